@@ -0,0 +1,73 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file amqpeventencoder.h
+*	@brief	Writes an IoTHub message as the AMQP sections of one event of a
+*			batched AMQP message.
+*
+*	@details	An event is its application-properties section, when the
+*				message has properties, followed by its data section. The
+*				sections are written straight from the content and the
+*				properties map of the message, without building AMQP values,
+*				into a buffer owned by the encoder. The buffer is reused from
+*				one event to the next, so encoding does not allocate once it
+*				has grown to the size of the largest event. The encoder is not
+*				thread safe.
+*/
+
+#ifndef AMQPEVENTENCODER_H
+#define AMQPEVENTENCODER_H
+
+#include <stddef.h>
+#include "azure_c_shared_utility/macro_utils.h"
+#include "iothub_message.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define AMQPEVENTENCODER_RESULT_VALUES      \
+    AMQPEVENTENCODER_OK,                    \
+    AMQPEVENTENCODER_INVALID_ARG,           \
+    AMQPEVENTENCODER_INVALID_MESSAGE,       \
+    AMQPEVENTENCODER_ERROR                  \
+
+DEFINE_ENUM(AMQPEVENTENCODER_RESULT, AMQPEVENTENCODER_RESULT_VALUES);
+
+typedef struct AMQPEVENTENCODER_TAG* AMQPEVENTENCODER_HANDLE;
+
+/**
+* @brief	Creates an encoder. Its buffer is allocated by the first call to
+*			AmqpEventEncoder_Encode.
+*
+* @return	A valid @c AMQPEVENTENCODER_HANDLE or @c NULL in case an error occurs.
+*/
+extern AMQPEVENTENCODER_HANDLE AmqpEventEncoder_Create(void);
+
+/**
+* @brief	Frees the encoder and its buffer.
+*/
+extern void AmqpEventEncoder_Destroy(AMQPEVENTENCODER_HANDLE encoder);
+
+/**
+* @brief	Encodes @p message.
+*
+* @param	encoder		The encoder.
+* @param	message		The message to encode.
+* @param	encoded		Receives the encoded sections. They stay valid until
+*						the next call to AmqpEventEncoder_Encode or
+*						AmqpEventEncoder_Destroy.
+* @param	size		Receives the size of the encoded sections.
+*
+* @return	AMQPEVENTENCODER_OK on success, AMQPEVENTENCODER_INVALID_MESSAGE
+*			if the content or the properties of @p message cannot be
+*			obtained or encoded, or another error code on failure.
+*/
+extern AMQPEVENTENCODER_RESULT AmqpEventEncoder_Encode(AMQPEVENTENCODER_HANDLE encoder, IOTHUB_MESSAGE_HANDLE message, const unsigned char** encoded, size_t* size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AMQPEVENTENCODER_H */
@@ -0,0 +1,87 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file deviceregistry.h
+*	@brief	A hashed index of the devices served by a transport.
+*
+*	@details	The registry answers "is this handle one of ours?" and "which
+*				device has this id?" in constant time, so that transports
+*				serving thousands of devices do not scan their device list on
+*				every call. Entries are looked up by the device handle and,
+*				when one was given, by the device id. The registry does not
+*				own the devices. It is not thread safe; callers serialize
+*				access the same way they serialize access to their device list.
+*/
+
+#ifndef DEVICEREGISTRY_H
+#define DEVICEREGISTRY_H
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+typedef struct DEVICE_REGISTRY_TAG* DEVICE_REGISTRY_HANDLE;
+
+typedef void(*DEVICE_REGISTRY_VISITOR)(const void* device, void* context);
+
+/**
+* @brief	Creates an empty registry.
+*
+* @return	A valid @c DEVICE_REGISTRY_HANDLE or @c NULL in case an error occurs.
+*/
+extern DEVICE_REGISTRY_HANDLE DeviceRegistry_Create(void);
+
+/**
+* @brief	Frees the registry. The registered devices are not touched.
+*/
+extern void DeviceRegistry_Destroy(DEVICE_REGISTRY_HANDLE registry);
+
+/**
+* @brief	Adds @p device to the registry.
+*
+* @param	registry	The registry.
+* @param	device		The device handle, used as the key of the entry.
+* @param	deviceId	The id of the device or @c NULL. The registry keeps a copy.
+*
+* @return	0 on success, any other value on error or if @p device or
+*			@p deviceId is already registered.
+*/
+extern int DeviceRegistry_Add(DEVICE_REGISTRY_HANDLE registry, const void* device, const char* deviceId);
+
+/**
+* @brief	Removes @p device from the registry. Does nothing if @p device is
+*			not registered.
+*/
+extern void DeviceRegistry_Remove(DEVICE_REGISTRY_HANDLE registry, const void* device);
+
+/**
+* @brief	Tells whether @p device is registered.
+*/
+extern bool DeviceRegistry_Contains(DEVICE_REGISTRY_HANDLE registry, const void* device);
+
+/**
+* @brief	Returns the device registered with @p deviceId or @c NULL.
+*/
+extern const void* DeviceRegistry_FindById(DEVICE_REGISTRY_HANDLE registry, const char* deviceId);
+
+/**
+* @brief	Returns the number of registered devices, 0 if @p registry is @c NULL.
+*/
+extern size_t DeviceRegistry_GetCount(DEVICE_REGISTRY_HANDLE registry);
+
+/**
+* @brief	Calls @p visitor once for every registered device, in no particular
+*			order. @p visitor must not add or remove devices.
+*/
+extern void DeviceRegistry_ForEach(DEVICE_REGISTRY_HANDLE registry, DEVICE_REGISTRY_VISITOR visitor, void* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEVICEREGISTRY_H */
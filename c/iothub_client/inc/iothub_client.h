@@ -103,6 +103,33 @@ extern "C"
 	*/
 	extern IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback);
 
+	/**
+	* @brief	Asynchronous call to send the message specified by @p eventMessageHandle,
+	* 			handing the message over to the client instead of copying it.
+	*
+	* @param	iotHubClientHandle		   	The handle created by a call to the create function.
+	* @param	eventMessageHandle		   	The handle to an IoT Hub message. When the call
+	* 										succeeds the client owns the message and destroys it
+	* 										once the message is completed; the caller shall not
+	* 										use or destroy @p eventMessageHandle afterwards. When
+	* 										the call fails the message still belongs to the caller.
+	* @param	eventConfirmationCallback  	The callback specified by the device for receiving
+	* 										confirmation of the delivery of the IoT Hub message.
+	* 										The user can specify a @c NULL value here to
+	* 										indicate that no callback is required.
+	* @param	userContextCallback			User specified context that will be provided to the
+	* 										callback. This can be @c NULL.
+	*
+	*			This avoids the copy of the payload and of the properties that
+	*			::IoTHubClient_SendEventAsync makes.
+	*
+	*			@b NOTE: The application behavior is undefined if the user calls
+	*			the ::IoTHubClient_Destroy function from within any callback.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync_Move(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback);
+
 	/**
 	* @brief	This function returns the current sending status for IoTHubClient.
 	*
@@ -111,7 +138,9 @@ extern "C"
 	* 									at by this parameter. The value will be set to
 	* 									@c IOTHUBCLIENT_SENDSTATUS_IDLE if there is currently
 	* 								    no item to be sent and @c IOTHUBCLIENT_SENDSTATUS_BUSY
-	* 								    if there are.
+	* 								    if there are. @c IOTHUB_CLIENT_SEND_STATUS_FULL means
+	* 								    the transport cannot accept more items in flight and
+	* 								    callers should hold further sends until it drains.
 	*
 	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
 	*/
@@ -181,13 +210,112 @@ extern "C"
 	*				- @b CURLOPT_VERBOSE - only available for HTTP protocol and only
 	*				  when CURL is used. It has the same meaning as CURL's option with the same
 	*				  name. @p value is pointer to a long.
+	*				- @b Batching - only available for HTTP and AMQP protocols. Sends several
+	*				  events in one request or batched message. @p value is a pointer to a
+	*				  @c bool.
+	*				- @b batching_max_events, @b batching_max_size - only available for AMQP
+	*				  protocol. The maximum number of events and bytes of a batched message.
+	*				  @p value is a pointer to a @c size_t.
+	*				- @b incoming_window_size, @b outgoing_window_size - only available for
+	*				  AMQP protocol. The windows of the AMQP sessions created afterwards.
+	*				  @p value is a pointer to a @c uint32_t.
+	*				- @b sender_max_link_size, @b receiver_max_link_size - only available for
+	*				  AMQP protocol. The maximum message size of the links created afterwards.
+	*				  @p value is a pointer to a @c uint64_t.
+	*				- @b max_unsettled_transfers - only available for AMQP protocol. The
+	*				  maximum number of AMQP messages a device leaves unsettled, 0 for no
+	*				  limit. @p value is a pointer to a @c size_t.
 	*				- @b messageTimeout - the maximum time in milliseconds until a message
 	*                 is timeouted. The time starts at IoTHubClient_SendEventAsync. By default,
 	*                 messages do not expire.
+	*				- @b MaxIdleSleepTime - the maximum time in milliseconds the worker
+	*				  thread sleeps between calls to IoTHubClient_LL_DoWork when there are
+	*				  no events waiting to be sent. The sleep starts at 1 ms and doubles on
+	*				  every idle iteration. @p value is a pointer to an @c unsigned @c int.
+	*				  The default is 16 ms; 1 makes the thread run every 1 ms. An event
+	*				  sent while the thread sleeps wakes it within 1 ms.
+	*				- @b messagePoolSize - the number of queue records to preallocate.
+	*				  @p value is a pointer to a @c size_t.
+	*				- @b messagePoolGrowth - the number of queue records allocated at once
+	*				  when the preallocated ones are all in use. @p value is a pointer to
+	*				  a @c size_t.
+	*				- @b messageStore - the prefix of the files of an on-disk store that
+	*				  keeps the messages queued past @b messageStoreWatermark until they
+	*				  can be sent, across restarts. @p value is a @c const @c char*.
+	*				- @b messageStoreWatermark - the number of messages kept in memory
+	*				  before new ones go to the message store. @p value is a pointer to
+	*				  a @c size_t.
+	*				- @b messageStoreSegmentSize - the size in bytes of the files of the
+	*				  message store. @p value is a pointer to a @c size_t.
+	*				- @b messageStoreSyncInterval - how many messages are appended to the
+	*				  message store between two waits for its files to reach the disk.
+	*				  0 leaves it to the operating system. @p value is a pointer to a
+	*				  @c size_t. The default is 1.
+	*				- @b priorityMaxOvertakes - how many messages of a higher priority
+	*				  can be queued ahead of a message that is already waiting. 0 keeps
+	*				  the order the messages were sent in. @p value is a pointer to a
+	*				  @c size_t. The default is 16.
+	*				- @b MessageDispatchQueueSize - when not 0, the message callback is
+	*				  called on a thread of its own instead of the worker thread, and
+	*				  this many received messages can wait for it; while the queue is
+	*				  full the client stops receiving and the messages stay with IoT
+	*				  Hub. With a transport that supports "AsyncMessageDisposition"
+	*				  (HTTP) each message is settled with the value the callback
+	*				  returns (IOTHUBMESSAGE_ASYNC_ACK abandons it); with the other
+	*				  transports each message is accepted when it is queued. @p value
+	*				  is a pointer to a @c size_t. The default is 0.
 	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
 	*/
 	extern IOTHUB_CLIENT_RESULT IoTHubClient_SetOption(IOTHUB_CLIENT_HANDLE iotHubClientHandle, const char* optionName, const void* value);
 
+	/**
+	* @brief	This function returns in the out parameter @p stats the usage
+	* 			counters of the pool the client takes its queue records from.
+	*
+	* @param	iotHubClientHandle	The handle created by a call to the create function.
+	* @param	stats				Out parameter receiving the counters.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_GetMessagePoolStats(IOTHUB_CLIENT_HANDLE iotHubClientHandle, NODEPOOL_STATS* stats);
+
+	/**
+	* @brief	This function returns in the out parameter @p stats how many
+	* 			messages of priority @p priority are waiting to be sent and
+	* 			how long the completed ones waited.
+	*
+	* @param	iotHubClientHandle	The handle created by a call to the create function.
+	* @param	priority			The priority the counters are returned for.
+	* @param	stats				Out parameter receiving the counters.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_GetPriorityLaneStats(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY priority, IOTHUB_CLIENT_PRIORITY_LANE_STATS* stats);
+
+	/**
+	* @brief	This function returns in the out parameter @p stats the queue,
+	* 			latency, retry, batch and byte counters of the client.
+	*
+	* @param	iotHubClientHandle	The handle created by a call to the create function.
+	* @param	stats				Out parameter receiving the counters.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStats(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_SEND_STATS* stats);
+
+	/**
+	* @brief	Completes a message for which the message callback returned
+	* 			@c IOTHUBMESSAGE_ASYNC_ACK. This can be called from any thread.
+	*
+	* @param	iotHubClientHandle	The handle created by a call to the create function.
+	* @param	message				The message handle that was passed to the message callback.
+	* @param	disposition			@c IOTHUBMESSAGE_ACCEPTED, @c IOTHUBMESSAGE_REJECTED or
+	* 								@c IOTHUBMESSAGE_ABANDONED.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_SendMessageDisposition(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition);
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,6 +28,7 @@
 #include "azure_c_shared_utility/xio.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "iothub_message.h"
+#include "nodepool.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -59,7 +60,8 @@ extern "C"
 
 #define IOTHUB_CLIENT_STATUS_VALUES       \
     IOTHUB_CLIENT_SEND_STATUS_IDLE,       \
-    IOTHUB_CLIENT_SEND_STATUS_BUSY        \
+    IOTHUB_CLIENT_SEND_STATUS_BUSY,       \
+    IOTHUB_CLIENT_SEND_STATUS_FULL        \
 
 	/** @brief Enumeration returned by the ::IoTHubClient_LL_GetSendStatus
 	*		   API to indicate the current sending status of the IoT Hub client.
@@ -75,7 +77,8 @@ extern "C"
 #define IOTHUBMESSAGE_DISPOSITION_RESULT_VALUES \
     IOTHUBMESSAGE_ACCEPTED, \
     IOTHUBMESSAGE_REJECTED, \
-    IOTHUBMESSAGE_ABANDONED
+    IOTHUBMESSAGE_ABANDONED, \
+    IOTHUBMESSAGE_ASYNC_ACK
 
 	/** @brief Enumeration returned by the callback which is invoked whenever the
 	*		   IoT Hub sends a message to the device.
@@ -136,6 +139,87 @@ extern "C"
 		const char* deviceSasToken;
 	} IOTHUB_CLIENT_DEVICE_CONFIG;
 
+	/** @brief	This struct captures the counters of the messages of one priority,
+	*			as returned by ::IoTHubClient_LL_GetPriorityLaneStats. */
+	typedef struct IOTHUB_CLIENT_PRIORITY_LANE_STATS_TAG
+	{
+		/** @brief	Messages of this priority queued in memory or being sent, that were not completed yet. */
+		size_t depth;
+
+		/** @brief	The highest value @c depth has had. */
+		size_t maxDepth;
+
+		/** @brief	Messages of this priority that the transport completed, whether they were sent or failed. */
+		size_t completed;
+
+		/** @brief	Sum of the milliseconds the @c completed messages spent between being queued and being completed. */
+		uint64_t totalLatencyMs;
+
+		/** @brief	The longest time in milliseconds a completed message spent between being queued and being completed. */
+		uint64_t maxLatencyMs;
+	} IOTHUB_CLIENT_PRIORITY_LANE_STATS;
+
+#define IOTHUB_CLIENT_HISTOGRAM_BUCKET_COUNT 20
+
+	/** @brief	This struct captures the distribution of a series of values, as
+	*			part of ::IOTHUB_CLIENT_SEND_STATS. */
+	typedef struct IOTHUB_CLIENT_HISTOGRAM_TAG
+	{
+		/** @brief	How many values were recorded. */
+		size_t count;
+
+		/** @brief	Sum of the recorded values. */
+		uint64_t total;
+
+		/** @brief	The largest recorded value. */
+		uint64_t max;
+
+		/** @brief	@c buckets[0] counts the values equal to 0 and @c buckets[i] the values from 2^(i-1) to 2^i - 1.
+		*			The last bucket also counts all the values larger than that. */
+		size_t buckets[IOTHUB_CLIENT_HISTOGRAM_BUCKET_COUNT];
+	} IOTHUB_CLIENT_HISTOGRAM;
+
+	/** @brief	This struct captures the counters of the messages sent and received
+	*			by a client, as returned by ::IoTHubClient_LL_GetSendStats. */
+	typedef struct IOTHUB_CLIENT_SEND_STATS_TAG
+	{
+		/** @brief	Messages queued in memory that the transport did not send yet. */
+		size_t queued;
+
+		/** @brief	Messages the transport sent that were not completed yet, including the ones it will send again. */
+		size_t inFlight;
+
+		/** @brief	Bytes of the @c inFlight messages, as sent by the transport. */
+		uint64_t bytesInFlight;
+
+		/** @brief	Messages completed with IOTHUB_CLIENT_CONFIRMATION_OK. */
+		size_t succeeded;
+
+		/** @brief	Messages completed with IOTHUB_CLIENT_CONFIRMATION_ERROR. */
+		size_t failed;
+
+		/** @brief	Messages completed with IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT. */
+		size_t timedOut;
+
+		/** @brief	How many times the transport sent again a message it had already sent. */
+		size_t retries;
+
+		/** @brief	Bytes of the messages sent by the transport, retries included. */
+		uint64_t bytesOut;
+
+		/** @brief	Bytes of the bodies of the messages received from IoT Hub. */
+		uint64_t bytesIn;
+
+		/** @brief	Milliseconds between queuing a message and the transport sending it for the first time. */
+		IOTHUB_CLIENT_HISTOGRAM enqueueToSendMs;
+
+		/** @brief	Milliseconds between the transport sending a message for the last time and the message being completed. */
+		IOTHUB_CLIENT_HISTOGRAM sendToConfirmMs;
+
+		/** @brief	Messages sent by the transport in one transfer. */
+		IOTHUB_CLIENT_HISTOGRAM batchSize;
+	} IOTHUB_CLIENT_SEND_STATS;
+
 	/** @brief	This struct captures IoTHub transport configuration. */
 	typedef struct IOTHUBTRANSPORT_CONFIG_TAG
 	{
@@ -219,6 +303,33 @@ extern "C"
 	*/
 	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback);
 
+	/**
+	* @brief	Asynchronous call to send the message specified by @p eventMessageHandle,
+	* 			handing the message over to the client instead of copying it.
+	*
+	* @param	iotHubClientHandle		   	The handle created by a call to the create function.
+	* @param	eventMessageHandle		   	The handle to an IoT Hub message. When the call
+	* 										succeeds the client owns the message and destroys it
+	* 										once the message is completed; the caller shall not
+	* 										use or destroy @p eventMessageHandle afterwards. When
+	* 										the call fails the message still belongs to the caller.
+	* @param	eventConfirmationCallback  	The callback specified by the device for receiving
+	* 										confirmation of the delivery of the IoT Hub message.
+	* 										The user can specify a @c NULL value here to
+	* 										indicate that no callback is required.
+	* @param	userContextCallback			User specified context that will be provided to the
+	* 										callback. This can be @c NULL.
+	*
+	*			This avoids the copy of the payload and of the properties that
+	*			::IoTHubClient_LL_SendEventAsync makes.
+	*
+	*			@b NOTE: The application behavior is undefined if the user calls
+	*			the ::IoTHubClient_LL_Destroy function from within any callback.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync_Move(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback);
+
 	/**
 	* @brief	This function returns the current sending status for IoTHubClient.
 	*
@@ -227,7 +338,9 @@ extern "C"
 	* 									at by this parameter. The value will be set to
 	* 									@c IOTHUBCLIENT_SENDSTATUS_IDLE if there is currently
 	* 								    no item to be sent and @c IOTHUBCLIENT_SENDSTATUS_BUSY
-	* 								    if there are.
+	* 								    if there are. @c IOTHUB_CLIENT_SEND_STATUS_FULL means
+	* 								    the transport cannot accept more items in flight and
+	* 								    callers should hold further sends until it drains.
 	*
 	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
 	*/
@@ -313,11 +426,130 @@ extern "C"
 	*                interval in seconds when pings are sent to the server.
 	*              - @b logtrace - available for MQTT protocol.  Boolean value that turns on and
 	*                off the diagnostic logging.
+	*              - @b maxinflight - available for MQTT protocol.  @c size_t value between 1 and
+	*                256 that sets how many messages may be waiting for PUBACK at once. While
+	*                the window is full and events are queued ::IoTHubClient_LL_GetSendStatus
+	*                reports @c IOTHUB_CLIENT_SEND_STATUS_FULL.
+	*              - @b Batching - available for HTTP and AMQP protocols. Boolean value that makes
+	*                the transport send several events in one request (HTTP) or in one batched
+	*                message (AMQP). Each event is still confirmed on its own.
+	*              - @b batching_max_events - available for AMQP protocol. @c size_t value with the
+	*                maximum number of events in one batched message. The default is 100.
+	*              - @b batching_max_size - available for AMQP protocol. @c size_t value with the
+	*                maximum size in bytes of one batched message. An event larger than that is
+	*                sent alone. The default is 261120 (255 KB).
+	*              - @b incoming_window_size, @b outgoing_window_size - available for AMQP
+	*                protocol. @c uint32_t values with the incoming and outgoing windows of the
+	*                AMQP session, in transfer frames. They apply to the sessions created
+	*                afterwards. The defaults are UINT32_MAX and 100.
+	*              - @b sender_max_link_size, @b receiver_max_link_size - available for AMQP
+	*                protocol. @c uint64_t values with the maximum message size of the links
+	*                sending events and receiving messages. They apply to the links created
+	*                afterwards. The defaults are UINT64_MAX and 65536.
+	*              - @b max_unsettled_transfers - available for AMQP protocol. @c size_t value
+	*                with the maximum number of AMQP messages, single events or batches, a
+	*                device leaves unsettled. Further events wait in the queue of the client,
+	*                and ::IoTHubClient_LL_GetSendStatus reports @c IOTHUB_CLIENT_SEND_STATUS_FULL
+	*                while they do. 0 means no limit, which is the default.
+	*              - @b messageTimeout - available for all protocols. @c uint64_t value in
+	*                milliseconds after which a message that was not sent times out. 0 disables
+	*                the timeout.
+	*              - @b messagePoolSize - available for all protocols. @c size_t value with the
+	*                number of queue records to preallocate, so that up to that many messages can
+	*                be queued without going to the heap.
+	*              - @b messagePoolGrowth - available for all protocols. @c size_t value with the
+	*                number of queue records allocated at once when the preallocated ones are all
+	*                in use. 0 makes every extra record a separate heap allocation.
+	*              - @b messageStore - available for all protocols. @c const @c char* prefix of the
+	*                files of an on-disk store. Past @b messageStoreWatermark queued messages, new
+	*                messages are appended to the store and sent once there is room again. The
+	*                messages left in the store are sent by the next client that opens it.
+	*              - @b messageStoreWatermark - @c size_t value with the number of messages kept in
+	*                memory before new ones go to the message store. The default is 1000.
+	*              - @b messageStoreSegmentSize - @c size_t value with the size in bytes of the
+	*                files of the message stores opened afterwards. The default is 1 MB.
+	*              - @b messageStoreSyncInterval - @c size_t value with the number of messages
+	*                appended to the message stores opened afterwards between two waits for
+	*                their files to reach the disk. 0 leaves it to the operating system. The
+	*                default is 1, so that a stored message survives a power loss.
+	*              - @b priorityMaxOvertakes - available for all protocols. @c size_t value with
+	*                the number of messages of a higher priority that can be queued ahead of a
+	*                message that is already waiting. Once it is reached, the waiting message
+	*                keeps its place, so that lower priorities are never starved. 0 sends the
+	*                messages in the order they were queued. The default is 16.
+	*              - @b AsyncMessageDisposition - @c bool value. When true, a message callback
+	*                can return @c IOTHUBMESSAGE_ASYNC_ACK and complete the message later with
+	*                ::IoTHubClient_LL_SendMessageDisposition. Only the HTTP transport accepts
+	*                true, the other transports complete a message when it is delivered. When
+	*                it is not set, @c IOTHUBMESSAGE_ASYNC_ACK abandons the message. The
+	*                default is false.
 	*
 	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
 	*/
 	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_SetOption(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* optionName, const void* value);
 
+	/**
+	* @brief	This function returns in the out parameter @p stats the usage
+	* 			counters of the pool the client takes its queue records from.
+	*
+	* @param	iotHubClientHandle	The handle created by a call to the create function.
+	* @param	stats				Out parameter receiving the hits, misses, records
+	* 								in use and high-water mark of the pool.
+	*
+	*			The counters can be used to tune the @b messagePoolSize and
+	*			@b messagePoolGrowth options.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetMessagePoolStats(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, NODEPOOL_STATS* stats);
+
+	/**
+	* @brief	This function returns in the out parameter @p stats the queue depth
+	* 			and latency counters of the messages of priority @p priority.
+	*
+	* @param	iotHubClientHandle	The handle created by a call to the create function.
+	* @param	priority			The priority set on the messages with
+	* 								::IoTHubMessage_SetPriority.
+	* @param	stats				Out parameter receiving the counters.
+	*
+	*			Messages appended to the message store are counted once they
+	*			are back in memory.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetPriorityLaneStats(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY priority, IOTHUB_CLIENT_PRIORITY_LANE_STATS* stats);
+
+	/**
+	* @brief	This function returns in the out parameter @p stats the queue,
+	* 			latency, retry, batch and byte counters of the client.
+	*
+	* @param	iotHubClientHandle	The handle created by a call to the create function.
+	* @param	stats				Out parameter receiving the counters.
+	*
+	*			The counters are always kept, their cost is a few additions per
+	*			message and one tick count read per transfer.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendStats(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_SEND_STATS* stats);
+
+	/**
+	* @brief	Completes a message for which the message callback returned
+	* 			@c IOTHUBMESSAGE_ASYNC_ACK.
+	*
+	* @param	iotHubClientHandle	The handle created by a call to the create function.
+	* @param	message				The message handle that was passed to the message callback.
+	* @param	disposition			@c IOTHUBMESSAGE_ACCEPTED, @c IOTHUBMESSAGE_REJECTED or
+	* 								@c IOTHUBMESSAGE_ABANDONED.
+	*
+	*			The transport sends the completion on its next ::IoTHubClient_LL_DoWork
+	*			and then destroys @p message, which must not be used after this call.
+	*			It fails unless the @b AsyncMessageDisposition option was set.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendMessageDisposition(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,6 +12,7 @@
 
 #include "iothub_message.h"
 #include "iothub_client_ll.h"
+#include "messagestore.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -44,8 +45,29 @@ typedef struct IOTHUB_MESSAGE_LIST_TAG
     void* context; 
     DLIST_ENTRY entry;
     uint64_t ms_timesOutAfter; /* a value of "0" means "no timeout", if the IOTHUBCLIENT_LL's handle tickcounter > msTimesOutAfer then the message shall timeout*/
+    MESSAGESTORE_SEGMENT_HANDLE storeSegment; /* NULL unless the message was replayed from the message store, in which case it is confirmed to the store once completed*/
+    IOTHUB_CLIENT_LL_HANDLE owner; /* the IoTHubClient_LL that queued the message, transports that complete messages one by one pass it to IoTHubClient_LL_SendComplete*/
+    IOTHUB_MESSAGE_PRIORITY priority;
+    size_t overtaken; /* how many messages of a higher priority were queued ahead of this one*/
+    uint64_t ms_queuedAt; /* tickcounter value when the message was queued, used for the latency of its priority lane*/
+    size_t sendAttempts; /* how many times the transport sent the message, 0 while it only waited in waitingToSend*/
+    uint64_t ms_sentAt; /* tickcounter value when the transport sent the message for the last time*/
+    size_t sentSize; /* bytes the transport sent for the message the last time, counted in flight until the message is completed*/
+    void* sender; /* set by transports that need to know, in their completion callbacks, which of their devices sent the message*/
 }IOTHUB_MESSAGE_LIST;
 
+/*the time of a message that could not be stamped*/
+#define UNKNOWN_QUEUED_TIME ((uint64_t)(-1))
+
+/*transports call this when they put messages on the wire: first and the count - 1 messages that follow it in its list go in one transfer of size bytes*/
+extern void IoTHubClient_LL_SendStarted(IOTHUB_CLIENT_LL_HANDLE handle, IOTHUB_MESSAGE_LIST* first, size_t count, size_t size);
+
+/*IoTHubClient calls this when it queues a message for IoTHubClient_LL_SendEventAsync_MoveQueuedAt. It only uses what IoTHubClient_LL_Create set up, so it is called without the lock that serializes the other calls*/
+extern uint64_t IoTHubClient_LL_GetCurrentTime(IOTHUB_CLIENT_LL_HANDLE handle);
+
+/*IoTHubClient_LL_SendEventAsync_Move for a message that waited in the queue of IoTHubClient since queuedAt (obtained from IoTHubClient_LL_GetCurrentTime)*/
+extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync_MoveQueuedAt(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, uint64_t queuedAt);
+
 
 #ifdef __cplusplus
 }
@@ -45,6 +45,18 @@ IOTHUBMESSAGE_UNKNOWN \
   */
 DEFINE_ENUM(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
 
+#define IOTHUB_MESSAGE_PRIORITY_VALUES \
+IOTHUB_MESSAGE_PRIORITY_LOW, \
+IOTHUB_MESSAGE_PRIORITY_NORMAL, \
+IOTHUB_MESSAGE_PRIORITY_HIGH \
+
+/** @brief Enumeration specifying the priority of a given message. Messages
+  * of a higher priority are sent before the messages of a lower priority
+  * that are waiting to be sent. New messages are of priority
+  * @c IOTHUB_MESSAGE_PRIORITY_NORMAL.
+  */
+DEFINE_ENUM(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
+
 typedef void* IOTHUB_MESSAGE_HANDLE;
 
 /**
@@ -75,6 +87,10 @@ extern IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source);
  * @brief   Creates a new IoT hub message with the content identical to that
  *          of the @p iotHubMessageHandle parameter.
  *
+ *          The message body is not copied; it is shared by the source and the
+ *          clone and released when the last of them is destroyed. Properties,
+ *          message id and correlation id are copied.
+ *
  * @param   iotHubMessageHandle Handle to the message that is to be cloned.
  *
  * @return  A valid @c IOTHUB_MESSAGE_HANDLE if the message was successfully
@@ -170,6 +186,28 @@ extern const char* IoTHubMessage_GetCorrelationId(IOTHUB_MESSAGE_HANDLE iotHubMe
 */
 extern IOTHUB_MESSAGE_RESULT IoTHubMessage_SetCorrelationId(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char* correlationId);
 
+/**
+* @brief   Gets the priority of the IOTHUB_MESSAGE_HANDLE.
+*
+* @param   iotHubMessageHandle Handle to the message.
+*
+* @return  The priority of the message, @c IOTHUB_MESSAGE_PRIORITY_NORMAL if
+*          @p iotHubMessageHandle is @c NULL.
+*/
+extern IOTHUB_MESSAGE_PRIORITY IoTHubMessage_GetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle);
+
+/**
+* @brief   Sets the priority of the IOTHUB_MESSAGE_HANDLE.
+*
+* @param   iotHubMessageHandle Handle to the message.
+* @param   priority The priority with which the message is queued by
+*          IoTHubClient_SendEventAsync and IoTHubClient_LL_SendEventAsync.
+*
+* @return  Returns IOTHUB_MESSAGE_OK if the priority was set successfully
+*          or an error code otherwise.
+*/
+extern IOTHUB_MESSAGE_RESULT IoTHubMessage_SetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY priority);
+
 /**
  * @brief   Frees all resources associated with the given message handle.
  *
@@ -39,6 +39,7 @@ extern "C"
 	typedef void (*pfIoTHubTransport_Unsubscribe)(IOTHUB_DEVICE_HANDLE handle);
 	typedef void (*pfIoTHubTransport_DoWork)(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle);
 	typedef IOTHUB_CLIENT_RESULT(*pfIoTHubTransport_GetSendStatus)(IOTHUB_DEVICE_HANDLE handle, IOTHUB_CLIENT_STATUS *iotHubClientStatus);
+	typedef IOTHUB_CLIENT_RESULT(*pfIoTHubTransport_SendMessageDisposition)(IOTHUB_DEVICE_HANDLE handle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition);
 
 #define TRANSPORT_PROVIDER_FIELDS                            \
 pfIoTHubTransport_SetOption IoTHubTransport_SetOption;       \
@@ -49,7 +50,8 @@ pfIotHubTransport_Unregister IoTHubTransport_Unregister;      \
 pfIoTHubTransport_Subscribe IoTHubTransport_Subscribe;       \
 pfIoTHubTransport_Unsubscribe IoTHubTransport_Unsubscribe;   \
 pfIoTHubTransport_DoWork IoTHubTransport_DoWork;             \
-pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus  /*there's an intentional missing ; on this line*/ \
+pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus;  \
+pfIoTHubTransport_SendMessageDisposition IoTHubTransport_SendMessageDisposition  /*there's an intentional missing ; on this line*/ \
 
 	typedef struct TRANSPORT_PROVIDER_TAG
 	{
@@ -17,14 +17,35 @@ extern "C"
 {
 #endif
 
+/*a transport can open several connections to IoT Hub and partition its IoTHubClients between them. Lower layer transports
+are not thread safe, so one connection cannot be driven by several threads: every connection is its own lower layer transport,
+driven by its own worker thread under its own lock. Each IoTHubClient is pinned to one connection, which keeps its messages in order.
+With MQTT_Protocol a connection still opens one socket and one TLS session per device, as IoT Hub authenticates one device per MQTT
+CONNECT: sharing the transport saves threads and DoWork calls, not sockets. Only AMQP_Protocol multiplexes its devices over one socket*/
+typedef struct IOTHUBTRANSPORT_CONNECTIONS_CONFIG_TAG
+{
+	size_t connectionCount; /*from 1 to 64*/
+	const int* cpuAffinity; /*NULL, or connectionCount CPU numbers the worker threads of the connections pin themselves to. A negative number leaves that worker unpinned*/
+} IOTHUBTRANSPORT_CONNECTIONS_CONFIG;
+
 extern TRANSPORT_HANDLE		IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol, const char* iotHubName, const char* iotHubSuffix);
+extern TRANSPORT_HANDLE		IoTHubTransport_CreateWithConnections(IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol, const char* iotHubName, const char* iotHubSuffix, const IOTHUBTRANSPORT_CONNECTIONS_CONFIG* connectionsConfig);
 extern void					IoTHubTransport_Destroy(TRANSPORT_HANDLE transportHandle);
+/*the lock and the lower layer transport of the first connection*/
 extern LOCK_HANDLE			IoTHubTransport_GetLock(TRANSPORT_HANDLE transportHandle);
 extern TRANSPORT_LL_HANDLE	IoTHubTransport_GetLLTransport(TRANSPORT_HANDLE transportHandle);
+/*the lock and the lower layer transport of the connection clientHandle is pinned to, pinning it on first use*/
+extern LOCK_HANDLE			IoTHubTransport_GetClientLock(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
+extern TRANSPORT_LL_HANDLE	IoTHubTransport_GetClientLLTransport(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
+extern void					IoTHubTransport_ReleaseClient(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
 extern IOTHUB_CLIENT_RESULT IoTHubTransport_StartWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
 extern bool					IoTHubTransport_SignalEndWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
 extern void					IoTHubTransport_JoinWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
 
+/*implemented by iothub_client.c, the transport worker thread calls them with the transport lock held*/
+extern void					IoTHubClient_SendQueuedEvents(IOTHUB_CLIENT_HANDLE iotHubClientHandle);
+extern void					IoTHubClient_RecordSendStatus(IOTHUB_CLIENT_HANDLE iotHubClientHandle);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,6 +12,12 @@ extern "C"
 {
 #endif
 
+	typedef struct HTTP_POLL_STATISTICS_TAG
+	{
+		size_t polls; /*GET requests that completed*/
+		size_t hits; /*GET requests that returned a message*/
+	} HTTP_POLL_STATISTICS;
+
 	extern TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONFIG* config);
 	extern void IoTHubTransportHttp_Destroy(TRANSPORT_LL_HANDLE handle);
 
@@ -25,6 +31,8 @@ extern "C"
 
 	extern IOTHUB_CLIENT_RESULT IoTHubTransportHttp_GetSendStatus(IOTHUB_DEVICE_HANDLE handle, IOTHUB_CLIENT_STATUS *iotHubClientStatus);
 	extern IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE handle, const char* optionName, const void* value);
+	extern IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SendMessageDisposition(IOTHUB_DEVICE_HANDLE handle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition);
+	extern IOTHUB_CLIENT_RESULT IoTHubTransportHttp_GetPollStatistics(TRANSPORT_LL_HANDLE handle, HTTP_POLL_STATISTICS* statistics);
 	extern const void* HTTP_Protocol(void);
 
 #ifdef __cplusplus
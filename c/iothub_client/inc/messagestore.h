@@ -0,0 +1,104 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file messagestore.h
+*	@brief	An append-only log of records kept in segment files.
+*
+*	@details	Records are appended at the end of the newest segment and read
+*				back in the order they were appended. A segment is deleted
+*				once every record in it has been read and confirmed. The log
+*				survives the process: creating a store on the path of an
+*				existing one reads the records that were not confirmed yet.
+*				Records are read at least once; a record that was read but
+*				not confirmed before the process ended is read again.
+*/
+
+#ifndef MESSAGESTORE_H
+#define MESSAGESTORE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#else
+#include <stdbool.h>
+#endif
+
+typedef struct MESSAGESTORE_TAG* MESSAGESTORE_HANDLE;
+typedef struct MESSAGESTORE_SEGMENT_TAG* MESSAGESTORE_SEGMENT_HANDLE;
+
+typedef struct MESSAGESTORE_RECORD_TAG
+{
+    /** @brief	The bytes of the record, valid until the next call to MessageStore_ReadNext. */
+    const unsigned char* data;
+
+    size_t size;
+
+    /** @brief	Pass it to MessageStore_Confirm once the record is not needed anymore. */
+    MESSAGESTORE_SEGMENT_HANDLE segment;
+
+    /** @brief	false if the record was appended before this store was created, by a previous process. */
+    bool appendedByThisStore;
+} MESSAGESTORE_RECORD;
+
+/**
+* @brief	Opens the log whose files are named after @p path, creating it if it
+*			does not exist.
+*
+* @param	path		Prefix of the names of the files of the log. The
+*						segments are called "path.N" and the number of the
+*						oldest segment is kept in "path.head".
+* @param	segmentSize	Size after which a segment is closed and a new one is
+*						started.
+*
+* @return	A handle to the store or @c NULL on failure.
+*/
+extern MESSAGESTORE_HANDLE MessageStore_Create(const char* path, size_t segmentSize);
+
+/**
+* @brief	Closes the log. The records that were not confirmed stay in the files.
+*/
+extern void MessageStore_Destroy(MESSAGESTORE_HANDLE store);
+
+/**
+* @brief	Appends a record of @p size bytes at the end of the log.
+*
+* @return	0 on success, a non-zero value otherwise.
+*/
+extern int MessageStore_Append(MESSAGESTORE_HANDLE store, const unsigned char* data, size_t size);
+
+/**
+* @brief	Sets after how many appended records MessageStore_Append waits for
+*			the newest segment to be written to the disk. The default is 1,
+*			every record; 0 leaves it to the operating system.
+*
+* @return	0 on success, a non-zero value otherwise.
+*/
+extern int MessageStore_SetSyncInterval(MESSAGESTORE_HANDLE store, size_t syncInterval);
+
+/**
+* @brief	Reads the oldest record that was not read yet.
+*
+* @return	0 if @p record was filled, a non-zero value if there is no record
+*			left to read or on failure.
+*/
+extern int MessageStore_ReadNext(MESSAGESTORE_HANDLE store, MESSAGESTORE_RECORD* record);
+
+/**
+* @brief	Tells whether every record of the log has been read.
+*/
+extern bool MessageStore_IsEmpty(MESSAGESTORE_HANDLE store);
+
+/**
+* @brief	Tells the store that a record read from @p segment is not needed
+*			anymore. Records can be confirmed in any order; the oldest
+*			segments are deleted as soon as all their records are confirmed.
+*/
+extern void MessageStore_Confirm(MESSAGESTORE_HANDLE store, MESSAGESTORE_SEGMENT_HANDLE segment);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MESSAGESTORE_H */
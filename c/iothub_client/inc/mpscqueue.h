@@ -0,0 +1,92 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file mpscqueue.h
+*	@brief	An intrusive, lock-free, multi-producer single-consumer queue.
+*
+*	@details	Any number of threads can push entries concurrently without
+*				taking a lock; a single consumer takes all the queued entries
+*				at once, in the order they were pushed. Like DLIST_ENTRY, the
+*				entry is embedded in the record that is queued and the record
+*				is found back with containingRecord. The queue never allocates.
+*
+*				Compilers the queue knows no atomic operations for (or builds
+*				defining MPSCQUEUE_USES_LOCK) get a queue guarded by a lock
+*				from azure_c_shared_utility/lock.h instead.
+*/
+
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#else
+#include <stdbool.h>
+#endif
+
+#if !defined(MPSCQUEUE_USES_LOCK) && !defined(_MSC_VER) && !defined(__GNUC__)
+#define MPSCQUEUE_USES_LOCK
+#endif
+
+#ifdef MPSCQUEUE_USES_LOCK
+#include "azure_c_shared_utility/lock.h"
+#endif
+
+typedef struct MPSC_QUEUE_ENTRY_TAG
+{
+    struct MPSC_QUEUE_ENTRY_TAG* next;
+} MPSC_QUEUE_ENTRY;
+
+typedef struct MPSC_QUEUE_TAG
+{
+    MPSC_QUEUE_ENTRY* volatile head; /*newest entry first*/
+#ifdef MPSCQUEUE_USES_LOCK
+    LOCK_HANDLE lock;
+#endif
+} MPSC_QUEUE;
+
+/**
+* @brief	Makes @p queue empty. Not thread safe, call it before the queue is shared.
+*
+* @return	0 on success. Only fails for a NULL @p queue or when the lock of
+*			an MPSCQUEUE_USES_LOCK build cannot be created.
+*/
+extern int MpscQueue_Initialize(MPSC_QUEUE* queue);
+
+/**
+* @brief	Releases what MpscQueue_Initialize acquired. The entries still in
+*			@p queue are left to the caller.
+*/
+extern void MpscQueue_Deinitialize(MPSC_QUEUE* queue);
+
+/**
+* @brief	Appends @p entry to @p queue. Can be called from any thread.
+*
+* @return	0 on success. Only fails for NULL arguments or when the lock of
+*			an MPSCQUEUE_USES_LOCK build cannot be taken.
+*/
+extern int MpscQueue_Push(MPSC_QUEUE* queue, MPSC_QUEUE_ENTRY* entry);
+
+/**
+* @brief	Empties @p queue. Only one thread at a time may call this.
+*
+* @return	The entries that were in the queue, oldest first, linked through
+*			their @c next field and terminated by @c NULL, or @c NULL if the
+*			queue was empty.
+*/
+extern MPSC_QUEUE_ENTRY* MpscQueue_PopAll(MPSC_QUEUE* queue);
+
+/**
+* @brief	Tells whether @p queue is empty. The answer can be out of date as
+*			soon as it is returned if producers are pushing concurrently.
+*			The head is read with a full memory barrier, so a flag written
+*			before the call is seen by any producer pushing afterwards.
+*/
+extern bool MpscQueue_IsEmpty(const MPSC_QUEUE* queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MPSCQUEUE_H */
@@ -0,0 +1,101 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file nodepool.h
+*	@brief	A pool of fixed-size nodes carved out of larger slabs.
+*
+*	@details	The pool is used for the small records that are allocated and
+*				freed for every message (queue entries, in-flight records), so
+*				that a long running device does not fragment its heap. Slabs
+*				are only released when the pool is destroyed. The pool is not
+*				thread safe; callers serialize access the same way they
+*				serialize access to the lists the nodes live in.
+*/
+
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct NODEPOOL_TAG* NODEPOOL_HANDLE;
+
+/** @brief	Usage counters of a node pool. */
+typedef struct NODEPOOL_STATS_TAG
+{
+    /** @brief	Number of NodePool_Alloc calls served by a free node. */
+    size_t hits;
+
+    /** @brief	Number of NodePool_Alloc calls that had to allocate from the heap. */
+    size_t misses;
+
+    /** @brief	Number of nodes currently handed out. */
+    size_t inUse;
+
+    /** @brief	Highest value ever reached by @c inUse. */
+    size_t highWaterMark;
+
+    /** @brief	Number of nodes owned by the slabs of the pool. */
+    size_t capacity;
+} NODEPOOL_STATS;
+
+/**
+* @brief	Creates a pool of nodes of @p nodeSize bytes.
+*
+* @param	nodeSize	Size of every node handed out by the pool.
+* @param	growth		Number of nodes in every slab allocated when the pool runs
+*						out of free nodes. A value of 0 makes an empty pool fall
+*						back to one heap allocation per node.
+*
+* @return	A valid @c NODEPOOL_HANDLE or @c NULL in case an error occurs.
+*/
+extern NODEPOOL_HANDLE NodePool_Create(size_t nodeSize, size_t growth);
+
+/**
+* @brief	Frees the pool and all its slabs. All the nodes must have been
+*			returned with NodePool_Free before calling this.
+*/
+extern void NodePool_Destroy(NODEPOOL_HANDLE pool);
+
+/**
+* @brief	Makes sure that at least @p count nodes are owned by the pool,
+*			allocating one slab for the missing ones.
+*
+* @return	0 on success, any other value on error.
+*/
+extern int NodePool_Reserve(NODEPOOL_HANDLE pool, size_t count);
+
+/**
+* @brief	Changes the number of nodes of the slabs allocated from now on.
+*
+* @return	0 on success, any other value on error.
+*/
+extern int NodePool_SetGrowth(NODEPOOL_HANDLE pool, size_t growth);
+
+/**
+* @brief	Hands out a node, or @c NULL if no memory is available.
+*/
+extern void* NodePool_Alloc(NODEPOOL_HANDLE pool);
+
+/**
+* @brief	Returns a node obtained from NodePool_Alloc to its pool. Does
+*			nothing if @p node is @c NULL.
+*/
+extern void NodePool_Free(void* node);
+
+/**
+* @brief	Copies the usage counters of the pool in @p stats.
+*
+* @return	0 on success, any other value on error.
+*/
+extern int NodePool_GetStats(NODEPOOL_HANDLE pool, NODEPOOL_STATS* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NODEPOOL_H */
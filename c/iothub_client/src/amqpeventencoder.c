@@ -0,0 +1,254 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <string.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/iot_logging.h"
+
+#include "amqpeventencoder.h"
+
+DEFINE_ENUM_STRINGS(AMQPEVENTENCODER_RESULT, AMQPEVENTENCODER_RESULT_VALUES);
+
+/*AMQP 1.0 encodings, see part 1 (types) and part 3 (messaging) of the specification*/
+#define AMQP_DESCRIBED_TYPE 0x00
+#define AMQP_SMALLULONG 0x53
+#define AMQP_DESCRIPTOR_APPLICATION_PROPERTIES 0x74
+#define AMQP_DESCRIPTOR_DATA 0x75
+#define AMQP_VBIN8 0xa0
+#define AMQP_VBIN32 0xb0
+#define AMQP_STR8_UTF8 0xa1
+#define AMQP_STR32_UTF8 0xb1
+#define AMQP_MAP8 0xc1
+#define AMQP_MAP32 0xd1
+
+/*described type constructor, smallulong constructor, descriptor code*/
+#define SECTION_DESCRIPTOR_SIZE 3
+/*constructor and the size of the variable width value*/
+#define VARIABLE8_HEADER_SIZE 2
+#define VARIABLE32_HEADER_SIZE 5
+/*constructor, size and count*/
+#define MAP8_HEADER_SIZE 3
+#define MAP32_HEADER_SIZE 9
+
+typedef struct AMQPEVENTENCODER_TAG
+{
+    unsigned char* buffer;
+    size_t capacity;
+} AMQPEVENTENCODER;
+
+static size_t variableWidthSize(size_t length)
+{
+    return ((length <= UINT8_MAX) ? VARIABLE8_HEADER_SIZE : VARIABLE32_HEADER_SIZE) + length;
+}
+
+static unsigned char* writeUInt32(unsigned char* position, uint32_t value)
+{
+    position[0] = (unsigned char)(value >> 24);
+    position[1] = (unsigned char)(value >> 16);
+    position[2] = (unsigned char)(value >> 8);
+    position[3] = (unsigned char)value;
+    return position + 4;
+}
+
+static unsigned char* writeDescriptor(unsigned char* position, unsigned char descriptor)
+{
+    position[0] = AMQP_DESCRIBED_TYPE;
+    position[1] = AMQP_SMALLULONG;
+    position[2] = descriptor;
+    return position + SECTION_DESCRIPTOR_SIZE;
+}
+
+static unsigned char* writeVariableWidth(unsigned char* position, unsigned char constructor8, unsigned char constructor32, const void* bytes, size_t length)
+{
+    if (length <= UINT8_MAX)
+    {
+        *position++ = constructor8;
+        *position++ = (unsigned char)length;
+    }
+    else
+    {
+        *position++ = constructor32;
+        position = writeUInt32(position, (uint32_t)length);
+    }
+    (void)memcpy(position, bytes, length);
+    return position + length;
+}
+
+static int growBuffer(AMQPEVENTENCODER* encoder, size_t size)
+{
+    int result;
+    if (size <= encoder->capacity)
+    {
+        result = 0;
+    }
+    else
+    {
+        unsigned char* newBuffer = (unsigned char*)realloc(encoder->buffer, size);
+        if (newBuffer == NULL)
+        {
+            LogError("unable to grow the encoding buffer to %lu bytes", (unsigned long)size);
+            result = __LINE__;
+        }
+        else
+        {
+            encoder->buffer = newBuffer;
+            encoder->capacity = size;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+AMQPEVENTENCODER_HANDLE AmqpEventEncoder_Create(void)
+{
+    /*Codes_SRS_AMQPEVENTENCODER_09_001: [ AmqpEventEncoder_Create shall allocate memory for the encoder and shall not allocate its buffer. ]*/
+    AMQPEVENTENCODER* result = (AMQPEVENTENCODER*)malloc(sizeof(AMQPEVENTENCODER));
+    if (result == NULL)
+    {
+        /*Codes_SRS_AMQPEVENTENCODER_09_002: [ If allocating memory fails then AmqpEventEncoder_Create shall fail and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else
+    {
+        /*Codes_SRS_AMQPEVENTENCODER_09_003: [ Otherwise AmqpEventEncoder_Create shall succeed and return a non-NULL handle. ]*/
+        result->buffer = NULL;
+        result->capacity = 0;
+    }
+    return result;
+}
+
+void AmqpEventEncoder_Destroy(AMQPEVENTENCODER_HANDLE encoder)
+{
+    /*Codes_SRS_AMQPEVENTENCODER_09_004: [ If encoder is NULL then AmqpEventEncoder_Destroy shall do nothing. ]*/
+    if (encoder != NULL)
+    {
+        /*Codes_SRS_AMQPEVENTENCODER_09_005: [ AmqpEventEncoder_Destroy shall free the buffer of the encoder and the encoder. ]*/
+        free(encoder->buffer);
+        free(encoder);
+    }
+}
+
+AMQPEVENTENCODER_RESULT AmqpEventEncoder_Encode(AMQPEVENTENCODER_HANDLE encoder, IOTHUB_MESSAGE_HANDLE message, const unsigned char** encoded, size_t* size)
+{
+    AMQPEVENTENCODER_RESULT result;
+    IOTHUBMESSAGE_CONTENT_TYPE contentType;
+    const unsigned char* content;
+    size_t contentSize;
+    MAP_HANDLE properties;
+    const char*const* keys;
+    const char*const* values;
+    size_t propertyCount;
+
+    /*Codes_SRS_AMQPEVENTENCODER_09_006: [ If encoder, message, encoded or size is NULL then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_INVALID_ARG. ]*/
+    if ((encoder == NULL) || (message == NULL) || (encoded == NULL) || (size == NULL))
+    {
+        LogError("invalid arg encoder=%p, message=%p, encoded=%p, size=%p", encoder, message, encoded, size);
+        result = AMQPEVENTENCODER_INVALID_ARG;
+    }
+    /*Codes_SRS_AMQPEVENTENCODER_09_007: [ AmqpEventEncoder_Encode shall get the content of message with IoTHubMessage_GetByteArray or IoTHubMessage_GetString, according to IoTHubMessage_GetContentType. ]*/
+    /*Codes_SRS_AMQPEVENTENCODER_09_008: [ If the content cannot be obtained, or the content type is IOTHUBMESSAGE_UNKNOWN, then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_INVALID_MESSAGE. ]*/
+    else if ((contentType = IoTHubMessage_GetContentType(message)) == IOTHUBMESSAGE_UNKNOWN)
+    {
+        LogError("cannot encode a message with content type IOTHUBMESSAGE_UNKNOWN");
+        result = AMQPEVENTENCODER_INVALID_MESSAGE;
+    }
+    else if ((contentType == IOTHUBMESSAGE_BYTEARRAY) &&
+        (IoTHubMessage_GetByteArray(message, &content, &contentSize) != IOTHUB_MESSAGE_OK))
+    {
+        LogError("failed getting the BYTE array representation of the message");
+        result = AMQPEVENTENCODER_INVALID_MESSAGE;
+    }
+    else if ((contentType == IOTHUBMESSAGE_STRING) &&
+        ((content = (const unsigned char*)IoTHubMessage_GetString(message)) == NULL))
+    {
+        LogError("failed getting the STRING representation of the message");
+        result = AMQPEVENTENCODER_INVALID_MESSAGE;
+    }
+    /*Codes_SRS_AMQPEVENTENCODER_09_009: [ AmqpEventEncoder_Encode shall get the properties of message with IoTHubMessage_Properties and Map_GetInternals. ]*/
+    else if (((properties = IoTHubMessage_Properties(message)) == NULL) ||
+        (Map_GetInternals(properties, &keys, &values, &propertyCount) != MAP_OK))
+    {
+        /*Codes_SRS_AMQPEVENTENCODER_09_010: [ If the properties cannot be obtained then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_INVALID_MESSAGE. ]*/
+        LogError("failed getting the properties of the message");
+        result = AMQPEVENTENCODER_INVALID_MESSAGE;
+    }
+    else
+    {
+        size_t propertiesSize = 0; /*size of the items of the map*/
+        size_t sectionsSize;
+        size_t i;
+
+        if (contentType == IOTHUBMESSAGE_STRING)
+        {
+            contentSize = strlen((const char*)content);
+        }
+
+        for (i = 0; i < propertyCount; i++)
+        {
+            propertiesSize += variableWidthSize(strlen(keys[i])) + variableWidthSize(strlen(values[i]));
+        }
+
+        sectionsSize = SECTION_DESCRIPTOR_SIZE + variableWidthSize(contentSize);
+        if (propertyCount > 0)
+        {
+            sectionsSize += SECTION_DESCRIPTOR_SIZE + propertiesSize +
+                (((propertiesSize + 1 <= UINT8_MAX) && (propertyCount * 2 <= UINT8_MAX)) ? MAP8_HEADER_SIZE : MAP32_HEADER_SIZE);
+        }
+
+        /*Codes_SRS_AMQPEVENTENCODER_09_011: [ If the encoded sections do not fit in 32 bits then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_INVALID_MESSAGE. ]*/
+        if ((uint64_t)sectionsSize > UINT32_MAX)
+        {
+            LogError("a message of %lu bytes is too big to be encoded", (unsigned long)sectionsSize);
+            result = AMQPEVENTENCODER_INVALID_MESSAGE;
+        }
+        /*Codes_SRS_AMQPEVENTENCODER_09_012: [ AmqpEventEncoder_Encode shall grow the buffer of the encoder with realloc only when the encoded sections do not fit in it. ]*/
+        else if (growBuffer(encoder, sectionsSize) != 0)
+        {
+            /*Codes_SRS_AMQPEVENTENCODER_09_013: [ If growing the buffer fails then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_ERROR, keeping the buffer it had. ]*/
+            result = AMQPEVENTENCODER_ERROR;
+        }
+        else
+        {
+            unsigned char* position = encoder->buffer;
+
+            /*Codes_SRS_AMQPEVENTENCODER_09_014: [ If message has properties, AmqpEventEncoder_Encode shall write an application-properties section holding a map of their keys and values as UTF-8 strings, using the 8 bit width encodings whenever they fit. ]*/
+            if (propertyCount > 0)
+            {
+                position = writeDescriptor(position, AMQP_DESCRIPTOR_APPLICATION_PROPERTIES);
+                if ((propertiesSize + 1 <= UINT8_MAX) && (propertyCount * 2 <= UINT8_MAX))
+                {
+                    *position++ = AMQP_MAP8;
+                    *position++ = (unsigned char)(propertiesSize + 1);
+                    *position++ = (unsigned char)(propertyCount * 2);
+                }
+                else
+                {
+                    *position++ = AMQP_MAP32;
+                    position = writeUInt32(position, (uint32_t)(propertiesSize + 4));
+                    position = writeUInt32(position, (uint32_t)(propertyCount * 2));
+                }
+
+                for (i = 0; i < propertyCount; i++)
+                {
+                    position = writeVariableWidth(position, AMQP_STR8_UTF8, AMQP_STR32_UTF8, keys[i], strlen(keys[i]));
+                    position = writeVariableWidth(position, AMQP_STR8_UTF8, AMQP_STR32_UTF8, values[i], strlen(values[i]));
+                }
+            }
+
+            /*Codes_SRS_AMQPEVENTENCODER_09_015: [ AmqpEventEncoder_Encode shall write a data section holding the content of message. ]*/
+            position = writeDescriptor(position, AMQP_DESCRIPTOR_DATA);
+            position = writeVariableWidth(position, AMQP_VBIN8, AMQP_VBIN32, content, contentSize);
+
+            /*Codes_SRS_AMQPEVENTENCODER_09_016: [ Otherwise AmqpEventEncoder_Encode shall set encoded to the buffer of the encoder, size to the size of the sections and return AMQPEVENTENCODER_OK. ]*/
+            *encoded = encoder->buffer;
+            *size = (size_t)(position - encoder->buffer);
+            result = AMQPEVENTENCODER_OK;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,353 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <stdint.h>
+#include <string.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/iot_logging.h"
+
+#include "deviceregistry.h"
+
+/*the bucket count is always a power of 2, it doubles when there are more entries than buckets*/
+#define INITIAL_BUCKET_COUNT 16
+
+typedef struct REGISTRY_ENTRY_TAG
+{
+    const void* device;
+    struct REGISTRY_ENTRY_TAG* nextByDevice;
+    struct REGISTRY_ENTRY_TAG* nextById;
+    size_t idHash;
+    char* deviceId; /*points right after the entry, NULL when the device was added without an id*/
+} REGISTRY_ENTRY;
+
+typedef struct DEVICE_REGISTRY_TAG
+{
+    REGISTRY_ENTRY** byDevice;
+    REGISTRY_ENTRY** byId; /*second half of the same allocation as byDevice*/
+    size_t bucketCount;
+    size_t count;
+} DEVICE_REGISTRY;
+
+static size_t hashDevice(const void* device)
+{
+    /*handles are aligned heap addresses, mix the bits so that the low ones are not always the same*/
+    uint64_t x = (uint64_t)(uintptr_t)device;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+static size_t hashId(const char* deviceId)
+{
+    /*FNV-1a*/
+    uint32_t h = 2166136261u;
+    while (*deviceId != '\0')
+    {
+        h ^= (unsigned char)*deviceId;
+        h *= 16777619u;
+        deviceId++;
+    }
+    return (size_t)h;
+}
+
+static REGISTRY_ENTRY** allocateBuckets(size_t bucketCount)
+{
+    REGISTRY_ENTRY** result = (REGISTRY_ENTRY**)malloc(2 * bucketCount * sizeof(REGISTRY_ENTRY*));
+    if (result == NULL)
+    {
+        LogError("unable to malloc %lu buckets", (unsigned long)bucketCount);
+    }
+    else
+    {
+        size_t i;
+        for (i = 0; i < 2 * bucketCount; i++)
+        {
+            result[i] = NULL;
+        }
+    }
+    return result;
+}
+
+static void linkEntry(DEVICE_REGISTRY* registry, REGISTRY_ENTRY* entry)
+{
+    size_t mask = registry->bucketCount - 1;
+    REGISTRY_ENTRY** deviceBucket = &(registry->byDevice[hashDevice(entry->device) & mask]);
+    entry->nextByDevice = *deviceBucket;
+    *deviceBucket = entry;
+    if (entry->deviceId != NULL)
+    {
+        REGISTRY_ENTRY** idBucket = &(registry->byId[entry->idHash & mask]);
+        entry->nextById = *idBucket;
+        *idBucket = entry;
+    }
+    else
+    {
+        entry->nextById = NULL;
+    }
+}
+
+static void grow(DEVICE_REGISTRY* registry)
+{
+    size_t newBucketCount = registry->bucketCount * 2;
+    REGISTRY_ENTRY** newBuckets = allocateBuckets(newBucketCount);
+    if (newBuckets == NULL)
+    {
+        /*the registry keeps working with longer chains*/
+        LogError("unable to grow the registry, keeping %lu buckets", (unsigned long)registry->bucketCount);
+    }
+    else
+    {
+        REGISTRY_ENTRY** oldBuckets = registry->byDevice;
+        size_t oldBucketCount = registry->bucketCount;
+        size_t i;
+        registry->byDevice = newBuckets;
+        registry->byId = newBuckets + newBucketCount;
+        registry->bucketCount = newBucketCount;
+        for (i = 0; i < oldBucketCount; i++)
+        {
+            REGISTRY_ENTRY* entry = oldBuckets[i];
+            while (entry != NULL)
+            {
+                REGISTRY_ENTRY* next = entry->nextByDevice;
+                linkEntry(registry, entry);
+                entry = next;
+            }
+        }
+        free(oldBuckets);
+    }
+}
+
+static REGISTRY_ENTRY** findByDevice(DEVICE_REGISTRY* registry, const void* device)
+{
+    REGISTRY_ENTRY** result = &(registry->byDevice[hashDevice(device) & (registry->bucketCount - 1)]);
+    while ((*result != NULL) && ((*result)->device != device))
+    {
+        result = &((*result)->nextByDevice);
+    }
+    return result;
+}
+
+static REGISTRY_ENTRY* findById(DEVICE_REGISTRY* registry, const char* deviceId, size_t idHash)
+{
+    REGISTRY_ENTRY* result = registry->byId[idHash & (registry->bucketCount - 1)];
+    while ((result != NULL) && ((result->idHash != idHash) || (strcmp(result->deviceId, deviceId) != 0)))
+    {
+        result = result->nextById;
+    }
+    return result;
+}
+
+DEVICE_REGISTRY_HANDLE DeviceRegistry_Create(void)
+{
+    /*Codes_SRS_DEVICEREGISTRY_02_001: [ DeviceRegistry_Create shall allocate memory for the registry and for its hash buckets. ]*/
+    DEVICE_REGISTRY* result = (DEVICE_REGISTRY*)malloc(sizeof(DEVICE_REGISTRY));
+    if (result == NULL)
+    {
+        /*Codes_SRS_DEVICEREGISTRY_02_002: [ If allocating memory fails then DeviceRegistry_Create shall fail and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else
+    {
+        result->byDevice = allocateBuckets(INITIAL_BUCKET_COUNT);
+        if (result->byDevice == NULL)
+        {
+            /*Codes_SRS_DEVICEREGISTRY_02_002: [ If allocating memory fails then DeviceRegistry_Create shall fail and return NULL. ]*/
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_DEVICEREGISTRY_02_003: [ Otherwise DeviceRegistry_Create shall succeed and return a non-NULL handle to an empty registry. ]*/
+            result->byId = result->byDevice + INITIAL_BUCKET_COUNT;
+            result->bucketCount = INITIAL_BUCKET_COUNT;
+            result->count = 0;
+        }
+    }
+    return (DEVICE_REGISTRY_HANDLE)result;
+}
+
+void DeviceRegistry_Destroy(DEVICE_REGISTRY_HANDLE handle)
+{
+    /*Codes_SRS_DEVICEREGISTRY_02_004: [ If registry is NULL then DeviceRegistry_Destroy shall do nothing. ]*/
+    if (handle != NULL)
+    {
+        DEVICE_REGISTRY* registry = (DEVICE_REGISTRY*)handle;
+        /*Codes_SRS_DEVICEREGISTRY_02_005: [ DeviceRegistry_Destroy shall free all the entries, the hash buckets and the registry itself. ]*/
+        size_t i;
+        for (i = 0; i < registry->bucketCount; i++)
+        {
+            REGISTRY_ENTRY* entry = registry->byDevice[i];
+            while (entry != NULL)
+            {
+                REGISTRY_ENTRY* next = entry->nextByDevice;
+                free(entry);
+                entry = next;
+            }
+        }
+        free(registry->byDevice);
+        free(registry);
+    }
+}
+
+int DeviceRegistry_Add(DEVICE_REGISTRY_HANDLE handle, const void* device, const char* deviceId)
+{
+    int result;
+    DEVICE_REGISTRY* registry = (DEVICE_REGISTRY*)handle;
+    if ((registry == NULL) || (device == NULL))
+    {
+        /*Codes_SRS_DEVICEREGISTRY_02_006: [ If registry or device is NULL then DeviceRegistry_Add shall fail and return a non-zero value. ]*/
+        LogError("invalid argument registry=%p device=%p", registry, device);
+        result = __LINE__;
+    }
+    else if (*findByDevice(registry, device) != NULL)
+    {
+        /*Codes_SRS_DEVICEREGISTRY_02_007: [ If device is already registered then DeviceRegistry_Add shall fail and return a non-zero value. ]*/
+        LogError("device %p is already registered", device);
+        result = __LINE__;
+    }
+    else
+    {
+        size_t idHash = (deviceId == NULL) ? 0 : hashId(deviceId);
+        if ((deviceId != NULL) && (findById(registry, deviceId, idHash) != NULL))
+        {
+            /*Codes_SRS_DEVICEREGISTRY_02_008: [ If deviceId is not NULL and a device with the same id is already registered then DeviceRegistry_Add shall fail and return a non-zero value. ]*/
+            LogError("device id %s is already registered", deviceId);
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_DEVICEREGISTRY_02_009: [ DeviceRegistry_Add shall allocate one entry holding device and a copy of deviceId. ]*/
+            size_t idSize = (deviceId == NULL) ? 0 : strlen(deviceId) + 1;
+            REGISTRY_ENTRY* entry = (REGISTRY_ENTRY*)malloc(sizeof(REGISTRY_ENTRY) + idSize);
+            if (entry == NULL)
+            {
+                /*Codes_SRS_DEVICEREGISTRY_02_010: [ If allocating the entry fails then DeviceRegistry_Add shall fail and return a non-zero value. ]*/
+                LogError("unable to malloc");
+                result = __LINE__;
+            }
+            else
+            {
+                entry->device = device;
+                entry->idHash = idHash;
+                if (deviceId == NULL)
+                {
+                    entry->deviceId = NULL;
+                }
+                else
+                {
+                    entry->deviceId = (char*)(entry + 1);
+                    (void)memcpy(entry->deviceId, deviceId, idSize);
+                }
+
+                /*Codes_SRS_DEVICEREGISTRY_02_011: [ When the registry holds more devices than hash buckets, DeviceRegistry_Add shall double the number of buckets. If that allocation fails the registry shall keep its current buckets. ]*/
+                if (registry->count >= registry->bucketCount)
+                {
+                    grow(registry);
+                }
+
+                /*Codes_SRS_DEVICEREGISTRY_02_012: [ Otherwise DeviceRegistry_Add shall index the entry by device and, if deviceId is not NULL, by deviceId, and return 0. ]*/
+                linkEntry(registry, entry);
+                registry->count++;
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
+
+void DeviceRegistry_Remove(DEVICE_REGISTRY_HANDLE handle, const void* device)
+{
+    /*Codes_SRS_DEVICEREGISTRY_02_013: [ If registry or device is NULL then DeviceRegistry_Remove shall do nothing. ]*/
+    if ((handle != NULL) && (device != NULL))
+    {
+        DEVICE_REGISTRY* registry = (DEVICE_REGISTRY*)handle;
+        REGISTRY_ENTRY** link = findByDevice(registry, device);
+        REGISTRY_ENTRY* entry = *link;
+        if (entry == NULL)
+        {
+            /*Codes_SRS_DEVICEREGISTRY_02_014: [ If device is not registered then DeviceRegistry_Remove shall do nothing. ]*/
+            LogError("device %p is not registered", device);
+        }
+        else
+        {
+            /*Codes_SRS_DEVICEREGISTRY_02_015: [ Otherwise DeviceRegistry_Remove shall remove the entry from both indexes and free it. ]*/
+            *link = entry->nextByDevice;
+            if (entry->deviceId != NULL)
+            {
+                REGISTRY_ENTRY** idLink = &(registry->byId[entry->idHash & (registry->bucketCount - 1)]);
+                while (*idLink != entry)
+                {
+                    idLink = &((*idLink)->nextById);
+                }
+                *idLink = entry->nextById;
+            }
+            free(entry);
+            registry->count--;
+        }
+    }
+}
+
+bool DeviceRegistry_Contains(DEVICE_REGISTRY_HANDLE handle, const void* device)
+{
+    DEVICE_REGISTRY* registry = (DEVICE_REGISTRY*)handle;
+    bool result;
+    if ((registry == NULL) || (device == NULL))
+    {
+        /*Codes_SRS_DEVICEREGISTRY_02_016: [ If registry or device is NULL then DeviceRegistry_Contains shall return false. ]*/
+        result = false;
+    }
+    else
+    {
+        /*Codes_SRS_DEVICEREGISTRY_02_017: [ Otherwise DeviceRegistry_Contains shall return true if device is registered and false otherwise. ]*/
+        result = (*findByDevice(registry, device) != NULL);
+    }
+    return result;
+}
+
+const void* DeviceRegistry_FindById(DEVICE_REGISTRY_HANDLE handle, const char* deviceId)
+{
+    DEVICE_REGISTRY* registry = (DEVICE_REGISTRY*)handle;
+    const void* result;
+    if ((registry == NULL) || (deviceId == NULL))
+    {
+        /*Codes_SRS_DEVICEREGISTRY_02_018: [ If registry or deviceId is NULL then DeviceRegistry_FindById shall return NULL. ]*/
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_DEVICEREGISTRY_02_019: [ Otherwise DeviceRegistry_FindById shall return the device registered with deviceId, or NULL if there is none. ]*/
+        REGISTRY_ENTRY* entry = findById(registry, deviceId, hashId(deviceId));
+        result = (entry == NULL) ? NULL : entry->device;
+    }
+    return result;
+}
+
+size_t DeviceRegistry_GetCount(DEVICE_REGISTRY_HANDLE handle)
+{
+    /*Codes_SRS_DEVICEREGISTRY_02_020: [ DeviceRegistry_GetCount shall return the number of registered devices, or 0 if registry is NULL. ]*/
+    return (handle == NULL) ? 0 : ((DEVICE_REGISTRY*)handle)->count;
+}
+
+void DeviceRegistry_ForEach(DEVICE_REGISTRY_HANDLE handle, DEVICE_REGISTRY_VISITOR visitor, void* context)
+{
+    /*Codes_SRS_DEVICEREGISTRY_02_021: [ If registry or visitor is NULL then DeviceRegistry_ForEach shall do nothing. ]*/
+    if ((handle != NULL) && (visitor != NULL))
+    {
+        DEVICE_REGISTRY* registry = (DEVICE_REGISTRY*)handle;
+        /*Codes_SRS_DEVICEREGISTRY_02_022: [ Otherwise DeviceRegistry_ForEach shall call visitor once for every registered device, passing the device and context. ]*/
+        size_t i;
+        for (i = 0; i < registry->bucketCount; i++)
+        {
+            REGISTRY_ENTRY* entry;
+            for (entry = registry->byDevice[i]; entry != NULL; entry = entry->nextByDevice)
+            {
+                visitor(entry->device, context);
+            }
+        }
+    }
+}
@@ -10,13 +10,17 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <stddef.h>
+#include <string.h>
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "iothub_client.h"
 #include "iothub_client_ll.h"
+#include "iothub_client_private.h"
 #include "iothubtransport.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/iot_logging.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "mpscqueue.h"
 
 typedef struct IOTHUB_CLIENT_INSTANCE_TAG
 {
@@ -25,17 +29,161 @@ typedef struct IOTHUB_CLIENT_INSTANCE_TAG
     THREAD_HANDLE ThreadHandle;
     LOCK_HANDLE LockHandle;
     sig_atomic_t StopThread;
+    sig_atomic_t WorkerThreadStarted; /*set under LockHandle once the (own or transport) worker thread serves this client, read without it by the senders*/
+    sig_atomic_t SendStatusBusy; /*set by the senders after queuing and by the (own or transport) worker thread after every DoWork, read without LockHandle by IoTHubClient_GetSendStatus*/
+    unsigned int IdleSleepTime;
+    unsigned int MaxIdleSleepTime; /*written without LockHandle by IoTHubClient_SetOption, the threads pick it up on their next sleep*/
+    MPSC_QUEUE EventsToSend; /*filled by SendEventAsync without taking LockHandle, emptied by the (own or transport) worker thread*/
+    IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC MessageCallback;
+    void* MessageUserContextCallback;
+    size_t MessageDispatchQueueSize; /*0 when the message callback runs on the worker thread*/
+    size_t MessagesWaitingForDispatch; /*guarded by LockHandle*/
+    bool DispatchPaused; /*guarded by LockHandle, set while receiving is paused because the dispatch queue is full*/
+    bool DispatchSettlesMessages; /*guarded by LockHandle, true while this module has "AsyncMessageDisposition" set on IoTHubClient_LL*/
+    THREAD_HANDLE DispatchThreadHandle;
+    MPSC_QUEUE MessagesToDispatch; /*filled by the (own or transport) worker thread, emptied by the dispatch thread*/
 } IOTHUB_CLIENT_INSTANCE;
 
+/*an event waiting in EventsToSend to be handed over to IoTHubClient_LL*/
+typedef struct QUEUED_EVENT_TAG
+{
+    MPSC_QUEUE_ENTRY entry;
+    IOTHUB_MESSAGE_HANDLE messageHandle; /*owned by the record*/
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback;
+    void* userContextCallback;
+    uint64_t queuedAt; /*on the clock of IoTHubClient_LL, so that "messageTimeout" runs from the call to SendEventAsync*/
+} QUEUED_EVENT;
+
+/*a received message waiting in MessagesToDispatch to be handed to the message callback by the dispatch thread*/
+typedef struct DISPATCHED_MESSAGE_TAG
+{
+    MPSC_QUEUE_ENTRY entry;
+    IOTHUB_MESSAGE_HANDLE messageHandle; /*a clone owned by the record*/
+    IOTHUB_MESSAGE_HANDLE receivedMessageHandle; /*owned by IoTHubClient_LL until it is settled, NULL if it was accepted when it was queued*/
+    IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback;
+    void* userContextCallback;
+} DISPATCHED_MESSAGE;
+
+#define WORKER_THREAD_BUSY_SLEEP_TIME 1
+#define WORKER_THREAD_DEFAULT_MAX_IDLE_SLEEP_TIME 16
+
 /*used by unittests only*/
 const size_t IoTHubClient_ThreadTerminationOffset = offsetof(IOTHUB_CLIENT_INSTANCE, StopThread);
 
+/*the queues only need resources of their own where the compiler has no atomics, see mpscqueue.h*/
+static int InitializeQueues(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    int result;
+    if (MpscQueue_Initialize(&iotHubClientInstance->EventsToSend) != 0)
+    {
+        result = __LINE__;
+        LogError("unable to MpscQueue_Initialize");
+    }
+    else if (MpscQueue_Initialize(&iotHubClientInstance->MessagesToDispatch) != 0)
+    {
+        MpscQueue_Deinitialize(&iotHubClientInstance->EventsToSend);
+        result = __LINE__;
+        LogError("unable to MpscQueue_Initialize");
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*hands the events queued by the senders over to IoTHubClient_LL, oldest first. Called with LockHandle (the transport lock when the transport is shared) held*/
+static void MoveQueuedEvents(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    /*Codes_SRS_IOTHUBCLIENT_02_073: [ Before calling IoTHubClient_LL_DoWork the thread shall take all the queued events and call IoTHubClient_LL_SendEventAsync_MoveQueuedAt for each of them, with the time it was queued at, in the order they were queued, under the same lock. ]*/
+    MPSC_QUEUE_ENTRY* current = MpscQueue_PopAll(&iotHubClientInstance->EventsToSend);
+    if (current != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_050: [ When the thread hands at least one queued event over to IoTHubClient_LL it shall reset its sleep time to 1 ms. ]*/
+        iotHubClientInstance->IdleSleepTime = WORKER_THREAD_BUSY_SLEEP_TIME;
+    }
+    while (current != NULL)
+    {
+        QUEUED_EVENT* queuedEvent = containingRecord(current, QUEUED_EVENT, entry);
+        current = current->next;
+        if (IoTHubClient_LL_SendEventAsync_MoveQueuedAt(iotHubClientInstance->IoTHubClientLLHandle, queuedEvent->messageHandle, queuedEvent->eventConfirmationCallback, queuedEvent->userContextCallback, queuedEvent->queuedAt) != IOTHUB_CLIENT_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_074: [ If IoTHubClient_LL_SendEventAsync_MoveQueuedAt fails then the thread shall call the event's eventConfirmationCallback (if any) with IOTHUB_CLIENT_CONFIRMATION_ERROR and destroy the event's message. ]*/
+            LogError("unable to hand a queued event over to IoTHubClient_LL");
+            if (queuedEvent->eventConfirmationCallback != NULL)
+            {
+                queuedEvent->eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, queuedEvent->userContextCallback);
+            }
+            IoTHubMessage_Destroy(queuedEvent->messageHandle);
+        }
+        free(queuedEvent);
+    }
+}
+
+void IoTHubClient_SendQueuedEvents(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_02_077: [ If iotHubClientHandle is NULL then IoTHubClient_SendQueuedEvents shall do nothing. ]*/
+    if (iotHubClientHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_078: [ Otherwise IoTHubClient_SendQueuedEvents shall take all the events queued for iotHubClientHandle and hand them over to IoTHubClient_LL the same way the worker thread does before calling IoTHubClient_LL_DoWork. ]*/
+        MoveQueuedEvents((IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle);
+    }
+}
+
+/*records for IoTHubClient_GetSendStatus what IoTHubClient_LL reports after DoWork. Called with LockHandle (the transport lock when the transport is shared) held*/
+static IOTHUB_CLIENT_STATUS RecordSendStatus(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    IOTHUB_CLIENT_STATUS sendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+
+    /*Codes_SRS_IOTHUBCLIENT_02_047: [ After calling IoTHubClient_LL_DoWork the thread shall call IoTHubClient_LL_GetSendStatus (under the same lock) to find out if there are events waiting to be sent. ]*/
+    if (IoTHubClient_LL_GetSendStatus(iotHubClientInstance->IoTHubClientLLHandle, &sendStatus) != IOTHUB_CLIENT_OK)
+    {
+        sendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_02_106: [ The thread shall keep what IoTHubClient_LL_GetSendStatus reported, taking a failure as IOTHUB_CLIENT_SEND_STATUS_BUSY, for IoTHubClient_GetSendStatus. ]*/
+    iotHubClientInstance->SendStatusBusy = (sendStatus != IOTHUB_CLIENT_SEND_STATUS_IDLE);
+
+    /*an event queued after IoTHubClient_LL_GetSendStatus was called is not in sendStatus and its busy mark might just have been overwritten, so IDLE only stands once the queue is seen empty after the store (MpscQueue_IsEmpty is a full barrier)*/
+    if ((sendStatus == IOTHUB_CLIENT_SEND_STATUS_IDLE) && !MpscQueue_IsEmpty(&iotHubClientInstance->EventsToSend))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_112: [ If after keeping IOTHUB_CLIENT_SEND_STATUS_IDLE the queue of events is not empty then the thread shall keep IOTHUB_CLIENT_SEND_STATUS_BUSY instead. ]*/
+        sendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        iotHubClientInstance->SendStatusBusy = 1;
+    }
+
+    return sendStatus;
+}
+
+void IoTHubClient_RecordSendStatus(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_02_107: [ If iotHubClientHandle is NULL then IoTHubClient_RecordSendStatus shall do nothing. ]*/
+    if (iotHubClientHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_108: [ Otherwise IoTHubClient_RecordSendStatus shall record the send status of iotHubClientHandle the same way the worker thread does after calling IoTHubClient_LL_DoWork. ]*/
+        (void)RecordSendStatus((IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle);
+    }
+}
+
+/*sleeps sleepTime ms in slices of WORKER_THREAD_BUSY_SLEEP_TIME, so that an event queued by SendEventAsync does not wait for the whole idle sleep*/
+static void WorkerThreadSleep(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, unsigned int sleepTime)
+{
+    unsigned int sleptTime = 0;
+    /*Codes_SRS_IOTHUBCLIENT_02_115: [ The thread shall sleep in slices of 1 ms and stop sleeping as soon as an event is queued or the thread is told to stop. ]*/
+    do
+    {
+        (void)ThreadAPI_Sleep(WORKER_THREAD_BUSY_SLEEP_TIME);
+        sleptTime += WORKER_THREAD_BUSY_SLEEP_TIME;
+    } while ((sleptTime < sleepTime) && MpscQueue_IsEmpty(&iotHubClientInstance->EventsToSend) && !iotHubClientInstance->StopThread);
+}
+
 static int ScheduleWork_Thread(void* threadArgument)
 {
     IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)threadArgument;
     
     while (1)
     {
+        unsigned int sleepTime = WORKER_THREAD_BUSY_SLEEP_TIME;
+
         if (Lock(iotHubClientInstance->LockHandle) == LOCK_OK)
         {
             /*Codes_SRS_IOTHUBCLIENT_01_038: [ The thread shall exit when IoTHubClient_Destroy is called. ]*/
@@ -46,9 +194,30 @@ static int ScheduleWork_Thread(void* threadArgument)
             }
             else
             {
+                MoveQueuedEvents(iotHubClientInstance);
+
                 /* Codes_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_SendEvent or IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_DoWork every 1 ms.] */
                 /* Codes_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
                 IoTHubClient_LL_DoWork(iotHubClientInstance->IoTHubClientLLHandle);
+
+                if (RecordSendStatus(iotHubClientInstance) != IOTHUB_CLIENT_SEND_STATUS_IDLE)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_02_048: [ If IoTHubClient_LL_GetSendStatus fails or reports IOTHUB_CLIENT_SEND_STATUS_BUSY then the thread shall sleep 1 ms before calling IoTHubClient_LL_DoWork again. ]*/
+                    iotHubClientInstance->IdleSleepTime = WORKER_THREAD_BUSY_SLEEP_TIME;
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_02_049: [ If IoTHubClient_LL_GetSendStatus reports IOTHUB_CLIENT_SEND_STATUS_IDLE then the thread shall double the time it sleeps, up to the value of the option "MaxIdleSleepTime". ]*/
+                    if (iotHubClientInstance->IdleSleepTime < iotHubClientInstance->MaxIdleSleepTime / 2)
+                    {
+                        iotHubClientInstance->IdleSleepTime *= 2;
+                    }
+                    else
+                    {
+                        iotHubClientInstance->IdleSleepTime = iotHubClientInstance->MaxIdleSleepTime;
+                    }
+                }
+                sleepTime = iotHubClientInstance->IdleSleepTime;
                 (void)Unlock(iotHubClientInstance->LockHandle);
             }
         }
@@ -57,12 +226,226 @@ static int ScheduleWork_Thread(void* threadArgument)
             /*Codes_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClient_LL_DoWork shall not be called.]*/
             /*no code, shall retry*/
         }
-        (void)ThreadAPI_Sleep(1);
+        WorkerThreadSleep(iotHubClientInstance, sleepTime);
     }
        
     return 0;
 }
 
+static IOTHUBMESSAGE_DISPOSITION_RESULT DispatchMessageCallback(IOTHUB_MESSAGE_HANDLE message, void* userContextCallback);
+
+/*turns "AsyncMessageDisposition" off once the dispatch thread is not used anymore and has settled the messages it had. Called with LockHandle held*/
+static void ReleaseAsyncMessageDisposition(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    if (iotHubClientInstance->DispatchSettlesMessages &&
+        (iotHubClientInstance->MessageDispatchQueueSize == 0) &&
+        (iotHubClientInstance->MessagesWaitingForDispatch == 0))
+    {
+        bool asyncMessageDisposition = false;
+        /*Codes_SRS_IOTHUBCLIENT_02_113: [ Once "MessageDispatchQueueSize" is 0 again and no received message waits to be settled by the dispatch thread, IoTHubClient_LL_SetOption shall be called with "AsyncMessageDisposition" set to false. ]*/
+        if (IoTHubClient_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, "AsyncMessageDisposition", &asyncMessageDisposition) != IOTHUB_CLIENT_OK)
+        {
+            LogError("unable to turn \"AsyncMessageDisposition\" off");
+        }
+        else
+        {
+            iotHubClientInstance->DispatchSettlesMessages = false;
+        }
+    }
+}
+
+static int Dispatch_Thread(void* threadArgument)
+{
+    IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)threadArgument;
+    unsigned int sleepTime = WORKER_THREAD_BUSY_SLEEP_TIME;
+    sig_atomic_t stopThread = 0;
+
+    while (!stopThread)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_093: [ The dispatch thread shall take all the queued messages and, in the order they were received, call the message callback with each of them without holding the lock, then destroy the message. ]*/
+        MPSC_QUEUE_ENTRY* current = MpscQueue_PopAll(&iotHubClientInstance->MessagesToDispatch);
+        if (current == NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_096: [ When there are no queued messages the dispatch thread shall sleep, starting at 1 ms and doubling up to the value of the option "MaxIdleSleepTime". ]*/
+            (void)ThreadAPI_Sleep(sleepTime);
+            if (sleepTime < iotHubClientInstance->MaxIdleSleepTime / 2)
+            {
+                sleepTime *= 2;
+            }
+            else
+            {
+                sleepTime = iotHubClientInstance->MaxIdleSleepTime;
+            }
+        }
+        else
+        {
+            sleepTime = WORKER_THREAD_BUSY_SLEEP_TIME;
+            while (current != NULL)
+            {
+                DISPATCHED_MESSAGE* dispatchedMessage = containingRecord(current, DISPATCHED_MESSAGE, entry);
+                IOTHUBMESSAGE_DISPOSITION_RESULT disposition = dispatchedMessage->messageCallback(dispatchedMessage->messageHandle, dispatchedMessage->userContextCallback);
+                current = current->next;
+                if ((dispatchedMessage->receivedMessageHandle != NULL) && (disposition == IOTHUBMESSAGE_ASYNC_ACK))
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_02_101: [ If the message callback returns IOTHUBMESSAGE_ASYNC_ACK the received message shall be abandoned, since the callback was only given a clone of it. ]*/
+                    LogError("IOTHUBMESSAGE_ASYNC_ACK cannot be used with \"MessageDispatchQueueSize\", the message is abandoned");
+                    disposition = IOTHUBMESSAGE_ABANDONED;
+                }
+                IoTHubMessage_Destroy(dispatchedMessage->messageHandle);
+
+                /*Codes_SRS_IOTHUBCLIENT_02_094: [ After calling the message callback, the dispatch thread shall, under the lock, settle the received message by calling IoTHubClient_LL_SendMessageDisposition with what the callback returned and make room for one more message in the dispatch queue. ]*/
+                if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+                {
+                    LogError("unable to Lock, the message is left to IoT Hub to deliver again");
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_02_102: [ Once IoTHubClient_Destroy has signalled the dispatch thread to end, the received messages shall not be settled anymore. ]*/
+                    if (!iotHubClientInstance->StopThread &&
+                        (dispatchedMessage->receivedMessageHandle != NULL) &&
+                        (IoTHubClient_LL_SendMessageDisposition(iotHubClientInstance->IoTHubClientLLHandle, dispatchedMessage->receivedMessageHandle, disposition) != IOTHUB_CLIENT_OK))
+                    {
+                        LogError("unable to IoTHubClient_LL_SendMessageDisposition");
+                    }
+                    iotHubClientInstance->MessagesWaitingForDispatch--;
+                    ReleaseAsyncMessageDisposition(iotHubClientInstance);
+                    (void)Unlock(iotHubClientInstance->LockHandle);
+                }
+                free(dispatchedMessage);
+            }
+        }
+
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            LogError("unable to Lock, will retry");
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_095: [ The dispatch thread shall exit when IoTHubClient_Destroy is called. ]*/
+            stopThread = iotHubClientInstance->StopThread;
+            if (!stopThread &&
+                iotHubClientInstance->DispatchPaused &&
+                (iotHubClientInstance->MessagesWaitingForDispatch < iotHubClientInstance->MessageDispatchQueueSize))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_103: [ When receiving is paused and there is room in the dispatch queue again, the dispatch thread shall resume receiving by calling IoTHubClient_LL_SetMessageCallback with the callback that queues the messages for it. ]*/
+                if (IoTHubClient_LL_SetMessageCallback(iotHubClientInstance->IoTHubClientLLHandle, DispatchMessageCallback, iotHubClientInstance) != IOTHUB_CLIENT_OK)
+                {
+                    LogError("unable to resume receiving, will retry");
+                }
+                else
+                {
+                    iotHubClientInstance->DispatchPaused = false;
+                }
+            }
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return 0;
+}
+
+/*registered with IoTHubClient_LL instead of the user's callback when "MessageDispatchQueueSize" is not 0. Called by the worker thread with LockHandle held*/
+static IOTHUBMESSAGE_DISPOSITION_RESULT DispatchMessageCallback(IOTHUB_MESSAGE_HANDLE message, void* userContextCallback)
+{
+    IOTHUBMESSAGE_DISPOSITION_RESULT result;
+    IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)userContextCallback;
+    DISPATCHED_MESSAGE* dispatchedMessage = (DISPATCHED_MESSAGE*)malloc(sizeof(DISPATCHED_MESSAGE));
+
+    if (dispatchedMessage == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_092: [ If allocating the queue record, cloning the message or queuing it fails, the received message shall be abandoned. ]*/
+        result = IOTHUBMESSAGE_ABANDONED;
+        LogError("unable to malloc");
+    }
+    else if ((dispatchedMessage->messageHandle = IoTHubMessage_Clone(message)) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_092: [ If allocating the queue record, cloning the message or queuing it fails, the received message shall be abandoned. ]*/
+        result = IOTHUBMESSAGE_ABANDONED;
+        LogError("unable to IoTHubMessage_Clone");
+        free(dispatchedMessage);
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_090: [ Otherwise a clone of the received message (obtained by calling IoTHubMessage_Clone) shall be queued for the dispatch thread together with the received message, the message callback and its context, and IOTHUBMESSAGE_ASYNC_ACK shall be returned, leaving the received message to be settled by the dispatch thread. ]*/
+        /*Codes_SRS_IOTHUBCLIENT_02_114: [ If IoTHubClient_LL did not accept "AsyncMessageDisposition", the received message shall not be kept with the clone and IOTHUBMESSAGE_ACCEPTED shall be returned instead of IOTHUBMESSAGE_ASYNC_ACK, so what the message callback returns is not sent to IoT Hub. ]*/
+        dispatchedMessage->receivedMessageHandle = iotHubClientInstance->DispatchSettlesMessages ? message : NULL;
+        dispatchedMessage->messageCallback = iotHubClientInstance->MessageCallback;
+        dispatchedMessage->userContextCallback = iotHubClientInstance->MessageUserContextCallback;
+        if (MpscQueue_Push(&iotHubClientInstance->MessagesToDispatch, &dispatchedMessage->entry) != 0)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_092: [ If allocating the queue record, cloning the message or queuing it fails, the received message shall be abandoned. ]*/
+            result = IOTHUBMESSAGE_ABANDONED;
+            LogError("unable to MpscQueue_Push");
+            IoTHubMessage_Destroy(dispatchedMessage->messageHandle);
+            free(dispatchedMessage);
+        }
+        else
+        {
+            iotHubClientInstance->MessagesWaitingForDispatch++;
+            result = iotHubClientInstance->DispatchSettlesMessages ? IOTHUBMESSAGE_ASYNC_ACK : IOTHUBMESSAGE_ACCEPTED;
+
+            if (!iotHubClientInstance->DispatchPaused &&
+                (iotHubClientInstance->MessagesWaitingForDispatch >= iotHubClientInstance->MessageDispatchQueueSize))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_091: [ When "MessageDispatchQueueSize" messages are waiting for the dispatch thread, receiving shall be paused by calling IoTHubClient_LL_SetMessageCallback with a NULL callback, leaving the next messages with IoT Hub until there is room again. ]*/
+                if (IoTHubClient_LL_SetMessageCallback(iotHubClientInstance->IoTHubClientLLHandle, NULL, NULL) != IOTHUB_CLIENT_OK)
+                {
+                    LogError("unable to pause receiving, the dispatch queue grows past \"MessageDispatchQueueSize\"");
+                }
+                else
+                {
+                    iotHubClientInstance->DispatchPaused = true;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*registers the message callback with IoTHubClient_LL, directly or through the dispatch thread. Called with LockHandle held*/
+static IOTHUB_CLIENT_RESULT SetLLMessageCallback(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if ((iotHubClientInstance->MessageCallback == NULL) ||
+        (iotHubClientInstance->MessageDispatchQueueSize == 0))
+    {
+        /* Codes_SRS_IOTHUBCLIENT_01_017: [IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_SetMessageCallback, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters messageCallback and userContextCallback.] */
+        result = IoTHubClient_LL_SetMessageCallback(iotHubClientInstance->IoTHubClientLLHandle, iotHubClientInstance->MessageCallback, iotHubClientInstance->MessageUserContextCallback);
+    }
+    else
+    {
+        if (iotHubClientInstance->DispatchThreadHandle == NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_089: [ When "MessageDispatchQueueSize" is not 0 and messageCallback is not NULL, IoTHubClient_SetMessageCallback shall start the dispatch thread if it was not previously started, and call IoTHubClient_LL_SetMessageCallback with a callback of its own that queues the received messages for the dispatch thread. ]*/
+            if (ThreadAPI_Create(&iotHubClientInstance->DispatchThreadHandle, Dispatch_Thread, iotHubClientInstance) != THREADAPI_OK)
+            {
+                iotHubClientInstance->DispatchThreadHandle = NULL;
+            }
+        }
+
+        if (iotHubClientInstance->DispatchThreadHandle == NULL)
+        {
+            /* Codes_SRS_IOTHUBCLIENT_01_015: [If starting the thread fails, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not start dispatch thread");
+        }
+        else
+        {
+            result = IoTHubClient_LL_SetMessageCallback(iotHubClientInstance->IoTHubClientLLHandle, DispatchMessageCallback, iotHubClientInstance);
+        }
+    }
+
+    if (result == IOTHUB_CLIENT_OK)
+    {
+        /*the registration made here replaces any pause made because the dispatch queue was full*/
+        iotHubClientInstance->DispatchPaused = false;
+    }
+
+    return result;
+}
+
 static IOTHUB_CLIENT_RESULT StartWorkerThreadIfNeeded(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
 {
 	IOTHUB_CLIENT_RESULT result;
@@ -71,6 +454,7 @@ static IOTHUB_CLIENT_RESULT StartWorkerThreadIfNeeded(IOTHUB_CLIENT_INSTANCE* io
 		if (iotHubClientInstance->ThreadHandle == NULL)
 		{
 			iotHubClientInstance->StopThread = 0;
+			iotHubClientInstance->IdleSleepTime = WORKER_THREAD_BUSY_SLEEP_TIME;
 			if (ThreadAPI_Create(&iotHubClientInstance->ThreadHandle, ScheduleWork_Thread, iotHubClientInstance) != THREADAPI_OK)
 			{
 				iotHubClientInstance->ThreadHandle = NULL;
@@ -78,6 +462,7 @@ static IOTHUB_CLIENT_RESULT StartWorkerThreadIfNeeded(IOTHUB_CLIENT_INSTANCE* io
 			}
 			else
 			{
+				iotHubClientInstance->WorkerThreadStarted = 1;
 				result = IOTHUB_CLIENT_OK;
 		}
 	}
@@ -92,10 +477,108 @@ static IOTHUB_CLIENT_RESULT StartWorkerThreadIfNeeded(IOTHUB_CLIENT_INSTANCE* io
 		/*Codes_SRS_IOTHUBCLIENT_17_011: [ If the transport connection is shared, the thread shall be started by calling IoTHubTransport_StartWorkerThread*/
 
 		result = IoTHubTransport_StartWorkerThread(iotHubClientInstance->TransportHandle, iotHubClientInstance);
+		if (result == IOTHUB_CLIENT_OK)
+		{
+			iotHubClientInstance->WorkerThreadStarted = 1;
+		}
 	}
 	return result;
 }
 
+/*queues eventMessageHandle (or a clone of it) for the worker thread. LockHandle is only taken if the worker thread has to be started*/
+static IOTHUB_CLIENT_RESULT QueueEvent(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool adoptMessage)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_02_068: [ If eventMessageHandle is NULL, or eventConfirmationCallback is NULL and userContextCallback is not NULL, then IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if ((eventMessageHandle == NULL) ||
+        ((eventConfirmationCallback == NULL) && (userContextCallback != NULL)))
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("invalid argument eventMessageHandle=%p, eventConfirmationCallback=%p, userContextCallback=%p", eventMessageHandle, eventConfirmationCallback, userContextCallback);
+    }
+    else
+    {
+        if (iotHubClientInstance->WorkerThreadStarted)
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_02_069: [ Only if the worker thread has not been started yet, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall acquire the lock created in IoTHubClient_Create to start it. ]*/
+        else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            /* Codes_SRS_IOTHUBCLIENT_01_026: [If acquiring the lock fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
+            /*Codes_SRS_IOTHUBCLIENT_02_056: [ If acquiring the lock fails, IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
+            /* Codes_SRS_IOTHUBCLIENT_01_010: [If starting the thread fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
+            /*Codes_SRS_IOTHUBCLIENT_02_057: [ IoTHubClient_SendEventAsync_Move shall start the worker thread if it was not previously started. If starting the thread fails, IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+            if (StartWorkerThreadIfNeeded(iotHubClientInstance) != IOTHUB_CLIENT_OK)
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("Could not start worker thread");
+            }
+            else
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+
+        if (result == IOTHUB_CLIENT_OK)
+        {
+            QUEUED_EVENT* queuedEvent = (QUEUED_EVENT*)malloc(sizeof(QUEUED_EVENT));
+            if (queuedEvent == NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_071: [ If allocating the queued event, cloning the message or queuing it fails, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("unable to malloc");
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_070: [ IoTHubClient_SendEventAsync shall queue a clone of eventMessageHandle (obtained by calling IoTHubMessage_Clone) together with eventConfirmationCallback and userContextCallback for the worker thread without acquiring the lock, and return IOTHUB_CLIENT_OK. ]*/
+                /*Codes_SRS_IOTHUBCLIENT_02_072: [ IoTHubClient_SendEventAsync_Move shall queue eventMessageHandle itself, without cloning it. If queuing fails, eventMessageHandle stays owned by the caller. ]*/
+                queuedEvent->messageHandle = adoptMessage ? eventMessageHandle : IoTHubMessage_Clone(eventMessageHandle);
+                if (queuedEvent->messageHandle == NULL)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_02_071: [ If allocating the queued event, cloning the message or queuing it fails, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("unable to IoTHubMessage_Clone");
+                    free(queuedEvent);
+                }
+                else
+                {
+                    queuedEvent->eventConfirmationCallback = eventConfirmationCallback;
+                    queuedEvent->userContextCallback = userContextCallback;
+                    /*Codes_SRS_IOTHUBCLIENT_02_104: [ IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall record the time the event is queued at by calling IoTHubClient_LL_GetCurrentTime, so that its "messageTimeout" starts when it is queued and not when the worker thread hands it over to IoTHubClient_LL. ]*/
+                    queuedEvent->queuedAt = IoTHubClient_LL_GetCurrentTime(iotHubClientInstance->IoTHubClientLLHandle);
+                    if (MpscQueue_Push(&iotHubClientInstance->EventsToSend, &queuedEvent->entry) != 0)
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_02_071: [ If allocating the queued event, cloning the message or queuing it fails, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+                        result = IOTHUB_CLIENT_ERROR;
+                        LogError("unable to MpscQueue_Push");
+                        if (!adoptMessage)
+                        {
+                            IoTHubMessage_Destroy(queuedEvent->messageHandle);
+                        }
+                        free(queuedEvent);
+                    }
+                    else
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_02_109: [ After queuing the event IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall mark the client busy for IoTHubClient_GetSendStatus, so that until the event is sent it is seen either in the queue or in the busy mark. ]*/
+                        iotHubClientInstance->SendStatusBusy = 1;
+                    }
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_HANDLE IoTHubClient_CreateFromConnectionString(const char* connectionString, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol)
 {
     IOTHUB_CLIENT_INSTANCE* result = NULL;
@@ -145,7 +628,27 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateFromConnectionString(const char* connect
                     else
                     {
                         result->ThreadHandle = NULL;
+                        result->StopThread = 0;
 						result->TransportHandle = NULL;
+                        result->WorkerThreadStarted = 0;
+                        result->SendStatusBusy = 1;
+                        result->IdleSleepTime = WORKER_THREAD_BUSY_SLEEP_TIME;
+                        result->MaxIdleSleepTime = WORKER_THREAD_DEFAULT_MAX_IDLE_SLEEP_TIME;
+                        result->MessageCallback = NULL;
+                        result->MessageUserContextCallback = NULL;
+                        result->MessageDispatchQueueSize = 0;
+                        result->MessagesWaitingForDispatch = 0;
+                        result->DispatchPaused = false;
+                        result->DispatchSettlesMessages = false;
+                        result->DispatchThreadHandle = NULL;
+                        if (InitializeQueues(result) != 0)
+                        {
+                            /*Codes_SRS_IOTHUBCLIENT_02_111: [ If initializing the queues of the worker and dispatch threads fails, IoTHubClient_CreateFromConnectionString, IoTHubClient_Create and IoTHubClient_CreateWithTransport shall free all the resources they allocated and return NULL. ]*/
+                            IoTHubClient_LL_Destroy(result->IoTHubClientLLHandle);
+                            Lock_Deinit(result->LockHandle);
+                            free(result);
+                            result = NULL;
+                        }
                     }
                 }
             
@@ -187,6 +690,26 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_Create(const IOTHUB_CLIENT_CONFIG* config)
 			{
 				result->TransportHandle = NULL;
 				result->ThreadHandle = NULL;
+				result->StopThread = 0;
+				result->WorkerThreadStarted = 0;
+				result->SendStatusBusy = 1;
+				result->IdleSleepTime = WORKER_THREAD_BUSY_SLEEP_TIME;
+				result->MaxIdleSleepTime = WORKER_THREAD_DEFAULT_MAX_IDLE_SLEEP_TIME;
+				result->MessageCallback = NULL;
+				result->MessageUserContextCallback = NULL;
+				result->MessageDispatchQueueSize = 0;
+				result->MessagesWaitingForDispatch = 0;
+				result->DispatchPaused = false;
+				result->DispatchSettlesMessages = false;
+				result->DispatchThreadHandle = NULL;
+				if (InitializeQueues(result) != 0)
+				{
+					/*Codes_SRS_IOTHUBCLIENT_02_111: [ If initializing the queues of the worker and dispatch threads fails, IoTHubClient_CreateFromConnectionString, IoTHubClient_Create and IoTHubClient_CreateWithTransport shall free all the resources they allocated and return NULL. ]*/
+					IoTHubClient_LL_Destroy(result->IoTHubClientLLHandle);
+					Lock_Deinit(result->LockHandle);
+					free(result);
+					result = NULL;
+				}
 			}
         }
     }
@@ -211,13 +734,27 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
 		if (result != NULL)
 		{
 			result->ThreadHandle = NULL;
+			result->StopThread = 0;
 			result->TransportHandle = transportHandle;
-			/*Codes_SRS_IOTHUBCLIENT_17_005: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetLock to get the transport lock to be used later for serializing IoTHubClient calls. ]*/
-			LOCK_HANDLE transportLock = IoTHubTransport_GetLock(transportHandle);
+			result->WorkerThreadStarted = 0;
+			result->SendStatusBusy = 1;
+			result->IdleSleepTime = WORKER_THREAD_BUSY_SLEEP_TIME;
+			result->MaxIdleSleepTime = WORKER_THREAD_DEFAULT_MAX_IDLE_SLEEP_TIME;
+			result->MessageCallback = NULL;
+			result->MessageUserContextCallback = NULL;
+			result->MessageDispatchQueueSize = 0;
+			result->MessagesWaitingForDispatch = 0;
+			result->DispatchPaused = false;
+			result->DispatchSettlesMessages = false;
+			result->DispatchThreadHandle = NULL;
+			/*Codes_SRS_IOTHUBCLIENT_17_005: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetClientLock to get the lock of the transport worker serving the new instance, to be used later for serializing IoTHubClient calls. ]*/
+			LOCK_HANDLE transportLock = IoTHubTransport_GetClientLock(transportHandle, result);
 			result->LockHandle = transportLock;
 			if (result->LockHandle == NULL)
 			{
-				/*Codes_SRS_IOTHUBCLIENT_17_006: [ If IoTHubTransport_GetLock fails, then IoTHubClient_CreateWithTransport shall return NULL. ]*/
+				/*Codes_SRS_IOTHUBCLIENT_17_006: [ If IoTHubTransport_GetClientLock fails, then IoTHubClient_CreateWithTransport shall return NULL. ]*/
+				/*Codes_SRS_IOTHUBCLIENT_02_080: [ If IoTHubClient_CreateWithTransport fails after calling IoTHubTransport_GetClientLock, it shall call IoTHubTransport_ReleaseClient. ]*/
+				IoTHubTransport_ReleaseClient(transportHandle, result);
 				free(result);
 				result = NULL;
 			}
@@ -230,12 +767,13 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
                 deviceConfig.deviceSasToken = config->deviceSasToken;
                 deviceConfig.protocol = config->protocol;
 
-				/*Codes_SRS_IOTHUBCLIENT_17_003: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetLLTransport on transportHandle to get lower layer transport. ]*/
-				deviceConfig.transportHandle = IoTHubTransport_GetLLTransport(transportHandle);
+				/*Codes_SRS_IOTHUBCLIENT_17_003: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetClientLLTransport on transportHandle to get the lower layer transport of the same worker. ]*/
+				deviceConfig.transportHandle = IoTHubTransport_GetClientLLTransport(transportHandle, result);
 
 				if (deviceConfig.transportHandle == NULL)
 				{
-					/*Codes_SRS_IOTHUBCLIENT_17_004: [ If IoTHubTransport_GetLLTransport fails, then IoTHubClient_CreateWithTransport shall return NULL. ]*/
+					/*Codes_SRS_IOTHUBCLIENT_17_004: [ If IoTHubTransport_GetClientLLTransport fails, then IoTHubClient_CreateWithTransport shall return NULL. ]*/
+					IoTHubTransport_ReleaseClient(transportHandle, result);
 					free(result);
 					result = NULL;
 				}
@@ -243,6 +781,7 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
 				{
 					if (Lock(transportLock) != LOCK_OK)
 					{
+						IoTHubTransport_ReleaseClient(transportHandle, result);
 						free(result);
 						result = NULL;
 					}
@@ -254,6 +793,15 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
 						{
 							/*Codes_SRS_IOTHUBCLIENT_17_008: [ If IoTHubClient_LL_CreateWithTransport fails, then IoTHubClient_Create shall return NULL. ]*/
 							/*Codes_SRS_IOTHUBCLIENT_17_009: [ If IoTHubClient_LL_CreateWithTransport fails, all resources allocated by it shall be freed. ]*/
+							IoTHubTransport_ReleaseClient(transportHandle, result);
+							free(result);
+							result = NULL;
+						}
+						else if (InitializeQueues(result) != 0)
+						{
+							/*Codes_SRS_IOTHUBCLIENT_02_111: [ If initializing the queues of the worker and dispatch threads fails, IoTHubClient_CreateFromConnectionString, IoTHubClient_Create and IoTHubClient_CreateWithTransport shall free all the resources they allocated and return NULL. ]*/
+							IoTHubClient_LL_Destroy(result->IoTHubClientLLHandle);
+							IoTHubTransport_ReleaseClient(transportHandle, result);
 							free(result);
 							result = NULL;
 						}
@@ -298,6 +846,12 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
 			okToJoin = false;
 		}
 
+		if (iotHubClientInstance->DispatchThreadHandle != NULL)
+		{
+			/*Codes_SRS_IOTHUBCLIENT_02_095: [ The dispatch thread shall exit when IoTHubClient_Destroy is called. ]*/
+			iotHubClientInstance->StopThread = 1;
+		}
+
 		if (iotHubClientInstance->TransportHandle != NULL)
 		{
 			/*Codes_SRS_IOTHUBCLIENT_01_007: [ The thread created as part of executing IoTHubClient_SendEventAsync or IoTHubClient_SetNotificationMessageCallback shall be joined. ]*/
@@ -307,6 +861,22 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
         /* Codes_SRS_IOTHUBCLIENT_01_006: [That includes destroying the IoTHubClient_LL instance by calling IoTHubClient_LL_Destroy.] */
         IoTHubClient_LL_Destroy(iotHubClientInstance->IoTHubClientLLHandle);
 
+		/*Codes_SRS_IOTHUBCLIENT_02_076: [ After destroying the IoTHubClient_LL instance, IoTHubClient_Destroy shall call the eventConfirmationCallback (if any) of every event still queued with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY and destroy its message. ]*/
+		{
+			MPSC_QUEUE_ENTRY* current = MpscQueue_PopAll(&iotHubClientInstance->EventsToSend);
+			while (current != NULL)
+			{
+				QUEUED_EVENT* queuedEvent = containingRecord(current, QUEUED_EVENT, entry);
+				current = current->next;
+				if (queuedEvent->eventConfirmationCallback != NULL)
+				{
+					queuedEvent->eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, queuedEvent->userContextCallback);
+				}
+				IoTHubMessage_Destroy(queuedEvent->messageHandle);
+				free(queuedEvent);
+			}
+		}
+
 		/*Codes_SRS_IOTHUBCLIENT_02_045: [ IoTHubClient_Destroy shall unlock the serializing lock. ]*/
 		if (Unlock(iotHubClientInstance->LockHandle) != LOCK_OK)
 		{
@@ -331,12 +901,40 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
 			}
 		}
 
+		if (iotHubClientInstance->DispatchThreadHandle != NULL)
+		{
+			int res;
+			/*Codes_SRS_IOTHUBCLIENT_02_097: [ IoTHubClient_Destroy shall join the dispatch thread (if any) and then destroy the messages still waiting for it, without calling the message callback. ]*/
+			if (ThreadAPI_Join(iotHubClientInstance->DispatchThreadHandle, &res) != THREADAPI_OK)
+			{
+				LogError("ThreadAPI_Join failed");
+			}
+		}
+
+		{
+			MPSC_QUEUE_ENTRY* current = MpscQueue_PopAll(&iotHubClientInstance->MessagesToDispatch);
+			while (current != NULL)
+			{
+				DISPATCHED_MESSAGE* dispatchedMessage = containingRecord(current, DISPATCHED_MESSAGE, entry);
+				current = current->next;
+				IoTHubMessage_Destroy(dispatchedMessage->messageHandle);
+				free(dispatchedMessage);
+			}
+		}
+
 		if (iotHubClientInstance->TransportHandle == NULL)
 		{
 			/* Codes_SRS_IOTHUBCLIENT_01_032: [If the lock was allocated in IoTHubClient_Create, it shall be also freed..] */
 			Lock_Deinit(iotHubClientInstance->LockHandle);
 		}
+		else
+		{
+			/*Codes_SRS_IOTHUBCLIENT_02_079: [ If the transport connection is shared, IoTHubClient_Destroy shall call IoTHubTransport_ReleaseClient after the worker thread (if any) has been joined. ]*/
+			IoTHubTransport_ReleaseClient(iotHubClientInstance->TransportHandle, iotHubClientHandle);
+		}
 
+		MpscQueue_Deinitialize(&iotHubClientInstance->EventsToSend);
+		MpscQueue_Deinitialize(&iotHubClientInstance->MessagesToDispatch);
         free(iotHubClientInstance);
     }
 }
@@ -355,30 +953,107 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClie
     {
         IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
 
-        /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+        /*Codes_SRS_IOTHUBCLIENT_02_070: [ IoTHubClient_SendEventAsync shall queue a clone of eventMessageHandle (obtained by calling IoTHubMessage_Clone) together with eventConfirmationCallback and userContextCallback for the worker thread without acquiring the lock, and return IOTHUB_CLIENT_OK. ]*/
+        result = QueueEvent(iotHubClientInstance, eventMessageHandle, eventConfirmationCallback, userContextCallback, false);
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync_Move(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_054: [ If iotHubClientHandle is NULL, IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+
+        /*Codes_SRS_IOTHUBCLIENT_02_072: [ IoTHubClient_SendEventAsync_Move shall queue eventMessageHandle itself, without cloning it. If queuing fails, eventMessageHandle stays owned by the caller. ]*/
+        result = QueueEvent(iotHubClientInstance, eventMessageHandle, eventConfirmationCallback, userContextCallback, true);
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_01_023: [If iotHubClientHandle is NULL, IoTHubClient_ GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG.] */
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+
+        if ((iotHubClientStatus != NULL) && !MpscQueue_IsEmpty(&iotHubClientInstance->EventsToSend))
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_075: [ If there are events queued for the worker thread, IoTHubClient_GetSendStatus shall set iotHubClientStatus to IOTHUB_CLIENT_SEND_STATUS_BUSY and return IOTHUB_CLIENT_OK without acquiring the lock. ]*/
+            *iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if ((iotHubClientStatus != NULL) && iotHubClientInstance->WorkerThreadStarted)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_105: [ Otherwise, once the worker thread has been started, IoTHubClient_GetSendStatus shall set iotHubClientStatus to what the worker thread recorded after its last call to IoTHubClient_LL_DoWork (IOTHUB_CLIENT_SEND_STATUS_BUSY until then) and return IOTHUB_CLIENT_OK without acquiring the lock. ]*/
+            *iotHubClientStatus = iotHubClientInstance->SendStatusBusy ? IOTHUB_CLIENT_SEND_STATUS_BUSY : IOTHUB_CLIENT_SEND_STATUS_IDLE;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUBCLIENT_01_033: [IoTHubClient_GetSendStatus shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+        else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            /* Codes_SRS_IOTHUBCLIENT_01_034: [If acquiring the lock fails, IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_ERROR.] */
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUBCLIENT_01_022: [IoTHubClient_GetSendStatus shall call IoTHubClient_LL_GetSendStatus, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameter iotHubClientStatus.] */
+            /* Codes_SRS_IOTHUBCLIENT_01_024: [Otherwise, IoTHubClient_GetSendStatus shall return the result of IoTHubClient_LL_GetSendStatus.] */
+            result = IoTHubClient_LL_GetSendStatus(iotHubClientInstance->IoTHubClientLLHandle, iotHubClientStatus);
+
+            /* Codes_SRS_IOTHUBCLIENT_01_033: [IoTHubClient_GetSendStatus shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_GetMessagePoolStats(IOTHUB_CLIENT_HANDLE iotHubClientHandle, NODEPOOL_STATS* stats)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_02_060: [ If iotHubClientHandle is NULL then IoTHubClient_GetMessagePoolStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+
+        /* Codes_SRS_IOTHUBCLIENT_02_061: [ IoTHubClient_GetMessagePoolStats shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
         if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
         {
-            /* Codes_SRS_IOTHUBCLIENT_01_026: [If acquiring the lock fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
+            /* Codes_SRS_IOTHUBCLIENT_02_062: [ If acquiring the lock fails, IoTHubClient_GetMessagePoolStats shall return IOTHUB_CLIENT_ERROR. ]*/
             result = IOTHUB_CLIENT_ERROR;
             LogError("Could not acquire lock");
         }
         else
         {
-            /* Codes_SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
-            if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
-            {
-                /* Codes_SRS_IOTHUBCLIENT_01_010: [If starting the thread fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
-                result = IOTHUB_CLIENT_ERROR;
-                LogError("Could not start worker thread");
-            }
-            else
-            {
-                /* Codes_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClient_LL_SendEventAsync, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
-                /* Codes_SRS_IOTHUBCLIENT_01_013: [When IoTHubClient_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClient_LL_SendEventAsync.] */
-                result = IoTHubClient_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
-            }
+            /* Codes_SRS_IOTHUBCLIENT_02_063: [ Otherwise IoTHubClient_GetMessagePoolStats shall call IoTHubClient_LL_GetMessagePoolStats and return what IoTHubClient_LL_GetMessagePoolStats returns. ]*/
+            result = IoTHubClient_LL_GetMessagePoolStats(iotHubClientInstance->IoTHubClientLLHandle, stats);
 
-            /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
             (void)Unlock(iotHubClientInstance->LockHandle);
         }
     }
@@ -386,13 +1061,13 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClie
     return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
+IOTHUB_CLIENT_RESULT IoTHubClient_GetPriorityLaneStats(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY priority, IOTHUB_CLIENT_PRIORITY_LANE_STATS* stats)
 {
     IOTHUB_CLIENT_RESULT result;
 
     if (iotHubClientHandle == NULL)
     {
-        /* Codes_SRS_IOTHUBCLIENT_01_023: [If iotHubClientHandle is NULL, IoTHubClient_ GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG.] */
+        /* Codes_SRS_IOTHUBCLIENT_02_081: [ If iotHubClientHandle is NULL then IoTHubClient_GetPriorityLaneStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
         result = IOTHUB_CLIENT_INVALID_ARG;
         LogError("NULL iothubClientHandle");
     }
@@ -400,20 +1075,84 @@ IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE iotHubClien
     {
         IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
 
-        /* Codes_SRS_IOTHUBCLIENT_01_033: [IoTHubClient_GetSendStatus shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+        /* Codes_SRS_IOTHUBCLIENT_02_082: [ IoTHubClient_GetPriorityLaneStats shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
         if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
         {
-            /* Codes_SRS_IOTHUBCLIENT_01_034: [If acquiring the lock fails, IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_ERROR.] */
+            /* Codes_SRS_IOTHUBCLIENT_02_083: [ If acquiring the lock fails, IoTHubClient_GetPriorityLaneStats shall return IOTHUB_CLIENT_ERROR. ]*/
             result = IOTHUB_CLIENT_ERROR;
             LogError("Could not acquire lock");
         }
         else
         {
-            /* Codes_SRS_IOTHUBCLIENT_01_022: [IoTHubClient_GetSendStatus shall call IoTHubClient_LL_GetSendStatus, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameter iotHubClientStatus.] */
-            /* Codes_SRS_IOTHUBCLIENT_01_024: [Otherwise, IoTHubClient_GetSendStatus shall return the result of IoTHubClient_LL_GetSendStatus.] */
-            result = IoTHubClient_LL_GetSendStatus(iotHubClientInstance->IoTHubClientLLHandle, iotHubClientStatus);
+            /* Codes_SRS_IOTHUBCLIENT_02_084: [ Otherwise IoTHubClient_GetPriorityLaneStats shall call IoTHubClient_LL_GetPriorityLaneStats and return what IoTHubClient_LL_GetPriorityLaneStats returns. ]*/
+            result = IoTHubClient_LL_GetPriorityLaneStats(iotHubClientInstance->IoTHubClientLLHandle, priority, stats);
+
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStats(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_SEND_STATS* stats)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_02_085: [ If iotHubClientHandle is NULL then IoTHubClient_GetSendStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+
+        /* Codes_SRS_IOTHUBCLIENT_02_086: [ IoTHubClient_GetSendStats shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            /* Codes_SRS_IOTHUBCLIENT_02_087: [ If acquiring the lock fails, IoTHubClient_GetSendStats shall return IOTHUB_CLIENT_ERROR. ]*/
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUBCLIENT_02_088: [ Otherwise IoTHubClient_GetSendStats shall call IoTHubClient_LL_GetSendStats and return what IoTHubClient_LL_GetSendStats returns. ]*/
+            result = IoTHubClient_LL_GetSendStats(iotHubClientInstance->IoTHubClientLLHandle, stats);
+
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_SendMessageDisposition(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_02_064: [ If iotHubClientHandle is NULL then IoTHubClient_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+
+        /* Codes_SRS_IOTHUBCLIENT_02_065: [ IoTHubClient_SendMessageDisposition shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            /* Codes_SRS_IOTHUBCLIENT_02_066: [ If acquiring the lock fails, IoTHubClient_SendMessageDisposition shall return IOTHUB_CLIENT_ERROR. ]*/
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUBCLIENT_02_067: [ Otherwise IoTHubClient_SendMessageDisposition shall call IoTHubClient_LL_SendMessageDisposition and return what IoTHubClient_LL_SendMessageDisposition returns. ]*/
+            result = IoTHubClient_LL_SendMessageDisposition(iotHubClientInstance->IoTHubClientLLHandle, message, disposition);
 
-            /* Codes_SRS_IOTHUBCLIENT_01_033: [IoTHubClient_GetSendStatus shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
             (void)Unlock(iotHubClientInstance->LockHandle);
         }
     }
@@ -453,8 +1192,12 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SetMessageCallback(IOTHUB_CLIENT_HANDLE iotHub
             }
             else
             {
-                /* Codes_SRS_IOTHUBCLIENT_01_017: [IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_SetMessageCallback, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters messageCallback and userContextCallback.] */
-                result = IoTHubClient_LL_SetMessageCallback(iotHubClientInstance->IoTHubClientLLHandle, messageCallback, userContextCallback);
+                iotHubClientInstance->MessageCallback = messageCallback;
+                iotHubClientInstance->MessageUserContextCallback = userContextCallback;
+                result = SetLLMessageCallback(iotHubClientInstance);
+
+                /*Codes_SRS_IOTHUBCLIENT_02_053: [ IoTHubClient_SetMessageCallback shall reset the worker thread sleep time to 1 ms. ]*/
+                iotHubClientInstance->IdleSleepTime = WORKER_THREAD_BUSY_SLEEP_TIME;
             }
 
             /* Codes_SRS_IOTHUBCLIENT_01_027: [IoTHubClient_SetMessageCallback shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
@@ -517,8 +1260,26 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SetOption(IOTHUB_CLIENT_HANDLE iotHubClientHan
     {
         IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
 
-        /* Codes_SRS_IOTHUBCLIENT_01_041: [ IoTHubClient_SetOption shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
-        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        /*Codes_SRS_IOTHUBCLIENT_02_037: [If optionName matches one of the option handled by IoTHubClient, then the pointer value shall be dereferenced (by convention) to the data type for that option and option specific code shall be executed.] */
+        if (strcmp(optionName, "MaxIdleSleepTime") == 0)
+        {
+            unsigned int maxIdleSleepTime = *(const unsigned int*)value;
+            if (maxIdleSleepTime < WORKER_THREAD_BUSY_SLEEP_TIME)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_052: [ If the value of "MaxIdleSleepTime" is 0 then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                result = IOTHUB_CLIENT_INVALID_ARG;
+                LogError("MaxIdleSleepTime cannot be 0");
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_051: [ "MaxIdleSleepTime" - unsigned int, the maximum number of milliseconds the worker thread sleeps between calls to IoTHubClient_LL_DoWork when there is nothing to send. ]*/
+                /*Codes_SRS_IOTHUBCLIENT_02_110: [ IoTHubClient_SetOption shall set "MaxIdleSleepTime" without acquiring the lock; the threads use the new value from their next sleep. ]*/
+                iotHubClientInstance->MaxIdleSleepTime = maxIdleSleepTime;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /* Codes_SRS_IOTHUBCLIENT_01_041: [ IoTHubClient_SetOption shall be made thread-safe by using the lock created in IoTHubClient_Create for the options that reach IoTHubClient_LL. ]*/
+        else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
         {
             /* Codes_SRS_IOTHUBCLIENT_01_042: [ If acquiring the lock fails, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR. ]*/
             result = IOTHUB_CLIENT_ERROR;
@@ -526,11 +1287,46 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SetOption(IOTHUB_CLIENT_HANDLE iotHubClientHan
         }
         else
         {
-            /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.] */
-            result = IoTHubClient_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
-            if (result != IOTHUB_CLIENT_OK)
+            if (strcmp(optionName, "MessageDispatchQueueSize") == 0)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_098: [ "MessageDispatchQueueSize" - size_t, the number of received messages that can wait for the dispatch thread. 0 (the default) makes the message callback run on the worker thread. ]*/
+                size_t queueSize = *(const size_t*)value;
+                size_t previousQueueSize = iotHubClientInstance->MessageDispatchQueueSize;
+                if ((queueSize != 0) && !iotHubClientInstance->DispatchSettlesMessages)
+                {
+                    bool asyncMessageDisposition = true;
+                    /*Codes_SRS_IOTHUBCLIENT_02_100: [ If the value is not 0, IoTHubClient_SetOption shall first call IoTHubClient_LL_SetOption with "AsyncMessageDisposition" set to true, so that the dispatch thread can settle the messages with what the message callback returns; if that fails the dispatched messages shall be accepted when they are queued instead. ]*/
+                    if (IoTHubClient_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, "AsyncMessageDisposition", &asyncMessageDisposition) == IOTHUB_CLIENT_OK)
+                    {
+                        iotHubClientInstance->DispatchSettlesMessages = true;
+                    }
+                    else
+                    {
+                        LogInfo("the transport cannot settle messages after the message callback returns, the dispatched messages are accepted when they are queued");
+                    }
+                }
+
+                iotHubClientInstance->MessageDispatchQueueSize = queueSize;
+                if (iotHubClientInstance->MessageCallback == NULL)
+                {
+                    result = IOTHUB_CLIENT_OK;
+                }
+                /*Codes_SRS_IOTHUBCLIENT_02_099: [ If a message callback is set, IoTHubClient_SetOption shall register it again with IoTHubClient_LL the same way IoTHubClient_SetMessageCallback does, and restore the previous value of "MessageDispatchQueueSize" if that fails. ]*/
+                else if ((result = SetLLMessageCallback(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
+                {
+                    iotHubClientInstance->MessageDispatchQueueSize = previousQueueSize;
+                    LogError("unable to register the message callback again");
+                }
+                ReleaseAsyncMessageDisposition(iotHubClientInstance);
+            }
+            else
             {
-                LogError("IoTHubClient_LL_SetOption failed");
+                /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.] */
+                result = IoTHubClient_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubClient_LL_SetOption failed");
+                }
             }
 
             Unlock(iotHubClientInstance->LockHandle);
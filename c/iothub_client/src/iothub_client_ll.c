@@ -16,9 +16,19 @@
 #include "iothub_client_private.h"
 #include "iothub_client_version.h"
 #include "iothub_transport_ll.h"
+#include "nodepool.h"
+#include "messagestore.h"
 
 #define LOG_ERROR LogError("result = %s", ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, result));
 #define INDEFINITE_TIME ((time_t)(-1))
+#define DEFAULT_MESSAGE_POOL_GROWTH 16
+#define DEFAULT_MESSAGE_STORE_WATERMARK 1000
+#define DEFAULT_MESSAGE_STORE_SEGMENT_SIZE (1024 * 1024)
+#define DEFAULT_MESSAGE_STORE_SYNC_INTERVAL 1
+#define STORE_RECORD_VERSION 1
+#define STORE_RECORD_SIZE_LENGTH 4
+#define DEFAULT_PRIORITY_MAX_OVERTAKES 16
+#define PRIORITY_LANE_COUNT (IOTHUB_MESSAGE_PRIORITY_HIGH + 1)
 
 DEFINE_ENUM_STRINGS(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_RESULT_VALUES);
 
@@ -34,8 +44,27 @@ typedef struct IOTHUB_CLIENT_LL_HANDLE_DATA_TAG
 	time_t lastMessageReceiveTime;
 	TICK_COUNTER_HANDLE tickCounter; /*shared tickcounter used to track message timeouts in waitingToSend list*/
 	uint64_t currentMessageTimeout;
+	uint64_t lastQueuedTimeout; /*ms_timesOutAfter of the newest message in waitingToSend that can timeout, 0 if none can*/
+	bool timeoutsInOrder; /*true when the messages of waitingToSend that can timeout are sorted by ms_timesOutAfter*/
+	NODEPOOL_HANDLE messagePool; /*IOTHUB_MESSAGE_LIST records of waitingToSend are carved from here*/
+	MESSAGESTORE_HANDLE messageStore; /*NULL unless the "messageStore" option was set*/
+	size_t messageStoreWatermark; /*messages kept in memory before the new ones go to messageStore*/
+	size_t messageStoreSegmentSize;
+	size_t messageStoreSyncInterval;
+	unsigned char* storeRecord; /*messages are serialized here before they are appended to messageStore*/
+	size_t storeRecordSize;
+	size_t priorityMaxOvertakes; /*how many messages of a higher priority can be queued ahead of a waiting message*/
+	bool asyncMessageDisposition; /*true once the transport accepted the "AsyncMessageDisposition" option*/
+	IOTHUB_CLIENT_PRIORITY_LANE_STATS laneStats[PRIORITY_LANE_COUNT]; /*indexed by IOTHUB_MESSAGE_PRIORITY*/
+	IOTHUB_CLIENT_SEND_STATS sendStats; /*sendStats.queued is computed by IoTHubClient_LL_GetSendStats*/
 }IOTHUB_CLIENT_LL_HANDLE_DATA;
 
+typedef struct STORE_RECORD_READER_TAG
+{
+	const unsigned char* position;
+	size_t left;
+} STORE_RECORD_READER;
+
 static const char HOSTNAME_TOKEN[] = "HostName";
 static const char DEVICEID_TOKEN[] = "DeviceId";
 static const char DEVICEKEY_TOKEN[] = "SharedAccessKey";
@@ -275,6 +304,7 @@ static void setTransportProtocol(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, TRANS
 	handleData->IoTHubTransport_Unsubscribe = protocol->IoTHubTransport_Unsubscribe;
 	handleData->IoTHubTransport_DoWork = protocol->IoTHubTransport_DoWork;
 	handleData->IoTHubTransport_GetSendStatus = protocol->IoTHubTransport_GetSendStatus;
+	handleData->IoTHubTransport_SendMessageDisposition = protocol->IoTHubTransport_SendMessageDisposition;
 
 }
 
@@ -306,6 +336,15 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_Create(const IOTHUB_CLIENT_CONFIG* confi
 				free(handleData);
 				result = NULL;
 			}
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_054: [ IoTHubClient_LL_Create shall create a pool for the records of waitingToSend by calling NodePool_Create. ]*/
+			else if ((handleData->messagePool = NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), DEFAULT_MESSAGE_POOL_GROWTH)) == NULL)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_055: [ If NodePool_Create fails then IoTHubClient_LL_Create shall fail and return NULL. ]*/
+				LogError("unable to create the message pool");
+				tickcounter_destroy(handleData->tickCounter);
+				free(handleData);
+				result = NULL;
+			}
 			else
 			{
 				/*Codes_SRS_IOTHUBCLIENT_LL_02_004: [Otherwise IoTHubClient_LL_Create shall initialize a new DLIST (further called "waitingToSend") containing records with fields of the following types: IOTHUB_MESSAGE_HANDLE, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, void*.]*/
@@ -322,6 +361,7 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_Create(const IOTHUB_CLIENT_CONFIG* confi
 				if ((handleData->transportHandle = handleData->IoTHubTransport_Create(&lowerLayerConfig)) == NULL)
 				{
 					LogError("underlying transport failed");
+					NodePool_Destroy(handleData->messagePool);
 					tickcounter_destroy(handleData->tickCounter);
 					free(handleData);
 					result = NULL;
@@ -340,6 +380,7 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_Create(const IOTHUB_CLIENT_CONFIG* confi
 						/*Codes_SRS_IOTHUBCLIENT_LL_17_009: [If the _Register function fails, this function shall fail and return NULL.]*/
 						LogError("Registering device in transport failed");
 						handleData->IoTHubTransport_Destroy(handleData->transportHandle);
+						NodePool_Destroy(handleData->messagePool);
 						tickcounter_destroy(handleData->tickCounter);
 						free(handleData);
 						result = NULL;
@@ -350,6 +391,21 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_Create(const IOTHUB_CLIENT_CONFIG* confi
 						handleData->isSharedTransport = false;
 						/*Codes_SRS_IOTHUBCLIENT_LL_02_042: [ By default, messages shall not timeout. ]*/
 						handleData->currentMessageTimeout = 0;
+						handleData->lastQueuedTimeout = 0;
+						handleData->timeoutsInOrder = true;
+						/*Codes_SRS_IOTHUBCLIENT_LL_02_070: [ By default, there shall be no message store. ]*/
+						handleData->messageStore = NULL;
+						handleData->messageStoreWatermark = DEFAULT_MESSAGE_STORE_WATERMARK;
+						handleData->messageStoreSegmentSize = DEFAULT_MESSAGE_STORE_SEGMENT_SIZE;
+						handleData->messageStoreSyncInterval = DEFAULT_MESSAGE_STORE_SYNC_INTERVAL;
+						handleData->storeRecord = NULL;
+						handleData->storeRecordSize = 0;
+						/*Codes_SRS_IOTHUBCLIENT_LL_02_089: [ By default, "priorityMaxOvertakes" shall be 16. ]*/
+						handleData->priorityMaxOvertakes = DEFAULT_PRIORITY_MAX_OVERTAKES;
+						/*Codes_SRS_IOTHUBCLIENT_LL_02_106: [ By default, "AsyncMessageDisposition" shall be false. ]*/
+						handleData->asyncMessageDisposition = false;
+						(void)memset(handleData->laneStats, 0, sizeof(handleData->laneStats));
+						(void)memset(&(handleData->sendStats), 0, sizeof(handleData->sendStats));
 						result = handleData;
 					}
 				}
@@ -391,6 +447,15 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_CreateWithTransport(const IOTHUB_CLIENT_
 				free(handleData);
 				result = NULL;
 			}
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_056: [ IoTHubClient_LL_CreateWithTransport shall create a pool for the records of waitingToSend by calling NodePool_Create. ]*/
+			else if ((handleData->messagePool = NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), DEFAULT_MESSAGE_POOL_GROWTH)) == NULL)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_057: [ If NodePool_Create fails then IoTHubClient_LL_CreateWithTransport shall fail and return NULL. ]*/
+				LogError("unable to create the message pool");
+				tickcounter_destroy(handleData->tickCounter);
+				free(handleData);
+				result = NULL;
+			}
 			else
 			{
 				/*Codes_SRS_IOTHUBCLIENT_LL_17_004: [IoTHubClient_LL_CreateWithTransport shall initialize a new DLIST (further called "waitingToSend") containing records with fields of the following types: IOTHUB_MESSAGE_HANDLE, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, void*.]*/
@@ -413,6 +478,7 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_CreateWithTransport(const IOTHUB_CLIENT_
 				{
 					/*Codes_SRS_IOTHUBCLIENT_LL_17_007: [If the _Register function fails, this function shall fail and return NULL.]*/
 					LogError("Registering device in transport failed");
+					NodePool_Destroy(handleData->messagePool);
 					tickcounter_destroy(handleData->tickCounter);
 					free(handleData);
 					result = NULL;
@@ -423,6 +489,21 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_CreateWithTransport(const IOTHUB_CLIENT_
 					handleData->isSharedTransport = true;
 					/*Codes_SRS_IOTHUBCLIENT_LL_02_042: [ By default, messages shall not timeout. ]*/
 					handleData->currentMessageTimeout = 0;
+					handleData->lastQueuedTimeout = 0;
+					handleData->timeoutsInOrder = true;
+					/*Codes_SRS_IOTHUBCLIENT_LL_02_070: [ By default, there shall be no message store. ]*/
+					handleData->messageStore = NULL;
+					handleData->messageStoreWatermark = DEFAULT_MESSAGE_STORE_WATERMARK;
+					handleData->messageStoreSegmentSize = DEFAULT_MESSAGE_STORE_SEGMENT_SIZE;
+					handleData->messageStoreSyncInterval = DEFAULT_MESSAGE_STORE_SYNC_INTERVAL;
+					handleData->storeRecord = NULL;
+					handleData->storeRecordSize = 0;
+					/*Codes_SRS_IOTHUBCLIENT_LL_02_089: [ By default, "priorityMaxOvertakes" shall be 16. ]*/
+					handleData->priorityMaxOvertakes = DEFAULT_PRIORITY_MAX_OVERTAKES;
+					/*Codes_SRS_IOTHUBCLIENT_LL_02_106: [ By default, "AsyncMessageDisposition" shall be false. ]*/
+					handleData->asyncMessageDisposition = false;
+					(void)memset(handleData->laneStats, 0, sizeof(handleData->laneStats));
+					(void)memset(&(handleData->sendStats), 0, sizeof(handleData->sendStats));
 					result = handleData;
 				}
 			}
@@ -432,6 +513,77 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_CreateWithTransport(const IOTHUB_CLIENT_
 	return result;
 }
 
+static void laneQueued(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* message)
+{
+	IOTHUB_CLIENT_PRIORITY_LANE_STATS* lane = &(handleData->laneStats[message->priority]);
+	lane->depth++;
+	if (lane->depth > lane->maxDepth)
+	{
+		lane->maxDepth = lane->depth;
+	}
+}
+
+/*for messages that leave the queue without being sent: timed out or destroyed*/
+static void laneDropped(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* message)
+{
+	IOTHUB_CLIENT_PRIORITY_LANE_STATS* lane = &(handleData->laneStats[message->priority]);
+	if (lane->depth > 0)
+	{
+		lane->depth--;
+	}
+}
+
+static void laneCompleted(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* message, uint64_t nowTick)
+{
+	IOTHUB_CLIENT_PRIORITY_LANE_STATS* lane = &(handleData->laneStats[message->priority]);
+	if (lane->depth > 0)
+	{
+		lane->depth--;
+	}
+	lane->completed++;
+	/*messages whose queue time is not known add no latency*/
+	if ((nowTick != UNKNOWN_QUEUED_TIME) && (message->ms_queuedAt != UNKNOWN_QUEUED_TIME) && (nowTick >= message->ms_queuedAt))
+	{
+		uint64_t latency = nowTick - message->ms_queuedAt;
+		lane->totalLatencyMs += latency;
+		if (latency > lane->maxLatencyMs)
+		{
+			lane->maxLatencyMs = latency;
+		}
+	}
+}
+
+static void histogramRecord(IOTHUB_CLIENT_HISTOGRAM* histogram, uint64_t value)
+{
+	size_t bucket = 0;
+	uint64_t rest = value;
+	while ((rest != 0) && (bucket < IOTHUB_CLIENT_HISTOGRAM_BUCKET_COUNT - 1))
+	{
+		bucket++;
+		rest >>= 1;
+	}
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->total += value;
+	if (value > histogram->max)
+	{
+		histogram->max = value;
+	}
+}
+
+/*for messages that leave the client, whichever way: a message the transport sent is not in flight anymore*/
+static void inFlightReleased(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* message)
+{
+	if (message->sendAttempts > 0)
+	{
+		if (handleData->sendStats.inFlight > 0)
+		{
+			handleData->sendStats.inFlight--;
+		}
+		handleData->sendStats.bytesInFlight -= (handleData->sendStats.bytesInFlight < message->sentSize) ? handleData->sendStats.bytesInFlight : message->sentSize;
+	}
+}
+
 void IoTHubClient_LL_Destroy(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 {
 	/*Codes_SRS_IOTHUBCLIENT_LL_02_009: [IoTHubClient_LL_Destroy shall do nothing if parameter iotHubClientHandle is NULL.]*/
@@ -455,260 +607,898 @@ void IoTHubClient_LL_Destroy(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 			{
 				temp->callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, temp->context);
 			}
+			laneDropped(handleData, temp);
+			inFlightReleased(handleData, temp);
 			IoTHubMessage_Destroy(temp->messageHandle);
-			free(temp);
+			NodePool_Free(temp);
+		}
+		if (handleData->messageStore != NULL)
+		{
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_079: [ IoTHubClient_LL_Destroy shall close the message store by calling MessageStore_Destroy. The messages that were not confirmed stay in the store for the next IoTHubClient_LL that opens it. ]*/
+			MessageStore_Destroy(handleData->messageStore);
+		}
+		if (handleData->storeRecord != NULL)
+		{
+			free(handleData->storeRecord);
 		}
 		/*Codes_SRS_IOTHUBCLIENT_LL_17_011: [IoTHubClient_LL_Destroy  shall free the resources allocated by IoTHubClient (if any).] */
+		NodePool_Destroy(handleData->messagePool);
 		tickcounter_destroy(handleData->tickCounter);
 		free(handleData);
 	}
 }
 
 /*Codes_SRS_IOTHUBCLIENT_LL_02_044: [ Messages already delivered to IoTHubClient_LL shall not have their timeouts modified by a new call to IoTHubClient_LL_SetOption. ]*/
-/*returns 0 on success, any other value is error*/
-static int attach_ms_timesOutAfter(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST *newEntry)
+/*stamps the time the message is queued at (now, unless queuedAt is known) and the time it times out after. returns 0 on success, any other value is error*/
+static int attach_ms_timesOutAfter(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST *newEntry, uint64_t queuedAt)
 {
 	int result;
+	if (queuedAt != UNKNOWN_QUEUED_TIME)
+	{
+		newEntry->ms_queuedAt = queuedAt;
+	}
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_090: [ IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall record the time the message is queued at by calling tickcounter_get_current_ms. ]*/
+	else if (tickcounter_get_current_ms(handleData->tickCounter, &newEntry->ms_queuedAt) != 0)
+	{
+		newEntry->ms_queuedAt = UNKNOWN_QUEUED_TIME;
+	}
+
 	/*Codes_SRS_IOTHUBCLIENT_LL_02_043: [ Calling IoTHubClient_LL_SetOption with value set to "0" shall disable the timeout mechanism for all new messages. ]*/
 	if (handleData->currentMessageTimeout == 0)
 	{
 		newEntry->ms_timesOutAfter = 0; /*do not timeout*/
 		result = 0;
 	}
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+	else if (newEntry->ms_queuedAt == UNKNOWN_QUEUED_TIME)
+	{
+		result = __LINE__;
+		LogError("unable to get the current relative tickcount");
+	}
 	else
 	{
-		/*Codes_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-		if (tickcounter_get_current_ms(handleData->tickCounter, &newEntry->ms_timesOutAfter) != 0)
+		newEntry->ms_timesOutAfter = newEntry->ms_queuedAt + handleData->currentMessageTimeout;
+		/*waitingToSend is consumed from the head, so as long as deadlines are handed out in increasing order the messages that timed out are always the first ones*/
+		if (newEntry->ms_timesOutAfter < handleData->lastQueuedTimeout)
 		{
-			result = __LINE__;
-			LogError("unable to get the current relative tickcount");
+			handleData->timeoutsInOrder = false;
 		}
 		else
 		{
-			newEntry->ms_timesOutAfter += handleData->currentMessageTimeout;
-			result = 0;
+			handleData->lastQueuedTimeout = newEntry->ms_timesOutAfter;
 		}
+		result = 0;
 	}
 	return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+/*waitingToSend is sorted by priority, highest first, except for the messages that were overtaken "priorityMaxOvertakes" times already: those keep their place*/
+static void insertByPriority(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* newEntry)
 {
-	IOTHUB_CLIENT_RESULT result;
-	/*Codes_SRS_IOTHUBCLIENT_LL_02_011: [IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL.]*/
+	PDLIST_ENTRY waitingToSend = &(handleData->waitingToSend);
+	newEntry->overtaken = 0;
+	newEntry->sendAttempts = 0;
+	newEntry->sentSize = 0;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_085: [ A message that does not have a higher priority than the newest message in waitingToSend shall be added at the end of waitingToSend. ]*/
 	if (
-		(iotHubClientHandle == NULL) ||
-		(eventMessageHandle == NULL) ||
-		/*Codes_SRS_IOTHUBCLIENT_LL_02_012: [IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter eventConfirmationCallback is NULL and userContextCallback is not NULL.] */
-		((eventConfirmationCallback == NULL) && (userContextCallback != NULL))
+		(waitingToSend->Blink == waitingToSend) ||
+		(containingRecord(waitingToSend->Blink, IOTHUB_MESSAGE_LIST, entry)->priority >= newEntry->priority)
 		)
 	{
-		result = IOTHUB_CLIENT_INVALID_ARG;
-		LOG_ERROR;
+		DList_InsertTailList(waitingToSend, &(newEntry->entry));
 	}
 	else
 	{
-		IOTHUB_MESSAGE_LIST *newEntry = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
-		if (newEntry == NULL)
-		{
-			result = IOTHUB_CLIENT_ERROR;
-			LOG_ERROR;
-		}
-		else
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_086: [ Otherwise the message shall be inserted in waitingToSend before the first message of a lower priority that was overtaken less than "priorityMaxOvertakes" times, and that message shall count one more overtake. ]*/
+		PDLIST_ENTRY current = waitingToSend->Flink;
+		while (current != waitingToSend)
 		{
-			IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
-
-			if (attach_ms_timesOutAfter(handleData, newEntry) != 0)
-			{
-				result = IOTHUB_CLIENT_ERROR;
-				LOG_ERROR;
-				free(newEntry);
-			}
-			else
+			IOTHUB_MESSAGE_LIST* waiting = containingRecord(current, IOTHUB_MESSAGE_LIST, entry);
+			if ((waiting->priority < newEntry->priority) && (waiting->overtaken < handleData->priorityMaxOvertakes))
 			{
-				/*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-				if ((newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle)) == NULL)
-				{
-					/*Codes_SRS_IOTHUBCLIENT_LL_02_014: [If cloning and/or adding the information fails for any reason, IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
-					result = IOTHUB_CLIENT_ERROR;
-					free(newEntry);
-					LOG_ERROR;
-				}
-				else
+				waiting->overtaken++;
+				/*the new message times out after the messages it overtakes*/
+				if (newEntry->ms_timesOutAfter != 0)
 				{
-					IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
-					/*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-					newEntry->callback = eventConfirmationCallback;
-					newEntry->context = userContextCallback;
-					DList_InsertTailList(&(handleData->waitingToSend), &(newEntry->entry));
-					/*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClient_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
-					result = IOTHUB_CLIENT_OK;
+					handleData->timeoutsInOrder = false;
 				}
+				break;
 			}
+			current = current->Flink;
 		}
+		/*the tail of the list that starts at current is right before current*/
+		DList_InsertTailList(current, &(newEntry->entry));
 	}
-	return result;
+	laneQueued(handleData, newEntry);
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClient_LL_SetMessageCallback(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback)
+static size_t messagesInMemory(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
 {
-	IOTHUB_CLIENT_RESULT result;
-	/*Codes_SRS_IOTHUBCLIENT_LL_02_016: [IoTHubClient_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.] */
-	if (iotHubClientHandle == NULL)
+	NODEPOOL_STATS stats;
+	/*every message in waitingToSend or in flight in the transport owns a record of messagePool*/
+	return (NodePool_GetStats(handleData->messagePool, &stats) == 0) ? stats.inUse : 0;
+}
+
+static size_t storedStringSize(const char* value)
+{
+	/*strings are stored with their terminator so that they can be used in place when read back, 0 means NULL*/
+	return (value == NULL) ? 0 : strlen(value) + 1;
+}
+
+static unsigned char* putBytes(unsigned char* destination, const void* bytes, size_t size)
+{
+	destination[0] = (unsigned char)(size & 0xFF);
+	destination[1] = (unsigned char)((size >> 8) & 0xFF);
+	destination[2] = (unsigned char)((size >> 16) & 0xFF);
+	destination[3] = (unsigned char)((size >> 24) & 0xFF);
+	if (size > 0)
 	{
-		result = IOTHUB_CLIENT_INVALID_ARG;
-		LOG_ERROR;
+		(void)memcpy(destination + STORE_RECORD_SIZE_LENGTH, bytes, size);
+	}
+	return destination + STORE_RECORD_SIZE_LENGTH + size;
+}
+
+/*serializes a message and its confirmation callback in handleData->storeRecord: version, callback, context, content type, body, messageId, correlationId, properties and priority*/
+static int serializeToStoreRecord(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, IOTHUB_MESSAGE_PRIORITY priority, size_t* recordSize)
+{
+	int result;
+	IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(eventMessageHandle);
+	const unsigned char* body = NULL;
+	size_t bodySize = 0;
+	MAP_HANDLE properties = IoTHubMessage_Properties(eventMessageHandle);
+	const char*const* keys;
+	const char*const* values;
+	size_t propertyCount;
+
+	if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+	{
+		if (IoTHubMessage_GetByteArray(eventMessageHandle, &body, &bodySize) != IOTHUB_MESSAGE_OK)
+		{
+			body = NULL;
+		}
+	}
+	else if (contentType == IOTHUBMESSAGE_STRING)
+	{
+		const char* text = IoTHubMessage_GetString(eventMessageHandle);
+		body = (const unsigned char*)text;
+		bodySize = storedStringSize(text);
+	}
+
+	if ((body == NULL) && (bodySize == 0) && (contentType != IOTHUBMESSAGE_BYTEARRAY))
+	{
+		LogError("unable to get the body of the message");
+		result = __LINE__;
+	}
+	else if ((properties == NULL) || (Map_GetInternals(properties, &keys, &values, &propertyCount) != MAP_OK))
+	{
+		LogError("unable to get the properties of the message");
+		result = __LINE__;
 	}
 	else
 	{
-		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
-		if (messageCallback == NULL)
+		const char* messageId = IoTHubMessage_GetMessageId(eventMessageHandle);
+		const char* correlationId = IoTHubMessage_GetCorrelationId(eventMessageHandle);
+		size_t i;
+		size_t size = 1 + sizeof(eventConfirmationCallback) + sizeof(userContextCallback) + 1 +
+			STORE_RECORD_SIZE_LENGTH + bodySize +
+			STORE_RECORD_SIZE_LENGTH + storedStringSize(messageId) +
+			STORE_RECORD_SIZE_LENGTH + storedStringSize(correlationId) +
+			STORE_RECORD_SIZE_LENGTH + 1;
+		for (i = 0; i < propertyCount; i++)
 		{
-			/*Codes_SRS_IOTHUBCLIENT_LL_02_019: [If parameter messageCallback is NULL then IoTHubClient_LL_SetMessageCallback shall call the underlying layer's _Unsubscribe function and return IOTHUB_CLIENT_OK.] */
-			handleData->IoTHubTransport_Unsubscribe(handleData->deviceHandle);
-			handleData->messageCallback = NULL;
-			handleData->messageUserContextCallback = NULL;
-			result = IOTHUB_CLIENT_OK;
+			size += STORE_RECORD_SIZE_LENGTH + storedStringSize(keys[i]) + STORE_RECORD_SIZE_LENGTH + storedStringSize(values[i]);
 		}
-		else
+
+		if (size > handleData->storeRecordSize)
 		{
-			/*Codes_SRS_IOTHUBCLIENT_LL_02_017: [If parameter messageCallback is non-NULL then IoTHubClient_LL_SetMessageCallback shall call the underlying layer's _Subscribe function.]*/
-			if (handleData->IoTHubTransport_Subscribe(handleData->deviceHandle) == 0)
+			unsigned char* newRecord = (unsigned char*)realloc(handleData->storeRecord, size);
+			if (newRecord != NULL)
 			{
-				handleData->messageCallback = messageCallback;
-				handleData->messageUserContextCallback = userContextCallback;
-				result = IOTHUB_CLIENT_OK;
+				handleData->storeRecord = newRecord;
+				handleData->storeRecordSize = size;
 			}
-			else
+		}
+
+		if (size > handleData->storeRecordSize)
+		{
+			LogError("unable to realloc %lu bytes", (unsigned long)size);
+			result = __LINE__;
+		}
+		else
+		{
+			unsigned char* position = handleData->storeRecord;
+			*position++ = STORE_RECORD_VERSION;
+			(void)memcpy(position, &eventConfirmationCallback, sizeof(eventConfirmationCallback));
+			position += sizeof(eventConfirmationCallback);
+			(void)memcpy(position, &userContextCallback, sizeof(userContextCallback));
+			position += sizeof(userContextCallback);
+			*position++ = (unsigned char)contentType;
+			position = putBytes(position, body, bodySize);
+			position = putBytes(position, messageId, storedStringSize(messageId));
+			position = putBytes(position, correlationId, storedStringSize(correlationId));
+			position = putBytes(position, NULL, 0);
+			/*the property count overwrites the size that putBytes wrote*/
+			position[-4] = (unsigned char)(propertyCount & 0xFF);
+			position[-3] = (unsigned char)((propertyCount >> 8) & 0xFF);
+			position[-2] = (unsigned char)((propertyCount >> 16) & 0xFF);
+			position[-1] = (unsigned char)((propertyCount >> 24) & 0xFF);
+			for (i = 0; i < propertyCount; i++)
 			{
-				handleData->messageCallback = NULL;
-				handleData->messageUserContextCallback = NULL;
-				/*Codes_SRS_IOTHUBCLIENT_LL_02_018: [If the underlying layer's _Subscribe function fails, then IoTHubClient_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_ERROR. Otherwise IoTHubClient_LL_SetMessageCallback shall succeed and return IOTHUB_CLIENT_OK.]*/
-				result = IOTHUB_CLIENT_ERROR;
+				position = putBytes(position, keys[i], storedStringSize(keys[i]));
+				position = putBytes(position, values[i], storedStringSize(values[i]));
 			}
+			/*the priority comes last, records written before priorities existed end with the properties*/
+			*position = (unsigned char)priority;
+			*recordSize = size;
+			result = 0;
 		}
 	}
-
 	return result;
 }
 
-static void DoTimeouts(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+static const unsigned char* takeBytes(STORE_RECORD_READER* reader, size_t size)
 {
-	uint64_t nowTick;
-	if (tickcounter_get_current_ms(handleData->tickCounter, &nowTick) != 0)
+	const unsigned char* result;
+	if (size > reader->left)
 	{
-		LogError("unable to get the current ms, timeouts will not be processed");
+		result = NULL;
 	}
 	else
 	{
-		DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
-		while (currentItemInWaitingToSend != &(handleData->waitingToSend)) /*while we are not at the end of the list*/
-		{
-			IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
-			/*Codes_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-			if ((fullEntry->ms_timesOutAfter!=0) && (fullEntry->ms_timesOutAfter < nowTick))
-			{
-				PDLIST_ENTRY theNext = currentItemInWaitingToSend->Flink; /*need to save the next item, because the below operations are destructive*/
-				DList_RemoveEntryList(currentItemInWaitingToSend);
-				if (fullEntry->callback != NULL)
-				{
-					fullEntry->callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, fullEntry->context);
-				}
-				IoTHubMessage_Destroy(fullEntry->messageHandle); /*because it has been cloned*/
-				free(fullEntry);
-				currentItemInWaitingToSend = theNext;
-			}
-			else
-			{
-				currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
-			}
-		}
+		result = reader->position;
+		reader->position += size;
+		reader->left -= size;
 	}
+	return result;
 }
 
-void IoTHubClient_LL_DoWork(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+static int takeSize(STORE_RECORD_READER* reader, size_t* size)
 {
-	/*Codes_SRS_IOTHUBCLIENT_LL_02_020: [If parameter iotHubClientHandle is NULL then IoTHubClient_LL_DoWork shall not perform any action.] */
-	if (iotHubClientHandle != NULL)
+	int result;
+	const unsigned char* bytes = takeBytes(reader, STORE_RECORD_SIZE_LENGTH);
+	if (bytes == NULL)
 	{
-		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
-		DoTimeouts(handleData);
-		handleData->IoTHubTransport_DoWork(handleData->transportHandle, iotHubClientHandle);
+		result = __LINE__;
+	}
+	else
+	{
+		*size = (size_t)bytes[0] | ((size_t)bytes[1] << 8) | ((size_t)bytes[2] << 16) | ((size_t)bytes[3] << 24);
+		result = 0;
 	}
+	return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendStatus(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
+/*the string is used in place, *value is NULL if the string was NULL when it was stored*/
+static int takeString(STORE_RECORD_READER* reader, const char** value)
 {
-	IOTHUB_CLIENT_RESULT result;
-
-	/* Codes_SRS_IOTHUBCLIENT_09_007: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter] */
-	if (iotHubClientHandle == NULL || iotHubClientStatus == NULL)
+	int result;
+	size_t size;
+	const unsigned char* bytes;
+	if (takeSize(reader, &size) != 0)
 	{
-		result = IOTHUB_CLIENT_INVALID_ARG;
-		LOG_ERROR;
+		result = __LINE__;
+	}
+	else if (size == 0)
+	{
+		*value = NULL;
+		result = 0;
+	}
+	else if (((bytes = takeBytes(reader, size)) == NULL) || (bytes[size - 1] != '\0'))
+	{
+		result = __LINE__;
 	}
 	else
 	{
-		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
-
-		/* Codes_SRS_IOTHUBCLIENT_09_008: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there is currently no items to be sent] */
-		/* Codes_SRS_IOTHUBCLIENT_09_009: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently items to be sent] */
-		result = handleData->IoTHubTransport_GetSendStatus(handleData->deviceHandle, iotHubClientStatus);
+		*value = (const char*)bytes;
+		result = 0;
 	}
-
 	return result;
 }
 
-void IoTHubClient_LL_SendComplete(IOTHUB_CLIENT_LL_HANDLE handle, PDLIST_ENTRY completed, IOTHUB_BATCHSTATE_RESULT result)
+/*rebuilds a message serialized by serializeToStoreRecord, returns NULL if the record cannot be read back*/
+static IOTHUB_MESSAGE_HANDLE deserializeStoreRecord(const unsigned char* data, size_t size, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK* eventConfirmationCallback, void** userContextCallback, IOTHUB_MESSAGE_PRIORITY* priority)
 {
-	/*Codes_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL, or parameter handle is NULL then IoTHubClient_LL_SendBatch shall return.]*/
+	IOTHUB_MESSAGE_HANDLE result;
+	STORE_RECORD_READER reader;
+	const unsigned char* header;
+	const unsigned char* body;
+	size_t bodySize;
+	const char* messageId;
+	const char* correlationId;
+	size_t propertyCount;
+	reader.position = data;
+	reader.left = size;
 	if (
-		(handle == NULL) ||
-		(completed == NULL)
+		((header = takeBytes(&reader, 1 + sizeof(*eventConfirmationCallback) + sizeof(*userContextCallback) + 1)) == NULL) ||
+		(header[0] != STORE_RECORD_VERSION) ||
+		(takeSize(&reader, &bodySize) != 0) ||
+		((body = takeBytes(&reader, bodySize)) == NULL) ||
+		(takeString(&reader, &messageId) != 0) ||
+		(takeString(&reader, &correlationId) != 0) ||
+		(takeSize(&reader, &propertyCount) != 0)
 		)
 	{
-		/*"shall return"*/
-		LogError("invalid arg");
+		LogError("corrupted record in the message store");
+		result = NULL;
 	}
 	else
 	{
-		/*Codes_SRS_IOTHUBCLIENT_LL_02_027: [If parameter result is IOTHUB_BACTHSTATE_FAILED then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_ERROR and the context set to the context passed originally in the SendEventAsync call.] */
-		/*Codes_SRS_IOTHUBCLIENT_LL_02_025: [If parameter result is IOTHUB_BATCHSTATE_SUCCESS then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_OK and the context set to the context passed originally in the SendEventAsync call.]*/
-		IOTHUB_CLIENT_CONFIRMATION_RESULT resultToBeCalled = (result == IOTHUB_BATCHSTATE_SUCCESS) ? IOTHUB_CLIENT_CONFIRMATION_OK : IOTHUB_CLIENT_CONFIRMATION_ERROR;
-		PDLIST_ENTRY oldest;
-		while((oldest= DList_RemoveHeadList(completed))!=completed)
+		IOTHUBMESSAGE_CONTENT_TYPE contentType = (IOTHUBMESSAGE_CONTENT_TYPE)header[1 + sizeof(*eventConfirmationCallback) + sizeof(*userContextCallback)];
+		(void)memcpy(eventConfirmationCallback, header + 1, sizeof(*eventConfirmationCallback));
+		(void)memcpy(userContextCallback, header + 1 + sizeof(*eventConfirmationCallback), sizeof(*userContextCallback));
+
+		if (contentType == IOTHUBMESSAGE_STRING)
 		{
-			IOTHUB_MESSAGE_LIST* messageList = (IOTHUB_MESSAGE_LIST*)containingRecord(oldest, IOTHUB_MESSAGE_LIST, entry);
-			if (messageList->callback != NULL)
+			result = ((bodySize == 0) || (body[bodySize - 1] != '\0')) ? NULL : IoTHubMessage_CreateFromString((const char*)body);
+		}
+		else
+		{
+			result = IoTHubMessage_CreateFromByteArray(body, bodySize);
+		}
+
+		if (result == NULL)
+		{
+			LogError("unable to create a message from the message store");
+		}
+		else if (
+			((messageId != NULL) && (IoTHubMessage_SetMessageId(result, messageId) != IOTHUB_MESSAGE_OK)) ||
+			((correlationId != NULL) && (IoTHubMessage_SetCorrelationId(result, correlationId) != IOTHUB_MESSAGE_OK))
+			)
+		{
+			LogError("unable to set the ids of a message from the message store");
+			IoTHubMessage_Destroy(result);
+			result = NULL;
+		}
+		else
+		{
+			MAP_HANDLE properties = IoTHubMessage_Properties(result);
+			size_t i;
+			for (i = 0; i < propertyCount; i++)
 			{
-				messageList->callback(resultToBeCalled, messageList->context);
+				const char* key;
+				const char* value;
+				if (
+					(takeString(&reader, &key) != 0) ||
+					(takeString(&reader, &value) != 0) ||
+					(key == NULL) ||
+					(value == NULL) ||
+					(Map_AddOrUpdate(properties, key, value) != MAP_OK)
+					)
+				{
+					break;
+				}
+			}
+
+			if (i < propertyCount)
+			{
+				LogError("unable to set the properties of a message from the message store");
+				IoTHubMessage_Destroy(result);
+				result = NULL;
+			}
+			else
+			{
+				const unsigned char* storedPriority = takeBytes(&reader, 1);
+				*priority = (
+					(storedPriority != NULL) &&
+					((storedPriority[0] == IOTHUB_MESSAGE_PRIORITY_LOW) || (storedPriority[0] == IOTHUB_MESSAGE_PRIORITY_HIGH))
+					) ? (IOTHUB_MESSAGE_PRIORITY)storedPriority[0] : IOTHUB_MESSAGE_PRIORITY_NORMAL;
+				if ((*priority != IOTHUB_MESSAGE_PRIORITY_NORMAL) && (IoTHubMessage_SetPriority(result, *priority) != IOTHUB_MESSAGE_OK))
+				{
+					LogError("unable to set the priority of a message from the message store");
+					IoTHubMessage_Destroy(result);
+					result = NULL;
+				}
 			}
-			IoTHubMessage_Destroy(messageList->messageHandle);
-			free(messageList);
 		}
 	}
+	return result;
 }
 
-IOTHUBMESSAGE_DISPOSITION_RESULT IoTHubClient_LL_MessageCallback(IOTHUB_CLIENT_LL_HANDLE handle, IOTHUB_MESSAGE_HANDLE message)
+/*appends a message to messageStore instead of waitingToSend, eventMessageHandle stays owned by the caller*/
+static IOTHUB_CLIENT_RESULT addToMessageStore(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, IOTHUB_MESSAGE_PRIORITY priority)
 {
-	int result;
-	/*Codes_SRS_IOTHUBCLIENT_LL_02_029: [If parameter handle is NULL then IoTHubClient_LL_MessageCallback shall return IOTHUBMESSAGE_ABANDONED.] */
-	if (handle == NULL)
+	IOTHUB_CLIENT_RESULT result;
+	size_t recordSize;
+	if (
+		(serializeToStoreRecord(handleData, eventMessageHandle, eventConfirmationCallback, userContextCallback, priority, &recordSize) != 0) ||
+		(MessageStore_Append(handleData->messageStore, handleData->storeRecord, recordSize) != 0)
+		)
 	{
-		LogError("invalid argument");
-		result = IOTHUBMESSAGE_ABANDONED;
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_075: [ If serializing the message or MessageStore_Append fails then IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+		result = IOTHUB_CLIENT_ERROR;
+		LOG_ERROR;
 	}
 	else
 	{
-		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)handle;
+		result = IOTHUB_CLIENT_OK;
+	}
+	return result;
+}
 
-		/* Codes_SRS_IOTHUBCLIENT_LL_09_004: [IoTHubClient_LL_GetLastMessageReceiveTime shall return lastMessageReceiveTime in localtime] */
-		handleData->lastMessageReceiveTime = get_time(NULL);
+/*adds a new record to waitingToSend. The record owns a clone of eventMessageHandle, or eventMessageHandle itself when adoptMessage is true.
+The message counts as queued at queuedAt, or now when queuedAt is UNKNOWN_QUEUED_TIME. Past the watermark of the message store the message is appended to the store instead*/
+static IOTHUB_CLIENT_RESULT addToWaitingToSend(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool adoptMessage, uint64_t queuedAt)
+{
+	IOTHUB_CLIENT_RESULT result;
+	IOTHUB_MESSAGE_LIST *newEntry;
+	IOTHUB_MESSAGE_PRIORITY priority = IoTHubMessage_GetPriority(eventMessageHandle);
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_074: [ If there is a message store, and either it still has messages to replay or there are "messageStoreWatermark" messages in memory already, then IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall serialize the message together with eventConfirmationCallback and userContextCallback and append it to the store by calling MessageStore_Append instead of adding it to waitingToSend. ]*/
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_087: [ Messages of priority IOTHUB_MESSAGE_PRIORITY_HIGH shall always be added to waitingToSend, never to the message store. ]*/
+	if (
+		(handleData->messageStore != NULL) &&
+		(priority != IOTHUB_MESSAGE_PRIORITY_HIGH) &&
+		(!MessageStore_IsEmpty(handleData->messageStore) || (messagesInMemory(handleData) >= handleData->messageStoreWatermark))
+		)
+	{
+		result = addToMessageStore(handleData, eventMessageHandle, eventConfirmationCallback, userContextCallback, priority);
+		if ((result == IOTHUB_CLIENT_OK) && adoptMessage)
+		{
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_076: [ Once the message is in the store, IoTHubClient_LL_SendEventAsync_Move shall destroy eventMessageHandle. ]*/
+			IoTHubMessage_Destroy(eventMessageHandle);
+		}
+	}
+	else if ((newEntry = (IOTHUB_MESSAGE_LIST*)NodePool_Alloc(handleData->messagePool)) == NULL)
+	{
+		result = IOTHUB_CLIENT_ERROR;
+		LOG_ERROR;
+	}
+	else
+	{
+		if (attach_ms_timesOutAfter(handleData, newEntry, queuedAt) != 0)
+		{
+			result = IOTHUB_CLIENT_ERROR;
+			LOG_ERROR;
+			NodePool_Free(newEntry);
+		}
+		else
+		{
+			if (adoptMessage)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_051: [ IoTHubClient_LL_SendEventAsync_Move shall add to the DLIST waitingToSend a new record that takes eventMessageHandle itself, without cloning it, together with eventConfirmationCallback and userContextCallback. ]*/
+				newEntry->messageHandle = eventMessageHandle;
+			}
+			else
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
+				newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle);
+			}
+
+			if (newEntry->messageHandle == NULL)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_014: [If cloning and/or adding the information fails for any reason, IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
+				result = IOTHUB_CLIENT_ERROR;
+				NodePool_Free(newEntry);
+				LOG_ERROR;
+			}
+			else
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
+				newEntry->callback = eventConfirmationCallback;
+				newEntry->context = userContextCallback;
+				newEntry->storeSegment = NULL;
+				newEntry->owner = handleData;
+				newEntry->priority = priority;
+				insertByPriority(handleData, newEntry);
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClient_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+	}
+	return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+	IOTHUB_CLIENT_RESULT result;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_011: [IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL.]*/
+	if (
+		(iotHubClientHandle == NULL) ||
+		(eventMessageHandle == NULL) ||
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_012: [IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter eventConfirmationCallback is NULL and userContextCallback is not NULL.] */
+		((eventConfirmationCallback == NULL) && (userContextCallback != NULL))
+		)
+	{
+		result = IOTHUB_CLIENT_INVALID_ARG;
+		LOG_ERROR;
+	}
+	else
+	{
+		result = addToWaitingToSend((IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, false, UNKNOWN_QUEUED_TIME);
+	}
+	return result;
+}
+
+static IOTHUB_CLIENT_RESULT sendEventAsyncMove(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, uint64_t queuedAt)
+{
+	IOTHUB_CLIENT_RESULT result;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_049: [ IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL. ]*/
+	if (
+		(iotHubClientHandle == NULL) ||
+		(eventMessageHandle == NULL) ||
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_050: [ IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+		((eventConfirmationCallback == NULL) && (userContextCallback != NULL))
+		)
+	{
+		result = IOTHUB_CLIENT_INVALID_ARG;
+		LOG_ERROR;
+	}
+	else
+	{
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_052: [ If adding the record fails for any reason, IoTHubClient_LL_SendEventAsync_Move shall fail, return IOTHUB_CLIENT_ERROR and leave eventMessageHandle owned by the caller. ]*/
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_053: [ Otherwise IoTHubClient_LL_SendEventAsync_Move shall succeed and return IOTHUB_CLIENT_OK. From then on eventMessageHandle is owned by IoTHubClient_LL and shall be destroyed by it once the message is completed. ]*/
+		result = addToWaitingToSend((IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, true, queuedAt);
+	}
+	return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync_Move(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+	return sendEventAsyncMove(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, UNKNOWN_QUEUED_TIME);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync_MoveQueuedAt(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, uint64_t queuedAt)
+{
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_113: [ IoTHubClient_LL_SendEventAsync_MoveQueuedAt shall check its arguments, add the record and take over eventMessageHandle the same way IoTHubClient_LL_SendEventAsync_Move does. ]*/
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_114: [ IoTHubClient_LL_SendEventAsync_MoveQueuedAt shall record queuedAt as the time the message is queued at, instead of calling tickcounter_get_current_ms, so that its "messageTimeout" runs from queuedAt. If queuedAt is UNKNOWN_QUEUED_TIME it shall behave exactly as IoTHubClient_LL_SendEventAsync_Move. ]*/
+	return sendEventAsyncMove(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, queuedAt);
+}
+
+uint64_t IoTHubClient_LL_GetCurrentTime(IOTHUB_CLIENT_LL_HANDLE handle)
+{
+	uint64_t result;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_115: [ If handle is NULL or tickcounter_get_current_ms fails then IoTHubClient_LL_GetCurrentTime shall return UNKNOWN_QUEUED_TIME. ]*/
+	if (handle == NULL)
+	{
+		result = UNKNOWN_QUEUED_TIME;
+		LogError("invalid arg");
+	}
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_116: [ Otherwise IoTHubClient_LL_GetCurrentTime shall return the time given by tickcounter_get_current_ms. ]*/
+	else if (tickcounter_get_current_ms(((IOTHUB_CLIENT_LL_HANDLE_DATA*)handle)->tickCounter, &result) != 0)
+	{
+		result = UNKNOWN_QUEUED_TIME;
+		LogError("unable to get the current relative tickcount");
+	}
+	else
+	{
+		/*all is fine*/
+	}
+	return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_SetMessageCallback(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback)
+{
+	IOTHUB_CLIENT_RESULT result;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_016: [IoTHubClient_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.] */
+	if (iotHubClientHandle == NULL)
+	{
+		result = IOTHUB_CLIENT_INVALID_ARG;
+		LOG_ERROR;
+	}
+	else
+	{
+		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+		if (messageCallback == NULL)
+		{
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_019: [If parameter messageCallback is NULL then IoTHubClient_LL_SetMessageCallback shall call the underlying layer's _Unsubscribe function and return IOTHUB_CLIENT_OK.] */
+			handleData->IoTHubTransport_Unsubscribe(handleData->deviceHandle);
+			handleData->messageCallback = NULL;
+			handleData->messageUserContextCallback = NULL;
+			result = IOTHUB_CLIENT_OK;
+		}
+		else
+		{
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_017: [If parameter messageCallback is non-NULL then IoTHubClient_LL_SetMessageCallback shall call the underlying layer's _Subscribe function.]*/
+			if (handleData->IoTHubTransport_Subscribe(handleData->deviceHandle) == 0)
+			{
+				handleData->messageCallback = messageCallback;
+				handleData->messageUserContextCallback = userContextCallback;
+				result = IOTHUB_CLIENT_OK;
+			}
+			else
+			{
+				handleData->messageCallback = NULL;
+				handleData->messageUserContextCallback = NULL;
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_018: [If the underlying layer's _Subscribe function fails, then IoTHubClient_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_ERROR. Otherwise IoTHubClient_LL_SetMessageCallback shall succeed and return IOTHUB_CLIENT_OK.]*/
+				result = IOTHUB_CLIENT_ERROR;
+			}
+		}
+	}
+
+	return result;
+}
+
+static void DoTimeouts(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+{
+	uint64_t nowTick;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_064: [ If no message in waitingToSend can timeout then IoTHubClient_LL_DoWork shall not look for timed out messages. ]*/
+	if (handleData->lastQueuedTimeout == 0)
+	{
+		/*nothing to do*/
+	}
+	else if (tickcounter_get_current_ms(handleData->tickCounter, &nowTick) != 0)
+	{
+		LogError("unable to get the current ms, timeouts will not be processed");
+	}
+	else
+	{
+		bool timedEntriesLeft = false;
+		bool remainingInOrder = true;
+		uint64_t lastRemainingTimeout = 0;
+		DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
+		while (currentItemInWaitingToSend != &(handleData->waitingToSend)) /*while we are not at the end of the list*/
+		{
+			IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
+			if (fullEntry->ms_timesOutAfter == 0)
+			{
+				currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
+			}
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+			else if (fullEntry->ms_timesOutAfter < nowTick)
+			{
+				PDLIST_ENTRY theNext = currentItemInWaitingToSend->Flink; /*need to save the next item, because the below operations are destructive*/
+				DList_RemoveEntryList(currentItemInWaitingToSend);
+				if (fullEntry->callback != NULL)
+				{
+					fullEntry->callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, fullEntry->context);
+				}
+				if (fullEntry->storeSegment != NULL)
+				{
+					/*Codes_SRS_IOTHUBCLIENT_LL_02_078: [ Once a message replayed from the message store is completed, whether it was sent, failed or timed out, IoTHubClient_LL shall call MessageStore_Confirm. ]*/
+					MessageStore_Confirm(handleData->messageStore, fullEntry->storeSegment);
+				}
+				laneDropped(handleData, fullEntry);
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_101: [ Messages that time out shall be counted in timedOut and shall not be in flight anymore. ]*/
+				handleData->sendStats.timedOut++;
+				inFlightReleased(handleData, fullEntry);
+				IoTHubMessage_Destroy(fullEntry->messageHandle); /*because it has been cloned*/
+				NodePool_Free(fullEntry);
+				currentItemInWaitingToSend = theNext;
+			}
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_065: [ If the messages that can timeout were queued with increasing timeouts then IoTHubClient_LL_DoWork shall stop looking for timed out messages at the first message that has not timed out. ]*/
+			else if (handleData->timeoutsInOrder)
+			{
+				timedEntriesLeft = true;
+				break;
+			}
+			else
+			{
+				if (fullEntry->ms_timesOutAfter < lastRemainingTimeout)
+				{
+					remainingInOrder = false;
+				}
+				else
+				{
+					lastRemainingTimeout = fullEntry->ms_timesOutAfter;
+				}
+				currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
+			}
+		}
+
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_066: [ Once all the messages of waitingToSend have been inspected, IoTHubClient_LL_DoWork shall resume stopping at the first message that has not timed out if the remaining messages are sorted by their timeouts. ]*/
+		if (!timedEntriesLeft)
+		{
+			handleData->lastQueuedTimeout = lastRemainingTimeout;
+			handleData->timeoutsInOrder = remainingInOrder;
+		}
+	}
+}
+
+static void DoReplay(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+{
+	if (handleData->messageStore != NULL)
+	{
+		size_t inMemory = messagesInMemory(handleData);
+		MESSAGESTORE_RECORD record;
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_077: [ If there is a message store, IoTHubClient_LL_DoWork shall move the messages of the store, oldest first, to waitingToSend by calling MessageStore_ReadNext until there are "messageStoreWatermark" messages in memory or the store has no more messages to replay. ]*/
+		while ((inMemory < handleData->messageStoreWatermark) && !MessageStore_IsEmpty(handleData->messageStore))
+		{
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_110: [ The record of a replayed message shall be allocated before calling MessageStore_ReadNext; if that fails, IoTHubClient_LL_DoWork shall stop replaying and leave the message in the store for the next call. ]*/
+			IOTHUB_MESSAGE_LIST* newEntry = (IOTHUB_MESSAGE_LIST*)NodePool_Alloc(handleData->messagePool);
+			if ((newEntry == NULL) || (attach_ms_timesOutAfter(handleData, newEntry, UNKNOWN_QUEUED_TIME) != 0))
+			{
+				LogError("unable to replay a message of the message store, will retry");
+				if (newEntry != NULL)
+				{
+					NodePool_Free(newEntry);
+				}
+				break;
+			}
+			else if (MessageStore_ReadNext(handleData->messageStore, &record) != 0)
+			{
+				NodePool_Free(newEntry);
+				break;
+			}
+			else
+			{
+				IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback;
+				void* userContextCallback;
+				IOTHUB_MESSAGE_PRIORITY priority;
+				IOTHUB_MESSAGE_HANDLE message = deserializeStoreRecord(record.data, record.size, &eventConfirmationCallback, &userContextCallback, &priority);
+				if (message == NULL)
+				{
+					/*Codes_SRS_IOTHUBCLIENT_LL_02_081: [ A record of the message store that cannot be turned back into a message shall be dropped by calling MessageStore_Confirm. ]*/
+					LogError("dropping a message of the message store that cannot be read back");
+					MessageStore_Confirm(handleData->messageStore, record.segment);
+					NodePool_Free(newEntry);
+				}
+				else
+				{
+					if (!record.appendedByThisStore)
+					{
+						/*Codes_SRS_IOTHUBCLIENT_LL_02_080: [ Messages that were stored by a previous process shall be replayed without a confirmation callback. ]*/
+						eventConfirmationCallback = NULL;
+						userContextCallback = NULL;
+					}
+
+					newEntry->messageHandle = message;
+					newEntry->callback = eventConfirmationCallback;
+					newEntry->context = userContextCallback;
+					newEntry->storeSegment = record.segment;
+					newEntry->owner = handleData;
+					newEntry->priority = priority;
+					/*Codes_SRS_IOTHUBCLIENT_LL_02_088: [ Messages replayed from the message store shall be added to waitingToSend by their priority, like new messages. ]*/
+					insertByPriority(handleData, newEntry);
+					inMemory++;
+				}
+			}
+		}
+	}
+}
+
+void IoTHubClient_LL_DoWork(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_020: [If parameter iotHubClientHandle is NULL then IoTHubClient_LL_DoWork shall not perform any action.] */
+	if (iotHubClientHandle != NULL)
+	{
+		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+		DoTimeouts(handleData);
+		DoReplay(handleData);
+		handleData->IoTHubTransport_DoWork(handleData->transportHandle, iotHubClientHandle);
+	}
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendStatus(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
+{
+	IOTHUB_CLIENT_RESULT result;
+
+	/* Codes_SRS_IOTHUBCLIENT_09_007: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter] */
+	if (iotHubClientHandle == NULL || iotHubClientStatus == NULL)
+	{
+		result = IOTHUB_CLIENT_INVALID_ARG;
+		LOG_ERROR;
+	}
+	else
+	{
+		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+
+		/* Codes_SRS_IOTHUBCLIENT_09_008: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there is currently no items to be sent] */
+		/* Codes_SRS_IOTHUBCLIENT_09_009: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently items to be sent] */
+		result = handleData->IoTHubTransport_GetSendStatus(handleData->deviceHandle, iotHubClientStatus);
+
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_082: [ If the transport reports IOTHUB_CLIENT_SEND_STATUS_IDLE while the message store still has messages to replay, IoTHubClient_LL_GetSendStatus shall report IOTHUB_CLIENT_SEND_STATUS_BUSY. ]*/
+		if (
+			(result == IOTHUB_CLIENT_OK) &&
+			(*iotHubClientStatus == IOTHUB_CLIENT_SEND_STATUS_IDLE) &&
+			(handleData->messageStore != NULL) &&
+			!MessageStore_IsEmpty(handleData->messageStore)
+			)
+		{
+			*iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+		}
+	}
+
+	return result;
+}
+
+void IoTHubClient_LL_SendComplete(IOTHUB_CLIENT_LL_HANDLE handle, PDLIST_ENTRY completed, IOTHUB_BATCHSTATE_RESULT result)
+{
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL, or parameter handle is NULL then IoTHubClient_LL_SendBatch shall return.]*/
+	if (
+		(handle == NULL) ||
+		(completed == NULL)
+		)
+	{
+		/*"shall return"*/
+		LogError("invalid arg");
+	}
+	else
+	{
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_027: [If parameter result is IOTHUB_BACTHSTATE_FAILED then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_ERROR and the context set to the context passed originally in the SendEventAsync call.] */
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_025: [If parameter result is IOTHUB_BATCHSTATE_SUCCESS then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_OK and the context set to the context passed originally in the SendEventAsync call.]*/
+		IOTHUB_CLIENT_CONFIRMATION_RESULT resultToBeCalled = (result == IOTHUB_BATCHSTATE_SUCCESS) ? IOTHUB_CLIENT_CONFIRMATION_OK : IOTHUB_CLIENT_CONFIRMATION_ERROR;
+		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)handle;
+		PDLIST_ENTRY oldest;
+		uint64_t nowTick = UNKNOWN_QUEUED_TIME;
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_091: [ If completed is not empty, IoTHubClient_LL_SendComplete shall call tickcounter_get_current_ms once and add to the counters of the priority of every completed message the time since the message was queued. ]*/
+		if ((completed->Flink != completed) && (tickcounter_get_current_ms(handleData->tickCounter, &nowTick) != 0))
+		{
+			LogError("unable to get the current ms, the latency of the completed messages will not be counted");
+			nowTick = UNKNOWN_QUEUED_TIME;
+		}
+		while((oldest= DList_RemoveHeadList(completed))!=completed)
+		{
+			IOTHUB_MESSAGE_LIST* messageList = (IOTHUB_MESSAGE_LIST*)containingRecord(oldest, IOTHUB_MESSAGE_LIST, entry);
+			if (messageList->callback != NULL)
+			{
+				messageList->callback(resultToBeCalled, messageList->context);
+			}
+			laneCompleted(handleData, messageList, nowTick);
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_100: [ IoTHubClient_LL_SendComplete shall count every completed message in succeeded or failed, and for every completed message that the transport sent it shall record in sendToConfirmMs the time since the message was sent for the last time and shall not count it in flight anymore. ]*/
+			if (result == IOTHUB_BATCHSTATE_SUCCESS)
+			{
+				handleData->sendStats.succeeded++;
+			}
+			else
+			{
+				handleData->sendStats.failed++;
+			}
+			if ((messageList->sendAttempts > 0) && (nowTick != UNKNOWN_QUEUED_TIME) && (messageList->ms_sentAt != UNKNOWN_QUEUED_TIME) && (nowTick >= messageList->ms_sentAt))
+			{
+				histogramRecord(&(handleData->sendStats.sendToConfirmMs), nowTick - messageList->ms_sentAt);
+			}
+			inFlightReleased(handleData, messageList);
+			if ((handleData->messageStore != NULL) && (messageList->storeSegment != NULL))
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_078: [ Once a message replayed from the message store is completed, whether it was sent, failed or timed out, IoTHubClient_LL shall call MessageStore_Confirm. ]*/
+				MessageStore_Confirm(handleData->messageStore, messageList->storeSegment);
+			}
+			IoTHubMessage_Destroy(messageList->messageHandle);
+			/*the record might have been allocated by another client that shares the transport, NodePool_Free finds the owning pool by itself*/
+			NodePool_Free(messageList);
+		}
+	}
+}
+
+IOTHUBMESSAGE_DISPOSITION_RESULT IoTHubClient_LL_MessageCallback(IOTHUB_CLIENT_LL_HANDLE handle, IOTHUB_MESSAGE_HANDLE message)
+{
+	int result;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_029: [If parameter handle is NULL then IoTHubClient_LL_MessageCallback shall return IOTHUBMESSAGE_ABANDONED.] */
+	if (handle == NULL)
+	{
+		LogError("invalid argument");
+		result = IOTHUBMESSAGE_ABANDONED;
+	}
+	else
+	{
+		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)handle;
+		IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message);
+		const unsigned char* body;
+		size_t bodySize;
+
+		/* Codes_SRS_IOTHUBCLIENT_LL_09_004: [IoTHubClient_LL_GetLastMessageReceiveTime shall return lastMessageReceiveTime in localtime] */
+		handleData->lastMessageReceiveTime = get_time(NULL);
+
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_102: [ IoTHubClient_LL_MessageCallback shall add to bytesIn the size of the body of the message, obtained by calling IoTHubMessage_GetContentType and then IoTHubMessage_GetByteArray or IoTHubMessage_GetString. ]*/
+		if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+		{
+			if (IoTHubMessage_GetByteArray(message, &body, &bodySize) == IOTHUB_MESSAGE_OK)
+			{
+				handleData->sendStats.bytesIn += bodySize;
+			}
+		}
+		else if (contentType == IOTHUBMESSAGE_STRING)
+		{
+			const char* text = IoTHubMessage_GetString(message);
+			if (text != NULL)
+			{
+				handleData->sendStats.bytesIn += strlen(text);
+			}
+		}
+		else
+		{
+			/*nothing to count*/
+		}
 
 		/*Codes_SRS_IOTHUBCLIENT_LL_02_030: [IoTHubClient_LL_MessageCallback shall invoke the last callback function (the parameter messageCallback to IoTHubClient_LL_SetMessageCallback) passing the message and the passed userContextCallback.]*/
 		if (handleData->messageCallback != NULL)
 		{
 			result = handleData->messageCallback(message, handleData->messageUserContextCallback);
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_107: [ If the callback returns IOTHUBMESSAGE_ASYNC_ACK and the "AsyncMessageDisposition" option is not set then IoTHubClient_LL_MessageCallback shall return IOTHUBMESSAGE_ABANDONED. ]*/
+			if ((result == IOTHUBMESSAGE_ASYNC_ACK) && !handleData->asyncMessageDisposition)
+			{
+				LogError("IOTHUBMESSAGE_ASYNC_ACK needs the \"AsyncMessageDisposition\" option, the message is abandoned");
+				result = IOTHUBMESSAGE_ABANDONED;
+			}
 		}
 		else
 		{
@@ -780,6 +1570,111 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_SetOption(IOTHUB_CLIENT_LL_HANDLE iotHubCli
 			handleData->currentMessageTimeout = *(const uint64_t*)value;
 			result = IOTHUB_CLIENT_OK;
 		}
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_058: [ "messagePoolSize" - IoTHubClient_LL_SetOption shall call NodePool_Reserve so that the pool of waitingToSend records owns at least value records. Value is a pointer to a size_t. ]*/
+		else if (strcmp(optionName, "messagePoolSize") == 0)
+		{
+			if (NodePool_Reserve(handleData->messagePool, *(const size_t*)value) != 0)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_059: [ If NodePool_Reserve fails then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+				result = IOTHUB_CLIENT_ERROR;
+				LOG_ERROR;
+			}
+			else
+			{
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_060: [ "messagePoolGrowth" - IoTHubClient_LL_SetOption shall call NodePool_SetGrowth to set how many records are added to the pool when it runs out of records. Value is a pointer to a size_t. ]*/
+		else if (strcmp(optionName, "messagePoolGrowth") == 0)
+		{
+			if (NodePool_SetGrowth(handleData->messagePool, *(const size_t*)value) != 0)
+			{
+				result = IOTHUB_CLIENT_ERROR;
+				LOG_ERROR;
+			}
+			else
+			{
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_071: [ "messageStore" - IoTHubClient_LL_SetOption shall open the message store whose files are named after value by calling MessageStore_Create with the current "messageStoreSegmentSize". Value is a const char*. ]*/
+		else if (strcmp(optionName, "messageStore") == 0)
+		{
+			if (handleData->messageStore != NULL)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_072: [ If a message store is already open or MessageStore_Create fails then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+				LogError("a message store is already open");
+				result = IOTHUB_CLIENT_ERROR;
+			}
+			else if ((handleData->messageStore = MessageStore_Create((const char*)value, handleData->messageStoreSegmentSize)) == NULL)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_072: [ If a message store is already open or MessageStore_Create fails then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+				result = IOTHUB_CLIENT_ERROR;
+				LOG_ERROR;
+			}
+			else
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_112: [ IoTHubClient_LL_SetOption shall then pass the current "messageStoreSyncInterval" to the message store by calling MessageStore_SetSyncInterval. ]*/
+				(void)MessageStore_SetSyncInterval(handleData->messageStore, handleData->messageStoreSyncInterval);
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_073: [ "messageStoreWatermark" - IoTHubClient_LL_SetOption shall set how many messages are kept in memory before new messages go to the message store. The default is 1000. Value is a pointer to a size_t. ]*/
+		else if (strcmp(optionName, "messageStoreWatermark") == 0)
+		{
+			if (*(const size_t*)value == 0)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_083: [ If the value of "messageStoreWatermark" or "messageStoreSegmentSize" is 0 then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+				result = IOTHUB_CLIENT_INVALID_ARG;
+				LOG_ERROR;
+			}
+			else
+			{
+				handleData->messageStoreWatermark = *(const size_t*)value;
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_084: [ "messageStoreSegmentSize" - IoTHubClient_LL_SetOption shall set the size in bytes after which the message stores opened afterwards start a new segment file. The default is 1 MB. Value is a pointer to a size_t. ]*/
+		else if (strcmp(optionName, "messageStoreSegmentSize") == 0)
+		{
+			if (*(const size_t*)value == 0)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_083: [ If the value of "messageStoreWatermark" or "messageStoreSegmentSize" is 0 then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+				result = IOTHUB_CLIENT_INVALID_ARG;
+				LOG_ERROR;
+			}
+			else
+			{
+				handleData->messageStoreSegmentSize = *(const size_t*)value;
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_111: [ "messageStoreSyncInterval" - IoTHubClient_LL_SetOption shall set after how many stored messages the message stores opened afterwards wait for their files to be written to the disk. 0 leaves it to the operating system. The default is 1, every message. Value is a pointer to a size_t. ]*/
+		else if (strcmp(optionName, "messageStoreSyncInterval") == 0)
+		{
+			handleData->messageStoreSyncInterval = *(const size_t*)value;
+			result = IOTHUB_CLIENT_OK;
+		}
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_092: [ "priorityMaxOvertakes" - IoTHubClient_LL_SetOption shall set how many messages of a higher priority can be queued ahead of a message that is already waiting. 0 keeps the messages in the order they were queued. Value is a pointer to a size_t. ]*/
+		else if (strcmp(optionName, "priorityMaxOvertakes") == 0)
+		{
+			handleData->priorityMaxOvertakes = *(const size_t*)value;
+			result = IOTHUB_CLIENT_OK;
+		}
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_105: [ "AsyncMessageDisposition" - IoTHubClient_LL_SetOption shall pass the option to the transport's _SetOption and, if that returns IOTHUB_CLIENT_OK, remember whether messages can be completed later by IoTHubClient_LL_SendMessageDisposition. Value is a pointer to a bool. ]*/
+		else if (strcmp(optionName, "AsyncMessageDisposition") == 0)
+		{
+			result = handleData->IoTHubTransport_SetOption(handleData->transportHandle, optionName, value);
+			if (result != IOTHUB_CLIENT_OK)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_108: [ If the transport's _SetOption fails then IoTHubClient_LL_SetOption shall leave "AsyncMessageDisposition" unchanged and return what the transport returned. ]*/
+				LogError("the transport does not support asynchronous message disposition, returned = %s", ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, result));
+			}
+			else
+			{
+				handleData->asyncMessageDisposition = *(const bool*)value;
+			}
+		}
 		else
 		{
 			/*Codes_SRS_IOTHUBCLIENT_LL_02_038: [Otherwise, IoTHubClient_LL shall call the function _SetOption of the underlying transport and return what that function is returning.] */
@@ -793,3 +1688,179 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_SetOption(IOTHUB_CLIENT_LL_HANDLE iotHubCli
 	}
 	return result;
 }
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendMessageDisposition(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition)
+{
+	IOTHUB_CLIENT_RESULT result;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_067: [ If iotHubClientHandle or message is NULL then IoTHubClient_LL_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_068: [ If disposition is not one of IOTHUBMESSAGE_ACCEPTED, IOTHUBMESSAGE_REJECTED or IOTHUBMESSAGE_ABANDONED then IoTHubClient_LL_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+	if (
+		(iotHubClientHandle == NULL) ||
+		(message == NULL) ||
+		(
+			(disposition != IOTHUBMESSAGE_ACCEPTED) &&
+			(disposition != IOTHUBMESSAGE_REJECTED) &&
+			(disposition != IOTHUBMESSAGE_ABANDONED)
+		)
+		)
+	{
+		result = IOTHUB_CLIENT_INVALID_ARG;
+		LOG_ERROR;
+	}
+	else
+	{
+		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_109: [ If the "AsyncMessageDisposition" option is not set then IoTHubClient_LL_SendMessageDisposition shall return IOTHUB_CLIENT_ERROR. ]*/
+		if (!handleData->asyncMessageDisposition)
+		{
+			result = IOTHUB_CLIENT_ERROR;
+			LogError("the \"AsyncMessageDisposition\" option is not set");
+		}
+		else
+		{
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_069: [ Otherwise IoTHubClient_LL_SendMessageDisposition shall call the transport's _SendMessageDisposition and return what it returns. ]*/
+			result = handleData->IoTHubTransport_SendMessageDisposition(handleData->deviceHandle, message, disposition);
+		}
+	}
+	return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetMessagePoolStats(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, NODEPOOL_STATS* stats)
+{
+	IOTHUB_CLIENT_RESULT result;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_061: [ If iotHubClientHandle or stats is NULL then IoTHubClient_LL_GetMessagePoolStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+	if (
+		(iotHubClientHandle == NULL) ||
+		(stats == NULL)
+		)
+	{
+		result = IOTHUB_CLIENT_INVALID_ARG;
+		LOG_ERROR;
+	}
+	else
+	{
+		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_062: [ Otherwise IoTHubClient_LL_GetMessagePoolStats shall fill stats by calling NodePool_GetStats and return IOTHUB_CLIENT_OK. ]*/
+		if (NodePool_GetStats(handleData->messagePool, stats) != 0)
+		{
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_063: [ If NodePool_GetStats fails then IoTHubClient_LL_GetMessagePoolStats shall return IOTHUB_CLIENT_ERROR. ]*/
+			result = IOTHUB_CLIENT_ERROR;
+			LOG_ERROR;
+		}
+		else
+		{
+			result = IOTHUB_CLIENT_OK;
+		}
+	}
+	return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetPriorityLaneStats(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY priority, IOTHUB_CLIENT_PRIORITY_LANE_STATS* stats)
+{
+	IOTHUB_CLIENT_RESULT result;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_093: [ If iotHubClientHandle or stats is NULL, or priority is not one of the values of IOTHUB_MESSAGE_PRIORITY, then IoTHubClient_LL_GetPriorityLaneStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+	if (
+		(iotHubClientHandle == NULL) ||
+		(stats == NULL) ||
+		(
+			(priority != IOTHUB_MESSAGE_PRIORITY_LOW) &&
+			(priority != IOTHUB_MESSAGE_PRIORITY_NORMAL) &&
+			(priority != IOTHUB_MESSAGE_PRIORITY_HIGH)
+		)
+		)
+	{
+		result = IOTHUB_CLIENT_INVALID_ARG;
+		LOG_ERROR;
+	}
+	else
+	{
+		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_094: [ Otherwise IoTHubClient_LL_GetPriorityLaneStats shall fill stats with the counters of the messages of priority priority and return IOTHUB_CLIENT_OK. ]*/
+		*stats = handleData->laneStats[priority];
+		result = IOTHUB_CLIENT_OK;
+	}
+	return result;
+}
+
+void IoTHubClient_LL_SendStarted(IOTHUB_CLIENT_LL_HANDLE handle, IOTHUB_MESSAGE_LIST* first, size_t count, size_t size)
+{
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_095: [ If handle or first is NULL, or count is 0, then IoTHubClient_LL_SendStarted shall return. ]*/
+	if (
+		(handle == NULL) ||
+		(first == NULL) ||
+		(count == 0)
+		)
+	{
+		LogError("invalid arg");
+	}
+	else
+	{
+		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)handle;
+		IOTHUB_MESSAGE_LIST* message = first;
+		uint64_t nowTick;
+		size_t i;
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_096: [ IoTHubClient_LL_SendStarted shall call tickcounter_get_current_ms once, record count in batchSize and add size to bytesOut. ]*/
+		if (tickcounter_get_current_ms(handleData->tickCounter, &nowTick) != 0)
+		{
+			LogError("unable to get the current ms, the latency of the sent messages will not be counted");
+			nowTick = UNKNOWN_QUEUED_TIME;
+		}
+		histogramRecord(&(handleData->sendStats.batchSize), count);
+		handleData->sendStats.bytesOut += size;
+
+		for (i = 0; i < count; i++)
+		{
+			/*Codes_SRS_IOTHUBCLIENT_LL_02_099: [ size shall be split evenly between the messages, the remainder going to first, and every message shall be counted in bytesInFlight with its share until it is completed. ]*/
+			size_t share = (size / count) + ((i == 0) ? (size % count) : 0);
+			if (message->sendAttempts == 0)
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_097: [ A message sent for the first time shall be counted in inFlight and IoTHubClient_LL_SendStarted shall record in enqueueToSendMs the time since the message was queued. ]*/
+				handleData->sendStats.inFlight++;
+				if ((nowTick != UNKNOWN_QUEUED_TIME) && (message->ms_queuedAt != UNKNOWN_QUEUED_TIME) && (nowTick >= message->ms_queuedAt))
+				{
+					histogramRecord(&(handleData->sendStats.enqueueToSendMs), nowTick - message->ms_queuedAt);
+				}
+			}
+			else
+			{
+				/*Codes_SRS_IOTHUBCLIENT_LL_02_098: [ A message that was sent before shall be counted as one more retry. ]*/
+				handleData->sendStats.retries++;
+				handleData->sendStats.bytesInFlight -= (handleData->sendStats.bytesInFlight < message->sentSize) ? handleData->sendStats.bytesInFlight : message->sentSize;
+			}
+			message->sendAttempts++;
+			message->ms_sentAt = nowTick;
+			message->sentSize = share;
+			handleData->sendStats.bytesInFlight += share;
+			message = containingRecord(message->entry.Flink, IOTHUB_MESSAGE_LIST, entry);
+		}
+	}
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendStats(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_SEND_STATS* stats)
+{
+	IOTHUB_CLIENT_RESULT result;
+	/*Codes_SRS_IOTHUBCLIENT_LL_02_103: [ If iotHubClientHandle or stats is NULL then IoTHubClient_LL_GetSendStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+	if (
+		(iotHubClientHandle == NULL) ||
+		(stats == NULL)
+		)
+	{
+		result = IOTHUB_CLIENT_INVALID_ARG;
+		LOG_ERROR;
+	}
+	else
+	{
+		IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+		size_t inMemory = 0;
+		size_t i;
+		/*Codes_SRS_IOTHUBCLIENT_LL_02_104: [ Otherwise IoTHubClient_LL_GetSendStats shall fill stats with the counters of the client, queued being the messages in memory that are not in flight, and return IOTHUB_CLIENT_OK. ]*/
+		for (i = 0; i < PRIORITY_LANE_COUNT; i++)
+		{
+			inMemory += handleData->laneStats[i].depth;
+		}
+		*stats = handleData->sendStats;
+		stats->queued = (inMemory > stats->inFlight) ? (inMemory - stats->inFlight) : 0;
+		result = IOTHUB_CLIENT_OK;
+	}
+	return result;
+}
@@ -17,17 +17,47 @@ DEFINE_ENUM_STRINGS(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUE
 #define LOG_IOTHUB_MESSAGE_ERROR() \
     LogError("(result = %s)", ENUM_TO_STRING(IOTHUB_MESSAGE_RESULT, result));
 
-typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
+/*messages are cloned on one thread and destroyed on another, so the reference count of their content needs atomic operations.
+Compilers without known ones (or builds defining IOTHUB_MESSAGE_REFCOUNT_USES_LOCK) guard it with a lock of the content's own*/
+#if !defined(IOTHUB_MESSAGE_REFCOUNT_USES_LOCK) && !defined(_MSC_VER) && !defined(__GNUC__)
+#define IOTHUB_MESSAGE_REFCOUNT_USES_LOCK
+#endif
+
+#if defined(IOTHUB_MESSAGE_REFCOUNT_USES_LOCK)
+#include "azure_c_shared_utility/lock.h"
+#define INC_REF(content) lockedIncRef(content)
+#define DEC_REF(content) lockedDecRef(content)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define INC_REF(content) _InterlockedIncrement(&(content)->refCount)
+#define DEC_REF(content) _InterlockedDecrement(&(content)->refCount)
+#else
+#define INC_REF(content) __sync_add_and_fetch(&(content)->refCount, 1)
+#define DEC_REF(content) __sync_sub_and_fetch(&(content)->refCount, 1)
+#endif
+
+/*the content is never modified after creation, so all the clones of a message share it*/
+typedef struct IOTHUB_MESSAGE_CONTENT_TAG
 {
+    volatile long refCount;
+#ifdef IOTHUB_MESSAGE_REFCOUNT_USES_LOCK
+    LOCK_HANDLE lock;
+#endif
     IOTHUBMESSAGE_CONTENT_TYPE contentType;
     union 
     {
         BUFFER_HANDLE byteArray;
         STRING_HANDLE string;
     } value;
+}IOTHUB_MESSAGE_CONTENT;
+
+typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
+{
+    IOTHUB_MESSAGE_CONTENT* content;
     MAP_HANDLE properties;
     char* messageId;
     char* correlationId;
+    IOTHUB_MESSAGE_PRIORITY priority;
 }IOTHUB_MESSAGE_HANDLE_DATA;
 
 static bool ContainsOnlyUsAscii(const char* asciiValue)
@@ -62,6 +92,88 @@ static int ValidateAsciiCharactersFilter(const char* mapKey, const char* mapValu
     return result;
 }
 
+#ifdef IOTHUB_MESSAGE_REFCOUNT_USES_LOCK
+/*returns 0 when the count could not be incremented*/
+static long lockedIncRef(IOTHUB_MESSAGE_CONTENT* content)
+{
+    long result;
+    if (Lock(content->lock) != LOCK_OK)
+    {
+        result = 0;
+        LogError("unable to Lock");
+    }
+    else
+    {
+        result = ++content->refCount;
+        (void)Unlock(content->lock);
+    }
+    return result;
+}
+
+/*never returns 0 when the count could not be decremented, the content is leaked rather than freed under another user*/
+static long lockedDecRef(IOTHUB_MESSAGE_CONTENT* content)
+{
+    long result;
+    if (Lock(content->lock) != LOCK_OK)
+    {
+        result = 1;
+        LogError("unable to Lock, the message content is leaked");
+    }
+    else
+    {
+        result = --content->refCount;
+        (void)Unlock(content->lock);
+    }
+    return result;
+}
+#endif
+
+static IOTHUB_MESSAGE_CONTENT* CreateContent(void)
+{
+    IOTHUB_MESSAGE_CONTENT* result = (IOTHUB_MESSAGE_CONTENT*)malloc(sizeof(IOTHUB_MESSAGE_CONTENT));
+    if (result != NULL)
+    {
+#ifdef IOTHUB_MESSAGE_REFCOUNT_USES_LOCK
+        if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("unable to Lock_Init");
+            free(result);
+            result = NULL;
+        }
+        else
+#endif
+        {
+            result->refCount = 1;
+        }
+    }
+    return result;
+}
+
+static void DestroyContent(IOTHUB_MESSAGE_CONTENT* content)
+{
+#ifdef IOTHUB_MESSAGE_REFCOUNT_USES_LOCK
+    (void)Lock_Deinit(content->lock);
+#endif
+    free(content);
+}
+
+static void ReleaseContent(IOTHUB_MESSAGE_CONTENT* content)
+{
+    if (DEC_REF(content) == 0)
+    {
+        if (content->contentType == IOTHUBMESSAGE_BYTEARRAY)
+        {
+            BUFFER_delete(content->value.byteArray);
+        }
+        else
+        {
+            /*can only be STRING*/
+            STRING_delete(content->value.string);
+        }
+        DestroyContent(content);
+    }
+}
+
 IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byteArray, size_t size)
 {
     IOTHUB_MESSAGE_HANDLE_DATA* result;
@@ -72,6 +184,13 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
         /*Codes_SRS_IOTHUBMESSAGE_02_024: [If there are any errors then IoTHubMessage_CreateFromByteArray shall return NULL.] */
         /*let it go through*/
     }
+    else if ((result->content = CreateContent()) == NULL)
+    {
+        LogError("unable to malloc");
+        /*Codes_SRS_IOTHUBMESSAGE_02_024: [If there are any errors then IoTHubMessage_CreateFromByteArray shall return NULL.] */
+        free(result);
+        result = NULL;
+    }
     else
     {
         const unsigned char* source;
@@ -82,6 +201,7 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
             if (byteArray == NULL)
             {
                 LogError("Attempted to create a Hub Message from a NULL pointer!");
+                DestroyContent(result->content);
                 free(result);
                 result = NULL;
                 source = NULL;
@@ -99,10 +219,11 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
         if (result != NULL)
         {
             /*Codes_SRS_IOTHUBMESSAGE_02_022: [IoTHubMessage_CreateFromByteArray shall call BUFFER_create passing byteArray and size as parameters.] */
-            if ((result->value.byteArray = BUFFER_create(source, size)) == NULL)
+            if ((result->content->value.byteArray = BUFFER_create(source, size)) == NULL)
             {
                 LogError("BUFFER_create failed");
                 /*Codes_SRS_IOTHUBMESSAGE_02_024: [If there are any errors then IoTHubMessage_CreateFromByteArray shall return NULL.] */
+                DestroyContent(result->content);
                 free(result);
                 result = NULL;
             }
@@ -111,7 +232,8 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
             {
                 LogError("Map_Create failed");
                 /*Codes_SRS_IOTHUBMESSAGE_02_024: [If there are any errors then IoTHubMessage_CreateFromByteArray shall return NULL.] */
-                BUFFER_delete(result->value.byteArray);
+                BUFFER_delete(result->content->value.byteArray);
+                DestroyContent(result->content);
                 free(result);
                 result = NULL;
             }
@@ -119,9 +241,11 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
             {
                 /*Codes_SRS_IOTHUBMESSAGE_02_025: [Otherwise, IoTHubMessage_CreateFromByteArray shall return a non-NULL handle.] */
                 /*Codes_SRS_IOTHUBMESSAGE_02_026: [The type of the new message shall be IOTHUBMESSAGE_BYTEARRAY.] */
-                result->contentType = IOTHUBMESSAGE_BYTEARRAY;
+                result->content->contentType = IOTHUBMESSAGE_BYTEARRAY;
                 result->messageId = NULL;
                 result->correlationId = NULL;
+                /*Codes_SRS_IOTHUBMESSAGE_02_036: [The priority of the new message shall be IOTHUB_MESSAGE_PRIORITY_NORMAL.] */
+                result->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
                 /*all is fine, return result*/
             }
         }
@@ -138,13 +262,21 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
         /*Codes_SRS_IOTHUBMESSAGE_02_029: [If there are any encountered in the execution of IoTHubMessage_CreateFromString then IoTHubMessage_CreateFromString shall return NULL.] */
         /*let it go through*/
     }
+    else if ((result->content = CreateContent()) == NULL)
+    {
+        LogError("malloc failed");
+        /*Codes_SRS_IOTHUBMESSAGE_02_029: [If there are any encountered in the execution of IoTHubMessage_CreateFromString then IoTHubMessage_CreateFromString shall return NULL.] */
+        free(result);
+        result = NULL;
+    }
     else
     {
         /*Codes_SRS_IOTHUBMESSAGE_02_027: [IoTHubMessage_CreateFromString shall call STRING_construct passing source as parameter.] */
-        if ((result->value.string = STRING_construct(source)) == NULL)
+        if ((result->content->value.string = STRING_construct(source)) == NULL)
         {
             LogError("STRING_construct failed");
             /*Codes_SRS_IOTHUBMESSAGE_02_029: [If there are any encountered in the execution of IoTHubMessage_CreateFromString then IoTHubMessage_CreateFromString shall return NULL.] */
+            DestroyContent(result->content);
             free(result);
             result = NULL;
         }
@@ -153,7 +285,8 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
         {
             LogError("Map_Create failed");
             /*Codes_SRS_IOTHUBMESSAGE_02_029: [If there are any encountered in the execution of IoTHubMessage_CreateFromString then IoTHubMessage_CreateFromString shall return NULL.] */
-            STRING_delete(result->value.string);
+            STRING_delete(result->content->value.string);
+            DestroyContent(result->content);
             free(result);
             result = NULL;
         }
@@ -161,9 +294,11 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
         {
             /*Codes_SRS_IOTHUBMESSAGE_02_031: [Otherwise, IoTHubMessage_CreateFromString shall return a non-NULL handle.] */
             /*Codes_SRS_IOTHUBMESSAGE_02_032: [The type of the new message shall be IOTHUBMESSAGE_STRING.] */
-            result->contentType = IOTHUBMESSAGE_STRING;
+            result->content->contentType = IOTHUBMESSAGE_STRING;
             result->messageId = NULL;
             result->correlationId = NULL;
+            /*Codes_SRS_IOTHUBMESSAGE_02_036: [The priority of the new message shall be IOTHUB_MESSAGE_PRIORITY_NORMAL.] */
+            result->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
         }
     }
     return result;
@@ -211,96 +346,51 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
                 free(result);
                 result = NULL;
             }
-            else if (source->contentType == IOTHUBMESSAGE_BYTEARRAY)
+            /*Codes_SRS_IOTHUBMESSAGE_02_005: [IoTHubMessage_Clone shall clone the properties map by using Map_Clone.] */
+            else if ((result->properties = Map_Clone(source->properties)) == NULL)
             {
-                /*Codes_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall clone to content by a call to BUFFER_clone] */
-                if ((result->value.byteArray = BUFFER_clone(source->value.byteArray)) == NULL)
-                {
-                    /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-                    LogError("unable to BUFFER_clone");
-                    if (result->messageId)
-                    {
-                        free(result->messageId);
-                        result->messageId = NULL;
-                    }
-                    if (result->correlationId != NULL)
-                    {
-                        free(result->correlationId);
-                        result->correlationId = NULL;
-                    }
-                    free(result);
-                    result = NULL;
-                }
-                /*Codes_SRS_IOTHUBMESSAGE_02_005: [IoTHubMessage_Clone shall clone the properties map by using Map_Clone.] */
-                else if ((result->properties = Map_Clone(source->properties)) == NULL)
+                /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
+                LogError("unable to Map_Clone");
+                if (result->messageId != NULL)
                 {
-                    /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-                    LogError("unable to Map_Clone");
-                    BUFFER_delete(result->value.byteArray);
-                    if (result->messageId)
-                    {
-                        free(result->messageId);
-                        result->messageId = NULL;
-                    }
-                    if (result->correlationId != NULL)
-                    {
-                        free(result->correlationId);
-                        result->correlationId = NULL;
-                    }
-                    free(result);
-                    result = NULL;
+                    free(result->messageId);
+                    result->messageId = NULL;
                 }
-                else
+                if (result->correlationId != NULL)
                 {
-                    result->contentType = IOTHUBMESSAGE_BYTEARRAY;
-                    /*Codes_SRS_IOTHUBMESSAGE_03_002: [IoTHubMessage_Clone shall return upon success a non-NULL handle to the newly created IoT hub message.]*/
-                    /*return as is, this is a good result*/
+                    free(result->correlationId);
+                    result->correlationId = NULL;
                 }
+                free(result);
+                result = NULL;
             }
-            else /*can only be STRING*/
+            /*Codes_SRS_IOTHUBMESSAGE_02_034: [IoTHubMessage_Clone shall share the content of iotHubMessageHandle with the new message by incrementing the content's reference count, without copying the content.] */
+            /*incrementing only fails where the reference count is guarded by a lock*/
+            else if (INC_REF(source->content) == 0)
             {
-                /*Codes_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall clone the content by a call to BUFFER_clone or STRING_clone] */
-                if ((result->value.string = STRING_clone(source->value.string)) == NULL)
-                {
-                    /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-                    if (result->messageId)
-                    {
-                        free(result->messageId);
-                        result->messageId = NULL;
-                    }
-                    if (result->correlationId != NULL)
-                    {
-                        free(result->correlationId);
-                        result->correlationId = NULL;
-                    }
-                    free(result);
-                    result = NULL;
-                    LogError("failed to STRING_clone");
-                }
-                /*Codes_SRS_IOTHUBMESSAGE_02_005: [IoTHubMessage_Clone shall clone the properties map by using Map_Clone.] */
-                else if ((result->properties = Map_Clone(source->properties)) == NULL)
+                /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
+                LogError("unable to share the message content");
+                Map_Destroy(result->properties);
+                if (result->messageId != NULL)
                 {
-                    /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-                    LogError("unable to Map_Clone");
-                    STRING_delete(result->value.string);
-                    if (result->messageId)
-                    {
-                        free(result->messageId);
-                        result->messageId = NULL;
-                    }
-                    if (result->correlationId != NULL)
-                    {
-                        free(result->correlationId);
-                        result->correlationId = NULL;
-                    }
-                    free(result);
-                    result = NULL;
+                    free(result->messageId);
+                    result->messageId = NULL;
                 }
-                else
+                if (result->correlationId != NULL)
                 {
-                    result->contentType = IOTHUBMESSAGE_STRING;
-                    /*all is fine*/
+                    free(result->correlationId);
+                    result->correlationId = NULL;
                 }
+                free(result);
+                result = NULL;
+            }
+            else
+            {
+                result->content = source->content;
+                /*Codes_SRS_IOTHUBMESSAGE_02_037: [IoTHubMessage_Clone shall copy the priority of iotHubMessageHandle.] */
+                result->priority = source->priority;
+                /*Codes_SRS_IOTHUBMESSAGE_03_002: [IoTHubMessage_Clone shall return upon success a non-NULL handle to the newly created IoT hub message.]*/
+                /*return as is, this is a good result*/
             }
         }
     }
@@ -323,18 +413,18 @@ IOTHUB_MESSAGE_RESULT IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMes
     else
     {
         IOTHUB_MESSAGE_HANDLE_DATA* handleData = iotHubMessageHandle;
-        if (handleData->contentType != IOTHUBMESSAGE_BYTEARRAY)
+        if (handleData->content->contentType != IOTHUBMESSAGE_BYTEARRAY)
         {
             /*Codes_SRS_IOTHUBMESSAGE_02_021: [If iotHubMessageHandle is not a iothubmessage containing BYTEARRAY data, then IoTHubMessage_GetData shall write in *buffer NULL and shall set *size to 0.] */
             result = IOTHUB_MESSAGE_INVALID_ARG;
-            LogError("invalid type of message %s", ENUM_TO_STRING(IOTHUBMESSAGE_CONTENT_TYPE, handleData->contentType));
+            LogError("invalid type of message %s", ENUM_TO_STRING(IOTHUBMESSAGE_CONTENT_TYPE, handleData->content->contentType));
         }
         else
         {
             /*Codes_SRS_IOTHUBMESSAGE_01_011: [The pointer shall be obtained by using BUFFER_u_char and it shall be copied in the buffer argument.]*/
-            *buffer = BUFFER_u_char(handleData->value.byteArray);
+            *buffer = BUFFER_u_char(handleData->content->value.byteArray);
             /*Codes_SRS_IOTHUBMESSAGE_01_012: [The size of the associated data shall be obtained by using BUFFER_length and it shall be copied to the size argument.]*/
-            *size = BUFFER_length(handleData->value.byteArray);
+            *size = BUFFER_length(handleData->content->value.byteArray);
             result = IOTHUB_MESSAGE_OK;
         }
     }
@@ -352,7 +442,7 @@ const char* IoTHubMessage_GetString(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
     else
     {
         IOTHUB_MESSAGE_HANDLE_DATA* handleData = iotHubMessageHandle;
-        if (handleData->contentType != IOTHUBMESSAGE_STRING)
+        if (handleData->content->contentType != IOTHUBMESSAGE_STRING)
         {
             /*Codes_SRS_IOTHUBMESSAGE_02_017: [IoTHubMessage_GetString shall return NULL if the iotHubMessageHandle does not refer to a IOTHUBMESSAGE of type STRING.] */
             result = NULL;
@@ -360,7 +450,7 @@ const char* IoTHubMessage_GetString(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
         else
         {
             /*Codes_SRS_IOTHUBMESSAGE_02_018: [IoTHubMessage_GetStringData shall return the currently stored null terminated string.] */
-            result = STRING_c_str(handleData->value.string);
+            result = STRING_c_str(handleData->content->value.string);
         }
     }
     return result;
@@ -378,7 +468,7 @@ IOTHUBMESSAGE_CONTENT_TYPE IoTHubMessage_GetContentType(IOTHUB_MESSAGE_HANDLE io
     {
         /*Codes_SRS_IOTHUBMESSAGE_02_009: [Otherwise IoTHubMessage_GetContentType shall return the type of the message.] */
         IOTHUB_MESSAGE_HANDLE_DATA* handleData = iotHubMessageHandle;
-        result = handleData->contentType;
+        result = handleData->content->contentType;
     }
     return result;
 }
@@ -500,6 +590,49 @@ const char* IoTHubMessage_GetMessageId(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle
     return result;
 }
 
+IOTHUB_MESSAGE_PRIORITY IoTHubMessage_GetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    IOTHUB_MESSAGE_PRIORITY result;
+    /*Codes_SRS_IOTHUBMESSAGE_02_038: [If iotHubMessageHandle is NULL then IoTHubMessage_GetPriority shall return IOTHUB_MESSAGE_PRIORITY_NORMAL.] */
+    if (iotHubMessageHandle == NULL)
+    {
+        LogError("invalid arg (NULL) passed to IoTHubMessage_GetPriority");
+        result = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_02_039: [Otherwise IoTHubMessage_GetPriority shall return the priority of the message.] */
+        IOTHUB_MESSAGE_HANDLE_DATA* handleData = iotHubMessageHandle;
+        result = handleData->priority;
+    }
+    return result;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    IOTHUB_MESSAGE_RESULT result;
+    /*Codes_SRS_IOTHUBMESSAGE_02_040: [If iotHubMessageHandle is NULL then IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+    if (iotHubMessageHandle == NULL)
+    {
+        LogError("invalid arg (NULL) passed to IoTHubMessage_SetPriority");
+        result = IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    /*Codes_SRS_IOTHUBMESSAGE_02_041: [If priority is not one of the values of IOTHUB_MESSAGE_PRIORITY then IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+    else if ((priority != IOTHUB_MESSAGE_PRIORITY_LOW) && (priority != IOTHUB_MESSAGE_PRIORITY_NORMAL) && (priority != IOTHUB_MESSAGE_PRIORITY_HIGH))
+    {
+        LogError("invalid priority %d passed to IoTHubMessage_SetPriority", (int)priority);
+        result = IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_02_042: [Otherwise IoTHubMessage_SetPriority shall set the priority of the message and return IOTHUB_MESSAGE_OK.] */
+        IOTHUB_MESSAGE_HANDLE_DATA* handleData = iotHubMessageHandle;
+        handleData->priority = priority;
+        result = IOTHUB_MESSAGE_OK;
+    }
+    return result;
+}
+
 void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
 {
     /*Codes_SRS_IOTHUBMESSAGE_01_004: [If iotHubMessageHandle is NULL, IoTHubMessage_Destroy shall do nothing.] */
@@ -507,15 +640,8 @@ void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
     {
         /*Codes_SRS_IOTHUBMESSAGE_01_003: [IoTHubMessage_Destroy shall free all resources associated with iotHubMessageHandle.]  */
         IOTHUB_MESSAGE_HANDLE_DATA* handleData = iotHubMessageHandle;
-        if (handleData->contentType == IOTHUBMESSAGE_BYTEARRAY)
-        {
-            BUFFER_delete(handleData->value.byteArray);
-        }
-        else
-        {
-            /*can only be STRING*/
-            STRING_delete(handleData->value.string);
-        }
+        /*Codes_SRS_IOTHUBMESSAGE_02_035: [IoTHubMessage_Destroy shall decrement the reference count of the message content and free the content only when no other message refers to it anymore.] */
+        ReleaseContent(handleData->content);
         Map_Destroy(handleData->properties);
         free(handleData->messageId);
         handleData->messageId = NULL;
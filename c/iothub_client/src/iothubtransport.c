@@ -1,6 +1,10 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /*pthread_setaffinity_np*/
+#endif
+
 #include <stdlib.h> 
 #ifdef _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
@@ -18,22 +22,119 @@
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/iot_logging.h"
-#include "azure_c_shared_utility/vector.h"
+#include "deviceregistry.h"
 
-typedef struct TRANSPORT_HANDLE_DATA_TAG
+/*CPU pinning is done by the worker thread itself, ThreadAPI does not expose the native thread handle*/
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*MAXIMUM_CONNECTION_COUNT is the upper bound of IOTHUBTRANSPORT_CONNECTIONS_CONFIG's connectionCount*/
+#define MAXIMUM_CONNECTION_COUNT 64
+
+/*one connection of the transport: the lower layer transport, the worker thread that drives it and the IoTHubClients pinned to it. Connections share nothing, so their workers run in parallel*/
+typedef struct TRANSPORT_WORKER_TAG
 {
 	TRANSPORT_LL_HANDLE transportLLHandle;
-    THREAD_HANDLE workerThreadHandle;
-    LOCK_HANDLE lockHandle;
-    sig_atomic_t stopThread;
+	THREAD_HANDLE workerThreadHandle;
+	LOCK_HANDLE lockHandle;
+	sig_atomic_t stopThread;
+	DEVICE_REGISTRY_HANDLE clients; /*the clients that started the thread*/
+	DEVICE_REGISTRY_HANDLE assignedClients; /*the clients pinned to this worker, NULL when the transport has a single worker*/
+	int cpu; /*-1 when the thread is not pinned*/
+	struct TRANSPORT_HANDLE_DATA_TAG* transport;
+} TRANSPORT_WORKER;
+
+typedef struct TRANSPORT_HANDLE_DATA_TAG
+{
 	TRANSPORT_PROVIDER_FIELDS;
-	VECTOR_HANDLE clients;
+	LOCK_HANDLE assignLock; /*guards the assignedClients of all the workers, NULL when the transport has a single worker*/
+	size_t workerCount;
+	TRANSPORT_WORKER workers[1]; /*workerCount workers are allocated together with the transport data*/
 } TRANSPORT_HANDLE_DATA;
 
 /* Used for Unit test */
-const size_t IoTHubTransport_ThreadTerminationOffset = offsetof(TRANSPORT_HANDLE_DATA, stopThread);
+const size_t IoTHubTransport_ThreadTerminationOffset = offsetof(TRANSPORT_WORKER, stopThread);
+
+static void destroy_worker(TRANSPORT_HANDLE_DATA* transportData, TRANSPORT_WORKER* worker)
+{
+	Lock_Deinit(worker->lockHandle);
+	(transportData->IoTHubTransport_Destroy)(worker->transportLLHandle);
+	DeviceRegistry_Destroy(worker->clients);
+	if (worker->assignedClients != NULL)
+	{
+		DeviceRegistry_Destroy(worker->assignedClients);
+	}
+}
+
+static bool create_worker(TRANSPORT_HANDLE_DATA* transportData, TRANSPORT_WORKER* worker, const TRANSPORT_PROVIDER* transportProtocol, const IOTHUBTRANSPORT_CONFIG* transportLLConfig, int cpu)
+{
+	bool result;
+	worker->transport = transportData;
+	worker->cpu = cpu;
+	worker->stopThread = 1;
+	worker->workerThreadHandle = NULL; /* create thread when work needs to be done */
+	worker->assignedClients = NULL;
+
+	/*Codes_SRS_IOTHUBTRANSPORT_17_005: [ IoTHubTransport_Create shall create the lower layer transport by calling the protocol's IoTHubTransport_Create function. ]*/
+	worker->transportLLHandle = transportProtocol->IoTHubTransport_Create(transportLLConfig);
+	if (worker->transportLLHandle == NULL)
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_17_006: [ If the creation of the transport fails, IoTHubTransport_Create shall return NULL. ]*/
+		LogError("Lower Layer transport not created.");
+		result = false;
+	}
+	else
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_17_007: [ IoTHubTransport_Create shall create the transport lock by Calling Lock_Init. ]*/
+		worker->lockHandle = Lock_Init();
+		if (worker->lockHandle == NULL)
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_17_008: [ If the lock creation fails, IoTHubTransport_Create shall return NULL. ]*/
+			LogError("transport Lock not created.");
+			transportProtocol->IoTHubTransport_Destroy(worker->transportLLHandle);
+			result = false;
+		}
+		else
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_17_038: [ IoTHubTransport_Create shall call DeviceRegistry_Create to make a set of the IOTHUB_CLIENT_HANDLEs using this transport. ]*/
+			worker->clients = DeviceRegistry_Create();
+			if (worker->clients == NULL)
+			{
+				/*Codes_SRS_IOTHUBTRANSPORT_17_039: [ If DeviceRegistry_Create fails, IoTHubTransport_Create shall return NULL. ]*/
+				LogError("clients list not created.");
+				Lock_Deinit(worker->lockHandle);
+				transportProtocol->IoTHubTransport_Destroy(worker->transportLLHandle);
+				result = false;
+			}
+			else if ((transportData->workerCount > 1) &&
+				((worker->assignedClients = DeviceRegistry_Create()) == NULL))
+			{
+				LogError("assigned clients list not created.");
+				DeviceRegistry_Destroy(worker->clients);
+				Lock_Deinit(worker->lockHandle);
+				transportProtocol->IoTHubTransport_Destroy(worker->transportLLHandle);
+				result = false;
+			}
+			else
+			{
+				result = true;
+			}
+		}
+	}
+	return result;
+}
 
-TRANSPORT_HANDLE  IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol, const char* iotHubName, const char* iotHubSuffix)
+TRANSPORT_HANDLE IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol, const char* iotHubName, const char* iotHubSuffix)
+{
+	/*Codes_SRS_IOTHUBTRANSPORT_17_047: [ IoTHubTransport_Create shall behave as IoTHubTransport_CreateWithConnections with a NULL connectionsConfig. ]*/
+	return IoTHubTransport_CreateWithConnections(protocol, iotHubName, iotHubSuffix, NULL);
+}
+
+TRANSPORT_HANDLE IoTHubTransport_CreateWithConnections(IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol, const char* iotHubName, const char* iotHubSuffix, const IOTHUBTRANSPORT_CONNECTIONS_CONFIG* connectionsConfig)
 {
 	TRANSPORT_HANDLE_DATA * result;
 
@@ -45,10 +146,20 @@ TRANSPORT_HANDLE  IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoc
 		LogError("Invalid NULL argument, protocol [%p], name [%p], suffix [%p].", protocol, iotHubName, iotHubSuffix);
 		result = NULL;
 	}
+	else if ((connectionsConfig != NULL) &&
+		((connectionsConfig->connectionCount == 0) || (connectionsConfig->connectionCount > MAXIMUM_CONNECTION_COUNT)))
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_17_049: [ If connectionsConfig->connectionCount is 0 or greater than 64, IoTHubTransport_CreateWithConnections shall return NULL. ]*/
+		LogError("Invalid connection count %lu.", (unsigned long)connectionsConfig->connectionCount);
+		result = NULL;
+	}
 	else
 	{
+		/*Codes_SRS_IOTHUBTRANSPORT_17_048: [ If connectionsConfig is NULL, IoTHubTransport_CreateWithConnections shall create a single connection whose worker thread is not pinned to a CPU. ]*/
+		size_t workerCount = (connectionsConfig == NULL) ? 1 : connectionsConfig->connectionCount;
+
 		/*Codes_SRS_IOTHUBTRANSPORT_17_032: [ IoTHubTransport_Create shall allocate memory for the transport data. ]*/
-		result = (TRANSPORT_HANDLE_DATA*)malloc(sizeof(TRANSPORT_HANDLE_DATA));
+		result = (TRANSPORT_HANDLE_DATA*)malloc(sizeof(TRANSPORT_HANDLE_DATA) + (workerCount - 1) * sizeof(TRANSPORT_WORKER));
 		if (result == NULL)
 		{
 			/*Codes_SRS_IOTHUBTRANSPORT_17_040: [ If memory allocation fails, IoTHubTransport_Create shall return NULL. ]*/
@@ -69,57 +180,53 @@ TRANSPORT_HANDLE  IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoc
 			transportLLConfig.upperConfig = &upperConfig;
 			transportLLConfig.waitingToSend = NULL;
 
-			/*Codes_SRS_IOTHUBTRANSPORT_17_005: [ IoTHubTransport_Create shall create the lower layer transport by calling the protocol's IoTHubTransport_Create function. ]*/
-			result->transportLLHandle = transportProtocol->IoTHubTransport_Create(&transportLLConfig);
-			if (result->transportLLHandle == NULL)
+			result->IoTHubTransport_SetOption = transportProtocol->IoTHubTransport_SetOption;
+			result->IoTHubTransport_Create = transportProtocol->IoTHubTransport_Create;
+			result->IoTHubTransport_Destroy = transportProtocol->IoTHubTransport_Destroy;
+			result->IoTHubTransport_Register = transportProtocol->IoTHubTransport_Register;
+			result->IoTHubTransport_Unregister = transportProtocol->IoTHubTransport_Unregister;
+			result->IoTHubTransport_Subscribe = transportProtocol->IoTHubTransport_Subscribe;
+			result->IoTHubTransport_Unsubscribe = transportProtocol->IoTHubTransport_Unsubscribe;
+			result->IoTHubTransport_DoWork = transportProtocol->IoTHubTransport_DoWork;
+			result->IoTHubTransport_GetSendStatus = transportProtocol->IoTHubTransport_GetSendStatus;
+			result->IoTHubTransport_SendMessageDisposition = transportProtocol->IoTHubTransport_SendMessageDisposition;
+			result->workerCount = workerCount;
+			result->assignLock = NULL;
+
+			/*Codes_SRS_IOTHUBTRANSPORT_17_050: [ IoTHubTransport_CreateWithConnections shall create, for every connection, its own lower layer transport, its own lock and its own set of IOTHUB_CLIENT_HANDLEs, the same way IoTHubTransport_Create does for its single connection. ]*/
+			/*Codes_SRS_IOTHUBTRANSPORT_17_052: [ If connectionsConfig->cpuAffinity is not NULL, the worker thread of connection i shall pin itself to the CPU connectionsConfig->cpuAffinity[i], unless that value is negative. ]*/
+			size_t createdWorkers;
+			for (createdWorkers = 0; createdWorkers < workerCount; createdWorkers++)
+			{
+				int cpu = ((connectionsConfig == NULL) || (connectionsConfig->cpuAffinity == NULL)) ? -1 : connectionsConfig->cpuAffinity[createdWorkers];
+				if (!create_worker(result, &result->workers[createdWorkers], transportProtocol, &transportLLConfig, cpu))
+				{
+					break;
+				}
+			}
+
+			if ((createdWorkers == workerCount) &&
+				(workerCount > 1) &&
+				((result->assignLock = Lock_Init()) == NULL))
+			{
+				LogError("assign Lock not created.");
+			}
+
+			if ((createdWorkers < workerCount) || ((workerCount > 1) && (result->assignLock == NULL)))
 			{
-				/*Codes_SRS_IOTHUBTRANSPORT_17_006: [ If the creation of the transport fails, IoTHubTransport_Create shall return NULL. ]*/
-				LogError("Lower Layer transport not created.");
+				/*Codes_SRS_IOTHUBTRANSPORT_17_051: [ If any of the connections cannot be created, IoTHubTransport_CreateWithConnections shall return NULL. ]*/
+				/*Codes_SRS_IOTHUBTRANSPORT_17_009: [ IoTHubTransport_Create shall clean up any resources it creates if the function does not succeed. ]*/
+				while (createdWorkers > 0)
+				{
+					createdWorkers--;
+					destroy_worker(result, &result->workers[createdWorkers]);
+				}
 				free(result);
 				result = NULL;
 			}
 			else
 			{
-				/*Codes_SRS_IOTHUBTRANSPORT_17_007: [ IoTHubTransport_Create shall create the transport lock by Calling Lock_Init. ]*/
-				result->lockHandle = Lock_Init();
-				if (result->lockHandle == NULL)
-				{
-					/*Codes_SRS_IOTHUBTRANSPORT_17_008: [ If the lock creation fails, IoTHubTransport_Create shall return NULL. ]*/
-					LogError("transport Lock not created.");
-					transportProtocol->IoTHubTransport_Destroy(result->transportLLHandle);
-					free(result);
-					result = NULL;
-				}
-				else
-				{
-					/*Codes_SRS_IOTHUBTRANSPORT_17_038: [ IoTHubTransport_Create shall call VECTOR_Create to make a list of IOTHUB_CLIENT_HANDLE using this transport. ]*/
-					result->clients = VECTOR_create(sizeof(IOTHUB_CLIENT_HANDLE));
-					if (result->clients == NULL)
-					{
-						/*Codes_SRS_IOTHUBTRANSPORT_17_039: [ If the Vector creation fails, IoTHubTransport_Create shall return NULL. ]*/
-						/*Codes_SRS_IOTHUBTRANSPORT_17_009: [ IoTHubTransport_Create shall clean up any resources it creates if the function does not succeed. ]*/
-						LogError("clients list not created.");
-						Lock_Deinit(result->lockHandle);
-						transportProtocol->IoTHubTransport_Destroy(result->transportLLHandle);
-						free(result);
-						result = NULL;
-					}
-					else
-					{
-						/*Codes_SRS_IOTHUBTRANSPORT_17_001: [ IoTHubTransport_Create shall return a non-NULL handle on success.]*/
-						result->stopThread = 1;
-						result->workerThreadHandle = NULL; /* create thread when work needs to be done */
-						result->IoTHubTransport_SetOption = transportProtocol->IoTHubTransport_SetOption;
-						result->IoTHubTransport_Create = transportProtocol->IoTHubTransport_Create;
-						result->IoTHubTransport_Destroy = transportProtocol->IoTHubTransport_Destroy;
-						result->IoTHubTransport_Register = transportProtocol->IoTHubTransport_Register;
-						result->IoTHubTransport_Unregister = transportProtocol->IoTHubTransport_Unregister;
-						result->IoTHubTransport_Subscribe = transportProtocol->IoTHubTransport_Subscribe;
-						result->IoTHubTransport_Unsubscribe = transportProtocol->IoTHubTransport_Unsubscribe;
-						result->IoTHubTransport_DoWork = transportProtocol->IoTHubTransport_DoWork;
-						result->IoTHubTransport_GetSendStatus = transportProtocol->IoTHubTransport_GetSendStatus;
-					}
-				}
+				/*Codes_SRS_IOTHUBTRANSPORT_17_001: [ IoTHubTransport_Create shall return a non-NULL handle on success.]*/
 			}
 		}
 	}
@@ -127,26 +234,69 @@ TRANSPORT_HANDLE  IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoc
 	return result;
 }
 
+static void send_queued_events(const void* clientHandle, void* context)
+{
+	(void)context;
+	IoTHubClient_SendQueuedEvents((IOTHUB_CLIENT_HANDLE)clientHandle);
+}
+
+static void record_send_status(const void* clientHandle, void* context)
+{
+	(void)context;
+	IoTHubClient_RecordSendStatus((IOTHUB_CLIENT_HANDLE)clientHandle);
+}
+
+static void pin_current_thread(int cpu)
+{
+#if defined(_WIN32)
+	if ((cpu >= (int)(8 * sizeof(DWORD_PTR))) ||
+		(SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) == 0))
+	{
+		LogError("unable to pin the transport worker thread to CPU %d", cpu);
+	}
+#elif defined(__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpu, &cpuSet);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0)
+	{
+		LogError("unable to pin the transport worker thread to CPU %d", cpu);
+	}
+#else
+	LogError("pinning the transport worker thread to CPU %d is not supported on this platform", cpu);
+#endif
+}
+
 static int transport_worker_thread(void* threadArgument)
 {
-	TRANSPORT_HANDLE_DATA* transportData = (TRANSPORT_HANDLE_DATA*)threadArgument;
+	TRANSPORT_WORKER* worker = (TRANSPORT_WORKER*)threadArgument;
+	TRANSPORT_HANDLE_DATA* transportData = worker->transport;
+
+	if (worker->cpu >= 0)
+	{
+		pin_current_thread(worker->cpu);
+	}
 
 	while (1)
 	{
 		/*Codes_SRS_IOTHUBTRANSPORT_17_030: [ All calls to lower layer transport DoWork shall be protected by the lock created in IoTHubTransport_Create. ]*/
-		if (Lock(transportData->lockHandle) == LOCK_OK)
+		if (Lock(worker->lockHandle) == LOCK_OK)
 		{
 			/*Codes_SRS_IOTHUBTRANSPORT_17_031: [ If acquiring the lock fails, lower layer transport DoWork shall not be called. ]*/
-			if (transportData->stopThread)
+			if (worker->stopThread)
 			{
 				/*Codes_SRS_IOTHUBTRANSPORT_17_028: [ The thread shall exit when IoTHubTransport_EndWorkerThread has been called for each clientHandle which invoked IoTHubTransport_StartWorkerThread. ]*/
-				(void)Unlock(transportData->lockHandle);
+				(void)Unlock(worker->lockHandle);
 				break;
 			}
 			else
 			{
-				(transportData->IoTHubTransport_DoWork)(transportData->transportLLHandle, NULL);
-				(void)Unlock(transportData->lockHandle);
+				/*Codes_SRS_IOTHUBTRANSPORT_17_046: [ Before calling lower layer transport DoWork, the thread shall call IoTHubClient_SendQueuedEvents for every IoTHubClient handle in the set, by calling DeviceRegistry_ForEach. ]*/
+				DeviceRegistry_ForEach(worker->clients, send_queued_events, NULL);
+				(transportData->IoTHubTransport_DoWork)(worker->transportLLHandle, NULL);
+				/*Codes_SRS_IOTHUBTRANSPORT_17_062: [ After calling lower layer transport DoWork, the thread shall call IoTHubClient_RecordSendStatus for every IoTHubClient handle in the set, by calling DeviceRegistry_ForEach. ]*/
+				DeviceRegistry_ForEach(worker->clients, record_send_status, NULL);
+				(void)Unlock(worker->lockHandle);
 			}
 		}
 		/*Codes_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]*/
@@ -156,34 +306,77 @@ static int transport_worker_thread(void* threadArgument)
 	return 0;
 }
 
-static bool find_by_handle(const void* element, const void* value)
+/*returns the worker clientHandle is pinned to. With assign, a client that is not pinned yet is pinned to the worker that has the fewest clients*/
+static TRANSPORT_WORKER* get_client_worker(TRANSPORT_HANDLE_DATA* transportData, IOTHUB_CLIENT_HANDLE clientHandle, bool assign)
 {
-	/* data stored at element is device handle */
-	const IOTHUB_CLIENT_HANDLE * guess = (const IOTHUB_CLIENT_HANDLE *)element;
-	const IOTHUB_CLIENT_HANDLE match = (const IOTHUB_CLIENT_HANDLE)value;
-	return (*guess == match);
+	TRANSPORT_WORKER* result;
+	if (transportData->workerCount == 1)
+	{
+		result = &transportData->workers[0];
+	}
+	else if (Lock(transportData->assignLock) != LOCK_OK)
+	{
+		LogError("unable to Lock");
+		result = NULL;
+	}
+	else
+	{
+		size_t i;
+		result = NULL;
+		for (i = 0; i < transportData->workerCount; i++)
+		{
+			if (DeviceRegistry_Contains(transportData->workers[i].assignedClients, clientHandle))
+			{
+				result = &transportData->workers[i];
+				break;
+			}
+		}
+
+		if ((result == NULL) && assign)
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_17_054: [ A client that is not pinned to a worker yet shall be pinned to the worker that has the fewest clients pinned to it, by calling DeviceRegistry_Add. ]*/
+			TRANSPORT_WORKER* leastLoaded = &transportData->workers[0];
+			for (i = 1; i < transportData->workerCount; i++)
+			{
+				if (DeviceRegistry_GetCount(transportData->workers[i].assignedClients) < DeviceRegistry_GetCount(leastLoaded->assignedClients))
+				{
+					leastLoaded = &transportData->workers[i];
+				}
+			}
+			if (DeviceRegistry_Add(leastLoaded->assignedClients, clientHandle, NULL) != 0)
+			{
+				LogError("unable to pin the client to a worker");
+			}
+			else
+			{
+				result = leastLoaded;
+			}
+		}
+		(void)Unlock(transportData->assignLock);
+	}
+	return result;
 }
 
-static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_HANDLE clientHandle)
+static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_WORKER* worker, IOTHUB_CLIENT_HANDLE clientHandle)
 {
 	IOTHUB_CLIENT_RESULT result;
-	if (transportData->workerThreadHandle == NULL)
+	if (worker->workerThreadHandle == NULL)
 	{
 		/*Codes_SRS_IOTHUBTRANSPORT_17_018: [ If the worker thread does not exist, IoTHubTransport_StartWorkerThread shall start the thread using ThreadAPI_Create. ]*/
-		transportData->stopThread = 0;
-		if (ThreadAPI_Create(&transportData->workerThreadHandle, transport_worker_thread, transportData) != THREADAPI_OK)
+		worker->stopThread = 0;
+		if (ThreadAPI_Create(&worker->workerThreadHandle, transport_worker_thread, worker) != THREADAPI_OK)
 		{
-			transportData->workerThreadHandle = NULL;
+			worker->workerThreadHandle = NULL;
 		}
 	}
-	if (transportData->workerThreadHandle != NULL)
+	if (worker->workerThreadHandle != NULL)
 	{
-		/*Codes_SRS_IOTHUBTRANSPORT_17_020: [ IoTHubTransport_StartWorkerThread shall search for IoTHubClient clientHandle in the list of IoTHubClient handles. ]*/
-		bool addToList = ((VECTOR_size(transportData->clients) == 0) || (VECTOR_find_if(transportData->clients, find_by_handle, clientHandle) == NULL));
+		/*Codes_SRS_IOTHUBTRANSPORT_17_020: [ IoTHubTransport_StartWorkerThread shall search for IoTHubClient clientHandle in the set of IoTHubClient handles by calling DeviceRegistry_Contains. ]*/
+		bool addToList = !DeviceRegistry_Contains(worker->clients, clientHandle);
 		if (addToList)
 		{
-			/*Codes_SRS_IOTHUBTRANSPORT_17_021: [ If handle is not found, then clientHandle shall be added to the list. ]*/
-			if (VECTOR_push_back(transportData->clients, &clientHandle, 1) != 0)
+			/*Codes_SRS_IOTHUBTRANSPORT_17_021: [ If handle is not found, then clientHandle shall be added to the set by calling DeviceRegistry_Add. ]*/
+			if (DeviceRegistry_Add(worker->clients, clientHandle, NULL) != 0)
 			{
 				/*Codes_SRS_IOTHUBTRANSPORT_17_042: [ If Adding to the client list fails, IoTHubTransport_StartWorkerThread shall return IOTHUB_CLIENT_ERROR. ]*/
 				result = IOTHUB_CLIENT_ERROR;
@@ -205,44 +398,40 @@ static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * trans
 	return result;
 }
 
-static void stop_worker_thread(TRANSPORT_HANDLE_DATA * transportData)
+static void stop_worker_thread(TRANSPORT_WORKER* worker)
 {
 	/*Codes_SRS_IOTHUBTRANSPORT_17_043: [** IoTHubTransport_SignalEndWorkerThread shall signal the worker thread to end.*/
-	transportData->stopThread = 1;
+	worker->stopThread = 1;
 }
 
-static void wait_worker_thread(TRANSPORT_HANDLE_DATA * transportData)
+static void wait_worker_thread(TRANSPORT_WORKER* worker)
 {
-	if (transportData->workerThreadHandle != NULL)
+	if (worker->workerThreadHandle != NULL)
 	{
 		int res;
 		/*Codes_SRS_IOTHUBTRANSPORT_17_027: [ If handle list is empty, IoTHubTransport_EndWorkerThread shall be joined. ]*/
-		if (ThreadAPI_Join(transportData->workerThreadHandle, &res) != THREADAPI_OK)
+		if (ThreadAPI_Join(worker->workerThreadHandle, &res) != THREADAPI_OK)
 		{
 			LogError("ThreadAPI_Join failed");
 		}
 		else
 		{
-			transportData->workerThreadHandle = NULL;
+			worker->workerThreadHandle = NULL;
 		}
 	}
 }
 
-static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_HANDLE clientHandle)
+static bool signal_end_worker_thread(TRANSPORT_WORKER* worker, IOTHUB_CLIENT_HANDLE clientHandle)
 {
 	bool okToJoin;
-	void* element = VECTOR_find_if(transportData->clients, find_by_handle, clientHandle);
-	if (element != NULL)
-	{
-		/*Codes_SRS_IOTHUBTRANSPORT_17_026: [ IoTHubTransport_EndWorkerThread shall remove clientHandlehandle from handle list. ]*/
-		VECTOR_erase(transportData->clients, element, 1);
-	}
+	/*Codes_SRS_IOTHUBTRANSPORT_17_026: [ IoTHubTransport_EndWorkerThread shall remove clientHandlehandle from handle set by calling DeviceRegistry_Remove. ]*/
+	DeviceRegistry_Remove(worker->clients, clientHandle);
 	/*Codes_SRS_IOTHUBTRANSPORT_17_025: [ If the worker thread does not exist, then IoTHubTransport_EndWorkerThread shall return. ]*/
-	if (transportData->workerThreadHandle != NULL)
+	if (worker->workerThreadHandle != NULL)
 	{
-		if (VECTOR_size(transportData->clients) == 0)
+		if (DeviceRegistry_GetCount(worker->clients) == 0)
 		{
-			stop_worker_thread(transportData);
+			stop_worker_thread(worker);
 			okToJoin = true;
 		}
 		else
@@ -263,22 +452,35 @@ void IoTHubTransport_Destroy(TRANSPORT_HANDLE transportHandle)
 	if (transportHandle != NULL)
 	{
 		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
-		/*Codes_SRS_IOTHUBTRANSPORT_17_033: [ IoTHubTransport_Destroy shall lock the transport lock. ]*/
-		if (Lock(transportData->lockHandle) != LOCK_OK)
+		size_t i;
+		for (i = 0; i < transportData->workerCount; i++)
 		{
-			LogError("Unable to lock - will still attempt to end thread without thread safety");
-			stop_worker_thread(transportData);
+			TRANSPORT_WORKER* worker = &transportData->workers[i];
+			/*Codes_SRS_IOTHUBTRANSPORT_17_033: [ IoTHubTransport_Destroy shall lock the transport lock. ]*/
+			if (Lock(worker->lockHandle) != LOCK_OK)
+			{
+				LogError("Unable to lock - will still attempt to end thread without thread safety");
+				stop_worker_thread(worker);
+			}
+			else
+			{
+				stop_worker_thread(worker);
+				(void)Unlock(worker->lockHandle);
+			}
 		}
-		else
+		for (i = 0; i < transportData->workerCount; i++)
 		{
-			stop_worker_thread(transportData);
-			(void)Unlock(transportData->lockHandle);
+			wait_worker_thread(&transportData->workers[i]);
 		}
-		wait_worker_thread(transportData);
 		/*Codes_SRS_IOTHUBTRANSPORT_17_010: [ IoTHubTransport_Destroy shall free all resources. ]*/
-		Lock_Deinit(transportData->lockHandle);
-		(transportData->IoTHubTransport_Destroy)(transportData->transportLLHandle);
-		VECTOR_destroy(transportData->clients);
+		for (i = 0; i < transportData->workerCount; i++)
+		{
+			destroy_worker(transportData, &transportData->workers[i]);
+		}
+		if (transportData->assignLock != NULL)
+		{
+			Lock_Deinit(transportData->assignLock);
+		}
 		free(transportHandle);
 	}
 }
@@ -295,7 +497,7 @@ LOCK_HANDLE IoTHubTransport_GetLock(TRANSPORT_HANDLE transportHandle)
 	{
 		/*Codes_SRS_IOTHUBTRANSPORT_17_012: [ IoTHubTransport_GetLock shall return a handle to the transport lock. ]*/
 		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
-		lock = transportData->lockHandle;
+		lock = transportData->workers[0].lockHandle;
 	}
 	return lock;
 }
@@ -312,11 +514,74 @@ TRANSPORT_LL_HANDLE IoTHubTransport_GetLLTransport(TRANSPORT_HANDLE transportHan
 	{
 		/*Codes_SRS_IOTHUBTRANSPORT_17_014: [ IoTHubTransport_GetLLTransport shall return a handle to the lower layer transport. ]*/
 		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
-		llTransport = transportData->transportLLHandle;
+		llTransport = transportData->workers[0].transportLLHandle;
 	}
 	return llTransport;
 }
 
+LOCK_HANDLE IoTHubTransport_GetClientLock(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle)
+{
+	LOCK_HANDLE lock;
+	if (transportHandle == NULL || clientHandle == NULL)
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_17_055: [ If transportHandle or clientHandle is NULL, IoTHubTransport_GetClientLock shall return NULL. ]*/
+		LogError("Invalid NULL argument, transportHandle [%p], clientHandle [%p].", transportHandle, clientHandle);
+		lock = NULL;
+	}
+	else
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_17_053: [ If the transport has a single worker, every client shall be pinned to it. ]*/
+		/*Codes_SRS_IOTHUBTRANSPORT_17_056: [ IoTHubTransport_GetClientLock shall return the lock of the worker clientHandle is pinned to, or NULL if the client cannot be pinned. ]*/
+		TRANSPORT_WORKER* worker = get_client_worker((TRANSPORT_HANDLE_DATA*)transportHandle, clientHandle, true);
+		lock = (worker == NULL) ? NULL : worker->lockHandle;
+	}
+	return lock;
+}
+
+TRANSPORT_LL_HANDLE IoTHubTransport_GetClientLLTransport(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle)
+{
+	TRANSPORT_LL_HANDLE llTransport;
+	if (transportHandle == NULL || clientHandle == NULL)
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_17_057: [ If transportHandle or clientHandle is NULL, IoTHubTransport_GetClientLLTransport shall return NULL. ]*/
+		LogError("Invalid NULL argument, transportHandle [%p], clientHandle [%p].", transportHandle, clientHandle);
+		llTransport = NULL;
+	}
+	else
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_17_058: [ IoTHubTransport_GetClientLLTransport shall return the lower layer transport of the worker clientHandle is pinned to, or NULL if the client cannot be pinned. ]*/
+		TRANSPORT_WORKER* worker = get_client_worker((TRANSPORT_HANDLE_DATA*)transportHandle, clientHandle, true);
+		llTransport = (worker == NULL) ? NULL : worker->transportLLHandle;
+	}
+	return llTransport;
+}
+
+void IoTHubTransport_ReleaseClient(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle)
+{
+	/*Codes_SRS_IOTHUBTRANSPORT_17_059: [ If transportHandle or clientHandle is NULL, IoTHubTransport_ReleaseClient shall do nothing. ]*/
+	if (!(transportHandle == NULL || clientHandle == NULL))
+	{
+		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+		if (transportData->workerCount > 1)
+		{
+			if (Lock(transportData->assignLock) != LOCK_OK)
+			{
+				LogError("unable to Lock");
+			}
+			else
+			{
+				/*Codes_SRS_IOTHUBTRANSPORT_17_060: [ IoTHubTransport_ReleaseClient shall unpin clientHandle from its worker by calling DeviceRegistry_Remove. ]*/
+				size_t i;
+				for (i = 0; i < transportData->workerCount; i++)
+				{
+					DeviceRegistry_Remove(transportData->workers[i].assignedClients, clientHandle);
+				}
+				(void)Unlock(transportData->assignLock);
+			}
+		}
+	}
+}
+
 IOTHUB_CLIENT_RESULT IoTHubTransport_StartWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle)
 {
 	IOTHUB_CLIENT_RESULT result;
@@ -328,12 +593,15 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_StartWorkerThread(TRANSPORT_HANDLE transpor
 	}
 	else
 	{
-		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+		/*Codes_SRS_IOTHUBTRANSPORT_17_061: [ IoTHubTransport_StartWorkerThread, IoTHubTransport_SignalEndWorkerThread and IoTHubTransport_JoinWorkerThread shall act on the worker clientHandle is pinned to. ]*/
+		TRANSPORT_WORKER* worker = get_client_worker((TRANSPORT_HANDLE_DATA*)transportHandle, clientHandle, true);
 
-		if ((result = start_worker_if_needed(transportData, clientHandle)) != IOTHUB_CLIENT_OK)
+		if ((worker == NULL) ||
+			((result = start_worker_if_needed(worker, clientHandle)) != IOTHUB_CLIENT_OK))
 		{
 			/*Codes_SRS_IOTHUBTRANSPORT_17_019: [ If thread creation fails, IoTHubTransport_StartWorkerThread shall return IOTHUB_CLIENT_ERROR. */
 			LogError("Unable to start thread safely");
+			result = IOTHUB_CLIENT_ERROR;
 		}
 		else
 		{
@@ -351,8 +619,8 @@ bool IoTHubTransport_SignalEndWorkerThread(TRANSPORT_HANDLE transportHandle, IOT
 	/*Codes_SRS_IOTHUBTRANSPORT_17_024: [ If clientHandle is NULL, IoTHubTransport_EndWorkerThread shall return. ]*/
 	if (!(transportHandle == NULL || clientHandle == NULL))
 	{
-		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
-		okToJoin = signal_end_worker_thread(transportData, clientHandle);
+		TRANSPORT_WORKER* worker = get_client_worker((TRANSPORT_HANDLE_DATA*)transportHandle, clientHandle, false);
+		okToJoin = (worker == NULL) ? false : signal_end_worker_thread(worker, clientHandle);
 	}
 	else
 	{
@@ -367,8 +635,11 @@ void IoTHubTransport_JoinWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_C
 	/*Codes_SRS_IOTHUBTRANSPORT_17_045: [ If clientHandle is NULL, IoTHubTransport_JoinWorkerThread shall do nothing. ]*/
 	if (!(transportHandle == NULL || clientHandle == NULL))
 	{
-		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
-		/*Codes_SRS_IOTHUBTRANSPORT_17_027: [ The worker thread shall be joined. ]*/
-		wait_worker_thread(transportData);
+		TRANSPORT_WORKER* worker = get_client_worker((TRANSPORT_HANDLE_DATA*)transportHandle, clientHandle, false);
+		if (worker != NULL)
+		{
+			/*Codes_SRS_IOTHUBTRANSPORT_17_027: [ The worker thread shall be joined. ]*/
+			wait_worker_thread(worker);
+		}
 	}
 }
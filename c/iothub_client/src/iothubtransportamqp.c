@@ -32,6 +32,9 @@
 #include "iothub_client_private.h"
 #include "iothubtransportamqp.h"
 #include "iothub_client_version.h"
+#include "nodepool.h"
+#include "amqpeventencoder.h"
+#include "deviceregistry.h"
 
 #define RESULT_OK 0
 #define RESULT_FAILURE 1
@@ -51,6 +54,13 @@
 #define MESSAGE_SENDER_LINK_NAME "sender-link"
 #define MESSAGE_SENDER_SOURCE_ADDRESS "ingress"
 #define MESSAGE_SENDER_MAX_LINK_SIZE UINT64_MAX
+#define AMQP_BATCHING_FORMAT_CODE 0x80013700
+#define DEFAULT_BATCHING_MAX_EVENTS 100
+#define DEFAULT_BATCHING_MAX_SIZE (255*1024)
+// Bytes added around each event of a batch: the data section descriptor and the vbin32 constructor and length.
+#define BATCHED_EVENT_SECTION_OVERHEAD 8
+// By default the number of unsettled transfers is not limited.
+#define DEFAULT_MAX_UNSETTLED_TRANSFERS 0
 
 typedef XIO_HANDLE(*TLS_IO_TRANSPORT_PROVIDER)(const char* fqdn, int port);
 
@@ -58,27 +68,34 @@ typedef enum CBS_STATE_TAG
 {
     CBS_STATE_IDLE,
     CBS_STATE_AUTH_IN_PROGRESS,
-    CBS_STATE_AUTHENTICATED
+    CBS_STATE_AUTHENTICATED,
+    // The put of the token of the device failed. DoWork resets that device alone and puts a new token.
+    CBS_STATE_AUTH_FAILED
 } CBS_STATE;
 
+struct AMQP_TRANSPORT_DEVICE_STATE_TAG;
+
+// Context of one cbs_put_token(). Puts of different devices are in flight at the same time, each with its own context.
+typedef struct AMQP_PUT_TOKEN_OPERATION_TAG
+{
+    // Entry in the list of the puts waiting for their completion.
+    DLIST_ENTRY entry;
+    // Device whose token is being put. NULL once the put timed out or the device was unregistered.
+    struct AMQP_TRANSPORT_DEVICE_STATE_TAG* device_state;
+    // True if the device was already authenticated by a previous token when the put started.
+    bool is_refresh;
+    // Time when the previous SAS token was created, in seconds since epoch.
+    size_t previous_sas_token_create_time;
+} AMQP_PUT_TOKEN_OPERATION;
+
 typedef struct AMQP_TRANSPORT_STATE_TAG
 {
     // FQDN of the IoT Hub.
     STRING_HANDLE iotHubHostFqdn;
     // AMQP port of the IoT Hub.
     int iotHubPort;
-    // Key associated to the device to be used.
-    STRING_HANDLE deviceKey;
-	// SAS associated to the device to be used.
-	STRING_HANDLE deviceSasToken;
-    // Address to which the transport will connect to and send events.
-    STRING_HANDLE targetAddress;
-    // Address to which the transport will connect to and receive messages from.
-    STRING_HANDLE messageReceiveAddress;
     // A component of the SAS token. Currently this must be an empty string.
     STRING_HANDLE sasTokenKeyName;
-    // Internal parameter that identifies the current logical device within the service.
-    STRING_HANDLE devicesPath;
     // How long a SAS token created by the transport is valid, in milliseconds.
     size_t sas_token_lifetime;
     // Maximum period of time for the transport to wait before refreshing the SAS token it created previously, in milliseconds.
@@ -87,8 +104,6 @@ typedef struct AMQP_TRANSPORT_STATE_TAG
     size_t cbs_request_timeout;
     // Maximum time for the connection establishment/retry logic should wait for a connection to succeed, in milliseconds.
     size_t connection_timeout;
-    // Saved reference to the IoTHub LL Client.
-    IOTHUB_CLIENT_LL_HANDLE iothub_client_handle;
 
     // TSL I/O transport.
     XIO_HANDLE tls_io;
@@ -104,8 +119,57 @@ typedef struct AMQP_TRANSPORT_STATE_TAG
     AMQP_MANAGEMENT_STATE connection_state;
     // Last time the AMQP connection establishment was initiated.
     size_t connection_establish_time;
-    // AMQP session.
+    // AMQP session, shared by the links of all the registered devices.
     SESSION_HANDLE session;
+    // Connection instance with the Azure IoT CBS.
+    CBS_HANDLE cbs;
+    // Puts waiting for their completion (AMQP_PUT_TOKEN_OPERATION entries). The ones left are freed with the CBS instance.
+    DLIST_ENTRY pending_put_tokens;
+    // Devices registered with the transport (AMQP_TRANSPORT_DEVICE_STATE entries).
+    DLIST_ENTRY registered_devices;
+    // Index of the registered devices by handle and by id.
+    DEVICE_REGISTRY_HANDLE device_registry;
+    // Device served first by the next DoWork call. The list head stands for the first device in the list.
+    PDLIST_ENTRY next_device_to_serve;
+    // Set by the option "Batching": events are packed in batched AMQP messages instead of being sent one by one.
+    bool batching;
+    // Maximum number of events in one batched AMQP message.
+    size_t batching_max_events;
+    // Maximum size of the body of one batched AMQP message, in bytes.
+    size_t batching_max_size;
+    // Writes the events of the batches, created by the first batch sent.
+    AMQPEVENTENCODER_HANDLE event_encoder;
+    // Incoming and outgoing windows of the AMQP session, in transfer frames. Applied when the session is created.
+    uint32_t incoming_window_size;
+    uint32_t outgoing_window_size;
+    // Maximum message size of the event sender and message receiver links, in bytes. Applied when the links are created.
+    uint64_t sender_max_link_size;
+    uint64_t receiver_max_link_size;
+    // Maximum number of AMQP messages a device leaves unsettled before it stops taking events from waitingToSend. 0 means no limit.
+    size_t max_unsettled_transfers;
+} AMQP_TRANSPORT_INSTANCE;
+
+typedef struct AMQP_TRANSPORT_DEVICE_STATE_TAG
+{
+    // Entry in the list of devices registered with the transport.
+    DLIST_ENTRY entry;
+    // Transport the device is registered with.
+    AMQP_TRANSPORT_INSTANCE* transport_state;
+    // Key associated to the device to be used.
+    STRING_HANDLE deviceKey;
+    // SAS associated to the device to be used.
+    STRING_HANDLE deviceSasToken;
+    // Internal parameter that identifies the current logical device within the service.
+    STRING_HANDLE devicesPath;
+    // Address to which the transport will connect to and send events.
+    STRING_HANDLE targetAddress;
+    // Address to which the transport will connect to and receive messages from.
+    STRING_HANDLE messageReceiveAddress;
+    // Names of the links of the device. Links attached to the same session need distinct names.
+    STRING_HANDLE senderLinkName;
+    STRING_HANDLE receiverLinkName;
+    // Saved reference to the IoTHub LL Client.
+    IOTHUB_CLIENT_LL_HANDLE iothub_client_handle;
     // AMQP link used by the event sender.
     LINK_HANDLE sender_link;
     // uAMQP event sender.
@@ -120,16 +184,29 @@ typedef struct AMQP_TRANSPORT_STATE_TAG
     PDLIST_ENTRY waitingToSend;
     // Internal list with the items currently being processed/sent through uAMQP.
     DLIST_ENTRY inProgress;
-    // Connection instance with the Azure IoT CBS.
-    CBS_HANDLE cbs;
-    // Current state of the CBS connection.
+    // Current state of the CBS authentication of the device.
     CBS_STATE cbs_state;
+    // Put of the token of the device waiting for its completion, NULL if there is none.
+    AMQP_PUT_TOKEN_OPERATION* put_token_operation;
     // Time when the current SAS token was created, in seconds since epoch.
     size_t current_sas_token_create_time;
-    // Mark if device is registered in transport (only one device per transport).
-    bool isRegistered;
-} AMQP_TRANSPORT_INSTANCE;
-
+    // Time when the last put of a SAS token was started, in seconds since epoch. Later than current_sas_token_create_time after a failed refresh.
+    size_t last_put_token_time;
+    // Events sent one by one and not settled yet.
+    size_t unsettled_events;
+    // Batched messages sent and not settled yet.
+    size_t unsettled_batches;
+} AMQP_TRANSPORT_DEVICE_STATE;
+
+// Events sent in one batched AMQP message, completed together by on_event_batch_send_complete.
+typedef struct AMQP_EVENT_BATCH_TAG
+{
+    // Device that sent the batch.
+    AMQP_TRANSPORT_DEVICE_STATE* device_state;
+    size_t count;
+    // Points right after the structure, in the same allocation.
+    IOTHUB_MESSAGE_LIST** events;
+} AMQP_EVENT_BATCH;
 
 
 // Auxiliary functions
@@ -161,19 +238,21 @@ static size_t getSecondsSinceEpoch(void)
     return (size_t)(difftime(get_time(NULL), (time_t)0));
 }
 
-static void trackEventInProgress(IOTHUB_MESSAGE_LIST* message, AMQP_TRANSPORT_INSTANCE* transport_state)
+static void trackEventInProgress(IOTHUB_MESSAGE_LIST* message, AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
     DList_RemoveEntryList(&message->entry);
-    DList_InsertTailList(&transport_state->inProgress, &message->entry);
+    DList_InsertTailList(&device_state->inProgress, &message->entry);
+    // not an unsettled transfer until it is sent on its own
+    message->sender = NULL;
 }
 
-static IOTHUB_MESSAGE_LIST* getNextEventToSend(AMQP_TRANSPORT_INSTANCE* transport_state)
+static IOTHUB_MESSAGE_LIST* getNextEventToSend(AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
     IOTHUB_MESSAGE_LIST* message;
 
-    if (!DList_IsListEmpty(transport_state->waitingToSend))
+    if (!DList_IsListEmpty(device_state->waitingToSend))
     {
-        PDLIST_ENTRY list_entry = transport_state->waitingToSend->Flink;
+        PDLIST_ENTRY list_entry = device_state->waitingToSend->Flink;
         message = containingRecord(list_entry, IOTHUB_MESSAGE_LIST, entry);
     }
     else
@@ -195,26 +274,28 @@ static void removeEventFromInProgressList(IOTHUB_MESSAGE_LIST* message)
     DList_InitializeListHead(&message->entry);
 }
 
-static void rollEventBackToWaitList(IOTHUB_MESSAGE_LIST* message, AMQP_TRANSPORT_INSTANCE* transport_state)
+static void rollEventBackToWaitList(IOTHUB_MESSAGE_LIST* message, AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
     removeEventFromInProgressList(message);
-	DList_InsertTailList(transport_state->waitingToSend, &message->entry);
+	/*waitingToSend is kept in priority order, the events in progress were taken from its head so that is where they go back*/
+	DList_InsertHeadList(device_state->waitingToSend, &message->entry);
 }
 
-static void rollEventsBackToWaitList(AMQP_TRANSPORT_INSTANCE* transport_state)
+static void rollEventsBackToWaitList(AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
-    PDLIST_ENTRY entry = transport_state->inProgress.Blink;
+    PDLIST_ENTRY entry = device_state->inProgress.Blink;
 
-    while (entry != &transport_state->inProgress)
+    while (entry != &device_state->inProgress)
     {
 		IOTHUB_MESSAGE_LIST* message = containingRecord(entry, IOTHUB_MESSAGE_LIST, entry);
         entry = entry->Blink;
-        rollEventBackToWaitList(message, transport_state);
+        rollEventBackToWaitList(message, device_state);
     }
 }
 
 
-static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, MESSAGE_HANDLE uamqp_message)
+// Builds the uAMQP map of the properties of an IoTHub message. *uamqp_map is set to NULL when the message has no properties.
+static int createuAMQPPropertiesMap(IOTHUB_MESSAGE_HANDLE iothub_message_handle, AMQP_VALUE* uamqp_map)
 {
 	int result;
 	MAP_HANDLE properties_map;
@@ -222,6 +303,8 @@ static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_hand
 	const char* const* propertyValues;
 	size_t propertyCount;
 
+	*uamqp_map = NULL;
+
 	/* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_007: [The IoTHub message properties shall be obtained by calling IoTHubMessage_Properties.] */
 	properties_map = IoTHubMessage_Properties(iothub_message_handle);
 	if (properties_map == NULL)
@@ -244,8 +327,8 @@ static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_hand
 		{
 			size_t i;
 			/* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_009: [The uAMQP map shall be created by calling amqpvalue_create_map.] */
-			AMQP_VALUE uamqp_map = amqpvalue_create_map();
-			if (uamqp_map == NULL)
+			AMQP_VALUE new_map = amqpvalue_create_map();
+			if (new_map == NULL)
 			{
 				/* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
 				LogError("Failed to create uAMQP map for the properties.");
@@ -276,7 +359,7 @@ static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_hand
 
 					/* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_008: [All properties shall be transferred to a uAMQP map.] */
 					/* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_012: [The key/value pair for the property shall be set into the uAMQP property map by calling amqpvalue_map_set_value.] */
-					if (amqpvalue_set_map_value(uamqp_map, map_key_value, map_value_value) != 0)
+					if (amqpvalue_set_map_value(new_map, map_key_value, map_value_value) != 0)
 					{
 						amqpvalue_destroy(map_key_value);
 						amqpvalue_destroy(map_value_value);
@@ -291,24 +374,14 @@ static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_hand
 
 				if (i < propertyCount)
 				{
+					amqpvalue_destroy(new_map);
 					result = __LINE__;
 				}
 				else
 				{
-					/* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_013: [After all properties have been filled in the uAMQP map, the uAMQP properties map shall be set on the uAMQP message by calling message_set_application_properties.] */
-					if (message_set_application_properties(uamqp_message, uamqp_map) != 0)
-					{
-						/* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-						LogError("Failed to transfer the message properties to the uAMQP message.");
-						result = __LINE__;
-					}
-					else
-					{
-						result = 0;
-					}
+					*uamqp_map = new_map;
+					result = 0;
 				}
-
-				amqpvalue_destroy(uamqp_map);
 			}
 		}
 		else
@@ -320,6 +393,39 @@ static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_hand
 	return result;
 }
 
+static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, MESSAGE_HANDLE uamqp_message)
+{
+	int result;
+	AMQP_VALUE uamqp_map;
+
+	if (createuAMQPPropertiesMap(iothub_message_handle, &uamqp_map) != 0)
+	{
+		result = __LINE__;
+	}
+	else if (uamqp_map == NULL)
+	{
+		result = 0;
+	}
+	else
+	{
+		/* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_013: [After all properties have been filled in the uAMQP map, the uAMQP properties map shall be set on the uAMQP message by calling message_set_application_properties.] */
+		if (message_set_application_properties(uamqp_message, uamqp_map) != 0)
+		{
+			/* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+			LogError("Failed to transfer the message properties to the uAMQP message.");
+			result = __LINE__;
+		}
+		else
+		{
+			result = 0;
+		}
+
+		amqpvalue_destroy(uamqp_map);
+	}
+
+	return result;
+}
+
 static int readPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, MESSAGE_HANDLE uamqp_message)
 {
 	int return_value;
@@ -331,7 +437,7 @@ static int readPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_h
 	/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_155: [uAMQP message properties shall be retrieved using message_get_properties.] */
 	if ((api_call_result = message_get_properties(uamqp_message, &uamqp_message_properties)) != 0)
 	{
-		/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_156: [If message_get_properties fails, the error shall be notified and on_message_received shall continue.] */
+		/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_156: [If message_get_properties fails, the error shall be notified and �on_message_received� shall continue.] */
 		LogError("Failed to get property properties map from uAMQP message (error code %d).", api_call_result);
 		return_value = __LINE__;
 	}
@@ -342,7 +448,7 @@ static int readPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_h
 		/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_157: [The message-id property shall be read from the uAMQP message by calling properties_get_message_id.] */
 		if ((api_call_result = properties_get_message_id(uamqp_message_properties, &uamqp_message_property)) != 0)
 		{
-			/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_158: [If properties_get_message_id fails, the error shall be notified and on_message_received shall continue.] */
+			/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_158: [If properties_get_message_id fails, the error shall be notified and �on_message_received� shall continue.] */
 			LogInfo("Failed to get value of uAMQP message 'message-id' property (%d).", api_call_result);
 			return_value = __LINE__;
 		}
@@ -351,14 +457,14 @@ static int readPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_h
 			/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_159: [The message-id value shall be retrieved from the AMQP_VALUE as char* by calling amqpvalue_get_string.] */
 			if ((api_call_result = amqpvalue_get_string(uamqp_message_property, &uamqp_message_property_value)) != 0)
 			{
-				/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_160: [If amqpvalue_get_string fails, the error shall be notified and on_message_received shall continue.] */
+				/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_160: [If amqpvalue_get_string fails, the error shall be notified and �on_message_received� shall continue.] */
 				LogError("Failed to get value of uAMQP message 'message-id' property (%d).", api_call_result);
 				return_value = __LINE__;
 			}
 			/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_161: [The message-id property shall be set on the IOTHUB_MESSAGE_HANDLE by calling IoTHubMessage_SetMessageId, passing the value read from the uAMQP message.] */
 			else if (IoTHubMessage_SetMessageId(iothub_message_handle, uamqp_message_property_value) != IOTHUB_MESSAGE_OK)
 			{
-				/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_162: [If IoTHubMessage_SetMessageId fails, the error shall be notified and on_message_received shall continue.] */
+				/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_162: [If IoTHubMessage_SetMessageId fails, the error shall be notified and �on_message_received� shall continue.] */
 				LogError("Failed to set IOTHUB_MESSAGE_HANDLE 'message-id' property.");
 				return_value = __LINE__;
 			}
@@ -367,7 +473,7 @@ static int readPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_h
 		/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_163: [The correlation-id property shall be read from the uAMQP message by calling properties_get_correlation_id.] */
 		if ((api_call_result = properties_get_correlation_id(uamqp_message_properties, &uamqp_message_property)) != 0)
 		{
-			/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_164: [If properties_get_correlation_id fails, the error shall be notified and on_message_received shall continue.] */
+			/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_164: [If properties_get_correlation_id fails, the error shall be notified and �on_message_received� shall continue.] */
 			LogError("Failed to get value of uAMQP message 'correlation-id' property (%d).", api_call_result);
 			return_value = __LINE__;
 		}
@@ -376,14 +482,14 @@ static int readPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_h
 			/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_165: [The correlation-id value shall be retrieved from the AMQP_VALUE as char* by calling amqpvalue_get_string.] */
 			if ((api_call_result = amqpvalue_get_string(uamqp_message_property, &uamqp_message_property_value)) != 0)
 			{
-				/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_166: [If amqpvalue_get_string fails, the error shall be notified and on_message_received shall continue.] */
+				/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_166: [If amqpvalue_get_string fails, the error shall be notified and �on_message_received� shall continue.] */
 				LogError("Failed to get value of uAMQP message 'correlation-id' property (%d).", api_call_result);
 				return_value = __LINE__;
 			}
 			/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_167: [The correlation-id property shall be set on the IOTHUB_MESSAGE_HANDLE by calling IoTHubMessage_SetCorrelationId, passing the value read from the uAMQP message.] */
 			else if (IoTHubMessage_SetCorrelationId(iothub_message_handle, uamqp_message_property_value) != IOTHUB_MESSAGE_OK)
 			{
-				/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_168: [If IoTHubMessage_SetCorrelationId fails, the error shall be notified and on_message_received shall continue.] */
+				/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_168: [If IoTHubMessage_SetCorrelationId fails, the error shall be notified and �on_message_received� shall continue.] */
 				LogError("Failed to set IOTHUB_MESSAGE_HANDLE 'correlation-id' property.");
 				return_value = __LINE__;
 			}
@@ -404,18 +510,18 @@ static int readApplicationPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothu
 	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_170: [The IOTHUB_MESSAGE_HANDLE properties shall be retrieved using IoTHubMessage_Properties.]
 	if ((iothub_message_properties_map = IoTHubMessage_Properties(iothub_message_handle)) == NULL)
 	{
-		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_186: [If IoTHubMessage_Properties fails, the error shall be notified and on_message_received shall continue.]
+		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_186: [If IoTHubMessage_Properties fails, the error shall be notified and �on_message_received� shall continue.]
 		LogError("Failed to get property map from IoTHub message.");
 		result = __LINE__;
 	}
 	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_171: [uAMQP message application properties shall be retrieved using message_get_application_properties.]
 	else if ((result = message_get_application_properties(uamqp_message, &uamqp_app_properties)) != 0)
 	{
-		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_172: [If message_get_application_properties fails, the error shall be notified and on_message_received shall continue.]
+		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_172: [If message_get_application_properties fails, the error shall be notified and �on_message_received� shall continue.]
 		LogError("Failed reading the incoming uAMQP message properties (return code %d).", result);
 		result = __LINE__;
 	}
-	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_187: [If message_get_application_properties succeeds but returns a NULL application properties map (there are no properties), on_message_received shall continue normally.]
+	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_187: [If message_get_application_properties succeeds but returns a NULL application properties map (there are no properties), �on_message_received� shall continue normally.]
 	else if (uamqp_app_properties == NULL)
 	{
 		result = 0;
@@ -423,20 +529,20 @@ static int readApplicationPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothu
 	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_173: [The actual uAMQP message application properties should be extracted from the result of message_get_application_properties using amqpvalue_get_inplace_described_value.]
 	else if ((uamqp_app_properties = amqpvalue_get_inplace_described_value(uamqp_app_properties)) == NULL)
 	{
-		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_174: [If amqpvalue_get_inplace_described_value fails, the error shall be notified and on_message_received shall continue.]
+		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_174: [If amqpvalue_get_inplace_described_value fails, the error shall be notified and �on_message_received� shall continue.]
 		LogError("Failed getting the map of uAMQP message application properties (return code %d).", result);
 		result = __LINE__;
 	}
 	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_175: [The number of items in the uAMQP message application properties shall be obtained using amqpvalue_get_map_pair_count.]
 	else if ((result = amqpvalue_get_map_pair_count(uamqp_app_properties, &property_count)) != 0)
 	{
-		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_176: [If amqpvalue_get_map_pair_count fails, the error shall be notified and on_message_received shall continue.]
+		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_176: [If amqpvalue_get_map_pair_count fails, the error shall be notified and �on_message_received� shall continue.]
 		LogError("Failed reading the number of values in the uAMQP property map (return code %d).", result);
 		result = __LINE__;
 	}
 	else
 	{
-		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_177: [on_message_received shall iterate through each uAMQP application property and add it on IOTHUB_MESSAGE_HANDLE properties.]
+		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_177: [�on_message_received� shall iterate through each uAMQP application property and add it on IOTHUB_MESSAGE_HANDLE properties.]
 		size_t i;
 		for (i = 0; i < property_count; i++)
 		{
@@ -448,7 +554,7 @@ static int readApplicationPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothu
 			// Codes_SRS_IOTHUBTRANSPORTAMQP_09_178: [The uAMQP application property name and value shall be obtained using amqpvalue_get_map_key_value_pair.]
 			if ((result = amqpvalue_get_map_key_value_pair(uamqp_app_properties, i, &map_key_name, &map_key_value)) != 0)
 			{
-				// Codes_SRS_IOTHUBTRANSPORTAMQP_09_179: [If amqpvalue_get_map_key_value_pair fails, the error shall be notified and on_message_received shall continue.]
+				// Codes_SRS_IOTHUBTRANSPORTAMQP_09_179: [If amqpvalue_get_map_key_value_pair fails, the error shall be notified and �on_message_received� shall continue.]
 				LogError("Failed reading the key/value pair from the uAMQP property map (return code %d).", result);
 				result = __LINE__;
 				break;
@@ -456,7 +562,7 @@ static int readApplicationPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothu
 			// Codes_SRS_IOTHUBTRANSPORTAMQP_09_180: [The uAMQP application property name shall be extracted as string using amqpvalue_get_string.]
 			else if ((result = amqpvalue_get_string(map_key_name, &key_name)) != 0)
 			{
-				// Codes_SRS_IOTHUBTRANSPORTAMQP_09_181: [If amqpvalue_get_string fails, the error shall be notified and on_message_received shall continue.]
+				// Codes_SRS_IOTHUBTRANSPORTAMQP_09_181: [If amqpvalue_get_string fails, the error shall be notified and �on_message_received� shall continue.]
 				LogError("Failed parsing the uAMQP property name (return code %d).", result);
 				result = __LINE__;
 				break;
@@ -464,7 +570,7 @@ static int readApplicationPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothu
 			// Codes_SRS_IOTHUBTRANSPORTAMQP_09_182: [The uAMQP application property value shall be extracted as string using amqpvalue_get_string.]
 			else if ((result = amqpvalue_get_string(map_key_value, &key_value)) != 0)
 			{
-				// Codes_SRS_IOTHUBTRANSPORTAMQP_09_183: [If amqpvalue_get_string fails, the error shall be notified and on_message_received shall continue.]
+				// Codes_SRS_IOTHUBTRANSPORTAMQP_09_183: [If amqpvalue_get_string fails, the error shall be notified and �on_message_received� shall continue.]
 				LogError("Failed parsing the uAMQP property value (return code %d).", result);
 				result = __LINE__;
 				break;
@@ -472,7 +578,7 @@ static int readApplicationPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothu
 			// Codes_SRS_IOTHUBTRANSPORTAMQP_09_184: [The application property name and value shall be added to IOTHUB_MESSAGE_HANDLE properties using Map_AddOrUpdate.]
 			else if (Map_AddOrUpdate(iothub_message_properties_map, key_name, key_value) != MAP_OK)
 			{
-				// Codes_SRS_IOTHUBTRANSPORTAMQP_09_185: [If Map_AddOrUpdate fails, the error shall be notified and on_message_received shall continue.]
+				// Codes_SRS_IOTHUBTRANSPORTAMQP_09_185: [If Map_AddOrUpdate fails, the error shall be notified and �on_message_received� shall continue.]
 				LogError("Failed to add/update IoTHub message property map.");
 				result = __LINE__;
 				break;
@@ -486,47 +592,107 @@ static int readApplicationPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothu
 static void on_message_send_complete(void* context, MESSAGE_SEND_RESULT send_result)
 {
 	IOTHUB_MESSAGE_LIST* message = (IOTHUB_MESSAGE_LIST*)context;
+	DLIST_ENTRY completed;
 
-    IOTHUB_CLIENT_RESULT iot_hub_send_result;
+    IOTHUB_BATCHSTATE_RESULT iot_hub_send_result;
 
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_142: [The callback 'on_message_send_complete' shall pass to the upper layer callback an IOTHUB_CLIENT_CONFIRMATION_OK if the result received is MESSAGE_SEND_OK] 
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_142: [The callback 'on_message_send_complete' shall complete the message with IOTHUB_BATCHSTATE_SUCCESS if the result received is MESSAGE_SEND_OK] 
     if (send_result == MESSAGE_SEND_OK)
     {
-        iot_hub_send_result = IOTHUB_CLIENT_CONFIRMATION_OK;
+        iot_hub_send_result = IOTHUB_BATCHSTATE_SUCCESS;
     }
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_143: [The callback 'on_message_send_complete' shall pass to the upper layer callback an IOTHUB_CLIENT_CONFIRMATION_ERROR if the result received is MESSAGE_SEND_ERROR]
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_143: [The callback 'on_message_send_complete' shall complete the message with IOTHUB_BATCHSTATE_FAILED if the result received is MESSAGE_SEND_ERROR]
     else
     {
-        iot_hub_send_result = IOTHUB_CLIENT_CONFIRMATION_ERROR;
+        iot_hub_send_result = IOTHUB_BATCHSTATE_FAILED;
     }
 
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_102: [The callback 'on_message_send_complete' shall invoke the upper layer callback for message received if provided] 
-    if (message->callback != NULL)
-    {
-        message->callback(iot_hub_send_result, message->context);
-    }
-
-	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_100: [The callback 'on_message_send_complete' shall remove the target message from the in-progress list after the upper layer callback] 
+	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_100: [The callback 'on_message_send_complete' shall remove the target message from the in-progress list before completing it] 
 	if (isEventInInProgressList(message))
 	{
+		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_231: [The callback 'on_message_send_complete' shall take the event off the count of unsettled transfers of the device that sent it]
+		// The device is only known to be alive while the event is in its in-progress list.
+		AMQP_TRANSPORT_DEVICE_STATE* device_state = (AMQP_TRANSPORT_DEVICE_STATE*)message->sender;
+		if (device_state != NULL && device_state->unsettled_events > 0)
+		{
+			device_state->unsettled_events--;
+		}
 		removeEventFromInProgressList(message);
 	}
 
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_151: [The callback 'on_message_send_complete' shall destroy the message handle (IOTHUB_MESSAGE_HANDLE) using IoTHubMessage_Destroy()]
-    IoTHubMessage_Destroy(message->messageHandle);
+	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_198: [The callback 'on_message_send_complete' shall complete the message by calling IoTHubClient_LL_SendComplete with the IOTHUB_CLIENT_LL_HANDLE that queued the message (message->owner) and a list containing only the message] 
+	DList_InitializeListHead(&completed);
+	DList_InsertTailList(&completed, &message->entry);
+	IoTHubClient_LL_SendComplete(message->owner, &completed, iot_hub_send_result);
+}
+
+static void on_event_batch_send_complete(void* context, MESSAGE_SEND_RESULT send_result)
+{
+	AMQP_EVENT_BATCH* batch = (AMQP_EVENT_BATCH*)context;
+	DLIST_ENTRY completed;
+	size_t i;
+
+	DList_InitializeListHead(&completed);
+
+	for (i = 0; i < batch->count; i++)
+	{
+		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_206: [The callback 'on_event_batch_send_complete' shall remove the events of the batch from the in-progress list]
+		if (isEventInInProgressList(batch->events[i]))
+		{
+			removeEventFromInProgressList(batch->events[i]);
+		}
+
+		DList_InsertTailList(&completed, &batch->events[i]->entry);
+	}
+
+	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_217: [The callback 'on_event_batch_send_complete' shall take the batch off the count of unsettled transfers of the device that sent it]
+	if (batch->device_state->unsettled_batches > 0)
+	{
+		batch->device_state->unsettled_batches--;
+	}
+
+	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_207: [The callback 'on_event_batch_send_complete' shall complete all the events of the batch with one call to IoTHubClient_LL_SendComplete, passing IOTHUB_BATCHSTATE_SUCCESS if the result received is MESSAGE_SEND_OK and IOTHUB_BATCHSTATE_FAILED otherwise]
+	IoTHubClient_LL_SendComplete(batch->events[0]->owner, &completed, (send_result == MESSAGE_SEND_OK) ? IOTHUB_BATCHSTATE_SUCCESS : IOTHUB_BATCHSTATE_FAILED);
 
-	// Codes_SRS_IOTHUBTRANSPORTAMQP_09_152: [The callback 'on_message_send_complete' shall destroy the IOTHUB_MESSAGE_LIST instance]
-    free(message);
+	free(batch);
+}
+
+// A put that fails or times out leaves the device authenticated if it was a refresh and the previous token is still valid.
+static bool isPreviousSasTokenValid(AMQP_PUT_TOKEN_OPERATION* operation)
+{
+    return operation->is_refresh &&
+        ((getSecondsSinceEpoch() - operation->previous_sas_token_create_time) < (operation->device_state->transport_state->sas_token_lifetime / 1000));
 }
 
 static void on_put_token_complete(void* context, CBS_OPERATION_RESULT operation_result, unsigned int status_code, const char* status_description)
 {
-    AMQP_TRANSPORT_INSTANCE* transportState = (AMQP_TRANSPORT_INSTANCE*)context;
+    AMQP_PUT_TOKEN_OPERATION* operation = (AMQP_PUT_TOKEN_OPERATION*)context;
+    AMQP_TRANSPORT_DEVICE_STATE* device_state = operation->device_state;
 
-    if (operation_result == CBS_OPERATION_RESULT_OK)
+    if (device_state != NULL)
     {
-        transportState->cbs_state = CBS_STATE_AUTHENTICATED;
+        device_state->put_token_operation = NULL;
+
+        if (operation_result == CBS_OPERATION_RESULT_OK)
+        {
+            device_state->cbs_state = CBS_STATE_AUTHENTICATED;
+        }
+        else if (isPreviousSasTokenValid(operation))
+        {
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_230: [If the put of a refreshed SAS token fails or times out while the previous SAS token of the device is still valid, the device shall stay authenticated and keep its links, and IoTHubTransportAMQP_DoWork shall put a new SAS token for it]
+            LogError("The put of the refreshed SAS token of a device failed (%u), the previous token is used until the put is retried.", status_code);
+            device_state->current_sas_token_create_time = operation->previous_sas_token_create_time;
+        }
+        else
+        {
+            // DoWork resets the device on its next call.
+            LogError("The put of the SAS token of a device failed (%u).", status_code);
+            device_state->cbs_state = CBS_STATE_AUTH_FAILED;
+        }
     }
+
+    DList_RemoveEntryList(&operation->entry);
+    free(operation);
 }
 
 static AMQP_VALUE on_message_received(const void* context, MESSAGE_HANDLE message)
@@ -565,17 +731,17 @@ static AMQP_VALUE on_message_received(const void* context, MESSAGE_HANDLE messag
     }
 	else
     {
-		/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_153: [The callback on_message_received shall read the message-id property from the uAMQP message and set it on the IoT Hub Message if the property is defined.] */
-		/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_154: [The callback on_message_received shall read the correlation-id property from the uAMQP message and set it on the IoT Hub Message if the property is defined.] */
+		/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_153: [The callback �on_message_received� shall read the message-id property from the uAMQP message and set it on the IoT Hub Message if the property is defined.] */
+		/* Codes_SRS_IOTHUBTRANSPORTAMQP_09_154: [The callback �on_message_received� shall read the correlation-id property from the uAMQP message and set it on the IoT Hub Message if the property is defined.] */
 		if (readPropertiesFromuAMQPMessage(iothub_message, message) != 0)
 		{
 			LogError("Transport failed reading properties of the message received.");
 		}
 
-		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_169: [The callback on_message_received shall read the application properties from the uAMQP message and set it on the IoT Hub Message if any are provided.]
+		// Codes_SRS_IOTHUBTRANSPORTAMQP_09_169: [The callback �on_message_received� shall read the application properties from the uAMQP message and set it on the IoT Hub Message if any are provided.]
 		if (readApplicationPropertiesFromuAMQPMessage(iothub_message, message) != 0)
 		{
-			// Codes_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
+			// Codes_SRS_IOTHUBTRANSPORTAMQP_09_188: [If �on_message_received� fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
 			LogError("Transport failed reading application properties of the message received.");
 			
 			result = messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties");
@@ -600,6 +766,12 @@ static AMQP_VALUE on_message_received(const void* context, MESSAGE_HANDLE messag
         else if (disposition_result == IOTHUBMESSAGE_REJECTED)
         {
             result = messaging_delivery_rejected("Rejected by application", "Rejected by application");
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_196: [The callback 'on_message_received' shall return the result of messaging_delivery_released() if the IoTHubClient_LL_MessageCallback() returns IOTHUBMESSAGE_ASYNC_ACK, since this transport does not support asynchronous dispositions]
+        else
+        {
+            LogError("IOTHUBMESSAGE_ASYNC_ACK is not supported by the AMQP transport, the message is released.");
+            result = messaging_delivery_released();
         }
 		}
 
@@ -624,6 +796,18 @@ static void destroyConnection(AMQP_TRANSPORT_INSTANCE* transport_state)
         transport_state->cbs = NULL;
     }
 
+    // The puts that did not complete will never do so once the CBS instance is gone.
+    while (transport_state->pending_put_tokens.Flink != &transport_state->pending_put_tokens)
+    {
+        AMQP_PUT_TOKEN_OPERATION* operation = containingRecord(transport_state->pending_put_tokens.Flink, AMQP_PUT_TOKEN_OPERATION, entry);
+        if (operation->device_state != NULL)
+        {
+            operation->device_state->put_token_operation = NULL;
+        }
+        DList_RemoveEntryList(&operation->entry);
+        free(operation);
+    }
+
     if (transport_state->session != NULL)
     {
         session_destroy(transport_state->session);
@@ -723,13 +907,14 @@ static int establishConnection(AMQP_TRANSPORT_INSTANCE* transport_state)
         else
         {
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_065: [IoTHubTransportAMQP_DoWork shall apply a default value of UINT_MAX for the parameter 'AMQP incoming window'] 
-            if (session_set_incoming_window(transport_state->session, (uint32_t)DEFAULT_INCOMING_WINDOW_SIZE) != 0)
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_219: [IoTHubTransportAMQP_DoWork shall apply the values of the options "incoming_window_size" and "outgoing_window_size", when set, instead of the defaults to the session it creates]
+            if (session_set_incoming_window(transport_state->session, transport_state->incoming_window_size) != 0)
             {
                 LogError("Failed to set the AMQP incoming window size.");
             }
 
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_115: [IoTHubTransportAMQP_DoWork shall apply a default value of 100 for the parameter 'AMQP outgoing window'] 
-            if (session_set_outgoing_window(transport_state->session, DEFAULT_OUTGOING_WINDOW_SIZE) != 0)
+            if (session_set_outgoing_window(transport_state->session, transport_state->outgoing_window_size) != 0)
             {
                 LogError("Failed to set the AMQP outgoing window size.");
             }
@@ -750,8 +935,17 @@ static int establishConnection(AMQP_TRANSPORT_INSTANCE* transport_state)
             }
             else
             {
+                PDLIST_ENTRY entry;
+
                 transport_state->connection_establish_time = getSecondsSinceEpoch();
-                transport_state->cbs_state = CBS_STATE_IDLE;
+
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_189: [Once the connection is established every registered device shall be authenticated again with its own SAS token.]
+                for (entry = transport_state->registered_devices.Flink; entry != &transport_state->registered_devices; entry = entry->Flink)
+                {
+                    AMQP_TRANSPORT_DEVICE_STATE* device_state = containingRecord(entry, AMQP_TRANSPORT_DEVICE_STATE, entry);
+                    device_state->cbs_state = CBS_STATE_IDLE;
+                }
+
                 result = RESULT_OK;
             }
         }
@@ -765,9 +959,10 @@ static int establishConnection(AMQP_TRANSPORT_INSTANCE* transport_state)
     return result;
 }
 
-static int startAuthentication(AMQP_TRANSPORT_INSTANCE* transport_state)
+static int startAuthentication(AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
     int result;
+    AMQP_TRANSPORT_INSTANCE* transport_state = device_state->transport_state;
 
     size_t sas_token_create_time = getSecondsSinceEpoch(); // I.e.: NOW, in seconds since epoch.
 
@@ -776,30 +971,54 @@ static int startAuthentication(AMQP_TRANSPORT_INSTANCE* transport_state)
 
 	STRING_HANDLE newSASToken;
 
-	if (transport_state->deviceSasToken == NULL)
+	if (device_state->deviceSasToken == NULL)
 	{
-		newSASToken = SASToken_Create(transport_state->deviceKey, transport_state->devicesPath, transport_state->sasTokenKeyName, new_expiry_time);
+		newSASToken = SASToken_Create(device_state->deviceKey, device_state->devicesPath, transport_state->sasTokenKeyName, new_expiry_time);
 	}
 	else
 	{
-		newSASToken = STRING_clone(transport_state->deviceSasToken);
+		newSASToken = STRING_clone(device_state->deviceSasToken);
 	}
 
+    AMQP_PUT_TOKEN_OPERATION* operation;
+
     if (newSASToken == NULL)
     {
 		LogError("Could not generate a new SAS token for the CBS.");
         result = RESULT_FAILURE;
     }
-    else if (cbs_put_token(transport_state->cbs, CBS_AUDIENCE, STRING_c_str(transport_state->devicesPath), STRING_c_str(newSASToken), on_put_token_complete, transport_state) != RESULT_OK)
+    else if ((operation = (AMQP_PUT_TOKEN_OPERATION*)malloc(sizeof(AMQP_PUT_TOKEN_OPERATION))) == NULL)
     {
-		LogError("Failed applying new SAS token to CBS.");
+        LogError("Could not allocate the context of the put of a SAS token.");
         result = RESULT_FAILURE;
     }
     else
     {
-        transport_state->cbs_state = CBS_STATE_AUTH_IN_PROGRESS;
-        transport_state->current_sas_token_create_time = sas_token_create_time;
-        result = RESULT_OK;
+        operation->device_state = device_state;
+        operation->is_refresh = (device_state->cbs_state == CBS_STATE_AUTHENTICATED);
+        operation->previous_sas_token_create_time = device_state->current_sas_token_create_time;
+
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_190: [The SAS token of each device shall be put on the shared CBS instance using the devicesPath of that device as audience.]
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_227: [The put of the SAS token of a device shall not wait for the puts of the other devices to complete.]
+        if (cbs_put_token(transport_state->cbs, CBS_AUDIENCE, STRING_c_str(device_state->devicesPath), STRING_c_str(newSASToken), on_put_token_complete, operation) != RESULT_OK)
+        {
+            LogError("Failed applying new SAS token to CBS.");
+            free(operation);
+            result = RESULT_FAILURE;
+        }
+        else
+        {
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_224: [A device that is already authenticated shall keep sending and receiving while its refreshed SAS token is being put on the CBS]
+            if (device_state->cbs_state != CBS_STATE_AUTHENTICATED)
+            {
+                device_state->cbs_state = CBS_STATE_AUTH_IN_PROGRESS;
+            }
+            device_state->current_sas_token_create_time = sas_token_create_time;
+            device_state->last_put_token_time = sas_token_create_time;
+            device_state->put_token_operation = operation;
+            DList_InsertTailList(&transport_state->pending_put_tokens, &operation->entry);
+            result = RESULT_OK;
+        }
     }
 
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_145: [Each new SAS token created shall be deleted from memory immediately after sending it to CBS]
@@ -811,9 +1030,9 @@ static int startAuthentication(AMQP_TRANSPORT_INSTANCE* transport_state)
     return result;
 }
 
-static int verifyAuthenticationTimeout(AMQP_TRANSPORT_INSTANCE* transport_state)
+static int verifyAuthenticationTimeout(AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
-    return ((getSecondsSinceEpoch() - transport_state->current_sas_token_create_time) * 1000 >= transport_state->cbs_request_timeout) ? RESULT_TIMEOUT : RESULT_OK;
+    return ((getSecondsSinceEpoch() - device_state->current_sas_token_create_time) * 1000 >= device_state->transport_state->cbs_request_timeout) ? RESULT_TIMEOUT : RESULT_OK;
 }
 
 static void attachDeviceClientTypeToLink(LINK_HANDLE link)
@@ -870,15 +1089,19 @@ static void attachDeviceClientTypeToLink(LINK_HANDLE link)
     }
 }
 
-static void destroyEventSender(AMQP_TRANSPORT_INSTANCE* transport_state)
+static void destroyEventSender(AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
-    if (transport_state->message_sender != NULL)
+    if (device_state->message_sender != NULL)
     {
-        messagesender_destroy(transport_state->message_sender);
-        transport_state->message_sender = NULL;
+        messagesender_destroy(device_state->message_sender);
+        device_state->message_sender = NULL;
 
-        link_destroy(transport_state->sender_link);
-        transport_state->sender_link = NULL;
+        link_destroy(device_state->sender_link);
+        device_state->sender_link = NULL;
+
+        // Nothing is left unsettled on a link that is gone.
+        device_state->unsettled_events = 0;
+        device_state->unsettled_batches = 0;
     }
 }
 
@@ -887,51 +1110,52 @@ void on_event_sender_state_changed(void* context, MESSAGE_SENDER_STATE new_state
 	LogInfo("Event sender state changed [%d->%d]", previous_state, new_state);
 }
 
-static int createEventSender(AMQP_TRANSPORT_INSTANCE* transport_state)
+static int createEventSender(AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
     int result = RESULT_FAILURE;
 
-    if (transport_state->message_sender == NULL)
+    if (device_state->message_sender == NULL)
     {
         AMQP_VALUE source = NULL;
         AMQP_VALUE target = NULL;
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_068: [IoTHubTransportAMQP_DoWork shall create the AMQP link for sending messages using 'source' as "ingress", target as the IoT hub FQDN, link name as "sender-link" and role as 'role_sender'] 
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_068: [IoTHubTransportAMQP_DoWork shall create the AMQP link for sending messages using 'source' as "ingress", target as the IoT hub FQDN, link name as "sender-link-" + deviceId and role as 'role_sender'] 
         if ((source = messaging_create_source(MESSAGE_SENDER_SOURCE_ADDRESS)) == NULL)
         {
             LogError("Failed creating AMQP messaging source attribute.");
         }
-        else if ((target = messaging_create_target(STRING_c_str(transport_state->targetAddress))) == NULL)
+        else if ((target = messaging_create_target(STRING_c_str(device_state->targetAddress))) == NULL)
         {
             LogError("Failed creating AMQP messaging target attribute.");
         }
-        else if ((transport_state->sender_link = link_create(transport_state->session, MESSAGE_SENDER_LINK_NAME, role_sender, source, target)) == NULL)
+        else if ((device_state->sender_link = link_create(device_state->transport_state->session, STRING_c_str(device_state->senderLinkName), role_sender, source, target)) == NULL)
         {
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_069: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for sending messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_069: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for sending messages, the function shall fail and return immediately, flagging the links of that device to be re-established] 
             LogError("Failed creating AMQP link for message sender.");
         }
         else
         {
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_119: [IoTHubTransportAMQP_DoWork shall apply a default value of 65536 for the parameter 'Link MAX message size']
-            if (link_set_max_message_size(transport_state->sender_link, MESSAGE_SENDER_MAX_LINK_SIZE) != RESULT_OK)
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_220: [IoTHubTransportAMQP_DoWork shall apply the values of the options "sender_max_link_size" and "receiver_max_link_size", when set, instead of the defaults to the links it creates]
+            if (link_set_max_message_size(device_state->sender_link, device_state->transport_state->sender_max_link_size) != RESULT_OK)
             {
                 LogError("Failed setting AMQP link max message size.");
             }
 
-            attachDeviceClientTypeToLink(transport_state->sender_link);
+            attachDeviceClientTypeToLink(device_state->sender_link);
 
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_070: [IoTHubTransportAMQP_DoWork shall create the AMQP message sender using messagesender_create() AMQP API] 
-            if ((transport_state->message_sender = messagesender_create(transport_state->sender_link, on_event_sender_state_changed, (void*)transport_state, NULL)) == NULL)
+            if ((device_state->message_sender = messagesender_create(device_state->sender_link, on_event_sender_state_changed, (void*)device_state, NULL)) == NULL)
             {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_071: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message sender instance fails to be created, flagging the connection to be re-established] 
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_071: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message sender instance fails to be created, flagging the links of that device to be re-established] 
                 LogError("Could not allocate AMQP message sender");
             }
             else
             {
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_072: [IoTHubTransportAMQP_DoWork shall open the AMQP message sender using messagesender_open() AMQP API] 
-                if (messagesender_open(transport_state->message_sender) != RESULT_OK)
+                if (messagesender_open(device_state->message_sender) != RESULT_OK)
                 {
-                    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_073: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message sender instance fails to be opened, flagging the connection to be re-established] 
+                    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_073: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message sender instance fails to be opened, flagging the links of that device to be re-established] 
                     LogError("Failed opening the AMQP message sender.");
                 }
                 else
@@ -950,24 +1174,24 @@ static int createEventSender(AMQP_TRANSPORT_INSTANCE* transport_state)
     return result;
 }
 
-static int destroyMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state)
+static int destroyMessageReceiver(AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
     int result = RESULT_FAILURE;
 
-    if (transport_state->message_receiver != NULL)
+    if (device_state->message_receiver != NULL)
     {
-        if (messagereceiver_close(transport_state->message_receiver) != RESULT_OK)
+        if (messagereceiver_close(device_state->message_receiver) != RESULT_OK)
         {
             LogError("Failed closing the AMQP message receiver.");
         }
 
-        messagereceiver_destroy(transport_state->message_receiver);
+        messagereceiver_destroy(device_state->message_receiver);
 
-        transport_state->message_receiver = NULL;
+        device_state->message_receiver = NULL;
 
-        link_destroy(transport_state->receiver_link);
+        link_destroy(device_state->receiver_link);
 
-        transport_state->receiver_link = NULL;
+        device_state->receiver_link = NULL;
 
         result = RESULT_OK;
     }
@@ -975,17 +1199,17 @@ static int destroyMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state)
     return result;
 }
 
-static int createMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state, IOTHUB_CLIENT_LL_HANDLE iothub_client_handle)
+static int createMessageReceiver(AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
     int result = RESULT_FAILURE;
 
-    if (transport_state->message_receiver == NULL)
+    if (device_state->message_receiver == NULL)
     {
         AMQP_VALUE source = NULL;
         AMQP_VALUE target = NULL;
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_074: [IoTHubTransportAMQP_DoWork shall create the AMQP link for receiving messages using 'source' as messageReceiveAddress, target as the "ingress-rx", link name as "receiver-link" and role as 'role_receiver'] 
-        if ((source = messaging_create_source(STRING_c_str(transport_state->messageReceiveAddress))) == NULL)
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_074: [IoTHubTransportAMQP_DoWork shall create the AMQP link for receiving messages using 'source' as messageReceiveAddress, target as the "ingress-rx", link name as "receiver-link-" + deviceId and role as 'role_receiver'] 
+        if ((source = messaging_create_source(STRING_c_str(device_state->messageReceiveAddress))) == NULL)
         {
             LogError("Failed creating AMQP message receiver source attribute.");
         }
@@ -993,40 +1217,40 @@ static int createMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state, IOTHU
         {
             LogError("Failed creating AMQP message receiver target attribute.");
         }
-        else if ((transport_state->receiver_link = link_create(transport_state->session, MESSAGE_RECEIVER_LINK_NAME, role_receiver, source, target)) == NULL)
+        else if ((device_state->receiver_link = link_create(device_state->transport_state->session, STRING_c_str(device_state->receiverLinkName), role_receiver, source, target)) == NULL)
         {
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_075: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for receiving messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_075: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for receiving messages, the function shall fail and return immediately, flagging the links of that device to be re-established] 
             LogError("Failed creating AMQP link for message receiver.");
         }
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_076: [IoTHubTransportAMQP_DoWork shall set the receiver link settle mode as receiver_settle_mode_first] 
-        else if (link_set_rcv_settle_mode(transport_state->receiver_link, receiver_settle_mode_first) != RESULT_OK)
+        else if (link_set_rcv_settle_mode(device_state->receiver_link, receiver_settle_mode_first) != RESULT_OK)
         {
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_141: [If IoTHubTransportAMQP_DoWork fails to set the settle mode on the AMQP link for receiving messages, the function shall fail and return immediately, flagging the connection to be re-stablished]
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_141: [If IoTHubTransportAMQP_DoWork fails to set the settle mode on the AMQP link for receiving messages, the function shall fail and return immediately, flagging the links of that device to be re-established]
             LogError("Failed setting AMQP link settle mode for message receiver.");
         }
         else
         {
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_119: [IoTHubTransportAMQP_DoWork shall apply a default value of 65536 for the parameter 'Link MAX message size']
-            if (link_set_max_message_size(transport_state->receiver_link, MESSAGE_RECEIVER_MAX_LINK_SIZE) != RESULT_OK)
+            if (link_set_max_message_size(device_state->receiver_link, device_state->transport_state->receiver_max_link_size) != RESULT_OK)
             {
                 LogError("Failed setting AMQP link max message size for message receiver.");
             }
 
-            attachDeviceClientTypeToLink(transport_state->receiver_link);
+            attachDeviceClientTypeToLink(device_state->receiver_link);
 
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_077: [IoTHubTransportAMQP_DoWork shall create the AMQP message receiver using messagereceiver_create() AMQP API] 
-            if ((transport_state->message_receiver = messagereceiver_create(transport_state->receiver_link, NULL, NULL)) == NULL)
+            if ((device_state->message_receiver = messagereceiver_create(device_state->receiver_link, NULL, NULL)) == NULL)
             {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_078: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message receiver instance fails to be created, flagging the connection to be re-established] 
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_078: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message receiver instance fails to be created, flagging the links of that device to be re-established] 
                 LogError("Could not allocate AMQP message receiver.");
             }
             else
             {
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_079: [IoTHubTransportAMQP_DoWork shall open the AMQP message receiver using messagereceiver_open() AMQP API, passing a callback function for handling C2D incoming messages] 
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_123: [IoTHubTransportAMQP_DoWork shall create each AMQP message_receiver passing the 'on_message_received' as the callback function] 
-                if (messagereceiver_open(transport_state->message_receiver, on_message_received, (const void*)iothub_client_handle) != RESULT_OK)
+                if (messagereceiver_open(device_state->message_receiver, on_message_received, (const void*)device_state->iothub_client_handle) != RESULT_OK)
                 {
-                    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_080: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message receiver instance fails to be opened, flagging the connection to be re-established] 
+                    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_080: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message receiver instance fails to be opened, flagging the links of that device to be re-established] 
                     LogError("Failed opening the AMQP message receiver.");
                 }
                 else
@@ -1045,12 +1269,20 @@ static int createMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state, IOTHU
     return result;
 }
 
-static int sendPendingEvents(AMQP_TRANSPORT_INSTANCE* transport_state)
+static bool isUnsettledTransferLimitReached(AMQP_TRANSPORT_DEVICE_STATE* device_state, size_t unsettled_transfers)
+{
+    size_t max_unsettled_transfers = device_state->transport_state->max_unsettled_transfers;
+    return (max_unsettled_transfers != 0 && unsettled_transfers >= max_unsettled_transfers) ? true : false;
+}
+
+static int sendPendingEvents(AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
     int result = RESULT_OK;
     IOTHUB_MESSAGE_LIST* message;
 
-    while ((message = getNextEventToSend(transport_state)) != NULL)
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_216: [IoTHubTransportAMQP_DoWork shall not take more events from waitingToSend once "max_unsettled_transfers" events sent one by one are unsettled, unless "max_unsettled_transfers" is 0]
+    while (!isUnsettledTransferLimitReached(device_state, device_state->unsettled_events) &&
+        (message = getNextEventToSend(device_state)) != NULL)
     {
         result = RESULT_FAILURE;
 
@@ -1061,7 +1293,7 @@ static int sendPendingEvents(AMQP_TRANSPORT_INSTANCE* transport_state)
         bool is_message_error = false;
 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_086: [IoTHubTransportAMQP_DoWork shall move queued events to an "in-progress" list right before processing them for sending]
-		trackEventInProgress(message, transport_state);
+		trackEventInProgress(message, device_state);
 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_087: [If the event contains a message of type IOTHUBMESSAGE_BYTEARRAY, IoTHubTransportAMQP_DoWork shall obtain its char* representation and size using IoTHubMessage_GetByteArray()] 
         if (contentType == IOTHUBMESSAGE_BYTEARRAY &&
@@ -1115,13 +1347,25 @@ static int sendPendingEvents(AMQP_TRANSPORT_INSTANCE* transport_state)
                 }
                 else
                 {
+                    // counted before, as on_message_send_complete can be called from within messagesender_send()
+                    message->sender = device_state;
+                    device_state->unsettled_events++;
+
                     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_097: [IoTHubTransportAMQP_DoWork shall pass the encoded AMQP message to AMQP for sending (along with on_message_send_complete callback) using messagesender_send()] 
-                    if (messagesender_send(transport_state->message_sender, amqp_message, on_message_send_complete, message) != RESULT_OK)
+                    if (messagesender_send(device_state->message_sender, amqp_message, on_message_send_complete, message) != RESULT_OK)
                     {
                         LogError("Failed sending the AMQP message.");
+                        message->sender = NULL;
+                        device_state->unsettled_events--;
                     }
                     else
                     {
+                        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_199: [If messagesender_send() succeeds, IoTHubTransportAMQP_DoWork shall call IoTHubClient_LL_SendStarted with the IOTHUB_CLIENT_LL_HANDLE that queued the event (message->owner), the event, a count of 1 and the size of the body of the AMQP message, unless the event was already completed from within messagesender_send()]
+                        // The event is the last one in progress until it is completed (and freed); only the pointers are compared.
+                        if (device_state->inProgress.Blink == &message->entry)
+                        {
+                            IoTHubClient_LL_SendStarted(message->owner, message, 1, messageContentSize);
+                        }
                         result = RESULT_OK;
                     }
                 }
@@ -1144,10 +1388,10 @@ static int sendPendingEvents(AMQP_TRANSPORT_INSTANCE* transport_state)
             }
             else
             {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_111: [If message_create() fails, IoTHubTransportAMQP_DoWork notify the failure, roll back the event to waitToSent list and return]
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_112: [If message_add_body_amqp_data() fails, IoTHubTransportAMQP_DoWork notify the failure, roll back the event to waitToSent list and return]
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_113: [If messagesender_send() fails, IoTHubTransportAMQP_DoWork notify the failure, roll back the event to waitToSent list and return]
-                rollEventBackToWaitList(message, transport_state);
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_111: [If message_create() fails, IoTHubTransportAMQP_DoWork notify the failure, roll back the event to the head of the waitToSent list and return]
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_112: [If message_add_body_amqp_data() fails, IoTHubTransportAMQP_DoWork notify the failure, roll back the event to the head of the waitToSent list and return]
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_113: [If messagesender_send() fails, IoTHubTransportAMQP_DoWork notify the failure, roll back the event to the head of the waitToSent list and return]
+                rollEventBackToWaitList(message, device_state);
                 break;
             }
         }
@@ -1156,25 +1400,324 @@ static int sendPendingEvents(AMQP_TRANSPORT_INSTANCE* transport_state)
     return result;
 }
 
-static bool isSasTokenRefreshRequired(AMQP_TRANSPORT_INSTANCE* transport_state)
+static void rollEventBatchBackToWaitList(AMQP_EVENT_BATCH* batch, AMQP_TRANSPORT_DEVICE_STATE* device_state)
+{
+    size_t i = batch->count;
+
+    // The events go back to the head of waitingToSend last first, so that they keep their order.
+    while (i > 0)
+    {
+        i--;
+        rollEventBackToWaitList(batch->events[i], device_state);
+    }
+}
+
+static int sendPendingEventBatches(AMQP_TRANSPORT_DEVICE_STATE* device_state)
+{
+    int result = RESULT_OK;
+    AMQP_TRANSPORT_INSTANCE* transport_state = device_state->transport_state;
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_214: [IoTHubTransportAMQP_DoWork shall create the encoder of the batched events with AmqpEventEncoder_Create the first time it has events to batch; if that fails, IoTHubTransportAMQP_DoWork shall leave the events in waitingToSend and return]
+    if (transport_state->event_encoder == NULL &&
+        getNextEventToSend(device_state) != NULL &&
+        (transport_state->event_encoder = AmqpEventEncoder_Create()) == NULL)
+    {
+        LogError("Failed creating the encoder of the batched events.");
+        result = RESULT_FAILURE;
+    }
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_218: [IoTHubTransportAMQP_DoWork shall not take more events from waitingToSend once "max_unsettled_transfers" batched messages are unsettled, unless "max_unsettled_transfers" is 0]
+    while (result == RESULT_OK &&
+        !isUnsettledTransferLimitReached(device_state, device_state->unsettled_batches) &&
+        getNextEventToSend(device_state) != NULL)
+    {
+        AMQP_EVENT_BATCH* batch;
+        MESSAGE_HANDLE batched_message = NULL;
+
+        if ((batch = (AMQP_EVENT_BATCH*)malloc(sizeof(AMQP_EVENT_BATCH) + transport_state->batching_max_events * sizeof(IOTHUB_MESSAGE_LIST*))) == NULL)
+        {
+            LogError("Failed allocating a batch of events.");
+            result = RESULT_FAILURE;
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_201: [If the option "Batching" is true, IoTHubTransportAMQP_DoWork shall create one AMQP message with message_create() and set its format to 0x80013700 with message_set_message_format() for every batch of events]
+        else if ((batched_message = message_create()) == NULL ||
+            message_set_message_format(batched_message, AMQP_BATCHING_FORMAT_CODE) != 0)
+        {
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_205: [If creating the batched message, adding an event to it or messagesender_send() fails, IoTHubTransportAMQP_DoWork shall roll back the events of the batch to the head of the waitToSent list, in order, and return]
+            LogError("Failed creating the batched AMQP message.");
+            free(batch);
+            result = RESULT_FAILURE;
+        }
+        else
+        {
+            IOTHUB_MESSAGE_LIST* message;
+            size_t batch_size = 0;
+
+            batch->device_state = device_state;
+            batch->events = (IOTHUB_MESSAGE_LIST**)(batch + 1);
+            batch->count = 0;
+
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_204: [A batch shall take the events from the head of waitingToSend, up to "batching_max_events" events and up to "batching_max_size" bytes; an event that does not fit in a batch on its own shall be sent alone in a batch]
+            while (batch->count < transport_state->batching_max_events &&
+                (message = getNextEventToSend(device_state)) != NULL)
+            {
+                BINARY_DATA encoded_event;
+                AMQPEVENTENCODER_RESULT encode_result;
+
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_203: [Each batched event shall be written with AmqpEventEncoder_Encode, straight from the content and the properties of the event, and added to the batched message with message_add_body_amqp_data]
+                if ((encode_result = AmqpEventEncoder_Encode(transport_state->event_encoder, message->messageHandle, &encoded_event.bytes, &encoded_event.length)) != AMQPEVENTENCODER_OK)
+                {
+                    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_202: [If AmqpEventEncoder_Encode returns AMQPEVENTENCODER_INVALID_MESSAGE, the event shall be completed with IOTHUB_BATCHSTATE_FAILED and left out of the batch]
+                    if (encode_result == AMQPEVENTENCODER_INVALID_MESSAGE)
+                    {
+                        LogError("Failed encoding an event of a batch, completing it as failed.");
+                        trackEventInProgress(message, device_state);
+                        on_message_send_complete(message, MESSAGE_SEND_ERROR);
+                    }
+                    else
+                    {
+                        LogError("Failed encoding an event of a batch.");
+                        result = RESULT_FAILURE;
+                        break;
+                    }
+                }
+                else if (batch->count > 0 &&
+                    batch_size + encoded_event.length + BATCHED_EVENT_SECTION_OVERHEAD > transport_state->batching_max_size)
+                {
+                    // Left in waitingToSend for the next batch.
+                    break;
+                }
+                // message_add_body_amqp_data() copies the bytes, so the buffer of the encoder is reused for the next event.
+                else if (message_add_body_amqp_data(batched_message, encoded_event) != RESULT_OK)
+                {
+                    LogError("Failed adding an event to the batched AMQP message.");
+                    result = RESULT_FAILURE;
+                    break;
+                }
+                else
+                {
+                    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_086: [IoTHubTransportAMQP_DoWork shall move queued events to an "in-progress" list right before processing them for sending]
+                    trackEventInProgress(message, device_state);
+                    batch->events[batch->count++] = message;
+                    batch_size += encoded_event.length + BATCHED_EVENT_SECTION_OVERHEAD;
+                }
+            }
+
+            if (batch->count == 0)
+            {
+                free(batch);
+            }
+            else if (result != RESULT_OK)
+            {
+                rollEventBatchBackToWaitList(batch, device_state);
+                free(batch);
+            }
+            else
+            {
+                // kept aside, as on_event_batch_send_complete frees the batch
+                IOTHUB_MESSAGE_LIST* first_event = batch->events[0];
+                size_t batch_count = batch->count;
+                PDLIST_ENTRY last_event_entry = &batch->events[batch->count - 1]->entry;
+
+                // counted before, as on_event_batch_send_complete can be called from within messagesender_send()
+                device_state->unsettled_batches++;
+
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_209: [IoTHubTransportAMQP_DoWork shall pass the batched message to messagesender_send() along with on_event_batch_send_complete as callback]
+                if (messagesender_send(device_state->message_sender, batched_message, on_event_batch_send_complete, batch) != RESULT_OK)
+                {
+                    LogError("Failed sending the batched AMQP message.");
+                    device_state->unsettled_batches--;
+                    rollEventBatchBackToWaitList(batch, device_state);
+                    free(batch);
+                    result = RESULT_FAILURE;
+                }
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_208: [If messagesender_send() succeeds for a batch, IoTHubTransportAMQP_DoWork shall call IoTHubClient_LL_SendStarted with the owner of the events, the first event of the batch, the number of batched events and the size of the batch, unless the batch was already completed from within messagesender_send()]
+                else if (device_state->inProgress.Blink == last_event_entry)
+                {
+                    IoTHubClient_LL_SendStarted(first_event->owner, first_event, batch_count, batch_size);
+                }
+            }
+        }
+
+        if (batched_message != NULL)
+        {
+            // It can be destroyed because AMQP keeps a clone of the message.
+            message_destroy(batched_message);
+        }
+    }
+
+    return result;
+}
+
+static bool isSasTokenRefreshRequired(AMQP_TRANSPORT_DEVICE_STATE* device_state)
 {
-	if (transport_state->deviceSasToken != NULL)
+	if (device_state->deviceSasToken != NULL)
 	{
 		return false;
 	}
 	else
 	{
-    return ((getSecondsSinceEpoch() - transport_state->current_sas_token_create_time) >= (transport_state->sas_token_refresh_time / 1000)) ? true : false;
+    size_t now = getSecondsSinceEpoch();
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_232: [After the put of a refreshed SAS token failed or timed out, IoTHubTransportAMQP_DoWork shall not put a new SAS token for the device until 'cbs_request_timeout' milliseconds have passed since that put was started]
+    if (device_state->current_sas_token_create_time < device_state->last_put_token_time &&
+        (now - device_state->last_put_token_time) * 1000 < device_state->transport_state->cbs_request_timeout)
+    {
+        return false;
+    }
+
+    return ((now - device_state->current_sas_token_create_time) >= (device_state->transport_state->sas_token_refresh_time / 1000)) ? true : false;
 }
 }
 
+// The completion of a put still in flight must not touch the device anymore.
+static void abandonPutToken(AMQP_TRANSPORT_DEVICE_STATE* device_state)
+{
+    if (device_state->put_token_operation != NULL)
+    {
+        device_state->put_token_operation->device_state = NULL;
+        device_state->put_token_operation = NULL;
+    }
+}
+
+// Destroys the links of one device and puts its in-progress events back on its waitingToSend list; the connection and the SAS token are kept.
+static void destroyDeviceLinks(AMQP_TRANSPORT_DEVICE_STATE* device_state)
+{
+    destroyMessageReceiver(device_state);
+    destroyEventSender(device_state);
+    rollEventsBackToWaitList(device_state);
+}
+
+// Same as destroyDeviceLinks, and the device puts a new SAS token.
+static void resetDevice(AMQP_TRANSPORT_DEVICE_STATE* device_state)
+{
+    abandonPutToken(device_state);
+
+    destroyDeviceLinks(device_state);
+    device_state->cbs_state = CBS_STATE_IDLE;
+}
+
 static void prepareForConnectionRetry(AMQP_TRANSPORT_INSTANCE* transport_state)
 {
-	destroyMessageReceiver(transport_state);
-	destroyEventSender(transport_state);
+    PDLIST_ENTRY entry;
+
+    for (entry = transport_state->registered_devices.Flink; entry != &transport_state->registered_devices; entry = entry->Flink)
+    {
+        destroyDeviceLinks(containingRecord(entry, AMQP_TRANSPORT_DEVICE_STATE, entry));
+    }
+
     destroyConnection(transport_state);
 	transport_state->connection_state = AMQP_MANAGEMENT_STATE_IDLE;
-    rollEventsBackToWaitList(transport_state);
+}
+
+static int doWorkForDevice(AMQP_TRANSPORT_DEVICE_STATE* device_state)
+{
+    int result = RESULT_OK;
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_225: [If the put of a SAS token fails and the device is not authenticated by a previous SAS token that is still valid, IoTHubTransportAMQP_DoWork shall destroy the links of that device only, return its in-progress events to its waitingToSend list and put a new SAS token for it; the connection and the other devices shall not be affected]
+    if (device_state->cbs_state == CBS_STATE_AUTH_FAILED)
+    {
+        resetDevice(device_state);
+    }
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_081: [IoTHubTransportAMQP_DoWork shall put a new SAS token if the one has not been out already, or if the previous one failed to be put due to timeout of cbs_put_token().]
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_082: [IoTHubTransportAMQP_DoWork shall refresh the SAS token if the current token has been used for more than 'sas_token_refresh_time' milliseconds]
+    if ((device_state->cbs_state == CBS_STATE_IDLE || isSasTokenRefreshRequired(device_state)) &&
+        device_state->put_token_operation == NULL &&
+        startAuthentication(device_state) != RESULT_OK)
+    {
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_146: [If the SAS token fails to be sent to CBS (cbs_put_token), IoTHubTransportAMQP_DoWork shall skip that device and try again on its next call]
+        LogError("Failed authenticating a device within CBS.");
+    }
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_084: [IoTHubTransportAMQP_DoWork shall wait for 'cbs_request_timeout' milliseconds for the cbs_put_token() to complete before resetting that device as if the put had failed]
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_226: [IoTHubTransportAMQP_DoWork shall also handle the put of a refreshed SAS token that does not complete within 'cbs_request_timeout' milliseconds as failed]
+    else if (device_state->put_token_operation != NULL &&
+        verifyAuthenticationTimeout(device_state) == RESULT_TIMEOUT)
+    {
+        LogError("The put of the SAS token of a device timed out.");
+        if (isPreviousSasTokenValid(device_state->put_token_operation))
+        {
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_230: [If the put of a refreshed SAS token fails or times out while the previous SAS token of the device is still valid, the device shall stay authenticated and keep its links, and IoTHubTransportAMQP_DoWork shall put a new SAS token for it]
+            device_state->current_sas_token_create_time = device_state->put_token_operation->previous_sas_token_create_time;
+            abandonPutToken(device_state);
+        }
+        else
+        {
+            resetDevice(device_state);
+        }
+    }
+
+    if (device_state->cbs_state == CBS_STATE_AUTHENTICATED)
+    {
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_121: [IoTHubTransportAMQP_DoWork shall create an AMQP message_receiver if transport_state->message_receive is NULL and transport_state->receive_messages is true] 
+        if (device_state->receive_messages == true &&
+            device_state->message_receiver == NULL &&
+            createMessageReceiver(device_state) != RESULT_OK)
+        {
+            LogError("Failed creating AMQP transport message receiver.");
+            result = RESULT_FAILURE;
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_122: [IoTHubTransportAMQP_DoWork shall destroy the transport_state->message_receiver (and set it to NULL) if it exists and transport_state->receive_messages is false] 
+        else if (device_state->receive_messages == false &&
+            device_state->message_receiver != NULL &&
+            destroyMessageReceiver(device_state) != RESULT_OK)
+        {
+            LogError("Failed destroying AMQP transport message receiver.");
+        }
+
+        if (device_state->message_sender == NULL &&
+            createEventSender(device_state) != RESULT_OK)
+        {
+            LogError("Failed creating AMQP transport event sender.");
+            result = RESULT_FAILURE;
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_200: [If the option "Batching" is true, IoTHubTransportAMQP_DoWork shall send the pending events in batches instead of one by one]
+        else if ((device_state->transport_state->batching ? sendPendingEventBatches(device_state) : sendPendingEvents(device_state)) != RESULT_OK)
+        {
+            LogError("AMQP transport failed sending events.");
+        }
+    }
+
+    return result;
+}
+
+static void destroyDeviceState(AMQP_TRANSPORT_DEVICE_STATE* device_state)
+{
+    if (device_state->deviceSasToken != NULL)
+        STRING_delete(device_state->deviceSasToken);
+    if (device_state->deviceKey != NULL)
+        STRING_delete(device_state->deviceKey);
+    if (device_state->receiverLinkName != NULL)
+        STRING_delete(device_state->receiverLinkName);
+    if (device_state->senderLinkName != NULL)
+        STRING_delete(device_state->senderLinkName);
+    if (device_state->messageReceiveAddress != NULL)
+        STRING_delete(device_state->messageReceiveAddress);
+    if (device_state->targetAddress != NULL)
+        STRING_delete(device_state->targetAddress);
+    if (device_state->devicesPath != NULL)
+        STRING_delete(device_state->devicesPath);
+
+    free(device_state);
+}
+
+static void unregisterDevice(AMQP_TRANSPORT_DEVICE_STATE* device_state)
+{
+    AMQP_TRANSPORT_INSTANCE* transport_state = device_state->transport_state;
+
+    destroyEventSender(device_state);
+    destroyMessageReceiver(device_state);
+    rollEventsBackToWaitList(device_state);
+    abandonPutToken(device_state);
+
+    if (transport_state->next_device_to_serve == &device_state->entry)
+    {
+        transport_state->next_device_to_serve = device_state->entry.Flink;
+    }
+
+    DeviceRegistry_Remove(transport_state->device_registry, device_state);
+    DList_RemoveEntryList(&device_state->entry);
+    destroyDeviceState(device_state);
 }
 
 
@@ -1184,31 +1727,18 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
 {
     AMQP_TRANSPORT_INSTANCE* transport_state = NULL;
     bool cleanup_required = false;
-    size_t deviceIdLength;
 
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_005: [If parameter config (or its fields) is NULL then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-    if (config == NULL || config->upperConfig == NULL || config->waitingToSend == NULL)
+    if (config == NULL || config->upperConfig == NULL)
     {
         LogError("IoTHub AMQP client transport null configuration parameter.");
     }
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_006: [IoTHubTransportAMQP_Create shall fail and return NULL if any fields of the config structure are NULL.]
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_03_001: [IoTHubTransportAMQP_Create shall fail and return NULL if both deviceKey & deviceSasToken fields are NOT NULL.]
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_192: [IoTHubTransportAMQP_Create shall ignore the device fields of the config structure and the waitingToSend list; devices are added with IoTHubTransportAMQP_Register.]
     else if (config->upperConfig->protocol == NULL)
     {
         LogError("Invalid configuration (NULL protocol detected)");
     }
-    else if (config->upperConfig->deviceId == NULL)
-    {
-        LogError("Invalid configuration (NULL deviceId detected)");
-    }
-    else if (config->upperConfig->deviceKey == NULL && config->upperConfig->deviceSasToken == NULL)
-    {
-        LogError("Invalid configuration (NULL deviceKey/deviceSasToken detected)");
-    }
-    else if (config->upperConfig->deviceKey != NULL && config->upperConfig->deviceSasToken != NULL)
-    {
-        LogError("Invalid configuration (Both deviceKey and deviceSasToken are defined)");
-    }
     else if (config->upperConfig->iotHubName == NULL)
     {
         LogError("Invalid configuration (NULL iotHubName detected)");
@@ -1217,29 +1747,11 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
     {
         LogError("Invalid configuration (NULL iotHubSuffix detected)");
     }
-    else if (!config->waitingToSend)
-    {
-        LogError("Invalid configuration (NULL waitingToSend list detected)");
-    }
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_008: [IoTHubTransportAMQP_Create shall fail and return NULL if any config field of type string is zero length.] 
-    else if ((deviceIdLength = strlen(config->upperConfig->deviceId)) == 0 ||
-        (strlen(config->upperConfig->iotHubName) == 0) ||
+    else if ((strlen(config->upperConfig->iotHubName) == 0) ||
         (strlen(config->upperConfig->iotHubSuffix) == 0))
     {
-		LogError("Zero-length config parameter (deviceId, iotHubName or iotHubSuffix)");
-    }
-	else if ((config->upperConfig->deviceKey != NULL) && (strlen(config->upperConfig->deviceKey) == 0))
-	{
-		LogError("Zero-length config parameter (deviceKey)");
-	}
-	else if ((config->upperConfig->deviceSasToken != NULL) && (strlen(config->upperConfig->deviceSasToken) == 0))
-	{
-		LogError("Zero-length config parameter (deviceSasToken)");
-	}
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_007: [IoTHubTransportAMQP_Create shall fail and return NULL if the deviceId length is greater than 128.]
-    else if (deviceIdLength > 128U)
-    {
-        LogError("deviceId is too long");
+		LogError("Zero-length config parameter (iotHubName or iotHubSuffix)");
     }
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_134: [IoTHubTransportAMQP_Create shall fail and return NULL if the combined length of config->iotHubName and config->iotHubSuffix exceeds 254 bytes (RFC1035)]
     else if ((strlen(config->upperConfig->iotHubName) + strlen(config->upperConfig->iotHubSuffix)) > (RFC1035_MAX_FQDN_LENGTH - 1))
@@ -1259,35 +1771,35 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
         {
             transport_state->iotHubHostFqdn = NULL;
             transport_state->iotHubPort = DEFAULT_IOTHUB_AMQP_PORT;
-            transport_state->deviceKey = NULL;
-			transport_state->deviceSasToken = NULL;
-            transport_state->devicesPath = NULL;
-            transport_state->messageReceiveAddress = NULL;
             transport_state->sasTokenKeyName = NULL;
-            transport_state->targetAddress = NULL;
-            transport_state->waitingToSend = config->waitingToSend;
+            transport_state->device_registry = NULL;
 
             transport_state->cbs = NULL;
-            transport_state->cbs_state = CBS_STATE_IDLE;
-            transport_state->current_sas_token_create_time = 0;
+            DList_InitializeListHead(&transport_state->pending_put_tokens);
             transport_state->connection = NULL;
             transport_state->connection_state = AMQP_MANAGEMENT_STATE_IDLE;
             transport_state->connection_establish_time = 0;
-            transport_state->iothub_client_handle = NULL;
-            transport_state->receive_messages = false;
-            transport_state->message_receiver = NULL;
-            transport_state->message_sender = NULL;
-            transport_state->receiver_link = NULL;
             transport_state->sasl_io = NULL;
             transport_state->sasl_mechanism = NULL;
-            transport_state->sender_link = NULL;
             transport_state->session = NULL;
             transport_state->tls_io = NULL;
             transport_state->tls_io_transport_provider = getTLSIOTransport;
-            transport_state->isRegistered = false;
 
-            transport_state->waitingToSend = config->waitingToSend;
-            DList_InitializeListHead(&transport_state->inProgress);
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_210: [IoTHubTransportAMQP_Create shall not batch events by default, and shall set batching_max_events to 100 and batching_max_size to 261120 (bytes).]
+            transport_state->batching = false;
+            transport_state->batching_max_events = DEFAULT_BATCHING_MAX_EVENTS;
+            transport_state->batching_max_size = DEFAULT_BATCHING_MAX_SIZE;
+            transport_state->event_encoder = NULL;
+
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_215: [IoTHubTransportAMQP_Create shall set incoming_window_size to UINT_MAX, outgoing_window_size to 100, sender_max_link_size to UINT64_MAX, receiver_max_link_size to 65536 and max_unsettled_transfers to 0 (no limit).]
+            transport_state->incoming_window_size = (uint32_t)DEFAULT_INCOMING_WINDOW_SIZE;
+            transport_state->outgoing_window_size = DEFAULT_OUTGOING_WINDOW_SIZE;
+            transport_state->sender_max_link_size = MESSAGE_SENDER_MAX_LINK_SIZE;
+            transport_state->receiver_max_link_size = MESSAGE_RECEIVER_MAX_LINK_SIZE;
+            transport_state->max_unsettled_transfers = DEFAULT_MAX_UNSETTLED_TRANSFERS;
+
+            DList_InitializeListHead(&transport_state->registered_devices);
+            transport_state->next_device_to_serve = &transport_state->registered_devices;
 
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_010: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as iotHubHostFqdn, from the following pieces: config->iotHubName + "." + config->iotHubSuffix.] 
             if ((transport_state->iotHubHostFqdn = concat3Params(config->upperConfig->iotHubName, ".", config->upperConfig->iotHubSuffix)) == NULL)
@@ -1295,49 +1807,17 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
                 LogError("Failed to set transport_state->iotHubHostFqdn.");
                 cleanup_required = true;
             }
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_012: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as devicesPath, from the following parts: host_fqdn + "/devices/" + deviceId.] 
-            else if ((transport_state->devicesPath = concat3Params(STRING_c_str(transport_state->iotHubHostFqdn), "/devices/", config->upperConfig->deviceId)) == NULL)
-            {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_013: [If creating devicesPath fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-                LogError("Failed to allocate transport_state->devicesPath.");
-                cleanup_required = true;
-            }
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_014: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as targetAddress, from the following parts: "amqps://" + devicesPath + "/messages/events".]
-            else if ((transport_state->targetAddress = concat3Params("amqps://", STRING_c_str(transport_state->devicesPath), "/messages/events")) == NULL)
-            {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_015: [If creating the targetAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-                LogError("Failed to allocate transport_state->targetAddress.");
-                cleanup_required = true;
-            }
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_053: [IoTHubTransportAMQP_Create shall define the source address for receiving messages as "amqps://" + devicesPath + "/messages/devicebound", stored in the transport handle as messageReceiveAddress]
-            else if ((transport_state->messageReceiveAddress = concat3Params("amqps://", STRING_c_str(transport_state->devicesPath), "/messages/devicebound")) == NULL)
-            {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_054: [If creating the messageReceiveAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.]
-                LogError("Failed to allocate transport_state->messageReceiveAddress.");
-                cleanup_required = true;
-            }
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_016: [IoTHubTransportAMQP_Create shall initialize handle->sasTokenKeyName with a zero-length STRING_HANDLE instance.] 
             else if ((transport_state->sasTokenKeyName = STRING_new()) == NULL)
             {
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_017: [If IoTHubTransportAMQP_Create fails to initialize handle->sasTokenKeyName with a zero-length STRING the function shall fail and return NULL.] 
                 LogError("Failed to allocate transport_state->sasTokenKeyName.");
                 cleanup_required = true;
-			}
-			else if (config->upperConfig->deviceSasToken != NULL)
-			{
-				if ((transport_state->deviceSasToken = STRING_construct(config->upperConfig->deviceSasToken)) == NULL)
-				{
-					// Codes_SRS_IOTHUBTRANSPORTAMQP_09_019: [If IoTHubTransportAMQP_Create fails to copy config->deviceKey, the function shall fail and return NULL.]
-					LogError("Failed to allocate transport_state->deviceSasToken.");
-					cleanup_required = true;
             }
-			}
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_018: [IoTHubTransportAMQP_Create shall store a copy of config->deviceKey (passed by upper layer) into the transports own deviceKey field.] 
-            else if ((config->upperConfig->deviceKey != NULL) && ((transport_state->deviceKey = STRING_new()) == NULL ||
-                STRING_copy(transport_state->deviceKey, config->upperConfig->deviceKey) != 0))
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_228: [IoTHubTransportAMQP_Create shall call DeviceRegistry_Create to create the index of the registered devices, and shall fail and return NULL if that fails.]
+            else if ((transport_state->device_registry = DeviceRegistry_Create()) == NULL)
             {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_019: [If IoTHubTransportAMQP_Create fails to copy config->deviceKey, the function shall fail and return NULL.]
-                LogError("Failed to allocate transport_state->deviceKey.");
+                LogError("Failed to create the device registry.");
                 cleanup_required = true;
             }
             else
@@ -1356,18 +1836,8 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
 
     if (cleanup_required)
     {
-		if (transport_state->deviceSasToken != NULL)
-			STRING_delete(transport_state->deviceSasToken);
-        if (transport_state->deviceKey != NULL)
-            STRING_delete(transport_state->deviceKey);
         if (transport_state->sasTokenKeyName != NULL)
             STRING_delete(transport_state->sasTokenKeyName);
-        if (transport_state->targetAddress != NULL)
-            STRING_delete(transport_state->targetAddress);
-        if (transport_state->messageReceiveAddress != NULL)
-            STRING_delete(transport_state->messageReceiveAddress);
-        if (transport_state->devicesPath != NULL)
-            STRING_delete(transport_state->devicesPath);
         if (transport_state->iotHubHostFqdn != NULL)
             STRING_delete(transport_state->iotHubHostFqdn);
 
@@ -1386,12 +1856,14 @@ static void IoTHubTransportAMQP_Destroy(TRANSPORT_LL_HANDLE handle)
         AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_024: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_sender.]
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_029 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP link.]
-        destroyEventSender(transport_state);
-
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_025: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_receiver.] 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_029 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP link.]
-        destroyMessageReceiver(transport_state);
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_036 : [IoTHubTransportAMQP_Destroy shall return the remaining items in inProgress to waitingToSend list.]
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_193: [IoTHubTransportAMQP_Destroy shall unregister the devices that are still registered.]
+        while (transport_state->registered_devices.Flink != &transport_state->registered_devices)
+        {
+            unregisterDevice(containingRecord(transport_state->registered_devices.Flink, AMQP_TRANSPORT_DEVICE_STATE, entry));
+        }
 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_027 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP cbs instance]
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_030 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP session.]
@@ -1400,16 +1872,16 @@ static void IoTHubTransportAMQP_Destroy(TRANSPORT_LL_HANDLE handle)
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_033 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP SASL mechanism.]
         destroyConnection(transport_state);
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_035 : [IoTHubTransportAMQP_Destroy shall delete its internally - set parameters(deviceKey, targetAddress, devicesPath, sasTokenKeyName).]
-        STRING_delete(transport_state->targetAddress);
-        STRING_delete(transport_state->messageReceiveAddress);
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_035 : [IoTHubTransportAMQP_Destroy shall delete its internally - set parameters(iotHubHostFqdn, sasTokenKeyName).]
         STRING_delete(transport_state->sasTokenKeyName);
-        STRING_delete(transport_state->deviceKey);
-        STRING_delete(transport_state->devicesPath);
         STRING_delete(transport_state->iotHubHostFqdn);
+        DeviceRegistry_Destroy(transport_state->device_registry);
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_036 : [IoTHubTransportAMQP_Destroy shall return the remaining items in inProgress to waitingToSend list.]
-        rollEventsBackToWaitList(transport_state);
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_213: [IoTHubTransportAMQP_Destroy shall destroy the encoder of the batched events, if it was created.]
+        if (transport_state->event_encoder != NULL)
+        {
+            AmqpEventEncoder_Destroy(transport_state->event_encoder);
+        }
 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_150: [IoTHubTransportAMQP_Destroy shall destroy the transport instance]
         free(transport_state);
@@ -1418,128 +1890,114 @@ static void IoTHubTransportAMQP_Destroy(TRANSPORT_LL_HANDLE handle)
 
 static void IoTHubTransportAMQP_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 {
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_052: [IoTHubTransportAMQP_DoWork shall ignore the client handle parameter; each device uses the client handle it was registered with.]
+    (void)iotHubClientHandle;
+
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_051: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the transport handle parameter is NULL] 
     if (handle == NULL)
     {
         LogError("IoTHubClient DoWork failed: transport handle parameter is NULL.");
     }
-    // Codes_[IoTHubTransportAMQP_DoWork shall fail and return immediately if the client handle parameter is NULL] 
-    else if (iotHubClientHandle == NULL)
-    {
-        LogError("IoTHubClient DoWork failed: client handle parameter is NULL.");
-    }
     else
     {
-        bool trigger_connection_retry = false;
         AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_147: [IoTHubTransportAMQP_DoWork shall save a reference to the client handle in transport_state->iothub_client_handle]
-        transport_state->iothub_client_handle = iotHubClientHandle;
-
-		if (transport_state->connection != NULL &&
-			transport_state->connection_state == AMQP_MANAGEMENT_STATE_ERROR)
-		{
-			LogError("An error occured on AMQP connection. The connection will be restablished.");
-			trigger_connection_retry = true;
-		}
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_055: [If the transport handle has a NULL connection, IoTHubTransportAMQP_DoWork shall instantiate and initialize the AMQP components and establish the connection] 
-        else if (transport_state->connection == NULL &&
-            establishConnection(transport_state) != RESULT_OK)
-        {
-            LogError("AMQP transport failed to establish connection with service.");
-            trigger_connection_retry = true;
-        }
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_081: [IoTHubTransportAMQP_DoWork shall put a new SAS token if the one has not been out already, or if the previous one failed to be put due to timeout of cbs_put_token().]
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_082: [IoTHubTransportAMQP_DoWork shall refresh the SAS token if the current token has been used for more than 'sas_token_refresh_time' milliseconds]
-        else if ((transport_state->cbs_state == CBS_STATE_IDLE || isSasTokenRefreshRequired(transport_state)) &&
-            startAuthentication(transport_state) != RESULT_OK)
-        {
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_146: [If the SAS token fails to be sent to CBS (cbs_put_token), IoTHubTransportAMQP_DoWork shall fail and exit immediately]
-            LogError("Failed authenticating AMQP connection within CBS.");
-            trigger_connection_retry = true;
-        }
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_084: [IoTHubTransportAMQP_DoWork shall wait for 'cbs_request_timeout' milliseconds for the cbs_put_token() to complete before failing due to timeout]
-        else if (transport_state->cbs_state == CBS_STATE_AUTH_IN_PROGRESS &&
-            verifyAuthenticationTimeout(transport_state) == RESULT_TIMEOUT)
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_194: [IoTHubTransportAMQP_DoWork shall return immediately if no device is registered with the transport.]
+        if (transport_state->registered_devices.Flink != &transport_state->registered_devices)
         {
-            LogError("AMQP transport authentication timed out.");
-            trigger_connection_retry = true;
-        }
-        else if (transport_state->cbs_state == CBS_STATE_AUTHENTICATED)
-        {
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_121: [IoTHubTransportAMQP_DoWork shall create an AMQP message_receiver if transport_state->message_receive is NULL and transport_state->receive_messages is true] 
-            if (transport_state->receive_messages == true &&
-                transport_state->message_receiver == NULL &&
-                createMessageReceiver(transport_state, iotHubClientHandle) != RESULT_OK)
+            bool trigger_connection_retry = false;
+
+            if (transport_state->connection != NULL &&
+                transport_state->connection_state == AMQP_MANAGEMENT_STATE_ERROR)
+            {
+                LogError("An error occured on AMQP connection. The connection will be restablished.");
+                trigger_connection_retry = true;
+            }
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_055: [If the transport handle has a NULL connection, IoTHubTransportAMQP_DoWork shall instantiate and initialize the AMQP components and establish the connection] 
+            else if (transport_state->connection == NULL &&
+                establishConnection(transport_state) != RESULT_OK)
             {
-                LogError("Failed creating AMQP transport message receiver.");
+                LogError("AMQP transport failed to establish connection with service.");
                 trigger_connection_retry = true;
             }
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_122: [IoTHubTransportAMQP_DoWork shall destroy the transport_state->message_receiver (and set it to NULL) if it exists and transport_state->receive_messages is false] 
-            else if (transport_state->receive_messages == false &&
-                transport_state->message_receiver != NULL &&
-                destroyMessageReceiver(transport_state) != RESULT_OK)
+            else
             {
-                LogError("Failed destroying AMQP transport message receiver.");
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_195: [IoTHubTransportAMQP_DoWork shall authenticate, create the links of and send the pending events of every registered device, starting with the device that follows the one the previous call started with.]
+                PDLIST_ENTRY first_entry = transport_state->next_device_to_serve;
+                PDLIST_ENTRY entry;
+
+                if (first_entry == &transport_state->registered_devices)
+                {
+                    first_entry = first_entry->Flink;
+                }
+
+                entry = first_entry;
+                do
+                {
+                    if (entry != &transport_state->registered_devices)
+                    {
+                        AMQP_TRANSPORT_DEVICE_STATE* device_state = containingRecord(entry, AMQP_TRANSPORT_DEVICE_STATE, entry);
+
+                        if (doWorkForDevice(device_state) != RESULT_OK)
+                        {
+                            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_234: [If creating the links of a device fails, IoTHubTransportAMQP_DoWork shall destroy the links of that device only and return its in-progress events to its waitingToSend list, keeping its SAS token; the connection and the other devices shall not be affected]
+                            LogError("Failed creating the AMQP links of a device, they are created again on the next call.");
+                            destroyDeviceLinks(device_state);
+                        }
+                    }
+
+                    entry = entry->Flink;
+                } while (entry != first_entry);
+
+                transport_state->next_device_to_serve = first_entry->Flink;
             }
 
-            if (transport_state->message_sender == NULL &&
-                createEventSender(transport_state) != RESULT_OK)
+            if (trigger_connection_retry)
             {
-                LogError("Failed creating AMQP transport event sender.");
-                trigger_connection_retry = true;
+                prepareForConnectionRetry(transport_state);
             }
-            else if (sendPendingEvents(transport_state) != RESULT_OK)
+            else
             {
-                LogError("AMQP transport failed sending events.");
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_103: [IoTHubTransportAMQP_DoWork shall invoke connection_dowork() on AMQP for triggering sending and receiving messages] 
+                connection_dowork(transport_state->connection);
             }
         }
-
-        if (trigger_connection_retry)
-        {
-            prepareForConnectionRetry(transport_state);
-        }
-        else
-        {
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_103: [IoTHubTransportAMQP_DoWork shall invoke connection_dowork() on AMQP for triggering sending and receiving messages] 
-            connection_dowork(transport_state->connection);
-        }
     }
 }
 
-static int IoTHubTransportAMQP_Subscribe(TRANSPORT_LL_HANDLE handle)
+static int IoTHubTransportAMQP_Subscribe(IOTHUB_DEVICE_HANDLE handle)
 {
     int result;
 
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_037: [IoTHubTransportAMQP_Subscribe shall fail if the transport handle parameter received is NULL.] 
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_037: [IoTHubTransportAMQP_Subscribe shall fail if the device handle parameter received is NULL.] 
     if (handle == NULL)
     {
-        LogError("Invalid handle to IoTHubClient AMQP transport.");
+        LogError("Invalid handle to IoTHubClient AMQP transport device.");
         result = __LINE__;
     }
     else
     {
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_038: [IoTHubTransportAMQP_Subscribe shall set transport_handle->receive_messages to true and return success code.]
-        AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
-        transport_state->receive_messages = true;
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_038: [IoTHubTransportAMQP_Subscribe shall set device_state->receive_messages to true and return success code.]
+        AMQP_TRANSPORT_DEVICE_STATE* device_state = (AMQP_TRANSPORT_DEVICE_STATE*)handle;
+        device_state->receive_messages = true;
         result = 0;
     }
 
     return result;
 }
 
-static void IoTHubTransportAMQP_Unsubscribe(TRANSPORT_LL_HANDLE handle)
+static void IoTHubTransportAMQP_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
 {
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_039: [IoTHubTransportAMQP_Unsubscribe shall fail if the transport handle parameter received is NULL.] 
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_039: [IoTHubTransportAMQP_Unsubscribe shall fail if the device handle parameter received is NULL.] 
     if (handle == NULL)
     {
-        LogError("Invalid handle to IoTHubClient AMQP transport.");
+        LogError("Invalid handle to IoTHubClient AMQP transport device.");
     }
     else
     {
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_040: [IoTHubTransportAMQP_Unsubscribe shall set transport_handle->receive_messages to false and return success code.]
-        AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
-        transport_state->receive_messages = false;
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_040: [IoTHubTransportAMQP_Unsubscribe shall set device_state->receive_messages to false and return success code.]
+        AMQP_TRANSPORT_DEVICE_STATE* device_state = (AMQP_TRANSPORT_DEVICE_STATE*)handle;
+        device_state->receive_messages = false;
     }
 }
 
@@ -1551,7 +2009,7 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportAMQP_GetSendStatus(IOTHUB_DEVICE_HAND
     if (handle == NULL)
     {
         result = IOTHUB_CLIENT_INVALID_ARG;
-        LogError("Invalid handle to IoTHubClient AMQP transport instance.");
+        LogError("Invalid handle to IoTHubClient AMQP transport device.");
     }
     else if (iotHubClientStatus == NULL)
     {
@@ -1560,10 +2018,17 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportAMQP_GetSendStatus(IOTHUB_DEVICE_HAND
     }
     else
     {
-        AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
+        AMQP_TRANSPORT_DEVICE_STATE* device_state = (AMQP_TRANSPORT_DEVICE_STATE*)handle;
 
+        if (!DList_IsListEmpty(device_state->waitingToSend))
+        {
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_233: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_FULL if there are events waiting to be sent and "max_unsettled_transfers" transfers of the device are unsettled]
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_043: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent.]
+            *iotHubClientStatus = isUnsettledTransferLimitReached(device_state, device_state->transport_state->batching ? device_state->unsettled_batches : device_state->unsettled_events) ?
+                IOTHUB_CLIENT_SEND_STATUS_FULL : IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        }
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_043: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent.]
-        if (!DList_IsListEmpty(transport_state->waitingToSend) || !DList_IsListEmpty(&(transport_state->inProgress)))
+        else if (!DList_IsListEmpty(&(device_state->inProgress)))
         {
             *iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
         }
@@ -1617,6 +2082,97 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportAMQP_SetOption(TRANSPORT_LL_HANDLE ha
             transport_state->cbs_request_timeout = *((size_t*)value);
             result = IOTHUB_CLIENT_OK;
         }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_211: [IotHubTransportAMQP_SetOption shall save and apply the value if the option name is "Batching", returning IOTHUB_CLIENT_OK] 
+        else if (strcmp("Batching", option) == 0)
+        {
+            transport_state->batching = *((bool*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_212: [IotHubTransportAMQP_SetOption shall save and apply the value if the option name is "batching_max_events" or "batching_max_size", returning IOTHUB_CLIENT_OK, or return IOTHUB_CLIENT_INVALID_ARG if the value is 0] 
+        else if (strcmp("batching_max_events", option) == 0 ||
+            strcmp("batching_max_size", option) == 0)
+        {
+            if (*((size_t*)value) == 0)
+            {
+                result = IOTHUB_CLIENT_INVALID_ARG;
+                LogError("Invalid value (0) for option %s", option);
+            }
+            else
+            {
+                if (strcmp("batching_max_events", option) == 0)
+                {
+                    transport_state->batching_max_events = *((size_t*)value);
+                }
+                else
+                {
+                    transport_state->batching_max_size = *((size_t*)value);
+                }
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_221: [IotHubTransportAMQP_SetOption shall save the value (uint32_t) if the option name is "incoming_window_size" or "outgoing_window_size", returning IOTHUB_CLIENT_OK, or return IOTHUB_CLIENT_INVALID_ARG if the value is 0] 
+        else if (strcmp("incoming_window_size", option) == 0 ||
+            strcmp("outgoing_window_size", option) == 0)
+        {
+            if (*((uint32_t*)value) == 0)
+            {
+                result = IOTHUB_CLIENT_INVALID_ARG;
+                LogError("Invalid value (0) for option %s", option);
+            }
+            else
+            {
+                if (strcmp("incoming_window_size", option) == 0)
+                {
+                    transport_state->incoming_window_size = *((uint32_t*)value);
+                }
+                else
+                {
+                    transport_state->outgoing_window_size = *((uint32_t*)value);
+                }
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_222: [IotHubTransportAMQP_SetOption shall save the value (uint64_t) if the option name is "sender_max_link_size" or "receiver_max_link_size", returning IOTHUB_CLIENT_OK, or return IOTHUB_CLIENT_INVALID_ARG if the value is 0] 
+        else if (strcmp("sender_max_link_size", option) == 0 ||
+            strcmp("receiver_max_link_size", option) == 0)
+        {
+            if (*((uint64_t*)value) == 0)
+            {
+                result = IOTHUB_CLIENT_INVALID_ARG;
+                LogError("Invalid value (0) for option %s", option);
+            }
+            else
+            {
+                if (strcmp("sender_max_link_size", option) == 0)
+                {
+                    transport_state->sender_max_link_size = *((uint64_t*)value);
+                }
+                else
+                {
+                    transport_state->receiver_max_link_size = *((uint64_t*)value);
+                }
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_223: [IotHubTransportAMQP_SetOption shall save and apply the value (size_t) if the option name is "max_unsettled_transfers", returning IOTHUB_CLIENT_OK; 0 removes the limit] 
+        else if (strcmp("max_unsettled_transfers", option) == 0)
+        {
+            transport_state->max_unsettled_transfers = *((size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_229: [IotHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_ERROR if the option name is "AsyncMessageDisposition" and the value (bool) is true, since messages are settled when they are delivered, or IOTHUB_CLIENT_OK if the value is false] 
+        else if (strcmp("AsyncMessageDisposition", option) == 0)
+        {
+            if (*((bool*)value))
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("asynchronous message disposition is not supported by the AMQP transport.");
+            }
+            else
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_047: [If the option name does not match one of the options handled by this module, then IoTHubTransportAMQP_SetOption shall get  the handle to the XIO and invoke the xio_setoption passing down the option name and value parameters.] 
         else
         {
@@ -1652,74 +2208,178 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportAMQP_Register(TRANSPORT_LL_HANDLE han
     // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_005: [IoTHubTransportAMQP_Register shall return NULL if the TRANSPORT_LL_HANDLE is NULL.]
 	if ((handle == NULL) || (device == NULL) || (waitingToSend == NULL))
     {
+        LogError("Invalid parameter (NULL) passed to AMQP transport Register()");
+        result = NULL;
+    }
+	// Codes_SRS_IOTHUBTRANSPORTUAMQP_03_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId, or both deviceKey and deviceSasToken are NULL.**]
+	else if ((device->deviceId == NULL) || (device->deviceSasToken == NULL && device->deviceKey == NULL))
+	{
+		LogError("Invalid device configuration (NULL deviceId or NULL deviceKey/deviceSasToken detected)");
+		result = NULL;
+	}
+	// Codes_SRS_IOTHUBTRANSPORTUAMQP_03_003: [IoTHubTransportAMQP_Register shall return NULL if both deviceKey and deviceSasToken are not NULL.]
+	else if ( (device->deviceSasToken != NULL) && (device->deviceKey != NULL) )
+	{
+		LogError("Invalid device configuration (Both deviceKey and deviceSasToken are defined)");
+		result = NULL;
+	}
+    // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_006: [IoTHubTransportAMQP_Register shall return NULL if deviceId, deviceKey or deviceSasToken are zero length.]
+    else if ((strlen(device->deviceId) == 0) ||
+        ((device->deviceKey != NULL) && (strlen(device->deviceKey) == 0)) ||
+        ((device->deviceSasToken != NULL) && (strlen(device->deviceSasToken) == 0)))
+    {
+        LogError("Zero-length device parameter (deviceId, deviceKey or deviceSasToken)");
+        result = NULL;
+    }
+    // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_007: [IoTHubTransportAMQP_Register shall return NULL if the deviceId length is greater than 128.]
+    else if (strlen(device->deviceId) > 128U)
+    {
+        LogError("deviceId is too long");
         result = NULL;
     }
     else
     {
         AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
+        AMQP_TRANSPORT_DEVICE_STATE* device_state;
 
-		// Codes_SRS_IOTHUBTRANSPORTUAMQP_03_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId, or both deviceKey and deviceSasToken are NULL.**]
-		if ((device->deviceId == NULL) || (device->deviceSasToken == NULL && device->deviceKey == NULL))
-		{
-			result = NULL;
-		}
-		// Codes_SRS_IOTHUBTRANSPORTUAMQP_03_003: [IoTHubTransportAMQP_Register shall return NULL if both deviceKey and deviceSasToken are not NULL.]
-		else if ( (device->deviceSasToken != NULL) && (device->deviceKey != NULL) )
-		{
-			result = NULL;
-		}
-		else
-		{
-			STRING_HANDLE devicesPath = concat3Params(STRING_c_str(transport_state->iotHubHostFqdn), "/devices/", device->deviceId);
+        // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_008: [IoTHubTransportAMQP_Register shall create an immutable string, referred to as devicesPath, from the following parts: host_fqdn + "/devices/" + deviceId.]
+        STRING_HANDLE devicesPath = concat3Params(STRING_c_str(transport_state->iotHubHostFqdn), "/devices/", device->deviceId);
         if (devicesPath == NULL)
         {
-				LogError("Could not create devicesPath");
+            // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_009: [If any of the per-device strings cannot be created IoTHubTransportAMQP_Register shall fail and return NULL.]
+            LogError("Could not create devicesPath");
+            result = NULL;
+        }
+        // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_002: [IoTHubTransportAMQP_Register shall return NULL if a device with the same deviceId is already registered with the transport.]
+        else if (DeviceRegistry_FindById(transport_state->device_registry, device->deviceId) != NULL)
+        {
+            LogError("Transport already has device registered by id: [%s]", device->deviceId);
+            STRING_delete(devicesPath);
+            result = NULL;
+        }
+        // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_010: [IoTHubTransportAMQP_Register shall allocate the state of the device and return NULL if that fails.]
+        else if ((device_state = (AMQP_TRANSPORT_DEVICE_STATE*)malloc(sizeof(AMQP_TRANSPORT_DEVICE_STATE))) == NULL)
+        {
+            LogError("Could not allocate AMQP transport device state");
+            STRING_delete(devicesPath);
             result = NULL;
         }
         else
         {
-            // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId or deviceKey do not match the deviceId and deviceKey passed in during IoTHubTransportAMQP_Create.] 
-            if (strcmp(STRING_c_str(transport_state->devicesPath), STRING_c_str(devicesPath)) != 0)
+            bool cleanup_required = false;
+
+            device_state->transport_state = transport_state;
+            device_state->devicesPath = devicesPath;
+            device_state->deviceKey = NULL;
+            device_state->deviceSasToken = NULL;
+            device_state->targetAddress = NULL;
+            device_state->messageReceiveAddress = NULL;
+            device_state->senderLinkName = NULL;
+            device_state->receiverLinkName = NULL;
+            device_state->iothub_client_handle = iotHubClientHandle;
+            device_state->sender_link = NULL;
+            device_state->message_sender = NULL;
+            device_state->receive_messages = false;
+            device_state->receiver_link = NULL;
+            device_state->message_receiver = NULL;
+            device_state->waitingToSend = waitingToSend;
+            device_state->cbs_state = CBS_STATE_IDLE;
+            device_state->put_token_operation = NULL;
+            device_state->current_sas_token_create_time = 0;
+            device_state->last_put_token_time = 0;
+            device_state->unsettled_events = 0;
+            device_state->unsettled_batches = 0;
+
+            // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_011: [IoTHubTransportAMQP_Register shall create an immutable string, referred to as targetAddress, from the following parts: "amqps://" + devicesPath + "/messages/events".]
+            if ((device_state->targetAddress = concat3Params("amqps://", STRING_c_str(devicesPath), "/messages/events")) == NULL)
             {
-                LogError("Attemping to add new device to AMQP transport, not allowed.");
-                result = NULL;
+                LogError("Failed to allocate device_state->targetAddress.");
+                cleanup_required = true;
             }
-				else if ((transport_state->deviceSasToken == NULL) && strcmp(STRING_c_str(transport_state->deviceKey), device->deviceKey) != 0)
+            // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_012: [IoTHubTransportAMQP_Register shall define the source address for receiving messages as "amqps://" + devicesPath + "/messages/devicebound", stored in the device state as messageReceiveAddress.]
+            else if ((device_state->messageReceiveAddress = concat3Params("amqps://", STRING_c_str(devicesPath), "/messages/devicebound")) == NULL)
             {
-                LogError("Attemping to add new device to AMQP transport, not allowed.");
-                result = NULL;
+                LogError("Failed to allocate device_state->messageReceiveAddress.");
+                cleanup_required = true;
             }
-            else
+            // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_013: [IoTHubTransportAMQP_Register shall name the links of the device "sender-link-" + deviceId and "receiver-link-" + deviceId.]
+            else if ((device_state->senderLinkName = concat3Params(MESSAGE_SENDER_LINK_NAME, "-", device->deviceId)) == NULL)
             {
-                if (transport_state->isRegistered == true)
-                {
-						LogError("Transport already has device registered by id: [%s]", device->deviceId);
-                    result = NULL;
-                }
-                else
+                LogError("Failed to allocate device_state->senderLinkName.");
+                cleanup_required = true;
+            }
+            else if ((device_state->receiverLinkName = concat3Params(MESSAGE_RECEIVER_LINK_NAME, "-", device->deviceId)) == NULL)
+            {
+                LogError("Failed to allocate device_state->receiverLinkName.");
+                cleanup_required = true;
+            }
+            // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_014: [IoTHubTransportAMQP_Register shall store a copy of device->deviceKey or device->deviceSasToken into the device state.]
+            else if (device->deviceSasToken != NULL)
+            {
+                if ((device_state->deviceSasToken = STRING_construct(device->deviceSasToken)) == NULL)
                 {
-                    transport_state->isRegistered = true;
-                    // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_003: [IoTHubTransportAMQP_Register shall return the TRANSPORT_LL_HANDLE as the IOTHUB_DEVICE_HANDLE.] 
-                    result = (IOTHUB_DEVICE_HANDLE)handle;
+                    LogError("Failed to allocate device_state->deviceSasToken.");
+                    cleanup_required = true;
                 }
             }
-            STRING_delete(devicesPath);
+            else if ((device_state->deviceKey = STRING_new()) == NULL ||
+                STRING_copy(device_state->deviceKey, device->deviceKey) != 0)
+            {
+                LogError("Failed to allocate device_state->deviceKey.");
+                cleanup_required = true;
+            }
+
+            // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_017: [IoTHubTransportAMQP_Register shall call DeviceRegistry_Add to index the new device by its handle and by deviceId, and shall fail and return NULL if that fails.]
+            if (!cleanup_required &&
+                DeviceRegistry_Add(transport_state->device_registry, device_state, device->deviceId) != 0)
+            {
+                LogError("Failed to add the device to the device registry.");
+                cleanup_required = true;
+            }
+
+            if (cleanup_required)
+            {
+                destroyDeviceState(device_state);
+                result = NULL;
+            }
+            else
+            {
+                DList_InitializeListHead(&device_state->inProgress);
+
+                // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_015: [IoTHubTransportAMQP_Register shall add the device to the list of devices served by IoTHubTransportAMQP_DoWork.]
+                DList_InsertTailList(&transport_state->registered_devices, &device_state->entry);
+
+                // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_003: [IoTHubTransportAMQP_Register shall return the state of the device as the IOTHUB_DEVICE_HANDLE.]
+                result = (IOTHUB_DEVICE_HANDLE)device_state;
+            }
         }
     }
-	}
 
     return result;
 }
 
-// Codes_SRS_IOTHUBTRANSPORTUAMQP_17_004: [IoTHubTransportAMQP_Unregister shall return.] 
 static void IoTHubTransportAMQP_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
 {
-    if (deviceHandle != NULL)
+    // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_004: [IoTHubTransportAMQP_Unregister shall return if deviceHandle is NULL.]
+    if (deviceHandle == NULL)
     {
-        AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)deviceHandle;
-
-        transport_state->isRegistered = false;
+        LogError("Invalid handle to IoTHubClient AMQP transport device.");
     }
+    else
+    {
+        // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_016: [IoTHubTransportAMQP_Unregister shall destroy the links of the device, return its in-progress events to its waitingToSend list, remove it from the transport and free its state.]
+        unregisterDevice((AMQP_TRANSPORT_DEVICE_STATE*)deviceHandle);
+    }
+}
+
+static IOTHUB_CLIENT_RESULT IoTHubTransportAMQP_SendMessageDisposition(IOTHUB_DEVICE_HANDLE handle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition)
+{
+    (void)handle;
+    (void)message;
+    (void)disposition;
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_197: [IoTHubTransportAMQP_SendMessageDisposition shall return IOTHUB_CLIENT_ERROR, the disposition of a message is the return value of IoTHubClient_LL_MessageCallback.]
+    LogError("Asynchronous message disposition is not supported by the AMQP transport.");
+    return IOTHUB_CLIENT_ERROR;
 }
 
 static TRANSPORT_PROVIDER thisTransportProvider = {
@@ -1731,7 +2391,8 @@ static TRANSPORT_PROVIDER thisTransportProvider = {
     IoTHubTransportAMQP_Subscribe,
     IoTHubTransportAMQP_Unsubscribe,
     IoTHubTransportAMQP_DoWork,
-    IoTHubTransportAMQP_GetSendStatus
+    IoTHubTransportAMQP_GetSendStatus,
+    IoTHubTransportAMQP_SendMessageDisposition
 };
 
 extern const void* AMQP_Protocol(void)
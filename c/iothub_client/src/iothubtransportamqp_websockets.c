@@ -37,7 +37,8 @@ static TRANSPORT_PROVIDER thisTransportProvider_WebSocketsOverTls = {
 	IoTHubTransportAMQP_Subscribe,
 	IoTHubTransportAMQP_Unsubscribe,
 	IoTHubTransportAMQP_DoWork,
-	IoTHubTransportAMQP_GetSendStatus
+	IoTHubTransportAMQP_GetSendStatus,
+	IoTHubTransportAMQP_SendMessageDisposition
 };
 
 extern const void* AMQP_Protocol_over_WebSocketsTls(void)
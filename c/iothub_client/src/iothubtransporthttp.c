@@ -2,6 +2,8 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #ifdef _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #endif
@@ -19,11 +21,13 @@
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
 #include "azure_c_shared_utility/strings.h"
-#include "azure_c_shared_utility/base64.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/httpheaders.h"
-#include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/lock.h"
+#include "deviceregistry.h"
 
 #define IOTHUB_APP_PREFIX "iothub-app-"
 const char* IOTHUB_MESSAGE_ID = "iothub-messageid";
@@ -37,13 +41,19 @@ const char* IOTHUB_CORRELATION_ID = "iothub-correlationid";
 /*the default is 25 minutes*/
 #define DEFAULT_GETMINIMUMPOLLINGTIME ((unsigned int)25*60) 
 
+/*MAXIMUM_POLLINGJITTER is the upper bound of the "PollingJitter" option, in percents of the polling interval*/
+#define MAXIMUM_POLLINGJITTER 100
+
+/*MAXIMUM_HTTPCONNECTIONS is the upper bound of the "HttpConnections" option, that is the maximum number of devices served in parallel by _DoWork*/
+#define MAXIMUM_HTTPCONNECTIONS 32
+
+/*HTTPCONNECTION_MAX_IDLE_SLEEP_TIME is the longest a connection sleeps, in milliseconds, before it looks again for a device to claim*/
+#define HTTPCONNECTION_MAX_IDLE_SLEEP_TIME 16
+
 #define MAXIMUM_MESSAGE_SIZE (255*1024-1)
 #define MAXIMUM_PAYLOAD_OVERHEAD 384
 #define MAXIMUM_PROPERTY_OVERHEAD 16
 
-/*forward declaration*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count);
-
 /*Codes_SRS_TRANSPORTMULTITHTTP_17_125: [This function shall return a pointer to a structure of type TRANSPORT_PROVIDER having the following values for its fields:] */
 static TRANSPORT_PROVIDER thisTransportProvider =
 {
@@ -55,7 +65,8 @@ static TRANSPORT_PROVIDER thisTransportProvider =
 	IoTHubTransportHttp_Subscribe, /*pfIoTHubTransport_Subscribe IoTHubTransport_Subscribe;                                            */
 	IoTHubTransportHttp_Unsubscribe, /*pfIoTHubTransport_Unsubscribe IoTHubTransport_Unsubscribe;                                        */
 	IoTHubTransportHttp_DoWork, /*pfIoTHubTransport_DoWork IoTHubTransport_DoWork; */
-	IoTHubTransportHttp_GetSendStatus /* pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus */
+	IoTHubTransportHttp_GetSendStatus, /* pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus */
+	IoTHubTransportHttp_SendMessageDisposition /* pfIoTHubTransport_SendMessageDisposition IoTHubTransport_SendMessageDisposition */
 };
 
 const void* HTTP_Protocol(void)
@@ -64,18 +75,60 @@ const void* HTTP_Protocol(void)
 }
 
 
+typedef struct HTTPTRANSPORT_WORKER_TAG
+{
+	struct HTTPTRANSPORT_HANDLE_DATA_TAG* transportHandle;
+	HTTPAPIEX_HANDLE httpApiExHandle;
+	THREAD_HANDLE threadHandle;
+}HTTPTRANSPORT_WORKER;
+
 typedef struct HTTPTRANSPORT_HANDLE_DATA_TAG
 {
 	STRING_HANDLE hostName;
 	HTTPAPIEX_HANDLE httpApiExHandle;
 	bool doBatchedTransfers;
 	unsigned int getMinimumPollingTime;
+	unsigned int getMaximumPollingTime;
+	unsigned int pollingJitter;
 	VECTOR_HANDLE perDeviceList;
+	DEVICE_REGISTRY_HANDLE deviceRegistry; /*indexes the devices of perDeviceList by handle and by id*/
+	TICK_COUNTER_HANDLE tickCounter;
+
+	/*the caller of _DoWork is the first connection, workers are the additional ones (none by default)*/
+	size_t eventRequestsPerDevice;
+	size_t workerCount;
+	HTTPTRANSPORT_WORKER* workers;
+	LOCK_HANDLE workLock;
+	bool stopWorkers;
+	size_t devicesInPass; /*number of devices of the current _DoWork pass, 0 when no pass is in progress*/
+	size_t nextDeviceInPass; /*index in perDeviceList of the next device to be claimed by a connection*/
+	size_t devicesCompleted;
+	bool wasOptionPassedDown;
 }HTTPTRANSPORT_HANDLE_DATA;
 
+/*used by unittests only*/
+const size_t IoTHubTransportHttp_StopWorkersOffset = offsetof(HTTPTRANSPORT_HANDLE_DATA, stopWorkers);
+
+#define ACTION_VALUES \
+    ABANDON, \
+    REJECT, \
+    ACCEPT
+DEFINE_ENUM(ACTION, ACTION_VALUES);
+
+/*a message for which IoTHubClient_LL_MessageCallback returned IOTHUBMESSAGE_ASYNC_ACK*/
+typedef struct HTTPTRANSPORT_PENDING_COMPLETION_TAG
+{
+	DLIST_ENTRY entry;
+	IOTHUB_MESSAGE_HANDLE message;
+	char* ETag;
+	bool hasDisposition; /*set by IoTHubTransportHttp_SendMessageDisposition, the completion is sent at the next _DoWork*/
+	ACTION action;
+} HTTPTRANSPORT_PENDING_COMPLETION;
+
 typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
 {
 	HTTPTRANSPORT_HANDLE_DATA* transportHandle;
+	size_t listIndex; /*position of the device in perDeviceList*/
 
 	STRING_HANDLE deviceId;
 	STRING_HANDLE deviceKey;
@@ -87,12 +140,18 @@ typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
 	STRING_HANDLE abandonHTTPrelativePathBegin;
 	HTTPAPIEX_SAS_HANDLE sasObject;
 	bool DoWork_PullMessage;
-	time_t lastPollTime;
+	uint64_t lastPollTime; /*in milliseconds*/
 	bool isFirstPoll;
+	unsigned int pollBackoff; /*number of consecutive empty GETs, each one doubles the polling interval*/
+	unsigned int pollJitter; /*percent taken off the polling interval, drawn again after every GET*/
+	unsigned int jitterState; /*state of the generator pollJitter is drawn from, one per device since devices can be served by several connections at once*/
+	size_t pollCount;
+	size_t pollHitCount;
 
 	IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle;
 	PDLIST_ENTRY waitingToSend;
 	DLIST_ENTRY eventConfirmations; /*holds items for event confirmations*/
+	DLIST_ENTRY pendingCompletions; /*holds HTTPTRANSPORT_PENDING_COMPLETION items*/
 } HTTPTRANSPORT_PERDEVICE_DATA;
 
 static void destroy_eventHTTPrelativePath(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
@@ -470,32 +529,6 @@ static bool create_deviceSasToken(HTTPTRANSPORT_PERDEVICE_DATA* handleData, cons
 	return result;
 }
 
-/*
-* List queries  Find by handle and find by device name
-*/
-
-/*Codes_SRS_TRANSPORTMULTITHTTP_17_137: [ IoTHubTransportHttp_Register shall search the devices list for any device matching name deviceId. If deviceId is found it shall return NULL. ]*/
-bool findDeviceHandle(const void* element, const void* value)
-{
-	bool result;
-	/* data stored at element is device handle */
-	const IOTHUB_DEVICE_HANDLE * guess = (const IOTHUB_DEVICE_HANDLE *)element;
-	const IOTHUB_DEVICE_HANDLE match = (const IOTHUB_DEVICE_HANDLE)value;
-	result = (*guess == match) ? true : false;
-	return result;
-}
-
-static bool findDeviceById(const void* element, const void* value)
-{
-	bool result;
-	const char* deviceId = (const char *)value;
-	const HTTPTRANSPORT_PERDEVICE_DATA * perDeviceElement = *(const HTTPTRANSPORT_PERDEVICE_DATA **)element;
-
-	result = (strcmp(STRING_c_str(perDeviceElement->deviceId), deviceId) == 0);
-
-	return result;
-}
-
 IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, PDLIST_ENTRY waitingToSend)
 {
 	HTTPTRANSPORT_PERDEVICE_DATA* result;
@@ -523,11 +556,10 @@ IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE handle, co
 	else
 	{
 		HTTPTRANSPORT_HANDLE_DATA* handleData = (HTTPTRANSPORT_HANDLE_DATA*)handle;
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_137: [ IoTHubTransportHttp_Register shall search the devices list for any device matching name deviceId. If deviceId is found it shall return NULL. ]*/
-		void* listItem = VECTOR_find_if(handleData->perDeviceList, findDeviceById, device->deviceId);
-		if (listItem != NULL)
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_137: [ IoTHubTransportHttp_Register shall look up deviceId in the device registry of the transport. If deviceId is found it shall return NULL. ]*/
+		if (DeviceRegistry_FindById(handleData->deviceRegistry, device->deviceId) != NULL)
 		{
-			/*Codes_SRS_TRANSPORTMULTITHTTP_17_137: [ IoTHubTransportHttp_Register shall search the devices list for any device matching name deviceId. If deviceId is found it shall return NULL. ]*/
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_137: [ IoTHubTransportHttp_Register shall look up deviceId in the device registry of the transport. If deviceId is found it shall return NULL. ]*/
 			LogError("Transport already has device registered by id: [%s]", device->deviceId);
 			result = NULL;
 		}
@@ -564,24 +596,36 @@ IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE handle, co
 				was_sasObject_ok = was_abandonHTTPrelativePathBegin_ok && create_deviceSASObject(result, handleData->hostName, device->deviceId, device->deviceKey);
 			}
 
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_181: [ IoTHubTransportHttp_Register shall call DeviceRegistry_Add to index the new device by its handle and by deviceId. ]*/
+			bool was_registry_add_ok = (was_sasObject_ok || was_create_deviceSasToken_ok) && (DeviceRegistry_Add(handleData->deviceRegistry, result, device->deviceId) == 0);
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_041: [ IoTHubTransportHttp_Register shall call VECTOR_push_back to store the new device information. ]*/
-			bool was_list_add_ok = (was_sasObject_ok || was_create_deviceSasToken_ok) && (VECTOR_push_back(handleData->perDeviceList, &result, 1) == 0);
+			bool was_list_add_ok = was_registry_add_ok && (VECTOR_push_back(handleData->perDeviceList, &result, 1) == 0);
 
 			if (was_list_add_ok)
 			{
+				result->listIndex = VECTOR_size(handleData->perDeviceList) - 1;
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_043: [ Upon success, IoTHubTransportHttp_Register shall store the transport handle, iotHubClientHandle, and the waitingToSend queue in the device handle return a non-NULL value. ]*/
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_040: [ IoTHubTransportHttp_Register shall put event HTTP relative path, message HTTP relative path, event HTTP request headers, message HTTP request headers, abandonHTTPrelativePathBegin, HTTPAPIEX_SAS_HANDLE, and the device handle into a device structure. ]*/
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_128: [ IoTHubTransportHttp_Register shall mark this device as unsubscribed. ]*/
 				result->DoWork_PullMessage = false;
 				result->isFirstPoll = true;
+				result->pollBackoff = 0;
+				result->pollJitter = 0;
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_189: [ IoTHubTransportHttp_Register shall seed the jitter generator of the device by calling rand. ]*/
+				result->jitterState = (unsigned int)rand();
+				result->pollCount = 0;
+				result->pollHitCount = 0;
 				result->iotHubClientHandle = iotHubClientHandle;
 				result->waitingToSend = waitingToSend;
 				DList_InitializeListHead(&(result->eventConfirmations));
+				DList_InitializeListHead(&(result->pendingCompletions));
 				result->transportHandle = handle;
 			}
 			else
 			{
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_042: [ If the list_add fails then IoTHubTransportHttp_Register shall fail and return NULL. ]*/
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_182: [ If DeviceRegistry_Add fails then IoTHubTransportHttp_Register shall fail and return NULL. ]*/
+				if (was_registry_add_ok) DeviceRegistry_Remove(handleData->deviceRegistry, result);
 				if (was_sasObject_ok) destroy_SASObject(result);
 				if (was_abandonHTTPrelativePathBegin_ok) destroy_abandonHTTPrelativePathBegin(result);
 				if (was_messageHTTPrelativePath_ok) destroy_messageHTTPrelativePath(result);
@@ -602,8 +646,27 @@ IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE handle, co
 }
 
 
+static void destroy_pendingCompletion(HTTPTRANSPORT_PENDING_COMPLETION* pendingCompletion)
+{
+	IoTHubMessage_Destroy(pendingCompletion->message);
+	free(pendingCompletion->ETag);
+	free(pendingCompletion);
+}
+
+static void destroy_pendingCompletions(HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem)
+{
+	/*Codes_SRS_TRANSPORTMULTITHTTP_17_180: [ Messages still waiting for their disposition shall be destroyed without sending a completion, the service makes them available again once their lock expires. ]*/
+	while (perDeviceItem->pendingCompletions.Flink != &(perDeviceItem->pendingCompletions))
+	{
+		PDLIST_ENTRY item = perDeviceItem->pendingCompletions.Flink;
+		(void)DList_RemoveEntryList(item);
+		destroy_pendingCompletion(containingRecord(item, HTTPTRANSPORT_PENDING_COMPLETION, entry));
+	}
+}
+
 static void destroy_perDeviceData(HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem)
 {
+	destroy_pendingCompletions(perDeviceItem);
 	destroy_deviceId(perDeviceItem);
 	destroy_deviceKey(perDeviceItem);
     destroy_deviceSas(perDeviceItem);
@@ -615,25 +678,39 @@ static void destroy_perDeviceData(HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem)
 	destroy_SASObject(perDeviceItem);
 }
 
-static IOTHUB_DEVICE_HANDLE* get_perDeviceDataItem(IOTHUB_DEVICE_HANDLE deviceHandle)
+static HTTPTRANSPORT_PERDEVICE_DATA* get_perDeviceDataItem(IOTHUB_DEVICE_HANDLE deviceHandle)
 {
 	HTTPTRANSPORT_PERDEVICE_DATA* deviceHandleData = (HTTPTRANSPORT_PERDEVICE_DATA*)deviceHandle;
-	IOTHUB_DEVICE_HANDLE* listItem;
+	HTTPTRANSPORT_PERDEVICE_DATA* result;
 
 	HTTPTRANSPORT_HANDLE_DATA* handleData = deviceHandleData->transportHandle;
 
-	listItem = VECTOR_find_if(handleData->perDeviceList, findDeviceHandle, deviceHandle);
-	if (listItem == NULL)
+	if (!DeviceRegistry_Contains(handleData->deviceRegistry, deviceHandle))
 	{
-		LogError("device handle not found in transport device list");
-		listItem = NULL;
+		LogError("device handle not found in transport device registry");
+		result = NULL;
 	}
 	else
 	{
-		/* sucessfully found device in list. */
+		/* sucessfully found device in registry. */
+		result = deviceHandleData;
 	}
 
-	return listItem;
+	return result;
+}
+
+/*moves the last device of perDeviceList in the slot of perDeviceItem, so that removing a device does not shift the list*/
+static void remove_perDeviceListItem(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem)
+{
+	IOTHUB_DEVICE_HANDLE* lastItem = (IOTHUB_DEVICE_HANDLE*)VECTOR_back(handleData->perDeviceList);
+	HTTPTRANSPORT_PERDEVICE_DATA* lastDevice = (HTTPTRANSPORT_PERDEVICE_DATA*)(*lastItem);
+	if (lastDevice != perDeviceItem)
+	{
+		IOTHUB_DEVICE_HANDLE* listItem = (IOTHUB_DEVICE_HANDLE*)VECTOR_element(handleData->perDeviceList, perDeviceItem->listIndex);
+		*listItem = lastDevice;
+		lastDevice->listIndex = perDeviceItem->listIndex;
+	}
+	VECTOR_erase(handleData->perDeviceList, lastItem, 1);
 }
 
 void IoTHubTransportHttp_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
@@ -647,21 +724,20 @@ void IoTHubTransportHttp_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
 	{
 		HTTPTRANSPORT_PERDEVICE_DATA* deviceHandleData = (HTTPTRANSPORT_PERDEVICE_DATA*)deviceHandle;
 		HTTPTRANSPORT_HANDLE_DATA* handleData = deviceHandleData->transportHandle;
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_045: [ IoTHubTransportHttp_Unregister shall locate deviceHandle in the transport device list by calling list_find_if. ]*/
-		IOTHUB_DEVICE_HANDLE* listItem = get_perDeviceDataItem(deviceHandle);
-		if (listItem == NULL)
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_045: [ IoTHubTransportHttp_Unregister shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains. ]*/
+		HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = get_perDeviceDataItem(deviceHandle);
+		if (perDeviceItem == NULL)
 		{
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_046: [ If the device structure is not found, then this function shall fail and do nothing. ]*/
 			LogError("Device Handle [%p] not found in transport", deviceHandle);
 		}
 		else
 		{
-			HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA *)(*listItem);
-
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_047: [ IoTHubTransportHttp_Unregister shall free all the resources used in the device structure. ]*/
 			destroy_perDeviceData(perDeviceItem);
-			/*Codes_SRS_TRANSPORTMULTITHTTP_17_048: [ IoTHubTransportHttp_Unregister shall call list_remove to remove device from devices list. ]*/
-			VECTOR_erase(handleData->perDeviceList, listItem, 1);
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_048: [ IoTHubTransportHttp_Unregister shall call DeviceRegistry_Remove and shall remove the device from the devices list by moving the last device of the list in its place. ]*/
+			DeviceRegistry_Remove(handleData->deviceRegistry, deviceHandle);
+			remove_perDeviceListItem(handleData, perDeviceItem);
 			free(deviceHandleData);
 		}
 	}
@@ -730,6 +806,8 @@ static bool create_httpApiExHandle(HTTPTRANSPORT_HANDLE_DATA* handleData, const
 
 static void destroy_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
 {
+	DeviceRegistry_Destroy(handleData->deviceRegistry);
+	handleData->deviceRegistry = NULL;
 	VECTOR_destroy(handleData->perDeviceList);
 	handleData->perDeviceList = NULL;
 }
@@ -745,12 +823,85 @@ static bool create_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
 		result = false;
 	}
 	else
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_183: [ IoTHubTransportHttp_Create shall call DeviceRegistry_Create to create the index of the registered devices. ]*/
+		handleData->deviceRegistry = DeviceRegistry_Create();
+		if (handleData->deviceRegistry == NULL)
+		{
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_184: [ If DeviceRegistry_Create fails, then IoTHubTransportHttp_Create shall fail and return NULL. ]*/
+			VECTOR_destroy(handleData->perDeviceList);
+			handleData->perDeviceList = NULL;
+			result = false;
+		}
+		else
+		{
+			result = true;
+		}
+	}
+	return result;
+}
+
+
+static void destroy_tickCounter(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	tickcounter_destroy(handleData->tickCounter);
+	handleData->tickCounter = NULL;
+}
+
+/*Codes_SRS_TRANSPORTMULTITHTTP_17_162: [ IoTHubTransportHttp_Create shall create a tick counter by calling tickcounter_create. ]*/
+static bool create_tickCounter(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	bool result;
+	handleData->tickCounter = tickcounter_create();
+	if (handleData->tickCounter == NULL)
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_163: [ If tickcounter_create fails, then IoTHubTransportHttp_Create shall fail and return NULL. ]*/
+		LogError("unable to tickcounter_create");
+		result = false;
+	}
+	else
 	{
 		result = true;
 	}
 	return result;
 }
 
+static void destroy_workers(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	if (handleData->workers != NULL)
+	{
+		if (Lock(handleData->workLock) != LOCK_OK)
+		{
+			LogError("unable to Lock, stopping the HTTP workers anyway");
+			handleData->stopWorkers = true;
+		}
+		else
+		{
+			handleData->stopWorkers = true;
+			(void)Unlock(handleData->workLock);
+		}
+
+		for (size_t i = 0; i < handleData->workerCount; i++)
+		{
+			int notUsed;
+			if (ThreadAPI_Join(handleData->workers[i].threadHandle, &notUsed) != THREADAPI_OK)
+			{
+				LogError("ThreadAPI_Join failed");
+			}
+			HTTPAPIEX_Destroy(handleData->workers[i].httpApiExHandle);
+		}
+		free(handleData->workers);
+		handleData->workers = NULL;
+	}
+	handleData->workerCount = 0;
+
+	if (handleData->workLock != NULL)
+	{
+		(void)Lock_Deinit(handleData->workLock);
+		handleData->workLock = NULL;
+	}
+	handleData->stopWorkers = false;
+}
 
 TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONFIG* config)
 {
@@ -799,16 +950,30 @@ TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONFIG* con
 			bool was_hostName_ok = create_hostName(result, config);
 			bool was_httpApiExHandle_ok = was_hostName_ok && create_httpApiExHandle(result, config);
 			bool was_perDeviceList_ok = was_httpApiExHandle_ok && create_perDeviceList(result);
+			bool was_tickCounter_ok = was_perDeviceList_ok && create_tickCounter(result);
 
 
-			if (was_perDeviceList_ok)
+			if (was_tickCounter_ok)
 			{
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_011: [ Otherwise, IoTHubTransportHttp_Create shall succeed and return a non-NULL value. ]*/
 				result->doBatchedTransfers = false;
 				result->getMinimumPollingTime = DEFAULT_GETMINIMUMPOLLINGTIME;
+				result->getMaximumPollingTime = 0;
+				result->pollingJitter = 0;
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_148: [ IoTHubTransportHttp_Create shall serve all the devices from the caller of _DoWork using a single HTTPAPIEX handle, with one event request per device per _DoWork. ]*/
+				result->eventRequestsPerDevice = 1;
+				result->workerCount = 0;
+				result->workers = NULL;
+				result->workLock = NULL;
+				result->stopWorkers = false;
+				result->devicesInPass = 0;
+				result->nextDeviceInPass = 0;
+				result->devicesCompleted = 0;
+				result->wasOptionPassedDown = false;
 			}
 			else
 			{
+				if (was_perDeviceList_ok) destroy_perDeviceList(result);
 				if (was_httpApiExHandle_ok) destroy_httpApiExHandle(result);
 				if (was_hostName_ok) destroy_hostName(result);
 
@@ -839,9 +1004,12 @@ void IoTHubTransportHttp_Destroy(TRANSPORT_LL_HANDLE handle)
 			free(perDeviceItem);
 		}
 
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_149: [ IoTHubTransportHttp_Destroy shall stop and join all the worker threads and destroy their HTTPAPIEX handles. ]*/
+		destroy_workers(handleData);
 		destroy_hostName(handle);
 		destroy_httpApiExHandle(handle);
 		destroy_perDeviceList(handle);
+		destroy_tickCounter(handle);
 		free(handle);
 	}
 }
@@ -857,10 +1025,10 @@ int IoTHubTransportHttp_Subscribe(IOTHUB_DEVICE_HANDLE handle)
 	}
 	else
 	{
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_104: [ IoTHubTransportHttp_Subscribe shall locate deviceHandle in the transport device list by calling list_find_if. ]*/
-		IOTHUB_DEVICE_HANDLE* listItem = get_perDeviceDataItem(handle);
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_104: [ IoTHubTransportHttp_Subscribe shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains. ]*/
+		HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem = get_perDeviceDataItem(handle);
 
-		if (listItem == NULL)
+		if (perDeviceItem == NULL)
 		{
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_105: [ If the device structure is not found, then this function shall fail and return a non-zero value. ]*/
 			LogError("did not find device in transport handle");
@@ -868,9 +1036,6 @@ int IoTHubTransportHttp_Subscribe(IOTHUB_DEVICE_HANDLE handle)
 		}
 		else
 		{
-			HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem;
-
-			perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA *)(*listItem);
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_106: [ Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork should execute HTTP requests. ]*/
 			perDeviceItem->DoWork_PullMessage = true;
 		}
@@ -884,12 +1049,11 @@ void IoTHubTransportHttp_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
 	/*Codes_SRS_TRANSPORTMULTITHTTP_17_107: [ If parameter deviceHandle is NULL then IoTHubTransportHttp_Unsubscribe shall fail do nothing. ]*/
 	if (handle != NULL)
 	{
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_108: [ IoTHubTransportHttp_Unsubscribe shall locate deviceHandle in the transport device list by calling list_find_if. ]*/
-		IOTHUB_DEVICE_HANDLE* listItem = get_perDeviceDataItem(handle);
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_108: [ IoTHubTransportHttp_Unsubscribe shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains. ]*/
+		HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem = get_perDeviceDataItem(handle);
 		/*Codes_SRS_TRANSPORTMULTITHTTP_17_109: [ If the device structure is not found, then this function shall fail and do nothing. ]*/
-		if (listItem != NULL)
+		if (perDeviceItem != NULL)
 		{
-			HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA *)(*listItem);
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_110: [ Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork shall not execute HTTP requests. ]*/
 			perDeviceItem->DoWork_PullMessage = false;
 		}
@@ -904,230 +1068,255 @@ void IoTHubTransportHttp_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
 	}
 }
 
-/*produces a representation of the properties, if they exist*/
-/*if they do not exist, produces ""*/
-static int concat_Properties(STRING_HANDLE existing, MAP_HANDLE map, size_t* propertiesMessageSizeContribution)
+static const char base64char[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char hexToASCII[] = "0123456789ABCDEF";
+
+/*everything makePayload needs to know about 1 message, fetched without allocating*/
+typedef struct BATCH_ITEM_TAG
 {
-	int result;
-	const char*const* keys;
-	const char*const* values;
+	IOTHUBMESSAGE_CONTENT_TYPE contentType;
+	const unsigned char* source;
+	size_t size;
+	const char* const* keys;
+	const char* const* values;
 	size_t count;
-	if (Map_GetInternals(map, &keys, &values, &count) != MAP_OK)
+} BATCH_ITEM;
+
+static int getBatchItem(PDLIST_ENTRY item, BATCH_ITEM* batchItem)
+{
+	int result;
+	IOTHUB_MESSAGE_LIST* message = containingRecord(item, IOTHUB_MESSAGE_LIST, entry);
+	batchItem->contentType = IoTHubMessage_GetContentType(message->messageHandle);
+
+	switch (batchItem->contentType)
 	{
-		result = __LINE__;
-		LogError("error while Map_GetInternals");
-	}
-	else
+	case IOTHUBMESSAGE_BYTEARRAY:
 	{
-
-		if (count == 0)
+		if (IoTHubMessage_GetByteArray(message->messageHandle, &batchItem->source, &batchItem->size) != IOTHUB_MESSAGE_OK)
+		{
+			LogError("unable to get the data for the message.");
+			result = __LINE__;
+		}
+		else
 		{
-			/*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
-			/*no properties - do nothing with existing*/
 			result = 0;
-			*propertiesMessageSizeContribution = 0;
+		}
+		break;
+	}
+	case IOTHUBMESSAGE_STRING:
+	{
+		const char* source = IoTHubMessage_GetString(message->messageHandle);
+		if (source == NULL)
+		{
+			LogError("unable to IoTHubMessage_GetString");
+			result = __LINE__;
 		}
 		else
 		{
-			/*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
-			if (STRING_concat(existing, ",\"properties\":") != 0)
-			{
-				/*go ahead and return it*/
-				result = __LINE__;
-				LogError("failed STRING_concat");
-			}
-			else if (appendMapToJSON(existing, keys, values, count) != 0)
-			{
-				result = __LINE__;
-				LogError("unable to append the properties");
-			}
-			else
-			{
-				/*all is fine*/
-				size_t i;
-				*propertiesMessageSizeContribution = 0;
-				for (i = 0;i < count;i++)
-				{
-					/*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
-					*propertiesMessageSizeContribution += (strlen(keys[i]) + strlen(values[i]) + MAXIMUM_PROPERTY_OVERHEAD);
-				}
-				result = 0;
-			}
+			batchItem->source = (const unsigned char*)source;
+			batchItem->size = strlen(source);
+			result = 0;
+		}
+		break;
+	}
+	default:
+	{
+		LogError("an unknown message type was encountered (%d)", batchItem->contentType);
+		result = __LINE__;
+		break;
+	}
+	}
+
+	if (result == 0)
+	{
+		if (Map_GetInternals(IoTHubMessage_Properties(message->messageHandle), &batchItem->keys, &batchItem->values, &batchItem->count) != MAP_OK)
+		{
+			LogError("error while Map_GetInternals");
+			result = __LINE__;
 		}
 	}
 	return result;
 }
 
-/*produces a JSON representation of the map : {"a": "value_of_a","b":"value_of_b"}*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count) /*under consideration: move to MAP module when it has more than 1 user*/
+/*the size that counts against the 255KB limit, this is not the size of the JSON*/
+static size_t batchItemMessageSize(const BATCH_ITEM* batchItem)
 {
-	int result;
-	if (STRING_concat(existing, "{") != 0)
+	/*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
+	size_t result = batchItem->size + MAXIMUM_PAYLOAD_OVERHEAD;
+	size_t i;
+	for (i = 0; i < batchItem->count; i++)
 	{
-		/*go on and return it*/
-		result = __LINE__;
-		LogError("STRING_construct failed");
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
+		result += (strlen(batchItem->keys[i]) + strlen(batchItem->values[i]) + MAXIMUM_PROPERTY_OVERHEAD);
 	}
-	else
+	return result;
+}
+
+/*number of characters source takes once escaped as the content of a JSON string*/
+static size_t jsonEscapedLength(const unsigned char* source, size_t size)
+{
+	size_t result = size;
+	size_t i;
+	for (i = 0; i < size; i++)
 	{
-		size_t i;
-		for (i = 0; i < count; i++)
+		if (source[i] <= 0x1F)
 		{
-			if (!(
-				(STRING_concat(existing, (i == 0) ? "\"" IOTHUB_APP_PREFIX : ",\"" IOTHUB_APP_PREFIX) == 0) &&
-				(STRING_concat(existing, keys[i]) == 0) &&
-				(STRING_concat(existing, "\":\"") == 0) &&
-				(STRING_concat(existing, values[i]) == 0) &&
-				(STRING_concat(existing, "\"") == 0)
-				))
-			{
-				LogError("unable to STRING_concat");
-				break;
-			}
+			result += 5; /*\u00XX*/
+		}
+		else if ((source[i] == '"') || (source[i] == '\\') || (source[i] == '/'))
+		{
+			result += 1;
 		}
+	}
+	return result;
+}
 
-		if (i < count)
+static size_t writeJsonEscaped(char* destination, const unsigned char* source, size_t size)
+{
+	size_t pos = 0;
+	size_t i;
+	for (i = 0; i < size; i++)
+	{
+		if (source[i] <= 0x1F)
 		{
-			result = __LINE__;
-			/*error, let it go through*/
+			destination[pos++] = '\\';
+			destination[pos++] = 'u';
+			destination[pos++] = '0';
+			destination[pos++] = '0';
+			destination[pos++] = hexToASCII[(source[i] & 0xF0) >> 4];
+			destination[pos++] = hexToASCII[source[i] & 0x0F];
 		}
-		else if (STRING_concat(existing, "}") != 0)
+		else if ((source[i] == '"') || (source[i] == '\\') || (source[i] == '/'))
 		{
-			result = __LINE__;
-			LogError("unable to STRING_concat");
+			destination[pos++] = '\\';
+			destination[pos++] = source[i];
 		}
 		else
 		{
-			/*all is fine*/
-			result = 0;
+			destination[pos++] = source[i];
 		}
 	}
-	return result;
+	return pos;
 }
 
-/*makes the following string:{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
-/*return NULL if there was a failure, or a non-NULL STRING_HANDLE that contains the intended data*/
-static STRING_HANDLE make1EventJSONitem(PDLIST_ENTRY item, size_t *messageSizeContribution)
+static size_t writeBase64(char* destination, const unsigned char* source, size_t size)
 {
-	STRING_HANDLE result; /*temp wants to contain :{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
-	IOTHUB_MESSAGE_LIST* message = containingRecord(item, IOTHUB_MESSAGE_LIST, entry);
-	IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message->messageHandle);
+	size_t pos = 0;
+	size_t i = 0;
+	while (i + 2 < size)
+	{
+		destination[pos++] = base64char[source[i] >> 2];
+		destination[pos++] = base64char[((source[i] & 0x03) << 4) | (source[i + 1] >> 4)];
+		destination[pos++] = base64char[((source[i + 1] & 0x0F) << 2) | (source[i + 2] >> 6)];
+		destination[pos++] = base64char[source[i + 2] & 0x3F];
+		i += 3;
+	}
+	if (i + 1 == size)
+	{
+		destination[pos++] = base64char[source[i] >> 2];
+		destination[pos++] = base64char[(source[i] & 0x03) << 4];
+		destination[pos++] = '=';
+		destination[pos++] = '=';
+	}
+	else if (i + 2 == size)
+	{
+		destination[pos++] = base64char[source[i] >> 2];
+		destination[pos++] = base64char[((source[i] & 0x03) << 4) | (source[i + 1] >> 4)];
+		destination[pos++] = base64char[(source[i + 1] & 0x0F) << 2];
+		destination[pos++] = '=';
+	}
+	return pos;
+}
+
+static size_t writeLiteral(char* destination, const char* literal)
+{
+	size_t length = strlen(literal);
+	(void)memcpy(destination, literal, length);
+	return length;
+}
 
-	switch (contentType)
+#define BODY_BEGIN "{\"body\":\""
+#define BODY_END "\""
+#define NOT_BASE64_ENCODED ",\"base64Encoded\":false"
+#define PROPERTIES_BEGIN ",\"properties\":{"
+#define PROPERTY_NAME_BEGIN "\"" IOTHUB_APP_PREFIX
+#define PROPERTY_NAME_END "\":\""
+#define PROPERTY_VALUE_END "\""
+#define PROPERTIES_END "}"
+#define ITEM_END "},"
+
+/*exact number of characters writeBatchItem produces for batchItem*/
+static size_t batchItemEncodedLength(const BATCH_ITEM* batchItem)
+{
+	size_t result = strlen(BODY_BEGIN) + strlen(BODY_END) + strlen(ITEM_END);
+	if (batchItem->contentType == IOTHUBMESSAGE_BYTEARRAY)
 	{
-	case IOTHUBMESSAGE_BYTEARRAY:
+		result += ((batchItem->size + 2) / 3) * 4;
+	}
+	else
 	{
-		result = STRING_construct("{\"body\":\"");
-		if (result == NULL)
+		result += jsonEscapedLength(batchItem->source, batchItem->size) + strlen(NOT_BASE64_ENCODED);
+	}
+
+	if (batchItem->count > 0)
+	{
+		size_t i;
+		result += strlen(PROPERTIES_BEGIN) + strlen(PROPERTIES_END) + (batchItem->count - 1); /*the commas between properties*/
+		for (i = 0; i < batchItem->count; i++)
 		{
-			LogError("unable to STRING_construct");
+			result += strlen(PROPERTY_NAME_BEGIN) + strlen(PROPERTY_NAME_END) + strlen(PROPERTY_VALUE_END) +
+				jsonEscapedLength((const unsigned char*)batchItem->keys[i], strlen(batchItem->keys[i])) +
+				jsonEscapedLength((const unsigned char*)batchItem->values[i], strlen(batchItem->values[i]));
 		}
-		else
-		{
-			const unsigned char* source;
-			size_t size;
+	}
+	return result;
+}
 
-			if (IoTHubMessage_GetByteArray(message->messageHandle, &source, &size) != IOTHUB_MESSAGE_OK)
-			{
-				LogError("unable to get the data for the message.");
-				STRING_delete(result);
-				result = NULL;
-			}
-			else
-			{
-				STRING_HANDLE encoded = Base64_Encode_Bytes(source, size);
-				if (encoded == NULL)
-				{
-					LogError("unable to Base64_Encode_Bytes.");
-					STRING_delete(result);
-					result = NULL;
-				}
-				else
-				{
-					size_t propertiesSize;
-					if (!(
-						(STRING_concat_with_STRING(result, encoded) == 0) &&
-						(STRING_concat(result, "\"") == 0) && /*\" because closing value*/
-						(concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-						(STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-						))
-					{
-						STRING_delete(result);
-						result = NULL;
-						LogError("unable to STRING_concat_with_STRING.");
-					}
-					else
-					{
-						/*all is fine... */
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-						*messageSizeContribution = size + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
-					}
-					STRING_delete(encoded);
-				}
-			}
-		}
-		break;
+/*writes {"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}, at destination*/
+/*the trailing comma is overwritten by ']' after the last item*/
+static size_t writeBatchItem(char* destination, const BATCH_ITEM* batchItem)
+{
+	size_t pos = writeLiteral(destination, BODY_BEGIN);
+	if (batchItem->contentType == IOTHUBMESSAGE_BYTEARRAY)
+	{
+		pos += writeBase64(destination + pos, batchItem->source, batchItem->size);
+		pos += writeLiteral(destination + pos, BODY_END);
 	}
-	/*Codes_SRS_TRANSPORTMULTITHTTP_17_057: [If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false}] */
-	case IOTHUBMESSAGE_STRING:
+	else
 	{
-		result = STRING_construct("{\"body\":");
-		if (result == NULL)
-		{
-			LogError("unable to STRING_construct");
-		}
-		else
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_057: [If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false}] */
+		pos += writeJsonEscaped(destination + pos, batchItem->source, batchItem->size);
+		pos += writeLiteral(destination + pos, BODY_END);
+		pos += writeLiteral(destination + pos, NOT_BASE64_ENCODED);
+	}
+
+	if (batchItem->count == 0)
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
+	}
+	else
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_147: [Property names and values shall be escaped the same way as the body of a message of type IOTHUBMESSAGE_STRING.] */
+		size_t i;
+		pos += writeLiteral(destination + pos, PROPERTIES_BEGIN);
+		for (i = 0; i < batchItem->count; i++)
 		{
-			const char* source = IoTHubMessage_GetString(message->messageHandle);
-			if (source == NULL)
-			{
-				LogError("unable to IoTHubMessage_GetString");
-				STRING_delete(result);
-				result = NULL;
-			}
-			else
+			if (i > 0)
 			{
-				STRING_HANDLE asJson = STRING_new_JSON(source);
-				if (asJson == NULL)
-				{
-					LogError("unable to STRING_new_JSON");
-					STRING_delete(result);
-					result = NULL;
-				}
-				else
-				{
-					size_t propertiesSize;
-					if (!(
-						(STRING_concat_with_STRING(result, asJson) == 0) &&
-						(STRING_concat(result, ",\"base64Encoded\":false") == 0) &&
-						(concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-						(STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-						))
-					{
-						LogError("unable to STRING_concat_with_STRING");
-						STRING_delete(result);
-						result = NULL;
-					}
-					else
-					{
-						/*result has the intended content*/
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-						*messageSizeContribution = strlen(source) + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
-					}
-					STRING_delete(asJson);
-				}
+				destination[pos++] = ',';
 			}
+			pos += writeLiteral(destination + pos, PROPERTY_NAME_BEGIN);
+			pos += writeJsonEscaped(destination + pos, (const unsigned char*)batchItem->keys[i], strlen(batchItem->keys[i]));
+			pos += writeLiteral(destination + pos, PROPERTY_NAME_END);
+			pos += writeJsonEscaped(destination + pos, (const unsigned char*)batchItem->values[i], strlen(batchItem->values[i]));
+			pos += writeLiteral(destination + pos, PROPERTY_VALUE_END);
 		}
-		break;
-	}
-	default:
-	{
-		LogError("an unknown message type was encountered (%d)", contentType);
-		result = NULL; /*unknown message type*/
-		break;
-	}
+		pos += writeLiteral(destination + pos, PROPERTIES_END);
 	}
-	return result;
+
+	pos += writeLiteral(destination + pos, ITEM_END);
+	return pos;
 }
 
 #define MAKE_PAYLOAD_RESULT_VALUES \
@@ -1140,118 +1329,119 @@ DEFINE_ENUM(MAKE_PAYLOAD_RESULT, MAKE_PAYLOAD_RESULT_VALUES);
 
 /*this function assembles several {"body":"base64 encoding of the message content"," base64Encoded": true} into 1 payload*/
 /*Codes_SRS_TRANSPORTMULTITHTTP_17_056: [IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...]]*/
-static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, STRING_HANDLE* payload)
+static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, BUFFER_HANDLE* payload, size_t* payloadItems, size_t* payloadBytes)
 {
-	MAKE_PAYLOAD_RESULT result;
+	MAKE_PAYLOAD_RESULT result = MAKE_PAYLOAD_OK; /*optimistically initializing it*/
 	size_t allMessagesSize = 0;
-	*payload = STRING_construct("[");
-	if (*payload == NULL)
-	{
-		LogError("unable to STRING_construct");
-		result = MAKE_PAYLOAD_ERROR;
-	}
-	else
+	size_t payloadSize = 1; /*the '['. The comma after the last item becomes the ']'*/
+	size_t itemCount = 0;
+	BATCH_ITEM batchItem;
+	PDLIST_ENTRY actual = deviceData->waitingToSend->Flink;
+
+	*payload = NULL;
+
+	/*Codes_SRS_TRANSPORTMULTITHTTP_17_144: [IoTHubTransportHttp_DoWork shall compute the exact size of the payload and decide which items are batched before allocating any memory for it.] */
+	while (actual != deviceData->waitingToSend)
 	{
-		bool isFirst = true;
-		PDLIST_ENTRY actual;
-		bool keepGoing = true; /*keepGoing gets sometimes to false from within the loop*/
-							   /*either all the items enter the list or only some*/
-		result = MAKE_PAYLOAD_OK; /*optimistically initializing it*/
-		while (keepGoing && ((actual = deviceData->waitingToSend->Flink) != deviceData->waitingToSend))
+		if (getBatchItem(actual, &batchItem) != 0)
 		{
-			size_t messageSize;
-			STRING_HANDLE temp = make1EventJSONitem(actual, &messageSize);
-			if (isFirst)
+			if (itemCount == 0)
 			{
-				isFirst = false;
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-				if (temp == NULL) /*first item failed to create, nothing to send*/
+				result = MAKE_PAYLOAD_ERROR;
+			}
+			else
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
+			}
+			break;
+		}
+		else
+		{
+			size_t messageSize = batchItemMessageSize(&batchItem);
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
+			if (allMessagesSize + messageSize > MAXIMUM_MESSAGE_SIZE)
+			{
+				if (itemCount == 0)
 				{
-					result = MAKE_PAYLOAD_ERROR;
-					STRING_delete(*payload);
-					*payload = NULL;
-					keepGoing = false;
-				}
+					/*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_FAILED.]*/
+					PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
+					DList_InsertTailList(&(deviceData->eventConfirmations), head);
+					result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
+				}
 				else
 				{
-					/*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_FAILED.]*/
-					/*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
-					if (messageSize > MAXIMUM_MESSAGE_SIZE)
-					{
-						PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-						DList_InsertTailList(&(deviceData->eventConfirmations), head);
-						result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
-						STRING_delete(*payload);
-						*payload = NULL;
-						keepGoing = false;
-					}
-					else
-					{
-						if (STRING_concat_with_STRING(*payload, temp) != 0)
-						{
-							/*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-							result = MAKE_PAYLOAD_ERROR;
-							STRING_delete(*payload);
-							*payload = NULL;
-							keepGoing = false;
-						}
-						else
-						{
-							/*first item was put nicely in the payload*/
-							PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-							DList_InsertTailList(&(deviceData->eventConfirmations), head);
-							allMessagesSize += messageSize;
-						}
-					}
-					STRING_delete(temp);
+					/*this item doesn't make it to the payload, but the payload is valid so far*/
 				}
+				break;
 			}
 			else
 			{
-				/*there is at least 1 item already in the payload*/
-				if (temp == NULL)
-				{
-					/*there are multiple payloads encoded, the last one had an internal error, just go with those - closing the payload happens "after the loop"*/
-					/*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-					result = MAKE_PAYLOAD_OK;
-					keepGoing = false;
-				}
-				else
-				{
-					if (allMessagesSize + messageSize > MAXIMUM_MESSAGE_SIZE)
-					{
-						/*this item doesn't make it to the payload, but the payload is valid so far*/
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-						result = MAKE_PAYLOAD_OK;
-						keepGoing = false;
-					}
-					else if (STRING_concat_with_STRING(*payload, temp) != 0)
-					{
-						/*should still send what there is so far...*/
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-						result = MAKE_PAYLOAD_OK;
-						keepGoing = false;
-					}
-					else
-					{
-						/*cool, the payload made it there, let's continue... */
-						PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-						DList_InsertTailList(&(deviceData->eventConfirmations), head);
-						allMessagesSize += messageSize;
-					}
-					STRING_delete(temp);
-				}
+				allMessagesSize += messageSize;
+				payloadSize += batchItemEncodedLength(&batchItem);
+				itemCount++;
+				actual = actual->Flink;
 			}
 		}
+	}
 
-		/*closing the payload*/
-		if (result == MAKE_PAYLOAD_OK)
+	if (result == MAKE_PAYLOAD_OK)
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_145: [The payload shall be written in one pass into a single BUFFER_HANDLE sized by BUFFER_pre_build, and that BUFFER_HANDLE shall be the one passed to HTTPAPIEX_SAS_ExecuteRequest.] */
+		if ((*payload = BUFFER_new()) == NULL)
 		{
-			((char*)STRING_c_str(*payload))[STRING_length(*payload) - 1] = ']'; /*TODO - do this in STRING_HANDLE*/
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_146: [If BUFFER_new or BUFFER_pre_build fails then no item shall be removed from waitingToSend and IoTHubTransportHttp_DoWork shall advance to the next activity.] */
+			LogError("unable to BUFFER_new");
+			result = MAKE_PAYLOAD_ERROR;
+		}
+		else if (BUFFER_pre_build(*payload, payloadSize) != 0)
+		{
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_146: [If BUFFER_new or BUFFER_pre_build fails then no item shall be removed from waitingToSend and IoTHubTransportHttp_DoWork shall advance to the next activity.] */
+			LogError("unable to BUFFER_pre_build");
+			BUFFER_delete(*payload);
+			*payload = NULL;
+			result = MAKE_PAYLOAD_ERROR;
 		}
 		else
 		{
-			/*no need to close anything*/
+			char* destination = (char*)BUFFER_u_char(*payload);
+			size_t pos = 0;
+			size_t i;
+			destination[pos++] = '[';
+			actual = deviceData->waitingToSend->Flink;
+			for (i = 0; i < itemCount; i++)
+			{
+				if (getBatchItem(actual, &batchItem) != 0)
+				{
+					/*the message is the same one that was measured above, this is not expected to happen*/
+					break;
+				}
+				else
+				{
+					pos += writeBatchItem(destination + pos, &batchItem);
+					actual = actual->Flink;
+				}
+			}
+
+			if (i < itemCount)
+			{
+				LogError("unable to encode a message that was already measured");
+				BUFFER_delete(*payload);
+				*payload = NULL;
+				result = MAKE_PAYLOAD_ERROR;
+			}
+			else
+			{
+				/*closing the payload*/
+				destination[pos - 1] = ']';
+				*payloadItems = itemCount;
+				*payloadBytes = payloadSize;
+				for (i = 0; i < itemCount; i++)
+				{
+					PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend);
+					DList_InsertTailList(&(deviceData->eventConfirmations), head);
+				}
+			}
 		}
 	}
 	return result;
@@ -1265,7 +1455,7 @@ static void reversePutListBackIn(PDLIST_ENTRY source, PDLIST_ENTRY destination)
 	DList_InitializeListHead(source);
 }
 
-static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, HTTPAPIEX_HANDLE httpApiExHandle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 {
 
 	if (DList_IsListEmpty(deviceData->waitingToSend))
@@ -1286,68 +1476,51 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 			else
 			{
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_059: [It shall inspect the "waitingToSend" DLIST passed in config structure.] */
-				STRING_HANDLE payload;
-				switch (makePayload(deviceData, &payload))
+				BUFFER_HANDLE payload;
+				size_t payloadItems;
+				size_t payloadBytes;
+				switch (makePayload(deviceData, &payload, &payloadItems, &payloadBytes))
 				{
 				case MAKE_PAYLOAD_OK:
 				{
 					/*Codes_SRS_TRANSPORTMULTITHTTP_17_068: [Once a final payload has been obtained, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters:] */
-					BUFFER_HANDLE temp = BUFFER_new();
-					if (temp == NULL)
+					unsigned int statusCode;
+					HTTPAPIEX_RESULT r;
+					if ((r = HTTPAPIEX_SAS_ExecuteRequest(
+						deviceData->sasObject,
+						httpApiExHandle,
+						HTTPAPI_REQUEST_POST,
+						STRING_c_str(deviceData->eventHTTPrelativePath),
+						deviceData->eventHTTPrequestHeaders,
+						payload,
+						&statusCode,
+						NULL,
+						NULL
+						)) != HTTPAPIEX_OK)
 					{
-						LogError("unable to BUFFER_new");
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+						LogError("unable to HTTPAPIEX_ExecuteRequest");
+						//items go back to waitingToSend
+						/*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
 						reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
 					}
 					else
 					{
-						if (BUFFER_build(temp, (const unsigned char*)STRING_c_str(payload), STRING_length(payload)) != 0)
+						/*Codes_SRS_TRANSPORTMULTITHTTP_17_186: [ If HTTPAPIEX_SAS_ExecuteRequest does not fail for a batch, IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendStarted passing the first batched message, the number of batched messages and the size of the payload, before looking at the http status code. ]*/
+						IoTHubClient_LL_SendStarted(iotHubClientHandle, containingRecord(deviceData->eventConfirmations.Flink, IOTHUB_MESSAGE_LIST, entry), payloadItems, payloadBytes);
+						if (statusCode < 300)
 						{
-							LogError("unable to BUFFER_build");
-							//items go back to waitingToSend
-							/*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-							reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCESS. The batched items shall be removed from waitingToSend.] */
+							IoTHubClient_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_BATCHSTATE_SUCCESS);
 						}
 						else
 						{
-							unsigned int statusCode;
-							HTTPAPIEX_RESULT r;
-							if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-								deviceData->sasObject,
-								handleData->httpApiExHandle,
-								HTTPAPI_REQUEST_POST,
-								STRING_c_str(deviceData->eventHTTPrelativePath),
-								deviceData->eventHTTPrequestHeaders,
-								temp,
-								&statusCode,
-								NULL,
-								NULL
-								)) != HTTPAPIEX_OK)
-							{
-								LogError("unable to HTTPAPIEX_ExecuteRequest");
-								//items go back to waitingToSend
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-								reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-							}
-							else
-							{
-								if (statusCode < 300)
-								{
-									/*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCESS. The batched items shall be removed from waitingToSend.] */
-									IoTHubClient_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_BATCHSTATE_SUCCESS);
-								}
-								else
-								{
-									//items go back to waitingToSend
-									/*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-									LogError("unexpected HTTP status code (%u)", statusCode);
-									reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-								}
-							}
+							//items go back to waitingToSend
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
+							LogError("unexpected HTTP status code (%u)", statusCode);
+							reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
 						}
-						BUFFER_delete(temp);
 					}
-					STRING_delete(payload);
+					BUFFER_delete(payload);
 					break;
 				}
 				case MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT:
@@ -1542,7 +1715,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 
 												/*Codes_SRS_TRANSPORTMULTITHTTP_03_003: [If a deviceSasToken exists, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_ExecuteRequest passing the following parameters] */
 												else if ((r = HTTPAPIEX_ExecuteRequest(
-													handleData->httpApiExHandle,
+													httpApiExHandle,
 													HTTPAPI_REQUEST_POST,
 													STRING_c_str(deviceData->eventHTTPrelativePath),
 													clonedEventHTTPrequestHeaders,
@@ -1560,7 +1733,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 												/*Codes_SRS_TRANSPORTMULTITHTTP_17_080: [If a deviceSasToken does not exist, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters] */
 												if ((r = HTTPAPIEX_SAS_ExecuteRequest(
 													deviceData->sasObject,
-													handleData->httpApiExHandle,
+													httpApiExHandle,
 													HTTPAPI_REQUEST_POST,
 													STRING_c_str(deviceData->eventHTTPrelativePath),
 													clonedEventHTTPrequestHeaders,
@@ -1575,6 +1748,8 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 											}
 											if (r == HTTPAPIEX_OK)
 											{
+												/*Codes_SRS_TRANSPORTMULTITHTTP_17_185: [ If executing the request does not fail, IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendStarted passing the message, 1 and the size of the message content, before looking at the http status code. ]*/
+												IoTHubClient_LL_SendStarted(iotHubClientHandle, message, 1, originalMessageSize);
 												if (statusCode < 300)
 												{
 													/*Codes_SRS_TRANSPORTMULTITHTTP_17_082: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCCESS. The item shall be removed from waitingToSend.] */
@@ -1602,13 +1777,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 	}
 }
 
-#define ACTION_VALUES \
-    ABANDON, \
-    REJECT, \
-    ACCEPT
-DEFINE_ENUM(ACTION, ACTION_VALUES);
-
-static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, ACTION action)
+static void abandonOrAcceptMessage(HTTPAPIEX_HANDLE httpApiExHandle, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, ACTION action)
 {
 	/*Codes_SRS_TRANSPORTMULTITHTTP_17_097: [_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
 	-requestType: POST
@@ -1708,7 +1877,7 @@ static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
 								LogError("Unable to replace the old SAS Token.");
 							}
 							else if ((r = HTTPAPIEX_ExecuteRequest(
-								handleData->httpApiExHandle,
+								httpApiExHandle,
 								(action == ABANDON) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
 								STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-02-03"   */
 								abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
@@ -1726,7 +1895,7 @@ static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
 						}
 						else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
 							deviceData->sasObject,
-							handleData->httpApiExHandle,
+							httpApiExHandle,
 							(action == ABANDON) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
 							STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-02-03"   */
 							abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
@@ -1768,7 +1937,83 @@ static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
 	}
 }
 
-static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+/*the generator of the rand example of the C standard, on a state of the device instead of the process-wide one of rand, which is not safe to use from the connections serving devices in parallel*/
+static unsigned int nextJitterRandom(unsigned int* state)
+{
+	*state = *state * 1103515245u + 12345u;
+	return (*state / 65536u) % 32768u;
+}
+
+/*returns the polling interval of a device in milliseconds, before jitter is applied*/
+static uint64_t getPollingInterval(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+	uint64_t minimum = (uint64_t)handleData->getMinimumPollingTime * 1000;
+	uint64_t maximum = (uint64_t)handleData->getMaximumPollingTime * 1000;
+	uint64_t result = minimum;
+
+	/*Codes_SRS_TRANSPORTMULTITHTTP_17_165: [ Every consecutive GET that returns no message shall double the polling interval of the device, up to MaximumPollingTime. ]*/
+	for (unsigned int i = 0; (i < deviceData->pollBackoff) && (result < maximum); i++)
+	{
+		result *= 2;
+	}
+	if ((maximum > minimum) && (result > maximum))
+	{
+		result = maximum;
+	}
+	return result;
+}
+
+static int deferCompletion(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_MESSAGE_HANDLE message, const char* ETag)
+{
+	int result;
+	HTTPTRANSPORT_PENDING_COMPLETION* pendingCompletion = (HTTPTRANSPORT_PENDING_COMPLETION*)malloc(sizeof(HTTPTRANSPORT_PENDING_COMPLETION));
+	if (pendingCompletion == NULL)
+	{
+		LogError("unable to malloc");
+		result = __LINE__;
+	}
+	else
+	{
+		size_t ETagSize = strlen(ETag) + 1;
+		pendingCompletion->ETag = (char*)malloc(ETagSize);
+		if (pendingCompletion->ETag == NULL)
+		{
+			LogError("unable to malloc");
+			free(pendingCompletion);
+			result = __LINE__;
+		}
+		else
+		{
+			(void)memcpy(pendingCompletion->ETag, ETag, ETagSize);
+			pendingCompletion->message = message;
+			pendingCompletion->hasDisposition = false;
+			pendingCompletion->action = ABANDON;
+			DList_InsertTailList(&(deviceData->pendingCompletions), &(pendingCompletion->entry));
+			result = 0;
+		}
+	}
+	return result;
+}
+
+static void DoCompletions(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, HTTPAPIEX_HANDLE httpApiExHandle)
+{
+	/*Codes_SRS_TRANSPORTMULTITHTTP_17_178: [ Before fetching messages, _DoWork shall send the completions of all the messages that received a disposition since the previous _DoWork, in the order the messages were received, over the same HTTPAPIEX handle, and then shall destroy those messages. ]*/
+	PDLIST_ENTRY item = deviceData->pendingCompletions.Flink;
+	while (item != &(deviceData->pendingCompletions))
+	{
+		PDLIST_ENTRY next = item->Flink;
+		HTTPTRANSPORT_PENDING_COMPLETION* pendingCompletion = containingRecord(item, HTTPTRANSPORT_PENDING_COMPLETION, entry);
+		if (pendingCompletion->hasDisposition)
+		{
+			abandonOrAcceptMessage(httpApiExHandle, deviceData, pendingCompletion->ETag, pendingCompletion->action);
+			(void)DList_RemoveEntryList(item);
+			destroy_pendingCompletion(pendingCompletion);
+		}
+		item = next;
+	}
+}
+
+static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, HTTPAPIEX_HANDLE httpApiExHandle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 {
 	/*Codes_SRS_TRANSPORTMULTITHTTP_17_083: [ If device is not subscribed then _DoWork shall advance to the next action. ] */
 	if (deviceData->DoWork_PullMessage)
@@ -1776,8 +2021,17 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 		/*Codes_SRS_TRANSPORTMULTITHTTP_17_123: [After client creation, the first GET shall be allowed no matter what the value of GetMinimumPollingTime.] */
 		/*Codes_SRS_TRANSPORTMULTITHTTP_17_124: [If time is not available then all calls shall be treated as if they are the first one.] */
 		/*Codes_SRS_TRANSPORTMULTITHTTP_17_122: [A GET request that happens earlier than GetMinimumPollingTime shall be ignored.] */
-		time_t timeNow = get_time(NULL);
-		bool isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > handleData->getMinimumPollingTime);
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_164: [ _DoWork shall measure the time between 2 GET requests of a device in milliseconds by calling tickcounter_get_current_ms. ]*/
+		uint64_t timeNow;
+		bool isTimeAvailable = (tickcounter_get_current_ms(handleData->tickCounter, &timeNow) == 0);
+		bool isPollingAllowed = deviceData->isFirstPoll || !isTimeAvailable;
+		if (!isPollingAllowed)
+		{
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_167: [ The polling interval of a device shall be shortened by the jitter percent drawn after its last GET. ]*/
+			uint64_t pollingInterval = getPollingInterval(handleData, deviceData);
+			pollingInterval -= pollingInterval * deviceData->pollJitter / 100;
+			isPollingAllowed = (timeNow - deviceData->lastPollTime) > pollingInterval;
+		}
 		if (isPollingAllowed)
 		{
 			HTTP_HEADERS_HANDLE responseHTTPHeaders = HTTPHeaders_Alloc();
@@ -1808,7 +2062,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 							LogError("Unable to replace the old SAS Token.");
 						}
 						else if ((r = HTTPAPIEX_ExecuteRequest(
-							handleData->httpApiExHandle,
+							httpApiExHandle,
 							HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
 							STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
 							deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
@@ -1834,7 +2088,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 					*/
 					else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
 						deviceData->sasObject,
-						handleData->httpApiExHandle,
+						httpApiExHandle,
 						HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
 						STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
 						deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
@@ -1850,7 +2104,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 					if (r == HTTPAPIEX_OK)
 					{
 						/*HTTP dialogue was succesfull*/
-						if (timeNow == (time_t)(-1))
+						if (!isTimeAvailable)
 						{
 							deviceData->isFirstPoll = true;
 						}
@@ -1859,12 +2113,20 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 							deviceData->isFirstPoll = false;
 							deviceData->lastPollTime = timeNow;
 						}
+						deviceData->pollCount++;
+						/*Codes_SRS_TRANSPORTMULTITHTTP_17_168: [ After every GET, _DoWork shall draw a new jitter percent for the device between 0 and PollingJitter. ]*/
+						deviceData->pollJitter = (handleData->pollingJitter == 0) ? 0 : (nextJitterRandom(&deviceData->jitterState) % (handleData->pollingJitter + 1));
+
 						if (statusCode == 204)
 						{
 							/*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
 							/*this is an expected status code, means "no commands", but logging that creates panic*/
 
-							/*do nothing, advance to next action*/
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_165: [ Every consecutive GET that returns no message shall double the polling interval of the device, up to MaximumPollingTime. ]*/
+							if (getPollingInterval(handleData, deviceData) < (uint64_t)handleData->getMaximumPollingTime * 1000)
+							{
+								deviceData->pollBackoff++;
+							}
 						}
 						else if (statusCode != 200)
 						{
@@ -1873,6 +2135,10 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 						}
 						else
 						{
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_166: [ A GET that returns a message shall reset the polling interval of the device to MinimumPollingTime. ]*/
+							deviceData->pollBackoff = 0;
+							deviceData->pollHitCount++;
+
 							/*Codes_SRS_TRANSPORTMULTITHTTP_17_087: [If status code is 200, then _DoWork shall make a copy of the value of the "ETag" http header.]*/
 							const char* etagValue = HTTPHeaders_FindHeaderValue(responseHTTPHeaders, "ETag");
 							if (etagValue == NULL)
@@ -1899,7 +2165,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 									{
 										/*Codes_SRS_TRANSPORTMULTITHTTP_17_092: [If assembling the message fails in any way, then _DoWork shall "abandon" the message.]*/
 										LogError("unable to IoTHubMessage_CreateFromByteArray, trying to abandon the message... ");
-										abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
+										abandonOrAcceptMessage(httpApiExHandle, deviceData, etagValue, ABANDON);
 									}
 									else
 									{
@@ -1909,7 +2175,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 										if (HTTPHeaders_GetHeaderCount(responseHTTPHeaders, &nHeaders) != HTTP_HEADERS_OK)
 										{
 											LogError("unable to get the count of HTTP headers");
-											abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
+											abandonOrAcceptMessage(httpApiExHandle, deviceData, etagValue, ABANDON);
 										}
 										else
 										{
@@ -1971,7 +2237,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 
 											if (i < nHeaders)
 											{
-												abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
+												abandonOrAcceptMessage(httpApiExHandle, deviceData, etagValue, ABANDON);
 											}
 											else
 											{
@@ -1980,21 +2246,37 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 												if (messageResult == IOTHUBMESSAGE_ACCEPTED)
 												{
 													/*Codes_SRS_TRANSPORTMULTITHTTP_17_094: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ACCEPTED then _DoWork shall "accept" the message.]*/
-													abandonOrAcceptMessage(handleData, deviceData, etagValue, ACCEPT);
+													abandonOrAcceptMessage(httpApiExHandle, deviceData, etagValue, ACCEPT);
 												}
 												else if (messageResult == IOTHUBMESSAGE_REJECTED)
 												{
 													/*Codes_SRS_TRANSPORTMULTITHTTP_17_095: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message.]*/
-													abandonOrAcceptMessage(handleData, deviceData, etagValue, REJECT);
+													abandonOrAcceptMessage(httpApiExHandle, deviceData, etagValue, REJECT);
+												}
+												else if (messageResult == IOTHUBMESSAGE_ASYNC_ACK)
+												{
+													/*Codes_SRS_TRANSPORTMULTITHTTP_17_174: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ASYNC_ACK then _DoWork shall keep the message and a copy of its ETag until IoTHubTransportHttp_SendMessageDisposition is called for it. ]*/
+													if (deferCompletion(deviceData, receivedMessage, etagValue) == 0)
+													{
+														receivedMessage = NULL;
+													}
+													else
+													{
+														/*Codes_SRS_TRANSPORTMULTITHTTP_17_175: [ If keeping the message fails then _DoWork shall "abandon" the message. ]*/
+														abandonOrAcceptMessage(httpApiExHandle, deviceData, etagValue, ABANDON);
+													}
 												}
 												else
 												{
 													/*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ABANDONED then _DoWork shall "abandon" the message.] */
-													abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
+													abandonOrAcceptMessage(httpApiExHandle, deviceData, etagValue, ABANDON);
 												}
 											}
 										}
-										IoTHubMessage_Destroy(receivedMessage);
+										if (receivedMessage != NULL)
+										{
+											IoTHubMessage_Destroy(receivedMessage);
+										}
 									}
 								}
 
@@ -2014,6 +2296,225 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 	}
 }
 
+static void serveDevice(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, HTTPAPIEX_HANDLE httpApiExHandle)
+{
+	/*Codes_SRS_TRANSPORTMULTITHTTP_17_150: [ For every device, _DoWork shall send events at most "EventRequestsPerDevice" times, stopping as soon as waitingToSend is empty or did not change, and then shall fetch messages once. ]*/
+	size_t eventRequests = 0;
+	PDLIST_ENTRY firstItem;
+	do
+	{
+		firstItem = deviceData->waitingToSend->Flink;
+		DoEvent(handleData, deviceData, httpApiExHandle, deviceData->iotHubClientHandle);
+		eventRequests++;
+	} while (
+		(eventRequests < handleData->eventRequestsPerDevice) &&
+		(deviceData->waitingToSend->Flink != deviceData->waitingToSend) &&
+		(deviceData->waitingToSend->Flink != firstItem)
+		);
+
+	DoCompletions(deviceData, httpApiExHandle);
+	DoMessages(handleData, deviceData, httpApiExHandle, deviceData->iotHubClientHandle);
+}
+
+/*sleeps for *sleepTime milliseconds, then doubles *sleepTime up to HTTPCONNECTION_MAX_IDLE_SLEEP_TIME*/
+static void backOff(unsigned int* sleepTime)
+{
+	ThreadAPI_Sleep(*sleepTime);
+	*sleepTime = (*sleepTime < HTTPCONNECTION_MAX_IDLE_SLEEP_TIME / 2) ? (*sleepTime * 2) : HTTPCONNECTION_MAX_IDLE_SLEEP_TIME;
+}
+
+/*this function shall be called with workLock held*/
+static HTTPTRANSPORT_PERDEVICE_DATA* claimDeviceInPass(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	HTTPTRANSPORT_PERDEVICE_DATA* result;
+	if (handleData->nextDeviceInPass < handleData->devicesInPass)
+	{
+		IOTHUB_DEVICE_HANDLE* listItem = VECTOR_element(handleData->perDeviceList, handleData->nextDeviceInPass);
+		result = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+		handleData->nextDeviceInPass++;
+	}
+	else
+	{
+		result = NULL;
+	}
+	return result;
+}
+
+static void completeDeviceInPass(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	if (Lock(handleData->workLock) != LOCK_OK)
+	{
+		LogError("unable to Lock");
+	}
+	else
+	{
+		handleData->devicesCompleted++;
+		(void)Unlock(handleData->workLock);
+	}
+}
+
+static int httpWorkerThread(void* userContextCallback)
+{
+	HTTPTRANSPORT_WORKER* worker = (HTTPTRANSPORT_WORKER*)userContextCallback;
+	HTTPTRANSPORT_HANDLE_DATA* handleData = worker->transportHandle;
+	bool stop = false;
+	unsigned int sleepTime = 1;
+
+	while (!stop)
+	{
+		HTTPTRANSPORT_PERDEVICE_DATA* deviceData = NULL;
+		if (Lock(handleData->workLock) != LOCK_OK)
+		{
+			LogError("unable to Lock");
+		}
+		else
+		{
+			stop = handleData->stopWorkers;
+			if (!stop)
+			{
+				deviceData = claimDeviceInPass(handleData);
+			}
+			(void)Unlock(handleData->workLock);
+		}
+
+		if (deviceData != NULL)
+		{
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_152: [ A worker shall serve the devices it claims using its own HTTPAPIEX handle. ]*/
+			serveDevice(handleData, deviceData, worker->httpApiExHandle);
+			completeDeviceInPass(handleData);
+			sleepTime = 1;
+		}
+		else if (!stop)
+		{
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_188: [ A connection that finds no device to claim shall sleep before looking again, starting at 1 ms and doubling up to 16 ms, and shall start again at 1 ms once it claimed a device. ]*/
+			backOff(&sleepTime);
+		}
+	}
+	return 0;
+}
+
+static bool create_workers(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t workerCount)
+{
+	bool result;
+	handleData->workLock = Lock_Init();
+	if (handleData->workLock == NULL)
+	{
+		LogError("Lock_Init failed");
+		result = false;
+	}
+	else if ((handleData->workers = (HTTPTRANSPORT_WORKER*)malloc(workerCount * sizeof(HTTPTRANSPORT_WORKER))) == NULL)
+	{
+		LogError("unable to malloc");
+		destroy_workers(handleData);
+		result = false;
+	}
+	else
+	{
+		handleData->stopWorkers = false;
+		handleData->workerCount = 0;
+		while (handleData->workerCount < workerCount)
+		{
+			HTTPTRANSPORT_WORKER* worker = handleData->workers + handleData->workerCount;
+			worker->transportHandle = handleData;
+			worker->httpApiExHandle = HTTPAPIEX_Create(STRING_c_str(handleData->hostName));
+			if (worker->httpApiExHandle == NULL)
+			{
+				LogError("HTTPAPIEX_Create failed");
+				break;
+			}
+			else if (ThreadAPI_Create(&worker->threadHandle, httpWorkerThread, worker) != THREADAPI_OK)
+			{
+				LogError("ThreadAPI_Create failed");
+				HTTPAPIEX_Destroy(worker->httpApiExHandle);
+				break;
+			}
+			else
+			{
+				handleData->workerCount++;
+			}
+		}
+
+		if (handleData->workerCount < workerCount)
+		{
+			destroy_workers(handleData);
+			result = false;
+		}
+		else
+		{
+			result = true;
+		}
+	}
+	return result;
+}
+
+static void DoWorkSequentially(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	IOTHUB_DEVICE_HANDLE* listItem;
+	size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+	/*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list, using the iotHubClientHandle field saved in the IOTHUB_DEVICE_HANDLE. ]*/
+	/*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
+	/*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
+	for (size_t i = 0; i < deviceListSize; i++)
+	{
+		listItem = VECTOR_element(handleData->perDeviceList, i);
+		HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+		serveDevice(handleData, perDeviceItem, handleData->httpApiExHandle);
+	}
+}
+
+static void DoWorkInParallel(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	if (Lock(handleData->workLock) != LOCK_OK)
+	{
+		LogError("unable to Lock, serving the devices sequentially");
+		DoWorkSequentially(handleData);
+	}
+	else
+	{
+		bool isPassComplete = false;
+		unsigned int sleepTime = 1;
+
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_151: [ When "HttpConnections" is greater than 1, _DoWork shall let the workers and the calling thread claim the devices of the transport device list one at a time, so that every device is served by exactly one connection per _DoWork. ]*/
+		handleData->devicesInPass = VECTOR_size(handleData->perDeviceList);
+		handleData->nextDeviceInPass = 0;
+		handleData->devicesCompleted = 0;
+		(void)Unlock(handleData->workLock);
+
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_153: [ _DoWork shall return only after all the devices of the transport device list have been served. ]*/
+		while (!isPassComplete)
+		{
+			HTTPTRANSPORT_PERDEVICE_DATA* deviceData = NULL;
+			if (Lock(handleData->workLock) != LOCK_OK)
+			{
+				LogError("unable to Lock");
+			}
+			else
+			{
+				deviceData = claimDeviceInPass(handleData);
+				isPassComplete = (deviceData == NULL) && (handleData->devicesCompleted == handleData->devicesInPass);
+				if (isPassComplete)
+				{
+					handleData->devicesInPass = 0;
+					handleData->nextDeviceInPass = 0;
+				}
+				(void)Unlock(handleData->workLock);
+			}
+
+			if (deviceData != NULL)
+			{
+				serveDevice(handleData, deviceData, handleData->httpApiExHandle);
+				completeDeviceInPass(handleData);
+				sleepTime = 1;
+			}
+			else if (!isPassComplete)
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_188: [ A connection that finds no device to claim shall sleep before looking again, starting at 1 ms and doubling up to 16 ms, and shall start again at 1 ms once it claimed a device. ]*/
+				backOff(&sleepTime);
+			}
+		}
+	}
+}
+
 void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 {
 	/*Codes_SRS_TRANSPORTMULTITHTTP_17_049: [ If handle is NULL, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
@@ -2023,18 +2524,13 @@ void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HAN
 	if (handle != NULL)
 	{
 		HTTPTRANSPORT_HANDLE_DATA* handleData = (HTTPTRANSPORT_HANDLE_DATA*)handle;
-		IOTHUB_DEVICE_HANDLE* listItem;
-		size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list, using the iotHubClientHandle field saved in the IOTHUB_DEVICE_HANDLE. ]*/
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
-		for (size_t i = 0; i < deviceListSize; i++)
+		if (handleData->workerCount == 0)
 		{
-			listItem = VECTOR_element(handleData->perDeviceList, i);
-			HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
-			DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
-			DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
-
+			DoWorkSequentially(handleData);
+		}
+		else
+		{
+			DoWorkInParallel(handleData);
 		}
 	}
 	else
@@ -2060,9 +2556,9 @@ IOTHUB_CLIENT_RESULT IoTHubTransportHttp_GetSendStatus(IOTHUB_DEVICE_HANDLE hand
 	}
 	else
 	{
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling list_find_if. ]*/
-		IOTHUB_DEVICE_HANDLE* listItem = get_perDeviceDataItem(handle);
-		if (listItem == NULL)
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains. ]*/
+		HTTPTRANSPORT_PERDEVICE_DATA* deviceData = get_perDeviceDataItem(handle);
+		if (deviceData == NULL)
 		{
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_139: [ If the device structure is not found, then this function shall fail and return with IOTHUB_CLIENT_INVALID_ARG. ]*/
 			result = IOTHUB_CLIENT_INVALID_ARG;
@@ -2070,7 +2566,6 @@ IOTHUB_CLIENT_RESULT IoTHubTransportHttp_GetSendStatus(IOTHUB_DEVICE_HANDLE hand
 		}
 		else
 		{
-			HTTPTRANSPORT_PERDEVICE_DATA* deviceData = (HTTPTRANSPORT_PERDEVICE_DATA*)(*listItem);
 			/* Codes_SRS_TRANSPORTMULTITHTTP_17_113: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent. ] */
 			if (!DList_IsListEmpty(deviceData->waitingToSend))
 			{
@@ -2088,6 +2583,91 @@ IOTHUB_CLIENT_RESULT IoTHubTransportHttp_GetSendStatus(IOTHUB_DEVICE_HANDLE hand
 	return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SendMessageDisposition(IOTHUB_DEVICE_HANDLE handle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition)
+{
+	IOTHUB_CLIENT_RESULT result;
+	if (
+		(handle == NULL) ||
+		(message == NULL) ||
+		(
+			(disposition != IOTHUBMESSAGE_ACCEPTED) &&
+			(disposition != IOTHUBMESSAGE_REJECTED) &&
+			(disposition != IOTHUBMESSAGE_ABANDONED)
+		)
+		)
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_176: [ If handle or message is NULL or disposition is not one of IOTHUBMESSAGE_ACCEPTED, IOTHUBMESSAGE_REJECTED or IOTHUBMESSAGE_ABANDONED then IoTHubTransportHttp_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+		result = IOTHUB_CLIENT_INVALID_ARG;
+		LogError("invalid parameter passed to IoTHubTransportHttp_SendMessageDisposition");
+	}
+	else
+	{
+		HTTPTRANSPORT_PERDEVICE_DATA* deviceData = (HTTPTRANSPORT_PERDEVICE_DATA*)handle;
+		PDLIST_ENTRY item = deviceData->pendingCompletions.Flink;
+		HTTPTRANSPORT_PENDING_COMPLETION* pendingCompletion = NULL;
+		while (item != &(deviceData->pendingCompletions))
+		{
+			HTTPTRANSPORT_PENDING_COMPLETION* candidate = containingRecord(item, HTTPTRANSPORT_PENDING_COMPLETION, entry);
+			if ((candidate->message == message) && !candidate->hasDisposition)
+			{
+				pendingCompletion = candidate;
+				break;
+			}
+			item = item->Flink;
+		}
+
+		if (pendingCompletion == NULL)
+		{
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_177: [ If message is not waiting for its disposition then IoTHubTransportHttp_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+			result = IOTHUB_CLIENT_INVALID_ARG;
+			LogError("message [%p] is not waiting for a disposition", message);
+		}
+		else
+		{
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_179: [ Otherwise IoTHubTransportHttp_SendMessageDisposition shall record the disposition, to be sent by the next _DoWork, and return IOTHUB_CLIENT_OK. ]*/
+			pendingCompletion->action =
+				(disposition == IOTHUBMESSAGE_ACCEPTED) ? ACCEPT :
+				(disposition == IOTHUBMESSAGE_REJECTED) ? REJECT :
+				ABANDON;
+			pendingCompletion->hasDisposition = true;
+			result = IOTHUB_CLIENT_OK;
+		}
+	}
+	return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubTransportHttp_GetPollStatistics(TRANSPORT_LL_HANDLE handle, HTTP_POLL_STATISTICS* statistics)
+{
+	IOTHUB_CLIENT_RESULT result;
+	if (
+		(handle == NULL) ||
+		(statistics == NULL)
+		)
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_172: [ If handle or statistics is NULL then IoTHubTransportHttp_GetPollStatistics shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+		result = IOTHUB_CLIENT_INVALID_ARG;
+		LogError("invalid parameter (NULL) passed to IoTHubTransportHttp_GetPollStatistics");
+	}
+	else
+	{
+		HTTPTRANSPORT_HANDLE_DATA* handleData = (HTTPTRANSPORT_HANDLE_DATA*)handle;
+		size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_173: [ IoTHubTransportHttp_GetPollStatistics shall add up the GET requests and the GET requests that returned a message of all the registered devices and return IOTHUB_CLIENT_OK. ]*/
+		statistics->polls = 0;
+		statistics->hits = 0;
+		for (size_t i = 0; i < deviceListSize; i++)
+		{
+			IOTHUB_DEVICE_HANDLE* listItem = VECTOR_element(handleData->perDeviceList, i);
+			HTTPTRANSPORT_PERDEVICE_DATA* deviceData = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+			statistics->polls += deviceData->pollCount;
+			statistics->hits += deviceData->pollHitCount;
+		}
+		result = IOTHUB_CLIENT_OK;
+	}
+	return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE handle, const char* option, const void* value)
 {
 	IOTHUB_CLIENT_RESULT result;
@@ -2119,6 +2699,85 @@ IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE handle, c
 			handleData->getMinimumPollingTime = *(unsigned int*)value;
 			result = IOTHUB_CLIENT_OK;
 		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_169: ["MaximumPollingTime"] */
+		else if (strcmp("MaximumPollingTime", option) == 0)
+		{
+			handleData->getMaximumPollingTime = *(unsigned int*)value;
+			result = IOTHUB_CLIENT_OK;
+		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_170: ["PollingJitter"] */
+		else if (strcmp("PollingJitter", option) == 0)
+		{
+			unsigned int pollingJitter = *(unsigned int*)value;
+			if (pollingJitter > MAXIMUM_POLLINGJITTER)
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_171: [ If the value of "PollingJitter" is greater than 100 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+				result = IOTHUB_CLIENT_INVALID_ARG;
+				LogError("PollingJitter cannot be greater than %d", MAXIMUM_POLLINGJITTER);
+			}
+			else
+			{
+				handleData->pollingJitter = pollingJitter;
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_154: ["HttpConnections"] */
+		else if (strcmp("HttpConnections", option) == 0)
+		{
+			size_t connections = *(size_t*)value;
+			if ((connections == 0) || (connections > MAXIMUM_HTTPCONNECTIONS))
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_155: [ If the value of "HttpConnections" is 0 or greater than 32 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+				result = IOTHUB_CLIENT_INVALID_ARG;
+				LogError("HttpConnections has to be between 1 and %d", MAXIMUM_HTTPCONNECTIONS);
+			}
+			else if (connections == handleData->workerCount + 1)
+			{
+				result = IOTHUB_CLIENT_OK;
+			}
+			else if ((connections > 1) && handleData->wasOptionPassedDown)
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_156: [ If an option has already been passed down to HTTPAPIEX and "HttpConnections" is greater than 1 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+				result = IOTHUB_CLIENT_ERROR;
+				LogError("HttpConnections has to be set before any option handled by HTTPAPIEX");
+			}
+			else
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_157: [ IoTHubTransportHttp_SetOption shall stop the existing workers and start "HttpConnections" - 1 workers, each one having its own HTTPAPIEX handle. ]*/
+				destroy_workers(handleData);
+				if ((connections > 1) && !create_workers(handleData, connections - 1))
+				{
+					/*Codes_SRS_TRANSPORTMULTITHTTP_17_158: [ If starting the workers fails then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR and _DoWork shall serve the devices sequentially. ]*/
+					result = IOTHUB_CLIENT_ERROR;
+					LogError("unable to start the HTTP workers");
+				}
+				else
+				{
+					result = IOTHUB_CLIENT_OK;
+				}
+			}
+		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_159: ["EventRequestsPerDevice"] */
+		else if (strcmp("EventRequestsPerDevice", option) == 0)
+		{
+			size_t eventRequestsPerDevice = *(size_t*)value;
+			if (eventRequestsPerDevice == 0)
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_160: [ If the value of "EventRequestsPerDevice" is 0 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+				result = IOTHUB_CLIENT_INVALID_ARG;
+				LogError("EventRequestsPerDevice cannot be 0");
+			}
+			else
+			{
+				handleData->eventRequestsPerDevice = eventRequestsPerDevice;
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_187: [ "AsyncMessageDisposition" - HTTP completes every message with its own request, so IoTHubTransportHttp_SetOption shall accept the option and return IOTHUB_CLIENT_OK. Value is a pointer to a bool. ]*/
+		else if (strcmp("AsyncMessageDisposition", option) == 0)
+		{
+			result = IOTHUB_CLIENT_OK;
+		}
 		else
 		{
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_126: [ "TrustedCerts"] */
@@ -2141,6 +2800,20 @@ IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE handle, c
 				result = IOTHUB_CLIENT_ERROR;
 				LogError("HTTPAPIEX_SetOption failed");
 			}
+
+			if (result == IOTHUB_CLIENT_OK)
+			{
+				handleData->wasOptionPassedDown = true;
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_161: [ An option passed down to HTTPAPIEX shall also be passed down to the HTTPAPIEX handle of every worker. If any of these calls fails then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+				for (size_t i = 0; i < handleData->workerCount; i++)
+				{
+					if (HTTPAPIEX_SetOption(handleData->workers[i].httpApiExHandle, option, value) != HTTPAPIEX_OK)
+					{
+						result = IOTHUB_CLIENT_ERROR;
+						LogError("HTTPAPIEX_SetOption failed for a HTTP worker");
+					}
+				}
+			}
 		}
 	}
 	return result;
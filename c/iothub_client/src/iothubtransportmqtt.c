@@ -24,6 +24,7 @@
 
 #include "azure_c_shared_utility/string_tokenizer.h"
 #include "iothub_client_version.h"
+#include "nodepool.h"
 
 #include <stdarg.h>
 #include <stdio.h>
@@ -41,6 +42,8 @@
 #define MAX_SEND_RECOUNT_LIMIT      2
 #define DEFAULT_CONNECTION_INTERVAL 30
 #define FAILED_CONN_BACKOFF_VALUE   5
+#define INFLIGHT_TABLE_SIZE         256 // must be a power of 2
+#define DETAILS_POOL_GROWTH         16
 
 static const char* DEVICE_MSG_TOPIC = "devices/%s/messages/devicebound/#";
 static const char* DEVICE_DEVICE_TOPIC = "devices/%s/messages/events/";
@@ -67,12 +70,29 @@ TICK_COUNTER_HANDLE g_msgTickCounter;
 
 typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
 {
+	STRING_HANDLE hostAddress;
+	int portNum;
+	int keepAliveValue;
+	bool logTrace;
+	bool destroyCalled;
+	size_t maxInflightCount;
+	// MQTT_MESSAGE_DETAILS_LIST records of every registered device are carved from here
+	NODEPOOL_HANDLE detailsPool;
+	// IoT Hub authenticates one device per MQTT connection, so every device keeps its own client and TLS I/O
+	DLIST_ENTRY registeredDevices;
+	// Device served first by the next DoWork call. The list head stands for the first device in the list.
+	PDLIST_ENTRY nextDeviceToServe;
+} MQTTTRANSPORT_HANDLE_DATA, *PMQTTTRANSPORT_HANDLE_DATA;
+
+typedef struct MQTTTRANSPORT_PERDEVICE_DATA_TAG
+{
+	DLIST_ENTRY entry;
+	PMQTTTRANSPORT_HANDLE_DATA transportState;
 	STRING_HANDLE device_id;
 	STRING_HANDLE device_key;
 	STRING_HANDLE sasTokenSr;
 	STRING_HANDLE mqttEventTopic;
 	STRING_HANDLE mqttMessageTopic;
-	STRING_HANDLE hostAddress;
 	// The current mqtt iothub implementation requires that the hub name and the domain suffix be passed as the first of a series of segments
 	// passed through the username portion of the connection frame.
 	// The second segment will contain the device id.  The two segments are delemited by a "/".
@@ -80,25 +100,24 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
 	// The second segment can be a maximum 128 characters.
 	// With the / delimeter you have 384 chars (Plus a terminator of 0).
 	STRING_HANDLE configPassedThroughUsername;
-	int portNum;
 	MQTT_CLIENT_HANDLE mqttClient;
 	uint16_t packetId;
 	bool sasTokenFromUser;
-	bool isRegistered;
 	bool connected;
 	bool subscribed;
 	bool receiveMessages;
-	bool destroyCalled;
 	DLIST_ENTRY waitingForAck;
 	PDLIST_ENTRY waitingToSend;
+	// Messages waiting for PUBACK, indexed by packet id modulo INFLIGHT_TABLE_SIZE
+	struct MQTT_MESSAGE_DETAILS_LIST_TAG* inflightTable[INFLIGHT_TABLE_SIZE];
+	size_t inflightCount;
 	IOTHUB_CLIENT_LL_HANDLE llClientHandle;
 	CONTROL_PACKET_TYPE currPacketState;
 	XIO_HANDLE xioTransport;
-	int keepAliveValue;
 	uint64_t mqtt_connect_time;
 	size_t connectFailCount;
 	uint64_t connectTick;
-} MQTTTRANSPORT_HANDLE_DATA, *PMQTTTRANSPORT_HANDLE_DATA;
+} MQTTTRANSPORT_PERDEVICE_DATA, *PMQTTTRANSPORT_PERDEVICE_DATA;
 
 typedef struct MQTT_MESSAGE_DETAILS_LIST_TAG
 {
@@ -123,12 +142,62 @@ static void defaultPrintLogFunction(unsigned int options, char* format, ...)
 	}
 }
 
-static void sendMsgComplete(IOTHUB_MESSAGE_LIST* iothubMsgList, PMQTTTRANSPORT_HANDLE_DATA transportState, IOTHUB_BATCHSTATE_RESULT batchResult)
+static void sendMsgComplete(IOTHUB_MESSAGE_LIST* iothubMsgList, PMQTTTRANSPORT_PERDEVICE_DATA deviceState, IOTHUB_BATCHSTATE_RESULT batchResult)
 {
 	DLIST_ENTRY messageCompleted;
 	DList_InitializeListHead(&messageCompleted);
 	DList_InsertTailList(&messageCompleted, &(iothubMsgList->entry));
-	IoTHubClient_LL_SendComplete(transportState->llClientHandle, &messageCompleted, batchResult);
+	IoTHubClient_LL_SendComplete(deviceState->llClientHandle, &messageCompleted, batchResult);
+}
+
+static uint16_t getNextPacketId(PMQTTTRANSPORT_PERDEVICE_DATA deviceState)
+{
+	// 0 is not a valid MQTT packet identifier
+	if (deviceState->packetId == 0)
+	{
+		deviceState->packetId = 1;
+	}
+	return deviceState->packetId++;
+}
+
+static uint16_t getNextPublishPacketId(PMQTTTRANSPORT_PERDEVICE_DATA deviceState)
+{
+	uint16_t result;
+	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_039: [IoTHubTransportMqtt_DoWork shall assign to every published message a packet id whose slot in the in flight table is not in use.] */
+	do
+	{
+		result = getNextPacketId(deviceState);
+	} while (deviceState->inflightTable[result & (INFLIGHT_TABLE_SIZE - 1)] != NULL);
+	return result;
+}
+
+static void addInflightMessage(PMQTTTRANSPORT_PERDEVICE_DATA deviceState, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
+{
+	deviceState->inflightTable[mqttMsgEntry->msgPacketId & (INFLIGHT_TABLE_SIZE - 1)] = mqttMsgEntry;
+	deviceState->inflightCount++;
+}
+
+static MQTT_MESSAGE_DETAILS_LIST* removeInflightMessage(PMQTTTRANSPORT_PERDEVICE_DATA deviceState, uint16_t packetId)
+{
+	MQTT_MESSAGE_DETAILS_LIST* result = deviceState->inflightTable[packetId & (INFLIGHT_TABLE_SIZE - 1)];
+	if (result != NULL && result->msgPacketId == packetId)
+	{
+		deviceState->inflightTable[packetId & (INFLIGHT_TABLE_SIZE - 1)] = NULL;
+		deviceState->inflightCount--;
+	}
+	else
+	{
+		result = NULL;
+	}
+	return result;
+}
+
+static void failInflightMessage(PMQTTTRANSPORT_PERDEVICE_DATA deviceState, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
+{
+	(void)DList_RemoveEntryList(&mqttMsgEntry->entry);
+	(void)removeInflightMessage(deviceState, mqttMsgEntry->msgPacketId);
+	sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, deviceState, IOTHUB_BATCHSTATE_FAILED);
+	NodePool_Free(mqttMsgEntry);
 }
 
 static STRING_HANDLE addPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, const char* eventTopic)
@@ -178,24 +247,24 @@ static STRING_HANDLE addPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_me
 	return result;
 }
 
-static int publishMqttMessage(PMQTTTRANSPORT_HANDLE_DATA transportState, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry, const unsigned char* payload, size_t len)
+static int publishMqttMessage(PMQTTTRANSPORT_PERDEVICE_DATA deviceState, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry, const unsigned char* payload, size_t len)
 {
 	int result;
-	STRING_HANDLE msgTopic = addPropertiesTouMqttMessage(mqttMsgEntry->iotHubMessageEntry->messageHandle, STRING_c_str(transportState->mqttEventTopic));
+	STRING_HANDLE msgTopic = addPropertiesTouMqttMessage(mqttMsgEntry->iotHubMessageEntry->messageHandle, STRING_c_str(deviceState->mqttEventTopic));
 	if (msgTopic == NULL)
 	{
 		result = __LINE__;
 	}
 	else
 	{
-		MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create(transportState->packetId++, STRING_c_str(msgTopic), DELIVER_AT_LEAST_ONCE, payload, len);
+		MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create(mqttMsgEntry->msgPacketId, STRING_c_str(msgTopic), DELIVER_AT_LEAST_ONCE, payload, len);
 		if (mqttMsg == NULL)
 		{
 			result = __LINE__;
 		}
 		else
 		{
-			if (mqtt_client_publish(transportState->mqttClient, mqttMsg) != 0)
+			if (mqtt_client_publish(deviceState->mqttClient, mqttMsg) != 0)
 			{
 				result = __LINE__;
 			}
@@ -203,6 +272,8 @@ static int publishMqttMessage(PMQTTTRANSPORT_HANDLE_DATA transportState, MQTT_ME
 			{
 				mqttMsgEntry->retryCount++;
 				(void)tickcounter_get_current_ms(g_msgTickCounter, &mqttMsgEntry->msgPublishTime);
+				/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_066: [Every time a message is published, first time or resent, IoTHubTransportMqtt_DoWork shall call IoTHubClient_LL_SendStarted with the message, a count of 1 and the size of its payload.] */
+				IoTHubClient_LL_SendStarted(deviceState->llClientHandle, mqttMsgEntry->iotHubMessageEntry, 1, len);
 				result = 0;
 			}
 			mqttmessage_destroy(mqttMsg);
@@ -332,8 +403,8 @@ static void MqttRecvCallback(MQTT_MESSAGE_HANDLE msgHandle, void* callbackCtx)
 		{
 			// Will need to update this when the service has messages that can be rejected
 			(void)extractMqttProperties(IoTHubMessage, msgHandle);
-			PMQTTTRANSPORT_HANDLE_DATA transportData = (PMQTTTRANSPORT_HANDLE_DATA)callbackCtx;
-			if (IoTHubClient_LL_MessageCallback(transportData->llClientHandle, IoTHubMessage) != IOTHUBMESSAGE_ACCEPTED)
+			PMQTTTRANSPORT_PERDEVICE_DATA deviceState = (PMQTTTRANSPORT_PERDEVICE_DATA)callbackCtx;
+			if (IoTHubClient_LL_MessageCallback(deviceState->llClientHandle, IoTHubMessage) != IOTHUBMESSAGE_ACCEPTED)
 			{
 				LogError("Event not accepted by our client.");
 			}
@@ -347,7 +418,7 @@ static void MqttOpCompleteCallback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_
 	(void)handle;
 	if (callbackCtx != NULL)
 	{
-		PMQTTTRANSPORT_HANDLE_DATA transportData = (PMQTTTRANSPORT_HANDLE_DATA)callbackCtx;
+		PMQTTTRANSPORT_PERDEVICE_DATA deviceState = (PMQTTTRANSPORT_PERDEVICE_DATA)callbackCtx;
 
 		switch (actionResult)
 		{
@@ -357,20 +428,13 @@ static void MqttOpCompleteCallback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_
 			const PUBLISH_ACK* puback = (const PUBLISH_ACK*)msgInfo;
 			if (puback != NULL)
 			{
-				PDLIST_ENTRY currentListEntry = transportData->waitingForAck.Flink;
-				while (currentListEntry != &transportData->waitingForAck)
+				/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_040: [On PUBACK or PUBCOMP the message shall be looked up in the in flight table by its packet id, without walking the Waiting for Ack list.] */
+				MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = removeInflightMessage(deviceState, puback->packetId);
+				if (mqttMsgEntry != NULL)
 				{
-					MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
-					DLIST_ENTRY saveListEntry;
-					saveListEntry.Flink = currentListEntry->Flink;
-
-					if (puback->packetId == mqttMsgEntry->msgPacketId)
-					{
-						(void)DList_RemoveEntryList(currentListEntry); //First remove the item from Waiting for Ack List.
-						sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transportData, IOTHUB_BATCHSTATE_SUCCESS);
-						free(mqttMsgEntry);
-					}
-					currentListEntry = saveListEntry.Flink;
+					(void)DList_RemoveEntryList(&mqttMsgEntry->entry); //First remove the item from Waiting for Ack List.
+					sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, deviceState, IOTHUB_BATCHSTATE_SUCCESS);
+					NodePool_Free(mqttMsgEntry);
 				}
 			}
 			break;
@@ -383,14 +447,14 @@ static void MqttOpCompleteCallback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_
 				if (connack->returnCode == CONNECTION_ACCEPTED)
 				{
 					// The connect packet has been acked
-					transportData->currPacketState = CONNACK_TYPE;
+					deviceState->currPacketState = CONNACK_TYPE;
 				}
 				else
 				{
 					LogError("Connection not accepted, return code: %d.", connack->returnCode);
-					(void)mqtt_client_disconnect(transportData->mqttClient);
-					transportData->connected = false;
-					transportData->currPacketState = PACKET_TYPE_ERROR;
+					(void)mqtt_client_disconnect(deviceState->mqttClient);
+					deviceState->connected = false;
+					deviceState->currPacketState = PACKET_TYPE_ERROR;
 				}
 			}
 			else
@@ -407,7 +471,7 @@ static void MqttOpCompleteCallback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_
 				if (suback->qosCount == 1)
 				{
 					// The connect packet has been acked
-					transportData->currPacketState = SUBACK_TYPE;
+					deviceState->currPacketState = SUBACK_TYPE;
 				}
 				else
 				{
@@ -425,16 +489,16 @@ static void MqttOpCompleteCallback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_
 		case MQTT_CLIENT_ON_DISCONNECT:
 		{
 			// Close the client so we can reconnect again
-			transportData->connected = false;
-			transportData->currPacketState = DISCONNECT_TYPE;
+			deviceState->connected = false;
+			deviceState->currPacketState = DISCONNECT_TYPE;
 			break;
 		}
 		case MQTT_CLIENT_ON_ERROR:
 		{
-			xio_close(transportData->xioTransport, NULL, NULL);
-			transportData->connected = false;
-			transportData->subscribed = false;
-			transportData->currPacketState = PACKET_TYPE_ERROR;
+			xio_close(deviceState->xioTransport, NULL, NULL);
+			deviceState->connected = false;
+			deviceState->subscribed = false;
+			deviceState->currPacketState = PACKET_TYPE_ERROR;
 		}
 		}
 	}
@@ -447,17 +511,17 @@ const XIO_HANDLE getIoTransportProvider(const char* fqdn, int port)
 	return (void*)xio_create(io_interface_description, &tls_io_config, NULL/*defaultPrintLogFunction*/);
 }
 
-static int SubscribeToMqttProtocol(PMQTTTRANSPORT_HANDLE_DATA transportState)
+static int SubscribeToMqttProtocol(PMQTTTRANSPORT_PERDEVICE_DATA deviceState)
 {
 	int result;
 
-	if (transportState->receiveMessages && !transportState->subscribed)
+	if (deviceState->receiveMessages && !deviceState->subscribed)
 	{
 		SUBSCRIBE_PAYLOAD subscribe[] = {
-			{ STRING_c_str(transportState->mqttMessageTopic), DELIVER_AT_LEAST_ONCE }
+			{ STRING_c_str(deviceState->mqttMessageTopic), DELIVER_AT_LEAST_ONCE }
 		};
 		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_016: [IoTHubTransportMqtt_Subscribe shall call mqtt_client_subscribe to subscribe to the Message Topic.] */
-		if (mqtt_client_subscribe(transportState->mqttClient, transportState->packetId++, subscribe, 1) != 0)
+		if (mqtt_client_subscribe(deviceState->mqttClient, getNextPacketId(deviceState), subscribe, 1) != 0)
 		{
 			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_017: [Upon failure IoTHubTransportMqtt_Subscribe shall return a non-zero value.] */
 			result = __LINE__;
@@ -465,20 +529,20 @@ static int SubscribeToMqttProtocol(PMQTTTRANSPORT_HANDLE_DATA transportState)
 		else
 		{
 			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_018: [On success IoTHubTransportMqtt_Subscribe shall return 0.] */
-			transportState->subscribed = true;
-			transportState->currPacketState = SUBSCRIBE_TYPE;
+			deviceState->subscribed = true;
+			deviceState->currPacketState = SUBSCRIBE_TYPE;
 			result = 0;
 		}
 	}
 	else
 	{
-		if (transportState->receiveMessages)
+		if (deviceState->receiveMessages)
 		{
-			transportState->currPacketState = SUBSCRIBE_TYPE;
+			deviceState->currPacketState = SUBSCRIBE_TYPE;
 		}
 		else
 		{
-			transportState->currPacketState = PUBLISH_TYPE;
+			deviceState->currPacketState = PUBLISH_TYPE;
 		}
 	}
 	return result;
@@ -520,11 +584,10 @@ static const unsigned char* RetrieveMessagePayload(IOTHUB_MESSAGE_HANDLE message
 	return result;
 }
 
-static STRING_HANDLE ConstructSasToken(const char* iothubName, const char* iotHubSuffix, const char* deviceId)
+static STRING_HANDLE ConstructSasToken(const char* hostAddress, const char* deviceId)
 {
 	STRING_HANDLE result;
-	size_t len = strlen(iothubName);
-	len += strlen(iotHubSuffix);
+	size_t len = strlen(hostAddress);
 	len += strlen(deviceId);
 
 	char* sasToken = malloc(len + SAS_TOKEN_DEFAULT_LEN + 1);
@@ -534,7 +597,7 @@ static STRING_HANDLE ConstructSasToken(const char* iothubName, const char* iotHu
 	}
 	else
 	{
-		(void)sprintf(sasToken, "%s.%s/devices/%s", iothubName, iotHubSuffix, deviceId);
+		(void)sprintf(sasToken, "%s/devices/%s", hostAddress, deviceId);
 		result = STRING_construct(sasToken);
 		free(sasToken);
 	}
@@ -579,14 +642,14 @@ static STRING_HANDLE ConstructMessageTopic(const char* deviceId)
 	return result;
 }
 
-static int GetTransportProviderIfNecessary(PMQTTTRANSPORT_HANDLE_DATA transportState)
+static int GetTransportProviderIfNecessary(PMQTTTRANSPORT_PERDEVICE_DATA deviceState)
 {
 	int result;
 
-	if (transportState->xioTransport == NULL)
+	if (deviceState->xioTransport == NULL)
 	{
 		// construct address
-		const char* hostAddress = STRING_c_str(transportState->hostAddress);
+		const char* hostAddress = STRING_c_str(deviceState->transportState->hostAddress);
 		const char* hostName = strstr(hostAddress, "//");
 		if (hostName == NULL)
 		{
@@ -597,8 +660,8 @@ static int GetTransportProviderIfNecessary(PMQTTTRANSPORT_HANDLE_DATA transportS
 			// Increment beyond the double backslash
 			hostName += 2;
 		}
-		transportState->xioTransport = getIoTransportProvider(hostName, transportState->portNum);
-		if (transportState->xioTransport == NULL)
+		deviceState->xioTransport = getIoTransportProvider(hostName, deviceState->transportState->portNum);
+		if (deviceState->xioTransport == NULL)
 		{
 			LogError("Unable to create the lower level TLS layer.");
 			result = __LINE__;
@@ -615,7 +678,7 @@ static int GetTransportProviderIfNecessary(PMQTTTRANSPORT_HANDLE_DATA transportS
 	return result;
 }
 
-static int SendMqttConnectMsg(PMQTTTRANSPORT_HANDLE_DATA transportState)
+static int SendMqttConnectMsg(PMQTTTRANSPORT_PERDEVICE_DATA deviceState)
 {
 	int result;
 
@@ -632,13 +695,13 @@ static int SendMqttConnectMsg(PMQTTTRANSPORT_HANDLE_DATA transportState)
     else
     {
         STRING_HANDLE sasToken = NULL;
-        if (transportState->sasTokenFromUser)
+        if (deviceState->sasTokenFromUser)
         {
-            sasToken = STRING_clone(transportState->sasTokenSr);
+            sasToken = STRING_clone(deviceState->sasTokenSr);
         }
         else
         {
-            sasToken = SASToken_Create(transportState->device_key, transportState->sasTokenSr, emptyKeyName, expiryTime);
+            sasToken = SASToken_Create(deviceState->device_key, deviceState->sasTokenSr, emptyKeyName, expiryTime);
         }
 
         if (sasToken == NULL)
@@ -648,26 +711,26 @@ static int SendMqttConnectMsg(PMQTTTRANSPORT_HANDLE_DATA transportState)
         else
         {
             MQTT_CLIENT_OPTIONS options = { 0 };
-            options.clientId = (char*)STRING_c_str(transportState->device_id);
+            options.clientId = (char*)STRING_c_str(deviceState->device_id);
             options.willMessage = NULL;
-            options.username = (char*)STRING_c_str(transportState->configPassedThroughUsername);
+            options.username = (char*)STRING_c_str(deviceState->configPassedThroughUsername);
             options.password = (char*)STRING_c_str(sasToken);
-            options.keepAliveInterval = transportState->keepAliveValue;
+            options.keepAliveInterval = deviceState->transportState->keepAliveValue;
             options.useCleanSession = false;
             options.qualityOfServiceValue = DELIVER_AT_LEAST_ONCE;
 
-            if (GetTransportProviderIfNecessary(transportState) == 0)
+            if (GetTransportProviderIfNecessary(deviceState) == 0)
             {
-                if (mqtt_client_connect(transportState->mqttClient, transportState->xioTransport, &options) != 0)
+                if (mqtt_client_connect(deviceState->mqttClient, deviceState->xioTransport, &options) != 0)
                 {
-                    LogError("failure connecting to address %s:%d.", STRING_c_str(transportState->hostAddress), transportState->portNum);
-                    xio_destroy(transportState->xioTransport);
-                    transportState->xioTransport = NULL;
+                    LogError("failure connecting to address %s:%d.", STRING_c_str(deviceState->transportState->hostAddress), deviceState->transportState->portNum);
+                    xio_destroy(deviceState->xioTransport);
+                    deviceState->xioTransport = NULL;
                     result = __LINE__;
                 }
                 else
                 {
-                    (void)tickcounter_get_current_ms(g_msgTickCounter, &transportState->mqtt_connect_time);
+                    (void)tickcounter_get_current_ms(g_msgTickCounter, &deviceState->mqtt_connect_time);
                     result = 0;
                 }
             }
@@ -682,27 +745,27 @@ static int SendMqttConnectMsg(PMQTTTRANSPORT_HANDLE_DATA transportState)
 	return result;
 }
 
-static int InitializeConnection(PMQTTTRANSPORT_HANDLE_DATA transportState)
+static int InitializeConnection(PMQTTTRANSPORT_PERDEVICE_DATA deviceState)
 {
 	int result = 0;
 
 	// Make sure we're not destroying the object
-	if (!transportState->destroyCalled)
+	if (!deviceState->transportState->destroyCalled)
 	{
 		// If we are not connected then check to see if we need 
 		// to back off the connecting to the server
-		if (!transportState->connected)
+		if (!deviceState->connected)
 		{
 			// Default makeConnection as true if something goes wrong we'll make the connection
 			bool makeConnection = true;
 			// If we've failed for FAILED_CONN_BACKOFF_VALUE straight times them let's slow down connection
 			// to the service
-			if (transportState->connectFailCount > FAILED_CONN_BACKOFF_VALUE)
+			if (deviceState->connectFailCount > FAILED_CONN_BACKOFF_VALUE)
 			{
 				uint64_t currentTick;
 				if (tickcounter_get_current_ms(g_msgTickCounter, &currentTick) == 0)
 				{
-					if ( ((currentTick - transportState->connectTick)/1000) <= DEFAULT_CONNECTION_INTERVAL)
+					if ( ((currentTick - deviceState->connectTick)/1000) <= DEFAULT_CONNECTION_INTERVAL)
 					{
 						result = __LINE__;
 						makeConnection = false;
@@ -712,43 +775,44 @@ static int InitializeConnection(PMQTTTRANSPORT_HANDLE_DATA transportState)
 
 			if (makeConnection)
 			{
-				(void)tickcounter_get_current_ms(g_msgTickCounter, &transportState->connectTick);
-				if (SendMqttConnectMsg(transportState) != 0)
+				(void)tickcounter_get_current_ms(g_msgTickCounter, &deviceState->connectTick);
+				if (SendMqttConnectMsg(deviceState) != 0)
 				{
-					transportState->connectFailCount++;
+					deviceState->connectFailCount++;
 					result = __LINE__;
 				}
 				else
 				{
-					transportState->connectFailCount = 0;
-					transportState->connected = true;
+					deviceState->connectFailCount = 0;
+					deviceState->connected = true;
 					result = 0;
 				}
 			}
 		}
 
-		if (transportState->connected)
+		if (deviceState->connected)
 		{
 			// We are connected and not being closed, so does SAS need to reconnect?
 			uint64_t current_time;
 			(void)tickcounter_get_current_ms(g_msgTickCounter, &current_time);
-			if ((current_time - transportState->mqtt_connect_time) / 1000 > (SAS_TOKEN_DEFAULT_LIFETIME*SAS_REFRESH_MULTIPLIER))
+			if ((current_time - deviceState->mqtt_connect_time) / 1000 > (SAS_TOKEN_DEFAULT_LIFETIME*SAS_REFRESH_MULTIPLIER))
 			{
-				(void)mqtt_client_disconnect(transportState->mqttClient);
-				transportState->subscribed = false;
-				transportState->connected = false;
-				transportState->currPacketState = UNKNOWN_TYPE;
+				(void)mqtt_client_disconnect(deviceState->mqttClient);
+				deviceState->subscribed = false;
+				deviceState->connected = false;
+				deviceState->currPacketState = UNKNOWN_TYPE;
 			}
 		}
 	}
 	return result;
 }
 
-static STRING_HANDLE buildConfigForUsername(const IOTHUB_CLIENT_CONFIG* upperConfig)
+
+static STRING_HANDLE buildConfigForUsername(const char* hostAddress, const char* deviceId)
 {
 	STRING_HANDLE result;
 
-	size_t len = strlen(upperConfig->iotHubName)+strlen(upperConfig->iotHubSuffix)+strlen(upperConfig->deviceId)+strlen(CLIENT_DEVICE_TYPE_PREFIX)+strlen(IOTHUB_SDK_VERSION);
+	size_t len = strlen(hostAddress)+strlen(deviceId)+strlen(CLIENT_DEVICE_TYPE_PREFIX)+strlen(IOTHUB_SDK_VERSION);
 	char* eventTopic = malloc(len + BUILD_CONFIG_USERNAME + 1);
 	if (eventTopic == NULL)
 	{
@@ -756,142 +820,125 @@ static STRING_HANDLE buildConfigForUsername(const IOTHUB_CLIENT_CONFIG* upperCon
 	}
 	else
 	{
-		(void)sprintf(eventTopic, "%s.%s/%s/DeviceClientType=%s%%2F%s", upperConfig->iotHubName, upperConfig->iotHubSuffix, upperConfig->deviceId, CLIENT_DEVICE_TYPE_PREFIX, IOTHUB_SDK_VERSION);
+		(void)sprintf(eventTopic, "%s/%s/DeviceClientType=%s%%2F%s", hostAddress, deviceId, CLIENT_DEVICE_TYPE_PREFIX, IOTHUB_SDK_VERSION);
 		result = STRING_construct(eventTopic);
 		free(eventTopic);
 	}
 	return result;
 }
 
-static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLIENT_CONFIG* upperConfig, PDLIST_ENTRY waitingToSend)
+static void FreeDeviceData(PMQTTTRANSPORT_PERDEVICE_DATA deviceState)
+{
+	if (deviceState->mqttClient != NULL)
+	{
+		mqtt_client_deinit(deviceState->mqttClient);
+	}
+	STRING_delete(deviceState->mqttEventTopic);
+	STRING_delete(deviceState->mqttMessageTopic);
+	STRING_delete(deviceState->device_id);
+	STRING_delete(deviceState->device_key);
+	STRING_delete(deviceState->sasTokenSr);
+	STRING_delete(deviceState->configPassedThroughUsername);
+	free(deviceState);
+}
+
+static PMQTTTRANSPORT_PERDEVICE_DATA InitializeDeviceData(PMQTTTRANSPORT_HANDLE_DATA transportState, const IOTHUB_DEVICE_CONFIG* device, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, PDLIST_ENTRY waitingToSend)
 {
-	PMQTTTRANSPORT_HANDLE_DATA state = (PMQTTTRANSPORT_HANDLE_DATA)malloc(sizeof(MQTTTRANSPORT_HANDLE_DATA));
+	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_059: [IoTHubTransportMqtt_Register shall allocate the state of the device where its topics, device_id, device_key, sasTokenSr, username and its own MQTT client handle shall be saved.] */
+	PMQTTTRANSPORT_PERDEVICE_DATA state = (PMQTTTRANSPORT_PERDEVICE_DATA)malloc(sizeof(MQTTTRANSPORT_PERDEVICE_DATA));
 	if (state == NULL)
 	{
-		LogError("Could not create MQTT transport state. Memory allocation failed.");
+		LogError("Could not create MQTT device state. Memory allocation failed.");
 	}
-	else if ((state->device_id = STRING_construct(upperConfig->deviceId)) == NULL)
+	else
 	{
-		free(state);
-		state = NULL;
+		const char* hostAddress = STRING_c_str(transportState->hostAddress);
+		state->device_key = NULL;
+		state->sasTokenSr = NULL;
+		state->mqttEventTopic = NULL;
+		state->mqttMessageTopic = NULL;
+		state->configPassedThroughUsername = NULL;
+		state->mqttClient = NULL;
+
+		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_060: [If any of the device resources cannot be created then IoTHubTransportMqtt_Register shall fail and return NULL.] */
+		if ((state->device_id = STRING_construct(device->deviceId)) == NULL)
+		{
+			LogError("Could not create device id for MQTT");
+			FreeDeviceData(state);
+			state = NULL;
+		}
+		else if ((device->deviceKey != NULL) && ((state->device_key = STRING_construct(device->deviceKey)) == NULL))
+		{
+			LogError("Could not create device key for MQTT");
+			FreeDeviceData(state);
+			state = NULL;
+		}
+		else if ((device->deviceSasToken != NULL) && ((state->sasTokenSr = STRING_construct(device->deviceSasToken)) == NULL))
+		{
+			LogError("Could not create Sas Token Sr String");
+			FreeDeviceData(state);
+			state = NULL;
+		}
+		else if ((device->deviceSasToken == NULL) && ((state->sasTokenSr = ConstructSasToken(hostAddress, device->deviceId)) == NULL))
+		{
+			LogError("Could not create Sas Token Sr String.");
+			FreeDeviceData(state);
+			state = NULL;
+		}
+		else if ((state->mqttEventTopic = ConstructEventTopic(device->deviceId)) == NULL)
+		{
+			LogError("Could not create mqttEventTopic for MQTT");
+			FreeDeviceData(state);
+			state = NULL;
+		}
+		else if ((state->mqttMessageTopic = ConstructMessageTopic(device->deviceId)) == NULL)
+		{
+			LogError("Could not create mqttMessageTopic for MQTT");
+			FreeDeviceData(state);
+			state = NULL;
+		}
+		else if ((state->mqttClient = mqtt_client_init(MqttRecvCallback, MqttOpCompleteCallback, state, defaultPrintLogFunction)) == NULL)
+		{
+			LogError("Could not create the MQTT client.");
+			FreeDeviceData(state);
+			state = NULL;
+		}
+		else if ((state->configPassedThroughUsername = buildConfigForUsername(hostAddress, device->deviceId)) == NULL)
+		{
+			LogError("Could not create the MQTT username.");
+			FreeDeviceData(state);
+			state = NULL;
+		}
+		else
+		{
+			if (transportState->logTrace)
+			{
+				mqtt_client_set_trace(state->mqttClient, true, true);
+			}
+			DList_InitializeListHead(&(state->waitingForAck));
+			memset(state->inflightTable, 0, sizeof(state->inflightTable));
+			state->transportState = transportState;
+			state->inflightCount = 0;
+			state->sasTokenFromUser = (device->deviceSasToken == NULL) ? false : true;
+			state->subscribed = false;
+			state->connected = false;
+			state->receiveMessages = false;
+			state->packetId = 1;
+			state->llClientHandle = iotHubClientHandle;
+			state->xioTransport = NULL;
+			state->waitingToSend = waitingToSend;
+			state->currPacketState = CONNECT_TYPE;
+			state->connectFailCount = 0;
+			state->connectTick = 0;
+			state->mqtt_connect_time = 0;
+		}
 	}
-    else
-    {
-        state->device_key = NULL;
-        state->sasTokenSr = NULL;
-
-        if ((upperConfig->deviceKey != NULL) && ((state->device_key = STRING_construct(upperConfig->deviceKey)) == NULL))
-        {
-            LogError("Could not create device key for MQTT");
-            STRING_delete(state->device_id);
-            free(state);
-            state = NULL;
-        }
-        else if ((upperConfig->deviceSasToken != NULL) && ((state->sasTokenSr = STRING_construct(upperConfig->deviceSasToken)) == NULL))
-        {
-            LogError("Could not create Sas Token Sr String");
-            STRING_delete(state->device_id);
-            STRING_delete(state->device_key);
-            free(state);
-            state = NULL;
-        }
-        else if ((upperConfig->deviceSasToken == NULL) && ((state->sasTokenSr = ConstructSasToken(upperConfig->iotHubName, upperConfig->iotHubSuffix, upperConfig->deviceId)) == NULL))
-        {
-            LogError("Could not create Sas Token Sr String.");
-            STRING_delete(state->device_id);
-            STRING_delete(state->device_key);
-            free(state);
-            state = NULL;
-        }
-        else if ((state->mqttEventTopic = ConstructEventTopic(upperConfig->deviceId)) == NULL)
-        {
-            LogError("Could not create mqttEventTopic for MQTT");
-            STRING_delete(state->sasTokenSr);
-            STRING_delete(state->device_key);
-            STRING_delete(state->device_id);
-            free(state);
-            state = NULL;
-        }
-        else if ((state->mqttMessageTopic = ConstructMessageTopic(upperConfig->deviceId)) == NULL)
-        {
-            LogError("Could not create mqttMessageTopic for MQTT");
-            STRING_delete(state->mqttEventTopic);
-            STRING_delete(state->sasTokenSr);
-            STRING_delete(state->device_key);
-            STRING_delete(state->device_id);
-            free(state);
-            state = NULL;
-        }
-        else
-        {
-            state->mqttClient = mqtt_client_init(MqttRecvCallback, MqttOpCompleteCallback, state, defaultPrintLogFunction);
-            if (state->mqttClient == NULL)
-            {
-                STRING_delete(state->mqttEventTopic);
-                STRING_delete(state->mqttMessageTopic);
-                STRING_delete(state->sasTokenSr);
-                STRING_delete(state->device_key);
-                STRING_delete(state->device_id);
-                free(state);
-                state = NULL;
-            }
-            else
-            {
-                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_008: [The hostname shall be constructed using the iothubname and iothubSuffix.] */
-                // TODO: need to strip the ssl or http or tls
-                char tempAddress[DEFAULT_TEMP_STRING_LEN];
-                (void)snprintf(tempAddress, DEFAULT_TEMP_STRING_LEN, "%s.%s", upperConfig->iotHubName, upperConfig->iotHubSuffix);
-                if ((state->hostAddress = STRING_construct(tempAddress)) == NULL)
-                {
-                    STRING_delete(state->mqttEventTopic);
-                    STRING_delete(state->mqttMessageTopic);
-                    STRING_delete(state->sasTokenSr);
-                    STRING_delete(state->device_key);
-                    STRING_delete(state->device_id);
-                    free(state);
-                    state = NULL;
-                }
-                else if ((state->configPassedThroughUsername = buildConfigForUsername(upperConfig)) == NULL)
-                {
-                    STRING_delete(state->hostAddress);
-                    STRING_delete(state->mqttEventTopic);
-                    STRING_delete(state->mqttMessageTopic);
-                    STRING_delete(state->sasTokenSr);
-                    STRING_delete(state->device_key);
-                    STRING_delete(state->device_id);
-                    free(state);
-                    state = NULL;
-                }
-                else
-                {
-                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_010: [IoTHubTransportMqtt_Create shall allocate memory to save its internal state where all topics, hostname, device_id, device_key, sasTokenSr and client handle shall be saved.] */
-                    DList_InitializeListHead(&(state->waitingForAck));
-                    state->sasTokenFromUser = (upperConfig->deviceSasToken == NULL) ? false : true;
-                    state->destroyCalled = false;
-                    state->isRegistered = false;
-                    state->subscribed = false;
-                    state->connected = false;
-                    state->receiveMessages = false;
-                    state->packetId = 1;
-                    state->llClientHandle = NULL;
-                    state->xioTransport = NULL;
-                    state->portNum = DEFAULT_PORT_NUMBER;
-                    state->waitingToSend = waitingToSend;
-                    state->currPacketState = CONNECT_TYPE;
-                    state->keepAliveValue = DEFAULT_MQTT_KEEPALIVE;
-                    state->connectFailCount = 0;
-                    state->connectTick = 0;
-                }
-            }
-        }
-    }
 	return state;
 }
 
 extern TRANSPORT_LL_HANDLE IoTHubTransportMqtt_Create(const IOTHUBTRANSPORT_CONFIG* config)
 {
 	PMQTTTRANSPORT_HANDLE_DATA result;
-	size_t deviceIdSize;
 
 	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_001: [If parameter config is NULL then IoTHubTransportMqtt_Create shall return NULL.] */
 	if (config == NULL)
@@ -899,45 +946,14 @@ extern TRANSPORT_LL_HANDLE IoTHubTransportMqtt_Create(const IOTHUBTRANSPORT_CONF
 		LogError("Invalid Argument: Config Parameter is NULL.");
 		result = NULL;
 	}
-	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_002: [If the parameter config's variables upperConfig or waitingToSend are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, both deviceKey and deviceSasToken, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-	else if (config->upperConfig == NULL || config->upperConfig->protocol == NULL || config->upperConfig->deviceId == NULL || ((config->upperConfig->deviceKey == NULL) && (config->upperConfig->deviceSasToken == NULL)) ||
-		config->upperConfig->iotHubName == NULL || config->upperConfig->iotHubSuffix == NULL)
+	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_002: [If the parameter config's variable upperConfig is NULL then IoTHubTransportMqtt_Create shall return NULL.] */
+	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
+	else if (config->upperConfig == NULL || config->upperConfig->protocol == NULL || config->upperConfig->iotHubName == NULL || config->upperConfig->iotHubSuffix == NULL)
 	{
 		LogError("Invalid Argument: upperConfig structure contains an invalid parameter");
 		result = NULL;
 	}
-	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_002: [If the parameter config's variables upperConfig or waitingToSend are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-	else if (config->waitingToSend == NULL)
-	{
-		LogError("Invalid Argument: waitingToSend is NULL)");
-		result = NULL;
-	}
-	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_006: [If the upperConfig's variables deviceId is an empty strings or length is greater then 128 then IoTHubTransportMqtt_Create shall return NULL.] */
-	else if ( ( (deviceIdSize = strlen(config->upperConfig->deviceId)) > 128U) || (deviceIdSize == 0) )
-	{
-		LogError("Invalid Argument: DeviceId is of an invalid size");
-		result = NULL;
-	}
-	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, both deviceKey and deviceSasToken, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-	else if ((config->upperConfig->deviceKey != NULL) && (strlen(config->upperConfig->deviceKey) == 0))
-	{
-		LogError("Invalid Argument: deviceKey is empty");
-		result = NULL;
-	}
-	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, both deviceKey and deviceSasToken, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-	else if ((config->upperConfig->deviceSasToken != NULL) && (strlen(config->upperConfig->deviceSasToken) == 0))
-	{
-		LogError("Invalid Argument: deviceSasToken is empty");
-		result = NULL;
-	}
-    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_03_003: [If both deviceKey & deviceSasToken fields are NOT NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-    else if ((config->upperConfig->deviceKey != NULL) && (config->upperConfig->deviceSasToken != NULL))
-    {
-        LogError("Invalid Argument: cannot have both deviceKey and deviceSasToken defined");
-        result = NULL;
-    }
-    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, deviceKey, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
+	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_005: [If the upperConfig's variable iotHubName is an empty string then IoTHubTransportMqtt_Create shall return NULL.] */
 	else if (strlen(config->upperConfig->iotHubName) == 0)
 	{
 		LogError("Invalid Argument: iotHubName is empty");
@@ -945,10 +961,45 @@ extern TRANSPORT_LL_HANDLE IoTHubTransportMqtt_Create(const IOTHUBTRANSPORT_CONF
 	}
 	else
 	{
-		result = InitializeTransportHandleData(config->upperConfig, config->waitingToSend);
-		if (result != NULL)
+		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_053: [IoTHubTransportMqtt_Create shall ignore the device fields of the upperConfig and the waitingToSend list; devices are added with IoTHubTransportMqtt_Register.] */
+		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_010: [IoTHubTransportMqtt_Create shall allocate memory to save its internal state where the hostname and the list of registered devices shall be saved.] */
+		result = (PMQTTTRANSPORT_HANDLE_DATA)malloc(sizeof(MQTTTRANSPORT_HANDLE_DATA));
+		if (result == NULL)
 		{
-			g_msgTickCounter = tickcounter_create();
+			LogError("Could not create MQTT transport state. Memory allocation failed.");
+		}
+		else
+		{
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_008: [The hostname shall be constructed using the iothubname and iothubSuffix.] */
+			// TODO: need to strip the ssl or http or tls
+			char tempAddress[DEFAULT_TEMP_STRING_LEN];
+			(void)snprintf(tempAddress, DEFAULT_TEMP_STRING_LEN, "%s.%s", config->upperConfig->iotHubName, config->upperConfig->iotHubSuffix);
+			if ((result->hostAddress = STRING_construct(tempAddress)) == NULL)
+			{
+				LogError("Could not create the host address.");
+				free(result);
+				result = NULL;
+			}
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_049: [IoTHubTransportMqtt_Create shall create a pool for the records of the messages waiting for PUBACK by calling NodePool_Create.] */
+			else if ((result->detailsPool = NodePool_Create(sizeof(MQTT_MESSAGE_DETAILS_LIST), DETAILS_POOL_GROWTH)) == NULL)
+			{
+				/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_050: [If NodePool_Create fails then IoTHubTransportMqtt_Create shall fail and return NULL.] */
+				LogError("Could not create the pool of MQTT message details.");
+				STRING_delete(result->hostAddress);
+				free(result);
+				result = NULL;
+			}
+			else
+			{
+				DList_InitializeListHead(&(result->registeredDevices));
+				result->nextDeviceToServe = &(result->registeredDevices);
+				result->portNum = DEFAULT_PORT_NUMBER;
+				result->keepAliveValue = DEFAULT_MQTT_KEEPALIVE;
+				result->maxInflightCount = INFLIGHT_TABLE_SIZE;
+				result->logTrace = false;
+				result->destroyCalled = false;
+				g_msgTickCounter = tickcounter_create();
+			}
 		}
 	}
 	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_009: [If any error is encountered then IoTHubTransportMqtt_Create shall return NULL.] */
@@ -956,20 +1007,43 @@ extern TRANSPORT_LL_HANDLE IoTHubTransportMqtt_Create(const IOTHUBTRANSPORT_CONF
 	return result;
 }
 
-static void DisconnectFromClient(PMQTTTRANSPORT_HANDLE_DATA transportState)
+static void DisconnectFromClient(PMQTTTRANSPORT_PERDEVICE_DATA deviceState)
 {
 	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_013: [If the parameter subscribe is true then IoTHubTransportMqtt_Destroy shall call IoTHubTransportMqtt_Unsubscribe.] */
-	if (transportState->subscribed)
+	if (deviceState->subscribed)
+	{
+		IoTHubTransportMqtt_Unsubscribe(deviceState);
+	}
+
+	(void)mqtt_client_disconnect(deviceState->mqttClient);
+	xio_destroy(deviceState->xioTransport);
+	deviceState->xioTransport = NULL;
+
+	deviceState->connected = false;
+	deviceState->currPacketState = DISCONNECT_TYPE;
+}
+
+static void UnregisterDevice(PMQTTTRANSPORT_PERDEVICE_DATA deviceState)
+{
+	PMQTTTRANSPORT_HANDLE_DATA transportState = deviceState->transportState;
+	if (transportState->nextDeviceToServe == &(deviceState->entry))
 	{
-		IoTHubTransportMqtt_Unsubscribe(transportState);
+		transportState->nextDeviceToServe = deviceState->entry.Flink;
 	}
+	(void)DList_RemoveEntryList(&(deviceState->entry));
 
-	(void)mqtt_client_disconnect(transportState->mqttClient);
-	xio_destroy(transportState->xioTransport);
-	transportState->xioTransport = NULL;
+	DisconnectFromClient(deviceState);
 
-	transportState->connected = false;
-	transportState->currPacketState = DISCONNECT_TYPE;
+	//Empty the Waiting for Ack Messages.
+	while (!DList_IsListEmpty(&deviceState->waitingForAck))
+	{
+		PDLIST_ENTRY currentEntry = DList_RemoveHeadList(&deviceState->waitingForAck);
+		MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
+		sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, deviceState, IOTHUB_BATCHSTATE_FAILED);
+		NodePool_Free(mqttMsgEntry);
+	}
+
+	FreeDeviceData(deviceState);
 }
 
 void IoTHubTransportMqtt_Destroy(TRANSPORT_LL_HANDLE handle)
@@ -980,26 +1054,15 @@ void IoTHubTransportMqtt_Destroy(TRANSPORT_LL_HANDLE handle)
 	{
 		transportState->destroyCalled = true;
 
-		DisconnectFromClient(transportState);
-
-		//Empty the Waiting for Ack Messages.
-		while (!DList_IsListEmpty(&transportState->waitingForAck))
+		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_054: [IoTHubTransportMqtt_Destroy shall unregister the devices that are still registered.] */
+		while (!DList_IsListEmpty(&transportState->registeredDevices))
 		{
-			PDLIST_ENTRY currentEntry = DList_RemoveHeadList(&transportState->waitingForAck);
-			MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
-			sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transportState, IOTHUB_BATCHSTATE_FAILED);
-			free(mqttMsgEntry);
+			UnregisterDevice(containingRecord(transportState->registeredDevices.Flink, MQTTTRANSPORT_PERDEVICE_DATA, entry));
 		}
 
 		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_014: [IoTHubTransportMqtt_Destroy shall free all the resources currently in use.] */
-		mqtt_client_deinit(transportState->mqttClient);
-		STRING_delete(transportState->mqttEventTopic);
-		STRING_delete(transportState->mqttMessageTopic);
-		STRING_delete(transportState->device_id);
-		STRING_delete(transportState->device_key);
-		STRING_delete(transportState->sasTokenSr);
 		STRING_delete(transportState->hostAddress);
-		STRING_delete(transportState->configPassedThroughUsername);
+		NodePool_Destroy(transportState->detailsPool);
 		tickcounter_destroy(g_msgTickCounter);
 		free(transportState);
 	}
@@ -1008,8 +1071,8 @@ void IoTHubTransportMqtt_Destroy(TRANSPORT_LL_HANDLE handle)
 int IoTHubTransportMqtt_Subscribe(IOTHUB_DEVICE_HANDLE handle)
 {
 	int result;
-	PMQTTTRANSPORT_HANDLE_DATA transportState = (PMQTTTRANSPORT_HANDLE_DATA)handle;
-	if (transportState == NULL)
+	PMQTTTRANSPORT_PERDEVICE_DATA deviceState = (PMQTTTRANSPORT_PERDEVICE_DATA)handle;
+	if (deviceState == NULL)
 	{
 		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_015: [If parameter handle is NULL than IoTHubTransportMqtt_Subscribe shall return a non-zero value.] */
 		LogError("Invalid handle parameter. NULL.");
@@ -1018,14 +1081,14 @@ int IoTHubTransportMqtt_Subscribe(IOTHUB_DEVICE_HANDLE handle)
 	else
 	{
 		/* Code_SRS_IOTHUB_MQTT_TRANSPORT_07_016: [IoTHubTransportMqtt_Subscribe shall set a flag to enable mqtt_client_subscribe to be called to subscribe to the Message Topic.] */
-		transportState->receiveMessages = true;
+		deviceState->receiveMessages = true;
 		/* Code_SRS_IOTHUB_MQTT_TRANSPORT_07_035: [If current packet state is not CONNACT, DISCONNECT_TYPE, or PACKET_TYPE_ERROR then IoTHubTransportMqtt_Subscribe shall set the packet state to SUBSCRIBE_TYPE.]*/
-		if (transportState->currPacketState != CONNACK_TYPE &&
-			transportState->currPacketState != CONNECT_TYPE &&
-			transportState->currPacketState != DISCONNECT_TYPE &&
-			transportState->currPacketState != PACKET_TYPE_ERROR)
+		if (deviceState->currPacketState != CONNACK_TYPE &&
+			deviceState->currPacketState != CONNECT_TYPE &&
+			deviceState->currPacketState != DISCONNECT_TYPE &&
+			deviceState->currPacketState != PACKET_TYPE_ERROR)
 		{
-			transportState->currPacketState = SUBSCRIBE_TYPE;
+			deviceState->currPacketState = SUBSCRIBE_TYPE;
 		}
 		result = 0;
 	}
@@ -1034,15 +1097,15 @@ int IoTHubTransportMqtt_Subscribe(IOTHUB_DEVICE_HANDLE handle)
 
 void IoTHubTransportMqtt_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
 {
-	PMQTTTRANSPORT_HANDLE_DATA transportState = (PMQTTTRANSPORT_HANDLE_DATA)handle;
+	PMQTTTRANSPORT_PERDEVICE_DATA deviceState = (PMQTTTRANSPORT_PERDEVICE_DATA)handle;
 	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_019: [If parameter handle is NULL then IoTHubTransportMqtt_Unsubscribe shall do nothing.] */
-	if (transportState != NULL && transportState->subscribed)
+	if (deviceState != NULL && deviceState->subscribed)
 	{
 		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_020: [IoTHubTransportMqtt_Unsubscribe shall call mqtt_client_unsubscribe to unsubscribe the mqtt message topic.] */
-		const char* unsubscribe[] = { STRING_c_str(transportState->mqttMessageTopic) };
-		(void)mqtt_client_unsubscribe(transportState->mqttClient, transportState->packetId++, unsubscribe, 1);
-		transportState->subscribed = false;
-		transportState->receiveMessages = false;
+		const char* unsubscribe[] = { STRING_c_str(deviceState->mqttMessageTopic) };
+		(void)mqtt_client_unsubscribe(deviceState->mqttClient, getNextPacketId(deviceState), unsubscribe, 1);
+		deviceState->subscribed = false;
+		deviceState->receiveMessages = false;
 	}
 	else
 	{
@@ -1050,119 +1113,155 @@ void IoTHubTransportMqtt_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
 	}
 }
 
-extern void IoTHubTransportMqtt_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+static void DoWorkForDevice(PMQTTTRANSPORT_PERDEVICE_DATA deviceState)
 {
-	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_026: [IoTHubTransportMqtt_DoWork shall do nothing if parameter handle and/or iotHubClientHandle is NULL.] */
-	PMQTTTRANSPORT_HANDLE_DATA transportState = (PMQTTTRANSPORT_HANDLE_DATA)handle;
-	if (transportState != NULL && iotHubClientHandle != NULL)
+	if (InitializeConnection(deviceState) != 0)
 	{
-		transportState->llClientHandle = iotHubClientHandle;
-
-		if (InitializeConnection(transportState) != 0)
+		// Don't want to flood the logs with failures here
+	}
+	else
+	{
+		if (deviceState->currPacketState == CONNACK_TYPE || deviceState->currPacketState == SUBSCRIBE_TYPE)
 		{
-			// Don't want to flood the logs with failures here
+			(void)SubscribeToMqttProtocol(deviceState);
 		}
-		else
+		else if (deviceState->currPacketState == SUBACK_TYPE)
 		{
-			if (transportState->currPacketState == CONNACK_TYPE || transportState->currPacketState == SUBSCRIBE_TYPE)
-			{
-				(void)SubscribeToMqttProtocol(transportState);
-			}
-			else if (transportState->currPacketState == SUBACK_TYPE)
-			{
-				// Publish can be called now
-				transportState->currPacketState = PUBLISH_TYPE;
-			}
-			else if (transportState->currPacketState == PUBLISH_TYPE)
+			// Publish can be called now
+			deviceState->currPacketState = PUBLISH_TYPE;
+		}
+		else if (deviceState->currPacketState == PUBLISH_TYPE)
+		{
+			PDLIST_ENTRY currentListEntry = deviceState->waitingForAck.Flink;
+			if (currentListEntry != &deviceState->waitingForAck)
 			{
-				PDLIST_ENTRY currentListEntry = transportState->waitingForAck.Flink;
-				while (currentListEntry != &transportState->waitingForAck)
+				/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_041: [The Waiting for Ack list shall be kept in publish time order so that IoTHubTransportMqtt_DoWork only needs to inspect the messages at its head for a resend.] */
+				PDLIST_ENTRY lastListEntry = deviceState->waitingForAck.Blink;
+				bool isDone = false;
+				uint64_t current_ms;
+				(void)tickcounter_get_current_ms(g_msgTickCounter, &current_ms);
+				while (!isDone)
 				{
 					MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
-					DLIST_ENTRY nextListEntry;
-					nextListEntry.Flink = currentListEntry->Flink;
+					PDLIST_ENTRY nextListEntry = currentListEntry->Flink;
+					isDone = (currentListEntry == lastListEntry);
 
-					uint64_t current_ms;
-					(void)tickcounter_get_current_ms(g_msgTickCounter, &current_ms);
 					/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_033: [IoTHubTransportMqtt_DoWork shall iterate through the Waiting Acknowledge messages looking for any message that has been waiting longer than 2 min.]*/
-					if (((current_ms - mqttMsgEntry->msgPublishTime) / 1000) > RESEND_TIMEOUT_VALUE_MIN)
+					if (((current_ms - mqttMsgEntry->msgPublishTime) / 1000) <= RESEND_TIMEOUT_VALUE_MIN)
 					{
-						/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_034: [If IoTHubTransportMqtt_DoWork has resent the message two times then it shall fail the message] */
-						if (mqttMsgEntry->retryCount >= MAX_SEND_RECOUNT_LIMIT)
+						// Everything after this message was published later
+						isDone = true;
+					}
+					/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_034: [If IoTHubTransportMqtt_DoWork has resent the message two times then it shall fail the message] */
+					else if (mqttMsgEntry->retryCount >= MAX_SEND_RECOUNT_LIMIT)
+					{
+						failInflightMessage(deviceState, mqttMsgEntry);
+					}
+					else
+					{
+						size_t messageLength;
+						const unsigned char* messagePayload = RetrieveMessagePayload(mqttMsgEntry->iotHubMessageEntry->messageHandle, &messageLength);
+						if (messageLength == 0 || messagePayload == NULL)
 						{
-							(void)DList_RemoveEntryList(currentListEntry);
-							sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transportState, IOTHUB_BATCHSTATE_FAILED);
-							free(mqttMsgEntry);
+							LogError("Failure from creating Message IoTHubMessage_GetData");
+						}
+						/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_042: [A resent message shall keep its packet id.] */
+						else if (publishMqttMessage(deviceState, mqttMsgEntry, messagePayload, messageLength) != 0)
+						{
+							failInflightMessage(deviceState, mqttMsgEntry);
 						}
 						else
 						{
-							size_t messageLength;
-							const unsigned char* messagePayload = RetrieveMessagePayload(mqttMsgEntry->iotHubMessageEntry->messageHandle, &messageLength);
-							if (messageLength == 0 || messagePayload == NULL)
-							{
-								LogError("Failure from creating Message IoTHubMessage_GetData");
-							}
-							else
-							{
-								if (publishMqttMessage(transportState, mqttMsgEntry, messagePayload, messageLength) != 0)
-								{
-									(void)DList_RemoveEntryList(currentListEntry);
-									sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transportState, IOTHUB_BATCHSTATE_FAILED);
-									free(mqttMsgEntry);
-								}
-							}
+							/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_043: [A resent message shall be moved to the end of the Waiting for Ack list.] */
+							(void)DList_RemoveEntryList(currentListEntry);
+							DList_InsertTailList(&(deviceState->waitingForAck), currentListEntry);
 						}
 					}
-					currentListEntry = nextListEntry.Flink;
+					currentListEntry = nextListEntry;
 				}
+			}
+
+			currentListEntry = deviceState->waitingToSend->Flink;
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_044: [If the in flight table is full then IoTHubTransportMqtt_DoWork shall leave the remaining messages in the waitingToSend list.] */
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_045: [IoTHubTransportMqtt_DoWork shall not publish a message while the number of messages waiting for PUBACK is equal to the "maxinflight" option.] */
+			while (currentListEntry != deviceState->waitingToSend && deviceState->inflightCount < deviceState->transportState->maxInflightCount)
+			{
+				IOTHUB_MESSAGE_LIST* iothubMsgList = containingRecord(currentListEntry, IOTHUB_MESSAGE_LIST, entry);
+				DLIST_ENTRY savedFromCurrentListEntry;
+				savedFromCurrentListEntry.Flink = currentListEntry->Flink;
 
-				currentListEntry = transportState->waitingToSend->Flink;
 				/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
-				while (currentListEntry != transportState->waitingToSend)
+				size_t messageLength;
+				const unsigned char* messagePayload = RetrieveMessagePayload(iothubMsgList->messageHandle, &messageLength);
+				if (messageLength == 0 || messagePayload == NULL)
 				{
-					IOTHUB_MESSAGE_LIST* iothubMsgList = containingRecord(currentListEntry, IOTHUB_MESSAGE_LIST, entry);
-					DLIST_ENTRY savedFromCurrentListEntry;
-					savedFromCurrentListEntry.Flink = currentListEntry->Flink;
-
-					/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
-					size_t messageLength;
-					const unsigned char* messagePayload = RetrieveMessagePayload(iothubMsgList->messageHandle, &messageLength);
-					if (messageLength == 0 || messagePayload == NULL)
+					LogError("Failure result from IoTHubMessage_GetData");
+				}
+				else
+				{
+					/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_029: [IoTHubTransportMqtt_DoWork shall create a MQTT_MESSAGE_HANDLE and pass this to a call to mqtt_client_publish.] */
+					MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)NodePool_Alloc(deviceState->transportState->detailsPool);
+					if (mqttMsgEntry == NULL)
 					{
-						LogError("Failure result from IoTHubMessage_GetData");
+						LogError("Allocation Error: Failure allocating MQTT Message Detail List.");
 					}
 					else
 					{
-						/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_029: [IoTHubTransportMqtt_DoWork shall create a MQTT_MESSAGE_HANDLE and pass this to a call to mqtt_client_publish.] */
-						MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST));
-						if (mqttMsgEntry == NULL)
+						mqttMsgEntry->retryCount = 0;
+						mqttMsgEntry->msgPacketId = getNextPublishPacketId(deviceState);
+						mqttMsgEntry->iotHubMessageEntry = iothubMsgList;
+
+						if (publishMqttMessage(deviceState, mqttMsgEntry, messagePayload, messageLength) != 0)
 						{
-							LogError("Allocation Error: Failure allocating MQTT Message Detail List.");
+							(void)(DList_RemoveEntryList(currentListEntry));
+							sendMsgComplete(iothubMsgList, deviceState, IOTHUB_BATCHSTATE_FAILED);
+							NodePool_Free(mqttMsgEntry);
 						}
 						else
 						{
-							mqttMsgEntry->retryCount = 0;
-							mqttMsgEntry->msgPacketId = transportState->packetId;
-							mqttMsgEntry->iotHubMessageEntry = iothubMsgList;
-
-							if (publishMqttMessage(transportState, mqttMsgEntry, messagePayload, messageLength) != 0)
-							{
-								(void)(DList_RemoveEntryList(currentListEntry));
-								sendMsgComplete(iothubMsgList, transportState, IOTHUB_BATCHSTATE_FAILED);
-								free(mqttMsgEntry);
-							}
-							else
-							{
-								(void)(DList_RemoveEntryList(currentListEntry));
-								DList_InsertTailList(&(transportState->waitingForAck), &(mqttMsgEntry->entry));
-							}
+							(void)(DList_RemoveEntryList(currentListEntry));
+							DList_InsertTailList(&(deviceState->waitingForAck), &(mqttMsgEntry->entry));
+							addInflightMessage(deviceState, mqttMsgEntry);
 						}
 					}
-					currentListEntry = savedFromCurrentListEntry.Flink;
 				}
+				currentListEntry = savedFromCurrentListEntry.Flink;
 			}
-			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_030: [IoTHubTransportMqtt_DoWork shall call mqtt_client_dowork everytime it is called if it is connected.] */
-			mqtt_client_dowork(transportState->mqttClient);
+		}
+		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_030: [IoTHubTransportMqtt_DoWork shall call mqtt_client_dowork everytime it is called if it is connected.] */
+		mqtt_client_dowork(deviceState->mqttClient);
+	}
+}
+
+extern void IoTHubTransportMqtt_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_026: [IoTHubTransportMqtt_DoWork shall do nothing if parameter handle is NULL.] */
+	PMQTTTRANSPORT_HANDLE_DATA transportState = (PMQTTTRANSPORT_HANDLE_DATA)handle;
+	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_055: [IoTHubTransportMqtt_DoWork shall ignore the iotHubClientHandle parameter; each device uses the client handle it was registered with.] */
+	(void)iotHubClientHandle;
+	if (transportState != NULL)
+	{
+		PDLIST_ENTRY firstListEntry = transportState->nextDeviceToServe;
+		if (firstListEntry == &(transportState->registeredDevices))
+		{
+			firstListEntry = firstListEntry->Flink;
+		}
+
+		if (firstListEntry != &(transportState->registeredDevices))
+		{
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_056: [IoTHubTransportMqtt_DoWork shall connect, publish and call mqtt_client_dowork for every registered device, starting with the device that follows the one the previous call started with.] */
+			PDLIST_ENTRY currentListEntry = firstListEntry;
+			transportState->nextDeviceToServe = firstListEntry->Flink;
+			do
+			{
+				PDLIST_ENTRY nextListEntry = currentListEntry->Flink;
+				if (currentListEntry != &(transportState->registeredDevices))
+				{
+					DoWorkForDevice(containingRecord(currentListEntry, MQTTTRANSPORT_PERDEVICE_DATA, entry));
+				}
+				currentListEntry = nextListEntry;
+			} while (currentListEntry != firstListEntry);
 		}
 	}
 }
@@ -1179,8 +1278,21 @@ IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_GetSendStatus(IOTHUB_DEVICE_HANDLE hand
 	}
 	else
 	{
-		MQTTTRANSPORT_HANDLE_DATA* handleData = (MQTTTRANSPORT_HANDLE_DATA*)handle;
-		if (!DList_IsListEmpty(handleData->waitingToSend) || !DList_IsListEmpty(&(handleData->waitingForAck)))
+		MQTTTRANSPORT_PERDEVICE_DATA* handleData = (MQTTTRANSPORT_PERDEVICE_DATA*)handle;
+		if (!DList_IsListEmpty(handleData->waitingToSend))
+		{
+			if (handleData->inflightCount >= handleData->transportState->maxInflightCount)
+			{
+				/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_047: [IoTHubTransportMqtt_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_FULL if there are event items to be sent and the in flight window is full.] */
+				*iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_FULL;
+			}
+			else
+			{
+				/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_025: [IoTHubTransportMqtt_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent.] */
+				*iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+			}
+		}
+		else if (!DList_IsListEmpty(&(handleData->waitingForAck)))
 		{
 			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_025: [IoTHubTransportMqtt_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent.] */
 			*iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
@@ -1195,6 +1307,16 @@ IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_GetSendStatus(IOTHUB_DEVICE_HANDLE hand
 	return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_SendMessageDisposition(IOTHUB_DEVICE_HANDLE handle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition)
+{
+	(void)handle;
+	(void)message;
+	(void)disposition;
+	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_065: [IoTHubTransportMqtt_SendMessageDisposition shall return IOTHUB_CLIENT_ERROR, messages received over MQTT are completed when they are delivered.] */
+	LogError("asynchronous message disposition is not supported by the MQTT transport.");
+	return IOTHUB_CLIENT_ERROR;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_SetOption(TRANSPORT_LL_HANDLE handle, const char* option, const void* value)
 {
 	/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_021: [If any parameter is NULL then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
@@ -1211,11 +1333,18 @@ IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_SetOption(TRANSPORT_LL_HANDLE handle, c
 	else
 	{
 		MQTTTRANSPORT_HANDLE_DATA* transportState = (MQTTTRANSPORT_HANDLE_DATA*)handle;
+		PDLIST_ENTRY currentListEntry;
 		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_031: [If the option parameter is set to "logtrace" then the value shall be a bool_ptr and the value will determine if the mqtt client log is on or off.] */
 		if (strcmp("logtrace", option) == 0)
 		{
 			bool* traceVal = (bool*)value;
-			mqtt_client_set_trace(transportState->mqttClient, *traceVal, *traceVal);
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_061: [The "logtrace" option shall apply to the MQTT client of every registered device and of the devices registered later.] */
+			transportState->logTrace = *traceVal;
+			for (currentListEntry = transportState->registeredDevices.Flink; currentListEntry != &(transportState->registeredDevices); currentListEntry = currentListEntry->Flink)
+			{
+				PMQTTTRANSPORT_PERDEVICE_DATA deviceState = containingRecord(currentListEntry, MQTTTRANSPORT_PERDEVICE_DATA, entry);
+				mqtt_client_set_trace(deviceState->mqttClient, *traceVal, *traceVal);
+			}
 			result = IOTHUB_CLIENT_OK;
 		}
 		else if (strcmp("keepalive", option) == 0)
@@ -1226,33 +1355,77 @@ IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_SetOption(TRANSPORT_LL_HANDLE handle, c
 			if (*keepAliveOption != transportState->keepAliveValue)
 			{
 				transportState->keepAliveValue = *keepAliveOption;
-				if (transportState->connected)
+				for (currentListEntry = transportState->registeredDevices.Flink; currentListEntry != &(transportState->registeredDevices); currentListEntry = currentListEntry->Flink)
 				{
-					/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_038: [If the client is connected when the keepalive is set then IoTHubTransportMqtt_SetOption shall disconnect and reconnect with the specified keepalive value.] */
-					DisconnectFromClient(transportState);
+					PMQTTTRANSPORT_PERDEVICE_DATA deviceState = containingRecord(currentListEntry, MQTTTRANSPORT_PERDEVICE_DATA, entry);
+					if (deviceState->connected)
+					{
+						/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_038: [Every device that is connected when the keepalive is set shall be disconnected by IoTHubTransportMqtt_SetOption and reconnect with the specified keepalive value.] */
+						DisconnectFromClient(deviceState);
+					}
 				}
 			}
 			result = IOTHUB_CLIENT_OK;
 		}
+		else if (strcmp("maxinflight", option) == 0)
+		{
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_046: [If the option parameter is set to "maxinflight" then the value shall be a size_t_ptr and the value will determine the maximum number of messages of each device waiting for PUBACK.] */
+			size_t maxInflight = *(const size_t*)value;
+			if (maxInflight == 0 || maxInflight > INFLIGHT_TABLE_SIZE)
+			{
+				/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_048: [If the "maxinflight" value is 0 or greater than 256 then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+				LogError("maxinflight must be between 1 and %d.", INFLIGHT_TABLE_SIZE);
+				result = IOTHUB_CLIENT_INVALID_ARG;
+			}
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_051: [When "maxinflight" is set IoTHubTransportMqtt_SetOption shall call NodePool_Reserve so that a full window of messages does not allocate from the heap.] */
+			else if (NodePool_Reserve(transportState->detailsPool, maxInflight) != 0)
+			{
+				/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_052: [If NodePool_Reserve fails then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_ERROR.] */
+				LogError("Could not reserve %lu MQTT message details.", (unsigned long)maxInflight);
+				result = IOTHUB_CLIENT_ERROR;
+			}
+			else
+			{
+				transportState->maxInflightCount = maxInflight;
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		else if (strcmp("AsyncMessageDisposition", option) == 0)
+		{
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_138: [If the option parameter is set to "AsyncMessageDisposition" then the value shall be a bool_ptr. IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_ERROR when it is true, since MQTT completes a message when it is delivered, and IOTHUB_CLIENT_OK when it is false.] */
+			if (*(const bool*)value)
+			{
+				LogError("asynchronous message disposition is not supported by the MQTT transport.");
+				result = IOTHUB_CLIENT_ERROR;
+			}
+			else
+			{
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_062: [If no device is registered IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_ERROR for an option that is not a known option string for the MQTT transport.] */
+		else if (DList_IsListEmpty(&(transportState->registeredDevices)))
+		{
+			LogError("No device is registered, option %s cannot be passed to the TLS layer.", option);
+			result = IOTHUB_CLIENT_ERROR;
+		}
 		else
 		{
-			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_032: [IoTHubTransportMqtt_SetOption shall pass down the option to xio_setoption if the option parameter is not a known option string for the MQTT transport.] */
-			if (GetTransportProviderIfNecessary(transportState) == 0)
+			/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_032: [IoTHubTransportMqtt_SetOption shall pass down the option to xio_setoption of every registered device if the option parameter is not a known option string for the MQTT transport.] */
+			result = IOTHUB_CLIENT_OK;
+			for (currentListEntry = transportState->registeredDevices.Flink; currentListEntry != &(transportState->registeredDevices) && result == IOTHUB_CLIENT_OK; currentListEntry = currentListEntry->Flink)
 			{
-				if (xio_setoption(transportState->xioTransport, option, value) == 0)
+				PMQTTTRANSPORT_PERDEVICE_DATA deviceState = containingRecord(currentListEntry, MQTTTRANSPORT_PERDEVICE_DATA, entry);
+				if (GetTransportProviderIfNecessary(deviceState) != 0)
 				{
-					result = IOTHUB_CLIENT_OK;
+					result = IOTHUB_CLIENT_ERROR;
 				}
-				else
+				else if (xio_setoption(deviceState->xioTransport, option, value) != 0)
 				{
 					/* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_132: [IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_INVALID_ARG xio_setoption fails] */
 					result = IOTHUB_CLIENT_INVALID_ARG;
 				}
 			}
-			else
-			{
-				result = IOTHUB_CLIENT_ERROR;
-			}
 		}
 	}
 	return result;
@@ -1261,60 +1434,74 @@ IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_SetOption(TRANSPORT_LL_HANDLE handle, c
 IOTHUB_DEVICE_HANDLE IoTHubTransportMqtt_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, PDLIST_ENTRY waitingToSend)
 {
 	IOTHUB_DEVICE_HANDLE result;
+	size_t deviceIdSize;
 	// Codes_SRS_IOTHUB_MQTT_TRANSPORT_17_001: [ IoTHubTransportMqtt_Register shall return NULL if the TRANSPORT_LL_HANDLE is NULL.]
 	// Codes_SRS_IOTHUB_MQTT_TRANSPORT_17_002: [ IoTHubTransportMqtt_Register shall return NULL if device or waitingToSend are NULL.]
 	if ((handle == NULL) || (device == NULL) || (waitingToSend == NULL))
 	{
-        LogError("IoTHubTransportMqtt_Register: handle, device or waitingToSend is NULL.");
-        result = NULL;
+		LogError("IoTHubTransportMqtt_Register: handle, device or waitingToSend is NULL.");
+		result = NULL;
+	}
+	// Codes_SRS_IOTHUB_MQTT_TRANSPORT_03_001: [ IoTHubTransportMqtt_Register shall return NULL if deviceId, or both deviceKey and deviceSasToken are NULL.]
+	else if (device->deviceId == NULL)
+	{
+		LogError("IoTHubTransportMqtt_Register: deviceId is NULL.");
+		result = NULL;
+	}
+	else if ((device->deviceKey == NULL) && (device->deviceSasToken == NULL))
+	{
+		LogError("IoTHubTransportMqtt_Register: deviceKey and deviceSasToken are NULL.");
+		result = NULL;
+	}
+	// Codes_SRS_IOTHUB_MQTT_TRANSPORT_03_002: [ IoTHubTransportMqtt_Register shall return NULL if both deviceKey and deviceSasToken are provided.]
+	else if ((device->deviceKey != NULL) && (device->deviceSasToken != NULL))
+	{
+		LogError("IoTHubTransportMqtt_Register: Both deviceKey and deviceSasToken are defined. Only one can be used.");
+		result = NULL;
+	}
+	// Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_057: [ IoTHubTransportMqtt_Register shall return NULL if deviceId is an empty string or its length is greater than 128.]
+	else if (((deviceIdSize = strlen(device->deviceId)) > 128U) || (deviceIdSize == 0))
+	{
+		LogError("IoTHubTransportMqtt_Register: DeviceId is of an invalid size");
+		result = NULL;
+	}
+	// Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_058: [ IoTHubTransportMqtt_Register shall return NULL if deviceKey or deviceSasToken is an empty string.]
+	else if (((device->deviceKey != NULL) && (strlen(device->deviceKey) == 0)) ||
+		((device->deviceSasToken != NULL) && (strlen(device->deviceSasToken) == 0)))
+	{
+		LogError("IoTHubTransportMqtt_Register: deviceKey or deviceSasToken is empty");
+		result = NULL;
 	}
 	else
 	{
 		MQTTTRANSPORT_HANDLE_DATA* transportState = (MQTTTRANSPORT_HANDLE_DATA*)handle;
+		PDLIST_ENTRY currentListEntry = transportState->registeredDevices.Flink;
 
-		// Codes_SRS_IOTHUB_MQTT_TRANSPORT_03_001: [ IoTHubTransportMqtt_Register shall return NULL if deviceId, or both deviceKey and deviceSasToken are NULL.]
-		if (device->deviceId == NULL)
-		{
-            LogError("IoTHubTransportMqtt_Register: deviceId is NULL.");
-            result = NULL;
-		}
-		else if ((device->deviceKey == NULL) && (device->deviceSasToken == NULL))
+		// Codes_SRS_IOTHUB_MQTT_TRANSPORT_17_003: [ IoTHubTransportMqtt_Register shall return NULL if a device with the same deviceId is already registered with the transport.]
+		while (currentListEntry != &(transportState->registeredDevices) &&
+			strcmp(STRING_c_str(containingRecord(currentListEntry, MQTTTRANSPORT_PERDEVICE_DATA, entry)->device_id), device->deviceId) != 0)
 		{
-            LogError("IoTHubTransportMqtt_Register: deviceKey and deviceSasToken are NULL.");
-            result = NULL;
+			currentListEntry = currentListEntry->Flink;
 		}
-		// Codes_SRS_IOTHUB_MQTT_TRANSPORT_03_002: [ IoTHubTransportMqtt_Register shall return NULL if both deviceKey and deviceSasToken are provided.]
-		else if ((device->deviceKey != NULL) && (device->deviceSasToken != NULL))
+
+		if (currentListEntry != &(transportState->registeredDevices))
 		{
-            LogError("IoTHubTransportMqtt_Register: Both deviceKey and deviceSasToken are defined. Only one can be used.");
-            result = NULL;
+			LogError("Transport already has device registered by id: [%s]", device->deviceId);
+			result = NULL;
 		}
 		else
 		{
-			// Codes_SRS_IOTHUB_MQTT_TRANSPORT_17_003: [ IoTHubTransportMqtt_Register shall return NULL if deviceId or deviceKey do not match the deviceId and deviceKey passed in during IoTHubTransportMqtt_Create.]
-			if (strcmp(STRING_c_str(transportState->device_id), device->deviceId) != 0)
-			{
-                LogError("IoTHubTransportMqtt_Register: deviceId does not match.");
-                result = NULL;
-			}
-			else if ((device->deviceKey != NULL) && (strcmp(STRING_c_str(transportState->device_key), device->deviceKey) != 0))
+			PMQTTTRANSPORT_PERDEVICE_DATA deviceState = InitializeDeviceData(transportState, device, iotHubClientHandle, waitingToSend);
+			if (deviceState == NULL)
 			{
-                LogError("IoTHubTransportMqtt_Register: deviceKey does not match.");
-                result = NULL;
+				result = NULL;
 			}
 			else
 			{
-				if (transportState->isRegistered == true)
-				{
-					LogError("Transport already has device registered by id: [%s]", device->deviceId);
-					result = NULL;
-				}
-				else
-				{
-					transportState->isRegistered = true;
-					// Codes_SRS_IOTHUB_MQTT_TRANSPORT_17_004: [ IoTHubTransportMqtt_Register shall return the TRANSPORT_LL_HANDLE as the IOTHUB_DEVICE_HANDLE. ]
-					result = (IOTHUB_DEVICE_HANDLE)handle;
-				}
+				// Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_063: [ IoTHubTransportMqtt_Register shall add the device to the devices served by IoTHubTransportMqtt_DoWork.]
+				DList_InsertTailList(&(transportState->registeredDevices), &(deviceState->entry));
+				// Codes_SRS_IOTHUB_MQTT_TRANSPORT_17_004: [ IoTHubTransportMqtt_Register shall return the state of the device as the IOTHUB_DEVICE_HANDLE. ]
+				result = (IOTHUB_DEVICE_HANDLE)deviceState;
 			}
 		}
 	}
@@ -1322,14 +1509,17 @@ IOTHUB_DEVICE_HANDLE IoTHubTransportMqtt_Register(TRANSPORT_LL_HANDLE handle, co
 	return result;
 }
 
-// Codes_SRS_IOTHUB_MQTT_TRANSPORT_17_005: [ IoTHubTransportMqtt_Unregister shall return. ]
 void IoTHubTransportMqtt_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
 {
-	if (deviceHandle != NULL)
+	// Codes_SRS_IOTHUB_MQTT_TRANSPORT_17_005: [ IoTHubTransportMqtt_Unregister shall do nothing if deviceHandle is NULL. ]
+	if (deviceHandle == NULL)
 	{
-		MQTTTRANSPORT_HANDLE_DATA* transportState = (MQTTTRANSPORT_HANDLE_DATA*)deviceHandle;
-
-		transportState->isRegistered = false;
+		LogError("IoTHubTransportMqtt_Unregister: deviceHandle is NULL.");
+	}
+	else
+	{
+		// Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_064: [ IoTHubTransportMqtt_Unregister shall disconnect the device, fail its messages waiting for PUBACK, remove it from the transport and free its resources. ]
+		UnregisterDevice((PMQTTTRANSPORT_PERDEVICE_DATA)deviceHandle);
 	}
 }
 
@@ -1342,7 +1532,8 @@ TRANSPORT_PROVIDER myfunc = {
 	IoTHubTransportMqtt_Subscribe,
 	IoTHubTransportMqtt_Unsubscribe,
 	IoTHubTransportMqtt_DoWork,
-	IoTHubTransportMqtt_GetSendStatus
+	IoTHubTransportMqtt_GetSendStatus,
+	IoTHubTransportMqtt_SendMessageDisposition
 };
 
 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_022: [This function shall return a pointer to a structure of type TRANSPORT_PROVIDER having the following values for its fields: IoTHubTransport_Create = IoTHubTransportMqtt_Create
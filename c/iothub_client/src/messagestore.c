@@ -0,0 +1,660 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/iot_logging.h"
+
+#include "messagestore.h"
+
+/*the appended records are handed from the stdio buffer to the disk with fsync, or _commit (FlushFileBuffers) on Windows*/
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/*every record is preceded by its size, 4 bytes little endian*/
+#define RECORD_HEADER_SIZE 4
+#define MAX_SEGMENT_NUMBER_LENGTH 20
+#define DEFAULT_SYNC_INTERVAL 1
+
+typedef struct MESSAGESTORE_SEGMENT_TAG
+{
+    unsigned long number;
+    size_t recordCount;
+    size_t readCount;
+    size_t confirmedCount;
+    struct MESSAGESTORE_SEGMENT_TAG* next;
+} MESSAGESTORE_SEGMENT;
+
+typedef struct MESSAGESTORE_TAG
+{
+    char* path;
+    char* fileName; /*scratch buffer big enough for "path.N" and "path.head"*/
+    size_t segmentSize;
+    unsigned long firstSegmentOfThisStore;
+    MESSAGESTORE_SEGMENT* oldest;
+    MESSAGESTORE_SEGMENT* newest; /*records are appended to this one*/
+    MESSAGESTORE_SEGMENT* reading; /*segment of the next record to read*/
+    size_t unreadCount;
+    FILE* writeFile;
+    size_t writeSize;
+    bool writeFileDirty; /*appended bytes might still sit in the stdio buffer of writeFile*/
+    size_t syncInterval; /*appends between two syncs of writeFile, 0 leaves it to the OS*/
+    size_t unsyncedCount; /*records appended since writeFile was last synced*/
+    FILE* readFile; /*open on reading, NULL until the first record of reading is read*/
+    unsigned char* readBuffer;
+    size_t readBufferSize;
+} MESSAGESTORE;
+
+static const char* segmentFileName(MESSAGESTORE* store, unsigned long number)
+{
+    (void)sprintf(store->fileName, "%s.%lu", store->path, number);
+    return store->fileName;
+}
+
+static const char* headFileName(MESSAGESTORE* store)
+{
+    (void)sprintf(store->fileName, "%s.head", store->path);
+    return store->fileName;
+}
+
+static unsigned long readHead(MESSAGESTORE* store)
+{
+    unsigned long result;
+    FILE* head = fopen(headFileName(store), "r");
+    if (head == NULL)
+    {
+        /*a new store*/
+        result = 0;
+    }
+    else
+    {
+        if (fscanf(head, "%lu", &result) != 1)
+        {
+            LogError("%s is corrupted, starting from segment 0", store->fileName);
+            result = 0;
+        }
+        (void)fclose(head);
+    }
+    return result;
+}
+
+static int writeHead(MESSAGESTORE* store, unsigned long number)
+{
+    int result;
+    FILE* head = fopen(headFileName(store), "w");
+    if (head == NULL)
+    {
+        LogError("unable to open %s", store->fileName);
+        result = __LINE__;
+    }
+    else
+    {
+        if (fprintf(head, "%lu", number) < 0)
+        {
+            LogError("unable to write %s", store->fileName);
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+        if (fclose(head) != 0)
+        {
+            result = __LINE__;
+        }
+    }
+    return result;
+}
+
+static size_t decodeRecordSize(const unsigned char header[RECORD_HEADER_SIZE])
+{
+    return (size_t)header[0] | ((size_t)header[1] << 8) | ((size_t)header[2] << 16) | ((size_t)header[3] << 24);
+}
+
+/*returns 0 and the number of complete records of an existing segment. A record cut short by the end of the process is not counted*/
+static int countRecords(MESSAGESTORE* store, unsigned long number, size_t* recordCount)
+{
+    int result;
+    FILE* segment = fopen(segmentFileName(store, number), "rb");
+    if (segment == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        long fileSize;
+        if ((fseek(segment, 0, SEEK_END) != 0) || ((fileSize = ftell(segment)) < 0))
+        {
+            LogError("unable to get the size of %s", store->fileName);
+            result = __LINE__;
+        }
+        else
+        {
+            unsigned char header[RECORD_HEADER_SIZE];
+            long offset = 0;
+            *recordCount = 0;
+            while ((fileSize - offset >= RECORD_HEADER_SIZE) &&
+                (fseek(segment, offset, SEEK_SET) == 0) &&
+                (fread(header, 1, RECORD_HEADER_SIZE, segment) == RECORD_HEADER_SIZE))
+            {
+                size_t recordSize = decodeRecordSize(header);
+                if (recordSize > (size_t)(fileSize - offset - RECORD_HEADER_SIZE))
+                {
+                    break;
+                }
+                offset += RECORD_HEADER_SIZE + (long)recordSize;
+                (*recordCount)++;
+            }
+            result = 0;
+        }
+        (void)fclose(segment);
+    }
+    return result;
+}
+
+static MESSAGESTORE_SEGMENT* addSegment(MESSAGESTORE* store, unsigned long number, size_t recordCount)
+{
+    MESSAGESTORE_SEGMENT* result = (MESSAGESTORE_SEGMENT*)malloc(sizeof(MESSAGESTORE_SEGMENT));
+    if (result == NULL)
+    {
+        LogError("unable to malloc");
+    }
+    else
+    {
+        result->number = number;
+        result->recordCount = recordCount;
+        result->readCount = 0;
+        result->confirmedCount = 0;
+        result->next = NULL;
+        if (store->newest == NULL)
+        {
+            store->oldest = result;
+            store->reading = result;
+        }
+        else
+        {
+            store->newest->next = result;
+        }
+        store->newest = result;
+        store->unreadCount += recordCount;
+    }
+    return result;
+}
+
+/*writes what was appended to writeFile through to the disk, so that it survives the end of the process and of the OS*/
+static int syncWriteFile(MESSAGESTORE* store)
+{
+    int result;
+    if (fflush(store->writeFile) != 0)
+    {
+        LogError("unable to flush segment %lu", store->newest->number);
+        result = __LINE__;
+    }
+#if defined(_WIN32)
+    else if (_commit(_fileno(store->writeFile)) != 0)
+#else
+    else if (fsync(fileno(store->writeFile)) != 0)
+#endif
+    {
+        LogError("unable to sync segment %lu", store->newest->number);
+        result = __LINE__;
+    }
+    else
+    {
+        store->writeFileDirty = false;
+        store->unsyncedCount = 0;
+        result = 0;
+    }
+    return result;
+}
+
+/*starts a new segment that becomes the one records are appended to*/
+static int startSegment(MESSAGESTORE* store, unsigned long number)
+{
+    int result;
+    FILE* file = fopen(segmentFileName(store, number), "wb");
+    if (file == NULL)
+    {
+        LogError("unable to create %s", store->fileName);
+        result = __LINE__;
+    }
+    else if (addSegment(store, number, 0) == NULL)
+    {
+        (void)fclose(file);
+        (void)remove(segmentFileName(store, number));
+        result = __LINE__;
+    }
+    else
+    {
+        if (store->writeFile != NULL)
+        {
+            if ((store->unsyncedCount > 0) && (syncWriteFile(store) != 0))
+            {
+                LogError("the last records of the previous segment might not be on the disk");
+            }
+            (void)fclose(store->writeFile);
+        }
+        store->writeFile = file;
+        store->writeSize = 0;
+        store->writeFileDirty = false;
+        store->unsyncedCount = 0;
+        result = 0;
+    }
+    return result;
+}
+
+static void closeReadFile(MESSAGESTORE* store)
+{
+    if (store->readFile != NULL)
+    {
+        (void)fclose(store->readFile);
+        store->readFile = NULL;
+    }
+}
+
+/*deletes the oldest segments for as long as all their records have been read and confirmed*/
+static void trim(MESSAGESTORE* store)
+{
+    while (
+        (store->oldest != store->newest) &&
+        (store->oldest->readCount == store->oldest->recordCount) &&
+        (store->oldest->confirmedCount >= store->oldest->recordCount)
+        )
+    {
+        MESSAGESTORE_SEGMENT* trimmed = store->oldest;
+        /*the head is moved first, so that a segment is never needed once the head has gone past it*/
+        if (writeHead(store, trimmed->next->number) != 0)
+        {
+            LogError("unable to move the head of the store, segment %lu is kept", trimmed->number);
+            break;
+        }
+        if (store->reading == trimmed)
+        {
+            closeReadFile(store);
+            store->reading = trimmed->next;
+        }
+        if (remove(segmentFileName(store, trimmed->number)) != 0)
+        {
+            LogError("unable to delete %s", store->fileName);
+        }
+        store->oldest = trimmed->next;
+        free(trimmed);
+    }
+}
+
+static void destroySegments(MESSAGESTORE* store)
+{
+    while (store->oldest != NULL)
+    {
+        MESSAGESTORE_SEGMENT* next = store->oldest->next;
+        free(store->oldest);
+        store->oldest = next;
+    }
+    store->newest = NULL;
+    store->reading = NULL;
+}
+
+MESSAGESTORE_HANDLE MessageStore_Create(const char* path, size_t segmentSize)
+{
+    MESSAGESTORE* result;
+    /*Codes_SRS_MESSAGESTORE_02_001: [ If path is NULL or segmentSize is 0 then MessageStore_Create shall fail and return NULL. ]*/
+    if ((path == NULL) || (segmentSize == 0))
+    {
+        LogError("invalid arg const char* path=%p, size_t segmentSize=%lu", path, (unsigned long)segmentSize);
+        result = NULL;
+    }
+    else if ((result = (MESSAGESTORE*)malloc(sizeof(MESSAGESTORE))) == NULL)
+    {
+        /*Codes_SRS_MESSAGESTORE_02_002: [ If allocating memory or accessing the files of the store fails then MessageStore_Create shall fail and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else
+    {
+        size_t pathLength = strlen(path);
+        result->path = (char*)malloc(pathLength + 1);
+        result->fileName = (char*)malloc(pathLength + 1 + MAX_SEGMENT_NUMBER_LENGTH + 1);
+        result->segmentSize = segmentSize;
+        result->oldest = NULL;
+        result->newest = NULL;
+        result->reading = NULL;
+        result->unreadCount = 0;
+        result->writeFile = NULL;
+        result->writeSize = 0;
+        result->writeFileDirty = false;
+        result->syncInterval = DEFAULT_SYNC_INTERVAL;
+        result->unsyncedCount = 0;
+        result->readFile = NULL;
+        result->readBuffer = NULL;
+        result->readBufferSize = 0;
+        if ((result->path == NULL) || (result->fileName == NULL))
+        {
+            /*Codes_SRS_MESSAGESTORE_02_002: [ If allocating memory or accessing the files of the store fails then MessageStore_Create shall fail and return NULL. ]*/
+            LogError("unable to malloc");
+            free(result->path);
+            free(result->fileName);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGESTORE_02_003: [ MessageStore_Create shall find the segments of an existing store, starting from the segment number saved in "path.head" (0 if there is no such file) up to the first missing segment, and shall make their complete records available to MessageStore_ReadNext. ]*/
+            unsigned long number;
+            size_t recordCount;
+            bool failed = false;
+            (void)memcpy(result->path, path, pathLength + 1);
+            number = readHead(result);
+            while (!failed && (countRecords(result, number, &recordCount) == 0))
+            {
+                if (addSegment(result, number, recordCount) == NULL)
+                {
+                    failed = true;
+                }
+                else
+                {
+                    number++;
+                }
+            }
+
+            /*Codes_SRS_MESSAGESTORE_02_004: [ MessageStore_Create shall append the new records to a new segment, so that records cut short by the end of a previous process are never followed by new records. ]*/
+            if (failed || (startSegment(result, number) != 0))
+            {
+                /*Codes_SRS_MESSAGESTORE_02_002: [ If allocating memory or accessing the files of the store fails then MessageStore_Create shall fail and return NULL. ]*/
+                destroySegments(result);
+                free(result->path);
+                free(result->fileName);
+                free(result);
+                result = NULL;
+            }
+            else
+            {
+                /*Codes_SRS_MESSAGESTORE_02_005: [ Otherwise MessageStore_Create shall succeed and return a non-NULL handle. ]*/
+                result->firstSegmentOfThisStore = number;
+                trim(result);
+            }
+        }
+    }
+    return result;
+}
+
+void MessageStore_Destroy(MESSAGESTORE_HANDLE store)
+{
+    /*Codes_SRS_MESSAGESTORE_02_006: [ If store is NULL then MessageStore_Destroy shall do nothing. ]*/
+    if (store != NULL)
+    {
+        /*Codes_SRS_MESSAGESTORE_02_007: [ MessageStore_Destroy shall close the files of the store and free all the resources used by store. The records that were not confirmed shall stay in the files. ]*/
+        /*Codes_SRS_MESSAGESTORE_02_024: [ If every record of the store has been read and confirmed, MessageStore_Destroy shall delete the newest segment too. ]*/
+        closeReadFile(store);
+        if ((store->unsyncedCount > 0) && (syncWriteFile(store) != 0))
+        {
+            LogError("the last records of the store might not be on the disk");
+        }
+        (void)fclose(store->writeFile);
+        if (store->newest->recordCount == 0)
+        {
+            /*nothing was appended by this store*/
+            (void)remove(segmentFileName(store, store->newest->number));
+        }
+        else if (
+            (store->oldest == store->newest) &&
+            (store->newest->readCount == store->newest->recordCount) &&
+            (store->newest->confirmedCount >= store->newest->recordCount) &&
+            (writeHead(store, store->newest->number + 1) == 0)
+            )
+        {
+            /*every record was confirmed, the next store starts afresh*/
+            (void)remove(segmentFileName(store, store->newest->number));
+        }
+        destroySegments(store);
+        free(store->readBuffer);
+        free(store->path);
+        free(store->fileName);
+        free(store);
+    }
+}
+
+int MessageStore_Append(MESSAGESTORE_HANDLE store, const unsigned char* data, size_t size)
+{
+    int result;
+    /*Codes_SRS_MESSAGESTORE_02_008: [ If store is NULL, or data is NULL while size is not 0, then MessageStore_Append shall fail and return a non-zero value. ]*/
+    if ((store == NULL) || ((data == NULL) && (size != 0)))
+    {
+        LogError("invalid arg MESSAGESTORE_HANDLE store=%p, const unsigned char* data=%p, size_t size=%lu", store, data, (unsigned long)size);
+        result = __LINE__;
+    }
+    /*Codes_SRS_MESSAGESTORE_02_009: [ If size does not fit in 32 bits then MessageStore_Append shall fail and return a non-zero value. ]*/
+    else if ((uint64_t)size > UINT32_MAX)
+    {
+        LogError("record of %lu bytes is too big", (unsigned long)size);
+        result = __LINE__;
+    }
+    /*Codes_SRS_MESSAGESTORE_02_010: [ If appending the record would make a segment that already has records bigger than segmentSize then MessageStore_Append shall start a new segment. ]*/
+    else if (
+        (store->newest->recordCount > 0) &&
+        (store->writeSize + RECORD_HEADER_SIZE + size > store->segmentSize) &&
+        (startSegment(store, store->newest->number + 1) != 0)
+        )
+    {
+        /*Codes_SRS_MESSAGESTORE_02_011: [ If writing to the files of the store fails then MessageStore_Append shall fail and return a non-zero value. ]*/
+        result = __LINE__;
+    }
+    else
+    {
+        unsigned char header[RECORD_HEADER_SIZE];
+        header[0] = (unsigned char)(size & 0xFF);
+        header[1] = (unsigned char)((size >> 8) & 0xFF);
+        header[2] = (unsigned char)((size >> 16) & 0xFF);
+        header[3] = (unsigned char)((size >> 24) & 0xFF);
+
+        /*Codes_SRS_MESSAGESTORE_02_012: [ MessageStore_Append shall write size, 4 bytes little endian, followed by the size bytes of data at the end of the newest segment. ]*/
+        store->writeFileDirty = true;
+        store->unsyncedCount++;
+        if (
+            (fwrite(header, 1, RECORD_HEADER_SIZE, store->writeFile) != RECORD_HEADER_SIZE) ||
+            ((size > 0) && (fwrite(data, 1, size, store->writeFile) != size)) ||
+            /*Codes_SRS_MESSAGESTORE_02_025: [ Once "syncInterval" records have been appended since the last sync, MessageStore_Append shall flush the newest segment and wait for the operating system to write it to the disk (fsync, or _commit on Windows). ]*/
+            ((store->syncInterval != 0) && (store->unsyncedCount >= store->syncInterval) && (syncWriteFile(store) != 0))
+            )
+        {
+            /*Codes_SRS_MESSAGESTORE_02_011: [ If writing to the files of the store fails then MessageStore_Append shall fail and return a non-zero value. ]*/
+            LogError("unable to write to segment %lu", store->newest->number);
+            /*part of the record might have been written, the next record goes to a new segment so it does not follow the partial one*/
+            store->writeSize = store->segmentSize;
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGESTORE_02_013: [ Otherwise MessageStore_Append shall succeed and return 0. ]*/
+            store->writeSize += RECORD_HEADER_SIZE + size;
+            store->newest->recordCount++;
+            store->unreadCount++;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+/*moves on to the segment of the next record to read and makes sure readFile is positioned on that record*/
+static int prepareRead(MESSAGESTORE* store)
+{
+    int result;
+    while ((store->reading != store->newest) && (store->reading->readCount == store->reading->recordCount))
+    {
+        closeReadFile(store);
+        store->reading = store->reading->next;
+    }
+
+    if ((store->reading == store->newest) && store->writeFileDirty)
+    {
+        /*the records that are read might still be in the stdio buffer of the writer*/
+        if (fflush(store->writeFile) != 0)
+        {
+            LogError("unable to flush segment %lu", store->newest->number);
+        }
+        store->writeFileDirty = false;
+    }
+
+    if (store->readFile != NULL)
+    {
+        /*the end of the newest segment might have been reached before more records were appended*/
+        clearerr(store->readFile);
+        result = 0;
+    }
+    else if ((store->readFile = fopen(segmentFileName(store, store->reading->number), "rb")) == NULL)
+    {
+        LogError("unable to open %s", store->fileName);
+        result = __LINE__;
+    }
+    else
+    {
+        /*only happens if a previous read failed half way: skip the records that were read already*/
+        size_t i;
+        result = 0;
+        for (i = 0; i < store->reading->readCount; i++)
+        {
+            unsigned char header[RECORD_HEADER_SIZE];
+            if (
+                (fread(header, 1, RECORD_HEADER_SIZE, store->readFile) != RECORD_HEADER_SIZE) ||
+                (fseek(store->readFile, (long)decodeRecordSize(header), SEEK_CUR) != 0)
+                )
+            {
+                LogError("unable to skip the records read from %s", store->fileName);
+                closeReadFile(store);
+                result = __LINE__;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+static int reserveReadBuffer(MESSAGESTORE* store, size_t size)
+{
+    int result;
+    if (size <= store->readBufferSize)
+    {
+        result = 0;
+    }
+    else
+    {
+        unsigned char* newBuffer = (unsigned char*)realloc(store->readBuffer, size);
+        if (newBuffer == NULL)
+        {
+            LogError("unable to realloc %lu bytes", (unsigned long)size);
+            result = __LINE__;
+        }
+        else
+        {
+            store->readBuffer = newBuffer;
+            store->readBufferSize = size;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int MessageStore_ReadNext(MESSAGESTORE_HANDLE store, MESSAGESTORE_RECORD* record)
+{
+    int result;
+    /*Codes_SRS_MESSAGESTORE_02_014: [ If store or record is NULL then MessageStore_ReadNext shall fail and return a non-zero value. ]*/
+    if ((store == NULL) || (record == NULL))
+    {
+        LogError("invalid arg MESSAGESTORE_HANDLE store=%p, MESSAGESTORE_RECORD* record=%p", store, record);
+        result = __LINE__;
+    }
+    /*Codes_SRS_MESSAGESTORE_02_015: [ If every record has been read then MessageStore_ReadNext shall return a non-zero value. ]*/
+    else if (store->unreadCount == 0)
+    {
+        result = __LINE__;
+    }
+    else if (prepareRead(store) != 0)
+    {
+        /*Codes_SRS_MESSAGESTORE_02_016: [ If reading the files of the store fails then MessageStore_ReadNext shall fail and return a non-zero value. The record shall be read again by the next call. ]*/
+        result = __LINE__;
+    }
+    else
+    {
+        unsigned char header[RECORD_HEADER_SIZE];
+        size_t size;
+        if (fread(header, 1, RECORD_HEADER_SIZE, store->readFile) != RECORD_HEADER_SIZE)
+        {
+            /*Codes_SRS_MESSAGESTORE_02_016: [ If reading the files of the store fails then MessageStore_ReadNext shall fail and return a non-zero value. The record shall be read again by the next call. ]*/
+            LogError("unable to read segment %lu", store->reading->number);
+            closeReadFile(store);
+            result = __LINE__;
+        }
+        else if (reserveReadBuffer(store, size = decodeRecordSize(header)) != 0)
+        {
+            closeReadFile(store);
+            result = __LINE__;
+        }
+        else if ((size > 0) && (fread(store->readBuffer, 1, size, store->readFile) != size))
+        {
+            LogError("unable to read segment %lu", store->reading->number);
+            closeReadFile(store);
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGESTORE_02_017: [ Otherwise MessageStore_ReadNext shall fill record with the oldest record that was not read yet and return 0. record->data shall be valid until the next call to MessageStore_ReadNext. ]*/
+            /*Codes_SRS_MESSAGESTORE_02_018: [ record->appendedByThisStore shall be false for the records found in the files by MessageStore_Create and true for the records appended by MessageStore_Append. ]*/
+            store->reading->readCount++;
+            store->unreadCount--;
+            record->data = store->readBuffer;
+            record->size = size;
+            record->segment = store->reading;
+            record->appendedByThisStore = (store->reading->number >= store->firstSegmentOfThisStore);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int MessageStore_SetSyncInterval(MESSAGESTORE_HANDLE store, size_t syncInterval)
+{
+    int result;
+    /*Codes_SRS_MESSAGESTORE_02_026: [ If store is NULL then MessageStore_SetSyncInterval shall fail and return a non-zero value. ]*/
+    if (store == NULL)
+    {
+        LogError("invalid arg MESSAGESTORE_HANDLE store=%p", store);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGESTORE_02_027: [ Otherwise MessageStore_SetSyncInterval shall set after how many appended records the newest segment is synced to the disk, 0 leaving it to the operating system, and return 0. The default is 1, every record. ]*/
+        store->syncInterval = syncInterval;
+        result = 0;
+    }
+    return result;
+}
+
+bool MessageStore_IsEmpty(MESSAGESTORE_HANDLE store)
+{
+    /*Codes_SRS_MESSAGESTORE_02_019: [ If store is NULL then MessageStore_IsEmpty shall return true. ]*/
+    /*Codes_SRS_MESSAGESTORE_02_020: [ Otherwise MessageStore_IsEmpty shall return true if every record has been read and false otherwise. ]*/
+    return (store == NULL) || (store->unreadCount == 0);
+}
+
+void MessageStore_Confirm(MESSAGESTORE_HANDLE store, MESSAGESTORE_SEGMENT_HANDLE segment)
+{
+    /*Codes_SRS_MESSAGESTORE_02_021: [ If store or segment is NULL then MessageStore_Confirm shall do nothing. ]*/
+    if ((store == NULL) || (segment == NULL))
+    {
+        LogError("invalid arg MESSAGESTORE_HANDLE store=%p, MESSAGESTORE_SEGMENT_HANDLE segment=%p", store, segment);
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGESTORE_02_022: [ MessageStore_Confirm shall count one more confirmed record in segment. ]*/
+        segment->confirmedCount++;
+        /*Codes_SRS_MESSAGESTORE_02_023: [ MessageStore_Confirm shall then delete, oldest first, every segment but the newest whose records have all been read and confirmed, saving the number of the oldest remaining segment in "path.head" before deleting a segment. ]*/
+        trim(store);
+    }
+}
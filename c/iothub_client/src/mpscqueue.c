@@ -0,0 +1,197 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <stddef.h>
+
+#include "mpscqueue.h"
+#include "azure_c_shared_utility/iot_logging.h"
+
+/*producers push onto a LIFO stack with compare-and-swap, the consumer swaps the whole stack out and reverses it.
+Since the consumer never pops a single entry, an entry cannot be recycled under a producer's feet and there is no ABA problem*/
+#if defined(MPSCQUEUE_USES_LOCK)
+/*no atomics known for this compiler: the operations below run under queue->lock, see MpscQueue_Push and MpscQueue_PopAll*/
+#define COMPARE_AND_SWAP(destination, expected, desired) compareAndSwap(&(destination), (expected), (desired))
+#define EXCHANGE(destination, value) exchange(&(destination), (value))
+#elif defined(_MSC_VER)
+#include <windows.h>
+#define COMPARE_AND_SWAP(destination, expected, desired) InterlockedCompareExchangePointer((PVOID volatile*)&(destination), (desired), (expected))
+#define EXCHANGE(destination, value) InterlockedExchangePointer((PVOID volatile*)&(destination), (value))
+#elif defined(__GNUC__)
+#define COMPARE_AND_SWAP(destination, expected, desired) __sync_val_compare_and_swap(&(destination), (expected), (desired))
+/*__sync_lock_test_and_set is an acquire barrier, which is all the consumer needs to see what the producers wrote before pushing*/
+#define EXCHANGE(destination, value) __sync_lock_test_and_set(&(destination), (value))
+#endif
+
+#ifdef MPSCQUEUE_USES_LOCK
+static MPSC_QUEUE_ENTRY* compareAndSwap(MPSC_QUEUE_ENTRY* volatile* destination, MPSC_QUEUE_ENTRY* expected, MPSC_QUEUE_ENTRY* desired)
+{
+    MPSC_QUEUE_ENTRY* result = *destination;
+    if (result == expected)
+    {
+        *destination = desired;
+    }
+    return result;
+}
+static MPSC_QUEUE_ENTRY* exchange(MPSC_QUEUE_ENTRY* volatile* destination, MPSC_QUEUE_ENTRY* value)
+{
+    MPSC_QUEUE_ENTRY* result = *destination;
+    *destination = value;
+    return result;
+}
+#endif
+
+int MpscQueue_Initialize(MPSC_QUEUE* queue)
+{
+    int result;
+    if (queue == NULL)
+    {
+        /*Codes_SRS_MPSCQUEUE_02_001: [ If queue is NULL then MpscQueue_Initialize shall fail and return a non-zero value. ]*/
+        result = __LINE__;
+        LogError("invalid arg queue=NULL");
+    }
+    else
+    {
+        /*Codes_SRS_MPSCQUEUE_02_002: [ Otherwise MpscQueue_Initialize shall make queue empty and return 0. ]*/
+        queue->head = NULL;
+#ifdef MPSCQUEUE_USES_LOCK
+        /*Codes_SRS_MPSCQUEUE_02_010: [ When MPSCQUEUE_USES_LOCK is defined, MpscQueue_Initialize shall create the lock guarding queue by calling Lock_Init, and return a non-zero value if that fails. ]*/
+        if ((queue->lock = Lock_Init()) == NULL)
+        {
+            result = __LINE__;
+            LogError("unable to Lock_Init");
+        }
+        else
+#endif
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+void MpscQueue_Deinitialize(MPSC_QUEUE* queue)
+{
+    /*Codes_SRS_MPSCQUEUE_02_011: [ If queue is NULL then MpscQueue_Deinitialize shall do nothing. ]*/
+    if (queue != NULL)
+    {
+#ifdef MPSCQUEUE_USES_LOCK
+        /*Codes_SRS_MPSCQUEUE_02_012: [ When MPSCQUEUE_USES_LOCK is defined, MpscQueue_Deinitialize shall destroy the lock created by MpscQueue_Initialize. ]*/
+        (void)Lock_Deinit(queue->lock);
+        queue->lock = NULL;
+#endif
+        queue->head = NULL;
+    }
+}
+
+int MpscQueue_Push(MPSC_QUEUE* queue, MPSC_QUEUE_ENTRY* entry)
+{
+    int result;
+    if ((queue == NULL) || (entry == NULL))
+    {
+        /*Codes_SRS_MPSCQUEUE_02_003: [ If queue or entry is NULL then MpscQueue_Push shall fail and return a non-zero value. ]*/
+        result = __LINE__;
+        LogError("invalid arg queue=%p, entry=%p", queue, entry);
+    }
+#ifdef MPSCQUEUE_USES_LOCK
+    /*Codes_SRS_MPSCQUEUE_02_013: [ When MPSCQUEUE_USES_LOCK is defined, MpscQueue_Push shall append entry under the lock created by MpscQueue_Initialize, and return a non-zero value if the lock cannot be taken. ]*/
+    else if (Lock(queue->lock) != LOCK_OK)
+    {
+        result = __LINE__;
+        LogError("unable to Lock");
+    }
+#endif
+    else
+    {
+        /*Codes_SRS_MPSCQUEUE_02_004: [ MpscQueue_Push shall append entry to queue without taking any lock, retrying with the latest head of the queue until its compare-and-swap succeeds, and return 0. ]*/
+        MPSC_QUEUE_ENTRY* head = queue->head;
+        while (1)
+        {
+            MPSC_QUEUE_ENTRY* seen;
+            entry->next = head;
+            seen = (MPSC_QUEUE_ENTRY*)COMPARE_AND_SWAP(queue->head, head, entry);
+            if (seen == head)
+            {
+                break;
+            }
+            head = seen;
+        }
+#ifdef MPSCQUEUE_USES_LOCK
+        (void)Unlock(queue->lock);
+#endif
+        result = 0;
+    }
+    return result;
+}
+
+MPSC_QUEUE_ENTRY* MpscQueue_PopAll(MPSC_QUEUE* queue)
+{
+    MPSC_QUEUE_ENTRY* result;
+    if (queue == NULL)
+    {
+        /*Codes_SRS_MPSCQUEUE_02_005: [ If queue is NULL then MpscQueue_PopAll shall return NULL. ]*/
+        result = NULL;
+    }
+#ifdef MPSCQUEUE_USES_LOCK
+    /*Codes_SRS_MPSCQUEUE_02_014: [ When MPSCQUEUE_USES_LOCK is defined, MpscQueue_PopAll shall take the entries under the lock created by MpscQueue_Initialize, and return NULL, leaving them queued, if the lock cannot be taken. ]*/
+    else if (Lock(queue->lock) != LOCK_OK)
+    {
+        result = NULL;
+        LogError("unable to Lock, the entries stay queued");
+    }
+#endif
+    else
+    {
+        /*Codes_SRS_MPSCQUEUE_02_006: [ MpscQueue_PopAll shall atomically take all the entries out of queue, leaving it empty. ]*/
+        MPSC_QUEUE_ENTRY* newestFirst = (MPSC_QUEUE_ENTRY*)EXCHANGE(queue->head, NULL);
+#ifdef MPSCQUEUE_USES_LOCK
+        (void)Unlock(queue->lock);
+#endif
+
+        /*Codes_SRS_MPSCQUEUE_02_007: [ MpscQueue_PopAll shall return the entries it took linked through their next field in the order they were pushed, the last one having a NULL next, or NULL if queue was empty. ]*/
+        result = NULL;
+        while (newestFirst != NULL)
+        {
+            MPSC_QUEUE_ENTRY* next = newestFirst->next;
+            newestFirst->next = result;
+            result = newestFirst;
+            newestFirst = next;
+        }
+    }
+    return result;
+}
+
+bool MpscQueue_IsEmpty(const MPSC_QUEUE* queue)
+{
+    bool result;
+    if (queue == NULL)
+    {
+        /*Codes_SRS_MPSCQUEUE_02_008: [ If queue is NULL then MpscQueue_IsEmpty shall return true. ]*/
+        result = true;
+    }
+    else
+    {
+        MPSC_QUEUE* mutableQueue = (MPSC_QUEUE*)queue;
+#ifdef MPSCQUEUE_USES_LOCK
+        if (Lock(mutableQueue->lock) != LOCK_OK)
+        {
+            /*Codes_SRS_MPSCQUEUE_02_016: [ When MPSCQUEUE_USES_LOCK is defined, MpscQueue_IsEmpty shall read the head of queue under the lock created by MpscQueue_Initialize, and return false if the lock cannot be taken. ]*/
+            result = false;
+            LogError("unable to Lock");
+        }
+        else
+#endif
+        {
+            /*Codes_SRS_MPSCQUEUE_02_009: [ Otherwise MpscQueue_IsEmpty shall return true if queue has no entries and false otherwise. ]*/
+            /*Codes_SRS_MPSCQUEUE_02_015: [ MpscQueue_IsEmpty shall read the head of queue with a full memory barrier, so that what the caller wrote before calling it is visible to a producer that pushes after it has returned true. ]*/
+            result = (COMPARE_AND_SWAP(mutableQueue->head, NULL, NULL) == NULL);
+#ifdef MPSCQUEUE_USES_LOCK
+            (void)Unlock(mutableQueue->lock);
+#endif
+        }
+    }
+    return result;
+}
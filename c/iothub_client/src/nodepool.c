@@ -0,0 +1,286 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <stdint.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/iot_logging.h"
+
+#include "nodepool.h"
+
+/*every node is preceded by a header that remembers where the node has to go back to*/
+typedef union NODE_HEADER_TAG
+{
+    struct
+    {
+        struct NODEPOOL_TAG* pool;
+        union NODE_HEADER_TAG* nextFree; /*only meaningful while the node is in the free list*/
+        int isSlabNode; /*0 for the nodes that were allocated one by one when the pool could not grow*/
+    } fields;
+    /*the members below only force the alignment of the node that follows the header*/
+    uint64_t alignInteger;
+    double alignDouble;
+    void* alignPointer;
+} NODE_HEADER;
+
+typedef struct SLAB_TAG
+{
+    struct SLAB_TAG* next;
+} SLAB;
+
+typedef struct NODEPOOL_TAG
+{
+    size_t stride; /*header + node, rounded up so that every header in a slab is aligned*/
+    size_t nodeSize;
+    size_t growth;
+    NODE_HEADER* freeList;
+    SLAB* slabs;
+    NODEPOOL_STATS stats;
+} NODEPOOL;
+
+#define ALIGN_TO_HEADER(size) ((((size) + sizeof(NODE_HEADER) - 1) / sizeof(NODE_HEADER)) * sizeof(NODE_HEADER))
+
+/*returns 0 if a slab of count nodes was added to the free list*/
+static int addSlab(NODEPOOL* pool, size_t count)
+{
+    int result;
+    size_t slabHeaderSize = ALIGN_TO_HEADER(sizeof(SLAB));
+    if (count > (((size_t)-1) - slabHeaderSize) / pool->stride)
+    {
+        LogError("slab of %lu nodes is too big", (unsigned long)count);
+        result = __LINE__;
+    }
+    else
+    {
+        SLAB* slab = (SLAB*)malloc(slabHeaderSize + count * pool->stride);
+        if (slab == NULL)
+        {
+            LogError("unable to malloc a slab of %lu nodes", (unsigned long)count);
+            result = __LINE__;
+        }
+        else
+        {
+            size_t i;
+            unsigned char* nodes = (unsigned char*)slab + slabHeaderSize;
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            for (i = 0; i < count; i++)
+            {
+                NODE_HEADER* header = (NODE_HEADER*)(nodes + i * pool->stride);
+                header->fields.pool = pool;
+                header->fields.isSlabNode = 1;
+                header->fields.nextFree = pool->freeList;
+                pool->freeList = header;
+            }
+            pool->stats.capacity += count;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+NODEPOOL_HANDLE NodePool_Create(size_t nodeSize, size_t growth)
+{
+    NODEPOOL* result;
+    /*Codes_SRS_NODEPOOL_02_001: [ If nodeSize is 0 then NodePool_Create shall fail and return NULL. ]*/
+    if (nodeSize == 0)
+    {
+        LogError("invalid arg size_t nodeSize=0");
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_NODEPOOL_02_002: [ NodePool_Create shall allocate memory for the pool and shall not allocate any slab. ]*/
+        result = (NODEPOOL*)malloc(sizeof(NODEPOOL));
+        if (result == NULL)
+        {
+            /*Codes_SRS_NODEPOOL_02_003: [ If allocating memory fails then NodePool_Create shall fail and return NULL. ]*/
+            LogError("unable to malloc");
+        }
+        else
+        {
+            /*Codes_SRS_NODEPOOL_02_004: [ Otherwise NodePool_Create shall succeed and return a non-NULL handle. ]*/
+            result->nodeSize = nodeSize;
+            result->stride = sizeof(NODE_HEADER) + ALIGN_TO_HEADER(nodeSize);
+            result->growth = growth;
+            result->freeList = NULL;
+            result->slabs = NULL;
+            result->stats.hits = 0;
+            result->stats.misses = 0;
+            result->stats.inUse = 0;
+            result->stats.highWaterMark = 0;
+            result->stats.capacity = 0;
+        }
+    }
+    return result;
+}
+
+void NodePool_Destroy(NODEPOOL_HANDLE pool)
+{
+    /*Codes_SRS_NODEPOOL_02_005: [ If pool is NULL then NodePool_Destroy shall do nothing. ]*/
+    if (pool != NULL)
+    {
+        /*Codes_SRS_NODEPOOL_02_006: [ NodePool_Destroy shall free all the slabs of the pool and the pool itself. ]*/
+        while (pool->slabs != NULL)
+        {
+            SLAB* next = pool->slabs->next;
+            free(pool->slabs);
+            pool->slabs = next;
+        }
+        if (pool->stats.inUse != 0)
+        {
+            LogError("pool destroyed while %lu nodes are still in use", (unsigned long)pool->stats.inUse);
+        }
+        free(pool);
+    }
+}
+
+int NodePool_Reserve(NODEPOOL_HANDLE pool, size_t count)
+{
+    int result;
+    /*Codes_SRS_NODEPOOL_02_007: [ If pool is NULL then NodePool_Reserve shall fail and return a non-zero value. ]*/
+    if (pool == NULL)
+    {
+        LogError("invalid arg NODEPOOL_HANDLE pool=%p", pool);
+        result = __LINE__;
+    }
+    /*Codes_SRS_NODEPOOL_02_008: [ If the pool already owns count nodes or more then NodePool_Reserve shall succeed and return 0. ]*/
+    else if (pool->stats.capacity >= count)
+    {
+        result = 0;
+    }
+    /*Codes_SRS_NODEPOOL_02_009: [ Otherwise NodePool_Reserve shall allocate one slab for the missing nodes. ]*/
+    else if (addSlab(pool, count - pool->stats.capacity) != 0)
+    {
+        /*Codes_SRS_NODEPOOL_02_010: [ If allocating the slab fails then NodePool_Reserve shall fail and return a non-zero value. ]*/
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+int NodePool_SetGrowth(NODEPOOL_HANDLE pool, size_t growth)
+{
+    int result;
+    /*Codes_SRS_NODEPOOL_02_011: [ If pool is NULL then NodePool_SetGrowth shall fail and return a non-zero value. ]*/
+    if (pool == NULL)
+    {
+        LogError("invalid arg NODEPOOL_HANDLE pool=%p", pool);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_NODEPOOL_02_012: [ Otherwise NodePool_SetGrowth shall use growth as the number of nodes of every slab allocated afterwards and return 0. ]*/
+        pool->growth = growth;
+        result = 0;
+    }
+    return result;
+}
+
+void* NodePool_Alloc(NODEPOOL_HANDLE pool)
+{
+    void* result;
+    /*Codes_SRS_NODEPOOL_02_013: [ If pool is NULL then NodePool_Alloc shall return NULL. ]*/
+    if (pool == NULL)
+    {
+        LogError("invalid arg NODEPOOL_HANDLE pool=%p", pool);
+        result = NULL;
+    }
+    else
+    {
+        NODE_HEADER* header;
+        if (pool->freeList != NULL)
+        {
+            /*Codes_SRS_NODEPOOL_02_014: [ If the pool has a free node then NodePool_Alloc shall hand it out and count a hit. ]*/
+            pool->stats.hits++;
+            header = pool->freeList;
+        }
+        else
+        {
+            /*Codes_SRS_NODEPOOL_02_015: [ Otherwise NodePool_Alloc shall count a miss and allocate a new slab of growth nodes. ]*/
+            pool->stats.misses++;
+            if ((pool->growth != 0) && (addSlab(pool, pool->growth) == 0))
+            {
+                header = pool->freeList;
+            }
+            /*Codes_SRS_NODEPOOL_02_016: [ If growth is 0 or the slab cannot be allocated then NodePool_Alloc shall allocate a single node from the heap. ]*/
+            else if ((header = (NODE_HEADER*)malloc(sizeof(NODE_HEADER) + pool->nodeSize)) == NULL)
+            {
+                /*Codes_SRS_NODEPOOL_02_017: [ If no memory can be allocated then NodePool_Alloc shall return NULL. ]*/
+                LogError("unable to malloc");
+            }
+            else
+            {
+                header->fields.pool = pool;
+                header->fields.isSlabNode = 0;
+                header->fields.nextFree = NULL;
+            }
+        }
+
+        if (header == NULL)
+        {
+            result = NULL;
+        }
+        else
+        {
+            if (header->fields.isSlabNode)
+            {
+                pool->freeList = header->fields.nextFree;
+            }
+            /*Codes_SRS_NODEPOOL_02_018: [ NodePool_Alloc shall keep track of the number of nodes in use and of the highest such number. ]*/
+            pool->stats.inUse++;
+            if (pool->stats.inUse > pool->stats.highWaterMark)
+            {
+                pool->stats.highWaterMark = pool->stats.inUse;
+            }
+            result = header + 1;
+        }
+    }
+    return result;
+}
+
+void NodePool_Free(void* node)
+{
+    /*Codes_SRS_NODEPOOL_02_019: [ If node is NULL then NodePool_Free shall do nothing. ]*/
+    if (node != NULL)
+    {
+        NODE_HEADER* header = (NODE_HEADER*)node - 1;
+        NODEPOOL* pool = header->fields.pool;
+        pool->stats.inUse--;
+        if (header->fields.isSlabNode)
+        {
+            /*Codes_SRS_NODEPOOL_02_020: [ NodePool_Free shall put a node that belongs to a slab back in the free list of its pool. ]*/
+            header->fields.nextFree = pool->freeList;
+            pool->freeList = header;
+        }
+        else
+        {
+            /*Codes_SRS_NODEPOOL_02_021: [ NodePool_Free shall free a node that was allocated from the heap. ]*/
+            free(header);
+        }
+    }
+}
+
+int NodePool_GetStats(NODEPOOL_HANDLE pool, NODEPOOL_STATS* stats)
+{
+    int result;
+    /*Codes_SRS_NODEPOOL_02_022: [ If pool or stats is NULL then NodePool_GetStats shall fail and return a non-zero value. ]*/
+    if ((pool == NULL) || (stats == NULL))
+    {
+        LogError("invalid arg NODEPOOL_HANDLE pool=%p, NODEPOOL_STATS* stats=%p", pool, stats);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_NODEPOOL_02_023: [ Otherwise NodePool_GetStats shall copy the usage counters of the pool in stats and return 0. ]*/
+        *stats = pool->stats;
+        result = 0;
+    }
+    return result;
+}
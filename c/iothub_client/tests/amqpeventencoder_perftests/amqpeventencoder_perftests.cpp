@@ -0,0 +1,114 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <cstdio>
+#include <cstring>
+
+#include "testrunnerswitcher.h"
+
+/*the allocations are counted by the gballoc functions below*/
+#define GBALLOC_H
+
+#include "amqpeventencoder.h"
+#include "iothub_message.h"
+
+#include "azure_c_shared_utility/map.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#define EVENT_COUNT 100000
+#define EVENT_SIZE 256 /*about the size of a serialized telemetry event*/
+
+static size_t allocationCount;
+
+extern "C" void* gballoc_malloc(size_t size)
+{
+    allocationCount++;
+    return malloc(size);
+}
+
+extern "C" void* gballoc_calloc(size_t nmemb, size_t size)
+{
+    allocationCount++;
+    return calloc(nmemb, size);
+}
+
+extern "C" void* gballoc_realloc(void* ptr, size_t size)
+{
+    allocationCount++;
+    return realloc(ptr, size);
+}
+
+extern "C" void gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+static double eventsPerSecond(size_t count, uint64_t elapsedMs)
+{
+    return (elapsedMs == 0) ? (double)count * 1000 : (double)count * 1000 / elapsedMs;
+}
+
+BEGIN_TEST_SUITE(amqpeventencoder_perftests)
+
+    /*encodes EVENT_COUNT events with a few properties the way IoTHubTransportAMQP does for a batch, counting the heap
+    allocations done while encoding. The AMQP_VALUE based encoding it replaces allocated the properties map, 2 strings per
+    property, the application-properties and data sections and the encoded bytes for every event.*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_throughput_and_allocations)
+    {
+        // arrange
+        TICK_COUNTER_HANDLE tickCounter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tickCounter);
+        unsigned char content[EVENT_SIZE];
+        (void)memset(content, 'x', sizeof(content));
+        IOTHUB_MESSAGE_HANDLE message = IoTHubMessage_CreateFromByteArray(content, sizeof(content));
+        ASSERT_IS_NOT_NULL(message);
+        MAP_HANDLE properties = IoTHubMessage_Properties(message);
+        ASSERT_IS_NOT_NULL(properties);
+        ASSERT_ARE_EQUAL(int, (int)MAP_OK, (int)Map_AddOrUpdate(properties, "temperatureAlert", "true"));
+        ASSERT_ARE_EQUAL(int, (int)MAP_OK, (int)Map_AddOrUpdate(properties, "sensor", "thermometer-42"));
+        ASSERT_ARE_EQUAL(int, (int)MAP_OK, (int)Map_AddOrUpdate(properties, "unit", "celsius"));
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        ASSERT_IS_NOT_NULL(encoder);
+        const unsigned char* encoded;
+        size_t size = 0;
+        size_t failedEncodes = 0;
+        size_t encodedBytes = 0;
+        size_t allocations;
+        uint64_t start;
+        uint64_t end;
+        size_t i;
+
+        // act
+        allocationCount = 0;
+        (void)tickcounter_get_current_ms(tickCounter, &start);
+        for (i = 0; i < EVENT_COUNT; i++)
+        {
+            if (AmqpEventEncoder_Encode(encoder, message, &encoded, &size) != AMQPEVENTENCODER_OK)
+            {
+                failedEncodes++;
+            }
+            encodedBytes += size;
+        }
+        (void)tickcounter_get_current_ms(tickCounter, &end);
+        allocations = allocationCount;
+
+        (void)printf("%d events of %d bytes with 3 properties, %lu bytes each once encoded: %.0f events/s, %lu heap allocations\r\n",
+            EVENT_COUNT, EVENT_SIZE, (unsigned long)size, eventsPerSecond(EVENT_COUNT, end - start), (unsigned long)allocations);
+
+        // assert
+        ASSERT_ARE_EQUAL(size_t, 0, failedEncodes);
+        ASSERT_ARE_EQUAL(size_t, size * EVENT_COUNT, encodedBytes);
+        /*only the first event grows the buffer of the encoder*/
+        ASSERT_ARE_EQUAL(size_t, 1, allocations);
+
+        // cleanup
+        AmqpEventEncoder_Destroy(encoder);
+        IoTHubMessage_Destroy(message);
+        tickcounter_destroy(tickCounter);
+    }
+
+END_TEST_SUITE(amqpeventencoder_perftests)
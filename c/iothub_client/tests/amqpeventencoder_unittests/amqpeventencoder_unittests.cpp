@@ -0,0 +1,759 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <cstring>
+
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "micromockcharstararenullterminatedstrings.h"
+#include "amqpeventencoder.h"
+#include "azure_c_shared_utility/lock.h"
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+
+#define GBALLOC_H
+
+extern "C" int gballoc_init(void);
+extern "C" void gballoc_deinit(void);
+extern "C" void* gballoc_malloc(size_t size);
+extern "C" void* gballoc_calloc(size_t nmemb, size_t size);
+extern "C" void* gballoc_realloc(void* ptr, size_t size);
+extern "C" void gballoc_free(void* ptr);
+
+namespace BASEIMPLEMENTATION
+{
+    /*if malloc is defined as gballoc_malloc at this moment, there'd be serious trouble*/
+#define Lock(x) (LOCK_OK + gballocState - gballocState) /*compiler warning about constant in if condition*/
+#define Unlock(x) (LOCK_OK + gballocState - gballocState)
+#define Lock_Init() (LOCK_HANDLE)0x42
+#define Lock_Deinit(x) (LOCK_OK + gballocState - gballocState)
+#include "gballoc.c"
+#undef Lock
+#undef Unlock
+#undef Lock_Init
+#undef Lock_Deinit
+};
+
+#define TEST_MESSAGE_HANDLE (IOTHUB_MESSAGE_HANDLE)0x4242
+#define TEST_PROPERTIES_MAP (MAP_HANDLE)0x4243
+#define LONG_SIZE 300
+
+static size_t currentmalloc_call;
+static size_t whenShallmalloc_fail;
+static size_t currentrealloc_call;
+static size_t whenShallrealloc_fail;
+
+/*what the mocked message is made of*/
+static IOTHUBMESSAGE_CONTENT_TYPE test_content_type;
+static const unsigned char* test_content;
+static size_t test_content_size;
+static const char* const* test_keys;
+static const char* const* test_values;
+static size_t test_property_count;
+
+static const char* const one_key[] = { "k" };
+static const char* const one_value[] = { "v" };
+static char long_value_text[LONG_SIZE + 1];
+static const char* const long_value[] = { long_value_text };
+static unsigned char long_content[LONG_SIZE];
+
+TYPED_MOCK_CLASS(CAmqpEventEncoderMocks, CGlobalMock)
+{
+public:
+
+    MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
+        void* result2;
+        currentmalloc_call++;
+        if ((whenShallmalloc_fail > 0) && (currentmalloc_call == whenShallmalloc_fail))
+        {
+            result2 = NULL;
+        }
+        else
+        {
+            result2 = BASEIMPLEMENTATION::gballoc_malloc(size);
+        }
+    MOCK_METHOD_END(void*, result2);
+
+    MOCK_STATIC_METHOD_2(, void*, gballoc_realloc, void*, ptr, size_t, size)
+        void* result2;
+        currentrealloc_call++;
+        if ((whenShallrealloc_fail > 0) && (currentrealloc_call == whenShallrealloc_fail))
+        {
+            result2 = NULL;
+        }
+        else
+        {
+            result2 = BASEIMPLEMENTATION::gballoc_realloc(ptr, size);
+        }
+    MOCK_METHOD_END(void*, result2);
+
+    MOCK_STATIC_METHOD_1(, void, gballoc_free, void*, ptr)
+        BASEIMPLEMENTATION::gballoc_free(ptr);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_1(, IOTHUBMESSAGE_CONTENT_TYPE, IoTHubMessage_GetContentType, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+    MOCK_METHOD_END(IOTHUBMESSAGE_CONTENT_TYPE, test_content_type)
+
+    MOCK_STATIC_METHOD_3(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetByteArray, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const unsigned char**, buffer, size_t*, size)
+        *buffer = test_content;
+        *size = test_content_size;
+    MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK)
+
+    MOCK_STATIC_METHOD_1(, const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+    MOCK_METHOD_END(const char*, (const char*)test_content)
+
+    MOCK_STATIC_METHOD_1(, MAP_HANDLE, IoTHubMessage_Properties, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+    MOCK_METHOD_END(MAP_HANDLE, TEST_PROPERTIES_MAP)
+
+    MOCK_STATIC_METHOD_4(, MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count)
+        *keys = test_keys;
+        *values = test_values;
+        *count = test_property_count;
+    MOCK_METHOD_END(MAP_RESULT, MAP_OK)
+};
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CAmqpEventEncoderMocks, , void*, gballoc_malloc, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_2(CAmqpEventEncoderMocks, , void*, gballoc_realloc, void*, ptr, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CAmqpEventEncoderMocks, , void, gballoc_free, void*, ptr);
+DECLARE_GLOBAL_MOCK_METHOD_1(CAmqpEventEncoderMocks, , IOTHUBMESSAGE_CONTENT_TYPE, IoTHubMessage_GetContentType, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CAmqpEventEncoderMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetByteArray, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const unsigned char**, buffer, size_t*, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CAmqpEventEncoderMocks, , const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CAmqpEventEncoderMocks, , MAP_HANDLE, IoTHubMessage_Properties, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_4(CAmqpEventEncoderMocks, , MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count);
+
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+static void setExpectedCallsForGettingTheMessage(CAmqpEventEncoderMocks& mocks)
+{
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+    if (test_content_type == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3);
+    }
+    else
+    {
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_MESSAGE_HANDLE));
+    }
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4);
+}
+
+BEGIN_TEST_SUITE(amqpeventencoder_unittests)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+        (void)memset(long_value_text, 'x', LONG_SIZE);
+        long_value_text[LONG_SIZE] = '\0';
+        (void)memset(long_content, 'y', LONG_SIZE);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+
+        currentmalloc_call = 0;
+        whenShallmalloc_fail = 0;
+        currentrealloc_call = 0;
+        whenShallrealloc_fail = 0;
+
+        test_content_type = IOTHUBMESSAGE_BYTEARRAY;
+        test_content = (const unsigned char*)"abc";
+        test_content_size = 3;
+        test_keys = NULL;
+        test_values = NULL;
+        test_property_count = 0;
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_001: [ AmqpEventEncoder_Create shall allocate memory for the encoder and shall not allocate its buffer. ]*/
+    /*Tests_SRS_AMQPEVENTENCODER_09_003: [ Otherwise AmqpEventEncoder_Create shall succeed and return a non-NULL handle. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Create_succeeds)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+
+        ///assert
+        ASSERT_IS_NOT_NULL(encoder);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_002: [ If allocating memory fails then AmqpEventEncoder_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Create_when_malloc_fails_fails)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+
+        whenShallmalloc_fail = 1;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+
+        ///assert
+        ASSERT_IS_NULL(encoder);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_004: [ If encoder is NULL then AmqpEventEncoder_Destroy shall do nothing. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Destroy_with_NULL_does_nothing)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+
+        ///act
+        AmqpEventEncoder_Destroy(NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_005: [ AmqpEventEncoder_Destroy shall free the buffer of the encoder and the encoder. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Destroy_frees_the_buffer_and_the_encoder)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char* encoded;
+        size_t size;
+        (void)AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .ExpectedTimesExactly(2);
+
+        ///act
+        AmqpEventEncoder_Destroy(encoder);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_006: [ If encoder, message, encoded or size is NULL then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_INVALID_ARG. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_with_NULL_encoder_fails)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        const unsigned char* encoded;
+        size_t size;
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(NULL, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_INVALID_ARG, (int)result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_006: [ If encoder, message, encoded or size is NULL then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_INVALID_ARG. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_with_NULL_message_fails)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char* encoded;
+        size_t size;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, NULL, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_INVALID_ARG, (int)result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_007: [ AmqpEventEncoder_Encode shall get the content of message with IoTHubMessage_GetByteArray or IoTHubMessage_GetString, according to IoTHubMessage_GetContentType. ]*/
+    /*Tests_SRS_AMQPEVENTENCODER_09_009: [ AmqpEventEncoder_Encode shall get the properties of message with IoTHubMessage_Properties and Map_GetInternals. ]*/
+    /*Tests_SRS_AMQPEVENTENCODER_09_012: [ AmqpEventEncoder_Encode shall grow the buffer of the encoder with realloc only when the encoded sections do not fit in it. ]*/
+    /*Tests_SRS_AMQPEVENTENCODER_09_015: [ AmqpEventEncoder_Encode shall write a data section holding the content of message. ]*/
+    /*Tests_SRS_AMQPEVENTENCODER_09_016: [ Otherwise AmqpEventEncoder_Encode shall set encoded to the buffer of the encoder, size to the size of the sections and return AMQPEVENTENCODER_OK. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_a_message_without_properties_writes_only_a_data_section)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char expected[] = { 0x00, 0x53, 0x75, 0xa0, 0x03, 'a', 'b', 'c' };
+        const unsigned char* encoded;
+        size_t size;
+        mocks.ResetAllCalls();
+
+        setExpectedCallsForGettingTheMessage(mocks);
+        STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, sizeof(expected)));
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected), size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected, encoded, size));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_007: [ AmqpEventEncoder_Encode shall get the content of message with IoTHubMessage_GetByteArray or IoTHubMessage_GetString, according to IoTHubMessage_GetContentType. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_a_STRING_message_writes_the_string_without_its_terminator)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char expected[] = { 0x00, 0x53, 0x75, 0xa0, 0x03, 'a', 'b', 'c' };
+        const unsigned char* encoded;
+        size_t size;
+        test_content_type = IOTHUBMESSAGE_STRING;
+        mocks.ResetAllCalls();
+
+        setExpectedCallsForGettingTheMessage(mocks);
+        STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, sizeof(expected)));
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected), size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected, encoded, size));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_014: [ If message has properties, AmqpEventEncoder_Encode shall write an application-properties section holding a map of their keys and values as UTF-8 strings, using the 8 bit width encodings whenever they fit. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_a_message_with_properties_writes_an_application_properties_section_first)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char expected[] =
+        {
+            0x00, 0x53, 0x74, 0xc1, 0x07, 0x02, 0xa1, 0x01, 'k', 0xa1, 0x01, 'v',
+            0x00, 0x53, 0x75, 0xa0, 0x03, 'a', 'b', 'c'
+        };
+        const unsigned char* encoded;
+        size_t size;
+        test_keys = one_key;
+        test_values = one_value;
+        test_property_count = 1;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected), size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected, encoded, size));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_014: [ If message has properties, AmqpEventEncoder_Encode shall write an application-properties section holding a map of their keys and values as UTF-8 strings, using the 8 bit width encodings whenever they fit. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_a_long_property_value_uses_map32_and_str32)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        /*items: "k" as str8 (3 bytes) and the value as str32 (5 + 300 bytes)*/
+        const unsigned char expected_header[] =
+        {
+            0x00, 0x53, 0x74, 0xd1, 0x00, 0x00, 0x01, 0x38, 0x00, 0x00, 0x00, 0x02, 0xa1, 0x01, 'k', 0xb1, 0x00, 0x00, 0x01, 0x2c
+        };
+        const unsigned char* encoded;
+        size_t size;
+        test_keys = one_key;
+        test_values = long_value;
+        test_property_count = 1;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected_header) + LONG_SIZE + 8, size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected_header, encoded, sizeof(expected_header)));
+        ASSERT_ARE_EQUAL(int, 0, memcmp(long_value_text, encoded + sizeof(expected_header), LONG_SIZE));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_015: [ AmqpEventEncoder_Encode shall write a data section holding the content of message. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_a_long_content_uses_vbin32)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char expected_header[] = { 0x00, 0x53, 0x75, 0xb0, 0x00, 0x00, 0x01, 0x2c };
+        const unsigned char* encoded;
+        size_t size;
+        test_content = long_content;
+        test_content_size = LONG_SIZE;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected_header) + LONG_SIZE, size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected_header, encoded, sizeof(expected_header)));
+        ASSERT_ARE_EQUAL(int, 0, memcmp(long_content, encoded + sizeof(expected_header), LONG_SIZE));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_015: [ AmqpEventEncoder_Encode shall write a data section holding the content of message. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_an_empty_content_writes_an_empty_vbin8)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char expected[] = { 0x00, 0x53, 0x75, 0xa0, 0x00 };
+        const unsigned char* encoded;
+        size_t size;
+        test_content_size = 0;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected), size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected, encoded, size));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_015: [ AmqpEventEncoder_Encode shall write a data section holding the content of message. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_a_content_of_255_bytes_still_uses_vbin8)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char expected_header[] = { 0x00, 0x53, 0x75, 0xa0, 0xff };
+        const unsigned char* encoded;
+        size_t size;
+        test_content = long_content;
+        test_content_size = 255;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected_header) + 255, size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected_header, encoded, sizeof(expected_header)));
+        ASSERT_ARE_EQUAL(int, 0, memcmp(long_content, encoded + sizeof(expected_header), 255));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_015: [ AmqpEventEncoder_Encode shall write a data section holding the content of message. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_a_content_of_256_bytes_uses_vbin32)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char expected_header[] = { 0x00, 0x53, 0x75, 0xb0, 0x00, 0x00, 0x01, 0x00 };
+        const unsigned char* encoded;
+        size_t size;
+        test_content = long_content;
+        test_content_size = 256;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected_header) + 256, size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected_header, encoded, sizeof(expected_header)));
+        ASSERT_ARE_EQUAL(int, 0, memcmp(long_content, encoded + sizeof(expected_header), 256));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_014: [ If message has properties, AmqpEventEncoder_Encode shall write an application-properties section holding a map of their keys and values as UTF-8 strings, using the 8 bit width encodings whenever they fit. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_writes_the_properties_in_the_order_of_the_map)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const char* const two_keys[] = { "k1", "k2" };
+        const char* const two_values[] = { "v1", "v2" };
+        const unsigned char expected[] =
+        {
+            0x00, 0x53, 0x74, 0xc1, 0x11, 0x04,
+            0xa1, 0x02, 'k', '1', 0xa1, 0x02, 'v', '1',
+            0xa1, 0x02, 'k', '2', 0xa1, 0x02, 'v', '2',
+            0x00, 0x53, 0x75, 0xa0, 0x03, 'a', 'b', 'c'
+        };
+        const unsigned char* encoded;
+        size_t size;
+        test_keys = two_keys;
+        test_values = two_values;
+        test_property_count = 2;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected), size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected, encoded, size));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_014: [ If message has properties, AmqpEventEncoder_Encode shall write an application-properties section holding a map of their keys and values as UTF-8 strings, using the 8 bit width encodings whenever they fit. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_uses_map8_while_the_map_size_fits_in_8_bits)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        /*items: "k" as str8 (3 bytes) and a value of 249 bytes as str8 (251 bytes), so the map size with its count is 255*/
+        const char* const value[] = { long_value_text + LONG_SIZE - 249 };
+        const unsigned char expected_header[] = { 0x00, 0x53, 0x74, 0xc1, 0xff, 0x02, 0xa1, 0x01, 'k', 0xa1, 0xf9 };
+        const unsigned char* encoded;
+        size_t size;
+        test_keys = one_key;
+        test_values = value;
+        test_property_count = 1;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected_header) + 249 + 8, size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected_header, encoded, sizeof(expected_header)));
+        ASSERT_ARE_EQUAL(int, 0, memcmp(long_value_text, encoded + sizeof(expected_header), 249));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_014: [ If message has properties, AmqpEventEncoder_Encode shall write an application-properties section holding a map of their keys and values as UTF-8 strings, using the 8 bit width encodings whenever they fit. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_uses_map32_with_str8_items_once_the_map_size_does_not_fit_in_8_bits)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        /*items: "k" as str8 (3 bytes) and a value of 250 bytes as str8 (252 bytes), so the map size with its count is 259*/
+        const char* const value[] = { long_value_text + LONG_SIZE - 250 };
+        const unsigned char expected_header[] =
+        {
+            0x00, 0x53, 0x74, 0xd1, 0x00, 0x00, 0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0xa1, 0x01, 'k', 0xa1, 0xfa
+        };
+        const unsigned char* encoded;
+        size_t size;
+        test_keys = one_key;
+        test_values = value;
+        test_property_count = 1;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        ASSERT_ARE_EQUAL(size_t, sizeof(expected_header) + 250 + 8, size);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(expected_header, encoded, sizeof(expected_header)));
+        ASSERT_ARE_EQUAL(int, 0, memcmp(long_value_text, encoded + sizeof(expected_header), 250));
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_012: [ AmqpEventEncoder_Encode shall grow the buffer of the encoder with realloc only when the encoded sections do not fit in it. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_does_not_allocate_when_the_event_fits_in_the_buffer)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char* encoded;
+        size_t size;
+        test_keys = one_key;
+        test_values = one_value;
+        test_property_count = 1;
+        (void)AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+        test_property_count = 0;
+        mocks.ResetAllCalls();
+
+        setExpectedCallsForGettingTheMessage(mocks);
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_OK, (int)result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 8, size);
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_013: [ If growing the buffer fails then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_ERROR, keeping the buffer it had. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_when_realloc_fails_fails_and_keeps_the_buffer)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char* encoded;
+        size_t size;
+        (void)AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+        test_content = long_content;
+        test_content_size = LONG_SIZE;
+        whenShallrealloc_fail = currentrealloc_call + 1;
+        mocks.ResetAllCalls();
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_ERROR, (int)result);
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_008: [ If the content cannot be obtained, or the content type is IOTHUBMESSAGE_UNKNOWN, then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_INVALID_MESSAGE. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_when_IoTHubMessage_GetByteArray_fails_returns_INVALID_MESSAGE)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char* encoded;
+        size_t size;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3)
+            .SetReturn(IOTHUB_MESSAGE_ERROR);
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_INVALID_MESSAGE, (int)result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_008: [ If the content cannot be obtained, or the content type is IOTHUBMESSAGE_UNKNOWN, then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_INVALID_MESSAGE. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_an_UNKNOWN_message_returns_INVALID_MESSAGE)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char* encoded;
+        size_t size;
+        test_content_type = IOTHUBMESSAGE_UNKNOWN;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_INVALID_MESSAGE, (int)result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+    /*Tests_SRS_AMQPEVENTENCODER_09_010: [ If the properties cannot be obtained then AmqpEventEncoder_Encode shall fail and return AMQPEVENTENCODER_INVALID_MESSAGE. ]*/
+    TEST_FUNCTION(AmqpEventEncoder_Encode_when_Map_GetInternals_fails_returns_INVALID_MESSAGE)
+    {
+        ///arrange
+        CAmqpEventEncoderMocks mocks;
+        AMQPEVENTENCODER_HANDLE encoder = AmqpEventEncoder_Create();
+        const unsigned char* encoded;
+        size_t size;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3)
+            .IgnoreArgument(4)
+            .SetReturn(MAP_ERROR);
+
+        ///act
+        AMQPEVENTENCODER_RESULT result = AmqpEventEncoder_Encode(encoder, TEST_MESSAGE_HANDLE, &encoded, &size);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, (int)AMQPEVENTENCODER_INVALID_MESSAGE, (int)result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        AmqpEventEncoder_Destroy(encoder);
+    }
+
+END_TEST_SUITE(amqpeventencoder_unittests)
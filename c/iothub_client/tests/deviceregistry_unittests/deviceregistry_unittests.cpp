@@ -0,0 +1,675 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#include <cstdio>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "micromockcharstararenullterminatedstrings.h"
+#include "deviceregistry.h"
+#include "azure_c_shared_utility/lock.h"
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+
+#define GBALLOC_H
+
+extern "C" int gballoc_init(void);
+extern "C" void gballoc_deinit(void);
+extern "C" void* gballoc_malloc(size_t size);
+extern "C" void* gballoc_calloc(size_t nmemb, size_t size);
+extern "C" void* gballoc_realloc(void* ptr, size_t size);
+extern "C" void gballoc_free(void* ptr);
+
+namespace BASEIMPLEMENTATION
+{
+    /*if malloc is defined as gballoc_malloc at this moment, there'd be serious trouble*/
+#define Lock(x) (LOCK_OK + gballocState - gballocState) /*compiler warning about constant in if condition*/
+#define Unlock(x) (LOCK_OK + gballocState - gballocState)
+#define Lock_Init() (LOCK_HANDLE)0x42
+#define Lock_Deinit(x) (LOCK_OK + gballocState - gballocState)
+#include "gballoc.c"
+#undef Lock
+#undef Unlock
+#undef Lock_Init
+#undef Lock_Deinit
+};
+
+#define TEST_DEVICE_1 ((const void*)0x4201)
+#define TEST_DEVICE_2 ((const void*)0x4202)
+#define TEST_DEVICE_ID_1 "device1"
+#define TEST_DEVICE_ID_2 "device2"
+
+static size_t currentmalloc_call;
+static size_t whenShallmalloc_fail;
+
+static size_t visitCount;
+static size_t device1Visits;
+static size_t device2Visits;
+static void* lastVisitContext;
+
+static void countingVisitor(const void* device, void* context)
+{
+    visitCount++;
+    if (device == TEST_DEVICE_1)
+    {
+        device1Visits++;
+    }
+    else if (device == TEST_DEVICE_2)
+    {
+        device2Visits++;
+    }
+    lastVisitContext = context;
+}
+
+TYPED_MOCK_CLASS(CDeviceRegistryMocks, CGlobalMock)
+{
+public:
+
+    MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
+        void* result2;
+        currentmalloc_call++;
+        if ((whenShallmalloc_fail > 0) && (currentmalloc_call == whenShallmalloc_fail))
+        {
+            result2 = NULL;
+        }
+        else
+        {
+            result2 = BASEIMPLEMENTATION::gballoc_malloc(size);
+        }
+    MOCK_METHOD_END(void*, result2);
+
+    MOCK_STATIC_METHOD_1(, void, gballoc_free, void*, ptr)
+        BASEIMPLEMENTATION::gballoc_free(ptr);
+    MOCK_VOID_METHOD_END()
+};
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CDeviceRegistryMocks, , void*, gballoc_malloc, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CDeviceRegistryMocks, , void, gballoc_free, void*, ptr);
+
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(deviceregistry_unittests)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+
+        currentmalloc_call = 0;
+        whenShallmalloc_fail = 0;
+        visitCount = 0;
+        device1Visits = 0;
+        device2Visits = 0;
+        lastVisitContext = NULL;
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_001: [ DeviceRegistry_Create shall allocate memory for the registry and for its hash buckets. ]*/
+    /*Tests_SRS_DEVICEREGISTRY_02_003: [ Otherwise DeviceRegistry_Create shall succeed and return a non-NULL handle to an empty registry. ]*/
+    TEST_FUNCTION(DeviceRegistry_Create_succeeds)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+
+        ///assert
+        ASSERT_IS_NOT_NULL(registry);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, DeviceRegistry_GetCount(registry));
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_002: [ If allocating memory fails then DeviceRegistry_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(DeviceRegistry_Create_fails_when_malloc_fails)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+
+        whenShallmalloc_fail = currentmalloc_call + 1;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+
+        ///assert
+        ASSERT_IS_NULL(registry);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_002: [ If allocating memory fails then DeviceRegistry_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(DeviceRegistry_Create_fails_when_allocating_buckets_fails)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+
+        whenShallmalloc_fail = currentmalloc_call + 2;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+
+        ///assert
+        ASSERT_IS_NULL(registry);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_004: [ If registry is NULL then DeviceRegistry_Destroy shall do nothing. ]*/
+    TEST_FUNCTION(DeviceRegistry_Destroy_with_NULL_does_nothing)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+
+        ///act
+        DeviceRegistry_Destroy(NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_005: [ DeviceRegistry_Destroy shall free all the entries, the hash buckets and the registry itself. ]*/
+    TEST_FUNCTION(DeviceRegistry_Destroy_frees_all_the_entries)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_2, NULL);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(registry));
+
+        ///act
+        DeviceRegistry_Destroy(registry);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_006: [ If registry or device is NULL then DeviceRegistry_Add shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(DeviceRegistry_Add_with_NULL_registry_fails)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+
+        ///act
+        int result = DeviceRegistry_Add(NULL, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_006: [ If registry or device is NULL then DeviceRegistry_Add shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(DeviceRegistry_Add_with_NULL_device_fails)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = DeviceRegistry_Add(registry, NULL, TEST_DEVICE_ID_1);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, DeviceRegistry_GetCount(registry));
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_007: [ If device is already registered then DeviceRegistry_Add shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(DeviceRegistry_Add_same_device_twice_fails)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_2);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 1, DeviceRegistry_GetCount(registry));
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_008: [ If deviceId is not NULL and a device with the same id is already registered then DeviceRegistry_Add shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(DeviceRegistry_Add_same_deviceId_twice_fails)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = DeviceRegistry_Add(registry, TEST_DEVICE_2, TEST_DEVICE_ID_1);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 1, DeviceRegistry_GetCount(registry));
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_009: [ DeviceRegistry_Add shall allocate one entry holding device and a copy of deviceId. ]*/
+    /*Tests_SRS_DEVICEREGISTRY_02_012: [ Otherwise DeviceRegistry_Add shall index the entry by device and, if deviceId is not NULL, by deviceId, and return 0. ]*/
+    TEST_FUNCTION(DeviceRegistry_Add_succeeds)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        char deviceId[] = TEST_DEVICE_ID_1;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        int result = DeviceRegistry_Add(registry, TEST_DEVICE_1, deviceId);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        deviceId[0] = 'X'; /*the registry keeps its own copy*/
+        ASSERT_ARE_EQUAL(size_t, 1, DeviceRegistry_GetCount(registry));
+        ASSERT_IS_TRUE(DeviceRegistry_Contains(registry, TEST_DEVICE_1));
+        ASSERT_ARE_EQUAL(void_ptr, (void*)TEST_DEVICE_1, (void*)DeviceRegistry_FindById(registry, TEST_DEVICE_ID_1));
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_012: [ Otherwise DeviceRegistry_Add shall index the entry by device and, if deviceId is not NULL, by deviceId, and return 0. ]*/
+    TEST_FUNCTION(DeviceRegistry_Add_without_deviceId_succeeds)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        int result = DeviceRegistry_Add(registry, TEST_DEVICE_1, NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_IS_TRUE(DeviceRegistry_Contains(registry, TEST_DEVICE_1));
+        ASSERT_ARE_EQUAL(int, 0, DeviceRegistry_Add(registry, TEST_DEVICE_2, NULL));
+        ASSERT_ARE_EQUAL(size_t, 2, DeviceRegistry_GetCount(registry));
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_010: [ If allocating the entry fails then DeviceRegistry_Add shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(DeviceRegistry_Add_fails_when_malloc_fails)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        mocks.ResetAllCalls();
+
+        whenShallmalloc_fail = currentmalloc_call + 1;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        int result = DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, DeviceRegistry_GetCount(registry));
+        ASSERT_IS_FALSE(DeviceRegistry_Contains(registry, TEST_DEVICE_1));
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_011: [ When the registry holds more devices than hash buckets, DeviceRegistry_Add shall double the number of buckets. If that allocation fails the registry shall keep its current buckets. ]*/
+    TEST_FUNCTION(DeviceRegistry_Add_grows_and_keeps_all_the_devices)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        char deviceId[16];
+        size_t i;
+        mocks.ResetAllCalls();
+
+        ///act
+        for (i = 1; i <= 100; i++)
+        {
+            (void)sprintf(deviceId, "device%u", (unsigned int)i);
+            ASSERT_ARE_EQUAL(int, 0, DeviceRegistry_Add(registry, (const void*)(i * 16), deviceId));
+        }
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 100, DeviceRegistry_GetCount(registry));
+        for (i = 1; i <= 100; i++)
+        {
+            (void)sprintf(deviceId, "device%u", (unsigned int)i);
+            ASSERT_IS_TRUE(DeviceRegistry_Contains(registry, (const void*)(i * 16)));
+            ASSERT_ARE_EQUAL(void_ptr, (void*)(i * 16), (void*)DeviceRegistry_FindById(registry, deviceId));
+        }
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_011: [ When the registry holds more devices than hash buckets, DeviceRegistry_Add shall double the number of buckets. If that allocation fails the registry shall keep its current buckets. ]*/
+    TEST_FUNCTION(DeviceRegistry_Add_succeeds_when_growing_fails)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        size_t i;
+        for (i = 1; i <= 16; i++)
+        {
+            (void)DeviceRegistry_Add(registry, (const void*)(i * 16), NULL);
+        }
+        mocks.ResetAllCalls();
+
+        whenShallmalloc_fail = currentmalloc_call + 2;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        int result = DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 17, DeviceRegistry_GetCount(registry));
+        ASSERT_ARE_EQUAL(void_ptr, (void*)TEST_DEVICE_1, (void*)DeviceRegistry_FindById(registry, TEST_DEVICE_ID_1));
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_013: [ If registry or device is NULL then DeviceRegistry_Remove shall do nothing. ]*/
+    TEST_FUNCTION(DeviceRegistry_Remove_with_NULL_registry_does_nothing)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+
+        ///act
+        DeviceRegistry_Remove(NULL, TEST_DEVICE_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_014: [ If device is not registered then DeviceRegistry_Remove shall do nothing. ]*/
+    TEST_FUNCTION(DeviceRegistry_Remove_unknown_device_does_nothing)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+        mocks.ResetAllCalls();
+
+        ///act
+        DeviceRegistry_Remove(registry, TEST_DEVICE_2);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 1, DeviceRegistry_GetCount(registry));
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_015: [ Otherwise DeviceRegistry_Remove shall remove the entry from both indexes and free it. ]*/
+    TEST_FUNCTION(DeviceRegistry_Remove_succeeds)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_2, TEST_DEVICE_ID_2);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        DeviceRegistry_Remove(registry, TEST_DEVICE_1);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 1, DeviceRegistry_GetCount(registry));
+        ASSERT_IS_FALSE(DeviceRegistry_Contains(registry, TEST_DEVICE_1));
+        ASSERT_IS_NULL(DeviceRegistry_FindById(registry, TEST_DEVICE_ID_1));
+        ASSERT_ARE_EQUAL(void_ptr, (void*)TEST_DEVICE_2, (void*)DeviceRegistry_FindById(registry, TEST_DEVICE_ID_2));
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_016: [ If registry or device is NULL then DeviceRegistry_Contains shall return false. ]*/
+    TEST_FUNCTION(DeviceRegistry_Contains_with_NULL_registry_returns_false)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+
+        ///act
+        bool result = DeviceRegistry_Contains(NULL, TEST_DEVICE_1);
+
+        ///assert
+        ASSERT_IS_FALSE(result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_017: [ Otherwise DeviceRegistry_Contains shall return true if device is registered and false otherwise. ]*/
+    TEST_FUNCTION(DeviceRegistry_Contains_unknown_device_returns_false)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+        mocks.ResetAllCalls();
+
+        ///act
+        bool result = DeviceRegistry_Contains(registry, TEST_DEVICE_2);
+
+        ///assert
+        ASSERT_IS_FALSE(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_018: [ If registry or deviceId is NULL then DeviceRegistry_FindById shall return NULL. ]*/
+    TEST_FUNCTION(DeviceRegistry_FindById_with_NULL_deviceId_returns_NULL)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+        mocks.ResetAllCalls();
+
+        ///act
+        const void* result = DeviceRegistry_FindById(registry, NULL);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_019: [ Otherwise DeviceRegistry_FindById shall return the device registered with deviceId, or NULL if there is none. ]*/
+    TEST_FUNCTION(DeviceRegistry_FindById_unknown_deviceId_returns_NULL)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+        mocks.ResetAllCalls();
+
+        ///act
+        const void* result = DeviceRegistry_FindById(registry, TEST_DEVICE_ID_2);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_020: [ DeviceRegistry_GetCount shall return the number of registered devices, or 0 if registry is NULL. ]*/
+    TEST_FUNCTION(DeviceRegistry_GetCount_with_NULL_returns_0)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+
+        ///act
+        size_t result = DeviceRegistry_GetCount(NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_021: [ If registry or visitor is NULL then DeviceRegistry_ForEach shall do nothing. ]*/
+    TEST_FUNCTION(DeviceRegistry_ForEach_with_NULL_registry_does_nothing)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+
+        ///act
+        DeviceRegistry_ForEach(NULL, countingVisitor, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 0, visitCount);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_021: [ If registry or visitor is NULL then DeviceRegistry_ForEach shall do nothing. ]*/
+    TEST_FUNCTION(DeviceRegistry_ForEach_with_NULL_visitor_does_nothing)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+        mocks.ResetAllCalls();
+
+        ///act
+        DeviceRegistry_ForEach(registry, NULL, (void*)0x42);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_022: [ Otherwise DeviceRegistry_ForEach shall call visitor once for every registered device, passing the device and context. ]*/
+    TEST_FUNCTION(DeviceRegistry_ForEach_visits_every_device_once)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_1, TEST_DEVICE_ID_1);
+        (void)DeviceRegistry_Add(registry, TEST_DEVICE_2, NULL);
+        mocks.ResetAllCalls();
+
+        ///act
+        DeviceRegistry_ForEach(registry, countingVisitor, (void*)0x42);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 2, visitCount);
+        ASSERT_ARE_EQUAL(size_t, 1, device1Visits);
+        ASSERT_ARE_EQUAL(size_t, 1, device2Visits);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)0x42, lastVisitContext);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+    /*Tests_SRS_DEVICEREGISTRY_02_022: [ Otherwise DeviceRegistry_ForEach shall call visitor once for every registered device, passing the device and context. ]*/
+    TEST_FUNCTION(DeviceRegistry_ForEach_on_empty_registry_visits_nothing)
+    {
+        ///arrange
+        CDeviceRegistryMocks mocks;
+        DEVICE_REGISTRY_HANDLE registry = DeviceRegistry_Create();
+        mocks.ResetAllCalls();
+
+        ///act
+        DeviceRegistry_ForEach(registry, countingVisitor, NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 0, visitCount);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        DeviceRegistry_Destroy(registry);
+    }
+
+END_TEST_SUITE(deviceregistry_unittests)
@@ -0,0 +1,145 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <cstdio>
+#include <cstring>
+
+#include "testrunnerswitcher.h"
+
+#include "iothub_client_ll.h"
+#include "iothub_message.h"
+#include "iothubtransportamqp.h"
+
+#include "iothub_account.h"
+
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/platform.h"
+
+#define EVENT_COUNT 1000
+#define EVENT_SIZE 256 /*about the size of a serialized telemetry event*/
+#define MAX_SEND_TIME_MS 300000
+
+static IOTHUB_ACCOUNT_INFO_HANDLE g_iothubAcctInfo = NULL;
+
+/*values of the option "max_unsettled_transfers" swept by the test, 0 being no limit*/
+static const size_t windowSizes[] = { 1, 4, 16, 64, 0 };
+
+typedef struct SEND_RESULTS_TAG
+{
+    size_t confirmed;
+    size_t confirmedOk;
+} SEND_RESULTS;
+
+static void SendConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    SEND_RESULTS* results = (SEND_RESULTS*)userContextCallback;
+    results->confirmed++;
+    if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        results->confirmedOk++;
+    }
+}
+
+static double eventsPerSecond(size_t count, uint64_t elapsedMs)
+{
+    return (elapsedMs == 0) ? (double)count * 1000 : (double)count * 1000 / elapsedMs;
+}
+
+BEGIN_TEST_SUITE(iothubclient_amqp_window_perftests)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        ASSERT_ARE_EQUAL(int, 0, platform_init());
+        g_iothubAcctInfo = IoTHubAccount_Init(true, "amqp_window_perftests");
+        ASSERT_IS_NOT_NULL(g_iothubAcctInfo);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        IoTHubAccount_deinit(g_iothubAcctInfo);
+        platform_deinit();
+    }
+
+    /*sends EVENT_COUNT events to the IoT hub for each value of "max_unsettled_transfers", measuring the throughput
+    and the peaks of the events waiting in the client queue and of the events and bytes left unsettled, which bound
+    what the client and uAMQP hold in memory at once.*/
+    TEST_FUNCTION(IoTHub_AMQP_max_unsettled_transfers_sweep)
+    {
+        // arrange
+        IOTHUB_CLIENT_CONFIG iotHubConfig = { 0 };
+        TICK_COUNTER_HANDLE tickCounter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tickCounter);
+        unsigned char content[EVENT_SIZE];
+        (void)memset(content, 'x', sizeof(content));
+        size_t i;
+
+        iotHubConfig.iotHubName = IoTHubAccount_GetIoTHubName(g_iothubAcctInfo);
+        iotHubConfig.iotHubSuffix = IoTHubAccount_GetIoTHubSuffix(g_iothubAcctInfo);
+        iotHubConfig.deviceId = IoTHubAccount_GetDeviceId(g_iothubAcctInfo);
+        iotHubConfig.deviceKey = IoTHubAccount_GetDeviceKey(g_iothubAcctInfo);
+        iotHubConfig.protocol = AMQP_Protocol;
+
+        (void)printf("max_unsettled_transfers  events/s  peak queued  peak in flight  peak bytes in flight\r\n");
+
+        for (i = 0; i < sizeof(windowSizes) / sizeof(windowSizes[0]); i++)
+        {
+            IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = IoTHubClient_LL_Create(&iotHubConfig);
+            ASSERT_IS_NOT_NULL(iotHubClientHandle);
+            ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_OK, IoTHubClient_LL_SetOption(iotHubClientHandle, "max_unsettled_transfers", &windowSizes[i]));
+
+            SEND_RESULTS results = { 0, 0 };
+            IOTHUB_CLIENT_SEND_STATS stats;
+            size_t peakQueued = 0;
+            size_t peakInFlight = 0;
+            uint64_t peakBytesInFlight = 0;
+            uint64_t start;
+            uint64_t now;
+            size_t j;
+
+            // act
+            (void)tickcounter_get_current_ms(tickCounter, &start);
+            for (j = 0; j < EVENT_COUNT; j++)
+            {
+                IOTHUB_MESSAGE_HANDLE message = IoTHubMessage_CreateFromByteArray(content, sizeof(content));
+                ASSERT_IS_NOT_NULL(message);
+                ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_OK, IoTHubClient_LL_SendEventAsync(iotHubClientHandle, message, SendConfirmationCallback, &results));
+                IoTHubMessage_Destroy(message);
+            }
+
+            do
+            {
+                IoTHubClient_LL_DoWork(iotHubClientHandle);
+                if (IoTHubClient_LL_GetSendStats(iotHubClientHandle, &stats) == IOTHUB_CLIENT_OK)
+                {
+                    peakQueued = (stats.queued > peakQueued) ? stats.queued : peakQueued;
+                    peakInFlight = (stats.inFlight > peakInFlight) ? stats.inFlight : peakInFlight;
+                    peakBytesInFlight = (stats.bytesInFlight > peakBytesInFlight) ? stats.bytesInFlight : peakBytesInFlight;
+                }
+                ThreadAPI_Sleep(1);
+                (void)tickcounter_get_current_ms(tickCounter, &now);
+            } while (results.confirmed < EVENT_COUNT && now - start < MAX_SEND_TIME_MS);
+
+            (void)printf("%23lu  %8.0f  %11lu  %14lu  %20lu\r\n",
+                (unsigned long)windowSizes[i], eventsPerSecond(results.confirmed, now - start),
+                (unsigned long)peakQueued, (unsigned long)peakInFlight, (unsigned long)peakBytesInFlight);
+
+            // assert
+            ASSERT_ARE_EQUAL(size_t, EVENT_COUNT, results.confirmedOk);
+            if (windowSizes[i] != 0)
+            {
+                ASSERT_IS_TRUE(peakInFlight <= windowSizes[i]);
+            }
+
+            // cleanup
+            IoTHubClient_LL_Destroy(iotHubClientHandle);
+        }
+
+        tickcounter_destroy(tickCounter);
+    }
+
+END_TEST_SUITE(iothubclient_amqp_window_perftests)
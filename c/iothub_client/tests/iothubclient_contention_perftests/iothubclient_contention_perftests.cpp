@@ -0,0 +1,295 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <cstdio>
+
+#include "testrunnerswitcher.h"
+
+#include "iothub_client.h"
+#include "iothub_message.h"
+#include "iothub_transport_ll.h"
+#include "iothub_client_private.h"
+
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+/*every IoTHubClient_LL_DoWork of the fake transport blocks this long, the way a synchronous HTTP request does*/
+#define SIMULATED_IO_TIME_MS 200
+#define PRODUCER_COUNT 16
+#define EVENTS_PER_PRODUCER 200
+#define MAX_CONFIRMATION_WAIT_TIME_MS 60000
+
+/*fake transport - accepts everything and "sends" whatever is waiting after blocking for SIMULATED_IO_TIME_MS*/
+typedef struct FAKE_TRANSPORT_TAG
+{
+    PDLIST_ENTRY waitingToSend;
+} FAKE_TRANSPORT;
+
+static IOTHUB_CLIENT_RESULT FakeTransport_SetOption(TRANSPORT_LL_HANDLE handle, const char* optionName, const void* value)
+{
+    (void)handle;
+    (void)optionName;
+    (void)value;
+    return IOTHUB_CLIENT_INVALID_ARG;
+}
+
+static TRANSPORT_LL_HANDLE FakeTransport_Create(const IOTHUBTRANSPORT_CONFIG* config)
+{
+    FAKE_TRANSPORT* result = (FAKE_TRANSPORT*)malloc(sizeof(FAKE_TRANSPORT));
+    (void)config;
+    if (result != NULL)
+    {
+        result->waitingToSend = NULL;
+    }
+    return result;
+}
+
+static void FakeTransport_Destroy(TRANSPORT_LL_HANDLE handle)
+{
+    free(handle);
+}
+
+static IOTHUB_DEVICE_HANDLE FakeTransport_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, PDLIST_ENTRY waitingToSend)
+{
+    FAKE_TRANSPORT* transport = (FAKE_TRANSPORT*)handle;
+    (void)device;
+    (void)iotHubClientHandle;
+    transport->waitingToSend = waitingToSend;
+    return transport;
+}
+
+static void FakeTransport_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
+{
+    (void)deviceHandle;
+}
+
+static int FakeTransport_Subscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    return 0;
+}
+
+static void FakeTransport_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+}
+
+static void FakeTransport_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    FAKE_TRANSPORT* transport = (FAKE_TRANSPORT*)handle;
+    if ((transport->waitingToSend != NULL) && !DList_IsListEmpty(transport->waitingToSend))
+    {
+        DLIST_ENTRY completed;
+        DList_InitializeListHead(&completed);
+
+        ThreadAPI_Sleep(SIMULATED_IO_TIME_MS);
+
+        while (!DList_IsListEmpty(transport->waitingToSend))
+        {
+            PDLIST_ENTRY entry = transport->waitingToSend->Flink;
+            (void)DList_RemoveEntryList(entry);
+            DList_InsertTailList(&completed, entry);
+        }
+        IoTHubClient_LL_SendComplete(iotHubClientHandle, &completed, IOTHUB_BATCHSTATE_SUCCESS);
+    }
+}
+
+static IOTHUB_CLIENT_RESULT FakeTransport_GetSendStatus(IOTHUB_DEVICE_HANDLE handle, IOTHUB_CLIENT_STATUS* iotHubClientStatus)
+{
+    FAKE_TRANSPORT* transport = (FAKE_TRANSPORT*)handle;
+    *iotHubClientStatus = DList_IsListEmpty(transport->waitingToSend) ? IOTHUB_CLIENT_SEND_STATUS_IDLE : IOTHUB_CLIENT_SEND_STATUS_BUSY;
+    return IOTHUB_CLIENT_OK;
+}
+
+static IOTHUB_CLIENT_RESULT FakeTransport_SendMessageDisposition(IOTHUB_DEVICE_HANDLE handle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition)
+{
+    (void)handle;
+    (void)disposition;
+    IoTHubMessage_Destroy(message);
+    return IOTHUB_CLIENT_OK;
+}
+
+static TRANSPORT_PROVIDER fakeTransportProvider =
+{
+    FakeTransport_SetOption,
+    FakeTransport_Create,
+    FakeTransport_Destroy,
+    FakeTransport_Register,
+    FakeTransport_Unregister,
+    FakeTransport_Subscribe,
+    FakeTransport_Unsubscribe,
+    FakeTransport_DoWork,
+    FakeTransport_GetSendStatus,
+    FakeTransport_SendMessageDisposition
+};
+
+static const void* provideFakeTransport(void)
+{
+    return &fakeTransportProvider;
+}
+
+static const IOTHUB_CLIENT_CONFIG TEST_CONFIG =
+{
+    provideFakeTransport,   /* IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol;   */
+    "perfDevice",           /* const char* deviceId;                        */
+    "perfKey",              /* const char* deviceKey;                       */
+    NULL,                   /* const char* deviceSasToken;                  */
+    "perfHub",              /* const char* iotHubName;                      */
+    "perfSuffix",           /* const char* iotHubSuffix;                    */
+    NULL                    /* const char* protocolGatewayHostName;         */
+};
+
+typedef struct PRODUCER_DATA_TAG
+{
+    IOTHUB_CLIENT_HANDLE iotHubClient;
+    TICK_COUNTER_HANDLE tickCounter;
+    size_t failedSends;
+    uint64_t maxCallTime;
+    uint64_t totalCallTime;
+} PRODUCER_DATA;
+
+static LOCK_HANDLE confirmationsLock;
+static size_t confirmationCount;
+
+static void SendConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    (void)result;
+    (void)userContextCallback;
+    if (Lock(confirmationsLock) == LOCK_OK)
+    {
+        confirmationCount++;
+        (void)Unlock(confirmationsLock);
+    }
+}
+
+static size_t GetConfirmationCount(void)
+{
+    size_t result = 0;
+    if (Lock(confirmationsLock) == LOCK_OK)
+    {
+        result = confirmationCount;
+        (void)Unlock(confirmationsLock);
+    }
+    return result;
+}
+
+static int Producer_Thread(void* threadArgument)
+{
+    PRODUCER_DATA* producer = (PRODUCER_DATA*)threadArgument;
+    const unsigned char payload[] = "{\"temperature\":21}";
+    size_t i;
+
+    for (i = 0; i < EVENTS_PER_PRODUCER; i++)
+    {
+        IOTHUB_MESSAGE_HANDLE message = IoTHubMessage_CreateFromByteArray(payload, sizeof(payload) - 1);
+        uint64_t before;
+        uint64_t after;
+        if (message == NULL)
+        {
+            producer->failedSends++;
+        }
+        else
+        {
+            (void)tickcounter_get_current_ms(producer->tickCounter, &before);
+            if (IoTHubClient_SendEventAsync_Move(producer->iotHubClient, message, SendConfirmationCallback, NULL) != IOTHUB_CLIENT_OK)
+            {
+                IoTHubMessage_Destroy(message);
+                producer->failedSends++;
+            }
+            (void)tickcounter_get_current_ms(producer->tickCounter, &after);
+
+            if (after - before > producer->maxCallTime)
+            {
+                producer->maxCallTime = after - before;
+            }
+            producer->totalCallTime += after - before;
+        }
+    }
+    return 0;
+}
+
+BEGIN_TEST_SUITE(iothubclient_contention_perftests)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        confirmationsLock = Lock_Init();
+        ASSERT_IS_NOT_NULL(confirmationsLock);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        (void)Lock_Deinit(confirmationsLock);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        confirmationCount = 0;
+    }
+
+    /*PRODUCER_COUNT threads send events while the worker thread keeps the transport busy in blocking I/O.
+    No call to IoTHubClient_SendEventAsync_Move shall wait for the I/O to complete.*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_Move_does_not_wait_for_blocking_transport_IO)
+    {
+        // arrange
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        ASSERT_IS_NOT_NULL(iotHubClient);
+        PRODUCER_DATA producers[PRODUCER_COUNT];
+        THREAD_HANDLE threads[PRODUCER_COUNT];
+        size_t i;
+        uint64_t maxCallTime = 0;
+        uint64_t totalCallTime = 0;
+        size_t failedSends = 0;
+
+        /*the first send starts the worker thread, after that the transport is busy most of the time*/
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, IoTHubMessage_CreateFromByteArray((const unsigned char*)"x", 1), SendConfirmationCallback, NULL);
+
+        // act
+        for (i = 0; i < PRODUCER_COUNT; i++)
+        {
+            producers[i].iotHubClient = iotHubClient;
+            producers[i].tickCounter = tickcounter_create();
+            ASSERT_IS_NOT_NULL(producers[i].tickCounter);
+            producers[i].failedSends = 0;
+            producers[i].maxCallTime = 0;
+            producers[i].totalCallTime = 0;
+            ASSERT_ARE_EQUAL(int, (int)THREADAPI_OK, (int)ThreadAPI_Create(&threads[i], Producer_Thread, &producers[i]));
+        }
+
+        for (i = 0; i < PRODUCER_COUNT; i++)
+        {
+            int res;
+            (void)ThreadAPI_Join(threads[i], &res);
+            if (producers[i].maxCallTime > maxCallTime)
+            {
+                maxCallTime = producers[i].maxCallTime;
+            }
+            totalCallTime += producers[i].totalCallTime;
+            failedSends += producers[i].failedSends;
+            tickcounter_destroy(producers[i].tickCounter);
+        }
+
+        for (i = 0; (i < MAX_CONFIRMATION_WAIT_TIME_MS / SIMULATED_IO_TIME_MS) && (GetConfirmationCount() < PRODUCER_COUNT * EVENTS_PER_PRODUCER + 1); i++)
+        {
+            ThreadAPI_Sleep(SIMULATED_IO_TIME_MS);
+        }
+
+        (void)printf("%d producers x %d events, simulated I/O %d ms: average call %.3f ms, max call %lu ms, %lu confirmed\r\n",
+            PRODUCER_COUNT, EVENTS_PER_PRODUCER, SIMULATED_IO_TIME_MS,
+            (double)totalCallTime / (PRODUCER_COUNT * EVENTS_PER_PRODUCER),
+            (unsigned long)maxCallTime, (unsigned long)GetConfirmationCount());
+
+        // assert
+        ASSERT_ARE_EQUAL(size_t, 0, failedSends);
+        ASSERT_ARE_EQUAL(size_t, PRODUCER_COUNT * EVENTS_PER_PRODUCER + 1, GetConfirmationCount());
+        ASSERT_IS_TRUE(maxCallTime < SIMULATED_IO_TIME_MS);
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+END_TEST_SUITE(iothubclient_contention_perftests)
@@ -24,6 +24,9 @@
 #include "azure_c_shared_utility/strings.h"
 
 #include "azure_c_shared_utility/tickcounter.h"
+#include "nodepool.h"
+#include "messagestore.h"
+#include "azure_c_shared_utility/map.h"
 
 extern "C" int gballoc_init(void);
 extern "C" void gballoc_deinit(void);
@@ -52,6 +55,7 @@ namespace BASEIMPLEMENTATION
 DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_RESULT_VALUES);
 DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUB_BATCHSTATE_RESULT, IOTHUB_BATCHSTATE_RESULT_VALUES);
 DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_DISPOSITION_RESULT_VALUES);
+DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
 
 
 static MICROMOCK_MUTEX_HANDLE g_testByTest;
@@ -80,6 +84,11 @@ static bool checkProtocolGatewayIsNull;
 #define TEST_DEVICEMESSAGE_HANDLE_2 (IOTHUB_MESSAGE_HANDLE)0x53
 #define TEST_IOTHUB_CLIENT_LL_HANDLE    (IOTHUB_CLIENT_LL_HANDLE)0x4242
 
+#define TEST_MESSAGESTORE_HANDLE (MESSAGESTORE_HANDLE)0x60
+#define TEST_MESSAGESTORE_SEGMENT_HANDLE (MESSAGESTORE_SEGMENT_HANDLE)0x61
+#define TEST_MAP_HANDLE (MAP_HANDLE)0x62
+#define TEST_MESSAGESTORE_PATH "theMessageStore"
+
 #define TEST_STRING_HANDLE (STRING_HANDLE)0x46
 #define TEST_STRING_TOKENIZER_HANDLE (STRING_TOKENIZER_HANDLE)0x48
 static const char* TEST_CHAR = "TestChar";
@@ -133,8 +142,22 @@ static const IOTHUB_CLIENT_DEVICE_CONFIG TEST_DEVICE_CONFIG_null_handle =
 
 static size_t currentmalloc_call;
 static size_t whenShallmalloc_fail;
+static size_t currentNodePool_Alloc_call;
+static size_t whenShallNodePool_Alloc_fail;
+static size_t nodePoolNodeSize;
 static IOTHUB_CLIENT_STATUS currentIotHubClientStatus;
 
+/*MessageStore_Append keeps the last record, MessageStore_ReadNext hands it out messageStoreRecordsToRead times*/
+static unsigned char messageStoreRecord[256];
+static size_t messageStoreRecordSize;
+static size_t messageStoreRecordsToRead;
+static bool messageStoreIsEmpty;
+static IOTHUB_MESSAGE_PRIORITY currentMessagePriority;
+static PDLIST_ENTRY registeredWaitingToSend;
+static const unsigned char TEST_BODY[] = { 'a', 'b', 'c' };
+static const char* TEST_PROPERTY_KEYS[] = { "theKey" };
+static const char* TEST_PROPERTY_VALUES[] = { "theValue" };
+
 TYPED_MOCK_CLASS(CIoTHubClientLLMocks, CGlobalMock)
 {
 public:
@@ -228,6 +251,7 @@ public:
 		MOCK_VOID_METHOD_END()
 
 		MOCK_STATIC_METHOD_4(, IOTHUB_DEVICE_HANDLE, FAKE_IoTHubTransport_Register, TRANSPORT_LL_HANDLE, handle, const IOTHUB_DEVICE_CONFIG*, device, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, PDLIST_ENTRY, waitingToSend)
+		registeredWaitingToSend = waitingToSend;
 		MOCK_METHOD_END(IOTHUB_DEVICE_HANDLE, (IOTHUB_DEVICE_HANDLE)handle)
 
 		MOCK_STATIC_METHOD_1(, void, FAKE_IoTHubTransport_Unregister, IOTHUB_DEVICE_HANDLE, handle)
@@ -246,6 +270,9 @@ public:
 		*iotHubClientStatus = currentIotHubClientStatus;
 	MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
 
+	MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, FAKE_IoTHubTransport_SendMessageDisposition, IOTHUB_DEVICE_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, message, IOTHUBMESSAGE_DISPOSITION_RESULT, disposition)
+	MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+
 		MOCK_STATIC_METHOD_2(, void, eventConfirmationCallback, IOTHUB_CLIENT_CONFIRMATION_RESULT, result2, void*, userContextCallback)
 		MOCK_VOID_METHOD_END()
 
@@ -305,6 +332,137 @@ public:
 
 		MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms);
 	MOCK_METHOD_END(int, 0)
+
+		/* NodePool mocks */
+		MOCK_STATIC_METHOD_2(, NODEPOOL_HANDLE, NodePool_Create, size_t, nodeSize, size_t, growth)
+	nodePoolNodeSize = nodeSize;
+	NODEPOOL_HANDLE result2 = (NODEPOOL_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+	MOCK_METHOD_END(NODEPOOL_HANDLE, result2)
+
+		MOCK_STATIC_METHOD_1(, void, NodePool_Destroy, NODEPOOL_HANDLE, pool)
+	BASEIMPLEMENTATION::gballoc_free(pool);
+	MOCK_VOID_METHOD_END()
+
+		MOCK_STATIC_METHOD_2(, int, NodePool_Reserve, NODEPOOL_HANDLE, pool, size_t, count)
+	MOCK_METHOD_END(int, 0)
+
+		MOCK_STATIC_METHOD_2(, int, NodePool_SetGrowth, NODEPOOL_HANDLE, pool, size_t, growth)
+	MOCK_METHOD_END(int, 0)
+
+		MOCK_STATIC_METHOD_1(, void*, NodePool_Alloc, NODEPOOL_HANDLE, pool)
+	void* result2;
+	currentNodePool_Alloc_call++;
+	if ((whenShallNodePool_Alloc_fail > 0) && (currentNodePool_Alloc_call == whenShallNodePool_Alloc_fail))
+	{
+		result2 = NULL;
+	}
+	else
+	{
+		result2 = BASEIMPLEMENTATION::gballoc_malloc(nodePoolNodeSize);
+	}
+	MOCK_METHOD_END(void*, result2)
+
+		MOCK_STATIC_METHOD_1(, void, NodePool_Free, void*, node)
+	BASEIMPLEMENTATION::gballoc_free(node);
+	MOCK_VOID_METHOD_END()
+
+		MOCK_STATIC_METHOD_2(, int, NodePool_GetStats, NODEPOOL_HANDLE, pool, NODEPOOL_STATS*, stats)
+	stats->hits = 1;
+	stats->misses = 2;
+	stats->inUse = 3;
+	stats->highWaterMark = 4;
+	stats->capacity = 5;
+	MOCK_METHOD_END(int, 0)
+
+		/* MessageStore mocks */
+		MOCK_STATIC_METHOD_2(, MESSAGESTORE_HANDLE, MessageStore_Create, const char*, path, size_t, segmentSize)
+	MOCK_METHOD_END(MESSAGESTORE_HANDLE, TEST_MESSAGESTORE_HANDLE)
+
+		MOCK_STATIC_METHOD_1(, void, MessageStore_Destroy, MESSAGESTORE_HANDLE, store)
+	MOCK_VOID_METHOD_END()
+
+		MOCK_STATIC_METHOD_3(, int, MessageStore_Append, MESSAGESTORE_HANDLE, store, const unsigned char*, data, size_t, size)
+	if (size <= sizeof(messageStoreRecord))
+	{
+		memcpy(messageStoreRecord, data, size);
+		messageStoreRecordSize = size;
+	}
+	MOCK_METHOD_END(int, 0)
+
+		MOCK_STATIC_METHOD_2(, int, MessageStore_ReadNext, MESSAGESTORE_HANDLE, store, MESSAGESTORE_RECORD*, record)
+	int result2;
+	if (messageStoreRecordsToRead == 0)
+	{
+		result2 = __LINE__;
+	}
+	else
+	{
+		messageStoreRecordsToRead--;
+		record->data = messageStoreRecord;
+		record->size = messageStoreRecordSize;
+		record->segment = TEST_MESSAGESTORE_SEGMENT_HANDLE;
+		record->appendedByThisStore = true;
+		result2 = 0;
+	}
+	MOCK_METHOD_END(int, result2)
+
+		MOCK_STATIC_METHOD_2(, int, MessageStore_SetSyncInterval, MESSAGESTORE_HANDLE, store, size_t, syncInterval)
+	MOCK_METHOD_END(int, 0)
+
+		MOCK_STATIC_METHOD_1(, bool, MessageStore_IsEmpty, MESSAGESTORE_HANDLE, store)
+	MOCK_METHOD_END(bool, messageStoreIsEmpty && (messageStoreRecordsToRead == 0))
+
+		MOCK_STATIC_METHOD_2(, void, MessageStore_Confirm, MESSAGESTORE_HANDLE, store, MESSAGESTORE_SEGMENT_HANDLE, segment)
+	MOCK_VOID_METHOD_END()
+
+		/* the message is serialized when it goes to the message store */
+		MOCK_STATIC_METHOD_1(, IOTHUBMESSAGE_CONTENT_TYPE, IoTHubMessage_GetContentType, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+	MOCK_METHOD_END(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_BYTEARRAY)
+
+		MOCK_STATIC_METHOD_3(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetByteArray, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const unsigned char**, buffer, size_t*, size)
+	*buffer = TEST_BODY;
+	*size = sizeof(TEST_BODY);
+	MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK)
+
+		MOCK_STATIC_METHOD_1(, const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+	MOCK_METHOD_END(const char*, (const char*)NULL)
+
+		MOCK_STATIC_METHOD_1(, MAP_HANDLE, IoTHubMessage_Properties, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+	MOCK_METHOD_END(MAP_HANDLE, TEST_MAP_HANDLE)
+
+		MOCK_STATIC_METHOD_1(, const char*, IoTHubMessage_GetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+	MOCK_METHOD_END(const char*, "theMessageId")
+
+		MOCK_STATIC_METHOD_1(, const char*, IoTHubMessage_GetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+	MOCK_METHOD_END(const char*, (const char*)NULL)
+
+		MOCK_STATIC_METHOD_4(, MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count)
+	*keys = TEST_PROPERTY_KEYS;
+	*values = TEST_PROPERTY_VALUES;
+	*count = 1;
+	MOCK_METHOD_END(MAP_RESULT, MAP_OK)
+
+		/* and rebuilt when it is replayed */
+		MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, byteArray, size_t, size)
+	MOCK_METHOD_END(IOTHUB_MESSAGE_HANDLE, TEST_DEVICEMESSAGE_HANDLE_2)
+
+		MOCK_STATIC_METHOD_1(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromString, const char*, source)
+	MOCK_METHOD_END(IOTHUB_MESSAGE_HANDLE, TEST_DEVICEMESSAGE_HANDLE_2)
+
+		MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, messageId)
+	MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK)
+
+		MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, correlationId)
+	MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK)
+
+		MOCK_STATIC_METHOD_1(, IOTHUB_MESSAGE_PRIORITY, IoTHubMessage_GetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+	MOCK_METHOD_END(IOTHUB_MESSAGE_PRIORITY, currentMessagePriority)
+
+		MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY, priority)
+	MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK)
+
+		MOCK_STATIC_METHOD_3(, MAP_RESULT, Map_AddOrUpdate, MAP_HANDLE, handle, const char*, key, const char*, value)
+	MOCK_METHOD_END(MAP_RESULT, MAP_OK)
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void, DList_InitializeListHead, PDLIST_ENTRY, listHead);
@@ -327,6 +485,7 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , int, FAKE_IoTHubTransport_S
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void, FAKE_IoTHubTransport_Unsubscribe, TRANSPORT_LL_HANDLE, handle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , void, FAKE_IoTHubTransport_DoWork, TRANSPORT_LL_HANDLE, handle, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , IOTHUB_CLIENT_RESULT, FAKE_IoTHubTransport_GetSendStatus, TRANSPORT_LL_HANDLE, handle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMocks, , IOTHUB_CLIENT_RESULT, FAKE_IoTHubTransport_SendMessageDisposition, IOTHUB_DEVICE_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, message, IOTHUBMESSAGE_DISPOSITION_RESULT, disposition);
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , void, eventConfirmationCallback, IOTHUB_CLIENT_CONFIRMATION_RESULT, result2, void*, userContextCallback);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , IOTHUBMESSAGE_DISPOSITION_RESULT, messageCallback, IOTHUB_MESSAGE_HANDLE, message, void*, userContextCallback);
@@ -354,6 +513,37 @@ DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubClientLLMocks, , TICK_COUNTER_HANDLE, tickco
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms);
 
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , NODEPOOL_HANDLE, NodePool_Create, size_t, nodeSize, size_t, growth);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void, NodePool_Destroy, NODEPOOL_HANDLE, pool);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , int, NodePool_Reserve, NODEPOOL_HANDLE, pool, size_t, count);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , int, NodePool_SetGrowth, NODEPOOL_HANDLE, pool, size_t, growth);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void*, NodePool_Alloc, NODEPOOL_HANDLE, pool);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void, NodePool_Free, void*, node);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , int, NodePool_GetStats, NODEPOOL_HANDLE, pool, NODEPOOL_STATS*, stats);
+
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , MESSAGESTORE_HANDLE, MessageStore_Create, const char*, path, size_t, segmentSize);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void, MessageStore_Destroy, MESSAGESTORE_HANDLE, store);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMocks, , int, MessageStore_Append, MESSAGESTORE_HANDLE, store, const unsigned char*, data, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , int, MessageStore_ReadNext, MESSAGESTORE_HANDLE, store, MESSAGESTORE_RECORD*, record);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , int, MessageStore_SetSyncInterval, MESSAGESTORE_HANDLE, store, size_t, syncInterval);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , bool, MessageStore_IsEmpty, MESSAGESTORE_HANDLE, store);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , void, MessageStore_Confirm, MESSAGESTORE_HANDLE, store, MESSAGESTORE_SEGMENT_HANDLE, segment);
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , IOTHUBMESSAGE_CONTENT_TYPE, IoTHubMessage_GetContentType, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetByteArray, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const unsigned char**, buffer, size_t*, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , MAP_HANDLE, IoTHubMessage_Properties, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , const char*, IoTHubMessage_GetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , const char*, IoTHubMessage_GetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientLLMocks, , MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, byteArray, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromString, const char*, source);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, messageId);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, correlationId);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_PRIORITY, IoTHubMessage_GetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY, priority);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMocks, , MAP_RESULT, Map_AddOrUpdate, MAP_HANDLE, handle, const char*, key, const char*, value);
+
 static TRANSPORT_PROVIDER FAKE_transport_provider =
 {
 	FAKE_IoTHubTransport_SetOption,     /*pfIoTHubTransport_SetOption IoTHubTransport_SetOption;       */
@@ -364,7 +554,8 @@ static TRANSPORT_PROVIDER FAKE_transport_provider =
 	FAKE_IoTHubTransport_Subscribe,     /*pfIoTHubTransport_Subscribe IoTHubTransport_Subscribe;        */
 	FAKE_IoTHubTransport_Unsubscribe,   /*pfIoTHubTransport_Unsubscribe IoTHubTransport_Unsubscribe;    */
 	FAKE_IoTHubTransport_DoWork,        /*pfIoTHubTransport_DoWork IoTHubTransport_DoWork;              */
-	FAKE_IoTHubTransport_GetSendStatus  /*pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus; */
+	FAKE_IoTHubTransport_GetSendStatus, /*pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus; */
+	FAKE_IoTHubTransport_SendMessageDisposition /*pfIoTHubTransport_SendMessageDisposition IoTHubTransport_SendMessageDisposition; */
 };
 
 static const void* provideFAKE(void)
@@ -396,8 +587,15 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 	}
 	currentmalloc_call = 0;
 	whenShallmalloc_fail = 0;
+	currentNodePool_Alloc_call = 0;
+	whenShallNodePool_Alloc_fail = 0;
 	checkProtocolGatewayHostName = false;
 	checkProtocolGatewayIsNull = false;
+	messageStoreRecordSize = 0;
+	messageStoreRecordsToRead = 0;
+	messageStoreIsEmpty = true;
+	currentMessagePriority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	registeredWaitingToSend = NULL;
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -496,6 +694,8 @@ TEST_FUNCTION(IoTHubClient_LL_CreateFromConnectionString_with_DeviceKey_succeeds
 
 	/* underlying IoTHubClient_LL_Create call */
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -598,6 +798,8 @@ TEST_FUNCTION(IoTHubClient_LL_CreateFromConnectionString_with_DeviceSasToken_suc
 
 	/* underlying IoTHubClient_LL_Create call */
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -833,6 +1035,8 @@ TEST_FUNCTION(IoTHubClient_LL_CreateFromConnectionString_withGatewayHostName_suc
 
 	/* underlying IoTHubClient_LL_Create call */
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -931,6 +1135,8 @@ TEST_FUNCTION(IoTHubClient_LL_CreateFromConnectionString_withoutGatewayHostName_
 
 	/* underlying IoTHubClient_LL_Create call */
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -1094,8 +1300,12 @@ TEST_FUNCTION(IoTHubClient_LL_CreateFromConnectionString_if_IoTHubClient_LL_Crea
 		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -2005,6 +2215,33 @@ TEST_FUNCTION(IoTHubClient_LL_Create_fails_when_tick_counter_create_fails)
 	ASSERT_ARE_EQUAL(void_ptr, NULL, result);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_055: [ If NodePool_Create fails then IoTHubClient_LL_Create shall fail and return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_LL_Create_fails_when_NodePool_Create_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2)
+		.SetFailReturn((NODEPOOL_HANDLE)NULL);
+
+	///act
+	auto result = IoTHubClient_LL_Create(&TEST_CONFIG);
+
+	///assert
+	ASSERT_ARE_EQUAL(void_ptr, NULL, result);
+	mocks.AssertActualAndExpectedCalls();
+}
+
 /*Tests_SRS_IOTHUBCLIENT_LL_02_004: [Otherwise IoTHubClient_LL_Create shall initialize a new DLIST (further called "waitingToSend") containing records with fields of the following types: IOTHUB_MESSAGE_HANDLE, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, void*.]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_006: [IoTHubClient_LL_Create shall populate a structure of type IOTHUBTRANSPORT_CONFIG with the information from config parameter and the previous DLIST and shall pass that to the underlying layer _Create function.]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_007: [If the underlaying layer _Create function fails them IoTHubClient_LL_Create shall fail and return NULL.]*/
@@ -2018,8 +2255,12 @@ TEST_FUNCTION(IoTHubClient_LL_Create_fails_when_underlying_transport_fails)
 		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -2051,8 +2292,12 @@ TEST_FUNCTION(IoTHubClient_LL_Create_fails_when_underlying_transport_register_fa
 		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -2091,6 +2336,8 @@ TEST_FUNCTION(IoTHubClient_LL_Create_suceeds)
 		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -2161,6 +2408,8 @@ TEST_FUNCTION(IoTHubClient_LL_CreateWithTransport_Succeeds)
 	device.deviceSasToken = NULL;
 
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -2194,8 +2443,12 @@ TEST_FUNCTION(IoTHubClient_LL_CreateWithTransport_transport_register_fails_retur
 	device.deviceSasToken = NULL;
 
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -2242,6 +2495,33 @@ TEST_FUNCTION(IoTHubClient_LL_CreateWithTransport_tick_counter_fails_returns_nul
 	///cleanup
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_057: [ If NodePool_Create fails then IoTHubClient_LL_CreateWithTransport shall fail and return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_LL_CreateWithTransport_NodePool_Create_fails_returns_null)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(sizeof(IOTHUB_MESSAGE_LIST), IGNORED_NUM_ARG))
+		.IgnoreArgument(2)
+		.SetFailReturn((NODEPOOL_HANDLE)NULL);
+
+	///act
+	auto result = IoTHubClient_LL_CreateWithTransport(&TEST_DEVICE_CONFIG);
+
+	///assert
+	ASSERT_IS_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
+}
+
 /*Tests_SRS_IOTHUBCLIENT_LL_17_003: [If allocation fails, the function shall fail and return NULL.]*/
 TEST_FUNCTION(IoTHubClient_LL_CreateWithTransport_allocation_fails_returns_null)
 {
@@ -2290,6 +2570,8 @@ TEST_FUNCTION(IoTHubClient_LL_Destroys_the_underlying_transport_succeeds)
 
 	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -2316,6 +2598,8 @@ TEST_FUNCTION(IoTHubClient_LL_Destroys_unregisters_but_does_not_destroy_transpor
 
 	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -2393,7 +2677,12 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_succeeds)
 	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -2440,8 +2729,10 @@ TEST_FUNCTION(IoTHubClient_LL_Destroy_after_sendEvent_succeeds)
 
 	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*IOTHUBMESSAGE*/
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*IOTHUB_MESSAGE_LIST*/
 		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG)) /*because this says "no more items in the list*/
@@ -2463,9 +2754,14 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_fails_when_IoTHubMessage_Clone_fail
 	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*because _Clone fails below*/
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*because _Clone fails below*/
 		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(IGNORED_PTR_ARG))
@@ -2494,9 +2790,12 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_fails_when_current_ms_cannot_be_obt
 	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*because _Clone fails below*/
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*because _Clone fails below*/
 		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -2523,8 +2822,11 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_fails_when_malloc_fails)
 	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
-	whenShallmalloc_fail = currentmalloc_call+1;
-	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	whenShallNodePool_Alloc_fail = currentNodePool_Alloc_call+1;
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
 	///act
@@ -2538,326 +2840,316 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_fails_when_malloc_fails)
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_016: [IoTHubClient_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.]*/
-TEST_FUNCTION(IoTHubClient_LL_SetMessageCallback_with_NULL_iotHubClientHandle_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_049: [ IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_with_NULL_iotHubClientHandle_fails)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
+	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 
 	///act
-	auto result = IoTHubClient_LL_SetMessageCallback(NULL, messageCallback, (void*)1);
+	auto result = IoTHubClient_LL_SendEventAsync_Move(NULL, messageHandle, eventConfirmationCallback, (void*)3);
 
 	///assert
 	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
-	mocks.AssertActualAndExpectedCalls();
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_019: [If parameter messageCallback is NULL then IoTHubClient_LL_SetMessageCallback shall call the underlying layer's _Unsubscribe function and return IOTHUB_CLIENT_OK.] */
-TEST_FUNCTION(IoTHubClient_LL_SetMessageCallback_with_NULL_calls_Unsubscribe_and_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_049: [ IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_with_NULL_messageHandle_fails)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Unsubscribe(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
 	///act
-	auto result = IoTHubClient_LL_SetMessageCallback(handle, NULL, (void*)1);
+	auto result = IoTHubClient_LL_SendEventAsync_Move(handle, NULL, eventConfirmationCallback, (void*)3);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_017: [If parameter messageCallback is non-NULL then IoTHubClient_LL_SetMessageCallback shall call the underlying layer's _Subscribe function.]*/
-TEST_FUNCTION(IoTHubClient_LL_SetMessageCallback_with_non_NULL_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_050: [ IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_with_NULL_eventConfirmationCallback_and_non_NULL_context_fails)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Subscribe(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
 	///act
-	auto result = IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)1);
+	auto result = IoTHubClient_LL_SendEventAsync_Move(handle, messageHandle, NULL, (void*)3);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_018: [If the underlying layer's _Subscribe function fails, then IoTHubClient_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_ERROR. Otherwise IoTHubClient_LL_SetMessageCallback shall succeed and return IOTHUB_CLIENT_OK.]*/
-TEST_FUNCTION(IoTHubClient_LL_SetMessageCallback_with_non_fails_when_underlying_transport_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_051: [ IoTHubClient_LL_SendEventAsync_Move shall add to the DLIST waitingToSend a new record that takes eventMessageHandle itself, without cloning it, together with eventConfirmationCallback and userContextCallback. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_053: [ Otherwise IoTHubClient_LL_SendEventAsync_Move shall succeed and return IOTHUB_CLIENT_OK. From then on eventMessageHandle is owned by IoTHubClient_LL and shall be destroyed by it once the message is completed. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_succeeds)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Subscribe(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
-		.SetReturn(1);
+		.IgnoreArgument(2);
 
 	///act
-	auto result = IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)1);
+	auto result = IoTHubClient_LL_SendEventAsync_Move(handle, messageHandle, eventConfirmationCallback, (void*)1);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_020: [If parameter iotHubClientHandle is NULL then IoTHubClient_LL_DoWork shall not perform any action.] */
-TEST_FUNCTION(IoTHubClient_LL_DoWork_with_NULL_does_nothing)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_053: [ Otherwise IoTHubClient_LL_SendEventAsync_Move shall succeed and return IOTHUB_CLIENT_OK. From then on eventMessageHandle is owned by IoTHubClient_LL and shall be destroyed by it once the message is completed. ]*/
+TEST_FUNCTION(IoTHubClient_LL_Destroy_after_SendEventAsync_Move_destroys_the_moved_message)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+	(void)IoTHubClient_LL_SendEventAsync_Move(handle, messageHandle, eventConfirmationCallback, (void*)1);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*IOTHUBCLIENT*/
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG)) /*because there is one item in the list*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(messageHandle)); /*the very handle that was moved in*/
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG)) /*because this says "no more items in the list*/
+		.IgnoreArgument(1);
 
 	///act
-	IoTHubClient_LL_DoWork(NULL);
+	IoTHubClient_LL_Destroy(handle);
 
-	///assert
-	mocks.AssertActualAndExpectedCalls();
+	///assert -uMock does it
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_021: [Otherwise, IoTHubClient_LL_DoWork shall invoke the underlaying layer's _DoWork function.] */
-TEST_FUNCTION(IoTHubClient_LL_DoWork_calls_underlying_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_052: [ If adding the record fails for any reason, IoTHubClient_LL_SendEventAsync_Move shall fail, return IOTHUB_CLIENT_ERROR and leave eventMessageHandle owned by the caller. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_fails_when_malloc_fails)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, handle))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*_DoWork will ask "what's the time"*/
-		.IgnoreAllArguments();
+	whenShallNodePool_Alloc_fail = currentNodePool_Alloc_call+1;
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	///act
-	IoTHubClient_LL_DoWork(handle);
+	auto result = IoTHubClient_LL_SendEventAsync_Move(handle, messageHandle, eventConfirmationCallback, (void*)1);
 
 	///assert
-	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls(); /*in particular, no IoTHubMessage_Destroy*/
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL or parameter handle is NULL then IoTHubClient_LL_SendBatch shall return.]*/
-TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_NULL_handle_shall_return)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_052: [ If adding the record fails for any reason, IoTHubClient_LL_SendEventAsync_Move shall fail, return IOTHUB_CLIENT_ERROR and leave eventMessageHandle owned by the caller. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_fails_when_current_ms_cannot_be_obtained)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
-	DLIST_ENTRY temp;
-	DList_InitializeListHead(&temp);
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t thisIsNotZero = 312984751;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &thisIsNotZero);
+	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.SetFailReturn(__LINE__);
+
 	///act
-	IoTHubClient_LL_SendComplete(NULL, &temp, IOTHUB_BATCHSTATE_SUCCESS);
+	auto result = IoTHubClient_LL_SendEventAsync_Move(handle, messageHandle, eventConfirmationCallback, (void*)1);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
 	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL or parameter handle is NULL then IoTHubClient_LL_SendBatch shall return.]*/
-TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_NULL_completed_shall_return)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_113: [ IoTHubClient_LL_SendEventAsync_MoveQueuedAt shall check its arguments, add the record and take over eventMessageHandle the same way IoTHubClient_LL_SendEventAsync_Move does. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_MoveQueuedAt_with_NULL_iotHubClientHandle_fails)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
-	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	mocks.ResetAllCalls();
+	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 
 	///act
-	IoTHubClient_LL_SendComplete(handle, NULL, IOTHUB_BATCHSTATE_SUCCESS);
+	auto result = IoTHubClient_LL_SendEventAsync_MoveQueuedAt(NULL, messageHandle, eventConfirmationCallback, (void*)3, 10);
 
 	///assert
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubClient_LL_Destroy(handle);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL or parameter handle is NULL then IoTHubClient_LL_SendBatch shall return.]*/
-TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_empty_completed_shall_return)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_113: [ IoTHubClient_LL_SendEventAsync_MoveQueuedAt shall check its arguments, add the record and take over eventMessageHandle the same way IoTHubClient_LL_SendEventAsync_Move does. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_MoveQueuedAt_with_NULL_eventConfirmationCallback_and_non_NULL_context_fails)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	DLIST_ENTRY temp;
-	DList_InitializeListHead(&temp);
+	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&temp));
-
 	///act
-	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_SUCCESS);
+	auto result = IoTHubClient_LL_SendEventAsync_MoveQueuedAt(handle, messageHandle, NULL, (void*)3, 10);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_025: [If parameter result is IOTHUB_BATCHSTATE_SUCCESS then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_OK and the context set to the context passed originally in the SendEventAsync call.]*/
-TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_1_items_with_callback_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_113: [ IoTHubClient_LL_SendEventAsync_MoveQueuedAt shall check its arguments, add the record and take over eventMessageHandle the same way IoTHubClient_LL_SendEventAsync_Move does. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_114: [ IoTHubClient_LL_SendEventAsync_MoveQueuedAt shall record queuedAt as the time the message is queued at, instead of calling tickcounter_get_current_ms, so that its "messageTimeout" runs from queuedAt. If queuedAt is UNKNOWN_QUEUED_TIME it shall behave exactly as IoTHubClient_LL_SendEventAsync_Move. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_MoveQueuedAt_succeeds_without_asking_for_the_time)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	DLIST_ENTRY temp;
-	DList_InitializeListHead(&temp);
-	IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
-	one->callback = eventConfirmationCallback;
-	one->context = (void*)1;
-	DList_InsertTailList(&temp, &(one->entry));
+	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(one));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
 
 	///act
-	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_SUCCESS);
+	auto result = IoTHubClient_LL_SendEventAsync_MoveQueuedAt(handle, messageHandle, eventConfirmationCallback, (void*)1, 10);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_025: [If parameter result is IOTHUB_BATCHSTATE_SUCCESS then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_OK and the context set to the context passed originally in the SendEventAsync call.]*/
-TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_with_callback_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_114: [ IoTHubClient_LL_SendEventAsync_MoveQueuedAt shall record queuedAt as the time the message is queued at, instead of calling tickcounter_get_current_ms, so that its "messageTimeout" runs from queuedAt. If queuedAt is UNKNOWN_QUEUED_TIME it shall behave exactly as IoTHubClient_LL_SendEventAsync_Move. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_MoveQueuedAt_with_UNKNOWN_QUEUED_TIME_stamps_the_message_now)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	DLIST_ENTRY temp;
-	DList_InitializeListHead(&temp);
-
-	IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
-	one->callback = eventConfirmationCallback;
-	one->context = (void*)1;
-	DList_InsertTailList(&temp, &(one->entry));
-
-	IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
-	two->callback = eventConfirmationCallback;
-	two->context = (void*)2;
-	DList_InsertTailList(&temp, &(two->entry));
-
-	IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
-	three->callback = eventConfirmationCallback;
-	three->context = (void*)3;
-	DList_InsertTailList(&temp, &(three->entry));
-
+	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(one));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)2));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)2));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(two));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)3));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)3));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(three));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
 
 	///act
-	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_SUCCESS);
+	auto result = IoTHubClient_LL_SendEventAsync_MoveQueuedAt(handle, messageHandle, eventConfirmationCallback, (void*)1, UNKNOWN_QUEUED_TIME);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_025: [If parameter result is IOTHUB_BATCHSTATE_SUCCESS then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_OK and the context set to the context passed originally in the SendEventAsync call.]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_026: [If any callback is NULL then there shall not be a callback call.]*/
-TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_one_without_callback_succeeds) /*for fun*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_114: [ IoTHubClient_LL_SendEventAsync_MoveQueuedAt shall record queuedAt as the time the message is queued at, instead of calling tickcounter_get_current_ms, so that its "messageTimeout" runs from queuedAt. If queuedAt is UNKNOWN_QUEUED_TIME it shall behave exactly as IoTHubClient_LL_SendEventAsync_Move. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_MoveQueuedAt_messageTimeout_runs_from_queuedAt)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
-	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	DLIST_ENTRY temp;
-	DList_InitializeListHead(&temp);
-
-	IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
-	one->callback = eventConfirmationCallback;
-	one->context = (void*)1;
-	DList_InsertTailList(&temp, &(one->entry));
-
-	IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
-	two->callback = NULL;
-	two->context = NULL;
-	DList_InsertTailList(&temp, &(two->entry));
-
-	IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
-	three->callback = eventConfirmationCallback;
-	three->context = (void*)3;
-	DList_InsertTailList(&temp, &(three->entry));
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t five = 5;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &five);
 
+	/*queued by IoTHubClient at time=10: taking the message over does not ask what's the time*/
+	(void)IoTHubClient_LL_SendEventAsync_MoveQueuedAt(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE, 10);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(one));
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)2));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(two));
+	uint64_t sixteen = 16; /*16 > 10 (queued time) + 5 (timeout) => timeout*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &sixteen, sizeof(sixteen));
 
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)3));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)3));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(three));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_DEVICEMESSAGE_HANDLE)); /*destroying the message*/
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
 		.IgnoreArgument(1);
 
 	///act
-	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_SUCCESS);
+	IoTHubClient_LL_DoWork(handle);
 
 	///assert
 	mocks.AssertActualAndExpectedCalls();
@@ -2866,943 +3158,2908 @@ TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_one_without_callback_suc
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_027: [If parameter result is IOTHUB_BACTCHSTATE_FAILED then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_ERROR and the context set to the context passed originally in the SendEventAsync call.]*/
-TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_with_callback__but_batch_failed_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_115: [ If handle is NULL or tickcounter_get_current_ms fails then IoTHubClient_LL_GetCurrentTime shall return UNKNOWN_QUEUED_TIME. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetCurrentTime_with_NULL_handle_returns_UNKNOWN_QUEUED_TIME)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
-	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	DLIST_ENTRY temp;
-	DList_InitializeListHead(&temp);
-
-	IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
-	one->callback = eventConfirmationCallback;
-	one->context = (void*)1;
-	DList_InsertTailList(&temp, &(one->entry));
-
-	IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
-	two->callback = eventConfirmationCallback;
-	two->context = (void*)2;
-	DList_InsertTailList(&temp, &(two->entry));
 
-	IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
-	three->callback = eventConfirmationCallback;
-	three->context = (void*)3;
-	DList_InsertTailList(&temp, &(three->entry));
+	///act
+	uint64_t result = IoTHubClient_LL_GetCurrentTime(NULL);
 
+	///assert
+	ASSERT_ARE_EQUAL(uint64_t, UNKNOWN_QUEUED_TIME, result);
+	mocks.AssertActualAndExpectedCalls();
+}
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_115: [ If handle is NULL or tickcounter_get_current_ms fails then IoTHubClient_LL_GetCurrentTime shall return UNKNOWN_QUEUED_TIME. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetCurrentTime_returns_UNKNOWN_QUEUED_TIME_when_tickcounter_get_current_ms_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)1));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(one));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)2));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)2));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(two));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)3));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)3));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(three));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.SetFailReturn(__LINE__);
 
 	///act
-	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_FAILED);
+	uint64_t result = IoTHubClient_LL_GetCurrentTime(handle);
 
 	///assert
+	ASSERT_ARE_EQUAL(uint64_t, UNKNOWN_QUEUED_TIME, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_028: [If any callback is NULL then there shall not be a callback call.] */
-TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_one_with_callback_but_batch_failed_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_116: [ Otherwise IoTHubClient_LL_GetCurrentTime shall return the time given by tickcounter_get_current_ms. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetCurrentTime_returns_the_time_of_the_tick_counter)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	DLIST_ENTRY temp;
-	DList_InitializeListHead(&temp);
-
-	IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
-	one->callback = NULL;
-	one->context = NULL;
-	DList_InsertTailList(&temp, &(one->entry));
-
-	IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
-	two->callback = NULL;
-	two->context = NULL;
-	DList_InsertTailList(&temp, &(two->entry));
-
-	IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
-	three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
-	three->callback = eventConfirmationCallback;
-	three->context = (void*)3;
-	DList_InsertTailList(&temp, &(three->entry));
-
+	uint64_t twelve = 12;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(one));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)2));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(two));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)3));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)3));
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(three));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
 
 	///act
-	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_FAILED);
+	uint64_t result = IoTHubClient_LL_GetCurrentTime(handle);
 
 	///assert
+	ASSERT_ARE_EQUAL(uint64_t, 12, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_029: [If parameter handle is NULL then IoTHubClient_LL_MessageCallback shall return IOTHUBMESSAGE_ABANDONED.] */
-TEST_FUNCTION(IoTHubClient_LL_MessageCallback_with_NULL_parameter_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_016: [IoTHubClient_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.]*/
+TEST_FUNCTION(IoTHubClient_LL_SetMessageCallback_with_NULL_iotHubClientHandle_fails)
 {
 	///arrange
+	CIoTHubClientLLMocks mocks;
 
 	///act
-	auto result = IoTHubClient_LL_MessageCallback(NULL, (IOTHUB_MESSAGE_HANDLE)1);
+	auto result = IoTHubClient_LL_SetMessageCallback(NULL, messageCallback, (void*)1);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ABANDONED, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_030: [IoTHubClient_LL_MessageCallback shall invoke the last callback function (the parameter messageCallback to IoTHubClient_LL_SetMessageCallback) passing the message and the passed userContextCallback.]*/
-TEST_FUNCTION(IoTHubClient_LL_MessageCallback_calls_upper_layer_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_019: [If parameter messageCallback is NULL then IoTHubClient_LL_SetMessageCallback shall call the underlying layer's _Unsubscribe function and return IOTHUB_CLIENT_OK.] */
+TEST_FUNCTION(IoTHubClient_LL_SetMessageCallback_with_NULL_calls_Unsubscribe_and_succeeds)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	(void)IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)11);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, messageCallback((IOTHUB_MESSAGE_HANDLE)1, (void*)11));
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Unsubscribe(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	///act
-	auto result = IoTHubClient_LL_MessageCallback(handle, (IOTHUB_MESSAGE_HANDLE)1);
+	auto result = IoTHubClient_LL_SetMessageCallback(handle, NULL, (void*)1);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ACCEPTED, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_032: [If the last callback function was NULL, then IoTHubClient_LL_MessageCallback  shall return IOTHUBMESSAGE_ABANDONED.] */
-TEST_FUNCTION(IoTHubClient_LL_MessageCallback_without_subscribe_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_017: [If parameter messageCallback is non-NULL then IoTHubClient_LL_SetMessageCallback shall call the underlying layer's _Subscribe function.]*/
+TEST_FUNCTION(IoTHubClient_LL_SetMessageCallback_with_non_NULL_succeeds)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Subscribe(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	///act
-	auto result = IoTHubClient_LL_MessageCallback(handle, (IOTHUB_MESSAGE_HANDLE)1);
+	auto result = IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)1);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ABANDONED, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-
-/*** IoTHubClient_LL_GetLastMessageReceiveTime ***/
-
-/* Tests_SRS_IOTHUBCLIENT_LL_09_001: [IoTHubClient_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG if any of the arguments is NULL] */
-TEST_FUNCTION(IoTHubClient_LL_GetLastMessageReceiveTime_InvalidClientHandleArg_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_018: [If the underlying layer's _Subscribe function fails, then IoTHubClient_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_ERROR. Otherwise IoTHubClient_LL_SetMessageCallback shall succeed and return IOTHUB_CLIENT_OK.]*/
+TEST_FUNCTION(IoTHubClient_LL_SetMessageCallback_with_non_fails_when_underlying_transport_fails)
 {
-	// arrange
-	time_t lastMessageReceiveTime;
-	CNiceCallComparer<CIoTHubClientLLMocks> niceMocks;
-
-	IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetLastMessageReceiveTime(NULL, &lastMessageReceiveTime);
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Subscribe(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.SetReturn(1);
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	///act
+	auto result = IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)1);
 
-	// Cleanup
-	IoTHubClient_LL_Destroy(iotHubClientHandle);
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_LL_09_001: [IoTHubClient_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG if any of the arguments is NULL] */
-TEST_FUNCTION(IoTHubClient_LL_GetLastMessageReceiveTime_InvalidTimeRefArg_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_020: [If parameter iotHubClientHandle is NULL then IoTHubClient_LL_DoWork shall not perform any action.] */
+TEST_FUNCTION(IoTHubClient_LL_DoWork_with_NULL_does_nothing)
 {
-	// arrange
-	CNiceCallComparer<CIoTHubClientLLMocks> niceMocks;
+	///arrange
+	CIoTHubClientLLMocks mocks;
 
-	IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	///act
+	IoTHubClient_LL_DoWork(NULL);
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetLastMessageReceiveTime(iotHubClientHandle, NULL);
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+}
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+/*Tests_SRS_IOTHUBCLIENT_LL_02_021: [Otherwise, IoTHubClient_LL_DoWork shall invoke the underlaying layer's _DoWork function.] */
+/*Tests_SRS_IOTHUBCLIENT_LL_02_064: [ If no message in waitingToSend can timeout then IoTHubClient_LL_DoWork shall not look for timed out messages. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_calls_underlying_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-	// Cleanup
-	IoTHubClient_LL_Destroy(iotHubClientHandle);
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, handle))
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_LL_09_002: [IoTHubClient_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INDEFINITE_TIME - and not set 'lastMessageReceiveTime' - if it is unable to provide the time for the last commands] */
-TEST_FUNCTION(IoTHubClient_LL_GetLastMessageReceiveTime_NoMessagesReceived_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL or parameter handle is NULL then IoTHubClient_LL_SendBatch shall return.]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_NULL_handle_shall_return)
 {
-	// arrange
-	CNiceCallComparer<CIoTHubClientLLMocks> niceMocks;
-	time_t lastMessageReceiveTime = (time_t)0;;
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	DLIST_ENTRY temp;
+	DList_InitializeListHead(&temp);
+	mocks.ResetAllCalls();
 
-	IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	///act
+	IoTHubClient_LL_SendComplete(NULL, &temp, IOTHUB_BATCHSTATE_SUCCESS);
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetLastMessageReceiveTime(iotHubClientHandle, &lastMessageReceiveTime);
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+}
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INDEFINITE_TIME, result);
-	ASSERT_ARE_EQUAL(int, 0, (int)(lastMessageReceiveTime));
+/*Tests_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL or parameter handle is NULL then IoTHubClient_LL_SendBatch shall return.]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_NULL_completed_shall_return)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-	// Cleanup
-	IoTHubClient_LL_Destroy(iotHubClientHandle);
+	///act
+	IoTHubClient_LL_SendComplete(handle, NULL, IOTHUB_BATCHSTATE_SUCCESS);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_LL_09_003: [IoTHubClient_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_OK if it wrote in the lastMessageReceiveTime the time when the last command was received] */
-/* Tests_SRS_IOTHUBCLIENT_LL_09_004: [IoTHubClient_LL_GetLastMessageReceiveTime shall return lastMessageReceiveTime in localtime] */
-TEST_FUNCTION(IoTHubClient_LL_GetLastMessageReceiveTime_MessagesReceived_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL or parameter handle is NULL then IoTHubClient_LL_SendBatch shall return.]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_empty_completed_shall_return)
 {
-	// arrange
+	///arrange
 	CIoTHubClientLLMocks mocks;
 	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	(void)IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)11);
+	DLIST_ENTRY temp;
+	DList_InitializeListHead(&temp);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, messageCallback((IOTHUB_MESSAGE_HANDLE)1, (void*)11));
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&temp));
 
-	time_t timeBeforeCall = time(NULL);
+	///act
+	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_SUCCESS);
 
-	(void)IoTHubClient_LL_MessageCallback(handle, (IOTHUB_MESSAGE_HANDLE)1);
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-	// act
-	time_t lastMessageReceiveTime = (time_t)0;
-	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetLastMessageReceiveTime(handle, &lastMessageReceiveTime);
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+/*Tests_SRS_IOTHUBCLIENT_LL_02_025: [If parameter result is IOTHUB_BATCHSTATE_SUCCESS then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_OK and the context set to the context passed originally in the SendEventAsync call.]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_1_items_with_callback_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	DLIST_ENTRY temp;
+	DList_InitializeListHead(&temp);
+	IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+	one->callback = eventConfirmationCallback;
+	one->context = (void*)1;
+	one->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	one->ms_queuedAt = 0;
+	one->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(one->entry));
+	mocks.ResetAllCalls();
 
-	time_t timeAfterCall = time(NULL);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
 
-	if (difftime(lastMessageReceiveTime, timeBeforeCall) < 0)
-	{
-		ASSERT_FAIL("Last message time is earlier than expected.");
-	}
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(one));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_SUCCESS);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_025: [If parameter result is IOTHUB_BATCHSTATE_SUCCESS then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_OK and the context set to the context passed originally in the SendEventAsync call.]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_with_callback_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	DLIST_ENTRY temp;
+	DList_InitializeListHead(&temp);
+
+	IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+	one->callback = eventConfirmationCallback;
+	one->context = (void*)1;
+	one->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	one->ms_queuedAt = 0;
+	one->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(one->entry));
+
+	IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
+	two->callback = eventConfirmationCallback;
+	two->context = (void*)2;
+	two->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	two->ms_queuedAt = 0;
+	two->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(two->entry));
+
+	IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
+	three->callback = eventConfirmationCallback;
+	three->context = (void*)3;
+	three->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	three->ms_queuedAt = 0;
+	three->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(three->entry));
+
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(one));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)2));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)2));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(two));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)3));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)3));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(three));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_SUCCESS);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_025: [If parameter result is IOTHUB_BATCHSTATE_SUCCESS then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_OK and the context set to the context passed originally in the SendEventAsync call.]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_026: [If any callback is NULL then there shall not be a callback call.]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_one_without_callback_succeeds) /*for fun*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	DLIST_ENTRY temp;
+	DList_InitializeListHead(&temp);
+
+	IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+	one->callback = eventConfirmationCallback;
+	one->context = (void*)1;
+	one->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	one->ms_queuedAt = 0;
+	one->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(one->entry));
+
+	IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
+	two->callback = NULL;
+	two->context = NULL;
+	two->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	two->ms_queuedAt = 0;
+	two->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(two->entry));
+
+	IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
+	three->callback = eventConfirmationCallback;
+	three->context = (void*)3;
+	three->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	three->ms_queuedAt = 0;
+	three->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(three->entry));
+
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(one));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)2));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(two));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)3));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)3));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(three));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_SUCCESS);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_027: [If parameter result is IOTHUB_BACTCHSTATE_FAILED then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_ERROR and the context set to the context passed originally in the SendEventAsync call.]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_with_callback__but_batch_failed_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	DLIST_ENTRY temp;
+	DList_InitializeListHead(&temp);
+
+	IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+	one->callback = eventConfirmationCallback;
+	one->context = (void*)1;
+	one->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	one->ms_queuedAt = 0;
+	one->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(one->entry));
+
+	IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
+	two->callback = eventConfirmationCallback;
+	two->context = (void*)2;
+	two->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	two->ms_queuedAt = 0;
+	two->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(two->entry));
+
+	IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
+	three->callback = eventConfirmationCallback;
+	three->context = (void*)3;
+	three->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	three->ms_queuedAt = 0;
+	three->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(three->entry));
+
+
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(one));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)2));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)2));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(two));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)3));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)3));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(three));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_FAILED);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_028: [If any callback is NULL then there shall not be a callback call.] */
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_3_items_one_with_callback_but_batch_failed_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	DLIST_ENTRY temp;
+	DList_InitializeListHead(&temp);
+
+	IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+	one->callback = NULL;
+	one->context = NULL;
+	one->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	one->ms_queuedAt = 0;
+	one->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(one->entry));
+
+	IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
+	two->callback = NULL;
+	two->context = NULL;
+	two->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	two->ms_queuedAt = 0;
+	two->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(two->entry));
+
+	IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+	three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
+	three->callback = eventConfirmationCallback;
+	three->context = (void*)3;
+	three->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+	three->ms_queuedAt = 0;
+	three->sendAttempts = 0;
+	DList_InsertTailList(&temp, &(three->entry));
+
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(one));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)2));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(two));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)3));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)3));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(three));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_FAILED);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_029: [If parameter handle is NULL then IoTHubClient_LL_MessageCallback shall return IOTHUBMESSAGE_ABANDONED.] */
+TEST_FUNCTION(IoTHubClient_LL_MessageCallback_with_NULL_parameter_fails)
+{
+	///arrange
+
+	///act
+	auto result = IoTHubClient_LL_MessageCallback(NULL, (IOTHUB_MESSAGE_HANDLE)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ABANDONED, result);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_030: [IoTHubClient_LL_MessageCallback shall invoke the last callback function (the parameter messageCallback to IoTHubClient_LL_SetMessageCallback) passing the message and the passed userContextCallback.]*/
+TEST_FUNCTION(IoTHubClient_LL_MessageCallback_calls_upper_layer_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)11);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, messageCallback((IOTHUB_MESSAGE_HANDLE)1, (void*)11));
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray((IOTHUB_MESSAGE_HANDLE)1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	///act
+	auto result = IoTHubClient_LL_MessageCallback(handle, (IOTHUB_MESSAGE_HANDLE)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ACCEPTED, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_032: [If the last callback function was NULL, then IoTHubClient_LL_MessageCallback  shall return IOTHUBMESSAGE_ABANDONED.] */
+TEST_FUNCTION(IoTHubClient_LL_MessageCallback_without_subscribe_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray((IOTHUB_MESSAGE_HANDLE)1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	///act
+	auto result = IoTHubClient_LL_MessageCallback(handle, (IOTHUB_MESSAGE_HANDLE)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ABANDONED, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_107: [ If the callback returns IOTHUBMESSAGE_ASYNC_ACK and the "AsyncMessageDisposition" option is not set then IoTHubClient_LL_MessageCallback shall return IOTHUBMESSAGE_ABANDONED. ]*/
+TEST_FUNCTION(IoTHubClient_LL_MessageCallback_abandons_ASYNC_ACK_without_AsyncMessageDisposition)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)11);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, messageCallback((IOTHUB_MESSAGE_HANDLE)1, (void*)11))
+		.SetReturn(IOTHUBMESSAGE_ASYNC_ACK);
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray((IOTHUB_MESSAGE_HANDLE)1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	///act
+	auto result = IoTHubClient_LL_MessageCallback(handle, (IOTHUB_MESSAGE_HANDLE)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ABANDONED, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_031: [Then IoTHubClient_LL_MessageCallback shall return what the user function returns.]*/
+TEST_FUNCTION(IoTHubClient_LL_MessageCallback_returns_ASYNC_ACK_with_AsyncMessageDisposition)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	bool asyncMessageDisposition = true;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)11);
+	(void)IoTHubClient_LL_SetOption(handle, "AsyncMessageDisposition", &asyncMessageDisposition);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, messageCallback((IOTHUB_MESSAGE_HANDLE)1, (void*)11))
+		.SetReturn(IOTHUBMESSAGE_ASYNC_ACK);
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray((IOTHUB_MESSAGE_HANDLE)1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	///act
+	auto result = IoTHubClient_LL_MessageCallback(handle, (IOTHUB_MESSAGE_HANDLE)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ASYNC_ACK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*** IoTHubClient_LL_GetLastMessageReceiveTime ***/
+
+/* Tests_SRS_IOTHUBCLIENT_LL_09_001: [IoTHubClient_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG if any of the arguments is NULL] */
+TEST_FUNCTION(IoTHubClient_LL_GetLastMessageReceiveTime_InvalidClientHandleArg_fails)
+{
+	// arrange
+	time_t lastMessageReceiveTime;
+	CNiceCallComparer<CIoTHubClientLLMocks> niceMocks;
+
+	IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = IoTHubClient_LL_Create(&TEST_CONFIG);
+
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetLastMessageReceiveTime(NULL, &lastMessageReceiveTime);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+	// Cleanup
+	IoTHubClient_LL_Destroy(iotHubClientHandle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_LL_09_001: [IoTHubClient_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG if any of the arguments is NULL] */
+TEST_FUNCTION(IoTHubClient_LL_GetLastMessageReceiveTime_InvalidTimeRefArg_fails)
+{
+	// arrange
+	CNiceCallComparer<CIoTHubClientLLMocks> niceMocks;
+
+	IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = IoTHubClient_LL_Create(&TEST_CONFIG);
+
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetLastMessageReceiveTime(iotHubClientHandle, NULL);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+	// Cleanup
+	IoTHubClient_LL_Destroy(iotHubClientHandle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_LL_09_002: [IoTHubClient_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INDEFINITE_TIME - and not set 'lastMessageReceiveTime' - if it is unable to provide the time for the last commands] */
+TEST_FUNCTION(IoTHubClient_LL_GetLastMessageReceiveTime_NoMessagesReceived_fails)
+{
+	// arrange
+	CNiceCallComparer<CIoTHubClientLLMocks> niceMocks;
+	time_t lastMessageReceiveTime = (time_t)0;;
+
+	IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = IoTHubClient_LL_Create(&TEST_CONFIG);
+
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetLastMessageReceiveTime(iotHubClientHandle, &lastMessageReceiveTime);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INDEFINITE_TIME, result);
+	ASSERT_ARE_EQUAL(int, 0, (int)(lastMessageReceiveTime));
+
+	// Cleanup
+	IoTHubClient_LL_Destroy(iotHubClientHandle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_LL_09_003: [IoTHubClient_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_OK if it wrote in the lastMessageReceiveTime the time when the last command was received] */
+/* Tests_SRS_IOTHUBCLIENT_LL_09_004: [IoTHubClient_LL_GetLastMessageReceiveTime shall return lastMessageReceiveTime in localtime] */
+TEST_FUNCTION(IoTHubClient_LL_GetLastMessageReceiveTime_MessagesReceived_succeeds)
+{
+	// arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)11);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, messageCallback((IOTHUB_MESSAGE_HANDLE)1, (void*)11));
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray((IOTHUB_MESSAGE_HANDLE)1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	time_t timeBeforeCall = time(NULL);
+
+	(void)IoTHubClient_LL_MessageCallback(handle, (IOTHUB_MESSAGE_HANDLE)1);
+
+	// act
+	time_t lastMessageReceiveTime = (time_t)0;
+	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetLastMessageReceiveTime(handle, &lastMessageReceiveTime);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+	time_t timeAfterCall = time(NULL);
+
+	if (difftime(lastMessageReceiveTime, timeBeforeCall) < 0)
+	{
+		ASSERT_FAIL("Last message time is earlier than expected.");
+	}
+
+	if (difftime(lastMessageReceiveTime, timeAfterCall) > 0)
+	{
+		ASSERT_FAIL("Last message time is later than expected.");
+	}
+
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+
+/*** IoTHubClient_LL_GetSendStatus ***/
+
+/* Tests_SRS_IOTHUBCLIENT_09_007: [IoTHubClient_LL_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter] */
+TEST_FUNCTION(IoTHubClient_GetSendStatus_BadHandleArgument_fails)
+{
+	// arrange
+	CIoTHubClientLLMocks mocks;
+	mocks.ResetAllCalls();
+
+	IOTHUB_CLIENT_STATUS status;
+
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendStatus(NULL, &status);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+	// cleanup
+}
+
+/* Tests_SRS_IOTHUBCLIENT_09_007: [IoTHubClient_LL_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter] */
+TEST_FUNCTION(IoTHubClient_GetSendStatus_BadStatusArgument_fails)
+{
+	// arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendStatus(handle, NULL);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+	// cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_09_008: [IoTHubClient_LL_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there is currently no items to be sent] */
+TEST_FUNCTION(IoTHubClient_GetSendStatus_NoEventToSend_Succeeds)
+{
+	// arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	IOTHUB_CLIENT_STATUS status;
+
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_GetSendStatus(IGNORED_PTR_ARG, &status))
+		.IgnoreAllArguments()
+		.SetReturn(IOTHUB_CLIENT_OK);
+
+	currentIotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendStatus(handle, &status);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_IDLE, status);
+
+	// cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_09_009: [IoTHubClient_LL_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently items to be sent] */
+TEST_FUNCTION(IoTHubClient_GetSendStatus_HasEventToSend_Succeeds)
+{
+	// arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	IOTHUB_CLIENT_STATUS status;
+
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_GetSendStatus(IGNORED_PTR_ARG, &status))
+		.IgnoreAllArguments()
+		.SetReturn(IOTHUB_CLIENT_OK);
+
+	currentIotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendStatus(handle, &status);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_BUSY, status);
+
+	// cleanup
+	IoTHubClient_LL_Destroy(handle);
+	currentIotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_034: [If iotHubClientHandle is NULL then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_with_NULL_handle_fails)
+{
+	///arrange
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(NULL, "a", "b");
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+	///cleanup
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_035: [If optionName is NULL then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubClient_LL_SetOption_with_NULL_optionName_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, NULL, "b");
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_036: [If value is NULL then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubClient_LL_SetOption_with_NULL_value_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "a", NULL);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_038: [Otherwise, IoTHubClient_LL shall call the function _SetOption of the underlying transport and return what that function is returning.] */
+TEST_FUNCTION(IoTHubClient_LL_SetOption_happy_path)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, "a", "b"));
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "a", "b");
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_038: [Otherwise, IoTHubClient_LL shall call the function _SetOption of the underlying transport and return what that function is returning.] */
+TEST_FUNCTION(IoTHubClient_LL_SetOption_fails_when_underlying_transport_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, "a", "b"))
+		.SetReturn(IOTHUB_CLIENT_INDEFINITE_TIME);
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "a", "b");
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INDEFINITE_TIME, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_105: [ "AsyncMessageDisposition" - IoTHubClient_LL_SetOption shall pass the option to the transport's _SetOption and, if that returns IOTHUB_CLIENT_OK, remember whether messages can be completed later by IoTHubClient_LL_SendMessageDisposition. Value is a pointer to a bool. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_AsyncMessageDisposition_calls_the_transport)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	bool asyncMessageDisposition = true;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, "AsyncMessageDisposition", &asyncMessageDisposition))
+		.IgnoreArgument(1);
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "AsyncMessageDisposition", &asyncMessageDisposition);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_108: [ If the transport's _SetOption fails then IoTHubClient_LL_SetOption shall leave "AsyncMessageDisposition" unchanged and return what the transport returned. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_AsyncMessageDisposition_refused_by_the_transport_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	bool asyncMessageDisposition = true;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, "AsyncMessageDisposition", &asyncMessageDisposition))
+		.IgnoreArgument(1)
+		.SetReturn(IOTHUB_CLIENT_ERROR);
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "AsyncMessageDisposition", &asyncMessageDisposition);
+	auto dispositionResult = IoTHubClient_LL_SendMessageDisposition(handle, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_ACCEPTED);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, dispositionResult);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_058: [ "messagePoolSize" - IoTHubClient_LL_SetOption shall call NodePool_Reserve so that the pool of waitingToSend records owns at least value records. Value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messagePoolSize_calls_NodePool_Reserve)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t poolSize = 100;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Reserve(IGNORED_PTR_ARG, 100))
+		.IgnoreArgument(1);
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messagePoolSize", &poolSize);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_059: [ If NodePool_Reserve fails then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messagePoolSize_fails_when_NodePool_Reserve_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t poolSize = 100;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Reserve(IGNORED_PTR_ARG, 100))
+		.IgnoreArgument(1)
+		.SetReturn(__LINE__);
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messagePoolSize", &poolSize);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_060: [ "messagePoolGrowth" - IoTHubClient_LL_SetOption shall call NodePool_SetGrowth to set how many records are added to the pool when it runs out of records. Value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messagePoolGrowth_calls_NodePool_SetGrowth)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t growth = 0;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_SetGrowth(IGNORED_PTR_ARG, 0))
+		.IgnoreArgument(1);
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messagePoolGrowth", &growth);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_070: [ By default, there shall be no message store. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_071: [ "messageStore" - IoTHubClient_LL_SetOption shall open the message store whose files are named after value by calling MessageStore_Create with the current "messageStoreSegmentSize". Value is a const char*. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_112: [ IoTHubClient_LL_SetOption shall then pass the current "messageStoreSyncInterval" to the message store by calling MessageStore_SetSyncInterval. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageStore_calls_MessageStore_Create)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, MessageStore_Create(TEST_MESSAGESTORE_PATH, 1024 * 1024));
+	STRICT_EXPECTED_CALL(mocks, MessageStore_SetSyncInterval(TEST_MESSAGESTORE_HANDLE, 1));
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_084: [ "messageStoreSegmentSize" - IoTHubClient_LL_SetOption shall set the size in bytes after which the message stores opened afterwards start a new segment file. The default is 1 MB. Value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageStoreSegmentSize_is_used_by_MessageStore_Create)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t segmentSize = 4096;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, MessageStore_Create(TEST_MESSAGESTORE_PATH, 4096));
+	STRICT_EXPECTED_CALL(mocks, MessageStore_SetSyncInterval(TEST_MESSAGESTORE_HANDLE, 1));
+
+	///act
+	auto result1 = IoTHubClient_LL_SetOption(handle, "messageStoreSegmentSize", &segmentSize);
+	auto result2 = IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result1);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result2);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_111: [ "messageStoreSyncInterval" - IoTHubClient_LL_SetOption shall set after how many stored messages the message stores opened afterwards wait for their files to be written to the disk. 0 leaves it to the operating system. The default is 1, every message. Value is a pointer to a size_t. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_112: [ IoTHubClient_LL_SetOption shall then pass the current "messageStoreSyncInterval" to the message store by calling MessageStore_SetSyncInterval. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageStoreSyncInterval_is_passed_to_the_message_store)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t syncInterval = 0;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, MessageStore_Create(TEST_MESSAGESTORE_PATH, 1024 * 1024));
+	STRICT_EXPECTED_CALL(mocks, MessageStore_SetSyncInterval(TEST_MESSAGESTORE_HANDLE, 0));
+
+	///act
+	auto result1 = IoTHubClient_LL_SetOption(handle, "messageStoreSyncInterval", &syncInterval);
+	auto result2 = IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result1);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result2);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_072: [ If a message store is already open or MessageStore_Create fails then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageStore_fails_when_MessageStore_Create_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, MessageStore_Create(TEST_MESSAGESTORE_PATH, 1024 * 1024))
+		.SetReturn((MESSAGESTORE_HANDLE)NULL);
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_072: [ If a message store is already open or MessageStore_Create fails then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageStore_twice_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_083: [ If the value of "messageStoreWatermark" or "messageStoreSegmentSize" is 0 then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageStoreWatermark_0_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t zero = 0;
+	mocks.ResetAllCalls();
+
+	///act
+	auto result1 = IoTHubClient_LL_SetOption(handle, "messageStoreWatermark", &zero);
+	auto result2 = IoTHubClient_LL_SetOption(handle, "messageStoreSegmentSize", &zero);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_073: [ "messageStoreWatermark" - IoTHubClient_LL_SetOption shall set how many messages are kept in memory before new messages go to the message store. The default is 1000. Value is a pointer to a size_t. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_074: [ If there is a message store, and either it still has messages to replay or there are "messageStoreWatermark" messages in memory already, then IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall serialize the message together with eventConfirmationCallback and userContextCallback and append it to the store by calling MessageStore_Append instead of adding it to waitingToSend. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_past_the_watermark_appends_to_the_message_store)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t watermark = 3; /*NodePool_GetStats reports 3 records in use*/
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStoreWatermark", &watermark);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, MessageStore_IsEmpty(TEST_MESSAGESTORE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_GetStats(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, gballoc_realloc(NULL, IGNORED_NUM_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, MessageStore_Append(TEST_MESSAGESTORE_HANDLE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_NOT_EQUAL(size_t, 0, messageStoreRecordSize);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_074: [ If there is a message store, and either it still has messages to replay or there are "messageStoreWatermark" messages in memory already, then IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall serialize the message together with eventConfirmationCallback and userContextCallback and append it to the store by calling MessageStore_Append instead of adding it to waitingToSend. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_below_the_watermark_adds_to_waitingToSend)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(mocks, MessageStore_IsEmpty(TEST_MESSAGESTORE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_GetStats(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_076: [ Once the message is in the store, IoTHubClient_LL_SendEventAsync_Move shall destroy eventMessageHandle. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_destroys_the_message_once_it_is_in_the_message_store)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	messageStoreIsEmpty = false; /*older messages are waiting in the store, new ones go behind them*/
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	EXPECTED_CALL(mocks, MessageStore_IsEmpty(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL(mocks, MessageStore_Append(TEST_MESSAGESTORE_HANDLE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_DEVICEMESSAGE_HANDLE));
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync_Move(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_075: [ If serializing the message or MessageStore_Append fails then IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_Move_fails_when_MessageStore_Append_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	messageStoreIsEmpty = false;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	EXPECTED_CALL(mocks, MessageStore_IsEmpty(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_Properties(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL(mocks, MessageStore_Append(TEST_MESSAGESTORE_HANDLE, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.SetReturn(1);
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync_Move(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert - the message still belongs to the caller
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_077: [ If there is a message store, IoTHubClient_LL_DoWork shall move the messages of the store, oldest first, to waitingToSend by calling MessageStore_ReadNext until there are "messageStoreWatermark" messages in memory or the store has no more messages to replay. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_replays_the_message_store_up_to_the_watermark)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t watermark = 3;
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStoreWatermark", &watermark);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1); /*goes to the store*/
+	watermark = 4; /*NodePool_GetStats reports 3 records in use, so there is room for exactly 1 more*/
+	(void)IoTHubClient_LL_SetOption(handle, "messageStoreWatermark", &watermark);
+	messageStoreRecordsToRead = 2;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_GetStats(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, MessageStore_IsEmpty(TEST_MESSAGESTORE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, MessageStore_ReadNext(TEST_MESSAGESTORE_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, sizeof(TEST_BODY)))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetMessageId(TEST_DEVICEMESSAGE_HANDLE_2, "theMessageId"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_HANDLE, "theKey", "theValue"));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	ASSERT_ARE_EQUAL(size_t, 1, messageStoreRecordsToRead);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_081: [ A record of the message store that cannot be turned back into a message shall be dropped by calling MessageStore_Confirm. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_drops_a_corrupted_record_of_the_message_store)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	messageStoreRecord[0] = 0xFF; /*not a version of the record*/
+	messageStoreRecordSize = 1;
+	messageStoreRecordsToRead = 1;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_GetStats(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, MessageStore_IsEmpty(TEST_MESSAGESTORE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, MessageStore_ReadNext(TEST_MESSAGESTORE_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, MessageStore_Confirm(TEST_MESSAGESTORE_HANDLE, TEST_MESSAGESTORE_SEGMENT_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, MessageStore_IsEmpty(TEST_MESSAGESTORE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_110: [ The record of a replayed message shall be allocated before calling MessageStore_ReadNext; if that fails, IoTHubClient_LL_DoWork shall stop replaying and leave the message in the store for the next call. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_leaves_the_message_in_the_message_store_when_NodePool_Alloc_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t watermark = 3;
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStoreWatermark", &watermark);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1); /*goes to the store*/
+	watermark = 4; /*room for exactly 1 more*/
+	(void)IoTHubClient_LL_SetOption(handle, "messageStoreWatermark", &watermark);
+	messageStoreRecordsToRead = 1;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_GetStats(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, MessageStore_IsEmpty(TEST_MESSAGESTORE_HANDLE));
+	whenShallNodePool_Alloc_fail = currentNodePool_Alloc_call + 1;
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	ASSERT_ARE_EQUAL(size_t, 1, messageStoreRecordsToRead);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_082: [ If the transport reports IOTHUB_CLIENT_SEND_STATUS_IDLE while the message store still has messages to replay, IoTHubClient_LL_GetSendStatus shall report IOTHUB_CLIENT_SEND_STATUS_BUSY. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendStatus_is_busy_while_the_message_store_has_messages)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_STATUS status;
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	messageStoreIsEmpty = false;
+	currentIotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_GetSendStatus(IGNORED_PTR_ARG, &status))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, MessageStore_IsEmpty(TEST_MESSAGESTORE_HANDLE));
+
+	///act
+	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendStatus(handle, &status);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_BUSY, status);
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_079: [ IoTHubClient_LL_Destroy shall close the message store by calling MessageStore_Destroy. The messages that were not confirmed stay in the store for the next IoTHubClient_LL that opens it. ]*/
+TEST_FUNCTION(IoTHubClient_LL_Destroy_calls_MessageStore_Destroy)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	mocks.ResetAllCalls();
+
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, MessageStore_Destroy(TEST_MESSAGESTORE_HANDLE));
+	EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, NodePool_Destroy(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+	///act
+	IoTHubClient_LL_Destroy(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_to_zero_after_Create_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	uint64_t zero = 0;
+	auto result = IoTHubClient_LL_SetOption(handle, "messageTimeout", &zero);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_to_one_after_Create_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	uint64_t one = 1;
+	auto result = IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_can_be_reverted_back_to_zero_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+	mocks.ResetAllCalls();
+
+	///act
+	uint64_t zero = 0;
+	auto result = IoTHubClient_LL_SetOption(handle, "messageTimeout", &zero);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_calls_timeout_callback)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 1 messages that will expire*/
+	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
+	"the message has been received at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_042: [ By default, messages shall not timeout. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_064: [ If no message in waitingToSend can timeout then IoTHubClient_LL_DoWork shall not look for timed out messages. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_defaults_to_zero)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+
+	/*send 1 messages that will expire*/
+	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
+	"the message has been received at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	/*messageTimeout option has never been set, therefore the message cannot timeout and _DoWork does not even ask "what's the time"*/
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_only_removes_the_message_if_it_has_NULL_callback)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 1 messages that will expire*/
+	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
+	"the message has been received at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL); /*this is a message with a NULL callback*/
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_when_exactly_on_the_edge_does_not_call_the_callback) /*because "more"*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 1 messages that will expire*/
+	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
+	"the message has been received at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	uint64_t eleven = 11; /*11 = 10 (receive time) + 1 (timeout) => NO timeout*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &eleven, sizeof(eleven));
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_065: [ If the messages that can timeout were queued with increasing timeouts then IoTHubClient_LL_DoWork shall stop looking for timed out messages at the first message that has not timed out. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_with_timeouts_at_11_and_12_calls_1_timeout) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
+	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
+	"the message has been received at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	uint64_t two = 2;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &two);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2 ));
+
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!!*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+
+	/*because we're at time = 12 in this test, the second message is untouched*/
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_044: [ Messages already delivered to IoTHubClient_LL shall not have their timeouts modified by a new call to IoTHubClient_LL_SetOption. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_with_timeouts_at_11_and_12_calls_2_timeouts) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
+	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
+	"the message has been received at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	uint64_t two = 2;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &two);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
+
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	{/*this scope happen in the first _DoWork call*/
+		uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!!*/
+		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+
+		STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+			.IgnoreArgument(1);
+	}
+
+	{/*this scope happen in the second _DoWork call*/
+		uint64_t timeIsNow = 13; /*13 > 10 (receive time) + 2 (timeout) => timeout!!!*/
+		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+
+		STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)(TEST_DEVICEMESSAGE_HANDLE_2))); /*calling the callback*/
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+			.IgnoreArgument(1);
+	}
+
+	/*because we're at time = 13 in this test, the second message times out too*/
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_043: [ Calling IoTHubClient_LL_SetOption with value set to "0" shall disable the timeout mechanism for all new messages. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_044: [ Messages already delivered to IoTHubClient_LL shall not have their timeouts modified by a new call to IoTHubClient_LL_SetOption. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_066: [ Once all the messages of waitingToSend have been inspected, IoTHubClient_LL_DoWork shall resume stopping at the first message that has not timed out if the remaining messages are sorted by their timeouts. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_one_with_timeout_one_without_call_1_callback) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
+	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
+	"the message has been received at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	uint64_t zero = 0;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &zero); /*essentially no timeout*/
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
+
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	{/*this scope happen in the first _DoWork call*/
+		uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!!*/
+		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+
+		STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+			.IgnoreArgument(1);
+	}
+
+	/*in the second _DoWork call the message left cannot timeout, so the time is not even asked for*/
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_044: [ Messages already delivered to IoTHubClient_LL shall not have their timeouts modified by a new call to IoTHubClient_LL_SetOption. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_with_timeouts_at_12_and_11_calls_the_second_timeout) /*the newest message times out first*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t two = 2;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &two);
+
+	/*send 2 messages that will expire at 12 and 11, both of these messages are send at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
+
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout for the second message only*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)(TEST_DEVICEMESSAGE_HANDLE_2))); /*calling the callback*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_when_tickcounter_fails_in_do_work_no_timeout_callbacks_are_called) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
+	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
+	"the message has been received at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	{/*this scope happen in the _DoWork call*/
+		uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!! (well - normally - but here the code doesn't call any callbacks because time cannot be obtained*/
+		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow))
+			.SetFailReturn(__LINE__);
+	}
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_061: [ If iotHubClientHandle or stats is NULL then IoTHubClient_LL_GetMessagePoolStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetMessagePoolStats_with_NULL_handle_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	NODEPOOL_STATS stats;
+
+	///act
+	auto result = IoTHubClient_LL_GetMessagePoolStats(NULL, &stats);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_061: [ If iotHubClientHandle or stats is NULL then IoTHubClient_LL_GetMessagePoolStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetMessagePoolStats_with_NULL_stats_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-	if (difftime(lastMessageReceiveTime, timeAfterCall) > 0)
-	{
-		ASSERT_FAIL("Last message time is later than expected.");
-	}
+	///act
+	auto result = IoTHubClient_LL_GetMessagePoolStats(handle, NULL);
 
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-
-/*** IoTHubClient_LL_GetSendStatus ***/
-
-/* Tests_SRS_IOTHUBCLIENT_09_007: [IoTHubClient_LL_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter] */
-TEST_FUNCTION(IoTHubClient_GetSendStatus_BadHandleArgument_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_062: [ Otherwise IoTHubClient_LL_GetMessagePoolStats shall fill stats by calling NodePool_GetStats and return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetMessagePoolStats_succeeds)
 {
-	// arrange
+	///arrange
 	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	NODEPOOL_STATS stats;
 	mocks.ResetAllCalls();
 
-	IOTHUB_CLIENT_STATUS status;
+	STRICT_EXPECTED_CALL(mocks, NodePool_GetStats(IGNORED_PTR_ARG, &stats))
+		.IgnoreArgument(1);
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendStatus(NULL, &status);
+	///act
+	auto result = IoTHubClient_LL_GetMessagePoolStats(handle, &stats);
 
-	// assert
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.hits);
+	ASSERT_ARE_EQUAL(size_t, 2, stats.misses);
+	ASSERT_ARE_EQUAL(size_t, 4, stats.highWaterMark);
 	mocks.AssertActualAndExpectedCalls();
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 
-	// cleanup
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_09_007: [IoTHubClient_LL_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter] */
-TEST_FUNCTION(IoTHubClient_GetSendStatus_BadStatusArgument_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_063: [ If NodePool_GetStats fails then IoTHubClient_LL_GetMessagePoolStats shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetMessagePoolStats_fails_when_NodePool_GetStats_fails)
 {
-	// arrange
+	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	NODEPOOL_STATS stats;
 	mocks.ResetAllCalls();
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendStatus(handle, NULL);
+	STRICT_EXPECTED_CALL(mocks, NodePool_GetStats(IGNORED_PTR_ARG, &stats))
+		.IgnoreArgument(1)
+		.SetReturn(__LINE__);
 
-	// assert
+	///act
+	auto result = IoTHubClient_LL_GetMessagePoolStats(handle, &stats);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
 	mocks.AssertActualAndExpectedCalls();
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 
-	// cleanup
+	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_09_008: [IoTHubClient_LL_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there is currently no items to be sent] */
-TEST_FUNCTION(IoTHubClient_GetSendStatus_NoEventToSend_Succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_067: [ If iotHubClientHandle or message is NULL then IoTHubClient_LL_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendMessageDisposition_with_NULL_handle_fails)
 {
-	// arrange
+	///arrange
 	CIoTHubClientLLMocks mocks;
-	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	mocks.ResetAllCalls();
 
-	IOTHUB_CLIENT_STATUS status;
+	///act
+	auto result = IoTHubClient_LL_SendMessageDisposition(NULL, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_ACCEPTED);
 
-	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_GetSendStatus(IGNORED_PTR_ARG, &status))
-		.IgnoreAllArguments()
-		.SetReturn(IOTHUB_CLIENT_OK);
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+}
 
-	currentIotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+/*Tests_SRS_IOTHUBCLIENT_LL_02_067: [ If iotHubClientHandle or message is NULL then IoTHubClient_LL_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendMessageDisposition_with_NULL_message_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendStatus(handle, &status);
+	///act
+	auto result = IoTHubClient_LL_SendMessageDisposition(handle, NULL, IOTHUBMESSAGE_ACCEPTED);
 
-	// assert
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_IDLE, status);
 
-	// cleanup
+	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_09_009: [IoTHubClient_LL_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently items to be sent] */
-TEST_FUNCTION(IoTHubClient_GetSendStatus_HasEventToSend_Succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_068: [ If disposition is not one of IOTHUBMESSAGE_ACCEPTED, IOTHUBMESSAGE_REJECTED or IOTHUBMESSAGE_ABANDONED then IoTHubClient_LL_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendMessageDisposition_with_ASYNC_ACK_fails)
 {
-	// arrange
+	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
 	mocks.ResetAllCalls();
 
-	IOTHUB_CLIENT_STATUS status;
-
-	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_GetSendStatus(IGNORED_PTR_ARG, &status))
-		.IgnoreAllArguments()
-		.SetReturn(IOTHUB_CLIENT_OK);
-
-	currentIotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
-
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_GetSendStatus(handle, &status);
+	///act
+	auto result = IoTHubClient_LL_SendMessageDisposition(handle, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_ASYNC_ACK);
 
-	// assert
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_BUSY, status);
 
-	// cleanup
+	///cleanup
 	IoTHubClient_LL_Destroy(handle);
-	currentIotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_034: [If iotHubClientHandle is NULL then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_with_NULL_handle_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_109: [ If the "AsyncMessageDisposition" option is not set then IoTHubClient_LL_SendMessageDisposition shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendMessageDisposition_without_AsyncMessageDisposition_fails)
 {
 	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
 	///act
-	auto result = IoTHubClient_LL_SetOption(NULL, "a", "b");
+	auto result = IoTHubClient_LL_SendMessageDisposition(handle, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_ACCEPTED);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
+	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_035: [If optionName is NULL then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-TEST_FUNCTION(IoTHubClient_LL_SetOption_with_NULL_optionName_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_069: [ Otherwise IoTHubClient_LL_SendMessageDisposition shall call the transport's _SendMessageDisposition and return what it returns. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendMessageDisposition_calls_the_transport)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
+	bool asyncMessageDisposition = true;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "AsyncMessageDisposition", &asyncMessageDisposition);
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_SendMessageDisposition(IGNORED_PTR_ARG, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_REJECTED))
+		.IgnoreArgument(1)
+		.SetReturn(IOTHUB_CLIENT_ERROR);
+
 	///act
-	auto result = IoTHubClient_LL_SetOption(handle, NULL, "b");
+	auto result = IoTHubClient_LL_SendMessageDisposition(handle, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_REJECTED);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
+}
 
+/*returns the context of the message at position "index" of waitingToSend*/
+static void* waitingToSendContextAt(size_t index)
+{
+	PDLIST_ENTRY entry = registeredWaitingToSend->Flink;
+	while ((index > 0) && (entry != registeredWaitingToSend))
+	{
+		entry = entry->Flink;
+		index--;
+	}
+	return (entry == registeredWaitingToSend) ? NULL : containingRecord(entry, IOTHUB_MESSAGE_LIST, entry)->context;
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_036: [If value is NULL then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-TEST_FUNCTION(IoTHubClient_LL_SetOption_with_NULL_value_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_085: [ A message that does not have a higher priority than the newest message in waitingToSend shall be added at the end of waitingToSend. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_LOW_priority_message_goes_after_NORMAL_ones)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	currentMessagePriority = IOTHUB_MESSAGE_PRIORITY_LOW;
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(registeredWaitingToSend, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+
 	///act
-	auto result = IoTHubClient_LL_SetOption(handle, "a", NULL);
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)2);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(void_ptr, (void*)1, waitingToSendContextAt(0));
+	ASSERT_ARE_EQUAL(void_ptr, (void*)2, waitingToSendContextAt(1));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
-
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_038: [Otherwise, IoTHubClient_LL shall call the function _SetOption of the underlying transport and return what that function is returning.] */
-TEST_FUNCTION(IoTHubClient_LL_SetOption_happy_path)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_086: [ Otherwise the message shall be inserted in waitingToSend before the first message of a lower priority that was overtaken less than "priorityMaxOvertakes" times, and that message shall count one more overtake. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_HIGH_priority_message_goes_ahead_of_NORMAL_ones)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)2);
+	currentMessagePriority = IOTHUB_MESSAGE_PRIORITY_HIGH;
 	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, "a", "b"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(registeredWaitingToSend->Flink, IGNORED_PTR_ARG)) /*right before the oldest message*/
+		.IgnoreArgument(2);
 
 	///act
-	auto result = IoTHubClient_LL_SetOption(handle, "a", "b");
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)3);
 
 	///assert
 	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(void_ptr, (void*)3, waitingToSendContextAt(0));
+	ASSERT_ARE_EQUAL(void_ptr, (void*)1, waitingToSendContextAt(1));
+	ASSERT_ARE_EQUAL(void_ptr, (void*)2, waitingToSendContextAt(2));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
-
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_038: [Otherwise, IoTHubClient_LL shall call the function _SetOption of the underlying transport and return what that function is returning.] */
-TEST_FUNCTION(IoTHubClient_LL_SetOption_fails_when_underlying_transport_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_086: [ Otherwise the message shall be inserted in waitingToSend before the first message of a lower priority that was overtaken less than "priorityMaxOvertakes" times, and that message shall count one more overtake. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_092: [ "priorityMaxOvertakes" - IoTHubClient_LL_SetOption shall set how many messages of a higher priority can be queued ahead of a message that is already waiting. 0 keeps the messages in the order they were queued. Value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_a_message_is_overtaken_at_most_priorityMaxOvertakes_times)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t two = 2;
+	(void)IoTHubClient_LL_SetOption(handle, "priorityMaxOvertakes", &two);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	currentMessagePriority = IOTHUB_MESSAGE_PRIORITY_HIGH;
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)2);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)3);
 	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, "a", "b"))
-		.SetReturn(IOTHUB_CLIENT_INDEFINITE_TIME);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(registeredWaitingToSend, IGNORED_PTR_ARG)) /*message 1 was overtaken twice already*/
+		.IgnoreArgument(2);
 
 	///act
-	auto result = IoTHubClient_LL_SetOption(handle, "a", "b");
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)4);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INDEFINITE_TIME, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(void_ptr, (void*)2, waitingToSendContextAt(0));
+	ASSERT_ARE_EQUAL(void_ptr, (void*)3, waitingToSendContextAt(1));
+	ASSERT_ARE_EQUAL(void_ptr, (void*)1, waitingToSendContextAt(2));
+	ASSERT_ARE_EQUAL(void_ptr, (void*)4, waitingToSendContextAt(3));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
-
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_to_zero_after_Create_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_092: [ "priorityMaxOvertakes" - IoTHubClient_LL_SetOption shall set how many messages of a higher priority can be queued ahead of a message that is already waiting. 0 keeps the messages in the order they were queued. Value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_priorityMaxOvertakes_0_keeps_the_order_of_the_messages)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t zero = 0;
+	(void)IoTHubClient_LL_SetOption(handle, "priorityMaxOvertakes", &zero);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	currentMessagePriority = IOTHUB_MESSAGE_PRIORITY_HIGH;
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(registeredWaitingToSend, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+
 	///act
-	uint64_t zero = 0;
-	auto result = IoTHubClient_LL_SetOption(handle, "messageTimeout", &zero);
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)2);
 
 	///assert
 	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(void_ptr, (void*)1, waitingToSendContextAt(0));
+	ASSERT_ARE_EQUAL(void_ptr, (void*)2, waitingToSendContextAt(1));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_to_one_after_Create_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_087: [ Messages of priority IOTHUB_MESSAGE_PRIORITY_HIGH shall always be added to waitingToSend, never to the message store. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_HIGH_priority_message_past_the_watermark_is_not_stored)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t watermark = 3; /*NodePool_GetStats reports 3 records in use*/
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStoreWatermark", &watermark);
+	messageStoreIsEmpty = false;
+	currentMessagePriority = IOTHUB_MESSAGE_PRIORITY_HIGH;
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetPriority(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
 	///act
-	uint64_t one = 1;
-	auto result = IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
 
 	///assert
 	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 0, messageStoreRecordSize);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
-
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_can_be_reverted_back_to_zero_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_088: [ Messages replayed from the message store shall be added to waitingToSend by their priority, like new messages. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_replays_a_stored_message_with_its_priority)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	uint64_t one = 1;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+	size_t watermark = 3;
+	(void)IoTHubClient_LL_SetOption(handle, "messageStore", TEST_MESSAGESTORE_PATH);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStoreWatermark", &watermark);
+	currentMessagePriority = IOTHUB_MESSAGE_PRIORITY_LOW;
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1); /*goes to the store*/
+	watermark = 4; /*room for exactly 1 more*/
+	(void)IoTHubClient_LL_SetOption(handle, "messageStoreWatermark", &watermark);
+	messageStoreRecordsToRead = 1;
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, NodePool_GetStats(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, MessageStore_IsEmpty(TEST_MESSAGESTORE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, MessageStore_ReadNext(TEST_MESSAGESTORE_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, sizeof(TEST_BODY)))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetMessageId(TEST_DEVICEMESSAGE_HANDLE_2, "theMessageId"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_HANDLE, "theKey", "theValue"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetPriority(TEST_DEVICEMESSAGE_HANDLE_2, IOTHUB_MESSAGE_PRIORITY_LOW));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
 	///act
-	uint64_t zero = 0;
-	auto result = IoTHubClient_LL_SetOption(handle, "messageTimeout", &zero);
+	IoTHubClient_LL_DoWork(handle);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_LOW, containingRecord(registeredWaitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->priority);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_calls_timeout_callback)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_093: [ If iotHubClientHandle or stats is NULL, or priority is not one of the values of IOTHUB_MESSAGE_PRIORITY, then IoTHubClient_LL_GetPriorityLaneStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetPriorityLaneStats_with_NULL_handle_fails)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
-	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	uint64_t one = 1;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+	IOTHUB_CLIENT_PRIORITY_LANE_STATS stats;
 
-	/*send 1 messages that will expire*/
-	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
-	"the message has been received at time=10*/
-	uint64_t ten = 10;
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+	///act
+	auto result = IoTHubClient_LL_GetPriorityLaneStats(NULL, IOTHUB_MESSAGE_PRIORITY_NORMAL, &stats);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_093: [ If iotHubClientHandle or stats is NULL, or priority is not one of the values of IOTHUB_MESSAGE_PRIORITY, then IoTHubClient_LL_GetPriorityLaneStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetPriorityLaneStats_with_NULL_stats_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
 	mocks.ResetAllCalls();
 
-	/*we don't care what happens in the Transport, so let's ignore all those calls*/
-	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllCalls();
+	///act
+	auto result = IoTHubClient_LL_GetPriorityLaneStats(handle, IOTHUB_MESSAGE_PRIORITY_NORMAL, NULL);
 
-	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout*/
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
 
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
-		.IgnoreArgument(1);
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_093: [ If iotHubClientHandle or stats is NULL, or priority is not one of the values of IOTHUB_MESSAGE_PRIORITY, then IoTHubClient_LL_GetPriorityLaneStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetPriorityLaneStats_with_unknown_priority_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_PRIORITY_LANE_STATS stats;
+	mocks.ResetAllCalls();
 
 	///act
-	IoTHubClient_LL_DoWork(handle);
+	auto result = IoTHubClient_LL_GetPriorityLaneStats(handle, (IOTHUB_MESSAGE_PRIORITY)(IOTHUB_MESSAGE_PRIORITY_HIGH + 1), &stats);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_042: [ By default, messages shall not timeout. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_defaults_to_zero)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_090: [ IoTHubClient_LL_SendEventAsync and IoTHubClient_LL_SendEventAsync_Move shall record the time the message is queued at by calling tickcounter_get_current_ms. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_091: [ If completed is not empty, IoTHubClient_LL_SendComplete shall call tickcounter_get_current_ms once and add to the counters of the priority of every completed message the time since the message was queued. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_094: [ Otherwise IoTHubClient_LL_GetPriorityLaneStats shall fill stats with the counters of the messages of priority priority and return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetPriorityLaneStats_counts_the_queued_and_the_completed_messages)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-
-	/*send 1 messages that will expire*/
-	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
-	"the message has been received at time=10*/
+	IOTHUB_CLIENT_PRIORITY_LANE_STATS stats;
+	DLIST_ENTRY completed;
 	uint64_t ten = 10;
+	uint64_t twentyFive = 25;
+	currentMessagePriority = IOTHUB_MESSAGE_PRIORITY_HIGH;
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)2);
+	/*the transport takes the oldest message and sends it*/
+	DList_InitializeListHead(&completed);
+	PDLIST_ENTRY oldest = DList_RemoveHeadList(registeredWaitingToSend);
+	DList_InsertTailList(&completed, oldest);
 	mocks.ResetAllCalls();
 
-	/*we don't care what happens in the Transport, so let's ignore all those calls*/
-	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllCalls();
-
-	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => would result in timeout, except the fact that messageTimeout option has never been set, therefore no timeout shall be called*/
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
-		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+		.CopyOutArgumentBuffer(2, &twentyFive, sizeof(twentyFive));
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&completed));
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&completed));
 
 	///act
-	IoTHubClient_LL_DoWork(handle);
+	IoTHubClient_LL_SendComplete(handle, &completed, IOTHUB_BATCHSTATE_SUCCESS);
+	auto result = IoTHubClient_LL_GetPriorityLaneStats(handle, IOTHUB_MESSAGE_PRIORITY_HIGH, &stats);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.depth);
+	ASSERT_ARE_EQUAL(size_t, 2, stats.maxDepth);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.completed);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)15, stats.totalLatencyMs);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)15, stats.maxLatencyMs);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClient_LL_GetPriorityLaneStats(handle, IOTHUB_MESSAGE_PRIORITY_NORMAL, &stats));
+	ASSERT_ARE_EQUAL(size_t, 0, stats.maxDepth);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.completed);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_only_removes_the_message_if_it_has_NULL_callback)
+/*Tests_SRS_IOTHUBCLIENT_LL_02_095: [ If handle or first is NULL, or count is 0, then IoTHubClient_LL_SendStarted shall return. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendStarted_with_NULL_handle_does_nothing)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
-	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	uint64_t one = 1;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
-
-	/*send 1 messages that will expire*/
-	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
-	"the message has been received at time=10*/
-	uint64_t ten = 10;
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL); /*this is a message with a NULL callback*/
-	mocks.ResetAllCalls();
+	IOTHUB_MESSAGE_LIST message;
+	message.sendAttempts = 0;
 
-	/*we don't care what happens in the Transport, so let's ignore all those calls*/
-	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllCalls();
+	///act
+	IoTHubClient_LL_SendStarted(NULL, &message, 1, 10);
 
-	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout*/
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+	///assert
+	ASSERT_ARE_EQUAL(size_t, 0, message.sendAttempts);
+	mocks.AssertActualAndExpectedCalls();
+}
 
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
-		.IgnoreArgument(1);
+/*Tests_SRS_IOTHUBCLIENT_LL_02_095: [ If handle or first is NULL, or count is 0, then IoTHubClient_LL_SendStarted shall return. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendStarted_with_0_count_does_nothing)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_SEND_STATS stats;
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	IOTHUB_MESSAGE_LIST* message = containingRecord(registeredWaitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry);
+	mocks.ResetAllCalls();
 
 	///act
-	IoTHubClient_LL_DoWork(handle);
+	IoTHubClient_LL_SendStarted(handle, NULL, 1, 10);
+	IoTHubClient_LL_SendStarted(handle, message, 0, 10);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClient_LL_GetSendStats(handle, &stats));
+	ASSERT_ARE_EQUAL(size_t, 1, stats.queued);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.inFlight);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.batchSize.count);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)0, stats.bytesOut);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_when_exactly_on_the_edge_does_not_call_the_callback) /*because "more"*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_103: [ If iotHubClientHandle or stats is NULL then IoTHubClient_LL_GetSendStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendStats_with_NULL_handle_fails)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
-	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	uint64_t one = 1;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+	IOTHUB_CLIENT_SEND_STATS stats;
 
-	/*send 1 messages that will expire*/
-	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
-	"the message has been received at time=10*/
-	uint64_t ten = 10;
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
-	mocks.ResetAllCalls();
+	///act
+	auto result = IoTHubClient_LL_GetSendStats(NULL, &stats);
 
-	/*we don't care what happens in the Transport, so let's ignore all those calls*/
-	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllCalls();
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+}
 
-	uint64_t eleven = 11; /*11 = 10 (receive time) + 1 (timeout) => NO timeout*/
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.CopyOutArgumentBuffer(2, &eleven, sizeof(eleven));
+/*Tests_SRS_IOTHUBCLIENT_LL_02_103: [ If iotHubClientHandle or stats is NULL then IoTHubClient_LL_GetSendStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendStats_with_NULL_stats_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
 	///act
-	IoTHubClient_LL_DoWork(handle);
+	auto result = IoTHubClient_LL_GetSendStats(handle, NULL);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_with_timeouts_at_11_and_12_calls_1_timeout) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_096: [ IoTHubClient_LL_SendStarted shall call tickcounter_get_current_ms once, record count in batchSize and add size to bytesOut. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_097: [ A message sent for the first time shall be counted in inFlight and IoTHubClient_LL_SendStarted shall record in enqueueToSendMs the time since the message was queued. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_099: [ size shall be split evenly between the messages, the remainder going to first, and every message shall be counted in bytesInFlight with its share until it is completed. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_104: [ Otherwise IoTHubClient_LL_GetSendStats shall fill stats with the counters of the client, queued being the messages in memory that are not in flight, and return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendStarted_counts_a_batch_in_flight)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	uint64_t one = 1;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
-
-	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
-	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
-	"the message has been received at time=10*/
+	IOTHUB_CLIENT_SEND_STATS stats;
 	uint64_t ten = 10;
+	uint64_t twentyFive = 25;
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
-
-	uint64_t two = 2;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &two);
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2 ));
-
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)2);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)3);
+	IOTHUB_MESSAGE_LIST* first = containingRecord(registeredWaitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry);
 	mocks.ResetAllCalls();
 
-	/*we don't care what happens in the Transport, so let's ignore all those calls*/
-	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllCalls();
-
-	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!!*/
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
-		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
-
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
-		.IgnoreArgument(1);
-
-	/*because we're at time = 12 in this test, the second message is untouched*/
+		.CopyOutArgumentBuffer(2, &twentyFive, sizeof(twentyFive));
 
 	///act
-	IoTHubClient_LL_DoWork(handle);
+	IoTHubClient_LL_SendStarted(handle, first, 2, 101);
+	auto result = IoTHubClient_LL_GetSendStats(handle, &stats);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.queued);
+	ASSERT_ARE_EQUAL(size_t, 2, stats.inFlight);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)101, stats.bytesInFlight);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)101, stats.bytesOut);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.retries);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.batchSize.count);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)2, stats.batchSize.max);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.batchSize.buckets[2]); /*2 is in [2, 3]*/
+	ASSERT_ARE_EQUAL(size_t, 2, stats.enqueueToSendMs.count);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)30, stats.enqueueToSendMs.total);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)15, stats.enqueueToSendMs.max);
+	ASSERT_ARE_EQUAL(size_t, 2, stats.enqueueToSendMs.buckets[4]); /*15 is in [8, 15]*/
+	ASSERT_ARE_EQUAL(size_t, 1, first->sendAttempts);
+	ASSERT_ARE_EQUAL(size_t, 51, first->sentSize);
+	ASSERT_ARE_EQUAL(size_t, 50, containingRecord(first->entry.Flink, IOTHUB_MESSAGE_LIST, entry)->sentSize);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_044: [ Messages already delivered to IoTHubClient_LL shall not have their timeouts modified by a new call to IoTHubClient_LL_SetOption. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_with_timeouts_at_11_and_12_calls_2_timeouts) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_098: [ A message that was sent before shall be counted as one more retry. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_100: [ IoTHubClient_LL_SendComplete shall count every completed message in succeeded or failed, and for every completed message that the transport sent it shall record in sendToConfirmMs the time since the message was sent for the last time and shall not count it in flight anymore. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_counts_the_retries_and_the_confirmation_latency)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	uint64_t one = 1;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
-
-	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
-	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
-	"the message has been received at time=10*/
+	IOTHUB_CLIENT_SEND_STATS stats;
+	DLIST_ENTRY completed;
 	uint64_t ten = 10;
+	uint64_t twenty = 20;
+	uint64_t thirty = 30;
+	uint64_t fortyFive = 45;
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
-
-	uint64_t two = 2;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &two);
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
-
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twenty, sizeof(twenty));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &thirty, sizeof(thirty));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)2);
+	IOTHUB_MESSAGE_LIST* first = containingRecord(registeredWaitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry);
+	/*the transport sends both messages at 20, then only the first one again at 30*/
+	IoTHubClient_LL_SendStarted(handle, first, 2, 101);
+	IoTHubClient_LL_SendStarted(handle, first, 1, 40);
+	DList_InitializeListHead(&completed);
+	DList_AppendTailList(&completed, registeredWaitingToSend);
+	DList_RemoveEntryList(registeredWaitingToSend);
+	DList_InitializeListHead(registeredWaitingToSend);
 	mocks.ResetAllCalls();
 
-	/*we don't care what happens in the Transport, so let's ignore all those calls*/
-	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllCalls();
-
-	{/*this scope happen in the first _DoWork call*/
-		uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!!*/
-		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
-
-		STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
-			.IgnoreArgument(1);
-	}
-
-	{/*this scope happen in the second _DoWork call*/
-		uint64_t timeIsNow = 13; /*13 > 10 (receive time) + 2 (timeout) => timeout!!!*/
-		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
-
-		STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)(TEST_DEVICEMESSAGE_HANDLE_2))); /*calling the callback*/
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
-			.IgnoreArgument(1);
-	}
-
-	/*because we're at time = 13 in this test, the second message times out too*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &fortyFive, sizeof(fortyFive));
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&completed));
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&completed));
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)2));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&completed));
 
 	///act
-	IoTHubClient_LL_DoWork(handle);
-	IoTHubClient_LL_DoWork(handle);
+	IoTHubClient_LL_SendComplete(handle, &completed, IOTHUB_BATCHSTATE_SUCCESS);
+	auto result = IoTHubClient_LL_GetSendStats(handle, &stats);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.queued);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.inFlight);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)0, stats.bytesInFlight);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)141, stats.bytesOut);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.retries);
+	ASSERT_ARE_EQUAL(size_t, 2, stats.succeeded);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.failed);
+	ASSERT_ARE_EQUAL(size_t, 2, stats.batchSize.count);
+	ASSERT_ARE_EQUAL(size_t, 2, stats.enqueueToSendMs.count);
+	ASSERT_ARE_EQUAL(size_t, 2, stats.sendToConfirmMs.count);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)40, stats.sendToConfirmMs.total); /*15 for the first message, 25 for the second*/
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)25, stats.sendToConfirmMs.max);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_043: [ Calling IoTHubClient_LL_SetOption with value set to "0" shall disable the timeout mechanism for all new messages. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_044: [ Messages already delivered to IoTHubClient_LL shall not have their timeouts modified by a new call to IoTHubClient_LL_SetOption. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_one_with_timeout_one_without_call_1_callback) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_101: [ Messages that time out shall be counted in timedOut and shall not be in flight anymore. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_counts_a_message_in_flight_that_times_out)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_SEND_STATS stats;
 	uint64_t one = 1;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
-
-	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
-	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
-	"the message has been received at time=10*/
 	uint64_t ten = 10;
+	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout*/
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
 	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
-
-	uint64_t zero = 0;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &zero); /*essentially no timeout*/
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
-
+	IoTHubClient_LL_SendStarted(handle, containingRecord(registeredWaitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry), 1, 20);
 	mocks.ResetAllCalls();
 
-	/*we don't care what happens in the Transport, so let's ignore all those calls*/
 	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreAllCalls();
-
-	{/*this scope happen in the first _DoWork call*/
-		uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!!*/
-		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
-
-		STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
-			.IgnoreArgument(1);
-	}
-
-	{/*this scope happen in the second _DoWork call*/
-		uint64_t timeIsNow = 999999999999999ULL; /*some very big number*/
-		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
-	}
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	///act
 	IoTHubClient_LL_DoWork(handle);
-	IoTHubClient_LL_DoWork(handle);
+	auto result = IoTHubClient_LL_GetSendStats(handle, &stats);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.timedOut);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.inFlight);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)0, stats.bytesInFlight);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.queued);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_when_tickcounter_fails_in_do_work_no_timeout_callbacks_are_called) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_102: [ IoTHubClient_LL_MessageCallback shall add to bytesIn the size of the body of the message, obtained by calling IoTHubMessage_GetContentType and then IoTHubMessage_GetByteArray or IoTHubMessage_GetString. ]*/
+TEST_FUNCTION(IoTHubClient_LL_MessageCallback_counts_the_bytes_received)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	uint64_t one = 1;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
-
-	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
-	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
-	"the message has been received at time=10*/
-	uint64_t ten = 10;
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
-
+	IOTHUB_CLIENT_SEND_STATS stats;
+	(void)IoTHubClient_LL_SetMessageCallback(handle, messageCallback, (void*)11);
 	mocks.ResetAllCalls();
 
-	/*we don't care what happens in the Transport, so let's ignore all those calls*/
-	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllCalls();
-
-	{/*this scope happen in the _DoWork call*/
-		uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!! (well - normally - but here the code doesn't call any callbacks because time cannot be obtained*/
-		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow))
-			.SetFailReturn(__LINE__);
-	}
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType((IOTHUB_MESSAGE_HANDLE)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray((IOTHUB_MESSAGE_HANDLE)1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType((IOTHUB_MESSAGE_HANDLE)2))
+		.SetReturn(IOTHUBMESSAGE_STRING);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString((IOTHUB_MESSAGE_HANDLE)2))
+		.SetReturn("abc");
+	STRICT_EXPECTED_CALL(mocks, messageCallback((IOTHUB_MESSAGE_HANDLE)1, (void*)11));
+	STRICT_EXPECTED_CALL(mocks, messageCallback((IOTHUB_MESSAGE_HANDLE)2, (void*)11));
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL))
+		.ExpectedTimesExactly(2);
 
 	///act
-	IoTHubClient_LL_DoWork(handle);
+	(void)IoTHubClient_LL_MessageCallback(handle, (IOTHUB_MESSAGE_HANDLE)1);
+	(void)IoTHubClient_LL_MessageCallback(handle, (IOTHUB_MESSAGE_HANDLE)2);
+	auto result = IoTHubClient_LL_GetSendStats(handle, &stats);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)(sizeof(TEST_BODY) + 3), stats.bytesIn);
+	ASSERT_ARE_EQUAL(uint64_t, (uint64_t)0, stats.bytesOut);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
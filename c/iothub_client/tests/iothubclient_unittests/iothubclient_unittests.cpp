@@ -15,6 +15,7 @@
 
 #include "iothub_client.h"
 #include "iothub_client_ll.h"
+#include "iothub_client_private.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
 #include "iothubtransport.h"
@@ -27,6 +28,7 @@ extern "C" void* gballoc_realloc(void* ptr, size_t size);
 extern "C" void gballoc_free(void* ptr);
 
 DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_STATUS_VALUES);
+DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
 
 namespace BASEIMPLEMENTATION
 {
@@ -42,6 +44,7 @@ namespace BASEIMPLEMENTATION
 };
 
 DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_RESULT_VALUES);
+DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_DISPOSITION_RESULT_VALUES);
 
 static MICROMOCK_MUTEX_HANDLE g_testByTest;
 static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
@@ -51,6 +54,7 @@ static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 #define TEST_IOTHUBNAME "theNameoftheIotHub"
 #define TEST_IOTHUBSUFFIX "theSuffixoftheIotHubHostname"
 #define TEST_DEVICEMESSAGE_HANDLE (IOTHUB_MESSAGE_HANDLE)0x52
+#define TEST_CLONED_MESSAGE_HANDLE (IOTHUB_MESSAGE_HANDLE)0x53
 #define TEST_THREAD_HANDLE (THREAD_HANDLE)0x4442
 #define TEST_LOCK_HANDLE (LOCK_HANDLE)0x4443
 static const char* TEST_CHAR = "TestChar";
@@ -59,6 +63,10 @@ static size_t howManyDoWorkCalls = 0;
 static size_t doWorkCallCount = 0;
 static THREAD_START_FUNC threadFunc;
 static void* threadFuncArg;
+static IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC savedLLMessageCallback;
+static void* savedLLMessageCallbackContext;
+static uint64_t currentLLTime;
+static IOTHUB_CLIENT_HANDLE sendEventOnSleep; /*when set, the next ThreadAPI_Sleep sends an event to it, as another thread would while the worker thread sleeps*/
 static const void* provideFAKE(void);
 extern "C" const size_t IoTHubClient_ThreadTerminationOffset;
 
@@ -95,13 +103,29 @@ public:
     MOCK_VOID_METHOD_END();
     MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync_Move, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_5(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync_MoveQueuedAt, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback, uint64_t, queuedAt)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_1(, uint64_t, IoTHubClient_LL_GetCurrentTime, IOTHUB_CLIENT_LL_HANDLE, handle)
+    MOCK_METHOD_END(uint64_t, ++currentLLTime);
     MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetMessageCallback, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, messageCallback, void*, userContextCallback)
+        savedLLMessageCallback = messageCallback;
+        savedLLMessageCallbackContext = userContextCallback;
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
     MOCK_STATIC_METHOD_1(, void, IoTHubClient_LL_DoWork, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle)
         doWorkCallCount++;
     MOCK_VOID_METHOD_END();
     MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStatus, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetMessagePoolStats, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, NODEPOOL_STATS*, stats)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetPriorityLaneStats, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY, priority, IOTHUB_CLIENT_PRIORITY_LANE_STATS*, stats)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStats, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_SEND_STATS*, stats)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendMessageDisposition, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, message, IOTHUBMESSAGE_DISPOSITION_RESULT, disposition)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
     MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetLastMessageReceiveTime, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, time_t*, lastMessageReceiveTime)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
 
@@ -119,6 +143,12 @@ public:
     MOCK_STATIC_METHOD_1(, void, ThreadAPI_Exit, int, res);
     MOCK_VOID_METHOD_END();
     MOCK_STATIC_METHOD_1(, void, ThreadAPI_Sleep, unsigned int, milliseconds)
+        if (sendEventOnSleep != NULL)
+        {
+            IOTHUB_CLIENT_HANDLE iotHubClient = sendEventOnSleep;
+            sendEventOnSleep = NULL;
+            (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL);
+        }
         if ((howManyDoWorkCalls > 0) && (howManyDoWorkCalls == doWorkCallCount))
         {
             *(sig_atomic_t*)(((char*)threadFuncArg) + IoTHubClient_ThreadTerminationOffset) = 1; /*tell the thread to stop*/
@@ -169,6 +199,12 @@ public:
     MOCK_STATIC_METHOD_2(, IOTHUBMESSAGE_DISPOSITION_RESULT, messageCallback, IOTHUB_MESSAGE_HANDLE, message, void*, userContextCallback)
     MOCK_METHOD_END(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ACCEPTED);
 
+    /* IoTHubMessage mocks */
+    MOCK_STATIC_METHOD_1(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_Clone, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+    MOCK_METHOD_END(IOTHUB_MESSAGE_HANDLE, TEST_CLONED_MESSAGE_HANDLE);
+    MOCK_STATIC_METHOD_1(, void, IoTHubMessage_Destroy, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+    MOCK_VOID_METHOD_END();
+
 	/* TRANSPORT mocks*/
 
 	MOCK_STATIC_METHOD_1(, LOCK_HANDLE, IoTHubTransport_GetLock, TRANSPORT_HANDLE, transportHlHandle)
@@ -177,6 +213,15 @@ public:
 	MOCK_STATIC_METHOD_1(, TRANSPORT_LL_HANDLE, IoTHubTransport_GetLLTransport, TRANSPORT_HANDLE, transportHlHandle)
 	MOCK_METHOD_END(TRANSPORT_LL_HANDLE, TEST_IOTHUBTRANSPORT_LL)
 
+	MOCK_STATIC_METHOD_2(, LOCK_HANDLE, IoTHubTransport_GetClientLock, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle)
+	MOCK_METHOD_END(LOCK_HANDLE, TEST_IOTHUBTRANSPORT_LOCK)
+
+	MOCK_STATIC_METHOD_2(, TRANSPORT_LL_HANDLE, IoTHubTransport_GetClientLLTransport, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle)
+	MOCK_METHOD_END(TRANSPORT_LL_HANDLE, TEST_IOTHUBTRANSPORT_LL)
+
+	MOCK_STATIC_METHOD_2(, void, IoTHubTransport_ReleaseClient, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle)
+	MOCK_VOID_METHOD_END()
+
 	MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubTransport_StartWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle)
 	MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
 
@@ -194,9 +239,16 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , IOTHUB_CLIENT_LL_HANDLE, IoTH
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubClient_LL_Destroy, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync_Move, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
+DECLARE_GLOBAL_MOCK_METHOD_5(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync_MoveQueuedAt, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback, uint64_t, queuedAt)
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , uint64_t, IoTHubClient_LL_GetCurrentTime, IOTHUB_CLIENT_LL_HANDLE, handle)
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetMessageCallback, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, messageCallback, void*, userContextCallback)
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubClient_LL_DoWork, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle)
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStatus, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus)
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetMessagePoolStats, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, NODEPOOL_STATS*, stats)
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetPriorityLaneStats, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_PRIORITY, priority, IOTHUB_CLIENT_PRIORITY_LANE_STATS*, stats)
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStats, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_SEND_STATS*, stats)
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendMessageDisposition, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, message, IOTHUBMESSAGE_DISPOSITION_RESULT, disposition)
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetLastMessageReceiveTime, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, time_t*, lastMessageReceiveTime)
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetOption, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, const char*, optionName, const void*, value)
 
@@ -217,8 +269,14 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, gballoc_free, void*, pt
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , void, eventConfirmationCallback, IOTHUB_CLIENT_CONFIRMATION_RESULT, result2, void*, userContextCallback);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUBMESSAGE_DISPOSITION_RESULT, messageCallback, IOTHUB_MESSAGE_HANDLE, message, void*, userContextCallback);
 
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , IOTHUB_MESSAGE_HANDLE, IoTHubMessage_Clone, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubMessage_Destroy, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , LOCK_HANDLE, IoTHubTransport_GetLock, TRANSPORT_HANDLE, transportHlHandle);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , TRANSPORT_LL_HANDLE, IoTHubTransport_GetLLTransport, TRANSPORT_HANDLE, transportHlHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , LOCK_HANDLE, IoTHubTransport_GetClientLock, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , TRANSPORT_LL_HANDLE, IoTHubTransport_GetClientLLTransport, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , void, IoTHubTransport_ReleaseClient, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubTransport_StartWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , bool, IoTHubTransport_SignalEndWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , void, IoTHubTransport_JoinWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
@@ -254,8 +312,12 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         whenShallmalloc_fail = 0;
         howManyDoWorkCalls = 0;
         doWorkCallCount = 0;
+        currentLLTime = 0;
+        sendEventOnSleep = NULL;
 		threadFunc = NULL;
 		threadFuncArg = NULL;
+        savedLLMessageCallback = NULL;
+        savedLLMessageCallbackContext = NULL;
     }
 
     TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -467,8 +529,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 	}
 
 	//Tests_SRS_IOTHUBCLIENT_17_001: [ IoTHubClient_CreateWithTransport shall allocate a new IoTHubClient instance and return a non-NULL handle to it. ]
-	//Tests_SRS_IOTHUBCLIENT_17_003: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_HL_GetLLTransport on transportHandle to get lower layer transport. ]
-	//Tests_SRS_IOTHUBCLIENT_17_005: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetLock to get the transport lock to be used later for serializing IoTHubClient calls. ]
+	//Tests_SRS_IOTHUBCLIENT_17_003: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetClientLLTransport on transportHandle to get the lower layer transport of the same worker. ]
+	//Tests_SRS_IOTHUBCLIENT_17_005: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetClientLock to get the lock of the transport worker serving the new instance, to be used later for serializing IoTHubClient calls. ]
 	//Tests_SRS_IOTHUBCLIENT_17_007: [ IoTHubClient_CreateWithTransport shall instantiate a new IoTHubClient_LL instance by calling IoTHubClient_LL_CreateWithTransport and passing the lower layer transport and config argument. ]
 	TEST_FUNCTION(When_creating_with_transport_success_returns_non_null)
 	{
@@ -479,8 +541,10 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		STRICT_EXPECTED_CALL(mocks, Unlock(TEST_IOTHUBTRANSPORT_LOCK));
 
 		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLock(TEST_IOTHUBTRANSPORT_HANDLE));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLLTransport(TEST_IOTHUBTRANSPORT_HANDLE));
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLock(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLLTransport(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
 		STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_CreateWithTransport(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
 
@@ -505,8 +569,10 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 			.SetFailReturn((LOCK_RESULT)LOCK_ERROR);
 
 		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLock(TEST_IOTHUBTRANSPORT_HANDLE));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLLTransport(TEST_IOTHUBTRANSPORT_HANDLE));
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLock(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLLTransport(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
 		STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_CreateWithTransport(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
 
@@ -533,11 +599,15 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
 		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 		EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLock(TEST_IOTHUBTRANSPORT_HANDLE));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLLTransport(TEST_IOTHUBTRANSPORT_HANDLE));
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLock(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLLTransport(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
 		STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_CreateWithTransport(IGNORED_PTR_ARG))
 			.IgnoreArgument(1)
 			.SetFailReturn((IOTHUB_CLIENT_LL_HANDLE)NULL);
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_ReleaseClient(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
 
 		// act
 		IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
@@ -559,8 +629,12 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
 		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 		EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLock(TEST_IOTHUBTRANSPORT_HANDLE));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLLTransport(TEST_IOTHUBTRANSPORT_HANDLE));
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLock(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLLTransport(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_ReleaseClient(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
 
 		// act
 		IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
@@ -571,7 +645,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
 		///cleanup
 	}
-	//Tests_SRS_IOTHUBCLIENT_17_004: [ If IoTHubTransport_GetLLTransport fails, then IoTHubClient_CreateWithTransport shall return NULL. ]
+	//Tests_SRS_IOTHUBCLIENT_17_004: [ If IoTHubTransport_GetClientLLTransport fails, then IoTHubClient_CreateWithTransport shall return NULL. ]
+	//Tests_SRS_IOTHUBCLIENT_02_080: [ If IoTHubClient_CreateWithTransport fails after calling IoTHubTransport_GetClientLock, it shall call IoTHubTransport_ReleaseClient. ]
 	TEST_FUNCTION(When_creating_with_transport_IoTHubClient_get_ll_transport_fails_returns_null)
 	{
 		// arrange
@@ -579,9 +654,13 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
 		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 		EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLock(TEST_IOTHUBTRANSPORT_HANDLE));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLLTransport(TEST_IOTHUBTRANSPORT_HANDLE))
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLock(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLLTransport(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2)
 			.SetFailReturn((TRANSPORT_LL_HANDLE)NULL);
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_ReleaseClient(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
 
 		// act
 		IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
@@ -593,7 +672,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		///cleanup
 	}
 
-	//Tests_SRS_IOTHUBCLIENT_17_006: [ If IoTHubTransport_GetLock fails, then IoTHubClient_CreateWithTransport shall return NULL. ]
+	//Tests_SRS_IOTHUBCLIENT_17_006: [ If IoTHubTransport_GetClientLock fails, then IoTHubClient_CreateWithTransport shall return NULL. ]
 	TEST_FUNCTION(When_creating_with_transport_IoTHubClient_getLock_fails_returns_null)
 	{
 		// arrange
@@ -601,8 +680,11 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
 		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 		EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLock(TEST_IOTHUBTRANSPORT_HANDLE))
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetClientLock(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2)
 			.SetFailReturn((LOCK_HANDLE)NULL);
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_ReleaseClient(TEST_IOTHUBTRANSPORT_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
 
 		// act
 		IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
@@ -646,7 +728,9 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_StartWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE, iotHubClient));
-		STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+		STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetCurrentTime(TEST_IOTHUB_CLIENT_LL_HANDLE));
 
 		// act
 		auto result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
@@ -755,6 +839,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		// uMock checks the calls
 	}
 
+	//Tests_SRS_IOTHUBCLIENT_02_079: [ If the transport connection is shared, IoTHubClient_Destroy shall call IoTHubTransport_ReleaseClient after the worker thread (if any) has been joined. ]
 	TEST_FUNCTION(IoTHubClient_Destroy_shared_transport_frees_LL_client)
 	{
 		// arrange
@@ -768,6 +853,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
 		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_SignalEndWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE, iotHubClient));
 		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_JoinWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE, iotHubClient));
+		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_ReleaseClient(TEST_IOTHUBTRANSPORT_HANDLE, iotHubClient));
 		EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
 		// act
@@ -791,6 +877,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     }
 
     /* Tests_SRS_IOTHUBCLIENT_01_007: [The thread created as part of executing IoTHubClient_SendEventAsync or IoTHubClient_SetMessageCallback shall be joined.] */
+    /* Tests_SRS_IOTHUBCLIENT_02_076: [ After destroying the IoTHubClient_LL instance, IoTHubClient_Destroy shall call the eventConfirmationCallback (if any) of every event still queued with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY and destroy its message. ]*/
     TEST_FUNCTION(IoTHubClient_Destroy_After_A_SendEvent_Joins_The_Thread)
     {
         // arrange
@@ -808,6 +895,9 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
             .IgnoreArgument(2);
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)0x42)); /*the event was still queued*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
         EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
@@ -912,9 +1002,10 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     /* IoTHubClient_SendEventAsync */
 
     /* Tests_SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClient_LL_SendEventAsync, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-    TEST_FUNCTION(On_The_First_SendEventAsync_The_Worker_Thread_Is_Created_And_the_Underlayer_Is_Called_To_Send_Event)
+    /* Tests_SRS_IOTHUBCLIENT_02_069: [ Only if the worker thread has not been started yet, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall acquire the lock created in IoTHubClient_Create to start it. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_070: [ IoTHubClient_SendEventAsync shall queue a clone of eventMessageHandle (obtained by calling IoTHubMessage_Clone) together with eventConfirmationCallback and userContextCallback for the worker thread without acquiring the lock, and return IOTHUB_CLIENT_OK. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_104: [ IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall record the time the event is queued at by calling IoTHubClient_LL_GetCurrentTime, so that its "messageTimeout" starts when it is queued and not when the worker thread hands it over to IoTHubClient_LL. ]*/
+    TEST_FUNCTION(On_The_First_SendEventAsync_The_Worker_Thread_Is_Created_And_The_Event_Is_Queued)
     {
         // arrange
         CIoTHubClientMocks mocks;
@@ -923,8 +1014,10 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
         EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetCurrentTime(TEST_IOTHUB_CLIENT_LL_HANDLE));
 
         // act
         IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
@@ -974,57 +1067,46 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_013: [When IoTHubClient_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClient_LL_SendEventAsync.] */
-    TEST_FUNCTION(IoTHubClient_SendEventAsync_Returns_The_Error_Code_From_The_Underlayer)
+    /* Tests_SRS_IOTHUBCLIENT_02_068: [ If eventMessageHandle is NULL, or eventConfirmationCallback is NULL and userContextCallback is not NULL, then IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_With_NULL_Message_Fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
-            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, NULL, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_SIZE);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
-    TEST_FUNCTION(When_The_Worker_Thread_Was_Started_Already_Due_To_SendEventAsync_Thread_Is_Not_Started_Again_On_A_New_SendEventAsync)
+    /* Tests_SRS_IOTHUBCLIENT_02_068: [ If eventMessageHandle is NULL, or eventConfirmationCallback is NULL and userContextCallback is not NULL, then IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_With_Context_But_No_Callback_Fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, NULL, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
-    TEST_FUNCTION(When_The_Worker_Thread_Was_Started_Already_Due_To_SetMessageCallback_Thread_Is_Not_Started_Again_On_A_New_SendEventAsync)
+    /* Tests_SRS_IOTHUBCLIENT_02_071: [ If allocating the queued event, cloning the message or queuing it fails, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(When_malloc_fails_then_IoTHubClient_SendEventAsync_fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
@@ -1032,23 +1114,22 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        whenShallmalloc_fail = currentmalloc_call + 1;
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 
         // act
         IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_026: [If acquiring the lock fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
-    TEST_FUNCTION(When_Acquiring_The_lock_fails_then_IoTHubClient_SendEventAsync_fails)
+    /* Tests_SRS_IOTHUBCLIENT_02_071: [ If allocating the queued event, cloning the message or queuing it fails, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(When_IoTHubMessage_Clone_fails_then_IoTHubClient_SendEventAsync_fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
@@ -1056,32 +1137,35 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE))
+            .SetReturn((IOTHUB_MESSAGE_HANDLE)NULL);
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
         // act
         IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    TEST_FUNCTION(When_Unlock_fails_SendEventAsync_still_succeeds)
+    /* Tests_SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
+    /* Tests_SRS_IOTHUBCLIENT_02_069: [ Only if the worker thread has not been started yet, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall acquire the lock created in IoTHubClient_Create to start it. ]*/
+    TEST_FUNCTION(When_The_Worker_Thread_Was_Started_Already_Due_To_SendEventAsync_The_Lock_Is_Not_Taken_On_A_New_SendEventAsync)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetCurrentTime(TEST_IOTHUB_CLIENT_LL_HANDLE));
 
         // act
         IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
@@ -1094,25 +1178,22 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* IoTHubClient_SetMessageCallback */
-
-    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_017: [IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_SetMessageCallback, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters messageCallback and userContextCallback.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_027: [IoTHubClient_SetMessageCallback shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-    TEST_FUNCTION(IoTHubClient_SetMessageCallback_starts_the_worker_thread_and_calls_the_underlayer)
+    /* Tests_SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
+    /* Tests_SRS_IOTHUBCLIENT_02_069: [ Only if the worker thread has not been started yet, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall acquire the lock created in IoTHubClient_Create to start it. ]*/
+    TEST_FUNCTION(When_The_Worker_Thread_Was_Started_Already_Due_To_SetMessageCallback_The_Lock_Is_Not_Taken_On_A_New_SendEventAsync)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetCurrentTime(TEST_IOTHUB_CLIENT_LL_HANDLE));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
@@ -1122,21 +1203,19 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_015: [If starting the thread fails, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
-    TEST_FUNCTION(When_Thread_API_Create_fails_then_IoTHubClient_SetMessageCallback_fails)
+    /* Tests_SRS_IOTHUBCLIENT_01_026: [If acquiring the lock fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
+    TEST_FUNCTION(When_Acquiring_The_lock_fails_then_IoTHubClient_SendEventAsync_fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .SetReturn(THREADAPI_ERROR);
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
@@ -1146,21 +1225,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_016: [If iotHubClientHandle is NULL, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetMessageCallback_with_NULL_handle_fails)
-    {
-        // arrange
-        CIoTHubClientMocks mocks;
-
-        // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(NULL, messageCallback, (void*)0x42);
-
-        // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
-    }
-
-    /* Tests_SRS_IOTHUBCLIENT_01_018: [When IoTHubClient_LL_SetMessageCallback is called, IoTHubClient_SetMessageCallback shall return the result of IoTHubClient_LL_SetMessageCallback.] */
-    TEST_FUNCTION(IoTHubClient_SetMessageCallback_returns_the_result_of_calling_IoTHubClient_LL_SetMessageCallback)
+    TEST_FUNCTION(When_Unlock_fails_SendEventAsync_still_succeeds)
     {
         // arrange
         CIoTHubClientMocks mocks;
@@ -1169,179 +1234,183 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
         EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42))
-            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetCurrentTime(TEST_IOTHUB_CLIENT_LL_HANDLE));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_SIZE);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
-    TEST_FUNCTION(When_the_worker_thread_was_started_by_a_SendEventAsync_A_Call_To_SetMessageCallback_Does_NOt_Start_A_New_Thread)
+    /* IoTHubClient_SendEventAsync_Move */
+
+    /* Tests_SRS_IOTHUBCLIENT_02_054: [ If iotHubClientHandle is NULL, IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_Move_With_NULL_Handle_Fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
-        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
-        mocks.ResetAllCalls();
-
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync_Move(NULL, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-        mocks.AssertActualAndExpectedCalls();
-
-        // cleanup
-        IoTHubClient_Destroy(iotHubClient);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
-    TEST_FUNCTION(When_the_worker_thread_was_started_by_a_previous_SetMessageCallback_A_Call_To_SetMessageCallback_Does_Not_Start_A_New_Thread)
+    /* Tests_SRS_IOTHUBCLIENT_02_068: [ If eventMessageHandle is NULL, or eventConfirmationCallback is NULL and userContextCallback is not NULL, then IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_Move_With_NULL_Message_Fails_Without_Queuing)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync_Move(iotHubClient, NULL, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_028: [If acquiring the lock fails, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
-    TEST_FUNCTION(When_Acquiring_The_Lock_Fails_Then_IoTHubClient_SetMessageCallback_Fails)
+    /* Tests_SRS_IOTHUBCLIENT_02_068: [ If eventMessageHandle is NULL, or eventConfirmationCallback is NULL and userContextCallback is not NULL, then IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_072: [ IoTHubClient_SendEventAsync_Move shall queue eventMessageHandle itself, without cloning it. If queuing fails, eventMessageHandle stays owned by the caller. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_Move_With_Context_But_No_Callback_Fails_And_Leaves_The_Message_To_The_Caller)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);;
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
-
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, NULL, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
-        IoTHubClient_Destroy(iotHubClient);
+        mocks.ResetAllCalls();
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        IoTHubClient_Destroy(iotHubClient); /*nothing was queued, so the message is not destroyed*/
+        mocks.AssertActualAndExpectedCalls();
     }
 
-    /* IoTHubClient_GetLastMessageReceiveTime */
-
-    /* Tests_SRS_IOTHUBCLIENT_01_019: [IoTHubClient_GetLastMessageReceiveTime shall call IoTHubClient_LL_GetLastMessageReceiveTime, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameter lastMessageReceiveTime.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_035: [IoTHubClient_GetLastMessageReceiveTime shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-    TEST_FUNCTION(IoTHubClient_GetLastMessageReceiveTime_Calls_the_Underlayer)
+    /* Tests_SRS_IOTHUBCLIENT_02_057: [ IoTHubClient_SendEventAsync_Move shall start the worker thread if it was not previously started. If starting the thread fails, IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_072: [ IoTHubClient_SendEventAsync_Move shall queue eventMessageHandle itself, without cloning it. If queuing fails, eventMessageHandle stays owned by the caller. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_Move_Starts_The_Worker_Thread_And_Queues_The_Message_Itself)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
         mocks.ResetAllCalls();
 
-        time_t lastMessageReceiveTime;
-        time_t currentTime;
-        time(&currentTime);
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetLastMessageReceiveTime(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer(2, &currentTime, sizeof(currentTime));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetCurrentTime(TEST_IOTHUB_CLIENT_LL_HANDLE));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetLastMessageReceiveTime(iotHubClient, &lastMessageReceiveTime);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-        ASSERT_ARE_EQUAL(double, 0.0, difftime(currentTime, lastMessageReceiveTime));
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
+        mocks.ResetAllCalls();
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_DEVICEMESSAGE_HANDLE)); /*the message itself was queued*/
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
         IoTHubClient_Destroy(iotHubClient);
+        mocks.AssertActualAndExpectedCalls();
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_020: [If iotHubClientHandle is NULL, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_GetLastMessageReceiveTime_with_NULL_handle_fails)
+    /* Tests_SRS_IOTHUBCLIENT_02_057: [ IoTHubClient_SendEventAsync_Move shall start the worker thread if it was not previously started. If starting the thread fails, IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(When_Starting_The_Worker_Thread_Fails_Then_IoTHubClient_SendEventAsync_Move_Fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
-        time_t lastMessageReceiveTime;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .SetReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetLastMessageReceiveTime(NULL, &lastMessageReceiveTime);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_021: [Otherwise, IoTHubClient_GetLastMessageReceiveTime shall return the result of IoTHubClient_LL_GetLastMessageReceiveTime.] */
-    TEST_FUNCTION(IoTHubClient_GetLastMessageReceiveTime_Returns_The_Result_Of_the_underlayer)
+    /* Tests_SRS_IOTHUBCLIENT_02_071: [ If allocating the queued event, cloning the message or queuing it fails, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_072: [ IoTHubClient_SendEventAsync_Move shall queue eventMessageHandle itself, without cloning it. If queuing fails, eventMessageHandle stays owned by the caller. ]*/
+    TEST_FUNCTION(When_malloc_fails_then_IoTHubClient_SendEventAsync_Move_fails_and_leaves_the_message_to_the_caller)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        time_t lastMessageReceiveTime;
-        time_t currentTime;
-        time(&currentTime);
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetLastMessageReceiveTime(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        whenShallmalloc_fail = currentmalloc_call + 1;
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetLastMessageReceiveTime(iotHubClient, &lastMessageReceiveTime);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_SIZE);
-        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls(); /*no IoTHubMessage_Destroy*/
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_036: [If acquiring the lock fails, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR.] */
-    TEST_FUNCTION(When_Accquiring_The_Lock_Fails_Then_IoTHubClient_GetLastMessageReceiveTime_fails)
+    /* Tests_SRS_IOTHUBCLIENT_02_056: [ If acquiring the lock fails, IoTHubClient_SendEventAsync_Move shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(When_Acquiring_The_lock_fails_then_IoTHubClient_SendEventAsync_Move_fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
         mocks.ResetAllCalls();
 
-        time_t lastMessageReceiveTime;
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
             .SetReturn(LOCK_ERROR);
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetLastMessageReceiveTime(iotHubClient, &lastMessageReceiveTime);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
@@ -1351,24 +1420,23 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    TEST_FUNCTION(When_unlock_fails_IoTHubClient_GetLastMessageReceiveTime_still_succeeds)
+    /* Tests_SRS_IOTHUBCLIENT_02_069: [ Only if the worker thread has not been started yet, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall acquire the lock created in IoTHubClient_Create to start it. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_072: [ IoTHubClient_SendEventAsync_Move shall queue eventMessageHandle itself, without cloning it. If queuing fails, eventMessageHandle stays owned by the caller. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_Move_shared_transport_queues_the_event_without_calling_the_underlayer)
     {
         // arrange
         CIoTHubClientMocks mocks;
-        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
         mocks.ResetAllCalls();
 
-        time_t lastMessageReceiveTime;
-        time_t currentTime;
-        time(&currentTime);
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetLastMessageReceiveTime(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer(2, &currentTime, sizeof(currentTime));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_IOTHUBTRANSPORT_LOCK));
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_StartWorkerThread(TEST_IOTHUBTRANSPORT_HANDLE, iotHubClient));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_IOTHUBTRANSPORT_LOCK));
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetCurrentTime(TEST_IOTHUB_CLIENT_LL_HANDLE));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetLastMessageReceiveTime(iotHubClient, &lastMessageReceiveTime);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
@@ -1378,29 +1446,22 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* IoTHubClient_GetSendStatus */
-
-    /* Tests_SRS_IOTHUBCLIENT_01_022: [IoTHubClient_GetSendStatus shall call IoTHubClient_LL_GetSendStatus, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameter iotHubClientStatus.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_033: [IoTHubClient_GetSendStatus shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-    TEST_FUNCTION(IoTHubClient_GetSendStatus_Calls_The_Underslayer_With_Lock_On)
+    /* Tests_SRS_IOTHUBCLIENT_02_069: [ Only if the worker thread has not been started yet, IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall acquire the lock created in IoTHubClient_Create to start it. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_Move_shared_transport_does_not_take_the_transport_lock_once_registered)
     {
         // arrange
         CIoTHubClientMocks mocks;
-        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        IOTHUB_CLIENT_STATUS injectedSendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer(2, &injectedSendStatus, sizeof(injectedSendStatus));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetCurrentTime(TEST_IOTHUB_CLIENT_LL_HANDLE));
 
         // act
-        IOTHUB_CLIENT_STATUS sendStatus;
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x43);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, sendStatus, IOTHUB_CLIENT_SEND_STATUS_BUSY);
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
@@ -1408,323 +1469,1791 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_023: [If iotHubClientHandle is NULL, IoTHubClient_ GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_GetSendStatus_With_NULL_handle_fails)
+    /* IoTHubClient_SendQueuedEvents */
+
+    /* Tests_SRS_IOTHUBCLIENT_02_077: [ If iotHubClientHandle is NULL then IoTHubClient_SendQueuedEvents shall do nothing. ]*/
+    TEST_FUNCTION(IoTHubClient_SendQueuedEvents_with_NULL_handle_does_nothing)
     {
         // arrange
         CIoTHubClientMocks mocks;
 
         // act
-        IOTHUB_CLIENT_STATUS sendStatus;
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(NULL, &sendStatus);
+        IoTHubClient_SendQueuedEvents(NULL);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
         mocks.AssertActualAndExpectedCalls();
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_024: [Otherwise, IoTHubClient_GetSendStatus shall return the result of IoTHubClient_LL_GetSendStatus.] */
-    TEST_FUNCTION(IoTHubClient_GetSendStatus_Returns_The_Result_From_The_Underlayer)
+    /* Tests_SRS_IOTHUBCLIENT_02_078: [ Otherwise IoTHubClient_SendQueuedEvents shall take all the events queued for iotHubClientHandle and hand them over to IoTHubClient_LL the same way the worker thread does before calling IoTHubClient_LL_DoWork. ]*/
+    TEST_FUNCTION(IoTHubClient_SendQueuedEvents_hands_the_queued_events_over_in_order)
     {
         // arrange
         CIoTHubClientMocks mocks;
-        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x43);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
-            .IgnoreArgument(2)
-            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_MoveQueuedAt(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42, 1));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_MoveQueuedAt(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x43, 2));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
         // act
-        IOTHUB_CLIENT_STATUS sendStatus;
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+        IoTHubClient_SendQueuedEvents(iotHubClient);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_SIZE);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_034: [If acquiring the lock fails, IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_ERROR.] */
-    TEST_FUNCTION(When_acquiring_the_lock_fails_then_IoTHubClient_GetSendStatus_fails)
+    /* Tests_SRS_IOTHUBCLIENT_02_078: [ Otherwise IoTHubClient_SendQueuedEvents shall take all the events queued for iotHubClientHandle and hand them over to IoTHubClient_LL the same way the worker thread does before calling IoTHubClient_LL_DoWork. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_074: [ If IoTHubClient_LL_SendEventAsync_MoveQueuedAt fails then the thread shall call the event's eventConfirmationCallback (if any) with IOTHUB_CLIENT_CONFIRMATION_ERROR and destroy the event's message. ]*/
+    TEST_FUNCTION(IoTHubClient_SendQueuedEvents_reports_a_refused_event_through_its_callback_and_hands_over_the_next_one)
     {
         // arrange
         CIoTHubClientMocks mocks;
-        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x43);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_MoveQueuedAt(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42, 1))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_DEVICEMESSAGE_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_MoveQueuedAt(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x43, 2));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
         // act
-        IOTHUB_CLIENT_STATUS sendStatus;
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+        IoTHubClient_SendQueuedEvents(iotHubClient);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    TEST_FUNCTION(When_unlock_fails_then_IoTHubClient_GetSendStatus_still_succeeds)
+    /* IoTHubClient_RecordSendStatus */
+
+    /* Tests_SRS_IOTHUBCLIENT_02_107: [ If iotHubClientHandle is NULL then IoTHubClient_RecordSendStatus shall do nothing. ]*/
+    TEST_FUNCTION(IoTHubClient_RecordSendStatus_with_NULL_handle_does_nothing)
     {
         // arrange
         CIoTHubClientMocks mocks;
-        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+
+        // act
+        IoTHubClient_RecordSendStatus(NULL);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_108: [ Otherwise IoTHubClient_RecordSendStatus shall record the send status of iotHubClientHandle the same way the worker thread does after calling IoTHubClient_LL_DoWork. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_105: [ Otherwise, once the worker thread has been started, IoTHubClient_GetSendStatus shall set iotHubClientStatus to what the worker thread recorded after its last call to IoTHubClient_LL_DoWork (IOTHUB_CLIENT_SEND_STATUS_BUSY until then) and return IOTHUB_CLIENT_OK without acquiring the lock. ]*/
+    TEST_FUNCTION(IoTHubClient_RecordSendStatus_keeps_what_the_underlayer_reports_for_IoTHubClient_GetSendStatus)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        IoTHubClient_SendQueuedEvents(iotHubClient);
         mocks.ResetAllCalls();
 
-        IOTHUB_CLIENT_STATUS injectedSendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        IOTHUB_CLIENT_STATUS idleStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer(2, &injectedSendStatus, sizeof(injectedSendStatus));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
 
         // act
-        IOTHUB_CLIENT_STATUS sendStatus;
+        IoTHubClient_RecordSendStatus(iotHubClient);
+        IOTHUB_CLIENT_STATUS sendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
         IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
 
         // assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_IDLE, sendStatus);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Work scheduling */
-
-    /* Tests_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_Create shall call IoTHubClient_LL_DoWork every 1 ms.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_038: [The thread shall exit when IoTHubClient_Destroy is called.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
-    TEST_FUNCTION(Worker_Thread_calls_DoWork_Every_1_ms)
+    /* Tests_SRS_IOTHUBCLIENT_02_106: [ The thread shall keep what IoTHubClient_LL_GetSendStatus reported, taking a failure as IOTHUB_CLIENT_SEND_STATUS_BUSY, for IoTHubClient_GetSendStatus. ]*/
+    TEST_FUNCTION(When_the_underlayer_fails_IoTHubClient_RecordSendStatus_keeps_BUSY)
     {
         // arrange
         CIoTHubClientMocks mocks;
-        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        IoTHubClient_SendQueuedEvents(iotHubClient);
         mocks.ResetAllCalls();
 
-        howManyDoWorkCalls = 1;
-        current_iothub_client = iotHubClient;
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-        
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        IOTHUB_CLIENT_STATUS idleStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
 
         // act
-        threadFunc(threadFuncArg);
+        IoTHubClient_RecordSendStatus(iotHubClient);
+        IOTHUB_CLIENT_STATUS sendStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
 
         // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_BUSY, sendStatus);
         mocks.AssertActualAndExpectedCalls();
-        
-        ///cleanup
+
+        // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_Create shall call IoTHubClient_LL_DoWork every 1 ms.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_038: [The thread shall exit when IoTHubClient_Destroy is called.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
-    TEST_FUNCTION(Worker_Thread_calls_DoWork_Every_1_ms_2_times)
+    /* Tests_SRS_IOTHUBCLIENT_02_112: [ If after keeping IOTHUB_CLIENT_SEND_STATUS_IDLE the queue of events is not empty then the thread shall keep IOTHUB_CLIENT_SEND_STATUS_BUSY instead. ]*/
+    TEST_FUNCTION(When_an_event_is_queued_after_the_underlayer_reports_IDLE_IoTHubClient_RecordSendStatus_keeps_BUSY)
     {
         // arrange
         CIoTHubClientMocks mocks;
-        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        howManyDoWorkCalls = 2;
-        current_iothub_client = iotHubClient;
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        IOTHUB_CLIENT_STATUS idleStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
 
         // act
-        threadFunc(threadFuncArg);
+        IoTHubClient_RecordSendStatus(iotHubClient);
+        mocks.AssertActualAndExpectedCalls();
+        IoTHubClient_SendQueuedEvents(iotHubClient);
+        IOTHUB_CLIENT_STATUS sendStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
 
         // assert
-        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_BUSY, sendStatus);
 
-        ///cleanup
+        // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClient_LL_DoWork shall not be called.] */
-    TEST_FUNCTION(When_Acquiring_The_lock_fails_then_DoWork_Is_Not_called)
+    /* IoTHubClient_SetMessageCallback */
+
+    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_017: [IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_SetMessageCallback, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters messageCallback and userContextCallback.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_027: [IoTHubClient_SetMessageCallback shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+    TEST_FUNCTION(IoTHubClient_SetMessageCallback_starts_the_worker_thread_and_calls_the_underlayer)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        howManyDoWorkCalls = 1;
-        current_iothub_client = iotHubClient;
-
-        /* first round, when lock fails */
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
-
-        /* second round, when lock does not fail and DoWork gets called */
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         // act
-        threadFunc(threadFuncArg);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
 
         // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
+        // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* IoTHubClient_SetOption */
-
-    /*Tests_SRS_IOTHUBCLIENT_02_034: [If parameter iotHubClientHandle is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_handle_fails)
+    /* Tests_SRS_IOTHUBCLIENT_01_015: [If starting the thread fails, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
+    TEST_FUNCTION(When_Thread_API_Create_fails_then_IoTHubClient_SetMessageCallback_fails)
     {
-        /// arrange
+        // arrange
         CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
 
-        ///act
-        auto result = IoTHubClient_SetOption(NULL, "a", "b");
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .SetReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
-        ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
 
-        ///cleanup
-        
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
     }
 
-    /*Tests_SRS_IOTHUBCLIENT_02_035: [If parameter optionName is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_optionName_fails)
+    /* Tests_SRS_IOTHUBCLIENT_01_016: [If iotHubClientHandle is NULL, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetMessageCallback_with_NULL_handle_fails)
     {
-        /// arrange
+        // arrange
         CIoTHubClientMocks mocks;
 
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
-        mocks.ResetAllCalls();
-
-        ///act
-        auto result = IoTHubClient_SetOption(handle, NULL, "b");
-
-        ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
-        mocks.AssertActualAndExpectedCalls();
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(NULL, messageCallback, (void*)0x42);
 
-        ///cleanup
-        IoTHubClient_Destroy(handle);
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
     }
 
-    /*Tests_SRS_IOTHUBCLIENT_02_036: [If parameter value is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_value_fails)
+    /* Tests_SRS_IOTHUBCLIENT_01_018: [When IoTHubClient_LL_SetMessageCallback is called, IoTHubClient_SetMessageCallback shall return the result of IoTHubClient_LL_SetMessageCallback.] */
+    TEST_FUNCTION(IoTHubClient_SetMessageCallback_returns_the_result_of_calling_IoTHubClient_LL_SetMessageCallback)
     {
-        /// arrange
+        // arrange
         CIoTHubClientMocks mocks;
-
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
         mocks.ResetAllCalls();
 
-        ///act
-        auto result = IoTHubClient_SetOption(handle, "a", NULL);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
-        ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_SIZE);
         mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
-        IoTHubClient_Destroy(handle);
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
     }
 
-    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
-    /* Tests_SRS_IOTHUBCLIENT_01_041: [ IoTHubClient_SetOption shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
-    TEST_FUNCTION(IoTHubClient_SetOption_happy_path)
+    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
+    TEST_FUNCTION(When_the_worker_thread_was_started_by_a_SendEventAsync_A_Call_To_SetMessageCallback_Does_NOt_Start_A_New_Thread)
     {
-        /// arrange
+        // arrange
         CIoTHubClientMocks mocks;
-
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
-        ///act
-        auto result = IoTHubClient_SetOption(handle, "a", "b");
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
 
-        ///assert
+        // assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
-        IoTHubClient_Destroy(handle);
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
     }
 
-    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
-    TEST_FUNCTION(IoTHubClient_SetOption_fails_when_LL_fails)
+    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
+    TEST_FUNCTION(When_the_worker_thread_was_started_by_a_previous_SetMessageCallback_A_Call_To_SetMessageCallback_Does_Not_Start_A_New_Thread)
     {
-        /// arrange
+        // arrange
         CIoTHubClientMocks mocks;
-
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"))
-            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
-        ///act
-        auto result = IoTHubClient_SetOption(handle, "a", "b");
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
 
-        ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
-        ///cleanup
-        IoTHubClient_Destroy(handle);
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_042: [ If acquiring the lock fails, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(when_Lock_fails_IoTHubClient_SetOption_fails)
+    /* Tests_SRS_IOTHUBCLIENT_01_028: [If acquiring the lock fails, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
+    TEST_FUNCTION(When_Acquiring_The_Lock_Fails_Then_IoTHubClient_SetMessageCallback_Fails)
     {
-        /// arrange
+        // arrange
         CIoTHubClientMocks mocks;
-
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);;
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
             .SetReturn(LOCK_ERROR);
 
-        ///act
-        auto result = IoTHubClient_SetOption(handle, "a", "b");
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_GetLastMessageReceiveTime */
+
+    /* Tests_SRS_IOTHUBCLIENT_01_019: [IoTHubClient_GetLastMessageReceiveTime shall call IoTHubClient_LL_GetLastMessageReceiveTime, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameter lastMessageReceiveTime.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_035: [IoTHubClient_GetLastMessageReceiveTime shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+    TEST_FUNCTION(IoTHubClient_GetLastMessageReceiveTime_Calls_the_Underlayer)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        time_t lastMessageReceiveTime;
+        time_t currentTime;
+        time(&currentTime);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetLastMessageReceiveTime(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &currentTime, sizeof(currentTime));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetLastMessageReceiveTime(iotHubClient, &lastMessageReceiveTime);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(double, 0.0, difftime(currentTime, lastMessageReceiveTime));
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_020: [If iotHubClientHandle is NULL, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_GetLastMessageReceiveTime_with_NULL_handle_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        time_t lastMessageReceiveTime;
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetLastMessageReceiveTime(NULL, &lastMessageReceiveTime);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_021: [Otherwise, IoTHubClient_GetLastMessageReceiveTime shall return the result of IoTHubClient_LL_GetLastMessageReceiveTime.] */
+    TEST_FUNCTION(IoTHubClient_GetLastMessageReceiveTime_Returns_The_Result_Of_the_underlayer)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        time_t lastMessageReceiveTime;
+        time_t currentTime;
+        time(&currentTime);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetLastMessageReceiveTime(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetLastMessageReceiveTime(iotHubClient, &lastMessageReceiveTime);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_SIZE);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_036: [If acquiring the lock fails, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR.] */
+    TEST_FUNCTION(When_Accquiring_The_Lock_Fails_Then_IoTHubClient_GetLastMessageReceiveTime_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        time_t lastMessageReceiveTime;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetLastMessageReceiveTime(iotHubClient, &lastMessageReceiveTime);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    TEST_FUNCTION(When_unlock_fails_IoTHubClient_GetLastMessageReceiveTime_still_succeeds)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        time_t lastMessageReceiveTime;
+        time_t currentTime;
+        time(&currentTime);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetLastMessageReceiveTime(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &currentTime, sizeof(currentTime));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetLastMessageReceiveTime(iotHubClient, &lastMessageReceiveTime);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_GetSendStatus */
+
+    /* Tests_SRS_IOTHUBCLIENT_01_022: [IoTHubClient_GetSendStatus shall call IoTHubClient_LL_GetSendStatus, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameter iotHubClientStatus.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_033: [IoTHubClient_GetSendStatus shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+    TEST_FUNCTION(IoTHubClient_GetSendStatus_Calls_The_Underslayer_With_Lock_On)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS injectedSendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &injectedSendStatus, sizeof(injectedSendStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_STATUS sendStatus;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, sendStatus, IOTHUB_CLIENT_SEND_STATUS_BUSY);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_075: [ If there are events queued for the worker thread, IoTHubClient_GetSendStatus shall set iotHubClientStatus to IOTHUB_CLIENT_SEND_STATUS_BUSY and return IOTHUB_CLIENT_OK without acquiring the lock. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendStatus_reports_BUSY_while_events_are_queued)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        // act
+        IOTHUB_CLIENT_STATUS sendStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_BUSY, sendStatus);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_023: [If iotHubClientHandle is NULL, IoTHubClient_ GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_GetSendStatus_With_NULL_handle_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+
+        // act
+        IOTHUB_CLIENT_STATUS sendStatus;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(NULL, &sendStatus);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_024: [Otherwise, IoTHubClient_GetSendStatus shall return the result of IoTHubClient_LL_GetSendStatus.] */
+    TEST_FUNCTION(IoTHubClient_GetSendStatus_Returns_The_Result_From_The_Underlayer)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_STATUS sendStatus;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_SIZE);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_034: [If acquiring the lock fails, IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_ERROR.] */
+    TEST_FUNCTION(When_acquiring_the_lock_fails_then_IoTHubClient_GetSendStatus_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_STATUS sendStatus;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    TEST_FUNCTION(When_unlock_fails_then_IoTHubClient_GetSendStatus_still_succeeds)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS injectedSendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &injectedSendStatus, sizeof(injectedSendStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_STATUS sendStatus;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_105: [ Otherwise, once the worker thread has been started, IoTHubClient_GetSendStatus shall set iotHubClientStatus to what the worker thread recorded after its last call to IoTHubClient_LL_DoWork (IOTHUB_CLIENT_SEND_STATUS_BUSY until then) and return IOTHUB_CLIENT_OK without acquiring the lock. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendStatus_reports_BUSY_without_the_lock_until_the_worker_thread_called_DoWork)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        // act
+        IOTHUB_CLIENT_STATUS sendStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_BUSY, sendStatus);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_105: [ Otherwise, once the worker thread has been started, IoTHubClient_GetSendStatus shall set iotHubClientStatus to what the worker thread recorded after its last call to IoTHubClient_LL_DoWork (IOTHUB_CLIENT_SEND_STATUS_BUSY until then) and return IOTHUB_CLIENT_OK without acquiring the lock. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_106: [ The thread shall keep what IoTHubClient_LL_GetSendStatus reported, taking a failure as IOTHUB_CLIENT_SEND_STATUS_BUSY, for IoTHubClient_GetSendStatus. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendStatus_reports_what_the_worker_thread_recorded_without_the_lock)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_STATUS idleStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
+        threadFunc(threadFuncArg);
+        mocks.ResetAllCalls();
+
+        // act
+        IOTHUB_CLIENT_STATUS sendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_IDLE, sendStatus);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_109: [ After queuing the event IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall mark the client busy for IoTHubClient_GetSendStatus, so that until the event is sent it is seen either in the queue or in the busy mark. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendStatus_reports_BUSY_once_a_queued_event_was_handed_over_before_the_next_DoWork)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_STATUS idleStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
+        IoTHubClient_RecordSendStatus(iotHubClient);
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        IoTHubClient_SendQueuedEvents(iotHubClient);
+        mocks.ResetAllCalls();
+
+        // act
+        IOTHUB_CLIENT_STATUS sendStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStatus(iotHubClient, &sendStatus);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, IOTHUB_CLIENT_SEND_STATUS_BUSY, sendStatus);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_GetMessagePoolStats */
+
+    /* Tests_SRS_IOTHUBCLIENT_02_060: [ If iotHubClientHandle is NULL then IoTHubClient_GetMessagePoolStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_GetMessagePoolStats_With_NULL_handle_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        NODEPOOL_STATS stats;
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetMessagePoolStats(NULL, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_061: [ IoTHubClient_GetMessagePoolStats shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_063: [ Otherwise IoTHubClient_GetMessagePoolStats shall call IoTHubClient_LL_GetMessagePoolStats and return what IoTHubClient_LL_GetMessagePoolStats returns. ]*/
+    TEST_FUNCTION(IoTHubClient_GetMessagePoolStats_Calls_The_Underlayer_With_Lock_On)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        NODEPOOL_STATS stats;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetMessagePoolStats(TEST_IOTHUB_CLIENT_LL_HANDLE, &stats));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetMessagePoolStats(iotHubClient, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_063: [ Otherwise IoTHubClient_GetMessagePoolStats shall call IoTHubClient_LL_GetMessagePoolStats and return what IoTHubClient_LL_GetMessagePoolStats returns. ]*/
+    TEST_FUNCTION(IoTHubClient_GetMessagePoolStats_Returns_The_Result_From_The_Underlayer)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        NODEPOOL_STATS stats;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetMessagePoolStats(TEST_IOTHUB_CLIENT_LL_HANDLE, &stats))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetMessagePoolStats(iotHubClient, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_062: [ If acquiring the lock fails, IoTHubClient_GetMessagePoolStats shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(When_acquiring_the_lock_fails_then_IoTHubClient_GetMessagePoolStats_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        NODEPOOL_STATS stats;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetMessagePoolStats(iotHubClient, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_GetPriorityLaneStats */
+
+    /* Tests_SRS_IOTHUBCLIENT_02_081: [ If iotHubClientHandle is NULL then IoTHubClient_GetPriorityLaneStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_GetPriorityLaneStats_With_NULL_handle_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_PRIORITY_LANE_STATS stats;
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetPriorityLaneStats(NULL, IOTHUB_MESSAGE_PRIORITY_NORMAL, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_082: [ IoTHubClient_GetPriorityLaneStats shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_084: [ Otherwise IoTHubClient_GetPriorityLaneStats shall call IoTHubClient_LL_GetPriorityLaneStats and return what IoTHubClient_LL_GetPriorityLaneStats returns. ]*/
+    TEST_FUNCTION(IoTHubClient_GetPriorityLaneStats_Calls_The_Underlayer_With_Lock_On)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_PRIORITY_LANE_STATS stats;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetPriorityLaneStats(TEST_IOTHUB_CLIENT_LL_HANDLE, IOTHUB_MESSAGE_PRIORITY_HIGH, &stats));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetPriorityLaneStats(iotHubClient, IOTHUB_MESSAGE_PRIORITY_HIGH, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_084: [ Otherwise IoTHubClient_GetPriorityLaneStats shall call IoTHubClient_LL_GetPriorityLaneStats and return what IoTHubClient_LL_GetPriorityLaneStats returns. ]*/
+    TEST_FUNCTION(IoTHubClient_GetPriorityLaneStats_Returns_The_Result_From_The_Underlayer)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_PRIORITY_LANE_STATS stats;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetPriorityLaneStats(TEST_IOTHUB_CLIENT_LL_HANDLE, IOTHUB_MESSAGE_PRIORITY_HIGH, &stats))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetPriorityLaneStats(iotHubClient, IOTHUB_MESSAGE_PRIORITY_HIGH, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_083: [ If acquiring the lock fails, IoTHubClient_GetPriorityLaneStats shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(When_acquiring_the_lock_fails_then_IoTHubClient_GetPriorityLaneStats_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_PRIORITY_LANE_STATS stats;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetPriorityLaneStats(iotHubClient, IOTHUB_MESSAGE_PRIORITY_HIGH, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_GetSendStats */
+
+    /* Tests_SRS_IOTHUBCLIENT_02_085: [ If iotHubClientHandle is NULL then IoTHubClient_GetSendStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendStats_With_NULL_handle_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_SEND_STATS stats;
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStats(NULL, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_086: [ IoTHubClient_GetSendStats shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_088: [ Otherwise IoTHubClient_GetSendStats shall call IoTHubClient_LL_GetSendStats and return what IoTHubClient_LL_GetSendStats returns. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendStats_Calls_The_Underlayer_With_Lock_On)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_SEND_STATS stats;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStats(TEST_IOTHUB_CLIENT_LL_HANDLE, &stats));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStats(iotHubClient, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_088: [ Otherwise IoTHubClient_GetSendStats shall call IoTHubClient_LL_GetSendStats and return what IoTHubClient_LL_GetSendStats returns. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendStats_Returns_The_Result_From_The_Underlayer)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_SEND_STATS stats;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStats(TEST_IOTHUB_CLIENT_LL_HANDLE, &stats))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStats(iotHubClient, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_087: [ If acquiring the lock fails, IoTHubClient_GetSendStats shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(When_acquiring_the_lock_fails_then_IoTHubClient_GetSendStats_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_SEND_STATS stats;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendStats(iotHubClient, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_SendMessageDisposition */
+
+    /* Tests_SRS_IOTHUBCLIENT_02_064: [ If iotHubClientHandle is NULL then IoTHubClient_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_SendMessageDisposition_With_NULL_handle_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendMessageDisposition(NULL, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_ACCEPTED);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_065: [ IoTHubClient_SendMessageDisposition shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_067: [ Otherwise IoTHubClient_SendMessageDisposition shall call IoTHubClient_LL_SendMessageDisposition and return what IoTHubClient_LL_SendMessageDisposition returns. ]*/
+    TEST_FUNCTION(IoTHubClient_SendMessageDisposition_Calls_The_Underlayer_With_Lock_On)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendMessageDisposition(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_REJECTED))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendMessageDisposition(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_REJECTED);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_066: [ If acquiring the lock fails, IoTHubClient_SendMessageDisposition shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(When_acquiring_the_lock_fails_then_IoTHubClient_SendMessageDisposition_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendMessageDisposition(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_ACCEPTED);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Work scheduling */
+
+    /* Tests_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_Create shall call IoTHubClient_LL_DoWork every 1 ms.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_038: [The thread shall exit when IoTHubClient_Destroy is called.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
+    /* Tests_SRS_IOTHUBCLIENT_02_047: [ After calling IoTHubClient_LL_DoWork the thread shall call IoTHubClient_LL_GetSendStatus (under the same lock) to find out if there are events waiting to be sent. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_048: [ If IoTHubClient_LL_GetSendStatus fails or reports IOTHUB_CLIENT_SEND_STATUS_BUSY then the thread shall sleep 1 ms before calling IoTHubClient_LL_DoWork again. ]*/
+    TEST_FUNCTION(Worker_Thread_calls_DoWork_Every_1_ms)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS busyStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &busyStatus, sizeof(busyStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+        
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_Create shall call IoTHubClient_LL_DoWork every 1 ms.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_038: [The thread shall exit when IoTHubClient_Destroy is called.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
+    /* Tests_SRS_IOTHUBCLIENT_02_047: [ After calling IoTHubClient_LL_DoWork the thread shall call IoTHubClient_LL_GetSendStatus (under the same lock) to find out if there are events waiting to be sent. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_048: [ If IoTHubClient_LL_GetSendStatus fails or reports IOTHUB_CLIENT_SEND_STATUS_BUSY then the thread shall sleep 1 ms before calling IoTHubClient_LL_DoWork again. ]*/
+    TEST_FUNCTION(Worker_Thread_calls_DoWork_Every_1_ms_2_times)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS busyStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        howManyDoWorkCalls = 2;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &busyStatus, sizeof(busyStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &busyStatus, sizeof(busyStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_073: [ Before calling IoTHubClient_LL_DoWork the thread shall take all the queued events and call IoTHubClient_LL_SendEventAsync_MoveQueuedAt for each of them, with the time it was queued at, in the order they were queued, under the same lock. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_104: [ IoTHubClient_SendEventAsync and IoTHubClient_SendEventAsync_Move shall record the time the event is queued at by calling IoTHubClient_LL_GetCurrentTime, so that its "messageTimeout" starts when it is queued and not when the worker thread hands it over to IoTHubClient_LL. ]*/
+    TEST_FUNCTION(Worker_Thread_hands_the_queued_events_to_the_LL_layer_before_DoWork)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        (void)IoTHubClient_SendEventAsync_Move(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x43);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS busyStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_MoveQueuedAt(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42, 1));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_MoveQueuedAt(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x43, 2));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &busyStatus, sizeof(busyStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_074: [ If IoTHubClient_LL_SendEventAsync_MoveQueuedAt fails then the thread shall call the event's eventConfirmationCallback (if any) with IOTHUB_CLIENT_CONFIRMATION_ERROR and destroy the event's message. ]*/
+    TEST_FUNCTION(When_the_LL_layer_refuses_a_queued_event_the_worker_thread_reports_it_through_the_callback)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS busyStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_MoveQueuedAt(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42, 1))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &busyStatus, sizeof(busyStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_074: [ If IoTHubClient_LL_SendEventAsync_MoveQueuedAt fails then the thread shall call the event's eventConfirmationCallback (if any) with IOTHUB_CLIENT_CONFIRMATION_ERROR and destroy the event's message. ]*/
+    TEST_FUNCTION(When_the_LL_layer_refuses_a_queued_event_without_callback_the_worker_thread_destroys_its_message)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS busyStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_MoveQueuedAt(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, NULL, NULL, 1))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &busyStatus, sizeof(busyStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClient_LL_DoWork shall not be called.] */
+    TEST_FUNCTION(When_Acquiring_The_lock_fails_then_DoWork_Is_Not_called)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS busyStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+
+        /* first round, when lock fails */
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+
+        /* second round, when lock does not fail and DoWork gets called */
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &busyStatus, sizeof(busyStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_049: [ If IoTHubClient_LL_GetSendStatus reports IOTHUB_CLIENT_SEND_STATUS_IDLE then the thread shall double the time it sleeps, up to the value of the option "MaxIdleSleepTime". ]*/
+    TEST_FUNCTION(Worker_Thread_doubles_the_sleep_time_when_idle)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS idleStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        howManyDoWorkCalls = 3;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1))
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1))
+            .ExpectedTimesExactly(4);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        /*the thread is told to stop during the first 1 ms slice of its 8 ms sleep*/
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_049: [ If IoTHubClient_LL_GetSendStatus reports IOTHUB_CLIENT_SEND_STATUS_IDLE then the thread shall double the time it sleeps, up to the value of the option "MaxIdleSleepTime". ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_051: [ "MaxIdleSleepTime" - unsigned int, the maximum number of milliseconds the worker thread sleeps between calls to IoTHubClient_LL_DoWork when there is nothing to send. ]*/
+    TEST_FUNCTION(Worker_Thread_idle_sleep_time_does_not_exceed_MaxIdleSleepTime)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        unsigned int maxIdleSleepTime = 3;
+        (void)IoTHubClient_SetOption(iotHubClient, "MaxIdleSleepTime", &maxIdleSleepTime);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS idleStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        howManyDoWorkCalls = 2;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1))
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_115: [ The thread shall sleep in slices of 1 ms and stop sleeping as soon as an event is queued or the thread is told to stop. ]*/
+    TEST_FUNCTION(Worker_Thread_stops_sleeping_when_an_event_is_queued)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS idleStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        IOTHUB_CLIENT_STATUS busyStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+        howManyDoWorkCalls = 2;
+        current_iothub_client = iotHubClient;
+        sendEventOnSleep = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        /*the event is sent during the first 1 ms slice of a 2 ms sleep*/
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetCurrentTime(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync_MoveQueuedAt(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL, 1));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &busyStatus, sizeof(busyStatus));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_048: [ If IoTHubClient_LL_GetSendStatus fails or reports IOTHUB_CLIENT_SEND_STATUS_BUSY then the thread shall sleep 1 ms before calling IoTHubClient_LL_DoWork again. ]*/
+    TEST_FUNCTION(Worker_Thread_sleeps_1_ms_when_GetSendStatus_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_STATUS idleStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+        howManyDoWorkCalls = 1;
+        current_iothub_client = iotHubClient;
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &idleStatus, sizeof(idleStatus))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_SetOption */
+
+    /*Tests_SRS_IOTHUBCLIENT_02_034: [If parameter iotHubClientHandle is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_handle_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        ///act
+        auto result = IoTHubClient_SetOption(NULL, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+        ///cleanup
+        
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_035: [If parameter optionName is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_optionName_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, NULL, "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_036: [If parameter value is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_value_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
+    /* Tests_SRS_IOTHUBCLIENT_01_041: [ IoTHubClient_SetOption shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_happy_path)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_fails_when_LL_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_042: [ If acquiring the lock fails, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_Lock_fails_IoTHubClient_SetOption_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_037: [If optionName matches one of the option handled by IoTHubClient, then the pointer value shall be dereferenced (by convention) to the data type for that option and option specific code shall be executed.] */
+    /*Tests_SRS_IOTHUBCLIENT_02_051: [ "MaxIdleSleepTime" - unsigned int, the maximum number of milliseconds the worker thread sleeps between calls to IoTHubClient_LL_DoWork when there is nothing to send. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_110: [ IoTHubClient_SetOption shall set "MaxIdleSleepTime" without acquiring the lock; the threads use the new value from their next sleep. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_MaxIdleSleepTime_does_not_call_LL_SetOption)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        unsigned int maxIdleSleepTime = 100;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "MaxIdleSleepTime", &maxIdleSleepTime);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_052: [ If the value of "MaxIdleSleepTime" is 0 then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_MaxIdleSleepTime_0_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        unsigned int maxIdleSleepTime = 0;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "MaxIdleSleepTime", &maxIdleSleepTime);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_098: [ "MessageDispatchQueueSize" - size_t, the number of received messages that can wait for the dispatch thread. 0 (the default) makes the message callback run on the worker thread. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_100: [ If the value is not 0, IoTHubClient_SetOption shall first call IoTHubClient_LL_SetOption with "AsyncMessageDisposition" set to true, so that the dispatch thread can settle the messages with what the message callback returns; if that fails the dispatched messages shall be accepted when they are queued instead. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_MessageDispatchQueueSize_without_a_message_callback_only_sets_AsyncMessageDisposition)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(TEST_IOTHUB_CLIENT_LL_HANDLE, "AsyncMessageDisposition", IGNORED_PTR_ARG))
+            .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "MessageDispatchQueueSize", &queueSize);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_100: [ If the value is not 0, IoTHubClient_SetOption shall first call IoTHubClient_LL_SetOption with "AsyncMessageDisposition" set to true, so that the dispatch thread can settle the messages with what the message callback returns; if that fails the dispatched messages shall be accepted when they are queued instead. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_114: [ If IoTHubClient_LL did not accept "AsyncMessageDisposition", the received message shall not be kept with the clone and IOTHUBMESSAGE_ACCEPTED shall be returned instead of IOTHUBMESSAGE_ASYNC_ACK, so what the message callback returns is not sent to IoT Hub. ]*/
+    TEST_FUNCTION(When_the_transport_rejects_AsyncMessageDisposition_the_dispatch_callback_accepts_the_message_when_it_is_queued)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(TEST_IOTHUB_CLIENT_LL_HANDLE, "AsyncMessageDisposition", IGNORED_PTR_ARG))
+            .IgnoreArgument(3)
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)); /*worker thread*/
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)); /*dispatch thread*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, handle))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "MessageDispatchQueueSize", &queueSize);
+        (void)IoTHubClient_SetMessageCallback(handle, messageCallback, (void*)0x42);
+        IOTHUBMESSAGE_DISPOSITION_RESULT disposition = savedLLMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ACCEPTED, disposition);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_114: [ If IoTHubClient_LL did not accept "AsyncMessageDisposition", the received message shall not be kept with the clone and IOTHUBMESSAGE_ACCEPTED shall be returned instead of IOTHUBMESSAGE_ASYNC_ACK, so what the message callback returns is not sent to IoT Hub. ]*/
+    TEST_FUNCTION(The_dispatch_thread_does_not_settle_a_message_accepted_when_it_was_queued)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(TEST_IOTHUB_CLIENT_LL_HANDLE, "AsyncMessageDisposition", IGNORED_PTR_ARG))
+            .IgnoreArgument(3)
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        (void)IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &queueSize);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        (void)savedLLMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext);
+        mocks.ResetAllCalls();
+        howManyDoWorkCalls = 1; /*the first sleep of the dispatch thread stops it*/
+        doWorkCallCount = 1;
+
+        STRICT_EXPECTED_CALL(mocks, messageCallback(TEST_CLONED_MESSAGE_HANDLE, (void*)0x42))
+            .SetReturn(IOTHUBMESSAGE_ASYNC_ACK);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        (void)threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_089: [ When "MessageDispatchQueueSize" is not 0 and messageCallback is not NULL, IoTHubClient_SetMessageCallback shall start the dispatch thread if it was not previously started, and call IoTHubClient_LL_SetMessageCallback with a callback of its own that queues the received messages for the dispatch thread. ]*/
+    TEST_FUNCTION(IoTHubClient_SetMessageCallback_with_MessageDispatchQueueSize_starts_the_dispatch_thread)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &queueSize);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)); /*worker thread*/
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)); /*dispatch thread*/
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_IS_TRUE(savedLLMessageCallback != messageCallback);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)iotHubClient, savedLLMessageCallbackContext);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_099: [ If a message callback is set, IoTHubClient_SetOption shall register it again with IoTHubClient_LL the same way IoTHubClient_SetMessageCallback does, and restore the previous value of "MessageDispatchQueueSize" if that fails. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_113: [ Once "MessageDispatchQueueSize" is 0 again and no received message waits to be settled by the dispatch thread, IoTHubClient_LL_SetOption shall be called with "AsyncMessageDisposition" set to false. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_MessageDispatchQueueSize_registers_the_message_callback_again)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+        size_t noQueue = 0;
+        bool asyncMessageDispositionOff = false;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(handle, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(TEST_IOTHUB_CLIENT_LL_HANDLE, "AsyncMessageDisposition", IGNORED_PTR_ARG))
+            .IgnoreArgument(3);
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, handle))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(TEST_IOTHUB_CLIENT_LL_HANDLE, "AsyncMessageDisposition", IGNORED_PTR_ARG))
+            .ValidateArgumentBuffer(3, &asyncMessageDispositionOff, sizeof(asyncMessageDispositionOff));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result1 = IoTHubClient_SetOption(handle, "MessageDispatchQueueSize", &queueSize);
+        auto result2 = IoTHubClient_SetOption(handle, "MessageDispatchQueueSize", &noQueue);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result1);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result2);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_099: [ If a message callback is set, IoTHubClient_SetOption shall register it again with IoTHubClient_LL the same way IoTHubClient_SetMessageCallback does, and restore the previous value of "MessageDispatchQueueSize" if that fails. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_113: [ Once "MessageDispatchQueueSize" is 0 again and no received message waits to be settled by the dispatch thread, IoTHubClient_LL_SetOption shall be called with "AsyncMessageDisposition" set to false. ]*/
+    TEST_FUNCTION(When_starting_the_dispatch_thread_fails_IoTHubClient_SetOption_MessageDispatchQueueSize_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+        bool asyncMessageDispositionOff = false;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(handle, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(TEST_IOTHUB_CLIENT_LL_HANDLE, "AsyncMessageDisposition", IGNORED_PTR_ARG))
+            .IgnoreArgument(3);
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .SetReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(TEST_IOTHUB_CLIENT_LL_HANDLE, "AsyncMessageDisposition", IGNORED_PTR_ARG))
+            .ValidateArgumentBuffer(3, &asyncMessageDispositionOff, sizeof(asyncMessageDispositionOff));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "MessageDispatchQueueSize", &queueSize);
 
         ///assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
@@ -1734,5 +3263,272 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(handle);
     }
 
+    /*Tests_SRS_IOTHUBCLIENT_02_090: [ Otherwise a clone of the received message (obtained by calling IoTHubMessage_Clone) shall be queued for the dispatch thread together with the received message, the message callback and its context, and IOTHUBMESSAGE_ASYNC_ACK shall be returned, leaving the received message to be settled by the dispatch thread. ]*/
+    TEST_FUNCTION(The_dispatch_callback_queues_a_clone_of_the_message_and_leaves_it_unsettled)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &queueSize);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+
+        // act
+        IOTHUBMESSAGE_DISPOSITION_RESULT result = savedLLMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ASYNC_ACK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_091: [ When "MessageDispatchQueueSize" messages are waiting for the dispatch thread, receiving shall be paused by calling IoTHubClient_LL_SetMessageCallback with a NULL callback, leaving the next messages with IoT Hub until there is room again. ]*/
+    TEST_FUNCTION(The_dispatch_callback_pauses_receiving_when_the_dispatch_queue_is_full)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 2;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &queueSize);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        (void)savedLLMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, NULL, NULL));
+
+        // act
+        IOTHUBMESSAGE_DISPOSITION_RESULT result = savedLLMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ASYNC_ACK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_092: [ If allocating the queue record, cloning the message or queuing it fails, the received message shall be abandoned. ]*/
+    TEST_FUNCTION(When_IoTHubMessage_Clone_fails_the_dispatch_callback_abandons_the_message)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &queueSize);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE))
+            .SetReturn((IOTHUB_MESSAGE_HANDLE)NULL);
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        // act
+        IOTHUBMESSAGE_DISPOSITION_RESULT result = savedLLMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ABANDONED, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_093: [ The dispatch thread shall take all the queued messages and, in the order they were received, call the message callback with each of them without holding the lock, then destroy the message. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_094: [ After calling the message callback, the dispatch thread shall, under the lock, settle the received message by calling IoTHubClient_LL_SendMessageDisposition with what the callback returned and make room for one more message in the dispatch queue. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_095: [ The dispatch thread shall exit when IoTHubClient_Destroy is called. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_103: [ When receiving is paused and there is room in the dispatch queue again, the dispatch thread shall resume receiving by calling IoTHubClient_LL_SetMessageCallback with the callback that queues the messages for it. ]*/
+    TEST_FUNCTION(The_dispatch_thread_settles_the_message_with_what_the_callback_returns_and_resumes_receiving)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 1;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &queueSize);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC dispatchMessageCallback = savedLLMessageCallback;
+        (void)dispatchMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext); /*fills the dispatch queue*/
+        mocks.ResetAllCalls();
+        howManyDoWorkCalls = 1; /*the first sleep of the dispatch thread stops it*/
+        doWorkCallCount = 1;
+
+        STRICT_EXPECTED_CALL(mocks, messageCallback(TEST_CLONED_MESSAGE_HANDLE, (void*)0x42))
+            .SetReturn(IOTHUBMESSAGE_REJECTED);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendMessageDisposition(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_REJECTED));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, dispatchMessageCallback, iotHubClient));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        (void)threadFunc(threadFuncArg);
+
+        // assert
+        ASSERT_IS_TRUE(savedLLMessageCallback == dispatchMessageCallback);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_101: [ If the message callback returns IOTHUBMESSAGE_ASYNC_ACK the received message shall be abandoned, since the callback was only given a clone of it. ]*/
+    TEST_FUNCTION(The_dispatch_thread_abandons_the_message_when_the_callback_returns_ASYNC_ACK)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &queueSize);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        (void)savedLLMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext);
+        mocks.ResetAllCalls();
+        howManyDoWorkCalls = 1; /*the first sleep of the dispatch thread stops it*/
+        doWorkCallCount = 1;
+
+        STRICT_EXPECTED_CALL(mocks, messageCallback(TEST_CLONED_MESSAGE_HANDLE, (void*)0x42))
+            .SetReturn(IOTHUBMESSAGE_ASYNC_ACK);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendMessageDisposition(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_ABANDONED));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        (void)threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_113: [ Once "MessageDispatchQueueSize" is 0 again and no received message waits to be settled by the dispatch thread, IoTHubClient_LL_SetOption shall be called with "AsyncMessageDisposition" set to false. ]*/
+    TEST_FUNCTION(The_dispatch_thread_turns_AsyncMessageDisposition_off_after_settling_the_last_message_once_MessageDispatchQueueSize_is_0)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+        size_t noQueue = 0;
+        bool asyncMessageDispositionOff = false;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &queueSize);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        (void)savedLLMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext);
+        mocks.ResetAllCalls();
+        howManyDoWorkCalls = 1; /*the first sleep of the dispatch thread stops it*/
+        doWorkCallCount = 1;
+
+        /*the message waiting for the dispatch thread still has to be settled*/
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, messageCallback(TEST_CLONED_MESSAGE_HANDLE, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendMessageDisposition(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, IOTHUBMESSAGE_ACCEPTED));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(TEST_IOTHUB_CLIENT_LL_HANDLE, "AsyncMessageDisposition", IGNORED_PTR_ARG))
+            .ValidateArgumentBuffer(3, &asyncMessageDispositionOff, sizeof(asyncMessageDispositionOff));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &noQueue);
+        (void)threadFunc(threadFuncArg);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_102: [ Once IoTHubClient_Destroy has signalled the dispatch thread to end, the received messages shall not be settled anymore. ]*/
+    TEST_FUNCTION(The_dispatch_thread_does_not_settle_the_message_once_it_was_told_to_stop)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &queueSize);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        (void)savedLLMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext);
+        mocks.ResetAllCalls();
+        *(sig_atomic_t*)(((char*)iotHubClient) + IoTHubClient_ThreadTerminationOffset) = 1; /*what IoTHubClient_Destroy does under the lock*/
+
+        STRICT_EXPECTED_CALL(mocks, messageCallback(TEST_CLONED_MESSAGE_HANDLE, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        (void)threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_097: [ IoTHubClient_Destroy shall join the dispatch thread (if any) and then destroy the messages still waiting for it, without calling the message callback. ]*/
+    TEST_FUNCTION(IoTHubClient_Destroy_joins_the_dispatch_thread_and_destroys_the_messages_waiting_for_it)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        size_t queueSize = 4;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "MessageDispatchQueueSize", &queueSize);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        (void)savedLLMessageCallback(TEST_DEVICEMESSAGE_HANDLE, savedLLMessageCallbackContext);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG)) /*worker thread*/
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG)) /*dispatch thread*/
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        // act
+        IoTHubClient_Destroy(iotHubClient);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
 END_TEST_SUITE(iothubclient_unittests)
 
@@ -0,0 +1,334 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <cstdio>
+#include <ctime>
+
+#include "testrunnerswitcher.h"
+
+#include "iothub_client.h"
+#include "iothub_message.h"
+#include "iothub_transport_ll.h"
+#include "iothub_client_private.h"
+
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+/*how long an idle client is observed*/
+#define IDLE_MEASURE_TIME_MS 2000
+/*events sent one at a time to measure the send-to-wire latency, each after the worker thread had time to back off*/
+#define LATENCY_EVENT_COUNT 50
+#define LATENCY_EVENT_GAP_MS 50
+#define MAX_CONFIRMATION_WAIT_TIME_MS 5000
+
+/*the behaviour of the worker thread before it backed off is "MaxIdleSleepTime" = 1*/
+#define POLLING_MAX_IDLE_SLEEP_TIME 1
+#define DEFAULT_MAX_IDLE_SLEEP_TIME 16
+
+/*fake transport - counts the calls to DoWork, "sends" whatever is waiting and records when it first saw it*/
+typedef struct FAKE_TRANSPORT_TAG
+{
+    PDLIST_ENTRY waitingToSend;
+} FAKE_TRANSPORT;
+
+static TICK_COUNTER_HANDLE tickCounter;
+static LOCK_HANDLE statsLock;
+static size_t doWorkCallCount;
+static size_t confirmationCount;
+static uint64_t wireTime;
+
+static IOTHUB_CLIENT_RESULT FakeTransport_SetOption(TRANSPORT_LL_HANDLE handle, const char* optionName, const void* value)
+{
+    (void)handle;
+    (void)optionName;
+    (void)value;
+    return IOTHUB_CLIENT_INVALID_ARG;
+}
+
+static TRANSPORT_LL_HANDLE FakeTransport_Create(const IOTHUBTRANSPORT_CONFIG* config)
+{
+    FAKE_TRANSPORT* result = (FAKE_TRANSPORT*)malloc(sizeof(FAKE_TRANSPORT));
+    (void)config;
+    if (result != NULL)
+    {
+        result->waitingToSend = NULL;
+    }
+    return result;
+}
+
+static void FakeTransport_Destroy(TRANSPORT_LL_HANDLE handle)
+{
+    free(handle);
+}
+
+static IOTHUB_DEVICE_HANDLE FakeTransport_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, PDLIST_ENTRY waitingToSend)
+{
+    FAKE_TRANSPORT* transport = (FAKE_TRANSPORT*)handle;
+    (void)device;
+    (void)iotHubClientHandle;
+    transport->waitingToSend = waitingToSend;
+    return transport;
+}
+
+static void FakeTransport_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
+{
+    (void)deviceHandle;
+}
+
+static int FakeTransport_Subscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    return 0;
+}
+
+static void FakeTransport_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+}
+
+static void FakeTransport_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    FAKE_TRANSPORT* transport = (FAKE_TRANSPORT*)handle;
+    if (Lock(statsLock) == LOCK_OK)
+    {
+        doWorkCallCount++;
+        (void)Unlock(statsLock);
+    }
+
+    if ((transport->waitingToSend != NULL) && !DList_IsListEmpty(transport->waitingToSend))
+    {
+        DLIST_ENTRY completed;
+        uint64_t now;
+        DList_InitializeListHead(&completed);
+
+        (void)tickcounter_get_current_ms(tickCounter, &now);
+        if (Lock(statsLock) == LOCK_OK)
+        {
+            wireTime = now;
+            (void)Unlock(statsLock);
+        }
+
+        while (!DList_IsListEmpty(transport->waitingToSend))
+        {
+            PDLIST_ENTRY entry = transport->waitingToSend->Flink;
+            (void)DList_RemoveEntryList(entry);
+            DList_InsertTailList(&completed, entry);
+        }
+        IoTHubClient_LL_SendComplete(iotHubClientHandle, &completed, IOTHUB_BATCHSTATE_SUCCESS);
+    }
+}
+
+static IOTHUB_CLIENT_RESULT FakeTransport_GetSendStatus(IOTHUB_DEVICE_HANDLE handle, IOTHUB_CLIENT_STATUS* iotHubClientStatus)
+{
+    FAKE_TRANSPORT* transport = (FAKE_TRANSPORT*)handle;
+    *iotHubClientStatus = DList_IsListEmpty(transport->waitingToSend) ? IOTHUB_CLIENT_SEND_STATUS_IDLE : IOTHUB_CLIENT_SEND_STATUS_BUSY;
+    return IOTHUB_CLIENT_OK;
+}
+
+static IOTHUB_CLIENT_RESULT FakeTransport_SendMessageDisposition(IOTHUB_DEVICE_HANDLE handle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition)
+{
+    (void)handle;
+    (void)disposition;
+    IoTHubMessage_Destroy(message);
+    return IOTHUB_CLIENT_OK;
+}
+
+static TRANSPORT_PROVIDER fakeTransportProvider =
+{
+    FakeTransport_SetOption,
+    FakeTransport_Create,
+    FakeTransport_Destroy,
+    FakeTransport_Register,
+    FakeTransport_Unregister,
+    FakeTransport_Subscribe,
+    FakeTransport_Unsubscribe,
+    FakeTransport_DoWork,
+    FakeTransport_GetSendStatus,
+    FakeTransport_SendMessageDisposition
+};
+
+static const void* provideFakeTransport(void)
+{
+    return &fakeTransportProvider;
+}
+
+static const IOTHUB_CLIENT_CONFIG TEST_CONFIG =
+{
+    provideFakeTransport,   /* IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol;   */
+    "perfDevice",           /* const char* deviceId;                        */
+    "perfKey",              /* const char* deviceKey;                       */
+    NULL,                   /* const char* deviceSasToken;                  */
+    "perfHub",              /* const char* iotHubName;                      */
+    "perfSuffix",           /* const char* iotHubSuffix;                    */
+    NULL                    /* const char* protocolGatewayHostName;         */
+};
+
+typedef struct WORKER_MEASUREMENT_TAG
+{
+    size_t idleDoWorkCalls;
+    double idleCpuTimeMs;
+    uint64_t maxLatency;
+    uint64_t totalLatency;
+    size_t confirmed;
+} WORKER_MEASUREMENT;
+
+static void SendConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    (void)result;
+    (void)userContextCallback;
+    if (Lock(statsLock) == LOCK_OK)
+    {
+        confirmationCount++;
+        (void)Unlock(statsLock);
+    }
+}
+
+static size_t GetConfirmationCount(void)
+{
+    size_t result = 0;
+    if (Lock(statsLock) == LOCK_OK)
+    {
+        result = confirmationCount;
+        (void)Unlock(statsLock);
+    }
+    return result;
+}
+
+static size_t GetDoWorkCallCount(void)
+{
+    size_t result = 0;
+    if (Lock(statsLock) == LOCK_OK)
+    {
+        result = doWorkCallCount;
+        (void)Unlock(statsLock);
+    }
+    return result;
+}
+
+static uint64_t GetWireTime(void)
+{
+    uint64_t result = 0;
+    if (Lock(statsLock) == LOCK_OK)
+    {
+        result = wireTime;
+        (void)Unlock(statsLock);
+    }
+    return result;
+}
+
+static bool WaitForConfirmations(size_t expected)
+{
+    size_t i;
+    for (i = 0; (i < MAX_CONFIRMATION_WAIT_TIME_MS) && (GetConfirmationCount() < expected); i++)
+    {
+        ThreadAPI_Sleep(1);
+    }
+    return GetConfirmationCount() >= expected;
+}
+
+static void MeasureWorkerThread(unsigned int maxIdleSleepTime, WORKER_MEASUREMENT* measurement)
+{
+    IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+    size_t doWorkCallsBefore;
+    clock_t cpuBefore;
+    size_t i;
+    ASSERT_IS_NOT_NULL(iotHubClient);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OK, (int)IoTHubClient_SetOption(iotHubClient, "MaxIdleSleepTime", &maxIdleSleepTime));
+
+    confirmationCount = 0;
+    measurement->maxLatency = 0;
+    measurement->totalLatency = 0;
+
+    /*the first send starts the worker thread*/
+    {
+        IOTHUB_MESSAGE_HANDLE message = IoTHubMessage_CreateFromByteArray((const unsigned char*)"x", 1);
+        ASSERT_IS_NOT_NULL(message);
+        ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OK, (int)IoTHubClient_SendEventAsync(iotHubClient, message, SendConfirmationCallback, NULL));
+        IoTHubMessage_Destroy(message);
+        ASSERT_IS_TRUE(WaitForConfirmations(1));
+    }
+
+    /*idle: nothing is queued, count how often the worker thread wakes up and how much CPU the process uses*/
+    doWorkCallsBefore = GetDoWorkCallCount();
+    cpuBefore = clock();
+    ThreadAPI_Sleep(IDLE_MEASURE_TIME_MS);
+    measurement->idleCpuTimeMs = (double)(clock() - cpuBefore) * 1000 / CLOCKS_PER_SEC;
+    measurement->idleDoWorkCalls = GetDoWorkCallCount() - doWorkCallsBefore;
+
+    /*send-to-wire latency: every event is sent after the worker thread had time to back off*/
+    for (i = 0; i < LATENCY_EVENT_COUNT; i++)
+    {
+        IOTHUB_MESSAGE_HANDLE message = IoTHubMessage_CreateFromByteArray((const unsigned char*)"x", 1);
+        uint64_t sendTime;
+        uint64_t latency;
+        ASSERT_IS_NOT_NULL(message);
+
+        ThreadAPI_Sleep(LATENCY_EVENT_GAP_MS);
+        (void)tickcounter_get_current_ms(tickCounter, &sendTime);
+        ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OK, (int)IoTHubClient_SendEventAsync(iotHubClient, message, SendConfirmationCallback, NULL));
+        IoTHubMessage_Destroy(message);
+        ASSERT_IS_TRUE(WaitForConfirmations(i + 2));
+
+        latency = GetWireTime() - sendTime;
+        if (latency > measurement->maxLatency)
+        {
+            measurement->maxLatency = latency;
+        }
+        measurement->totalLatency += latency;
+    }
+    measurement->confirmed = GetConfirmationCount();
+
+    IoTHubClient_Destroy(iotHubClient);
+
+    (void)printf("MaxIdleSleepTime %u ms: %lu DoWork calls and %.1f ms CPU in %d ms idle, send-to-wire latency average %.2f ms, max %lu ms\r\n",
+        maxIdleSleepTime, (unsigned long)measurement->idleDoWorkCalls, measurement->idleCpuTimeMs, IDLE_MEASURE_TIME_MS,
+        (double)measurement->totalLatency / LATENCY_EVENT_COUNT, (unsigned long)measurement->maxLatency);
+}
+
+BEGIN_TEST_SUITE(iothubclient_worker_perftests)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        statsLock = Lock_Init();
+        ASSERT_IS_NOT_NULL(statsLock);
+        tickCounter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tickCounter);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        tickcounter_destroy(tickCounter);
+        (void)Lock_Deinit(statsLock);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        doWorkCallCount = 0;
+        confirmationCount = 0;
+        wireTime = 0;
+    }
+
+    /*reports how often an idle client calls DoWork and how long an event takes to reach the transport, with the default
+    "MaxIdleSleepTime" and with the 1 ms polling loop. The numbers depend on the timer resolution and the scheduler of the
+    machine running the test (clock() is wall clock time on Windows), so only the delivery of the events is asserted*/
+    TEST_FUNCTION(IoTHubClient_worker_thread_idle_wakeups_and_send_latency_against_1ms_polling)
+    {
+        // arrange
+        WORKER_MEASUREMENT polling;
+        WORKER_MEASUREMENT backingOff;
+
+        // act
+        MeasureWorkerThread(POLLING_MAX_IDLE_SLEEP_TIME, &polling);
+        MeasureWorkerThread(DEFAULT_MAX_IDLE_SLEEP_TIME, &backingOff);
+
+        // assert
+        ASSERT_ARE_EQUAL(size_t, LATENCY_EVENT_COUNT + 1, polling.confirmed);
+        ASSERT_ARE_EQUAL(size_t, LATENCY_EVENT_COUNT + 1, backingOff.confirmed);
+    }
+
+END_TEST_SUITE(iothubclient_worker_perftests)
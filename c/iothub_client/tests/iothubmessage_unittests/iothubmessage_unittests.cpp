@@ -386,6 +386,7 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubMessageMocks, , size_t, STRING_length, STRIN
 
 DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_RESULT_VALUES);
 DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
+DEFINE_MICROMOCK_ENUM_TO_STRING(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
 
 static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 
@@ -472,7 +473,9 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///arrange
         CIoTHubMessageMocks mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, BUFFER_create(c, 1));
@@ -498,7 +501,11 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///arrange
         CIoTHubMessageMocks mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -519,7 +526,9 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///arrange
         CIoTHubMessageMocks mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, BUFFER_create(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -543,7 +552,9 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///arrange
         CIoTHubMessageMocks mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, BUFFER_create(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
@@ -567,7 +578,11 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///arrange
         CIoTHubMessageMocks mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -596,7 +611,11 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///arrange
         CIoTHubMessageMocks mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -634,6 +653,31 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///cleanup
     }
 
+    /*Tests_SRS_IOTHUBMESSAGE_02_024: [If there are any errors then IoTHubMessage_CreateFromByteArray shall return NULL*/
+    TEST_FUNCTION(IoTHubMessage_CreateFromByteArray_fails_when_gballoc_fails_for_the_content)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        whenShallmalloc_fail = currentmalloc_call + 2;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
+            .IgnoreArgument(1);
+
+        ///act
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+
+        ///assert
+        ASSERT_IS_NULL(h);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
     /*Tests_SRS_IOTHUBMESSAGE_02_027: [IoTHubMessage_CreateFromString shall call STRING_construct passing source as parameter.] */
     /*Tests_SRS_IOTHUBMESSAGE_02_028: [IoTHubMessage_CreateFromString shall call Map_Create to create the message properties.] */
     /*Tests_SRS_IOTHUBMESSAGE_02_031: [Otherwise, IoTHubMessage_CreateFromString shall return a non-NULL handle.] */
@@ -644,7 +688,9 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///arrange
         CIoTHubMessageMocks mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, STRING_construct("a"));
@@ -670,7 +716,11 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///arrange
         CIoTHubMessageMocks mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -700,7 +750,11 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///arrange
         CIoTHubMessageMocks mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -738,6 +792,31 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         ///cleanup
     }
 
+    /*Tests_SRS_IOTHUBMESSAGE_02_029: [If there are any encountered in the execution of IoTHubMessage_CreateFromString then IoTHubMessage_CreateFromString shall return NULL.] */
+    TEST_FUNCTION(IoTHubMessage_CreateFromString_fails_when_gballoc_fails_for_the_content)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*message*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        whenShallmalloc_fail = currentmalloc_call + 2;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*content*/
+            .IgnoreArgument(1);
+
+        ///act
+        auto h = IoTHubMessage_CreateFromString("a");
+
+        ///assert
+        ASSERT_IS_NULL(h);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
     /*Tests_SRS_IOTHUBMESSAGE_01_004: [If iotHubMessageHandle is NULL, IoTHubMessage_Destroy shall do nothing.] */
     TEST_FUNCTION(IoTHubMessage_Destroy_With_NULL_handle_does_nothing)
     {
@@ -766,6 +845,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(h));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1); /*content*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
@@ -791,6 +871,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(h));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1); /*content*/
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
@@ -917,7 +998,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     }
 
     /*Tests_SRS_IOTHUBMESSAGE_03_001: [IoTHubMessage_Clone shall create a new IoT hub message with data content identical to that of the iotHubMessageHandle parameter.]*/
-    /*Tests_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall clone the content by a call to BUFFER_clone or STRING_clone] */
+    /*Tests_SRS_IOTHUBMESSAGE_02_034: [IoTHubMessage_Clone shall share the content of iotHubMessageHandle with the new message by incrementing the content's reference count, without copying the content.] */
     /*Tests_SRS_IOTHUBMESSAGE_02_005: [IoTHubMessage_Clone shall clone the properties map by using Map_Clone.] */
     /*Tests_SRS_IOTHUBMESSAGE_03_002: [IoTHubMessage_Clone shall return upon success a non-NULL handle to the newly created IoT hub message.]*/
     TEST_FUNCTION(IoTHubMessage_Clone_with_BYTE_ARRAY_happy_path) 
@@ -929,8 +1010,6 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Map_Clone(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -959,10 +1038,6 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, BUFFER_clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         whenShallMap_Clone_fail = currentMap_Clone_call + 1;
         STRICT_EXPECTED_CALL(mocks, Map_Clone(IGNORED_PTR_ARG))
@@ -979,35 +1054,6 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         IoTHubMessage_Destroy(h);
     }
 
-    /*Tests_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-    TEST_FUNCTION(IoTHubMessage_Clone_with_BYTE_ARRAY_fails_when_BUFFER_clone_fails)
-    {
-        ///arrange
-        CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
-        mocks.ResetAllCalls();
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        whenShallBUFFER_clone_fail = currentBUFFER_clone_call + 1;
-        STRICT_EXPECTED_CALL(mocks, BUFFER_clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        ///act
-        auto r = IoTHubMessage_Clone(h);
-
-        ///assert
-        ASSERT_IS_NULL(r);
-        mocks.AssertActualAndExpectedCalls();
-
-        ///cleanup
-        IoTHubMessage_Destroy(h);
-    }
-
-
     /*Tests_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
     TEST_FUNCTION(IoTHubMessage_Clone_with_BYTE_ARRAY_fails_when_gballoc_fails)
     {
@@ -1032,7 +1078,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     }
 
     /*Tests_SRS_IOTHUBMESSAGE_03_001: [IoTHubMessage_Clone shall create a new IoT hub message with data content identical to that of the iotHubMessageHandle parameter.]*/
-    /*Tests_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall clone the content by a call to BUFFER_clone or STRING_clone] */
+    /*Tests_SRS_IOTHUBMESSAGE_02_034: [IoTHubMessage_Clone shall share the content of iotHubMessageHandle with the new message by incrementing the content's reference count, without copying the content.] */
     /*Tests_SRS_IOTHUBMESSAGE_02_005: [IoTHubMessage_Clone shall clone the properties map by using Map_Clone.] */
     /*Tests_SRS_IOTHUBMESSAGE_03_002: [IoTHubMessage_Clone shall return upon success a non-NULL handle to the newly created IoT hub message.]*/
     TEST_FUNCTION(IoTHubMessage_Clone_with_STRING_happy_path)
@@ -1044,8 +1090,6 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Map_Clone(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -1074,10 +1118,6 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         whenShallMap_Clone_fail = currentMap_Clone_call + 1;
         STRICT_EXPECTED_CALL(mocks, Map_Clone(IGNORED_PTR_ARG))
@@ -1095,21 +1135,16 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     }
 
     /*Tests_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-    TEST_FUNCTION(IoTHubMessage_Clone_with_STRING_fails_when_STRING_clone_fails)
+    TEST_FUNCTION(IoTHubMessage_Clone_with_STRING_fails_when_gballoc_fails)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
         auto h = IoTHubMessage_CreateFromString("c, 1");
         mocks.ResetAllCalls();
 
+        whenShallmalloc_fail = currentmalloc_call + 1;
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        whenShallSTRING_clone_fail = currentSTRING_clone_call + 1;
-        STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 
         ///act
         auto r = IoTHubMessage_Clone(h);
@@ -1122,29 +1157,127 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         IoTHubMessage_Destroy(h);
     }
 
-    /*Tests_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-    TEST_FUNCTION(IoTHubMessage_Clone_with_STRING_fails_when_gballoc_fails)
+    /*Tests_SRS_IOTHUBMESSAGE_02_034: [IoTHubMessage_Clone shall share the content of iotHubMessageHandle with the new message by incrementing the content's reference count, without copying the content.] */
+    TEST_FUNCTION(IoTHubMessage_Clone_with_BYTE_ARRAY_shares_the_content)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        const unsigned char* sourceByteArray;
+        const unsigned char* cloneByteArray;
+        size_t sourceSize;
+        size_t cloneSize;
+
+        ///act
+        auto r = IoTHubMessage_Clone(h);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(r);
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, IoTHubMessage_GetByteArray(h, &sourceByteArray, &sourceSize));
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, IoTHubMessage_GetByteArray(r, &cloneByteArray, &cloneSize));
+        ASSERT_ARE_EQUAL(void_ptr, (void_ptr)sourceByteArray, (void_ptr)cloneByteArray);
+        ASSERT_ARE_EQUAL(size_t, sourceSize, cloneSize);
+
+        ///cleanup
+        IoTHubMessage_Destroy(r);
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_034: [IoTHubMessage_Clone shall share the content of iotHubMessageHandle with the new message by incrementing the content's reference count, without copying the content.] */
+    TEST_FUNCTION(IoTHubMessage_Clone_with_STRING_shares_the_content)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
         auto h = IoTHubMessage_CreateFromString("c, 1");
+
+        ///act
+        auto r = IoTHubMessage_Clone(h);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(r);
+        ASSERT_ARE_EQUAL(void_ptr, (void_ptr)IoTHubMessage_GetString(h), (void_ptr)IoTHubMessage_GetString(r));
+
+        ///cleanup
+        IoTHubMessage_Destroy(r);
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_037: [IoTHubMessage_Clone shall copy the priority of iotHubMessageHandle.] */
+    TEST_FUNCTION(IoTHubMessage_Clone_copies_the_priority)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        (void)IoTHubMessage_SetPriority(h, IOTHUB_MESSAGE_PRIORITY_HIGH);
+
+        ///act
+        auto r = IoTHubMessage_Clone(h);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(r);
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_HIGH, IoTHubMessage_GetPriority(r));
+
+        ///cleanup
+        IoTHubMessage_Destroy(r);
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_035: [IoTHubMessage_Destroy shall decrement the reference count of the message content and free the content only when no other message refers to it anymore.] */
+    TEST_FUNCTION(IoTHubMessage_Destroy_of_a_clone_keeps_the_shared_content)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        auto r = IoTHubMessage_Clone(h);
+        const unsigned char* byteArray;
+        size_t size;
         mocks.ResetAllCalls();
 
-        whenShallmalloc_fail = currentmalloc_call + 1;
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(r));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
         ///act
-        auto r = IoTHubMessage_Clone(h);
+        IoTHubMessage_Destroy(r);
 
         ///assert
-        ASSERT_IS_NULL(r);
         mocks.AssertActualAndExpectedCalls();
+        mocks.ResetAllCalls();
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, IoTHubMessage_GetByteArray(h, &byteArray, &size));
+        ASSERT_ARE_EQUAL(uint8_t, c[0], byteArray[0]);
 
         ///cleanup
         IoTHubMessage_Destroy(h);
     }
 
+    /*Tests_SRS_IOTHUBMESSAGE_02_035: [IoTHubMessage_Destroy shall decrement the reference count of the message content and free the content only when no other message refers to it anymore.] */
+    TEST_FUNCTION(IoTHubMessage_Destroy_of_the_last_message_frees_the_shared_content)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromString("c, 1");
+        auto r = IoTHubMessage_Clone(h);
+        IoTHubMessage_Destroy(h);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(r));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1); /*content*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        ///act
+        IoTHubMessage_Destroy(r);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
     /*Tests_SRS_IOTHUBMESSAGE_02_002: [Otherwise, for any non-NULL iotHubMessageHandle it shall return a non-NULL MAP_HANDLE.] */
     TEST_FUNCTION(IoTHubMessage_Properties_happy_path)
     {        
@@ -1527,4 +1660,111 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         IoTHubMessage_Destroy(h);
     }
 
+    /*Tests_SRS_IOTHUBMESSAGE_02_036: [The priority of the new message shall be IOTHUB_MESSAGE_PRIORITY_NORMAL.] */
+    TEST_FUNCTION(IoTHubMessage_CreateFromByteArray_sets_the_priority_to_NORMAL)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_MESSAGE_PRIORITY result = IoTHubMessage_GetPriority(h);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_NORMAL, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_036: [The priority of the new message shall be IOTHUB_MESSAGE_PRIORITY_NORMAL.] */
+    TEST_FUNCTION(IoTHubMessage_CreateFromString_sets_the_priority_to_NORMAL)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromString("c, 1");
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_MESSAGE_PRIORITY result = IoTHubMessage_GetPriority(h);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_NORMAL, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_038: [If iotHubMessageHandle is NULL then IoTHubMessage_GetPriority shall return IOTHUB_MESSAGE_PRIORITY_NORMAL.] */
+    TEST_FUNCTION(IoTHubMessage_GetPriority_with_NULL_handle_returns_NORMAL)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+
+        ///act
+        IOTHUB_MESSAGE_PRIORITY result = IoTHubMessage_GetPriority(NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_NORMAL, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_040: [If iotHubMessageHandle is NULL then IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubMessage_SetPriority_with_NULL_handle_fails)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+
+        ///act
+        IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(NULL, IOTHUB_MESSAGE_PRIORITY_HIGH);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_041: [If priority is not one of the values of IOTHUB_MESSAGE_PRIORITY then IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubMessage_SetPriority_with_unknown_priority_fails)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(h, (IOTHUB_MESSAGE_PRIORITY)(IOTHUB_MESSAGE_PRIORITY_HIGH + 1));
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_NORMAL, IoTHubMessage_GetPriority(h));
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_039: [Otherwise IoTHubMessage_GetPriority shall return the priority of the message.] */
+    /*Tests_SRS_IOTHUBMESSAGE_02_042: [Otherwise IoTHubMessage_SetPriority shall set the priority of the message and return IOTHUB_MESSAGE_OK.] */
+    TEST_FUNCTION(IoTHubMessage_SetPriority_succeeds)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        mocks.ResetAllCalls();
+
+        ///act
+        IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(h, IOTHUB_MESSAGE_PRIORITY_LOW);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_LOW, IoTHubMessage_GetPriority(h));
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
 END_TEST_SUITE(iothubmessage_unittests)
@@ -15,7 +15,7 @@
 
 #include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
-#include "azure_c_shared_utility/vector.h"
+#include "deviceregistry.h"
 
 
 #include "azure_c_shared_utility/string_tokenizer.h"
@@ -46,7 +46,7 @@ namespace BASEIMPLEMENTATION
 #undef Lock_Deinit
 
 #include "doublylinkedlist.c"
-#include "vector.c"
+#include "../../src/deviceregistry.c"
 
 };
 
@@ -239,6 +239,9 @@ public:
 		*iotHubClientStatus = currentIotHubClientStatus;
 	MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
 
+	MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, FAKE_IoTHubTransport_SendMessageDisposition, IOTHUB_DEVICE_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, message, IOTHUBMESSAGE_DISPOSITION_RESULT, disposition)
+	MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+
 		MOCK_STATIC_METHOD_2(, void, eventConfirmationCallback, IOTHUB_CLIENT_CONFIRMATION_RESULT, result2, void*, userContextCallback)
 		MOCK_VOID_METHOD_END()
 
@@ -282,45 +285,41 @@ public:
 		MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms);
 	MOCK_METHOD_END(int, 0)
 
-		// vector.h
-		MOCK_STATIC_METHOD_1(, VECTOR_HANDLE, VECTOR_create, size_t, elementSize)
-		VECTOR_HANDLE result2;
-	result2 = BASEIMPLEMENTATION::VECTOR_create(elementSize);
-	MOCK_METHOD_END(VECTOR_HANDLE, result2)
+		// deviceregistry.h
+		MOCK_STATIC_METHOD_0(, DEVICE_REGISTRY_HANDLE, DeviceRegistry_Create)
+		DEVICE_REGISTRY_HANDLE result2 = BASEIMPLEMENTATION::DeviceRegistry_Create();
+	MOCK_METHOD_END(DEVICE_REGISTRY_HANDLE, result2)
 
-		MOCK_STATIC_METHOD_1(, void, VECTOR_destroy, VECTOR_HANDLE, vector)
-		BASEIMPLEMENTATION::VECTOR_destroy(vector);
+		MOCK_STATIC_METHOD_1(, void, DeviceRegistry_Destroy, DEVICE_REGISTRY_HANDLE, registry)
+		BASEIMPLEMENTATION::DeviceRegistry_Destroy(registry);
 	MOCK_VOID_METHOD_END()
 
-		MOCK_STATIC_METHOD_3(, int, VECTOR_push_back, VECTOR_HANDLE, vector, const void*, elements, size_t, numElements)
-		int result2;
-	result2 = BASEIMPLEMENTATION::VECTOR_push_back(vector, elements, numElements);
+		MOCK_STATIC_METHOD_3(, int, DeviceRegistry_Add, DEVICE_REGISTRY_HANDLE, registry, const void*, device, const char*, deviceId)
+		int result2 = BASEIMPLEMENTATION::DeviceRegistry_Add(registry, device, deviceId);
 	MOCK_METHOD_END(int, result2)
 
-		MOCK_STATIC_METHOD_3(, void, VECTOR_erase, VECTOR_HANDLE, vector, void*, elements, size_t, numElements)
-		BASEIMPLEMENTATION::VECTOR_erase(vector, elements, numElements);
+		MOCK_STATIC_METHOD_2(, void, DeviceRegistry_Remove, DEVICE_REGISTRY_HANDLE, registry, const void*, device)
+		BASEIMPLEMENTATION::DeviceRegistry_Remove(registry, device);
 	MOCK_VOID_METHOD_END()
 
-		MOCK_STATIC_METHOD_2(, void*, VECTOR_element, VECTOR_HANDLE, vector, size_t, index)
-		void* result2 = BASEIMPLEMENTATION::VECTOR_element(vector, index);
-	MOCK_METHOD_END(void*, result2)
+		MOCK_STATIC_METHOD_2(, bool, DeviceRegistry_Contains, DEVICE_REGISTRY_HANDLE, registry, const void*, device)
+		bool result2 = BASEIMPLEMENTATION::DeviceRegistry_Contains(registry, device);
+	MOCK_METHOD_END(bool, result2)
 
-		MOCK_STATIC_METHOD_1(, void*, VECTOR_front, VECTOR_HANDLE, vector)
-		void* result2 = BASEIMPLEMENTATION::VECTOR_front(vector);
-	MOCK_METHOD_END(void*, result2)
+		MOCK_STATIC_METHOD_1(, size_t, DeviceRegistry_GetCount, DEVICE_REGISTRY_HANDLE, registry)
+		size_t result2 = BASEIMPLEMENTATION::DeviceRegistry_GetCount(registry);
+	MOCK_METHOD_END(size_t, result2)
 
-		MOCK_STATIC_METHOD_1(, void*, VECTOR_back, const VECTOR_HANDLE, vector)
-		void* result2 = BASEIMPLEMENTATION::VECTOR_back(vector);
-	MOCK_METHOD_END(void*, result2)
+		MOCK_STATIC_METHOD_3(, void, DeviceRegistry_ForEach, DEVICE_REGISTRY_HANDLE, registry, DEVICE_REGISTRY_VISITOR, visitor, void*, context)
+		BASEIMPLEMENTATION::DeviceRegistry_ForEach(registry, visitor, context);
+	MOCK_VOID_METHOD_END()
 
-		MOCK_STATIC_METHOD_3(, void*, VECTOR_find_if, VECTOR_HANDLE, vector, PREDICATE_FUNCTION, pred, const void*, value)
-		void* result2;
-	result2 = BASEIMPLEMENTATION::VECTOR_find_if(vector, pred, value);
-	MOCK_METHOD_END(void*, result2)
+		// iothub_client.h
+		MOCK_STATIC_METHOD_1(, void, IoTHubClient_SendQueuedEvents, IOTHUB_CLIENT_HANDLE, iotHubClientHandle)
+	MOCK_VOID_METHOD_END()
 
-		MOCK_STATIC_METHOD_1(, size_t, VECTOR_size, VECTOR_HANDLE, vector)
-		size_t result2 = BASEIMPLEMENTATION::VECTOR_size(vector);
-	MOCK_METHOD_END(size_t, result2)
+		MOCK_STATIC_METHOD_1(, void, IoTHubClient_RecordSendStatus, IOTHUB_CLIENT_HANDLE, iotHubClientHandle)
+	MOCK_VOID_METHOD_END()
 
 
 		/* ThreadAPI mocks */
@@ -372,6 +371,7 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , int, FAKE_IoTHubTransport_
 DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void, FAKE_IoTHubTransport_Unsubscribe, TRANSPORT_LL_HANDLE, handle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIotHubTransportMocks, , void, FAKE_IoTHubTransport_DoWork, TRANSPORT_LL_HANDLE, handle, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIotHubTransportMocks, , IOTHUB_CLIENT_RESULT, FAKE_IoTHubTransport_GetSendStatus, TRANSPORT_LL_HANDLE, handle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIotHubTransportMocks, , IOTHUB_CLIENT_RESULT, FAKE_IoTHubTransport_SendMessageDisposition, IOTHUB_DEVICE_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, message, IOTHUBMESSAGE_DISPOSITION_RESULT, disposition);
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CIotHubTransportMocks, , void, eventConfirmationCallback, IOTHUB_CLIENT_CONFIRMATION_RESULT, result2, void*, userContextCallback);
 
@@ -391,16 +391,16 @@ DECLARE_GLOBAL_MOCK_METHOD_0(CIotHubTransportMocks, ,TICK_COUNTER_HANDLE, tickco
 DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIotHubTransportMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms);
 
-//vector
-DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , VECTOR_HANDLE, VECTOR_create, size_t, elementSize);
-DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void, VECTOR_destroy, VECTOR_HANDLE, vector);
-DECLARE_GLOBAL_MOCK_METHOD_3(CIotHubTransportMocks, , int, VECTOR_push_back, VECTOR_HANDLE, vector, const void*, elements, size_t, numElements);
-DECLARE_GLOBAL_MOCK_METHOD_3(CIotHubTransportMocks, , void, VECTOR_erase, VECTOR_HANDLE, vector, void*, elements, size_t, numElements);
-DECLARE_GLOBAL_MOCK_METHOD_2(CIotHubTransportMocks, , void*, VECTOR_element, VECTOR_HANDLE, vector, size_t, index);
-DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void*, VECTOR_front, VECTOR_HANDLE, vector);
-DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void*, VECTOR_back, VECTOR_HANDLE, vector);
-DECLARE_GLOBAL_MOCK_METHOD_3(CIotHubTransportMocks, , void*, VECTOR_find_if, VECTOR_HANDLE, vector, PREDICATE_FUNCTION, pred, const void*, value);
-DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , size_t, VECTOR_size, VECTOR_HANDLE, vector);
+//deviceregistry
+DECLARE_GLOBAL_MOCK_METHOD_0(CIotHubTransportMocks, , DEVICE_REGISTRY_HANDLE, DeviceRegistry_Create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void, DeviceRegistry_Destroy, DEVICE_REGISTRY_HANDLE, registry);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIotHubTransportMocks, , int, DeviceRegistry_Add, DEVICE_REGISTRY_HANDLE, registry, const void*, device, const char*, deviceId);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIotHubTransportMocks, , void, DeviceRegistry_Remove, DEVICE_REGISTRY_HANDLE, registry, const void*, device);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIotHubTransportMocks, , bool, DeviceRegistry_Contains, DEVICE_REGISTRY_HANDLE, registry, const void*, device);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , size_t, DeviceRegistry_GetCount, DEVICE_REGISTRY_HANDLE, registry);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIotHubTransportMocks, , void, DeviceRegistry_ForEach, DEVICE_REGISTRY_HANDLE, registry, DEVICE_REGISTRY_VISITOR, visitor, void*, context);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void, IoTHubClient_SendQueuedEvents, IOTHUB_CLIENT_HANDLE, iotHubClientHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void, IoTHubClient_RecordSendStatus, IOTHUB_CLIENT_HANDLE, iotHubClientHandle);
 
 DECLARE_GLOBAL_MOCK_METHOD_3(CIotHubTransportMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIotHubTransportMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
@@ -423,7 +423,8 @@ static TRANSPORT_PROVIDER FAKE_transport_provider =
 	FAKE_IoTHubTransport_Subscribe,     /*pfIoTHubTransport_Subscribe IoTHubTransport_Subscribe;        */
 	FAKE_IoTHubTransport_Unsubscribe,   /*pfIoTHubTransport_Unsubscribe IoTHubTransport_Unsubscribe;    */
 	FAKE_IoTHubTransport_DoWork,        /*pfIoTHubTransport_DoWork IoTHubTransport_DoWork;              */
-	FAKE_IoTHubTransport_GetSendStatus  /*pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus; */
+	FAKE_IoTHubTransport_GetSendStatus, /*pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus; */
+	FAKE_IoTHubTransport_SendMessageDisposition /*pfIoTHubTransport_SendMessageDisposition IoTHubTransport_SendMessageDisposition; */
 };
 
 static const void* provideFAKE(void)
@@ -473,7 +474,7 @@ TEST_FUNCTION_CLEANUP(TestMethodCleanup)
 /*Tests_SRS_IOTHUBTRANSPORT_17_001: [ IoTHubTransport_Create shall return a non-NULL handle on success.] */
 /*Tests_SRS_IOTHUBTRANSPORT_17_005: [ IoTHubTransport_Create shall create the lower layer transport by calling the protocol's IoTHubTransport_Create function. ]*/
 /*Tests_SRS_IOTHUBTRANSPORT_17_007: [ IoTHubTransport_Create shall create the transport lock by Calling Lock_Init. */
-/*Tests_SRS_IOTHUBTRANSPORT_17_038: [ IoTHubTransport_Create shall call VECTOR_Create to make a list of IOTHUB_CLIENT_HANDLE using this transport. ]*/
+/*Tests_SRS_IOTHUBTRANSPORT_17_038: [ IoTHubTransport_Create shall call DeviceRegistry_Create to make a set of the IOTHUB_CLIENT_HANDLEs using this transport. ]*/
 //Tests_SRS_IOTHUBTRANSPORT_17_032: [ IoTHubTransport_Create shall allocate memory for the transport data. ]
 TEST_FUNCTION(IoTHubTransport_Create_success_returns_non_null)
 {
@@ -484,7 +485,7 @@ TEST_FUNCTION(IoTHubTransport_Create_success_returns_non_null)
 	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Create(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, Lock_Init());
-	STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(IOTHUB_CLIENT_HANDLE)));
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Create());
 
 	///act
 	auto result = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
@@ -500,8 +501,8 @@ TEST_FUNCTION(IoTHubTransport_Create_success_returns_non_null)
 }
 
 //Tests_SRS_IOTHUBTRANSPORT_17_009: [ IoTHubTransport_Create shall clean up any resources it creates if the function does not succeed. ]
-//Tests_SRS_IOTHUBTRANSPORT_17_039: [ If the Vector creation fails, IoTHubTransport_Create shall return NULL. ]
-TEST_FUNCTION(IoTHubTransport_Create_vector_create_fails_returns_null)
+//Tests_SRS_IOTHUBTRANSPORT_17_039: [ If DeviceRegistry_Create fails, IoTHubTransport_Create shall return NULL. ]
+TEST_FUNCTION(IoTHubTransport_Create_DeviceRegistry_Create_fails_returns_null)
 {
 	CIotHubTransportMocks mocks;
 	///arrange
@@ -516,8 +517,8 @@ TEST_FUNCTION(IoTHubTransport_Create_vector_create_fails_returns_null)
 	STRICT_EXPECTED_CALL(mocks, Lock_Init());
 	STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(IOTHUB_CLIENT_HANDLE)))
-		.SetFailReturn((VECTOR_HANDLE)NULL);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Create())
+		.SetFailReturn((DEVICE_REGISTRY_HANDLE)NULL);
 
 	///act
 	auto result = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
@@ -668,7 +669,7 @@ TEST_FUNCTION(IoTHubTransport_Destroy_success)
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -702,7 +703,7 @@ TEST_FUNCTION(IoTHubTransport_Destroy_success_thread_join_fails)
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -731,7 +732,7 @@ TEST_FUNCTION(IoTHubTransport_Destroy_success_lock_fails)
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -836,8 +837,307 @@ TEST_FUNCTION(IoTHubTransport_GetLLTransport_fail)
 	IoTHubTransport_Destroy(transportHandle);
 }
 
+//Tests_SRS_IOTHUBTRANSPORT_17_047: [ IoTHubTransport_Create shall behave as IoTHubTransport_CreateWithConnections with a NULL connectionsConfig. ]
+//Tests_SRS_IOTHUBTRANSPORT_17_048: [ If connectionsConfig is NULL, IoTHubTransport_CreateWithConnections shall create a single connection whose worker thread is not pinned to a CPU. ]
+TEST_FUNCTION(IoTHubTransport_CreateWithConnections_NULL_config_creates_a_single_worker)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Create(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, Lock_Init());
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Create());
+
+	///act
+	auto result = IoTHubTransport_CreateWithConnections(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix, NULL);
+
+	///assert
+	ASSERT_IS_NOT_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransport_Destroy(result);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_049: [ If connectionsConfig->connectionCount is 0 or greater than 64, IoTHubTransport_CreateWithConnections shall return NULL. ]
+TEST_FUNCTION(IoTHubTransport_CreateWithConnections_0_workers_returns_null)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+	IOTHUBTRANSPORT_CONNECTIONS_CONFIG connectionsConfig = { 0, NULL };
+
+	///act
+	auto result = IoTHubTransport_CreateWithConnections(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix, &connectionsConfig);
+
+	///assert
+	ASSERT_IS_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_049: [ If connectionsConfig->connectionCount is 0 or greater than 64, IoTHubTransport_CreateWithConnections shall return NULL. ]
+TEST_FUNCTION(IoTHubTransport_CreateWithConnections_65_workers_returns_null)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+	IOTHUBTRANSPORT_CONNECTIONS_CONFIG connectionsConfig = { 65, NULL };
+
+	///act
+	auto result = IoTHubTransport_CreateWithConnections(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix, &connectionsConfig);
+
+	///assert
+	ASSERT_IS_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_050: [ IoTHubTransport_CreateWithConnections shall create, for every connection, its own lower layer transport, its own lock and its own set of IOTHUB_CLIENT_HANDLEs, the same way IoTHubTransport_Create does for its single connection. ]
+TEST_FUNCTION(IoTHubTransport_CreateWithConnections_2_workers_success)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+	IOTHUBTRANSPORT_CONNECTIONS_CONFIG connectionsConfig = { 2, NULL };
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Create(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, Lock_Init())
+		.ExpectedTimesExactly(3); /*one per worker and the assign lock*/
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Create())
+		.ExpectedTimesExactly(4); /*clients and assigned clients of each worker*/
+
+	///act
+	auto result = IoTHubTransport_CreateWithConnections(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix, &connectionsConfig);
+
+	///assert
+	ASSERT_IS_NOT_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransport_Destroy(result);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_051: [ If any of the connections cannot be created, IoTHubTransport_CreateWithConnections shall return NULL. ]
+TEST_FUNCTION(IoTHubTransport_CreateWithConnections_lower_layer_create_fails_returns_null)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+	IOTHUBTRANSPORT_CONNECTIONS_CONFIG connectionsConfig = { 2, NULL };
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Create(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.SetFailReturn((void_ptr)NULL);
+
+	///act
+	auto result = IoTHubTransport_CreateWithConnections(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix, &connectionsConfig);
+
+	///assert
+	ASSERT_IS_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_055: [ If transportHandle or clientHandle is NULL, IoTHubTransport_GetClientLock shall return NULL. ]
+TEST_FUNCTION(IoTHubTransport_GetClientLock_NULL_transport_fails)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+
+	///act
+	LOCK_HANDLE lock = IoTHubTransport_GetClientLock(NULL, TEST_IOTHUB_CLIENT_HANDLE1);
+
+	///assert
+	ASSERT_IS_NULL(lock);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_055: [ If transportHandle or clientHandle is NULL, IoTHubTransport_GetClientLock shall return NULL. ]
+TEST_FUNCTION(IoTHubTransport_GetClientLock_NULL_client_fails)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+	auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+	mocks.ResetAllCalls();
+
+	///act
+	LOCK_HANDLE lock = IoTHubTransport_GetClientLock(transportHandle, NULL);
+
+	///assert
+	ASSERT_IS_NULL(lock);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_053: [ If the transport has a single worker, every client shall be pinned to it. ]
+//Tests_SRS_IOTHUBTRANSPORT_17_056: [ IoTHubTransport_GetClientLock shall return the lock of the worker clientHandle is pinned to, or NULL if the client cannot be pinned. ]
+TEST_FUNCTION(IoTHubTransport_GetClientLock_single_worker_returns_the_transport_lock)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+	auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+	mocks.ResetAllCalls();
+
+	///act
+	LOCK_HANDLE lock = IoTHubTransport_GetClientLock(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+
+	///assert
+	ASSERT_ARE_EQUAL(void_ptr, (void_ptr)IoTHubTransport_GetLock(transportHandle), (void_ptr)lock);
+	mocks.AssertActualAndExpectedCalls(); /*nothing to bookkeep*/
+
+	///cleanup
+	IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_054: [ A client that is not pinned to a worker yet shall be pinned to the worker that has the fewest clients pinned to it, by calling DeviceRegistry_Add. ]
+//Tests_SRS_IOTHUBTRANSPORT_17_061: [ IoTHubTransport_StartWorkerThread, IoTHubTransport_SignalEndWorkerThread and IoTHubTransport_JoinWorkerThread shall act on the worker clientHandle is pinned to. ]
+TEST_FUNCTION(IoTHubTransport_GetClientLock_pins_clients_to_different_workers)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+	IOTHUBTRANSPORT_CONNECTIONS_CONFIG connectionsConfig = { 2, NULL };
+	auto transportHandle = IoTHubTransport_CreateWithConnections(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix, &connectionsConfig);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Add(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1, NULL))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Add(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE2, NULL))
+		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.ExpectedAtLeastTimes(1);
+	EXPECTED_CALL(mocks, DeviceRegistry_GetCount(IGNORED_PTR_ARG))
+		.ExpectedAtLeastTimes(1);
+	EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+		.ExpectedAtLeastTimes(1);
+	EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+		.ExpectedAtLeastTimes(1);
+
+	///act
+	LOCK_HANDLE lock1 = IoTHubTransport_GetClientLock(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+	LOCK_HANDLE lock2 = IoTHubTransport_GetClientLock(transportHandle, TEST_IOTHUB_CLIENT_HANDLE2);
+	LOCK_HANDLE lock1Again = IoTHubTransport_GetClientLock(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+
+	///assert
+	ASSERT_IS_NOT_NULL(lock1);
+	ASSERT_IS_NOT_NULL(lock2);
+	ASSERT_IS_NOT_NULL(lock1Again);
+	mocks.AssertActualAndExpectedCalls();
+
+	/*each connection has its own worker thread*/
+	mocks.ResetAllCalls();
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Add(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1, NULL))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Add(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE2, NULL))
+		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.ExpectedAtLeastTimes(1);
+	EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+		.ExpectedAtLeastTimes(1);
+	EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+		.ExpectedAtLeastTimes(1);
+	ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OK, (int)IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1));
+	ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OK, (int)IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE2));
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	(void)IoTHubTransport_SignalEndWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+	(void)IoTHubTransport_SignalEndWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE2);
+	IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_057: [ If transportHandle or clientHandle is NULL, IoTHubTransport_GetClientLLTransport shall return NULL. ]
+TEST_FUNCTION(IoTHubTransport_GetClientLLTransport_NULL_transport_fails)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+
+	///act
+	TRANSPORT_LL_HANDLE llTransport = IoTHubTransport_GetClientLLTransport(NULL, TEST_IOTHUB_CLIENT_HANDLE1);
+
+	///assert
+	ASSERT_IS_NULL(llTransport);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_058: [ IoTHubTransport_GetClientLLTransport shall return the lower layer transport of the worker clientHandle is pinned to, or NULL if the client cannot be pinned. ]
+TEST_FUNCTION(IoTHubTransport_GetClientLLTransport_success)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+	auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+	mocks.ResetAllCalls();
+
+	///act
+	TRANSPORT_LL_HANDLE llTransport = IoTHubTransport_GetClientLLTransport(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+
+	///assert
+	ASSERT_ARE_EQUAL(void_ptr, (void_ptr)0x42, (void_ptr)llTransport);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_059: [ If transportHandle or clientHandle is NULL, IoTHubTransport_ReleaseClient shall do nothing. ]
+TEST_FUNCTION(IoTHubTransport_ReleaseClient_NULL_transport_does_nothing)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+
+	///act
+	IoTHubTransport_ReleaseClient(NULL, TEST_IOTHUB_CLIENT_HANDLE1);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_17_060: [ IoTHubTransport_ReleaseClient shall unpin clientHandle from its worker by calling DeviceRegistry_Remove. ]
+TEST_FUNCTION(IoTHubTransport_ReleaseClient_unpins_the_client)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+	IOTHUBTRANSPORT_CONNECTIONS_CONFIG connectionsConfig = { 2, NULL };
+	auto transportHandle = IoTHubTransport_CreateWithConnections(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix, &connectionsConfig);
+	(void)IoTHubTransport_GetClientLock(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
+		.IgnoreArgument(1)
+		.ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+	///act
+	IoTHubTransport_ReleaseClient(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransport_Destroy(transportHandle);
+}
+
 //Tests_SRS_IOTHUBTRANSPORT_17_018: [ If the worker thread does not exist, IoTHubTransport_StartWorkerThread shall start the thread using ThreadAPI_Create. ]
-//Tests_SRS_IOTHUBTRANSPORT_17_021: [ If handle is not found, then clientHandle shall be added to the list. ]
+//Tests_SRS_IOTHUBTRANSPORT_17_021: [ If handle is not found, then clientHandle shall be added to the set by calling DeviceRegistry_Add. ]
 //Tests_SRS_IOTHUBTRANSPORT_17_022: [ Upon success, IoTHubTransport_StartWorkerThread shall return IOTHUB_CLIENT_OK.]
 TEST_FUNCTION(IoTHubTransport_StartWorkerThread_success)
 {
@@ -847,14 +1147,12 @@ TEST_FUNCTION(IoTHubTransport_StartWorkerThread_success)
 	auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, transportHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Add(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1, NULL))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
 	///act
 
 	IOTHUB_CLIENT_RESULT result = IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
@@ -877,11 +1175,8 @@ TEST_FUNCTION(IoTHubTransport_StartWorkerThread_same_client_twice_success)
 
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
 
 	///act
 
@@ -895,7 +1190,7 @@ TEST_FUNCTION(IoTHubTransport_StartWorkerThread_same_client_twice_success)
 	IoTHubTransport_Destroy(transportHandle);
 }
 
-//Tests_SRS_IOTHUBTRANSPORT_17_020: [ IoTHubTransport_StartWorkerThread shall search for IoTHubClient clientHandle in the list of IoTHubClient handles. ]
+//Tests_SRS_IOTHUBTRANSPORT_17_020: [ IoTHubTransport_StartWorkerThread shall search for IoTHubClient clientHandle in the set of IoTHubClient handles by calling DeviceRegistry_Contains. ]
 //Tests_SRS_IOTHUBTRANSPORT_17_022: [ Upon success, IoTHubTransport_StartWorkerThread shall return IOTHUB_CLIENT_OK.]
 TEST_FUNCTION(IoTHubTransport_StartWorkerThread_two_client_success)
 {
@@ -907,14 +1202,10 @@ TEST_FUNCTION(IoTHubTransport_StartWorkerThread_two_client_success)
 
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE2))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Add(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE2, NULL))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE2))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
 	///act
 
 	IOTHUB_CLIENT_RESULT result = IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE2);
@@ -973,9 +1264,8 @@ TEST_FUNCTION(IoTHubTransport_StartWorkerThread_thread_create_fails_returns_erro
 	auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, transportHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
 		.SetFailReturn(THREADAPI_ERROR);
 	///act
 
@@ -990,7 +1280,7 @@ TEST_FUNCTION(IoTHubTransport_StartWorkerThread_thread_create_fails_returns_erro
 }
 
 //Tests_SRS_IOTHUBTRANSPORT_17_042: [ If Adding to the client list fails, IoTHubTransport_StartWorkerThread shall return IOTHUB_CLIENT_ERROR. ]
-TEST_FUNCTION(IoTHubTransport_StartWorkerThread_Vector_push_back_returns_error)
+TEST_FUNCTION(IoTHubTransport_StartWorkerThread_DeviceRegistry_Add_returns_error)
 {
 	CIotHubTransportMocks mocks;
 	///arrange
@@ -998,14 +1288,12 @@ TEST_FUNCTION(IoTHubTransport_StartWorkerThread_Vector_push_back_returns_error)
 	auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, transportHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Add(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1, NULL))
 		.IgnoreArgument(1)
-		.IgnoreArgument(2)
 		.SetFailReturn(42);
 	///act
 
@@ -1020,7 +1308,7 @@ TEST_FUNCTION(IoTHubTransport_StartWorkerThread_Vector_push_back_returns_error)
 }
 
 
-//Tests_SRS_IOTHUBTRANSPORT_17_026: [ IoTHubTransport_SignalEndWorkerThread shall remove clientHandlehandle from handle list. ]
+//Tests_SRS_IOTHUBTRANSPORT_17_026: [ IoTHubTransport_SignalEndWorkerThread shall remove clientHandlehandle from handle set by calling DeviceRegistry_Remove. ]
 //Tests_SRS_IOTHUBTRANSPORT_17_028: [ The thread shall exit when IoTHubTransport_SignalEndWorkerThread has been called for each clientHandle which invoked IoTHubTransport_StartWorkerThread. ]
 //Tests_SRS_IOTHUBTRANSPORT_17_043: [ IoTHubTransport_SignalEndWorkerThread shall signal the worker thread to end. ]
 TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_success)
@@ -1032,13 +1320,9 @@ TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_success)
 	IOTHUB_CLIENT_RESULT result = IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_GetCount(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
 	///act
@@ -1052,7 +1336,7 @@ TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_success)
 	IoTHubTransport_Destroy(transportHandle);
 }
 
-//Tests_SRS_IOTHUBTRANSPORT_17_026: [ IoTHubTransport_SignalEndWorkerThread shall remove clientHandlehandle from handle list. ]
+//Tests_SRS_IOTHUBTRANSPORT_17_026: [ IoTHubTransport_SignalEndWorkerThread shall remove clientHandlehandle from handle set by calling DeviceRegistry_Remove. ]
 TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_2_client_success)
 {
 	CIotHubTransportMocks mocks;
@@ -1064,13 +1348,9 @@ TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_2_client_success)
 
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_GetCount(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
 	///act
@@ -1124,9 +1404,8 @@ TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_end_thread_client_not_found)
 	auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE1))
+		.IgnoreArgument(1);
 
 	///act
 	auto rv = IoTHubTransport_SignalEndWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
@@ -1148,10 +1427,9 @@ TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_end_thread_client_not_found2
 	IOTHUB_CLIENT_RESULT result = IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE2))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_HANDLE2))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_GetCount(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
 	///act
@@ -1235,6 +1513,8 @@ TEST_FUNCTION(IoTHubTransport_JoinWorkerThread_join_fails)
 
 //Tests_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]
 //Tests_SRS_IOTHUBTRANSPORT_17_030: [ All calls to lower layer transport DoWork shall be protected by the lock created in IoTHubTransport_Create. ]
+//Tests_SRS_IOTHUBTRANSPORT_17_046: [ Before calling lower layer transport DoWork, the thread shall call IoTHubClient_SendQueuedEvents for every IoTHubClient handle in the set, by calling DeviceRegistry_ForEach. ]
+//Tests_SRS_IOTHUBTRANSPORT_17_062: [ After calling lower layer transport DoWork, the thread shall call IoTHubClient_RecordSendStatus for every IoTHubClient handle in the set, by calling DeviceRegistry_ForEach. ]
 TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
 {
 	CIotHubTransportMocks mocks;
@@ -1248,12 +1528,28 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
 	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
 	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_ForEach(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendQueuedEvents(TEST_IOTHUB_CLIENT_HANDLE1));
 	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_ForEach(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_RecordSendStatus(TEST_IOTHUB_CLIENT_HANDLE1));
 	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
 
 	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
 	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_ForEach(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendQueuedEvents(TEST_IOTHUB_CLIENT_HANDLE1));
 	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_ForEach(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_RecordSendStatus(TEST_IOTHUB_CLIENT_HANDLE1));
 	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
 
 	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
@@ -1274,6 +1570,8 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
 
 //Tests_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]
 //Tests_SRS_IOTHUBTRANSPORT_17_030: [ All calls to lower layer transport DoWork shall be protected by the lock created in IoTHubTransport_Create. 
+//Tests_SRS_IOTHUBTRANSPORT_17_046: [ Before calling lower layer transport DoWork, the thread shall call IoTHubClient_SendQueuedEvents for every IoTHubClient handle in the set, by calling DeviceRegistry_ForEach. ]
+//Tests_SRS_IOTHUBTRANSPORT_17_062: [ After calling lower layer transport DoWork, the thread shall call IoTHubClient_RecordSendStatus for every IoTHubClient handle in the set, by calling DeviceRegistry_ForEach. ]
 TEST_FUNCTION(IoTHubTransport_worker_thread_runs_two_devices_once)
 {
 	CIotHubTransportMocks mocks;
@@ -1288,7 +1586,17 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_two_devices_once)
 	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
 	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_ForEach(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendQueuedEvents(TEST_IOTHUB_CLIENT_HANDLE1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendQueuedEvents(TEST_IOTHUB_CLIENT_HANDLE2));
 	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_ForEach(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_RecordSendStatus(TEST_IOTHUB_CLIENT_HANDLE1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_RecordSendStatus(TEST_IOTHUB_CLIENT_HANDLE2));
 
 	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
 
@@ -1325,7 +1633,17 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_lock_fails)
 	/* DoWork needs to run at least once, so, the number of calls to DoWork increments. */
 	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
 	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_ForEach(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendQueuedEvents(TEST_IOTHUB_CLIENT_HANDLE1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_SendQueuedEvents(TEST_IOTHUB_CLIENT_HANDLE2));
 	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_ForEach(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_RecordSendStatus(TEST_IOTHUB_CLIENT_HANDLE1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_RecordSendStatus(TEST_IOTHUB_CLIENT_HANDLE2));
 	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
 
 	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
@@ -32,6 +32,9 @@ static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 
 #include "iothubtransportamqp.h"
 #include "iothub_client_private.h"
+#include "nodepool.h"
+#include "amqpeventencoder.h"
+#include "deviceregistry.h"
 #include "iothub_message.h"
 
 #include "azure_uamqp_c/amqpvalue.h"
@@ -92,6 +95,7 @@ namespace BASEIMPLEMENTATION
 #include "buffer.c"
 #include "strings.c"
 #include "../adapters/agenttime.c"
+#include "../../src/deviceregistry.c"
 };
 
 DEFINE_ENUM(MESSAGERECEIVER_CREATION_ACTION, MESSAGERECEIVER_CREATE, MESSAGERECEIVER_DESTROY, MESSAGERECEIVER_NONE)
@@ -129,9 +133,20 @@ std::ostream& operator<<(std::ostream& left, const BINARY_DATA bindata)
     return left << "struct BINARY_DATA = ([length=" << bindata.length << " bytes] " << bindata.bytes << ")";
 }
 
+static bool operator==(amqp_binary left, amqp_binary right)
+{
+    return (left.length == right.length) && ((left.length == 0) || (memcmp(left.bytes, right.bytes, left.length) == 0));
+}
+
+std::ostream& operator<<(std::ostream& left, const amqp_binary bindata)
+{
+    return left << "amqp_binary = ([length=" << bindata.length << " bytes] " << bindata.bytes << ")";
+}
+
 
 // Control parameters
 #define TEST_DEVICE_ID "deviceid"
+#define TEST_DEVICE_ID_2 "deviceid2"
 #define TEST_DEVICE_KEY "devicekey"
 #define TEST_DEVICE_SAS "deviceSas"
 #define TEST_IOT_HUB_NAME "servername"
@@ -192,6 +207,9 @@ std::ostream& operator<<(std::ostream& left, const BINARY_DATA bindata)
 #define TEST_MESSAGE_HANDLE (MESSAGE_HANDLE)0x440
 #define TEST_MAP_HANDLE (MAP_HANDLE)0x448
 #define TEST_AMQP_MAP_VALUE (AMQP_VALUE)0x449
+#define TEST_AMQPEVENTENCODER_HANDLE (AMQPEVENTENCODER_HANDLE)0x450
+#define TEST_AMQP_ENCODED_SIZE 10
+#define TEST_AMQP_BATCHING_FORMAT_CODE 0x80013700
 
 
 static const char* const no_property_keys[] = { "test_property_key" };
@@ -220,11 +238,18 @@ static bool fail_STRING_new = false;
 static bool fail_STRING_new_with_memory = false;
 static bool fail_STRING_construct = false;
 
+static size_t currentDeviceRegistry_Create_call;
+static size_t whenShallDeviceRegistry_Create_fail;
+static size_t currentDeviceRegistry_Add_call;
+static size_t whenShallDeviceRegistry_Add_fail;
+
 static STRING_HANDLE test_STRING_HANDLE_EMPTY;
 static STRING_HANDLE test_iotHubHostFqdn;
 
 static ON_MESSAGE_RECEIVED saved_on_message_received_callback;
 static const void* saved_on_message_received_context;
+static ON_MESSAGE_SEND_COMPLETE saved_on_message_send_complete_callback;
+static void* saved_on_message_send_complete_context;
 static BINARY_DATA* saved_message_get_body_amqp_data_binary_data;
 static PROPERTIES_HANDLE* saved_message_get_properties_properties;
 static AMQP_VALUE* saved_properties_get_message_id_value;
@@ -357,6 +382,10 @@ public:
         BASEIMPLEMENTATION::DList_InsertTailList(listHead, listEntry);
     MOCK_VOID_METHOD_END()
 
+    MOCK_STATIC_METHOD_2(, void, DList_InsertHeadList, PDLIST_ENTRY, listHead, PDLIST_ENTRY, listEntry)
+        BASEIMPLEMENTATION::DList_InsertHeadList(listHead, listEntry);
+    MOCK_VOID_METHOD_END()
+
     MOCK_STATIC_METHOD_2(, void, DList_AppendTailList, PDLIST_ENTRY, listHead, PDLIST_ENTRY, ListToAppend)
         BASEIMPLEMENTATION::DList_AppendTailList(listHead, ListToAppend);
     MOCK_VOID_METHOD_END()
@@ -455,6 +484,10 @@ public:
         BASEIMPLEMENTATION::gballoc_free(ptr);
     MOCK_VOID_METHOD_END()
 
+    MOCK_STATIC_METHOD_1(, void, NodePool_Free, void*, node)
+        BASEIMPLEMENTATION::gballoc_free(node);
+    MOCK_VOID_METHOD_END()
+
     MOCK_STATIC_METHOD_2(, IOTHUBMESSAGE_DISPOSITION_RESULT, IoTHubClient_LL_MessageCallback, IOTHUB_CLIENT_LL_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, messageHandle)
     MOCK_METHOD_END(IOTHUBMESSAGE_DISPOSITION_RESULT, IOTHUBMESSAGE_ACCEPTED);
 
@@ -462,13 +495,57 @@ public:
         PDLIST_ENTRY oldest;
         while ((oldest = BASEIMPLEMENTATION::DList_RemoveHeadList(completedMessages)) != completedMessages)
         {
-            ;
+            BASEIMPLEMENTATION::gballoc_free(containingRecord(oldest, IOTHUB_MESSAGE_LIST, entry));
         }
     MOCK_VOID_METHOD_END();
 
+    MOCK_STATIC_METHOD_4(, void, IoTHubClient_LL_SendStarted, IOTHUB_CLIENT_LL_HANDLE, handle, IOTHUB_MESSAGE_LIST*, first, size_t, count, size_t, size)
+    MOCK_VOID_METHOD_END();
+
     MOCK_STATIC_METHOD_1(, time_t, get_time, time_t*, t)
     MOCK_METHOD_END(time_t, 0);
 
+    // deviceregistry.h
+    MOCK_STATIC_METHOD_0(, DEVICE_REGISTRY_HANDLE, DeviceRegistry_Create)
+        DEVICE_REGISTRY_HANDLE result2;
+        ++currentDeviceRegistry_Create_call;
+        if ((whenShallDeviceRegistry_Create_fail > 0) &&
+            (currentDeviceRegistry_Create_call == whenShallDeviceRegistry_Create_fail))
+        {
+            result2 = NULL;
+        }
+        else
+        {
+            result2 = BASEIMPLEMENTATION::DeviceRegistry_Create();
+        }
+    MOCK_METHOD_END(DEVICE_REGISTRY_HANDLE, result2)
+
+    MOCK_STATIC_METHOD_1(, void, DeviceRegistry_Destroy, DEVICE_REGISTRY_HANDLE, registry)
+        BASEIMPLEMENTATION::DeviceRegistry_Destroy(registry);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_3(, int, DeviceRegistry_Add, DEVICE_REGISTRY_HANDLE, registry, const void*, device, const char*, deviceId)
+        int result2;
+        ++currentDeviceRegistry_Add_call;
+        if ((whenShallDeviceRegistry_Add_fail > 0) &&
+            (currentDeviceRegistry_Add_call == whenShallDeviceRegistry_Add_fail))
+        {
+            result2 = __LINE__;
+        }
+        else
+        {
+            result2 = BASEIMPLEMENTATION::DeviceRegistry_Add(registry, device, deviceId);
+        }
+    MOCK_METHOD_END(int, result2)
+
+    MOCK_STATIC_METHOD_2(, void, DeviceRegistry_Remove, DEVICE_REGISTRY_HANDLE, registry, const void*, device)
+        BASEIMPLEMENTATION::DeviceRegistry_Remove(registry, device);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_2(, const void*, DeviceRegistry_FindById, DEVICE_REGISTRY_HANDLE, registry, const char*, deviceId)
+        const void* result2 = BASEIMPLEMENTATION::DeviceRegistry_FindById(registry, deviceId);
+    MOCK_METHOD_END(const void*, result2)
+
     MOCK_STATIC_METHOD_4(, STRING_HANDLE, SASToken_Create, STRING_HANDLE, key, STRING_HANDLE, scope, STRING_HANDLE, keyName, size_t, expiry)
         test_latest_SASToken_expiry_time = expiry;
     MOCK_METHOD_END(STRING_HANDLE, BASEIMPLEMENTATION::STRING_construct(TEST_SAS_TOKEN));
@@ -640,6 +717,20 @@ public:
     MOCK_STATIC_METHOD_1(, void, message_destroy, MESSAGE_HANDLE, message)
     MOCK_VOID_METHOD_END()
 
+    MOCK_STATIC_METHOD_2(, int, message_set_message_format, MESSAGE_HANDLE, message, uint32_t, message_format)
+    MOCK_METHOD_END(int, 0)
+
+    MOCK_STATIC_METHOD_0(, AMQPEVENTENCODER_HANDLE, AmqpEventEncoder_Create)
+    MOCK_METHOD_END(AMQPEVENTENCODER_HANDLE, TEST_AMQPEVENTENCODER_HANDLE)
+
+    MOCK_STATIC_METHOD_1(, void, AmqpEventEncoder_Destroy, AMQPEVENTENCODER_HANDLE, encoder)
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_4(, AMQPEVENTENCODER_RESULT, AmqpEventEncoder_Encode, AMQPEVENTENCODER_HANDLE, encoder, IOTHUB_MESSAGE_HANDLE, message, const unsigned char**, encoded, size_t*, size)
+        *encoded = (const unsigned char*)TEST_RANDOM_CHAR_SEQ;
+        *size = TEST_AMQP_ENCODED_SIZE;
+    MOCK_METHOD_END(AMQPEVENTENCODER_RESULT, AMQPEVENTENCODER_OK)
+
     MOCK_STATIC_METHOD_3(, int, message_get_body_amqp_data, MESSAGE_HANDLE, message, size_t, index, BINARY_DATA*, binary_data)
 		saved_message_get_body_amqp_data_binary_data = binary_data;
     MOCK_METHOD_END(int, 0)
@@ -678,6 +769,8 @@ public:
     MOCK_METHOD_END(int, 0)
 
     MOCK_STATIC_METHOD_4(, int, messagesender_send, MESSAGE_SENDER_HANDLE, message_sender, MESSAGE_HANDLE, message, ON_MESSAGE_SEND_COMPLETE, on_message_send_complete, void*, callback_context)
+        saved_on_message_send_complete_callback = on_message_send_complete;
+        saved_on_message_send_complete_context = callback_context;
     MOCK_METHOD_END(int, 0)
 
     // messaging.h
@@ -803,6 +896,7 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , const char*, IoTHubMes
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , void, DList_InitializeListHead, PDLIST_ENTRY, listHead);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , int, DList_IsListEmpty, PDLIST_ENTRY, listHead);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , void, DList_InsertTailList, PDLIST_ENTRY, listHead, PDLIST_ENTRY, listEntry);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , void, DList_InsertHeadList, PDLIST_ENTRY, listHead, PDLIST_ENTRY, listEntry);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , void, DList_AppendTailList, PDLIST_ENTRY, listHead, PDLIST_ENTRY, ListToAppend);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , int, DList_RemoveEntryList, PDLIST_ENTRY, listEntry);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , PDLIST_ENTRY, DList_RemoveHeadList, PDLIST_ENTRY, listHead);
@@ -831,15 +925,23 @@ DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportAMQPMocks, , int, size_tToString, c
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , void*, gballoc_malloc, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , void*, gballoc_realloc, void*, ptr, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , void, gballoc_free, void*, ptr);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , void, NodePool_Free, void*, node);
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , IOTHUBMESSAGE_DISPOSITION_RESULT, IoTHubClient_LL_MessageCallback, IOTHUB_CLIENT_LL_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, messageHandle);
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportAMQPMocks, , void, IoTHubClient_LL_SendComplete, IOTHUB_CLIENT_LL_HANDLE, handle, PDLIST_ENTRY, completedMessages, IOTHUB_BATCHSTATE_RESULT, batchResult);
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportAMQPMocks, , void, IoTHubClient_LL_SendStarted, IOTHUB_CLIENT_LL_HANDLE, handle, IOTHUB_MESSAGE_LIST*, first, size_t, count, size_t, size);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , time_t, get_time, time_t*, t)
 DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportAMQPMocks, , STRING_HANDLE, SASToken_Create, STRING_HANDLE, key, STRING_HANDLE, scope, STRING_HANDLE, keyName, size_t, expiry)
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , int, mallocAndStrcpy_s, char**, destination, const char*, source);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportAMQPMocks, , DEVICE_REGISTRY_HANDLE, DeviceRegistry_Create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , void, DeviceRegistry_Destroy, DEVICE_REGISTRY_HANDLE, registry);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportAMQPMocks, , int, DeviceRegistry_Add, DEVICE_REGISTRY_HANDLE, registry, const void*, device, const char*, deviceId);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , void, DeviceRegistry_Remove, DEVICE_REGISTRY_HANDLE, registry, const void*, device);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , const void*, DeviceRegistry_FindById, DEVICE_REGISTRY_HANDLE, registry, const char*, deviceId);
+
 // map.h
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportAMQPMocks, , MAP_RESULT, Map_AddOrUpdate, MAP_HANDLE, handle, const char*, key, const char*, value);
 DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportAMQPMocks, , MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count);
@@ -922,6 +1024,10 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , int, link_set_attach_p
 
 // message.h
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , int, message_add_body_amqp_data, MESSAGE_HANDLE, message, BINARY_DATA, binary_data);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , int, message_set_message_format, MESSAGE_HANDLE, message, uint32_t, message_format);
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportAMQPMocks, , AMQPEVENTENCODER_HANDLE, AmqpEventEncoder_Create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , void, AmqpEventEncoder_Destroy, AMQPEVENTENCODER_HANDLE, encoder);
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportAMQPMocks, , AMQPEVENTENCODER_RESULT, AmqpEventEncoder_Encode, AMQPEVENTENCODER_HANDLE, encoder, IOTHUB_MESSAGE_HANDLE, message, const unsigned char**, encoded, size_t*, size);
 DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportAMQPMocks, , MESSAGE_HANDLE, message_create);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , void, message_destroy, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportAMQPMocks, , int, message_get_body_amqp_data, MESSAGE_HANDLE, message, size_t, index, BINARY_DATA*, binary_data);
@@ -990,11 +1096,19 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , void, test_iothubclien
 
 #define STEP_CREATE_LIST_INIT 0
 #define STEP_CREATE_IOTHUB_FQDN 1
-#define STEP_CREATE_DEVICES_PATH 2
-#define STEP_CREATE_TARGET_ADDRESS 3
-#define STEP_CREATE_RECEIVE_ADDRESS 4
-#define STEP_CREATE_SASTOKEN_KEYNAME 5
-#define STEP_CREATE_DEVICEKEY 6
+#define STEP_CREATE_SASTOKEN_KEYNAME 2
+#define STEP_CREATE_DEVICE_REGISTRY 3
+
+#define STEP_REGISTER_DEVICES_PATH 0
+#define STEP_REGISTER_FIND_BY_ID 1
+#define STEP_REGISTER_STATE_ALLOC 2
+#define STEP_REGISTER_TARGET_ADDRESS 3
+#define STEP_REGISTER_RECEIVE_ADDRESS 4
+#define STEP_REGISTER_SENDER_LINK_NAME 5
+#define STEP_REGISTER_RECEIVER_LINK_NAME 6
+#define STEP_REGISTER_DEVICEKEY 7
+#define STEP_REGISTER_REGISTRY_ADD 8
+#define STEP_REGISTER_ADD_TO_LIST 9
 
 #define STEP_DOWORK_GET_TLS_IO 0
 #define STEP_DOWORK_CREATE_SASLMECHANISM 1
@@ -1040,6 +1154,7 @@ static void addTestEvents(PDLIST_ENTRY waitingToSend, int numberOfEvents, bool s
         else
         {
             iml->messageHandle = TEST_IOTHUB_MESSAGE_HANDLE;
+            iml->owner = TEST_IOTHUB_CLIENT_LL_HANDLE;
 
             if (setCallback)
             {
@@ -1061,6 +1176,7 @@ static void setExpectedCallsForTransportCreateUpTo(CIoTHubTransportAMQPMocks& mo
         {
             STRICT_EXPECTED_CALL(mocks, gballoc_malloc(0)).IgnoreArgument(1);
             STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(0)).IgnoreAllArguments();
+            STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(0)).IgnoreAllArguments();
         }
         else if (step == STEP_CREATE_IOTHUB_FQDN)
         {
@@ -1068,35 +1184,13 @@ static void setExpectedCallsForTransportCreateUpTo(CIoTHubTransportAMQPMocks& mo
             EXPECTED_CALL(mocks, STRING_construct(0));
             EXPECTED_CALL(mocks, gballoc_free(0));
         }
-        else if (step == STEP_CREATE_DEVICES_PATH)
-        {
-            EXPECTED_CALL(mocks, STRING_c_str(0));
-            EXPECTED_CALL(mocks, gballoc_malloc(0));
-            EXPECTED_CALL(mocks, STRING_construct(0));
-            EXPECTED_CALL(mocks, gballoc_free(0));
-        }
-        else if (step == STEP_CREATE_TARGET_ADDRESS)
-        {
-            EXPECTED_CALL(mocks, STRING_c_str(0));
-            EXPECTED_CALL(mocks, gballoc_malloc(0));
-            EXPECTED_CALL(mocks, STRING_construct(0));
-            EXPECTED_CALL(mocks, gballoc_free(0));
-        }
-        else if (step == STEP_CREATE_RECEIVE_ADDRESS)
-        {
-            EXPECTED_CALL(mocks, STRING_c_str(0));
-            EXPECTED_CALL(mocks, gballoc_malloc(0));
-            EXPECTED_CALL(mocks, STRING_construct(0));
-            EXPECTED_CALL(mocks, gballoc_free(0));
-        }
         else if (step == STEP_CREATE_SASTOKEN_KEYNAME)
         {
             STRICT_EXPECTED_CALL(mocks, STRING_new());
         }
-        else if (step == STEP_CREATE_DEVICEKEY)
+        else if (step == STEP_CREATE_DEVICE_REGISTRY)
         {
-            STRICT_EXPECTED_CALL(mocks, STRING_new());
-            STRICT_EXPECTED_CALL(mocks, STRING_copy(0, config->upperConfig->deviceKey)).IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Create());
         }
     }
 }
@@ -1114,29 +1208,92 @@ static void setExpectedCleanupCallsForTransportCreateUpTo(CIoTHubTransportAMQPMo
         {
             EXPECTED_CALL(mocks, STRING_delete(0));
         }
-        else if (step == STEP_CREATE_DEVICES_PATH)
+        else if (step == STEP_CREATE_SASTOKEN_KEYNAME)
         {
             EXPECTED_CALL(mocks, STRING_delete(0));
         }
-        else if (step == STEP_CREATE_TARGET_ADDRESS)
+    }
+}
+
+static void setExpectedCallsForTransportRegisterUpTo(CIoTHubTransportAMQPMocks& mocks, const IOTHUB_DEVICE_CONFIG* device, int maximumStepToSet)
+{
+    int step;
+    for (step = 0; step <= maximumStepToSet; step++)
+    {
+        if (step == STEP_REGISTER_DEVICES_PATH)
+        {
+            EXPECTED_CALL(mocks, STRING_c_str(0));
+            EXPECTED_CALL(mocks, gballoc_malloc(0));
+            EXPECTED_CALL(mocks, STRING_construct(0));
+            EXPECTED_CALL(mocks, gballoc_free(0));
+        }
+        else if (step == STEP_REGISTER_FIND_BY_ID)
         {
-            EXPECTED_CALL(mocks, STRING_delete(0));
+            STRICT_EXPECTED_CALL(mocks, DeviceRegistry_FindById(IGNORED_PTR_ARG, device->deviceId)).IgnoreArgument(1);
         }
-        else if (step == STEP_CREATE_RECEIVE_ADDRESS)
+        else if (step == STEP_REGISTER_STATE_ALLOC)
         {
-            EXPECTED_CALL(mocks, STRING_delete(0));
+            EXPECTED_CALL(mocks, gballoc_malloc(0));
         }
-        else if (step == STEP_CREATE_SASTOKEN_KEYNAME)
+        else if (step == STEP_REGISTER_TARGET_ADDRESS || step == STEP_REGISTER_RECEIVE_ADDRESS)
         {
-            EXPECTED_CALL(mocks, STRING_delete(0));
+            EXPECTED_CALL(mocks, STRING_c_str(0));
+            EXPECTED_CALL(mocks, gballoc_malloc(0));
+            EXPECTED_CALL(mocks, STRING_construct(0));
+            EXPECTED_CALL(mocks, gballoc_free(0));
+        }
+        else if (step == STEP_REGISTER_SENDER_LINK_NAME || step == STEP_REGISTER_RECEIVER_LINK_NAME)
+        {
+            EXPECTED_CALL(mocks, gballoc_malloc(0));
+            EXPECTED_CALL(mocks, STRING_construct(0));
+            EXPECTED_CALL(mocks, gballoc_free(0));
+        }
+        else if (step == STEP_REGISTER_DEVICEKEY)
+        {
+            if (device->deviceSasToken != NULL)
+            {
+                STRICT_EXPECTED_CALL(mocks, STRING_construct(device->deviceSasToken));
+            }
+            else
+            {
+                STRICT_EXPECTED_CALL(mocks, STRING_new());
+                STRICT_EXPECTED_CALL(mocks, STRING_copy(0, device->deviceKey)).IgnoreArgument(1);
+            }
+        }
+        else if (step == STEP_REGISTER_REGISTRY_ADD)
+        {
+            STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Add(IGNORED_PTR_ARG, IGNORED_PTR_ARG, device->deviceId)).IgnoreArgument(1).IgnoreArgument(2);
+        }
+        else if (step == STEP_REGISTER_ADD_TO_LIST)
+        {
+            EXPECTED_CALL(mocks, DList_InitializeListHead(0));
+            EXPECTED_CALL(mocks, DList_InsertTailList(0, 0));
         }
-        else if (step == STEP_CREATE_DEVICEKEY)
+    }
+}
+
+static void setExpectedCleanupCallsForTransportRegisterUpTo(CIoTHubTransportAMQPMocks& mocks, int maximumStepToCleanup)
+{
+    int step;
+    for (step = maximumStepToCleanup; step >= 0; step--)
+    {
+        if (step == STEP_REGISTER_STATE_ALLOC)
+        {
+            EXPECTED_CALL(mocks, gballoc_free(0));
+        }
+        else if (step != STEP_REGISTER_FIND_BY_ID && step != STEP_REGISTER_REGISTRY_ADD && step != STEP_REGISTER_ADD_TO_LIST)
         {
             EXPECTED_CALL(mocks, STRING_delete(0));
         }
     }
 }
 
+static IOTHUB_DEVICE_HANDLE registerTestDevice(TRANSPORT_LL_HANDLE transport, IOTHUBTRANSPORT_CONFIG* config)
+{
+    IOTHUB_DEVICE_CONFIG device = { config->upperConfig->deviceId, config->upperConfig->deviceKey, config->upperConfig->deviceSasToken };
+    return ((TRANSPORT_PROVIDER*)AMQP_Protocol())->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, config->waitingToSend);
+}
+
 static void setExpectedCallsForSASTokenExpiryCheck(CIoTHubTransportAMQPMocks& mocks, IOTHUBTRANSPORT_CONFIG* config, time_t current_time)
 {
     STRICT_EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(current_time);
@@ -1146,12 +1303,22 @@ static void setExpectedCallsForCbsAuthentication(CIoTHubTransportAMQPMocks& mock
 {
     STRICT_EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(current_time);
     EXPECTED_CALL(mocks, SASToken_Create(NULL, NULL, NULL, 0));
+    EXPECTED_CALL(mocks, gballoc_malloc(0));
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, cbs_put_token(NULL, NULL, NULL, NULL, NULL, NULL));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, STRING_delete(NULL));
 }
 
+// Completes the latest cbs_put_token(); the transport frees the context of the put.
+static void completePutToken(CIoTHubTransportAMQPMocks& mocks, void* context, CBS_OPERATION_RESULT operation_result, unsigned int status_code)
+{
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    test_latest_cbs_put_token_callback(context, operation_result, status_code, NULL);
+}
+
 static void setExpectedCallsForCbsAuthTimeoutCheck(CIoTHubTransportAMQPMocks& mocks, IOTHUBTRANSPORT_CONFIG* config, time_t current_time)
 {
     STRICT_EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(current_time);
@@ -1162,6 +1329,7 @@ static void setExpectedCallsForCreateMessageReceiver(CIoTHubTransportAMQPMocks&
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn(TEST_MESSAGERECEIVER_SOURCE);
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn(TEST_MESSAGERECEIVER_TARGET);
+    EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, link_create(NULL, NULL, NULL, NULL, NULL)).SetReturn(TEST_MESSAGERECEIVER_LINK);
     STRICT_EXPECTED_CALL(mocks, link_set_rcv_settle_mode(NULL, receiver_settle_mode_first)).IgnoreArgument(1);
     EXPECTED_CALL(mocks, link_set_max_message_size(NULL, TEST_MESSAGE_RECEIVER_MAX_LINK_SIZE)).IgnoreArgument(1);
@@ -1186,13 +1354,14 @@ static void setExpectedCallsForDestroyMessageReceiver(CIoTHubTransportAMQPMocks&
     STRICT_EXPECTED_CALL(mocks, link_destroy(TEST_MESSAGERECEIVER_LINK));
 }
 
-static void setExpectedCallsForCreateEventSender(CIoTHubTransportAMQPMocks& mocks, IOTHUBTRANSPORT_CONFIG* config)
+static void setExpectedCallsForCreateEventSenderWithMaxLinkSize(CIoTHubTransportAMQPMocks& mocks, IOTHUBTRANSPORT_CONFIG* config, uint64_t max_link_size)
 {
     STRICT_EXPECTED_CALL(mocks, messaging_create_source(TEST_MESSAGE_SENDER_SOURCE_ADDRESS)).SetReturn(TEST_MESSAGESENDER_SOURCE);
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn(TEST_MESSAGESENDER_TARGET);
+    EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, link_create(NULL, NULL, NULL, NULL, NULL)).SetReturn(TEST_MESSAGESENDER_LINK);
-    STRICT_EXPECTED_CALL(mocks, link_set_max_message_size(NULL, TEST_MESSAGE_SENDER_MAX_LINK_SIZE)).IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, link_set_max_message_size(NULL, max_link_size)).IgnoreArgument(1);
     EXPECTED_CALL(mocks, amqpvalue_create_map()).SetReturn(TEST_AMQP_VALUE_TEST_HANDLE);
     EXPECTED_CALL(mocks, amqpvalue_create_symbol(NULL)).IgnoreArgument(1).SetReturn(TEST_AMQP_VALUE_TEST_HANDLE);
     EXPECTED_CALL(mocks, amqpvalue_create_string(NULL)).IgnoreArgument(1).SetReturn(TEST_AMQP_VALUE_TEST_HANDLE);
@@ -1207,6 +1376,11 @@ static void setExpectedCallsForCreateEventSender(CIoTHubTransportAMQPMocks& mock
     EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGESENDER_TARGET));
 }
 
+static void setExpectedCallsForCreateEventSender(CIoTHubTransportAMQPMocks& mocks, IOTHUBTRANSPORT_CONFIG* config)
+{
+    setExpectedCallsForCreateEventSenderWithMaxLinkSize(mocks, config, TEST_MESSAGE_SENDER_MAX_LINK_SIZE);
+}
+
 static void setExpectedCallsForDestroyEventSender(CIoTHubTransportAMQPMocks& mocks, IOTHUBTRANSPORT_CONFIG* config)
 {
     STRICT_EXPECTED_CALL(mocks, messagesender_destroy(TEST_MESSAGE_SENDER));
@@ -1240,6 +1414,7 @@ static void setExpectedCallsForSendPendingEvents_SingleEvent(CIoTHubTransportAMQ
         .CopyOutArgumentBuffer(2, &no_property_keys_ptr, sizeof(no_property_keys_ptr))
         .CopyOutArgumentBuffer(3, &no_property_values_ptr, sizeof(no_property_values_ptr))
         .CopyOutArgumentBuffer(4, &no_property_size, sizeof(no_property_size));
+    EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, messagesender_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
 }
@@ -1281,22 +1456,23 @@ static void setExpectedCallsForTransportDestroy(CIoTHubTransportAMQPMocks& mocks
         EXPECTED_CALL(mocks, xio_destroy(0));
     }
 
-    EXPECTED_CALL(mocks, STRING_delete(0));
-    EXPECTED_CALL(mocks, STRING_delete(0));
-    EXPECTED_CALL(mocks, STRING_delete(0));
-    EXPECTED_CALL(mocks, STRING_delete(0));
-    EXPECTED_CALL(mocks, STRING_delete(0));
-    EXPECTED_CALL(mocks, STRING_delete(0));
-
     while (numberOfEventsInProgress-- > 0)
     {
         EXPECTED_CALL(mocks, DList_RemoveEntryList(0));
         EXPECTED_CALL(mocks, DList_InitializeListHead(0));
-        EXPECTED_CALL(mocks, DList_InsertTailList(0, 0));
+        EXPECTED_CALL(mocks, DList_InsertHeadList(0, 0));
     }
 
     setExpectedCallsForRollEventsBackToWaitList(mocks, config);
 
+    // the registered device
+    EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(0));
+    setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_DEVICEKEY);
+
+    EXPECTED_CALL(mocks, STRING_delete(0));
+    EXPECTED_CALL(mocks, STRING_delete(0));
+    EXPECTED_CALL(mocks, DeviceRegistry_Destroy(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, gballoc_free(NULL));
 }
 
@@ -1445,7 +1621,7 @@ static void setupSuccessfulDoWorkAndAuthenticate(TRANSPORT_LL_HANDLE transport,
     setExpectedCallsForCreateEventSender(mocks, &config);
     setExpectedCallsForConnectionDoWork(mocks, &config);
     ((TRANSPORT_PROVIDER*)AMQP_Protocol())->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     ((TRANSPORT_PROVIDER*)AMQP_Protocol())->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
     mocks.ResetAllCalls();
 }
@@ -1457,8 +1633,14 @@ static void resetTestSuiteState()
     fail_STRING_new = false;
     fail_STRING_new_with_memory = false;
     fail_STRING_construct = false;
+    currentDeviceRegistry_Create_call = 0;
+    whenShallDeviceRegistry_Create_fail = 0;
+    currentDeviceRegistry_Add_call = 0;
+    whenShallDeviceRegistry_Add_fail = 0;
 	saved_on_message_received_callback = NULL;
 	saved_on_message_received_context = NULL;
+	saved_on_message_send_complete_callback = NULL;
+	saved_on_message_send_complete_context = NULL;
 	saved_message_get_body_amqp_data_binary_data = NULL;
 	test_amqpvalue_get_string_index = 0;
 }
@@ -1558,53 +1740,14 @@ TEST_FUNCTION(AMQP_Create_with_config_null_field1_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_006: [IoTHubTransportAMQP_Create shall fail and return NULL if any fields of the config structure are NULL.]
-TEST_FUNCTION(AMQP_Create_with_config_null_field2_fails)
-{
-    // arrange
-    IOTHUBTRANSPORT_CONFIG config;
-    TRANSPORT_PROVIDER* transport_interface;
-    IOTHUB_CLIENT_CONFIG client_config;
-
-    config.waitingToSend = NULL;
-    config.upperConfig = &client_config;
-    transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    // act
-    TRANSPORT_LL_HANDLE transportHandle = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transportHandle);
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_007: [IoTHubTransportAMQP_Create shall fail and return NULL if the deviceId length is greater than 128.]
-TEST_FUNCTION(AMQP_Create_with_config_deviceId_too_long_fails)
-{
-    // arrange
-    DLIST_ENTRY wts;
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        "012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678",
-		TEST_DEVICE_KEY, TEST_DEVICE_SAS, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    
-    // act
-    TRANSPORT_LL_HANDLE transportHandle = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transportHandle);
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_008: [IoTHubTransportAMQP_Create shall fail and return NULL if any config field of type string is zero length.] 
-TEST_FUNCTION(AMQP_Create_with_config_deviceId_NULL_fails)
+TEST_FUNCTION(AMQP_Create_with_config_protocol_NULL_fails)
 {
     // arrange
     DLIST_ENTRY wts;
     TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
 
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        NULL, TEST_DEVICE_KEY, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUB_CLIENT_CONFIG client_config = { NULL,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
@@ -1615,45 +1758,31 @@ TEST_FUNCTION(AMQP_Create_with_config_deviceId_NULL_fails)
     ASSERT_IS_NULL(transportHandle);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_008: [IoTHubTransportAMQP_Create shall fail and return NULL if any config field of type string is zero length.] 
-TEST_FUNCTION(AMQP_Create_with_config_deviceKey_and_deviceSasToken_NULL_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_192: [IoTHubTransportAMQP_Create shall ignore the device fields of the config structure and the waitingToSend list; devices are added with IoTHubTransportAMQP_Register.]
+TEST_FUNCTION(AMQP_Create_with_config_device_fields_NULL_succeeds)
 {
     // arrange
-    DLIST_ENTRY wts;
+    CIoTHubTransportAMQPMocks mocks;
     TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
 
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, NULL, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    // act
-    TRANSPORT_LL_HANDLE transportHandle = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transportHandle);
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_03_001: [IoTHubTransportAMQP_Create shall fail and return NULL if both deviceKey & deviceSasToken fields are NOT NULL.]
-TEST_FUNCTION(AMQP_Create_with_config_deviceKey_and_deviceSasToken_defined_fails)
-{
-    // arrange
-    DLIST_ENTRY wts;
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+        NULL, NULL, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_DEVICE_SAS, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, NULL };
 
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    mocks.ResetAllCalls();
+    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICE_REGISTRY);
 
     // act
-    TRANSPORT_LL_HANDLE transportHandle = transport_interface->IoTHubTransport_Create(&config);
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 
     // assert
-    ASSERT_IS_NULL(transportHandle);
-}
-
+    ASSERT_IS_NOT_NULL(transport);
+    mocks.AssertActualAndExpectedCalls();
 
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_008: [IoTHubTransportAMQP_Create shall fail and return NULL if any config field of type string is zero length.] 
 TEST_FUNCTION(AMQP_Create_with_config_hubName_NULL_fails)
@@ -1701,7 +1830,7 @@ TEST_FUNCTION(AMQP_Create_with_config_hubFqdn_too_long_fails)
     TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
 
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        TEST_DEVICE_ID, TEST_DEVICE_KEY, 
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL,
         "0123456789012345678901234567890123456789", 
         "01234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234", 
         TEST_PROT_GW_HOSTNAME };
@@ -1742,11 +1871,7 @@ TEST_FUNCTION(AMQP_Create_transport_state_allocation_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_010: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as iotHubHostFqdn, from the following pieces : config->iotHubName + "." + config->iotHubSuffix.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_012: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as devicesPath, from the following parts : host_fqdn + " / devices / " + deviceId.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_014: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as targetAddress, from the following parts: "amqps://" + devicesPath + "/messages/events".]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_053: [IoTHubTransportAMQP_Create shall define the source address for receiving messages as "amqps://" + devicesPath + "/messages/devicebound", stored in the transport handle as messageReceiveAddress]
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_016: [IoTHubTransportAMQP_Create shall initialize handle->sasTokenKeyName with a zero-length STRING_HANDLE instance.] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_018: [IoTHubTransportAMQP_Create shall store a copy of config->deviceKey (passed by upper layer) into the transports own deviceKey field.] 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_023: [If IoTHubTransportAMQP_Create succeeds it shall return a non-NULL pointer to the structure that represents the transport.] 
 TEST_FUNCTION(AMQP_Create_succeeds)
 {
@@ -1762,7 +1887,7 @@ TEST_FUNCTION(AMQP_Create_succeeds)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICEKEY);
+    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICE_REGISTRY);
 
     // act
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
@@ -1775,8 +1900,8 @@ TEST_FUNCTION(AMQP_Create_succeeds)
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_013: [If creating devicesPath fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-TEST_FUNCTION(AMQP_Create_devicesPath_malloc_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_017: [If IoTHubTransportAMQP_Create fails to initialize handle->sasTokenKeyName with a zero-length STRING the function shall fail and return NULL.] 
+TEST_FUNCTION(AMQP_Create_sasTokenKeyName_allocation_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1789,12 +1914,9 @@ TEST_FUNCTION(AMQP_Create_devicesPath_malloc_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    const char* devicesPath = TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID;
-
     mocks.ResetAllCalls();
     setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_IOTHUB_FQDN);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(devicesPath) + 1)).SetFailReturn((char*)NULL);
+    STRICT_EXPECTED_CALL(mocks, STRING_new()).SetFailReturn(TEST_NULL_STRING_HANDLE);
     setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_IOTHUB_FQDN);
 
     // act
@@ -1805,8 +1927,8 @@ TEST_FUNCTION(AMQP_Create_devicesPath_malloc_fails)
     mocks.AssertActualAndExpectedCalls();
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_013: [If creating devicesPath fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-TEST_FUNCTION(AMQP_Create_devicesPath_STRING_construct_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_228: [IoTHubTransportAMQP_Create shall call DeviceRegistry_Create to create the index of the registered devices, and shall fail and return NULL if that fails.]
+TEST_FUNCTION(AMQP_Create_DeviceRegistry_Create_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1819,16 +1941,12 @@ TEST_FUNCTION(AMQP_Create_devicesPath_STRING_construct_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    const char* devicesPath = TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID;
+    whenShallDeviceRegistry_Create_fail = 1;
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_IOTHUB_FQDN);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(devicesPath) + 1));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(devicesPath)).SetFailReturn(TEST_NULL_STRING_HANDLE);
-    EXPECTED_CALL(mocks, gballoc_free(0));
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_IOTHUB_FQDN);
-    
+    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICE_REGISTRY);
+    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_SASTOKEN_KEYNAME);
+
     // act
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 
@@ -1837,8 +1955,19 @@ TEST_FUNCTION(AMQP_Create_devicesPath_STRING_construct_fails)
     mocks.AssertActualAndExpectedCalls();
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_015: [If creating the targetAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.]
-TEST_FUNCTION(AMQP_Create_targetAddress_malloc_fails)
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_024: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_sender.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_025: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_receiver.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_027: [IoTHubTransportAMQP_Destroy shall destroy the AMQP cbs instance]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_029: [IoTHubTransportAMQP_Destroy shall destroy the AMQP link.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_030: [IoTHubTransportAMQP_Destroy shall destroy the AMQP session.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_031: [IoTHubTransportAMQP_Destroy shall destroy the AMQP connection.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_032: [IoTHubTransportAMQP_Destroy shall destroy the AMQP SASL I / O transport.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_033: [IoTHubTransportAMQP_Destroy shall destroy the AMQP SASL mechanism.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_034: [IoTHubTransportAMQP_Destroy shall destroy the AMQP TLS I/O transport.] 
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_035: [IoTHubTransportAMQP_Destroy shall delete its internally - set parameters(iotHubHostFqdn, sasTokenKeyName).]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_036: [IoTHubTransportAMQP_Destroy shall return the remaining items in inProgress to waitingToSend list.] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_193: [IoTHubTransportAMQP_Destroy shall unregister the devices that are still registered.]
+TEST_FUNCTION(AMQP_Destroy_succeeds_no_DoWork)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1851,24 +1980,24 @@ TEST_FUNCTION(AMQP_Create_targetAddress_malloc_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    const char* targetAddress = "amqps://" TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID "/messages/events";
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    ASSERT_IS_NOT_NULL(transport);
+    ASSERT_IS_NOT_NULL(devHandle);
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICES_PATH);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(targetAddress) + 1)).SetFailReturn((char*)NULL);
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICES_PATH);
+    setExpectedCallsForTransportDestroy(mocks, &config, false, false, 0);
 
     // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    transport_interface->IoTHubTransport_Destroy(transport);
 
     // assert
-    ASSERT_IS_NULL(transport);
     mocks.AssertActualAndExpectedCalls();
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_015: [If creating the targetAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-TEST_FUNCTION(AMQP_Create_targetAddress_STRING_construct_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_051: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the transport handle parameter is NULL] 
+TEST_FUNCTION(AMQP_DoWork_transport_handle_NULL_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1881,26 +2010,17 @@ TEST_FUNCTION(AMQP_Create_targetAddress_STRING_construct_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    const char* targetAddress = "amqps://" TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID "/messages/events";
-
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICES_PATH);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(targetAddress) + 1));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(targetAddress)).SetFailReturn(TEST_NULL_STRING_HANDLE);
-    EXPECTED_CALL(mocks, gballoc_free(0));
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICES_PATH);
 
     // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    transport_interface->IoTHubTransport_DoWork(NULL, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
-    ASSERT_IS_NULL(transport);
-    mocks.AssertActualAndExpectedCalls();
+    mocks.AssertActualAndExpectedCalls(); // Nothing is expected.
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_054: [If creating the messageReceiveAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.]
-TEST_FUNCTION(AMQP_Create_receiveAddress_malloc_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_194: [IoTHubTransportAMQP_DoWork shall return immediately if no device is registered with the transport.]
+TEST_FUNCTION(AMQP_DoWork_no_device_registered_does_nothing)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1913,24 +2033,22 @@ TEST_FUNCTION(AMQP_Create_receiveAddress_malloc_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    const char* receiveAddress = "amqps://"  TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID "/messages/devicebound";
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_TARGET_ADDRESS);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(receiveAddress) + 1)).SetFailReturn((char*)NULL);
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_TARGET_ADDRESS);
 
     // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
-    ASSERT_IS_NULL(transport);
-    mocks.AssertActualAndExpectedCalls();
+    mocks.AssertActualAndExpectedCalls(); // Nothing is expected.
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_054: [If creating the messageReceiveAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.]
-TEST_FUNCTION(AMQP_Create_receiveAddress_STRING_construct_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_052: [IoTHubTransportAMQP_DoWork shall ignore the client handle parameter; each device uses the client handle it was registered with.]
+TEST_FUNCTION(AMQP_DoWork_client_handle_NULL_establishes_the_connection)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1942,27 +2060,28 @@ TEST_FUNCTION(AMQP_Create_receiveAddress_STRING_construct_fails)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
 
-    const char* receiveAddress = "amqps://"  TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID "/messages/devicebound";
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_TARGET_ADDRESS);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(receiveAddress) + 1));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(receiveAddress)).SetFailReturn(TEST_NULL_STRING_HANDLE);
-    EXPECTED_CALL(mocks, gballoc_free(0));
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_TARGET_ADDRESS);
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_AUTHENTICATION, DOWORK_MESSAGERECEIVER_NONE, current_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
 
     // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    transport_interface->IoTHubTransport_DoWork(transport, NULL);
 
     // assert
-    ASSERT_IS_NULL(transport);
     mocks.AssertActualAndExpectedCalls();
-}
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_017: [If IoTHubTransportAMQP_Create fails to initialize handle->sasTokenKeyName with a zero-length STRING the function shall fail and return NULL.] 
-TEST_FUNCTION(AMQP_Create_sasTokenKeyName_allocation_fails)
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_056: [IoTHubTransportAMQP_DoWork shall create the SASL mechanism using AMQP's saslmechanism_create() API] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_057: [If saslmechanism_create() fails, IoTHubTransportAMQP_DoWork shall fail and return immediately]
+TEST_FUNCTION(AMQP_DoWork_saslmechanism_create_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1975,137 +2094,29 @@ TEST_FUNCTION(AMQP_Create_sasTokenKeyName_allocation_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_RECEIVE_ADDRESS);
-    STRICT_EXPECTED_CALL(mocks, STRING_new()).SetFailReturn(TEST_NULL_STRING_HANDLE);
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_RECEIVE_ADDRESS);
-
-    // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transport);
-    mocks.AssertActualAndExpectedCalls();
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_135: [If creating the config->deviceKey fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.]
-TEST_FUNCTION(AMQP_Create_deviceKey_allocation_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
-
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_SASTOKEN_KEYNAME);
-    STRICT_EXPECTED_CALL(mocks, STRING_new()).SetFailReturn(TEST_NULL_STRING_HANDLE);
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_SASTOKEN_KEYNAME);
-
-    // act
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transport);
-    mocks.AssertActualAndExpectedCalls();
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_019: [If IoTHubTransportAMQP_Create fails to copy config->deviceKey, the function shall fail and return NULL.] 
-TEST_FUNCTION(AMQP_Create_deviceKey_copy_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
-
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_SASTOKEN_KEYNAME);
-    STRICT_EXPECTED_CALL(mocks, STRING_new());
-    STRICT_EXPECTED_CALL(mocks, STRING_copy(0, config.upperConfig->deviceKey)).IgnoreArgument(1).SetReturn(TEST_STRING_COPY_FAILURE_RESULT);
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICEKEY);
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_GET_TLS_IO, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
+    STRICT_EXPECTED_CALL(mocks, saslmssbcbs_get_interface());
+    EXPECTED_CALL(mocks, saslmechanism_create(NULL, NULL)).SetReturn((SASL_MECHANISM_HANDLE)NULL);
+	setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_GET_TLS_IO);
+    setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
-    ASSERT_IS_NULL(transport);
     mocks.AssertActualAndExpectedCalls();
-}
-
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_024: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_sender.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_025: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_receiver.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_027: [IoTHubTransportAMQP_Destroy shall destroy the AMQP cbs instance]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_029: [IoTHubTransportAMQP_Destroy shall destroy the AMQP link.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_030: [IoTHubTransportAMQP_Destroy shall destroy the AMQP session.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_031: [IoTHubTransportAMQP_Destroy shall destroy the AMQP connection.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_032: [IoTHubTransportAMQP_Destroy shall destroy the AMQP SASL I / O transport.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_033: [IoTHubTransportAMQP_Destroy shall destroy the AMQP SASL mechanism.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_034: [IoTHubTransportAMQP_Destroy shall destroy the AMQP TLS I/O transport.] 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_035: [IoTHubTransportAMQP_Destroy shall delete its internally - set parameters(deviceKey, targetAddress, devicesPath, sasTokenKeyName).]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_036: [IoTHubTransportAMQP_Destroy shall return the remaining items in inProgress to waitingToSend list.] 
-TEST_FUNCTION(AMQP_Destroy_succeeds_no_DoWork)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
-
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-
-    ASSERT_IS_NOT_NULL(transport);
 
-    mocks.ResetAllCalls();
-    setExpectedCallsForTransportDestroy(mocks, &config, false, false, 0);
-
-    // act
+    // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
-
-    // assert
-    mocks.AssertActualAndExpectedCalls();
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_051: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the transport handle parameter is NULL] 
-TEST_FUNCTION(AMQP_DoWork_transport_handle_NULL_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
-
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    mocks.ResetAllCalls();
-
-    // act
-    transport_interface->IoTHubTransport_DoWork(NULL, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    // assert
-    mocks.AssertActualAndExpectedCalls(); // Nothing is expected.
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_052: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the client handle parameter is NULL] 
-TEST_FUNCTION(AMQP_DoWork_client_handle_NULL_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_060: [IoTHubTransportAMQP_DoWork shall create the SASL I/O layer using the xio_create() C Shared Utility API] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_061: [If xio_create() fails creating the SASL I/O layer, IoTHubTransportAMQP_DoWork shall fail and return immediately]
+TEST_FUNCTION(AMQP_DoWork_saslio_create_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2119,21 +2130,27 @@ TEST_FUNCTION(AMQP_DoWork_client_handle_NULL_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_SASLIO_GET_INTERFACE, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
+    EXPECTED_CALL(mocks, xio_create(NULL, NULL, NULL)).SetReturn((XIO_HANDLE)NULL);
+    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_SASLMECHANISM);
+    setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
-    transport_interface->IoTHubTransport_DoWork(transport, NULL);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
-    mocks.AssertActualAndExpectedCalls(); // Nothing is expected.
+    mocks.AssertActualAndExpectedCalls();
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
 }
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_056: [IoTHubTransportAMQP_DoWork shall create the SASL mechanism using AMQP's saslmechanism_create() API] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_057: [If saslmechanism_create() fails, IoTHubTransportAMQP_DoWork shall fail and return immediately]
-TEST_FUNCTION(AMQP_DoWork_saslmechanism_create_fails)
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_062: [IoTHubTransportAMQP_DoWork shall create the connection with the IoT service using connection_create2() AMQP API, passing the SASL I/O layer, IoT Hub FQDN and container ID as parameters (pass NULL for callbacks)]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_063: [If connection_create2() fails, IoTHubTransportAMQP_DoWork shall fail and return immediately]
+TEST_FUNCTION(AMQP_DoWork_connection_create2_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2147,12 +2164,13 @@ TEST_FUNCTION(AMQP_DoWork_saslmechanism_create_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_GET_TLS_IO, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
-    STRICT_EXPECTED_CALL(mocks, saslmssbcbs_get_interface());
-    EXPECTED_CALL(mocks, saslmechanism_create(NULL, NULL)).SetReturn((SASL_MECHANISM_HANDLE)NULL);
-	setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_GET_TLS_IO);
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_CREATE_SASLIO, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
+    EXPECTED_CALL(mocks, STRING_c_str(NULL));
+    EXPECTED_CALL(mocks, connection_create2(NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL)).SetReturn((CONNECTION_HANDLE)NULL);
+    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_SASLIO);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
@@ -2165,9 +2183,9 @@ TEST_FUNCTION(AMQP_DoWork_saslmechanism_create_fails)
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_060: [IoTHubTransportAMQP_DoWork shall create the SASL I/O layer using the xio_create() C Shared Utility API] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_061: [If xio_create() fails creating the SASL I/O layer, IoTHubTransportAMQP_DoWork shall fail and return immediately]
-TEST_FUNCTION(AMQP_DoWork_saslio_create_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_137: [IoTHubTransportAMQP_DoWork shall create the AMQP session session_create() AMQP API, passing the connection instance as parameter]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_138: [If session_create() fails, IoTHubTransportAMQP_DoWork shall fail and return immediately]
+TEST_FUNCTION(AMQP_DoWork_session_create_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2181,11 +2199,13 @@ TEST_FUNCTION(AMQP_DoWork_saslio_create_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_SASLIO_GET_INTERFACE, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
-    EXPECTED_CALL(mocks, xio_create(NULL, NULL, NULL)).SetReturn((XIO_HANDLE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_SASLMECHANISM);
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_CREATE_CONNECTION, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
+    EXPECTED_CALL(mocks, session_create(NULL, NULL, NULL)).SetReturn((SESSION_HANDLE)NULL);
+    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CONNECTION);
+
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
@@ -2198,9 +2218,11 @@ TEST_FUNCTION(AMQP_DoWork_saslio_create_fails)
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_062: [IoTHubTransportAMQP_DoWork shall create the connection with the IoT service using connection_create2() AMQP API, passing the SASL I/O layer, IoT Hub FQDN and container ID as parameters (pass NULL for callbacks)]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_063: [If connection_create2() fails, IoTHubTransportAMQP_DoWork shall fail and return immediately]
-TEST_FUNCTION(AMQP_DoWork_connection_create2_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_065: [IoTHubTransportAMQP_DoWork shall apply a default value of UINT_MAX for the parameter 'AMQP incoming window'] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_115: [IoTHubTransportAMQP_DoWork shall apply a default value of 100 for the parameter 'AMQP outgoing window'] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_066: [IoTHubTransportAMQP_DoWork shall establish the CBS connection using the cbs_create() AMQP API] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_067: [If cbs_create() fails, IoTHubTransportAMQP_DoWork shall fail and return immediately]
+TEST_FUNCTION(AMQP_DoWork_cbs_create_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2214,12 +2236,13 @@ TEST_FUNCTION(AMQP_DoWork_connection_create2_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_CREATE_SASLIO, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
-    EXPECTED_CALL(mocks, STRING_c_str(NULL));
-    EXPECTED_CALL(mocks, connection_create2(NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL)).SetReturn((CONNECTION_HANDLE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_SASLIO);
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OUTGOING_WINDOW, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
+    EXPECTED_CALL(mocks, cbs_create(NULL, NULL, NULL)).SetReturn((CBS_HANDLE)NULL);
+    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_SESSION);
+
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
@@ -2232,9 +2255,9 @@ TEST_FUNCTION(AMQP_DoWork_connection_create2_fails)
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_137: [IoTHubTransportAMQP_DoWork shall create the AMQP session session_create() AMQP API, passing the connection instance as parameter]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_138: [If session_create() fails, IoTHubTransportAMQP_DoWork shall fail and return immediately]
-TEST_FUNCTION(AMQP_DoWork_session_create_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_219: [IoTHubTransportAMQP_DoWork shall apply the values of the options "incoming_window_size" and "outgoing_window_size", when set, instead of the defaults to the session it creates]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_221: [IotHubTransportAMQP_SetOption shall save the value (uint32_t) if the option name is "incoming_window_size" or "outgoing_window_size", returning IOTHUB_CLIENT_OK, or return IOTHUB_CLIENT_INVALID_ARG if the value is 0]
+TEST_FUNCTION(AMQP_DoWork_applies_the_window_size_options_to_the_session)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2246,13 +2269,20 @@ TEST_FUNCTION(AMQP_DoWork_session_create_fails)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    uint32_t incoming_window_size = 16;
+    uint32_t outgoing_window_size = 8;
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, transport_interface->IoTHubTransport_SetOption(transport, "incoming_window_size", &incoming_window_size));
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, transport_interface->IoTHubTransport_SetOption(transport, "outgoing_window_size", &outgoing_window_size));
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_CREATE_CONNECTION, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
-    EXPECTED_CALL(mocks, session_create(NULL, NULL, NULL)).SetReturn((SESSION_HANDLE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CONNECTION);
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_CREATE_SESSION, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
+    STRICT_EXPECTED_CALL(mocks, session_set_incoming_window(NULL, 16)).IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, session_set_outgoing_window(NULL, 8)).IgnoreArgument(1);
+    EXPECTED_CALL(mocks, cbs_create(NULL, NULL, NULL)).SetReturn((CBS_HANDLE)NULL);
+    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_SESSION);
 
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
@@ -2266,11 +2296,9 @@ TEST_FUNCTION(AMQP_DoWork_session_create_fails)
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_065: [IoTHubTransportAMQP_DoWork shall apply a default value of UINT_MAX for the parameter 'AMQP incoming window'] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_115: [IoTHubTransportAMQP_DoWork shall apply a default value of 100 for the parameter 'AMQP outgoing window'] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_066: [IoTHubTransportAMQP_DoWork shall establish the CBS connection using the cbs_create() AMQP API] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_067: [If cbs_create() fails, IoTHubTransportAMQP_DoWork shall fail and return immediately]
-TEST_FUNCTION(AMQP_DoWork_cbs_create_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_220: [IoTHubTransportAMQP_DoWork shall apply the values of the options "sender_max_link_size" and "receiver_max_link_size", when set, instead of the defaults to the links it creates]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_222: [IotHubTransportAMQP_SetOption shall save the value (uint64_t) if the option name is "sender_max_link_size" or "receiver_max_link_size", returning IOTHUB_CLIENT_OK, or return IOTHUB_CLIENT_INVALID_ARG if the value is 0]
+TEST_FUNCTION(AMQP_DoWork_applies_sender_max_link_size_to_the_event_sender_link)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2278,22 +2306,30 @@ TEST_FUNCTION(AMQP_DoWork_cbs_create_fails)
     DLIST_ENTRY wts;
     BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
     TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+    uint64_t sender_max_link_size = 262144;
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, transport_interface->IoTHubTransport_SetOption(transport, "sender_max_link_size", &sender_max_link_size));
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OUTGOING_WINDOW, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
-    EXPECTED_CALL(mocks, cbs_create(NULL, NULL, NULL)).SetReturn((CBS_HANDLE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_SESSION);
-
-    setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForCreateEventSenderWithMaxLinkSize(mocks, &config, 262144);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, current_time, 0);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
@@ -2318,6 +2354,7 @@ TEST_FUNCTION(AMQP_DoWork_cbs_open_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
@@ -2338,7 +2375,7 @@ TEST_FUNCTION(AMQP_DoWork_cbs_open_fails)
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_020: [IoTHubTransportAMQP_Create shall set parameter transport_state->sas_token_lifetime with the default value of 3600000 (milliseconds).] 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_081: [IoTHubTransportAMQP_DoWork shall put a new SAS token if the one has not been out already, or if the previous one failed to be put due to timeout of cbs_put_token().] 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_083: [Each new SAS token created by the transport shall be valid for up to 'sas_token_lifetime' milliseconds from the time of creation] 
-TEST_FUNCTION(AMQP_DoWork_SASToken_create_fails)
+TEST_FUNCTION(AMQP_DoWork_SASToken_create_fails_keeps_the_connection)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2350,6 +2387,7 @@ TEST_FUNCTION(AMQP_DoWork_SASToken_create_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     size_t expected_expiry_time = (size_t)(difftime(current_time, 0) + TEST_SAS_TOKEN_LIFETIME_MS / 1000);
 
@@ -2357,8 +2395,7 @@ TEST_FUNCTION(AMQP_DoWork_SASToken_create_fails)
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
     STRICT_EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(current_time);
     EXPECTED_CALL(mocks, SASToken_Create(NULL, NULL, NULL, 0)).SetReturn((STRING_HANDLE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
-    setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -2371,9 +2408,9 @@ TEST_FUNCTION(AMQP_DoWork_SASToken_create_fails)
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_146: [If the SAS token fails to be sent to CBS (cbs_put_token), IoTHubTransportAMQP_DoWork shall fail and exit immediately]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_146: [If the SAS token fails to be sent to CBS (cbs_put_token), IoTHubTransportAMQP_DoWork shall skip that device and try again on its next call]
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_145: [Each new SAS token created shall be deleted from memory immediately after sending it to CBS]
-TEST_FUNCTION(AMQP_DoWork_cbs_put_token_fails)
+TEST_FUNCTION(AMQP_DoWork_cbs_put_token_fails_keeps_the_connection_and_retries)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2385,22 +2422,27 @@ TEST_FUNCTION(AMQP_DoWork_cbs_put_token_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
 
     mocks.ResetAllCalls();
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
     STRICT_EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(current_time);
     EXPECTED_CALL(mocks, SASToken_Create(NULL, NULL, NULL, 0));
+    EXPECTED_CALL(mocks, gballoc_malloc(0));
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, cbs_put_token(NULL, NULL, NULL, NULL, NULL, NULL)).SetReturn(1);
+    EXPECTED_CALL(mocks, gballoc_free(NULL));
     EXPECTED_CALL(mocks, STRING_delete(NULL));
-
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
-    setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
@@ -2409,8 +2451,9 @@ TEST_FUNCTION(AMQP_DoWork_cbs_put_token_fails)
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_084: [IoTHubTransportAMQP_DoWork shall wait for 'cbs_request_timeout' milliseconds for the cbs_put_token() to complete before failing due to timeout] 
-TEST_FUNCTION(AMQP_DoWork_CBS_auth_timeout_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_084: [IoTHubTransportAMQP_DoWork shall wait for 'cbs_request_timeout' milliseconds for the cbs_put_token() to complete before resetting that device as if the put had failed]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_081: [IoTHubTransportAMQP_DoWork shall put a new SAS token if the one has not been out already, or if the previous one failed to be put due to timeout of cbs_put_token().]
+TEST_FUNCTION(AMQP_DoWork_CBS_auth_timeout_resets_the_device_and_puts_a_new_token)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2422,6 +2465,7 @@ TEST_FUNCTION(AMQP_DoWork_CBS_auth_timeout_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2429,11 +2473,19 @@ TEST_FUNCTION(AMQP_DoWork_CBS_auth_timeout_fails)
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
     setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
     EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(expiration_time);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
-    setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForCbsAuthentication(mocks, &config, expiration_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, expiration_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    // the put that timed out completes late and only frees its context
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    void* timed_out_put_context = test_latest_cbs_put_token_context;
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    test_latest_cbs_put_token_callback(timed_out_put_context, CBS_OPERATION_RESULT_OK, 0, NULL);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
@@ -2443,7 +2495,7 @@ TEST_FUNCTION(AMQP_DoWork_CBS_auth_timeout_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_068: [IoTHubTransportAMQP_DoWork shall create the AMQP link for sending messages using 'source' as "ingress", target as the IoT hub FQDN, link name as "sender-link" and role as 'role_sender'] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_069: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for sending messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_069: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for sending messages, the function shall fail and return immediately, flagging the links of that device to be re-established] 
 TEST_FUNCTION(AMQP_DoWork_messagesender_create_source_fails)
 {
     // arrange
@@ -2456,6 +2508,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_source_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2466,12 +2519,12 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_source_fails)
     setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn((AMQP_VALUE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2482,7 +2535,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_source_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_068: [IoTHubTransportAMQP_DoWork shall create the AMQP link for sending messages using 'source' as "ingress", target as the IoT hub FQDN, link name as "sender-link" and role as 'role_sender'] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_069: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for sending messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_069: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for sending messages, the function shall fail and return immediately, flagging the links of that device to be re-established] 
 TEST_FUNCTION(AMQP_DoWork_messagesender_create_target_fails)
 {
     // arrange
@@ -2495,6 +2548,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_target_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2508,12 +2562,12 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_target_fails)
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn((AMQP_VALUE)NULL);
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGESENDER_SOURCE));
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2524,7 +2578,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_target_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_068: [IoTHubTransportAMQP_DoWork shall create the AMQP link for sending messages using 'source' as "ingress", target as the IoT hub FQDN, link name as "sender-link" and role as 'role_sender'] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_069: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for sending messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_069: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for sending messages, the function shall fail and return immediately, flagging the links of that device to be re-established] 
 TEST_FUNCTION(AMQP_DoWork_messagesender_create_link_fails)
 {
     // arrange
@@ -2537,6 +2591,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_link_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2549,15 +2604,16 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_link_fails)
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn(TEST_MESSAGESENDER_SOURCE);
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn(TEST_MESSAGESENDER_TARGET);
+    EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, link_create(NULL, NULL, NULL, NULL, NULL)).SetReturn((LINK_HANDLE)NULL);
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGESENDER_SOURCE));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGESENDER_TARGET));
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2568,7 +2624,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_link_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_070: [IoTHubTransportAMQP_DoWork shall create the AMQP message sender using messagesender_create() AMQP API] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_071: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message sender instance fails to be created, flagging the connection to be re-established] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_071: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message sender instance fails to be created, flagging the links of that device to be re-established] 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_119: [IoTHubTransportAMQP_DoWork shall apply a default value of 65536 for the parameter 'Link MAX message size'] 
 TEST_FUNCTION(AMQP_DoWork_messagesender_create_fails)
 {
@@ -2582,6 +2638,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2594,6 +2651,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_fails)
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn(TEST_MESSAGESENDER_SOURCE);
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn(TEST_MESSAGESENDER_TARGET);
+    EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, link_create(NULL, NULL, NULL, NULL, NULL)).SetReturn(TEST_MESSAGESENDER_LINK);
     EXPECTED_CALL(mocks, link_set_max_message_size(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, amqpvalue_create_map()).SetReturn(TEST_AMQP_VALUE_TEST_HANDLE);
@@ -2607,12 +2665,12 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_fails)
     EXPECTED_CALL(mocks, messagesender_create(NULL, NULL, NULL, NULL)).SetReturn((MESSAGE_SENDER_HANDLE)NULL);
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGESENDER_SOURCE));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGESENDER_TARGET));
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2623,7 +2681,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_072: [IoTHubTransportAMQP_DoWork shall open the AMQP message sender using messagesender_open() AMQP API] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_073: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message sender instance fails to be opened, flagging the connection to be re-established] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_073: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message sender instance fails to be opened, flagging the links of that device to be re-established] 
 TEST_FUNCTION(AMQP_DoWork_messagesender_open_fails)
 {
     // arrange
@@ -2636,6 +2694,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_open_fails)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2648,6 +2707,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_open_fails)
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn(TEST_MESSAGESENDER_SOURCE);
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn(TEST_MESSAGESENDER_TARGET);
+    EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, link_create(NULL, NULL, NULL, NULL, NULL)).SetReturn(TEST_MESSAGESENDER_LINK);
     EXPECTED_CALL(mocks, link_set_max_message_size(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, amqpvalue_create_map()).SetReturn(TEST_AMQP_VALUE_TEST_HANDLE);
@@ -2663,12 +2723,12 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_open_fails)
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGESENDER_SOURCE));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGESENDER_TARGET));
 	setExpectedCallsForPrepareForConnectionRetry(mocks, &config, false, true);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2679,7 +2739,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_open_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_074: [IoTHubTransportAMQP_DoWork shall create the AMQP link for receiving messages using 'source' as messageReceiveAddress, target as the "ingress-rx", link name as "receiver-link" and role as 'role_receiver'] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_075: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for receiving messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_075: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for receiving messages, the function shall fail and return immediately, flagging the links of that device to be re-established] 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_038: [IoTHubTransportAMQP_Subscribe shall set transport_handle->receive_messages to true and return success code.]
 TEST_FUNCTION(AMQP_DoWork_messagereceiver_source_create_fails)
 {
@@ -2695,7 +2755,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_source_create_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2707,12 +2768,12 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_source_create_fails)
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn((AMQP_VALUE)NULL);
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn((AMQP_VALUE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2723,7 +2784,7 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_source_create_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_074: [IoTHubTransportAMQP_DoWork shall create the AMQP link for receiving messages using 'source' as messageReceiveAddress, target as the "ingress-rx", link name as "receiver-link" and role as 'role_receiver'] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_075: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for receiving messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_075: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for receiving messages, the function shall fail and return immediately, flagging the links of that device to be re-established] 
 TEST_FUNCTION(AMQP_DoWork_messagereceiver_target_create_fails)
 {
     // arrange
@@ -2738,7 +2799,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_target_create_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2752,12 +2814,12 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_target_create_fails)
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn((AMQP_VALUE)NULL);
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGERECEIVER_SOURCE));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn((AMQP_VALUE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2768,7 +2830,7 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_target_create_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_074: [IoTHubTransportAMQP_DoWork shall create the AMQP link for receiving messages using 'source' as messageReceiveAddress, target as the "ingress-rx", link name as "receiver-link" and role as 'role_receiver'] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_075: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for receiving messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_075: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for receiving messages, the function shall fail and return immediately, flagging the links of that device to be re-established] 
 TEST_FUNCTION(AMQP_DoWork_messagereceiver_link_create_fails)
 {
     // arrange
@@ -2783,7 +2845,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_link_create_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2795,16 +2858,17 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_link_create_fails)
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn(TEST_MESSAGERECEIVER_SOURCE);
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn(TEST_MESSAGERECEIVER_TARGET);
+    EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, link_create(NULL, NULL, NULL, NULL, NULL)).SetReturn((LINK_HANDLE)NULL);
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGERECEIVER_SOURCE));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGERECEIVER_TARGET));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn((AMQP_VALUE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2815,7 +2879,7 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_link_create_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_076: [IoTHubTransportAMQP_DoWork shall set the receiver link settle mode as receiver_settle_mode_first] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_141: [If IoTHubTransportAMQP_DoWork fails to set the settle mode on the AMQP link for receiving messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_141: [If IoTHubTransportAMQP_DoWork fails to set the settle mode on the AMQP link for receiving messages, the function shall fail and return immediately, flagging the links of that device to be re-established] 
 TEST_FUNCTION(AMQP_DoWork_messagereceiver_settle_mode_fails)
 {
     // arrange
@@ -2830,7 +2894,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_settle_mode_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2842,17 +2907,18 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_settle_mode_fails)
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn(TEST_MESSAGERECEIVER_SOURCE);
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn(TEST_MESSAGERECEIVER_TARGET);
+    EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, link_create(NULL, NULL, NULL, NULL, NULL)).SetReturn(TEST_MESSAGERECEIVER_LINK);
     STRICT_EXPECTED_CALL(mocks, link_set_rcv_settle_mode(TEST_MESSAGERECEIVER_LINK, receiver_settle_mode_first)).SetReturn(1);
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGERECEIVER_SOURCE));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGERECEIVER_TARGET));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn((AMQP_VALUE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
                                                  // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2863,7 +2929,7 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_settle_mode_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_077: [IoTHubTransportAMQP_DoWork shall create the AMQP message receiver using messagereceiver_create() AMQP API] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_078: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message receiver instance fails to be created, flagging the connection to be re-established] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_078: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message receiver instance fails to be created, flagging the links of that device to be re-established] 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_119: [IoTHubTransportAMQP_DoWork shall apply a default value of 65536 for the parameter 'Link MAX message size'] 
 TEST_FUNCTION(AMQP_DoWork_messagereceiver_create_fails)
 {
@@ -2879,7 +2945,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_create_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2891,6 +2958,7 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_create_fails)
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn(TEST_MESSAGERECEIVER_SOURCE);
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn(TEST_MESSAGERECEIVER_TARGET);
+    EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, link_create(NULL, NULL, NULL, NULL, NULL)).SetReturn(TEST_MESSAGERECEIVER_LINK);
     STRICT_EXPECTED_CALL(mocks, link_set_rcv_settle_mode(TEST_MESSAGERECEIVER_LINK, receiver_settle_mode_first));
     EXPECTED_CALL(mocks, link_set_max_message_size(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
@@ -2906,12 +2974,12 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_create_fails)
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGERECEIVER_SOURCE));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGERECEIVER_TARGET));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn((AMQP_VALUE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2922,7 +2990,7 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_create_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_079: [IoTHubTransportAMQP_DoWork shall open the AMQP message receiver using messagereceiver_open() AMQP API, passing a callback function for handling C2D incoming messages] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_080: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message receiver instance fails to be opened, flagging the connection to be re-established] 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_080: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message receiver instance fails to be opened, flagging the links of that device to be re-established] 
 TEST_FUNCTION(AMQP_DoWork_messagereceiver_open_fails)
 {
     // arrange
@@ -2937,7 +3005,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_open_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2949,6 +3018,7 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_open_fails)
     EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn(TEST_MESSAGERECEIVER_SOURCE);
     EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn(TEST_MESSAGERECEIVER_TARGET);
+    EXPECTED_CALL(mocks, STRING_c_str(NULL));
     EXPECTED_CALL(mocks, link_create(NULL, NULL, NULL, NULL, NULL)).SetReturn(TEST_MESSAGERECEIVER_LINK);
     STRICT_EXPECTED_CALL(mocks, link_set_rcv_settle_mode(TEST_MESSAGERECEIVER_LINK, receiver_settle_mode_first));
     EXPECTED_CALL(mocks, link_set_max_message_size(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
@@ -2966,12 +3036,12 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_open_fails)
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGERECEIVER_TARGET));
     EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn((AMQP_VALUE)NULL);
 	setExpectedCallsForPrepareForConnectionRetry(mocks, &config, true, false);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -2984,7 +3054,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_open_fails)
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_055: [If the transport handle has a NULL connection, IoTHubTransportAMQP_DoWork shall instantiate and initialize the AMQP components and establish the connection] 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_082: [IoTHubTransportAMQP_DoWork shall refresh the SAS token if the current token has been used for more than 'sas_token_refresh_time' milliseconds]
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_128: [IoTHubTransportAMQP_Create shall set parameter transport_state->sas_token_refresh_time with the default value of sas_token_lifetime/2 (milliseconds).] 
-TEST_FUNCTION(AMQP_DoWork_expired_SASToken_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_224: [A device that is already authenticated shall keep sending and receiving while its refreshed SAS token is being put on the CBS]
+TEST_FUNCTION(AMQP_DoWork_expired_SASToken_create_fails_keeps_the_device_sending)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2999,7 +3070,8 @@ TEST_FUNCTION(AMQP_DoWork_expired_SASToken_fails)
 	time_t expiration_time = addSecondsToTime(current_time, (TEST_SAS_TOKEN_LIFETIME_MS / 2) / 1000 + 1);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -3010,12 +3082,14 @@ TEST_FUNCTION(AMQP_DoWork_expired_SASToken_fails)
     setExpectedCallsForSASTokenExpiryCheck(mocks, &config, expiration_time);
     EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(current_time);
     EXPECTED_CALL(mocks, SASToken_Create(NULL, NULL, NULL, 0)).SetReturn((STRING_HANDLE)NULL);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
-    setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
+    setExpectedCallsForCreateMessageReceiver(mocks, &config);
+    setExpectedCallsForCreateEventSender(mocks, &config);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, expiration_time, 0);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -3025,10 +3099,8 @@ TEST_FUNCTION(AMQP_DoWork_expired_SASToken_fails)
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_086: [IoTHubTransportAMQP_DoWork shall move queued events to an "in-progress" list right before processing them for sending]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_089: [If the event contains a message of type IOTHUBMESSAGE_STRING, IoTHubTransportAMQP_DoWork shall obtain its char* representation using IoTHubMessage_GetString()]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_090: [If the event contains a message of type IOTHUBMESSAGE_STRING, IoTHubTransportAMQP_DoWork shall obtain the size of its char* representation using strlen()] 
-TEST_FUNCTION(AMQP_DoWork_succeeds_when_2_waiting_to_send_messages_are_in_the_list)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_224: [A device that is already authenticated shall keep sending and receiving while its refreshed SAS token is being put on the CBS]
+TEST_FUNCTION(AMQP_DoWork_keeps_sending_while_the_refreshed_SASToken_is_put)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -3040,24 +3112,26 @@ TEST_FUNCTION(AMQP_DoWork_succeeds_when_2_waiting_to_send_messages_are_in_the_li
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     time_t current_time = time(NULL);
-    
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	time_t refresh_time = addSecondsToTime(current_time, (TEST_SAS_TOKEN_LIFETIME_MS / 2) / 1000 + 1);
 
-    addTestEvents(config.waitingToSend, 2, true);
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
     setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
     setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
     setExpectedCallsForConnectionDoWork(mocks, &config);
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, refresh_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, refresh_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, refresh_time);
     setExpectedCallsForCreateEventSender(mocks, &config);
-    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, current_time, 2);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, refresh_time, 0);
     setExpectedCallsForConnectionDoWork(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -3065,12 +3139,229 @@ TEST_FUNCTION(AMQP_DoWork_succeeds_when_2_waiting_to_send_messages_are_in_the_li
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_230: [If the put of a refreshed SAS token fails or times out while the previous SAS token of the device is still valid, the device shall stay authenticated and keep its links, and IoTHubTransportAMQP_DoWork shall put a new SAS token for it]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_232: [After the put of a refreshed SAS token failed or timed out, IoTHubTransportAMQP_DoWork shall not put a new SAS token for the device until 'cbs_request_timeout' milliseconds have passed since that put was started]
+TEST_FUNCTION(AMQP_DoWork_keeps_the_device_authenticated_and_puts_again_after_cbs_request_timeout_when_the_put_of_the_refreshed_SASToken_fails)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+	time_t refresh_time = addSecondsToTime(current_time, (TEST_SAS_TOKEN_LIFETIME_MS / 2) / 1000 + 1);
+	time_t before_retry_time = addSecondsToTime(refresh_time, TEST_CBS_REQUEST_TIMEOUT_MS / 1000 - 1);
+	time_t retry_time = addSecondsToTime(refresh_time, TEST_CBS_REQUEST_TIMEOUT_MS / 1000);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    mocks.ResetAllCalls();
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, refresh_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, refresh_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, refresh_time);
+    setExpectedCallsForCreateEventSender(mocks, &config);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, refresh_time, 0);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(refresh_time); // the previous token is still valid
+    // no put before 'cbs_request_timeout' has passed since the failed one was started
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, refresh_time);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, refresh_time, 0);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, before_retry_time);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, before_retry_time, 0);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, retry_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, retry_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, retry_time);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, retry_time, 0);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OPERATION_FAILED, 401);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_226: [IoTHubTransportAMQP_DoWork shall also handle the put of a refreshed SAS token that does not complete within 'cbs_request_timeout' milliseconds as failed]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_230: [If the put of a refreshed SAS token fails or times out while the previous SAS token of the device is still valid, the device shall stay authenticated and keep its links, and IoTHubTransportAMQP_DoWork shall put a new SAS token for it]
+TEST_FUNCTION(AMQP_DoWork_keeps_the_device_authenticated_and_puts_again_when_the_put_of_the_refreshed_SASToken_times_out)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+	time_t refresh_time = addSecondsToTime(current_time, (TEST_SAS_TOKEN_LIFETIME_MS / 2) / 1000 + 1);
+	time_t timeout_time = addSecondsToTime(refresh_time, TEST_CBS_REQUEST_TIMEOUT_MS / 1000 + 1);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    mocks.ResetAllCalls();
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, refresh_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, refresh_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, refresh_time);
+    setExpectedCallsForCreateEventSender(mocks, &config);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, refresh_time, 0);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, timeout_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, timeout_time);
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(timeout_time); // the previous token is still valid
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, timeout_time, 0);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, timeout_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, timeout_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, timeout_time);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, timeout_time, 0);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    // the put that timed out completes late and only frees its context
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    void* timed_out_put_context = test_latest_cbs_put_token_context;
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    test_latest_cbs_put_token_callback(timed_out_put_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_225: [If the put of a SAS token fails and the device is not authenticated by a previous SAS token that is still valid, IoTHubTransportAMQP_DoWork shall destroy the links of that device only, return its in-progress events to its waitingToSend list and put a new SAS token for it; the connection and the other devices shall not be affected]
+TEST_FUNCTION(AMQP_DoWork_resets_the_device_when_the_put_of_the_refreshed_SASToken_fails_after_the_previous_one_expired)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+	time_t refresh_time = addSecondsToTime(current_time, (TEST_SAS_TOKEN_LIFETIME_MS / 2) / 1000 + 1);
+	time_t expiration_time = addSecondsToTime(current_time, TEST_SAS_TOKEN_LIFETIME_MS / 1000 + 1);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    mocks.ResetAllCalls();
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, refresh_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, refresh_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, refresh_time);
+    setExpectedCallsForCreateEventSender(mocks, &config);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, refresh_time, 0);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    STRICT_EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(expiration_time); // the previous token expired
+    setExpectedCallsForDestroyEventSender(mocks, &config);
+    setExpectedCallsForCbsAuthentication(mocks, &config, expiration_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, expiration_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OPERATION_FAILED, 401);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_086: [IoTHubTransportAMQP_DoWork shall move queued events to an "in-progress" list right before processing them for sending]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_089: [If the event contains a message of type IOTHUBMESSAGE_STRING, IoTHubTransportAMQP_DoWork shall obtain its char* representation using IoTHubMessage_GetString()]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_090: [If the event contains a message of type IOTHUBMESSAGE_STRING, IoTHubTransportAMQP_DoWork shall obtain the size of its char* representation using strlen()] 
+TEST_FUNCTION(AMQP_DoWork_succeeds_when_2_waiting_to_send_messages_are_in_the_list)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+    
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    addTestEvents(config.waitingToSend, 2, true);
+
+    mocks.ResetAllCalls();
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForCreateEventSender(mocks, &config);
+    setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_STRING, current_time, 2);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
 }
 
 /* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_007: [The IoTHub message properties shall be obtained by calling IoTHubMessage_Properties.] */
 /* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_016: [If the number of properties is 0, no uAMQP map shall be created and no application properties shall be set on the uAMQP message.] */
 /* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_015: [The actual keys and values, as well as the number of properties shall be obtained by calling Map_GetInternals on the handle obtained from IoTHubMessage_Properties.] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_199: [If messagesender_send() succeeds, IoTHubTransportAMQP_DoWork shall call IoTHubClient_LL_SendStarted with the IOTHUB_CLIENT_LL_HANDLE that queued the event (message->owner), the event, a count of 1 and the size of the body of the AMQP message, unless the event was already completed from within messagesender_send()] */
 TEST_FUNCTION(AMQP_DoWork_send_one_message_succeeds)
 {
 	// arrange
@@ -3085,6 +3376,7 @@ TEST_FUNCTION(AMQP_DoWork_send_one_message_succeeds)
 	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
@@ -3112,6 +3404,8 @@ TEST_FUNCTION(AMQP_DoWork_send_one_message_succeeds)
 		.CopyOutArgumentBuffer(2, &no_property_keys_ptr, sizeof(no_property_keys_ptr))
 		.CopyOutArgumentBuffer(3, &no_property_values_ptr, sizeof(no_property_values_ptr))
 		.CopyOutArgumentBuffer(4, &no_property_size, sizeof(no_property_size));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, 1, test_binary_data.length))
+		.IgnoreArgument(2);
 	EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL));
 	STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
 	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
@@ -3127,24 +3421,9 @@ TEST_FUNCTION(AMQP_DoWork_send_one_message_succeeds)
 	cleanupList(config.waitingToSend);
 }
 
-/* Test_SRS_IOTHUBTRANSPORTAMQP_09_155: [uAMQP message properties shall be retrieved using message_get_properties.] */
-/* Test_SRS_IOTHUBTRANSPORTAMQP_09_157: [The message-id property shall be read from the uAMQP message by calling properties_get_message_id.] */
-/* Test_SRS_IOTHUBTRANSPORTAMQP_09_159: [The message-id value shall be retrieved from the AMQP_VALUE as char* by calling amqpvalue_get_string.] */
-/* Test_SRS_IOTHUBTRANSPORTAMQP_09_161: [The message-id property shall be set on the IOTHUB_MESSAGE_HANDLE by calling IoTHubMessage_SetMessageId, passing the value read from the uAMQP message.] */
-/* Test_SRS_IOTHUBTRANSPORTAMQP_09_163: [The correlation-id property shall be read from the uAMQP message by calling properties_get_correlation_id.] */
-/* Test_SRS_IOTHUBTRANSPORTAMQP_09_165: [The correlation-id value shall be retrieved from the AMQP_VALUE as char* by calling amqpvalue_get_string.] */
-/* Test_SRS_IOTHUBTRANSPORTAMQP_09_167: [The correlation-id property shall be set on the IOTHUB_MESSAGE_HANDLE by calling IoTHubMessage_SetCorrelationId, passing the value read from the uAMQP message.] */
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_169: [The callback on_message_received shall read the application properties from the uAMQP message and set it on the IoT Hub Message if any are provided.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_170: [The IOTHUB_MESSAGE_HANDLE properties shall be retrieved using IoTHubMessage_Properties.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_171: [uAMQP message application properties shall be retrieved using message_get_application_properties.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_173: [The actual uAMQP message application properties should be extracted from the result of message_get_application_properties using amqpvalue_get_inplace_described_value.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_175: [The number of items in the uAMQP message application properties shall be obtained using amqpvalue_get_map_pair_count.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_177: [on_message_received shall iterate through each uAMQP application property and add it on IOTHUB_MESSAGE_HANDLE properties.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_178: [The uAMQP application property name and value shall be obtained using amqpvalue_get_map_key_value_pair.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_180: [The uAMQP application property name shall be extracted as string using amqpvalue_get_string.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_182: [The uAMQP application property value shall be extracted as string using amqpvalue_get_string.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_184: [The application property name and value shall be added to IOTHUB_MESSAGE_HANDLE properties using Map_AddOrUpdate.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_read_properties_succeeds)
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_113: [If messagesender_send() fails, IoTHubTransportAMQP_DoWork notify the failure, roll back the event to the head of the waitToSent list and return] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_199: [If messagesender_send() succeeds, IoTHubTransportAMQP_DoWork shall call IoTHubClient_LL_SendStarted with the IOTHUB_CLIENT_LL_HANDLE that queued the event (message->owner), the event, a count of 1 and the size of the body of the AMQP message, unless the event was already completed from within messagesender_send()] */
+TEST_FUNCTION(AMQP_DoWork_when_messagesender_send_fails_rolls_the_event_back_to_the_head_of_waitingToSend)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3156,70 +3435,47 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_read_properties_succeeds)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 	time_t current_time = time(NULL);
-	int subscribe_result;
-
-	resetTestSuiteState();
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
-
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
-	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	addTestEvents(config.waitingToSend, 1, true);
 	mocks.ResetAllCalls();
 
-	test_amqpvalue_get_string_index = 0;
-
-	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
-	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
-
-	// readPropertiesFromuAMQPMessage()
-	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, properties_destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-	EXPECTED_CALL(mocks, properties_get_message_id(NULL, NULL)).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_type(NULL)).SetReturn(AMQP_TYPE_MAP);
-	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetMessageId(TEST_IOTHUB_MESSAGE_HANDLE, test_amqpvalue_get_string_values[0])).SetReturn(IOTHUB_MESSAGE_OK);
-	
-	EXPECTED_CALL(mocks, properties_get_correlation_id(NULL, NULL)).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_type(NULL)).SetReturn(AMQP_TYPE_MAP);
-	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetCorrelationId(TEST_IOTHUB_MESSAGE_HANDLE, test_amqpvalue_get_string_values[1])).SetReturn(IOTHUB_MESSAGE_OK);
-
-	// readApplicationPropertiesFromuAMQPMessage
-	test_amqpvalue_get_map_pair_count = 2;
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
-	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(0);
-	
-	// First property.
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 0, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_HANDLE, test_amqpvalue_get_string_values[2], test_amqpvalue_get_string_values[3])).SetReturn(MAP_OK);
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
 
-	// Second property.
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 1, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_HANDLE, test_amqpvalue_get_string_values[4], test_amqpvalue_get_string_values[5])).SetReturn(MAP_OK);
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	const unsigned char* binarydata_ptr = test_binary_data.bytes;
+	EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+		.CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+	EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
 
-	// End of on_message_received()
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_ACCEPTED);
-	STRICT_EXPECTED_CALL(mocks, messaging_delivery_accepted());
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+		.SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.CopyOutArgumentBuffer(2, &no_property_keys_ptr, sizeof(no_property_keys_ptr))
+		.CopyOutArgumentBuffer(3, &no_property_values_ptr, sizeof(no_property_values_ptr))
+		.CopyOutArgumentBuffer(4, &no_property_size, sizeof(no_property_size));
+	EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL))
+		.SetReturn(1);
+	STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertHeadList(config.waitingToSend, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 
 	// act
-	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
-	
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
 	// assert
 	mocks.AssertActualAndExpectedCalls();
 
@@ -3228,9 +3484,26 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_read_properties_succeeds)
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_186: [If IoTHubMessage_Properties fails, the error shall be notified and on_message_received shall continue.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_IoTHubMessage_Properties_fails)
+static void setExpectedCallsForBatchedEvent(CIoTHubTransportAMQPMocks& mocks)
+{
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, AmqpEventEncoder_Encode(TEST_AMQPEVENTENCODER_HANDLE, TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+	EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data))
+		.IgnoreArgument(2);
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_200: [If the option "Batching" is true, IoTHubTransportAMQP_DoWork shall send the pending events in batches instead of one by one] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_201: [If the option "Batching" is true, IoTHubTransportAMQP_DoWork shall create one AMQP message with message_create() and set its format to 0x80013700 with message_set_message_format() for every batch of events] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_203: [Each batched event shall be written with AmqpEventEncoder_Encode, straight from the content and the properties of the event, and added to the batched message with message_add_body_amqp_data] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_214: [IoTHubTransportAMQP_DoWork shall create the encoder of the batched events with AmqpEventEncoder_Create the first time it has events to batch; if that fails, IoTHubTransportAMQP_DoWork shall leave the events in waitingToSend and return] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_208: [If messagesender_send() succeeds for a batch, IoTHubTransportAMQP_DoWork shall call IoTHubClient_LL_SendStarted with the owner of the events, the first event of the batch, the number of batched events and the size of the batch, unless the batch was already completed from within messagesender_send()] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_209: [IoTHubTransportAMQP_DoWork shall pass the batched message to messagesender_send() along with on_event_batch_send_complete as callback] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_211: [IotHubTransportAMQP_SetOption shall save and apply the value if the option name is "Batching", returning IOTHUB_CLIENT_OK] */
+TEST_FUNCTION(AMQP_DoWork_with_Batching_sends_2_events_in_1_batched_message)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3242,53 +3515,50 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_IoTHubMessage_Propertie
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 	time_t current_time = time(NULL);
-	int subscribe_result;
-
-	resetTestSuiteState();
+	bool batching = true;
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching));
 
-	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
-
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
-	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	addTestEvents(config.waitingToSend, 2, true);
+	IOTHUB_MESSAGE_LIST* first_event = containingRecord(config.waitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry);
 	mocks.ResetAllCalls();
 
-	test_amqpvalue_get_string_index = 0;
-
-	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
-	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
-
-	// readPropertiesFromuAMQPMessage()
-	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
-
-	// readApplicationPropertiesFromuAMQPMessage
-	test_amqpvalue_get_map_pair_count = 2;
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn((MAP_HANDLE)NULL);
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
 
-	// End of on_message_received()
-	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, AmqpEventEncoder_Create());
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_set_message_format(TEST_EVENT_MESSAGE_HANDLE, TEST_AMQP_BATCHING_FORMAT_CODE));
+	setExpectedCallsForBatchedEvent(mocks);
+	setExpectedCallsForBatchedEvent(mocks);
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, first_event, 2, 2 * (TEST_AMQP_ENCODED_SIZE + 8)));
+	EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL));
+	STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
 
 	// act
-	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	// assert
 	mocks.AssertActualAndExpectedCalls();
+	ASSERT_IS_TRUE(BASEIMPLEMENTATION::DList_IsListEmpty(config.waitingToSend) != 0);
 
 	// cleanup
 	transport_interface->IoTHubTransport_Destroy(transport);
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_172: [If message_get_application_properties fails, the error shall be notified and on_message_received shall continue.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_message_get_application_properties_fails)
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_204: [A batch shall take the events from the head of waitingToSend, up to "batching_max_events" events and up to "batching_max_size" bytes; an event that does not fit in a batch on its own shall be sent alone in a batch] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_212: [IotHubTransportAMQP_SetOption shall save and apply the value if the option name is "batching_max_events" or "batching_max_size", returning IOTHUB_CLIENT_OK, or return IOTHUB_CLIENT_INVALID_ARG if the value is 0] */
+TEST_FUNCTION(AMQP_DoWork_with_Batching_and_batching_max_events_1_sends_2_batched_messages)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3300,42 +3570,40 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_message_get_application
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 	time_t current_time = time(NULL);
-	int subscribe_result;
-
-	resetTestSuiteState();
+	bool batching = true;
+	size_t max_events = 1;
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching));
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, transport_interface->IoTHubTransport_SetOption(transport, "batching_max_events", &max_events));
 
-	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
-
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
-	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	addTestEvents(config.waitingToSend, 2, true);
 	mocks.ResetAllCalls();
 
-	test_amqpvalue_get_string_index = 0;
-
-	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
-	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
-
-	// readPropertiesFromuAMQPMessage()
-	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
-
-	// readApplicationPropertiesFromuAMQPMessage
-	test_amqpvalue_get_map_pair_count = 2;
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
-	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
 
-	// End of on_message_received()
-	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, AmqpEventEncoder_Create());
+	for (int i = 0; i < 2; i++)
+	{
+		EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+		EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+		STRICT_EXPECTED_CALL(mocks, message_set_message_format(TEST_EVENT_MESSAGE_HANDLE, TEST_AMQP_BATCHING_FORMAT_CODE));
+		setExpectedCallsForBatchedEvent(mocks);
+		STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, 1, TEST_AMQP_ENCODED_SIZE + 8))
+			.IgnoreArgument(2);
+		EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL));
+		STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+	}
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
 
 	// act
-	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	// assert
 	mocks.AssertActualAndExpectedCalls();
@@ -3345,9 +3613,9 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_message_get_application
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_174: [If amqpvalue_get_inplace_described_value fails, the error shall be notified and on_message_received shall continue.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_inplace_described_value_fails)
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_205: [If creating the batched message, adding an event to it or messagesender_send() fails, IoTHubTransportAMQP_DoWork shall roll back the events of the batch to the head of the waitToSent list, in order, and return] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_208: [If messagesender_send() succeeds for a batch, IoTHubTransportAMQP_DoWork shall call IoTHubClient_LL_SendStarted with the owner of the events, the first event of the batch, the number of batched events and the size of the batch, unless the batch was already completed from within messagesender_send()] */
+TEST_FUNCTION(AMQP_DoWork_with_Batching_when_messagesender_send_fails_rolls_the_events_back_in_order)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3359,55 +3627,55 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_inplace_d
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 	time_t current_time = time(NULL);
-	int subscribe_result;
-
-	resetTestSuiteState();
+	bool batching = true;
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
 
-	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
-
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
-	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	addTestEvents(config.waitingToSend, 2, true);
+	PDLIST_ENTRY first_entry = config.waitingToSend->Flink;
+	PDLIST_ENTRY second_entry = first_entry->Flink;
 	mocks.ResetAllCalls();
 
-	test_amqpvalue_get_string_index = 0;
-
-	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
-	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
-
-	// readPropertiesFromuAMQPMessage()
-	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
-
-	// readApplicationPropertiesFromuAMQPMessage
-	test_amqpvalue_get_map_pair_count = 2;
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
-	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn((AMQP_VALUE)NULL);
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
 
-	// End of on_message_received()
-	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, AmqpEventEncoder_Create());
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_set_message_format(TEST_EVENT_MESSAGE_HANDLE, TEST_AMQP_BATCHING_FORMAT_CODE));
+	setExpectedCallsForBatchedEvent(mocks);
+	setExpectedCallsForBatchedEvent(mocks);
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL))
+		.SetReturn(1);
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
+	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertHeadList(config.waitingToSend, second_entry));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertHeadList(config.waitingToSend, first_entry));
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
 
 	// act
-	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
-	
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
 	// assert
 	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(void_ptr, first_entry, config.waitingToSend->Flink);
+	ASSERT_ARE_EQUAL(void_ptr, second_entry, config.waitingToSend->Flink->Flink);
 
 	// cleanup
 	transport_interface->IoTHubTransport_Destroy(transport);
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_176: [If amqpvalue_get_map_pair_count fails, the error shall be notified and on_message_received shall continue.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_map_pair_count_fails)
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_214: [IoTHubTransportAMQP_DoWork shall create the encoder of the batched events with AmqpEventEncoder_Create the first time it has events to batch; if that fails, IoTHubTransportAMQP_DoWork shall leave the events in waitingToSend and return] */
+TEST_FUNCTION(AMQP_DoWork_with_Batching_when_AmqpEventEncoder_Create_fails_leaves_the_events_in_waitingToSend)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3419,55 +3687,38 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_map_pair_
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 	time_t current_time = time(NULL);
-	int subscribe_result;
-
-	resetTestSuiteState();
+	bool batching = true;
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
 
-	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
-
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
-	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	addTestEvents(config.waitingToSend, 2, true);
 	mocks.ResetAllCalls();
 
-	test_amqpvalue_get_string_index = 0;
-
-	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
-	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
-
-	// readPropertiesFromuAMQPMessage()
-	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
-
-	// readApplicationPropertiesFromuAMQPMessage
-	test_amqpvalue_get_map_pair_count = 2;
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
-	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(1);
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
 
-	// End of on_message_received()
-	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, AmqpEventEncoder_Create())
+		.SetReturn((AMQPEVENTENCODER_HANDLE)NULL);
 
 	// act
-	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	// assert
 	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(void_ptr, config.waitingToSend, config.waitingToSend->Flink->Flink->Flink);
 
 	// cleanup
 	transport_interface->IoTHubTransport_Destroy(transport);
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_187: [If message_get_application_properties succeeds but returns a NULL application properties map (there are no properties), on_message_received shall continue normally.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_NO_app_properties_succeeds)
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_202: [If AmqpEventEncoder_Encode returns AMQPEVENTENCODER_INVALID_MESSAGE, the event shall be completed with IOTHUB_BATCHSTATE_FAILED and left out of the batch] */
+TEST_FUNCTION(AMQP_DoWork_with_Batching_completes_an_invalid_event_as_failed_and_batches_the_others)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3479,46 +3730,47 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_NO_app_properties_succeeds)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 	time_t current_time = time(NULL);
-	int subscribe_result;
-
-	resetTestSuiteState();
+	bool batching = true;
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
 
-	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
-
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
-	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	addTestEvents(config.waitingToSend, 2, true);
+	IOTHUB_MESSAGE_LIST* second_event = containingRecord(config.waitingToSend->Flink->Flink, IOTHUB_MESSAGE_LIST, entry);
 	mocks.ResetAllCalls();
 
-	test_amqpvalue_get_string_index = 0;
-
-	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
-	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
-
-	// readPropertiesFromuAMQPMessage()
-	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
-
-	// readApplicationPropertiesFromuAMQPMessage
-	test_amqpvalue_get_map_pair_count = 2;
-	test_message_get_application_properties_return = NULL;
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
-	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	
-	// End of on_message_received()
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_ACCEPTED);
-	STRICT_EXPECTED_CALL(mocks, messaging_delivery_accepted());
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, AmqpEventEncoder_Create());
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_set_message_format(TEST_EVENT_MESSAGE_HANDLE, TEST_AMQP_BATCHING_FORMAT_CODE));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, AmqpEventEncoder_Encode(TEST_AMQPEVENTENCODER_HANDLE, TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(AMQPEVENTENCODER_INVALID_MESSAGE);
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
+	EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+		.IgnoreArgument(2);
+	setExpectedCallsForBatchedEvent(mocks);
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, second_event, 1, TEST_AMQP_ENCODED_SIZE + 8));
+	EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL));
+	STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
 
 	// act
-	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
-
-	test_message_get_application_properties_return = TEST_AMQP_MAP_VALUE;
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	// assert
 	mocks.AssertActualAndExpectedCalls();
@@ -3528,8 +3780,9 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_NO_app_properties_succeeds)
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_177: [on_message_received shall iterate through each uAMQP application property and add it on IOTHUB_MESSAGE_HANDLE properties.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_EMPTY_app_properties_succeeds)
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_206: [The callback 'on_event_batch_send_complete' shall remove the events of the batch from the in-progress list] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_207: [The callback 'on_event_batch_send_complete' shall complete all the events of the batch with one call to IoTHubClient_LL_SendComplete, passing IOTHUB_BATCHSTATE_SUCCESS if the result received is MESSAGE_SEND_OK and IOTHUB_BATCHSTATE_FAILED otherwise] */
+TEST_FUNCTION(AMQP_on_event_batch_send_complete_completes_all_the_batched_events_at_once)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3541,45 +3794,31 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_EMPTY_app_properties_succeeds)
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 	time_t current_time = time(NULL);
-	int subscribe_result;
-
-	resetTestSuiteState();
+	bool batching = true;
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
 
-	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+	addTestEvents(config.waitingToSend, 2, true);
+	mocks.ResetAllCalls();
+	EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
 	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
+	ASSERT_IS_NOT_NULL(saved_on_message_send_complete_callback);
 	mocks.ResetAllCalls();
 
-	test_amqpvalue_get_string_index = 0;
-
-	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
-	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
-
-	// readPropertiesFromuAMQPMessage()
-	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
-
-	// readApplicationPropertiesFromuAMQPMessage
-	test_amqpvalue_get_map_pair_count = 0;
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
-	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(0);
-
-	// End of on_message_received()
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_ACCEPTED);
-	STRICT_EXPECTED_CALL(mocks, messaging_delivery_accepted());
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).ExpectedTimesExactly(3);
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
+	EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+		.IgnoreArgument(2);
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
 	// act
-	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
+	saved_on_message_send_complete_callback(saved_on_message_send_complete_context, MESSAGE_SEND_ERROR);
 
 	// assert
 	mocks.AssertActualAndExpectedCalls();
@@ -3589,9 +3828,9 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_EMPTY_app_properties_succeeds)
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_179: [If amqpvalue_get_map_key_value_pair fails, the error shall be notified and on_message_received shall continue.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_map_key_value_pair_fails)
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_216: [IoTHubTransportAMQP_DoWork shall not take more events from waitingToSend once "max_unsettled_transfers" events sent one by one are unsettled, unless "max_unsettled_transfers" is 0] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_223: [IotHubTransportAMQP_SetOption shall save and apply the value (size_t) if the option name is "max_unsettled_transfers", returning IOTHUB_CLIENT_OK; 0 removes the limit] */
+TEST_FUNCTION(AMQP_DoWork_with_max_unsettled_transfers_1_leaves_the_second_event_in_waitingToSend)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3603,59 +3842,38 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_map_key_v
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 	time_t current_time = time(NULL);
-	int subscribe_result;
-
-	resetTestSuiteState();
+	size_t max_unsettled_transfers = 1;
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, transport_interface->IoTHubTransport_SetOption(transport, "max_unsettled_transfers", &max_unsettled_transfers));
 
-	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
-
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
-	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	addTestEvents(config.waitingToSend, 2, true);
+	PDLIST_ENTRY second_entry = config.waitingToSend->Flink->Flink;
 	mocks.ResetAllCalls();
 
-	test_amqpvalue_get_string_index = 0;
-
-	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
-	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
-
-	// readPropertiesFromuAMQPMessage()
-	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
-
-	// readApplicationPropertiesFromuAMQPMessage
-	test_amqpvalue_get_map_pair_count = 2;
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
-	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(0);
-
-	// First property.
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 0, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(1);
-
-	// End of on_message_received()
-	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
+	setExpectedCallsForSendPendingEvents_SingleEvent(mocks, IOTHUBMESSAGE_BYTEARRAY, current_time);
 
 	// act
-	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	// assert
 	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(void_ptr, second_entry, config.waitingToSend->Flink);
+	ASSERT_ARE_EQUAL(void_ptr, config.waitingToSend, second_entry->Flink);
 
 	// cleanup
 	transport_interface->IoTHubTransport_Destroy(transport);
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_181: [If amqpvalue_get_string fails, the error shall be notified and on_message_received shall continue.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_name_fails)
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_215: [IoTHubTransportAMQP_Create shall set incoming_window_size to UINT_MAX, outgoing_window_size to 100, sender_max_link_size to UINT64_MAX, receiver_max_link_size to 65536 and max_unsettled_transfers to 0 (no limit).] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_216: [IoTHubTransportAMQP_DoWork shall not take more events from waitingToSend once "max_unsettled_transfers" events sent one by one are unsettled, unless "max_unsettled_transfers" is 0] */
+TEST_FUNCTION(AMQP_DoWork_by_default_sends_more_events_than_the_outgoing_window_size_without_waiting_for_settlement)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3667,60 +3885,244 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_na
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 	time_t current_time = time(NULL);
-	int subscribe_result;
-
-	resetTestSuiteState();
+	int number_of_events = 101;
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
-
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
-	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	addTestEvents(config.waitingToSend, number_of_events, true);
 	mocks.ResetAllCalls();
 
-	test_amqpvalue_get_string_index = 0;
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
+	setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_BYTEARRAY, current_time, number_of_events);
 
-	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
-	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
+	// act
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	// readPropertiesFromuAMQPMessage()
-	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_IS_TRUE(BASEIMPLEMENTATION::DList_IsListEmpty(config.waitingToSend) != 0);
 
-	// readApplicationPropertiesFromuAMQPMessage
-	test_amqpvalue_get_map_pair_count = 2;
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
-	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(0);
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_216: [IoTHubTransportAMQP_DoWork shall not take more events from waitingToSend once "max_unsettled_transfers" events sent one by one are unsettled, unless "max_unsettled_transfers" is 0] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_231: [The callback 'on_message_send_complete' shall take the event off the count of unsettled transfers of the device that sent it] */
+TEST_FUNCTION(AMQP_DoWork_with_max_unsettled_transfers_1_sends_the_next_event_once_the_first_is_settled)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
 
-	// First property.
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 0, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(1);
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	size_t max_unsettled_transfers = 1;
 
-	// End of on_message_received()
-	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "max_unsettled_transfers", &max_unsettled_transfers);
+
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+	addTestEvents(config.waitingToSend, 2, true);
+	mocks.ResetAllCalls();
+	setExpectedCallsForSendPendingEvents_SingleEvent(mocks, IOTHUBMESSAGE_BYTEARRAY, current_time);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	ASSERT_IS_FALSE(BASEIMPLEMENTATION::DList_IsListEmpty(config.waitingToSend) != 0);
+	saved_on_message_send_complete_callback(saved_on_message_send_complete_context, MESSAGE_SEND_OK);
+	mocks.ResetAllCalls();
+	setExpectedCallsForSendPendingEvents_SingleEvent(mocks, IOTHUBMESSAGE_BYTEARRAY, current_time);
 
 	// act
-	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	// assert
+	ASSERT_IS_TRUE(BASEIMPLEMENTATION::DList_IsListEmpty(config.waitingToSend) != 0);
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_218: [IoTHubTransportAMQP_DoWork shall not take more events from waitingToSend once "max_unsettled_transfers" batched messages are unsettled, unless "max_unsettled_transfers" is 0] */
+TEST_FUNCTION(AMQP_DoWork_with_Batching_and_max_unsettled_transfers_1_sends_1_batched_message)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	bool batching = true;
+	size_t max_events = 1;
+	size_t max_unsettled_transfers = 1;
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "batching_max_events", &max_events);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "max_unsettled_transfers", &max_unsettled_transfers);
+
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+	addTestEvents(config.waitingToSend, 2, true);
+	PDLIST_ENTRY second_entry = config.waitingToSend->Flink->Flink;
+	mocks.ResetAllCalls();
+
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
+
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, AmqpEventEncoder_Create());
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_set_message_format(TEST_EVENT_MESSAGE_HANDLE, TEST_AMQP_BATCHING_FORMAT_CODE));
+	setExpectedCallsForBatchedEvent(mocks);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, 1, TEST_AMQP_ENCODED_SIZE + 8))
+		.IgnoreArgument(2);
+	EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL));
+	STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+
+	// act
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	// assert
 	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(void_ptr, second_entry, config.waitingToSend->Flink);
+	ASSERT_ARE_EQUAL(void_ptr, config.waitingToSend, second_entry->Flink);
 
 	// cleanup
 	transport_interface->IoTHubTransport_Destroy(transport);
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_183: [If amqpvalue_get_string fails, the error shall be notified and on_message_received shall continue.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_value_fails)
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_217: [The callback 'on_event_batch_send_complete' shall take the batch off the count of unsettled transfers of the device that sent it] */
+TEST_FUNCTION(AMQP_DoWork_with_Batching_and_max_unsettled_transfers_1_sends_the_next_batch_once_the_first_is_settled)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	bool batching = true;
+	size_t max_events = 1;
+	size_t max_unsettled_transfers = 1;
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "batching_max_events", &max_events);
+	(void)transport_interface->IoTHubTransport_SetOption(transport, "max_unsettled_transfers", &max_unsettled_transfers);
+
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+	addTestEvents(config.waitingToSend, 2, true);
+	mocks.ResetAllCalls();
+	EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	ASSERT_IS_FALSE(BASEIMPLEMENTATION::DList_IsListEmpty(config.waitingToSend) != 0);
+	saved_on_message_send_complete_callback(saved_on_message_send_complete_context, MESSAGE_SEND_OK);
+	mocks.ResetAllCalls();
+	EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+
+	// act
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	// assert
+	ASSERT_IS_TRUE(BASEIMPLEMENTATION::DList_IsListEmpty(config.waitingToSend) != 0);
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_100: [The callback 'on_message_send_complete' shall remove the target message from the in-progress list before completing it] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_142: [The callback 'on_message_send_complete' shall complete the message with IOTHUB_BATCHSTATE_SUCCESS if the result received is MESSAGE_SEND_OK] */
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_198: [The callback 'on_message_send_complete' shall complete the message by calling IoTHubClient_LL_SendComplete with the IOTHUB_CLIENT_LL_HANDLE that queued the message (message->owner) and a list containing only the message] */
+TEST_FUNCTION(AMQP_on_message_send_complete_completes_the_message_through_IoTHubClient_LL_SendComplete)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+	addTestEvents(config.waitingToSend, 1, true);
+	mocks.ResetAllCalls();
+
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
+	setExpectedCallsForSendPendingEvents_SingleEvent(mocks, IOTHUBMESSAGE_BYTEARRAY, current_time);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	ASSERT_IS_NOT_NULL(saved_on_message_send_complete_callback);
+	mocks.ResetAllCalls();
+
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
+
+	// act
+	saved_on_message_send_complete_callback(saved_on_message_send_complete_context, MESSAGE_SEND_OK);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+/* Test_SRS_IOTHUBTRANSPORTAMQP_09_155: [uAMQP message properties shall be retrieved using message_get_properties.] */
+/* Test_SRS_IOTHUBTRANSPORTAMQP_09_157: [The message-id property shall be read from the uAMQP message by calling properties_get_message_id.] */
+/* Test_SRS_IOTHUBTRANSPORTAMQP_09_159: [The message-id value shall be retrieved from the AMQP_VALUE as char* by calling amqpvalue_get_string.] */
+/* Test_SRS_IOTHUBTRANSPORTAMQP_09_161: [The message-id property shall be set on the IOTHUB_MESSAGE_HANDLE by calling IoTHubMessage_SetMessageId, passing the value read from the uAMQP message.] */
+/* Test_SRS_IOTHUBTRANSPORTAMQP_09_163: [The correlation-id property shall be read from the uAMQP message by calling properties_get_correlation_id.] */
+/* Test_SRS_IOTHUBTRANSPORTAMQP_09_165: [The correlation-id value shall be retrieved from the AMQP_VALUE as char* by calling amqpvalue_get_string.] */
+/* Test_SRS_IOTHUBTRANSPORTAMQP_09_167: [The correlation-id property shall be set on the IOTHUB_MESSAGE_HANDLE by calling IoTHubMessage_SetCorrelationId, passing the value read from the uAMQP message.] */
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_169: [The callback on_message_received shall read the application properties from the uAMQP message and set it on the IoT Hub Message if any are provided.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_170: [The IOTHUB_MESSAGE_HANDLE properties shall be retrieved using IoTHubMessage_Properties.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_171: [uAMQP message application properties shall be retrieved using message_get_application_properties.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_173: [The actual uAMQP message application properties should be extracted from the result of message_get_application_properties using amqpvalue_get_inplace_described_value.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_175: [The number of items in the uAMQP message application properties shall be obtained using amqpvalue_get_map_pair_count.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_177: [on_message_received shall iterate through each uAMQP application property and add it on IOTHUB_MESSAGE_HANDLE properties.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_178: [The uAMQP application property name and value shall be obtained using amqpvalue_get_map_key_value_pair.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_180: [The uAMQP application property name shall be extracted as string using amqpvalue_get_string.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_182: [The uAMQP application property value shall be extracted as string using amqpvalue_get_string.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_184: [The application property name and value shall be added to IOTHUB_MESSAGE_HANDLE properties using Map_AddOrUpdate.]
+TEST_FUNCTION(AMQP_DoWork_receive_message_read_properties_succeeds)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3737,12 +4139,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_va
 	resetTestSuiteState();
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
 	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
 	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	mocks.ResetAllCalls();
@@ -3754,7 +4157,19 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_va
 	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
 
 	// readPropertiesFromuAMQPMessage()
-	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
+	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, properties_destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+	EXPECTED_CALL(mocks, properties_get_message_id(NULL, NULL)).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_type(NULL)).SetReturn(AMQP_TYPE_MAP);
+	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetMessageId(TEST_IOTHUB_MESSAGE_HANDLE, test_amqpvalue_get_string_values[0])).SetReturn(IOTHUB_MESSAGE_OK);
+	
+	EXPECTED_CALL(mocks, properties_get_correlation_id(NULL, NULL)).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_type(NULL)).SetReturn(AMQP_TYPE_MAP);
+	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetCorrelationId(TEST_IOTHUB_MESSAGE_HANDLE, test_amqpvalue_get_string_values[1])).SetReturn(IOTHUB_MESSAGE_OK);
 
 	// readApplicationPropertiesFromuAMQPMessage
 	test_amqpvalue_get_map_pair_count = 2;
@@ -3767,15 +4182,23 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_va
 	// First property.
 	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 0, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(0);
 	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(1);
+	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_HANDLE, test_amqpvalue_get_string_values[2], test_amqpvalue_get_string_values[3])).SetReturn(MAP_OK);
+
+	// Second property.
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 1, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_HANDLE, test_amqpvalue_get_string_values[4], test_amqpvalue_get_string_values[5])).SetReturn(MAP_OK);
 
 	// End of on_message_received()
-	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_ACCEPTED);
+	STRICT_EXPECTED_CALL(mocks, messaging_delivery_accepted());
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
 
 	// act
 	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
-
+	
 	// assert
 	mocks.AssertActualAndExpectedCalls();
 
@@ -3784,9 +4207,9 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_va
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_185: [If Map_AddOrUpdate fails, the error shall be notified and on_message_received shall continue.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_186: [If IoTHubMessage_Properties fails, the error shall be notified and on_message_received shall continue.]
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
-TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_Map_AddOrUpdate_fails)
+TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_IoTHubMessage_Properties_fails)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3803,12 +4226,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_Map_AddOrUpdate_fails)
 	resetTestSuiteState();
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
 	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
 	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	mocks.ResetAllCalls();
@@ -3825,20 +4249,12 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_Map_AddOrUpdate_fails)
 	// readApplicationPropertiesFromuAMQPMessage
 	test_amqpvalue_get_map_pair_count = 2;
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
-	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 0, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
-	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
-	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_HANDLE, test_amqpvalue_get_string_values[0], test_amqpvalue_get_string_values[1])).SetReturn(MAP_ERROR);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn((MAP_HANDLE)NULL);
 
 	// End of on_message_received()
 	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
 
-
 	// act
 	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
 
@@ -3850,139 +4266,130 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_Map_AddOrUpdate_fails)
 	cleanupList(config.waitingToSend);
 }
 
-// Codes_SRS_IOTHUBTRANSPORTAMQP_09_041: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter.] 
-// Codes_SRS_IOTHUBTRANSPORTAMQP_09_042: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there are currently no event items to be sent or being sent.]
-TEST_FUNCTION(AMQP_GetSendStatus_idle_succeeds)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_172: [If message_get_application_properties fails, the error shall be notified and on_message_received shall continue.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
+TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_message_get_application_properties_fails)
 {
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	int subscribe_result;
 
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	resetTestSuiteState();
 
-    IOTHUB_CLIENT_STATUS iotHubClientStatus;
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    mocks.ResetAllCalls();
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+	mocks.ResetAllCalls();
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    // act
-    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(transport, &iotHubClientStatus);
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
-    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK, "IoTHubTransport_GetSendStatus returned unexpected result.");
-    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_STATUS, iotHubClientStatus, IOTHUB_CLIENT_SEND_STATUS_IDLE, "IoTHubTransport_GetSendStatus returned unexpected status.");
+	mocks.ResetAllCalls();
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
-}
+	test_amqpvalue_get_string_index = 0;
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_041: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter.]  
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_043: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent.] 
-TEST_FUNCTION(AMQP_GetSendStatus_inProgress_not_empty_succeeds)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
+	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
+	// readPropertiesFromuAMQPMessage()
+	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
 
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	// readApplicationPropertiesFromuAMQPMessage
+	test_amqpvalue_get_map_pair_count = 2;
 
-    IOTHUB_CLIENT_STATUS iotHubClientStatus;
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
 
-    mocks.ResetAllCalls();
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+	// End of on_message_received()
+	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
 
-    // act
-    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(transport, &iotHubClientStatus);
+	// act
+	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
-    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK, "IoTHubTransport_GetSendStatus returned unexpected result.");
-    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_STATUS, iotHubClientStatus, IOTHUB_CLIENT_SEND_STATUS_BUSY, "IoTHubTransport_GetSendStatus returned unexpected status.");
+	// assert
+	mocks.AssertActualAndExpectedCalls();
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_041: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter.]  
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_043: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent.] 
-TEST_FUNCTION(AMQP_GetSendStatus_waitingToSend_not_empty_succeeds)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_174: [If amqpvalue_get_inplace_described_value fails, the error shall be notified and on_message_received shall continue.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
+TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_inplace_described_value_fails)
 {
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	int subscribe_result;
 
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	resetTestSuiteState();
 
-    IOTHUB_CLIENT_STATUS iotHubClientStatus;
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    mocks.ResetAllCalls();
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+	mocks.ResetAllCalls();
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    // act
-    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(transport, &iotHubClientStatus);
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
-    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK, "IoTHubTransport_GetSendStatus returned unexpected result.");
-    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_STATUS, iotHubClientStatus, IOTHUB_CLIENT_SEND_STATUS_BUSY, "IoTHubTransport_GetSendStatus returned unexpected status.");
+	mocks.ResetAllCalls();
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
-}
+	test_amqpvalue_get_string_index = 0;
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_037: [IoTHubTransportAMQP_Subscribe shall fail if the transport handle parameter received is NULL.]
-TEST_FUNCTION(AMQP_Subscribe_NULL_transport_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
+	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	// readPropertiesFromuAMQPMessage()
+	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
 
-    mocks.ResetAllCalls();
+	// readApplicationPropertiesFromuAMQPMessage
+	test_amqpvalue_get_map_pair_count = 2;
 
-    // act
-    transport_interface->IoTHubTransport_Subscribe(NULL);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn((AMQP_VALUE)NULL);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
+	// End of on_message_received()
+	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
+	// act
+	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
+	
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_121: [IoTHubTransportAMQP_DoWork shall create an AMQP message_receiver if transport_state->message_receive is NULL and transport_state->receive_messages is true]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_123: [IoTHubTransportAMQP_DoWork shall create each AMQP message_receiver passing the on_message_received as the callback function]
-TEST_FUNCTION(AMQP_Subscribe_and_messagereceiver_create_succeeds)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_176: [If amqpvalue_get_map_pair_count fails, the error shall be notified and on_message_received shall continue.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
+TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_map_pair_count_fails)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -3999,171 +4406,177 @@ TEST_FUNCTION(AMQP_Subscribe_and_messagereceiver_create_succeeds)
 	resetTestSuiteState();
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
 	mocks.ResetAllCalls();
 	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-	// act
-	subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
 	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	mocks.ResetAllCalls();
+
+	test_amqpvalue_get_string_index = 0;
+
+	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
+	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
+
+	// readPropertiesFromuAMQPMessage()
+	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
+
+	// readApplicationPropertiesFromuAMQPMessage
+	test_amqpvalue_get_map_pair_count = 2;
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(1);
+
+	// End of on_message_received()
+	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+
+	// act
+	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
+
 	// assert
 	mocks.AssertActualAndExpectedCalls();
-	ASSERT_ARE_EQUAL(int, subscribe_result, 0);
-	ASSERT_IS_NOT_NULL(saved_on_message_received_callback);
-	ASSERT_ARE_EQUAL(void_ptr, (void_ptr)saved_on_message_received_context, (void_ptr)TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	// cleanup
 	transport_interface->IoTHubTransport_Destroy(transport);
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_039: [IoTHubTransportAMQP_Unsubscribe shall fail if the transport handle parameter received is NULL.]
-TEST_FUNCTION(AMQP_Unsubscribe_NULL_transport_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_187: [If message_get_application_properties succeeds but returns a NULL application properties map (there are no properties), on_message_received shall continue normally.]
+TEST_FUNCTION(AMQP_DoWork_receive_message_NO_app_properties_succeeds)
 {
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-
-    mocks.ResetAllCalls();
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	int subscribe_result;
 
-    // act
-    transport_interface->IoTHubTransport_Unsubscribe(NULL);
+	resetTestSuiteState();
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
-}
+	mocks.ResetAllCalls();
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_044: [If handle parameter is NULL then IoTHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]
-TEST_FUNCTION(AMQP_SetOption_NULL_transport_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
 
-    mocks.ResetAllCalls();
+	test_amqpvalue_get_string_index = 0;
 
-    // act
-    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(NULL, TEST_OPTION_SASTOKEN_LIFETIME, TEST_RANDOM_CHAR_SEQ);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
+	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
-    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG, "IoTHubTransport_SetOption returned unexpected result.");
+	// readPropertiesFromuAMQPMessage()
+	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
-}
+	// readApplicationPropertiesFromuAMQPMessage
+	test_amqpvalue_get_map_pair_count = 2;
+	test_message_get_application_properties_return = NULL;
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_045: [If parameter optionName is NULL then IoTHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] 
-TEST_FUNCTION(AMQP_SetOption_NULL_option_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	
+	// End of on_message_received()
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_ACCEPTED);
+	STRICT_EXPECTED_CALL(mocks, messaging_delivery_accepted());
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	// act
+	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
 
-    mocks.ResetAllCalls();
+	test_message_get_application_properties_return = TEST_AMQP_MAP_VALUE;
 
+	// assert
+	mocks.AssertActualAndExpectedCalls();
 
-    // act
-    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, NULL, TEST_RANDOM_CHAR_SEQ);
-
-    // assert
-    mocks.AssertActualAndExpectedCalls();
-    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG, "IoTHubTransport_SetOption returned unexpected result.");
-
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_046: [If parameter value is NULL then IoTHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]
-TEST_FUNCTION(AMQP_SetOption_NULL_value_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_177: [on_message_received shall iterate through each uAMQP application property and add it on IOTHUB_MESSAGE_HANDLE properties.]
+TEST_FUNCTION(AMQP_DoWork_receive_message_EMPTY_app_properties_succeeds)
 {
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	int subscribe_result;
 
-    mocks.ResetAllCalls();
+	resetTestSuiteState();
 
-    // act
-    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, TEST_OPTION_SASTOKEN_LIFETIME, NULL);
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
-    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG, "IoTHubTransport_SetOption returned unexpected result.");
+	mocks.ResetAllCalls();
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
-}
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_047: [If the option name does not match one of the options handled by this module, then IoTHubTransportAMQP_SetOption shall get  the handle to the XIO and invoke the xio_setoption passing down the option name and value parameters.] 
-TEST_FUNCTION(AMQP_SetOption_invokes_xio_setoption_succeeds)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	mocks.ResetAllCalls();
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-	const char* SOME_OPTION = "AnOption";
-	const void* SOME_VALUE = (void*)42;
+	test_amqpvalue_get_string_index = 0;
 
-    mocks.ResetAllCalls();
+	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
+	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
 
-	EXPECTED_CALL(mocks, STRING_c_str(NULL));
-	EXPECTED_CALL(mocks, platform_get_default_tlsio()).SetReturn(TEST_TLS_IO_INTERFACE_DESC);
-	EXPECTED_CALL(mocks, xio_create(NULL, NULL, NULL)).SetReturn(TEST_TLS_IO_INTERFACE);
-	STRICT_EXPECTED_CALL(mocks, xio_setoption(NULL, SOME_OPTION, SOME_VALUE))
-		.IgnoreArgument(1);
+	// readPropertiesFromuAMQPMessage()
+	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
+
+	// readApplicationPropertiesFromuAMQPMessage
+	test_amqpvalue_get_map_pair_count = 0;
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(0);
+
+	// End of on_message_received()
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_ACCEPTED);
+	STRICT_EXPECTED_CALL(mocks, messaging_delivery_accepted());
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
 
 	// act
-    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, SOME_OPTION, SOME_VALUE);
+	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
+	// assert
+	mocks.AssertActualAndExpectedCalls();
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_03_001: [If xio_setoption fails, IoTHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_ERROR.] */
-TEST_FUNCTION(AMQP_SetOption_fails_when_xio_setoption_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_179: [If amqpvalue_get_map_key_value_pair fails, the error shall be notified and on_message_received shall continue.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
+TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_map_key_value_pair_fails)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -4174,233 +4587,261 @@ TEST_FUNCTION(AMQP_SetOption_fails_when_xio_setoption_fails)
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	int subscribe_result;
+
+	resetTestSuiteState();
+
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-	const char* SOME_OPTION = "AnOption";
-	const void* SOME_VALUE = (void*)42;
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+	mocks.ResetAllCalls();
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
+
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, STRING_c_str(NULL));
-	EXPECTED_CALL(mocks, platform_get_default_tlsio()).SetReturn(TEST_TLS_IO_INTERFACE_DESC);
-	EXPECTED_CALL(mocks, xio_create(NULL, NULL, NULL)).SetReturn(TEST_TLS_IO_INTERFACE);
-	STRICT_EXPECTED_CALL(mocks, xio_setoption(NULL, SOME_OPTION, SOME_VALUE))
-		.IgnoreArgument(1)
-		.SetReturn(42);
+	test_amqpvalue_get_string_index = 0;
+
+	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
+	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
+
+	// readPropertiesFromuAMQPMessage()
+	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
+
+	// readApplicationPropertiesFromuAMQPMessage
+	test_amqpvalue_get_map_pair_count = 2;
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(0);
+
+	// First property.
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 0, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(1);
+
+	// End of on_message_received()
+	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
 
 	// act
-	IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, SOME_OPTION, SOME_VALUE);
+	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
 
 	// assert
 	mocks.AssertActualAndExpectedCalls();
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
 
 	// cleanup
 	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_getting_the_properties_map_for_a_message_to_be_sent_fails_AMQP_DoWork_reports_the_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_181: [If amqpvalue_get_string fails, the error shall be notified and on_message_received shall continue.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
+TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_name_fails)
 {
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
-
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	int subscribe_result;
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	resetTestSuiteState();
 
-    addTestEvents(config.waitingToSend, 1, true);
-    mocks.ResetAllCalls();
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
+	mocks.ResetAllCalls();
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+	mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn((MAP_HANDLE)NULL);
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+	test_amqpvalue_get_string_index = 0;
 
-    // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
+	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
+	// readPropertiesFromuAMQPMessage()
+	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
-}
+	// readApplicationPropertiesFromuAMQPMessage
+	test_amqpvalue_get_map_pair_count = 2;
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_getting_the_internals_for_the_properties_map_for_a_message_to_be_sent_fails_AMQP_DoWork_reports_the_error)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(0);
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
+	// First property.
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 0, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(1);
 
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	// End of on_message_received()
+	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	// act
+	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
 
-    addTestEvents(config.waitingToSend, 1, true);
-    mocks.ResetAllCalls();
+	// assert
+	mocks.AssertActualAndExpectedCalls();
 
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_183: [If amqpvalue_get_string fails, the error shall be notified and on_message_received shall continue.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
+TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_value_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
 
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	int subscribe_result;
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &no_property_keys_ptr, sizeof(no_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &no_property_values_ptr, sizeof(no_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &no_property_size, sizeof(no_property_size))
-        .SetReturn(MAP_ERROR);
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+	resetTestSuiteState();
 
-    // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
+	mocks.ResetAllCalls();
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	mocks.ResetAllCalls();
+
+	test_amqpvalue_get_string_index = 0;
+
+	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
+	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
+
+	// readPropertiesFromuAMQPMessage()
+	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
+
+	// readApplicationPropertiesFromuAMQPMessage
+	test_amqpvalue_get_map_pair_count = 2;
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(0);
+	
+	// First property.
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 0, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(1);
+
+	// End of on_message_received()
+	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+
+	// act
+	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_008: [All properties shall be transferred to a uAMQP map.] */
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_009: [The uAMQP map shall be created by calling amqpvalue_create_map.] */
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_010: [A key uAMQP value shall be created by using amqpvalue_create_string.] */
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_011: [A value uAMQP value shall be created by using amqpvalue_create_string.] */
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_012: [The key/value pair for the property shall be set into the uAMQP property map by calling amqpvalue_map_set_value.] */
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_013: [After all properties have been filled in the uAMQP map, the uAMQP properties map shall be set on the uAMQP message by calling message_set_application_properties.] */
-TEST_FUNCTION(AMQP_DoWork_encodes_two_properties_on_an_IoTHub_Message_before_giving_it_to_uAMQP)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_185: [If Map_AddOrUpdate fails, the error shall be notified and on_message_received shall continue.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_188: [If on_message_received fails reading the application properties from the uAMQP message, it shall NOT call IoTHubClient_LL_MessageCallback and shall reject the message.]
+TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_Map_AddOrUpdate_fails)
 {
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
 
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	int subscribe_result;
 
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	resetTestSuiteState();
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    addTestEvents(config.waitingToSend, 1, true);
-    mocks.ResetAllCalls();
+	mocks.ResetAllCalls();
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+	mocks.ResetAllCalls();
 
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+	test_amqpvalue_get_string_index = 0;
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
-        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
-        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, message_set_application_properties(TEST_EVENT_MESSAGE_HANDLE, TEST_UAMQP_MAP));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
-    EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL));
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_type(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, message_get_body_amqp_data(TEST_MESSAGE_HANDLE, 0, NULL)).IgnoreArgument(3).SetReturn(0);
+	EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE);
 
-    // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	// readPropertiesFromuAMQPMessage()
+	STRICT_EXPECTED_CALL(mocks, message_get_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(1);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
+	// readApplicationPropertiesFromuAMQPMessage
+	test_amqpvalue_get_map_pair_count = 2;
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(TEST_MAP_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, message_get_application_properties(TEST_MESSAGE_HANDLE, NULL)).IgnoreArgument(2).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_inplace_described_value(NULL)).SetReturn(TEST_AMQP_MAP_VALUE);
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_pair_count(TEST_AMQP_MAP_VALUE, NULL)).IgnoreArgument(2).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_get_map_key_value_pair(TEST_AMQP_MAP_VALUE, 0, NULL, NULL)).IgnoreArgument(3).IgnoreArgument(4).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
+	EXPECTED_CALL(mocks, amqpvalue_get_string(NULL, NULL)).SetReturn(0);
+	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_HANDLE, test_amqpvalue_get_string_values[0], test_amqpvalue_get_string_values[1])).SetReturn(MAP_ERROR);
+
+	// End of on_message_received()
+	STRICT_EXPECTED_CALL(mocks, messaging_delivery_rejected("Rejected due to failure reading AMQP message", "Failed reading application properties"));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+
+
+	// act
+	saved_on_message_received_callback(saved_on_message_received_context, TEST_MESSAGE_HANDLE);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_creating_the_property_map_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+// Codes_SRS_IOTHUBTRANSPORTAMQP_09_041: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter.] 
+// Codes_SRS_IOTHUBTRANSPORTAMQP_09_042: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there are currently no event items to be sent or being sent.]
+TEST_FUNCTION(AMQP_GetSendStatus_idle_succeeds)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4414,58 +4855,29 @@ TEST_FUNCTION(when_creating_the_property_map_fails_AMQP_DoWork_completes_the_mes
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+    IOTHUB_CLIENT_STATUS iotHubClientStatus;
 
-    addTestEvents(config.waitingToSend, 1, true);
     mocks.ResetAllCalls();
-
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
-
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
-
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn((AMQP_VALUE)NULL);
-
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
 
     // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(devHandle, &iotHubClientStatus);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK, "IoTHubTransport_GetSendStatus returned unexpected result.");
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_STATUS, iotHubClientStatus, IOTHUB_CLIENT_SEND_STATUS_IDLE, "IoTHubTransport_GetSendStatus returned unexpected status.");
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_key_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_041: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter.]  
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_043: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent.] 
+TEST_FUNCTION(AMQP_GetSendStatus_inProgress_not_empty_succeeds)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4479,61 +4891,29 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_key_fails_AMQP_
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+    IOTHUB_CLIENT_STATUS iotHubClientStatus;
 
-    addTestEvents(config.waitingToSend, 1, true);
     mocks.ResetAllCalls();
-
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
-
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
-
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn((AMQP_VALUE)NULL);
-
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
 
     // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(devHandle, &iotHubClientStatus);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK, "IoTHubTransport_GetSendStatus returned unexpected result.");
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_STATUS, iotHubClientStatus, IOTHUB_CLIENT_SEND_STATUS_BUSY, "IoTHubTransport_GetSendStatus returned unexpected status.");
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_value_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_041: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter.]  
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_043: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent.] 
+TEST_FUNCTION(AMQP_GetSendStatus_waitingToSend_not_empty_succeeds)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4547,64 +4927,27 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_value_fails_AMQ
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+    IOTHUB_CLIENT_STATUS iotHubClientStatus;
 
-    addTestEvents(config.waitingToSend, 1, true);
     mocks.ResetAllCalls();
-
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
-
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
-
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn((AMQP_VALUE)NULL);
-
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
 
     // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(devHandle, &iotHubClientStatus);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK, "IoTHubTransport_GetSendStatus returned unexpected result.");
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_STATUS, iotHubClientStatus, IOTHUB_CLIENT_SEND_STATUS_BUSY, "IoTHubTransport_GetSendStatus returned unexpected status.");
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_setting_the_value_for_the_1st_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_233: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_FULL if there are events waiting to be sent and "max_unsettled_transfers" transfers of the device are unsettled]
+TEST_FUNCTION(AMQP_GetSendStatus_waitingToSend_not_empty_and_max_unsettled_transfers_reached_returns_FULL)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4616,69 +4959,41 @@ TEST_FUNCTION(when_setting_the_value_for_the_1st_property_fails_AMQP_DoWork_comp
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     time_t current_time = time(NULL);
+    size_t max_unsettled_transfers = 1;
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, transport_interface->IoTHubTransport_SetOption(transport, "max_unsettled_transfers", &max_unsettled_transfers));
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
-    addTestEvents(config.waitingToSend, 1, true);
+    addTestEvents(config.waitingToSend, 2, true);
     mocks.ResetAllCalls();
-
     setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
     setExpectedCallsForConnectionDoWork(mocks, &config);
+    setExpectedCallsForSendPendingEvents_SingleEvent(mocks, IOTHUBMESSAGE_BYTEARRAY, current_time);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
-
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE))
-        .SetReturn(1);
+    IOTHUB_CLIENT_STATUS iotHubClientStatus;
 
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    mocks.ResetAllCalls();
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
 
     // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(devHandle, &iotHubClientStatus);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK, "IoTHubTransport_GetSendStatus returned unexpected result.");
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_STATUS, iotHubClientStatus, IOTHUB_CLIENT_SEND_STATUS_FULL, "IoTHubTransport_GetSendStatus returned unexpected status.");
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
     cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_key_of_the_2nd_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_037: [IoTHubTransportAMQP_Subscribe shall fail if the transport handle parameter received is NULL.]
+TEST_FUNCTION(AMQP_Subscribe_NULL_transport_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4689,71 +5004,90 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_key_of_the_2nd_property_
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
-
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-
-    addTestEvents(config.waitingToSend, 1, true);
     mocks.ResetAllCalls();
 
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
+    // act
+    transport_interface->IoTHubTransport_Subscribe(NULL);
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+    // assert
+    mocks.AssertActualAndExpectedCalls();
 
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
-        .SetReturn((AMQP_VALUE)NULL);
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_121: [IoTHubTransportAMQP_DoWork shall create an AMQP message_receiver if transport_state->message_receive is NULL and transport_state->receive_messages is true]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_123: [IoTHubTransportAMQP_DoWork shall create each AMQP message_receiver passing the on_message_received as the callback function]
+TEST_FUNCTION(AMQP_Subscribe_and_messagereceiver_create_succeeds)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
 
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+	int subscribe_result;
+
+	resetTestSuiteState();
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+	mocks.ResetAllCalls();
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+	setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
+
+	// act
+	subscribe_result = transport_interface->IoTHubTransport_Subscribe(devHandle);
+	transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(int, subscribe_result, 0);
+	ASSERT_IS_NOT_NULL(saved_on_message_received_callback);
+	ASSERT_ARE_EQUAL(void_ptr, (void_ptr)saved_on_message_received_context, (void_ptr)TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_039: [IoTHubTransportAMQP_Unsubscribe shall fail if the transport handle parameter received is NULL.]
+TEST_FUNCTION(AMQP_Unsubscribe_NULL_transport_fails)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    mocks.ResetAllCalls();
 
     // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    transport_interface->IoTHubTransport_Unsubscribe(NULL);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_value_of_the_2nd_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_044: [If handle parameter is NULL then IoTHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]
+TEST_FUNCTION(AMQP_SetOption_NULL_transport_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4764,73 +5098,53 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_value_of_the_2nd_propert
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
-
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-
-    addTestEvents(config.waitingToSend, 1, true);
     mocks.ResetAllCalls();
 
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
+    // act
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(NULL, TEST_OPTION_SASTOKEN_LIFETIME, TEST_RANDOM_CHAR_SEQ);
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG, "IoTHubTransport_SetOption returned unexpected result.");
 
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
-        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
-        .SetReturn((AMQP_VALUE)NULL);
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_045: [If parameter optionName is NULL then IoTHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] 
+TEST_FUNCTION(AMQP_SetOption_NULL_option_fails)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
 
     // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, NULL, TEST_RANDOM_CHAR_SEQ);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG, "IoTHubTransport_SetOption returned unexpected result.");
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_setting_the_2nd_property_on_the_uAMQP_map_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_046: [If parameter value is NULL then IoTHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]
+TEST_FUNCTION(AMQP_SetOption_NULL_value_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4841,77 +5155,82 @@ TEST_FUNCTION(when_setting_the_2nd_property_on_the_uAMQP_map_fails_AMQP_DoWork_c
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
-
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+    mocks.ResetAllCalls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, TEST_OPTION_SASTOKEN_LIFETIME, NULL);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG, "IoTHubTransport_SetOption returned unexpected result.");
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_229: [IotHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_ERROR if the option name is "AsyncMessageDisposition" and the value (bool) is true, since messages are settled when they are delivered, or IOTHUB_CLIENT_OK if the value is false] 
+TEST_FUNCTION(AMQP_SetOption_AsyncMessageDisposition_true_fails)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    bool asyncMessageDisposition = true;
 
-    addTestEvents(config.waitingToSend, 1, true);
     mocks.ResetAllCalls();
 
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
+    // act
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, "AsyncMessageDisposition", &asyncMessageDisposition);
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR, "IoTHubTransport_SetOption returned unexpected result.");
 
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
-        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
-        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE))
-        .SetReturn(1);
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_229: [IotHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_ERROR if the option name is "AsyncMessageDisposition" and the value (bool) is true, since messages are settled when they are delivered, or IOTHUB_CLIENT_OK if the value is false] 
+TEST_FUNCTION(AMQP_SetOption_AsyncMessageDisposition_false_succeeds)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
 
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    bool asyncMessageDisposition = false;
+
+    mocks.ResetAllCalls();
 
     // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, "AsyncMessageDisposition", &asyncMessageDisposition);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK, "IoTHubTransport_SetOption returned unexpected result.");
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_setting_the_message_properties_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_047: [If the option name does not match one of the options handled by this module, then IoTHubTransportAMQP_SetOption shall get  the handle to the XIO and invoke the xio_setoption passing down the option name and value parameters.] 
+TEST_FUNCTION(AMQP_SetOption_invokes_xio_setoption_succeeds)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4922,79 +5241,1450 @@ TEST_FUNCTION(when_setting_the_message_properties_fails_AMQP_DoWork_completes_th
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	const char* SOME_OPTION = "AnOption";
+	const void* SOME_VALUE = (void*)42;
+
+    mocks.ResetAllCalls();
+
+	EXPECTED_CALL(mocks, STRING_c_str(NULL));
+	EXPECTED_CALL(mocks, platform_get_default_tlsio()).SetReturn(TEST_TLS_IO_INTERFACE_DESC);
+	EXPECTED_CALL(mocks, xio_create(NULL, NULL, NULL)).SetReturn(TEST_TLS_IO_INTERFACE);
+	STRICT_EXPECTED_CALL(mocks, xio_setoption(NULL, SOME_OPTION, SOME_VALUE))
+		.IgnoreArgument(1);
+
+	// act
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, SOME_OPTION, SOME_VALUE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
 
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_212: [IotHubTransportAMQP_SetOption shall save and apply the value if the option name is "batching_max_events" or "batching_max_size", returning IOTHUB_CLIENT_OK, or return IOTHUB_CLIENT_INVALID_ARG if the value is 0] */
+TEST_FUNCTION(AMQP_SetOption_batching_max_size_0_fails)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    size_t zero = 0;
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+    mocks.ResetAllCalls();
+
+	// act
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, "batching_max_size", &zero);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_221: [IotHubTransportAMQP_SetOption shall save the value (uint32_t) if the option name is "incoming_window_size" or "outgoing_window_size", returning IOTHUB_CLIENT_OK, or return IOTHUB_CLIENT_INVALID_ARG if the value is 0] */
+TEST_FUNCTION(AMQP_SetOption_outgoing_window_size_0_fails)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    uint32_t zero = 0;
 
-    addTestEvents(config.waitingToSend, 1, true);
     mocks.ResetAllCalls();
 
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
+	// act
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, "outgoing_window_size", &zero);
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
-        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
-        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, message_set_application_properties(TEST_EVENT_MESSAGE_HANDLE, TEST_UAMQP_MAP))
-        .SetReturn(1);
+/* Tests_SRS_IOTHUBTRANSPORTAMQP_09_222: [IotHubTransportAMQP_SetOption shall save the value (uint64_t) if the option name is "sender_max_link_size" or "receiver_max_link_size", returning IOTHUB_CLIENT_OK, or return IOTHUB_CLIENT_INVALID_ARG if the value is 0] */
+TEST_FUNCTION(AMQP_SetOption_receiver_max_link_size_0_fails)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
 
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    uint64_t zero = 0;
+
+    mocks.ResetAllCalls();
+
+	// act
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, "receiver_max_link_size", &zero);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_03_001: [If xio_setoption fails, IoTHubTransportAMQP_SetOption shall return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(AMQP_SetOption_fails_when_xio_setoption_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	const char* SOME_OPTION = "AnOption";
+	const void* SOME_VALUE = (void*)42;
+
+	mocks.ResetAllCalls();
+
+	EXPECTED_CALL(mocks, STRING_c_str(NULL));
+	EXPECTED_CALL(mocks, platform_get_default_tlsio()).SetReturn(TEST_TLS_IO_INTERFACE_DESC);
+	EXPECTED_CALL(mocks, xio_create(NULL, NULL, NULL)).SetReturn(TEST_TLS_IO_INTERFACE);
+	STRICT_EXPECTED_CALL(mocks, xio_setoption(NULL, SOME_OPTION, SOME_VALUE))
+		.IgnoreArgument(1)
+		.SetReturn(42);
+
+	// act
+	IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, SOME_OPTION, SOME_VALUE);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_getting_the_properties_map_for_a_message_to_be_sent_fails_AMQP_DoWork_reports_the_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn((MAP_HANDLE)NULL);
     STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_getting_the_internals_for_the_properties_map_for_a_message_to_be_sent_fails_AMQP_DoWork_reports_the_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &no_property_keys_ptr, sizeof(no_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &no_property_values_ptr, sizeof(no_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &no_property_size, sizeof(no_property_size))
+        .SetReturn(MAP_ERROR);
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_008: [All properties shall be transferred to a uAMQP map.] */
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_009: [The uAMQP map shall be created by calling amqpvalue_create_map.] */
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_010: [A key uAMQP value shall be created by using amqpvalue_create_string.] */
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_011: [A value uAMQP value shall be created by using amqpvalue_create_string.] */
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_012: [The key/value pair for the property shall be set into the uAMQP property map by calling amqpvalue_map_set_value.] */
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_013: [After all properties have been filled in the uAMQP map, the uAMQP properties map shall be set on the uAMQP message by calling message_set_application_properties.] */
+TEST_FUNCTION(AMQP_DoWork_encodes_two_properties_on_an_IoTHub_Message_before_giving_it_to_uAMQP)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
+        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
+        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, message_set_application_properties(TEST_EVENT_MESSAGE_HANDLE, TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
+    EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_creating_the_property_map_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn((AMQP_VALUE)NULL);
+
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_key_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn((AMQP_VALUE)NULL);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_value_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn((AMQP_VALUE)NULL);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_setting_the_value_for_the_1st_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE))
+        .SetReturn(1);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_key_of_the_2nd_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
+        .SetReturn((AMQP_VALUE)NULL);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_value_of_the_2nd_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
+        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
+        .SetReturn((AMQP_VALUE)NULL);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_setting_the_2nd_property_on_the_uAMQP_map_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
+        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
+        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE))
+        .SetReturn(1);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_setting_the_message_properties_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
+        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
+        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, message_set_application_properties(TEST_EVENT_MESSAGE_HANDLE, TEST_UAMQP_MAP))
+        .SetReturn(1);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_008: [IoTHubTransportAMQP_Register shall create an immutable string, referred to as devicesPath, from the following parts: host_fqdn + "/devices/" + deviceId.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_011: [IoTHubTransportAMQP_Register shall create an immutable string, referred to as targetAddress, from the following parts: "amqps://" + devicesPath + "/messages/events".]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_012: [IoTHubTransportAMQP_Register shall define the source address for receiving messages as "amqps://" + devicesPath + "/messages/devicebound", stored in the device state as messageReceiveAddress.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_013: [IoTHubTransportAMQP_Register shall name the links of the device "sender-link-" + deviceId and "receiver-link-" + deviceId.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_014: [IoTHubTransportAMQP_Register shall store a copy of device->deviceKey or device->deviceSasToken into the device state.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_015: [IoTHubTransportAMQP_Register shall add the device to the list of devices served by IoTHubTransportAMQP_DoWork.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_003: [IoTHubTransportAMQP_Register shall return the state of the device as the IOTHUB_DEVICE_HANDLE.]
+TEST_FUNCTION(AMQP_Register_transport_success_returns_device_handle)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_ADD_TO_LIST);
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NOT_NULL(devHandle);
+	ASSERT_ARE_NOT_EQUAL(void_ptr, transport, devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_014: [IoTHubTransportAMQP_Register shall store a copy of device->deviceKey or device->deviceSasToken into the device state.]
+TEST_FUNCTION(AMQP_Register_transport_with_deviceSasToken_succeeds)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = NULL;
+	device.deviceSasToken = TEST_DEVICE_SAS;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_ADD_TO_LIST);
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NOT_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_002: [IoTHubTransportAMQP_Register shall return NULL if a device with the same deviceId is already registered with the transport.]
+TEST_FUNCTION(AMQP_Register_twice_returns_null_second_time)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle1 = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+	ASSERT_IS_NOT_NULL(devHandle1);
+	mocks.ResetAllCalls();
+
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_FIND_BY_ID);
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_DEVICES_PATH);
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_002: [IoTHubTransportAMQP_Register shall return NULL if a device with the same deviceId is already registered with the transport.]
+TEST_FUNCTION(AMQP_Register_second_device_succeeds)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle1 = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+	ASSERT_IS_NOT_NULL(devHandle1);
+
+	DLIST_ENTRY wts2;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts2);
+	IOTHUB_DEVICE_CONFIG device2;
+	device2.deviceId = TEST_DEVICE_ID_2;
+	device2.deviceKey = TEST_DEVICE_KEY;
+	device2.deviceSasToken = NULL;
+	mocks.ResetAllCalls();
+
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device2, STEP_REGISTER_ADD_TO_LIST);
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device2, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts2);
+
+	// assert
+	ASSERT_IS_NOT_NULL(devHandle2);
+	ASSERT_ARE_NOT_EQUAL(void_ptr, devHandle1, devHandle2);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+	cleanupList(&wts2);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_007: [IoTHubTransportAMQP_Register shall return NULL if the deviceId length is greater than 128.]
+TEST_FUNCTION(AMQP_Register_deviceId_too_long_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = "012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678";
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_006: [IoTHubTransportAMQP_Register shall return NULL if deviceId, deviceKey or deviceSasToken are zero length.]
+TEST_FUNCTION(AMQP_Register_zero_length_deviceId_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = "";
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_006: [IoTHubTransportAMQP_Register shall return NULL if deviceId, deviceKey or deviceSasToken are zero length.]
+TEST_FUNCTION(AMQP_Register_zero_length_deviceKey_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = "";
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_009: [If any of the per-device strings cannot be created IoTHubTransportAMQP_Register shall fail and return NULL.]
+TEST_FUNCTION(AMQP_Register_devicesPath_malloc_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+	EXPECTED_CALL(mocks, STRING_c_str(0));
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID) + 1)).SetFailReturn((void*)NULL);
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_009: [If any of the per-device strings cannot be created IoTHubTransportAMQP_Register shall fail and return NULL.]
+TEST_FUNCTION(AMQP_Register_devicesPath_STRING_construct_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+	EXPECTED_CALL(mocks, STRING_c_str(0));
+	EXPECTED_CALL(mocks, gballoc_malloc(0));
+	EXPECTED_CALL(mocks, STRING_construct(0)).SetFailReturn(TEST_NULL_STRING_HANDLE);
+	EXPECTED_CALL(mocks, gballoc_free(0));
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_010: [IoTHubTransportAMQP_Register shall allocate the state of the device and return NULL if that fails.]
+TEST_FUNCTION(AMQP_Register_device_state_malloc_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_FIND_BY_ID);
+	EXPECTED_CALL(mocks, gballoc_malloc(0)).SetFailReturn((void*)NULL);
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_DEVICES_PATH);
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_009: [If any of the per-device strings cannot be created IoTHubTransportAMQP_Register shall fail and return NULL.]
+TEST_FUNCTION(AMQP_Register_targetAddress_STRING_construct_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_STATE_ALLOC);
+	EXPECTED_CALL(mocks, STRING_c_str(0));
+	EXPECTED_CALL(mocks, gballoc_malloc(0));
+	EXPECTED_CALL(mocks, STRING_construct(0)).SetFailReturn(TEST_NULL_STRING_HANDLE);
+	EXPECTED_CALL(mocks, gballoc_free(0));
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_STATE_ALLOC);
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_009: [If any of the per-device strings cannot be created IoTHubTransportAMQP_Register shall fail and return NULL.]
+TEST_FUNCTION(AMQP_Register_receiveAddress_STRING_construct_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_TARGET_ADDRESS);
+	EXPECTED_CALL(mocks, STRING_c_str(0));
+	EXPECTED_CALL(mocks, gballoc_malloc(0));
+	EXPECTED_CALL(mocks, STRING_construct(0)).SetFailReturn(TEST_NULL_STRING_HANDLE);
+	EXPECTED_CALL(mocks, gballoc_free(0));
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_TARGET_ADDRESS);
+
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_009: [If any of the per-device strings cannot be created IoTHubTransportAMQP_Register shall fail and return NULL.]
+TEST_FUNCTION(AMQP_Register_senderLinkName_malloc_fails)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	IOTHUB_DEVICE_CONFIG device;
+	device.deviceId = TEST_DEVICE_ID;
+	device.deviceKey = TEST_DEVICE_KEY;
+	device.deviceSasToken = NULL;
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	mocks.ResetAllCalls();
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_RECEIVE_ADDRESS);
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen("sender-link-" TEST_DEVICE_ID) + 1)).SetFailReturn((void*)NULL);
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_RECEIVE_ADDRESS);
 
-    // assert
-    mocks.AssertActualAndExpectedCalls();
+	// act
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
-    // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_003: [IoTHubTransportAMQP_Register shall return the TRANSPORT_LL_HANDLE as the IOTHUB_DEVICE_HANDLE.] 
-TEST_FUNCTION(AMQP_Register_transport_success_returns_transport)
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_009: [If any of the per-device strings cannot be created IoTHubTransportAMQP_Register shall fail and return NULL.]
+TEST_FUNCTION(AMQP_Register_receiverLinkName_STRING_construct_fails)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -5009,26 +6699,20 @@ TEST_FUNCTION(AMQP_Register_transport_success_returns_transport)
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 	mocks.ResetAllCalls();
-
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_SENDER_LINK_NAME);
+	EXPECTED_CALL(mocks, gballoc_malloc(0));
+	EXPECTED_CALL(mocks, STRING_construct(0)).SetFailReturn(TEST_NULL_STRING_HANDLE);
+	EXPECTED_CALL(mocks, gballoc_free(0));
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_SENDER_LINK_NAME);
 
 	// act
 	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
 	// assert
-	ASSERT_IS_NOT_NULL(devHandle);
-	ASSERT_ARE_EQUAL(void_ptr, transport, devHandle);
+	ASSERT_IS_NULL(devHandle);
 	mocks.AssertActualAndExpectedCalls();
 
 	// cleanup
@@ -5036,7 +6720,9 @@ TEST_FUNCTION(AMQP_Register_transport_success_returns_transport)
 	cleanupList(config.waitingToSend);
 }
 
-TEST_FUNCTION(AMQP_Register_twice_returns_null_second_time)
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_009: [If any of the per-device strings cannot be created IoTHubTransportAMQP_Register shall fail and return NULL.]
+TEST_FUNCTION(AMQP_Register_deviceKey_allocation_fails)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -5051,26 +6737,18 @@ TEST_FUNCTION(AMQP_Register_twice_returns_null_second_time)
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 	mocks.ResetAllCalls();
-
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_RECEIVER_LINK_NAME);
+	STRICT_EXPECTED_CALL(mocks, STRING_new()).SetFailReturn(TEST_NULL_STRING_HANDLE);
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_RECEIVER_LINK_NAME);
 
 	// act
-	IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
 	// assert
-	ASSERT_IS_NULL(devHandle2);
+	ASSERT_IS_NULL(devHandle);
 	mocks.AssertActualAndExpectedCalls();
 
 	// cleanup
@@ -5078,14 +6756,15 @@ TEST_FUNCTION(AMQP_Register_twice_returns_null_second_time)
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId or deviceKey do not match the deviceId and deviceKey passed in during IoTHubTransportAMQP_Create.] 
-TEST_FUNCTION(AMQP_Register_transport_deviceKey_mismatch_returns_null)
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_009: [If any of the per-device strings cannot be created IoTHubTransportAMQP_Register shall fail and return NULL.]
+TEST_FUNCTION(AMQP_Register_deviceKey_copy_fails)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
 	IOTHUB_DEVICE_CONFIG device;
 	device.deviceId = TEST_DEVICE_ID;
-	device.deviceKey = "this is a different device key";
+	device.deviceKey = TEST_DEVICE_KEY;
 	device.deviceSasToken = NULL;
 
 	DLIST_ENTRY wts;
@@ -5094,19 +6773,13 @@ TEST_FUNCTION(AMQP_Register_transport_deviceKey_mismatch_returns_null)
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 	mocks.ResetAllCalls();
-
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_RECEIVER_LINK_NAME);
+	STRICT_EXPECTED_CALL(mocks, STRING_new());
+	STRICT_EXPECTED_CALL(mocks, STRING_copy(0, device.deviceKey)).IgnoreArgument(1).SetReturn(TEST_STRING_COPY_FAILURE_RESULT);
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_DEVICEKEY);
 
 	// act
 	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
@@ -5120,13 +6793,13 @@ TEST_FUNCTION(AMQP_Register_transport_deviceKey_mismatch_returns_null)
 	cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId or deviceKey do not match the deviceId and deviceKey passed in during IoTHubTransportAMQP_Create.] 
-TEST_FUNCTION(AMQP_Register_transport_deviceId_mismatch_returns_null)
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_017: [IoTHubTransportAMQP_Register shall call DeviceRegistry_Add to index the new device by its handle and by deviceId, and shall fail and return NULL if that fails.]
+TEST_FUNCTION(AMQP_Register_DeviceRegistry_Add_fails)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
 	IOTHUB_DEVICE_CONFIG device;
-	device.deviceId = "not the right devId";
+	device.deviceId = TEST_DEVICE_ID;
 	device.deviceKey = TEST_DEVICE_KEY;
 	device.deviceSasToken = NULL;
 
@@ -5136,18 +6809,12 @@ TEST_FUNCTION(AMQP_Register_transport_deviceId_mismatch_returns_null)
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	whenShallDeviceRegistry_Add_fail = currentDeviceRegistry_Add_call + 1;
 	mocks.ResetAllCalls();
-
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_REGISTRY_ADD);
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_DEVICEKEY);
 
 	// act
 	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
@@ -5161,6 +6828,7 @@ TEST_FUNCTION(AMQP_Register_transport_deviceId_mismatch_returns_null)
 	cleanupList(config.waitingToSend);
 }
 
+
 // Tests_SRS_IOTHUBTRANSPORTUAMQP_17_001: [IoTHubTransportAMQP_Register shall return NULL if deviceId, deviceKey or waitingToSend are NULL.] 
 TEST_FUNCTION(AMQP_Register_transport_deviceId_null_returns_null)
 {
@@ -5177,7 +6845,6 @@ TEST_FUNCTION(AMQP_Register_transport_deviceId_null_returns_null)
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 	mocks.ResetAllCalls();
@@ -5206,7 +6873,6 @@ TEST_FUNCTION(AMQP_Register_transport_device_null_returns_null)
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 	mocks.ResetAllCalls();
@@ -5239,7 +6905,6 @@ TEST_FUNCTION(AMQP_Register_transport_deviceKey_null_and_deviceSasToken_null_ret
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 	mocks.ResetAllCalls();
@@ -5272,7 +6937,6 @@ TEST_FUNCTION(AMQP_Register_transport_deviceKey_and_deviceSasToken_provided_retu
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 	mocks.ResetAllCalls();
@@ -5305,7 +6969,6 @@ TEST_FUNCTION(AMQP_Register_transport_wts_null_returns_null)
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 	mocks.ResetAllCalls();
@@ -5350,7 +7013,23 @@ TEST_FUNCTION(AMQP_Register_transport_null_returns_null)
 	cleanupList(&wts);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_004: [IoTHubTransportAMQP_Unregister shall return.] 
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_004: [IoTHubTransportAMQP_Unregister shall return if deviceHandle is NULL.]
+TEST_FUNCTION(AMQP_Unregister_NULL_device_handle_does_nothing)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+
+	mocks.ResetAllCalls();
+
+	// act
+	transport_interface->IoTHubTransport_Unregister(NULL);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls(); // Nothing is expected.
+}
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_016: [IoTHubTransportAMQP_Unregister shall destroy the links of the device, return its in-progress events to its waitingToSend list, remove it from the transport and free its state.]
 TEST_FUNCTION(AMQP_Unregister_transport_success)
 {
 	// arrange
@@ -5366,13 +7045,50 @@ TEST_FUNCTION(AMQP_Unregister_transport_success)
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 
 	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
 	mocks.ResetAllCalls();
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, devHandle)).IgnoreArgument(1);
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_DEVICEKEY);
+
+	// act
+	transport_interface->IoTHubTransport_Unregister(devHandle);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(config.waitingToSend);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_016: [IoTHubTransportAMQP_Unregister shall destroy the links of the device, return its in-progress events to its waitingToSend list, remove it from the transport and free its state.]
+TEST_FUNCTION(AMQP_Unregister_destroys_the_links_of_the_device)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	time_t current_time = time(NULL);
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+	mocks.ResetAllCalls();
+	setExpectedCallsForDestroyEventSender(mocks, &config);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, devHandle)).IgnoreArgument(1);
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+	setExpectedCleanupCallsForTransportRegisterUpTo(mocks, STEP_REGISTER_DEVICEKEY);
 
 	// act
 	transport_interface->IoTHubTransport_Unregister(devHandle);
@@ -5385,7 +7101,9 @@ TEST_FUNCTION(AMQP_Unregister_transport_success)
 	cleanupList(config.waitingToSend);
 }
 
-TEST_FUNCTION(AMQP_Register_transport_Register_Unregister_Register_success_returns_transport)
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_002: [IoTHubTransportAMQP_Register shall return NULL if a device with the same deviceId is already registered with the transport.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_016: [IoTHubTransportAMQP_Unregister shall destroy the links of the device, return its in-progress events to its waitingToSend list, remove it from the transport and free its state.]
+TEST_FUNCTION(AMQP_Register_transport_Register_Unregister_Register_success_returns_device_handle)
 {
 	// arrange
 	CIoTHubTransportAMQPMocks mocks;
@@ -5400,28 +7118,19 @@ TEST_FUNCTION(AMQP_Register_transport_Register_Unregister_Register_success_retur
 	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
 		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
 	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-	time_t current_time = time(NULL);
 
 	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 	IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 	transport_interface->IoTHubTransport_Unregister(devHandle);
 	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	setExpectedCallsForTransportRegisterUpTo(mocks, &device, STEP_REGISTER_ADD_TO_LIST);
 
 	// act
 	IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
 	// assert
 	ASSERT_IS_NOT_NULL(devHandle2);
-	ASSERT_ARE_EQUAL(void_ptr, transport, devHandle2);
 	mocks.AssertActualAndExpectedCalls();
 
 	// cleanup
@@ -5429,5 +7138,262 @@ TEST_FUNCTION(AMQP_Register_transport_Register_Unregister_Register_success_retur
 	cleanupList(config.waitingToSend);
 }
 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_227: [The put of the SAS token of a device shall not wait for the puts of the other devices to complete.]
+TEST_FUNCTION(AMQP_DoWork_two_devices_put_their_tokens_concurrently)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	DLIST_ENTRY wts2;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts2);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	IOTHUB_DEVICE_CONFIG device2 = { TEST_DEVICE_ID_2, TEST_DEVICE_KEY, NULL };
+	time_t current_time = time(NULL);
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device2, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts2);
+
+	mocks.ResetAllCalls();
+	setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_AUTHENTICATION, DOWORK_MESSAGERECEIVER_NONE, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
+
+	// act
+	transport_interface->IoTHubTransport_DoWork(transport, NULL);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(&wts);
+	cleanupList(&wts2);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_195: [IoTHubTransportAMQP_DoWork shall authenticate, create the links of and send the pending events of every registered device, starting with the device that follows the one the previous call started with.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_227: [The put of the SAS token of a device shall not wait for the puts of the other devices to complete.]
+TEST_FUNCTION(AMQP_DoWork_two_devices_authenticated_device_sends_while_the_other_put_is_pending)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	DLIST_ENTRY wts2;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts2);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	IOTHUB_DEVICE_CONFIG device2 = { TEST_DEVICE_ID_2, TEST_DEVICE_KEY, NULL };
+	time_t current_time = time(NULL);
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device2, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts2);
+	setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_AUTHENTICATION, DOWORK_MESSAGERECEIVER_NONE, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	transport_interface->IoTHubTransport_DoWork(transport, NULL);
+	completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
+
+	mocks.ResetAllCalls();
+	// the second device, whose put completed, opens its sender link...
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForCreateEventSender(mocks, &config);
+	setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_BYTEARRAY, current_time, 0);
+	// ...while the put of the first one is still waiting for its completion.
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
+
+	// act
+	transport_interface->IoTHubTransport_DoWork(transport, NULL);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(&wts);
+	cleanupList(&wts2);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_225: [If the put of a SAS token fails and the device is not authenticated by a previous SAS token that is still valid, IoTHubTransportAMQP_DoWork shall destroy the links of that device only, return its in-progress events to its waitingToSend list and put a new SAS token for it; the connection and the other devices shall not be affected]
+TEST_FUNCTION(AMQP_DoWork_two_devices_failed_put_of_one_device_does_not_stop_the_other)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	DLIST_ENTRY wts2;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts2);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	IOTHUB_DEVICE_CONFIG device2 = { TEST_DEVICE_ID_2, TEST_DEVICE_KEY, NULL };
+	time_t current_time = time(NULL);
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_AUTHENTICATION, DOWORK_MESSAGERECEIVER_NONE, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	transport_interface->IoTHubTransport_DoWork(transport, NULL);
+	void* first_device_put_context = test_latest_cbs_put_token_context;
+	IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device2, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts2);
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	transport_interface->IoTHubTransport_DoWork(transport, NULL);
+	completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
+	completePutToken(mocks, first_device_put_context, CBS_OPERATION_RESULT_OPERATION_FAILED, 401);
+
+	mocks.ResetAllCalls();
+	// the first device puts a new token, the connection is not re-established...
+	setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	// ...and the second device opens its sender link.
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForCreateEventSender(mocks, &config);
+	setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_BYTEARRAY, current_time, 0);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
+
+	// act
+	transport_interface->IoTHubTransport_DoWork(transport, NULL);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(&wts);
+	cleanupList(&wts2);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_234: [If creating the links of a device fails, IoTHubTransportAMQP_DoWork shall destroy the links of that device only and return its in-progress events to its waitingToSend list, keeping its SAS token; the connection and the other devices shall not be affected]
+TEST_FUNCTION(AMQP_DoWork_two_devices_failed_messagesender_create_of_one_device_does_not_stop_the_other)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	DLIST_ENTRY wts2;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts2);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	IOTHUB_DEVICE_CONFIG device2 = { TEST_DEVICE_ID_2, TEST_DEVICE_KEY, NULL };
+	time_t current_time = time(NULL);
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_AUTHENTICATION, DOWORK_MESSAGERECEIVER_NONE, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	transport_interface->IoTHubTransport_DoWork(transport, NULL);
+	void* first_device_put_context = test_latest_cbs_put_token_context;
+	IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device2, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts2);
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	transport_interface->IoTHubTransport_DoWork(transport, NULL);
+	completePutToken(mocks, test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0);
+	completePutToken(mocks, first_device_put_context, CBS_OPERATION_RESULT_OK, 0);
+
+	mocks.ResetAllCalls();
+	// the first device fails creating its sender link and only its links are destroyed...
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	EXPECTED_CALL(mocks, messaging_create_source(NULL)).SetReturn(TEST_MESSAGESENDER_SOURCE);
+	EXPECTED_CALL(mocks, STRING_c_str(NULL));
+	EXPECTED_CALL(mocks, messaging_create_target(NULL)).SetReturn(TEST_MESSAGESENDER_TARGET);
+	EXPECTED_CALL(mocks, STRING_c_str(NULL));
+	EXPECTED_CALL(mocks, link_create(NULL, NULL, NULL, NULL, NULL)).SetReturn(TEST_MESSAGESENDER_LINK);
+	EXPECTED_CALL(mocks, link_set_max_message_size(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+	EXPECTED_CALL(mocks, amqpvalue_create_map()).SetReturn(TEST_AMQP_VALUE_TEST_HANDLE);
+	EXPECTED_CALL(mocks, amqpvalue_create_symbol(NULL)).IgnoreArgument(1).SetReturn(TEST_AMQP_VALUE_TEST_HANDLE);
+	EXPECTED_CALL(mocks, amqpvalue_create_string(NULL)).IgnoreArgument(1).SetReturn(TEST_AMQP_VALUE_TEST_HANDLE);
+	EXPECTED_CALL(mocks, amqpvalue_set_map_value(NULL, NULL, NULL)).IgnoreAllArguments();
+	EXPECTED_CALL(mocks, amqpvalue_destroy(NULL)).IgnoreArgument(1);
+	EXPECTED_CALL(mocks, amqpvalue_destroy(NULL)).IgnoreArgument(1);
+	EXPECTED_CALL(mocks, amqpvalue_destroy(NULL)).IgnoreArgument(1);
+	EXPECTED_CALL(mocks, link_set_attach_properties(NULL, NULL)).IgnoreAllArguments().SetReturn(0);
+	EXPECTED_CALL(mocks, messagesender_create(NULL, NULL, NULL, NULL)).SetReturn((MESSAGE_SENDER_HANDLE)NULL);
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGESENDER_SOURCE));
+	STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_MESSAGESENDER_TARGET));
+	setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
+	// ...while the second device opens its sender link and the connection is kept.
+	setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+	setExpectedCallsForCreateEventSender(mocks, &config);
+	setExpectedCallsForSendPendingEvents(mocks, IOTHUBMESSAGE_BYTEARRAY, current_time, 0);
+	setExpectedCallsForConnectionDoWork(mocks, &config);
+
+	// act
+	transport_interface->IoTHubTransport_DoWork(transport, NULL);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(&wts);
+	cleanupList(&wts2);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_016: [IoTHubTransportAMQP_Unregister shall destroy the links of the device, return its in-progress events to its waitingToSend list, remove it from the transport and free its state.]
+TEST_FUNCTION(AMQP_Unregister_with_a_pending_put_the_late_completion_only_frees_its_context)
+{
+	// arrange
+	CIoTHubTransportAMQPMocks mocks;
+
+	DLIST_ENTRY wts;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+	DLIST_ENTRY wts2;
+	BASEIMPLEMENTATION::DList_InitializeListHead(&wts2);
+	TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+	IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+		TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+	IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+	IOTHUB_DEVICE_CONFIG device2 = { TEST_DEVICE_ID_2, TEST_DEVICE_KEY, NULL };
+	time_t current_time = time(NULL);
+
+	TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+	IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+	IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device2, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts2);
+	setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_AUTHENTICATION, DOWORK_MESSAGERECEIVER_NONE, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+	setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+	transport_interface->IoTHubTransport_DoWork(transport, NULL);
+	transport_interface->IoTHubTransport_Unregister(devHandle2);
+
+	mocks.ResetAllCalls();
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+	// act
+	test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	transport_interface->IoTHubTransport_Destroy(transport);
+	cleanupList(&wts);
+	cleanupList(&wts2);
+}
 
 END_TEST_SUITE(iothubtransportamqp_unittests)
@@ -0,0 +1,215 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <cstdio>
+#include <cstring>
+
+#include "testrunnerswitcher.h"
+
+#include "iothubtransporthttp.h"
+#include "iothub_client_private.h"
+#include "iothub_message.h"
+
+#include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/httpapiex.h"
+#include "azure_c_shared_utility/httpapiexsas.h"
+#include "azure_c_shared_utility/map.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#define MESSAGES_PER_RUN 100000
+#define MAXIMUM_BATCH 100
+#define MESSAGE_SIZE 256 /*about the size of a serialized telemetry event*/
+
+/*the HTTP layer is replaced by the functions below, so only the transport, and mostly the batch encoder, is measured*/
+#define TEST_HTTPAPIEX_HANDLE (HTTPAPIEX_HANDLE)0x1
+#define TEST_HTTPAPIEX_SAS_HANDLE (HTTPAPIEX_SAS_HANDLE)0x2
+
+static size_t requestCount;
+static size_t payloadBytes;
+static size_t completedMessages;
+
+extern "C" HTTPAPIEX_HANDLE HTTPAPIEX_Create(const char* hostName)
+{
+    (void)hostName;
+    return TEST_HTTPAPIEX_HANDLE;
+}
+
+extern "C" HTTPAPIEX_RESULT HTTPAPIEX_ExecuteRequest(HTTPAPIEX_HANDLE handle, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath, HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode, HTTP_HEADERS_HANDLE responseHttpHeadersHandle, BUFFER_HANDLE responseContent)
+{
+    (void)handle, (void)requestType, (void)relativePath, (void)requestHttpHeadersHandle, (void)requestContent, (void)statusCode, (void)responseHttpHeadersHandle, (void)responseContent;
+    return HTTPAPIEX_ERROR;
+}
+
+extern "C" void HTTPAPIEX_Destroy(HTTPAPIEX_HANDLE handle)
+{
+    (void)handle;
+}
+
+extern "C" HTTPAPIEX_RESULT HTTPAPIEX_SetOption(HTTPAPIEX_HANDLE handle, const char* optionName, const void* value)
+{
+    (void)handle, (void)optionName, (void)value;
+    return HTTPAPIEX_OK;
+}
+
+extern "C" HTTPAPIEX_SAS_HANDLE HTTPAPIEX_SAS_Create(STRING_HANDLE key, STRING_HANDLE uriResource, STRING_HANDLE keyName)
+{
+    (void)key, (void)uriResource, (void)keyName;
+    return TEST_HTTPAPIEX_SAS_HANDLE;
+}
+
+extern "C" void HTTPAPIEX_SAS_Destroy(HTTPAPIEX_SAS_HANDLE handle)
+{
+    (void)handle;
+}
+
+extern "C" HTTPAPIEX_RESULT HTTPAPIEX_SAS_ExecuteRequest(HTTPAPIEX_SAS_HANDLE sasHandle, HTTPAPIEX_HANDLE handle, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath, HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode, HTTP_HEADERS_HANDLE responseHeadersHandle, BUFFER_HANDLE responseContent)
+{
+    (void)sasHandle, (void)handle, (void)requestType, (void)relativePath, (void)requestHttpHeadersHandle, (void)responseHeadersHandle, (void)responseContent;
+    requestCount++;
+    payloadBytes += BUFFER_length(requestContent);
+    *statusCode = 204;
+    return HTTPAPIEX_OK;
+}
+
+extern "C" void IoTHubClient_LL_SendStarted(IOTHUB_CLIENT_LL_HANDLE handle, IOTHUB_MESSAGE_LIST* first, size_t count, size_t size)
+{
+    (void)handle, (void)first, (void)count, (void)size;
+}
+
+extern "C" void IoTHubClient_LL_SendComplete(IOTHUB_CLIENT_LL_HANDLE handle, PDLIST_ENTRY completed, IOTHUB_BATCHSTATE_RESULT result)
+{
+    (void)handle;
+    (void)result;
+    while (!DList_IsListEmpty(completed))
+    {
+        (void)DList_RemoveHeadList(completed);
+        completedMessages++;
+    }
+}
+
+extern "C" IOTHUBMESSAGE_DISPOSITION_RESULT IoTHubClient_LL_MessageCallback(IOTHUB_CLIENT_LL_HANDLE handle, IOTHUB_MESSAGE_HANDLE message)
+{
+    (void)handle, (void)message;
+    return IOTHUBMESSAGE_ACCEPTED;
+}
+
+static const IOTHUB_CLIENT_CONFIG TEST_CLIENT_CONFIG =
+{
+    HTTP_Protocol,
+    "perfDevice",
+    "aGVsbG8gd29ybGQ=",
+    NULL,
+    "perfHub",
+    "azure-devices.net",
+    NULL
+};
+
+static const IOTHUB_DEVICE_CONFIG TEST_DEVICE_CONFIG =
+{
+    "perfDevice",
+    "aGVsbG8gd29ybGQ=",
+    NULL
+};
+
+static double messagesPerSecond(size_t count, uint64_t elapsedMs)
+{
+    return (elapsedMs == 0) ? (double)count * 1000 : (double)count * 1000 / elapsedMs;
+}
+
+/*sends MESSAGES_PER_RUN messages in batches of batchSize, one batch per _DoWork, and prints the throughput*/
+static void runBatches(IOTHUBMESSAGE_CONTENT_TYPE contentType, size_t batchSize)
+{
+    TICK_COUNTER_HANDLE tickCounter = tickcounter_create();
+    ASSERT_IS_NOT_NULL(tickCounter);
+    unsigned char content[MESSAGE_SIZE + 1];
+    (void)memset(content, 'x', MESSAGE_SIZE);
+    content[MESSAGE_SIZE] = '\0';
+    /*every message carries a few properties and a character that needs escaping*/
+    content[MESSAGE_SIZE / 2] = '"';
+    IOTHUB_MESSAGE_HANDLE messageHandle = (contentType == IOTHUBMESSAGE_STRING) ?
+        IoTHubMessage_CreateFromString((const char*)content) :
+        IoTHubMessage_CreateFromByteArray(content, MESSAGE_SIZE);
+    ASSERT_IS_NOT_NULL(messageHandle);
+    MAP_HANDLE properties = IoTHubMessage_Properties(messageHandle);
+    ASSERT_ARE_EQUAL(int, (int)MAP_OK, (int)Map_AddOrUpdate(properties, "temperatureAlert", "true"));
+    ASSERT_ARE_EQUAL(int, (int)MAP_OK, (int)Map_AddOrUpdate(properties, "sensor", "thermometer/42"));
+    ASSERT_ARE_EQUAL(int, (int)MAP_OK, (int)Map_AddOrUpdate(properties, "unit", "celsius"));
+
+    DLIST_ENTRY waitingToSend;
+    DList_InitializeListHead(&waitingToSend);
+    IOTHUBTRANSPORT_CONFIG config = { &TEST_CLIENT_CONFIG, &waitingToSend };
+    TRANSPORT_LL_HANDLE transport = IoTHubTransportHttp_Create(&config);
+    ASSERT_IS_NOT_NULL(transport);
+    IOTHUB_DEVICE_HANDLE device = IoTHubTransportHttp_Register(transport, &TEST_DEVICE_CONFIG, (IOTHUB_CLIENT_LL_HANDLE)0x3, &waitingToSend);
+    ASSERT_IS_NOT_NULL(device);
+    bool batching = true;
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OK, (int)IoTHubTransportHttp_SetOption(transport, "Batching", &batching));
+
+    IOTHUB_MESSAGE_LIST messages[MAXIMUM_BATCH];
+    (void)memset(messages, 0, sizeof(messages));
+    size_t i;
+    for (i = 0; i < batchSize; i++)
+    {
+        messages[i].messageHandle = messageHandle;
+    }
+
+    size_t batches = MESSAGES_PER_RUN / batchSize;
+    uint64_t start;
+    uint64_t end;
+    requestCount = 0;
+    payloadBytes = 0;
+    completedMessages = 0;
+
+    // act
+    (void)tickcounter_get_current_ms(tickCounter, &start);
+    for (size_t batch = 0; batch < batches; batch++)
+    {
+        for (i = 0; i < batchSize; i++)
+        {
+            DList_InsertTailList(&waitingToSend, &(messages[i].entry));
+        }
+        IoTHubTransportHttp_DoWork(transport, (IOTHUB_CLIENT_LL_HANDLE)0x3);
+    }
+    (void)tickcounter_get_current_ms(tickCounter, &end);
+
+    (void)printf("%s messages of %d bytes with 3 properties in batches of %lu: %.0f messages/s, %lu bytes per request\r\n",
+        (contentType == IOTHUBMESSAGE_STRING) ? "string" : "byte array", MESSAGE_SIZE, (unsigned long)batchSize,
+        messagesPerSecond(batches * batchSize, end - start), (unsigned long)(payloadBytes / requestCount));
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, batches, requestCount);
+    ASSERT_ARE_EQUAL(size_t, batches * batchSize, completedMessages);
+    ASSERT_IS_TRUE(DList_IsListEmpty(&waitingToSend) != 0);
+
+    // cleanup
+    IoTHubTransportHttp_Unregister(device);
+    IoTHubTransportHttp_Destroy(transport);
+    IoTHubMessage_Destroy(messageHandle);
+    tickcounter_destroy(tickCounter);
+}
+
+BEGIN_TEST_SUITE(iothubtransporthttp_perftests)
+
+    /*measures how fast IoTHubTransportHttp_DoWork turns batches of 1, 10 and 100 byte array messages into one
+    JSON payload each. The payload is sized in a first pass and written in a second one into a single buffer.*/
+    TEST_FUNCTION(IoTHubTransportHttp_DoWork_byte_array_batches_throughput)
+    {
+        runBatches(IOTHUBMESSAGE_BYTEARRAY, 1);
+        runBatches(IOTHUBMESSAGE_BYTEARRAY, 10);
+        runBatches(IOTHUBMESSAGE_BYTEARRAY, MAXIMUM_BATCH);
+    }
+
+    /*same as above for string messages, whose body is JSON escaped instead of base64 encoded*/
+    TEST_FUNCTION(IoTHubTransportHttp_DoWork_string_batches_throughput)
+    {
+        runBatches(IOTHUBMESSAGE_STRING, 1);
+        runBatches(IOTHUBMESSAGE_STRING, 10);
+        runBatches(IOTHUBMESSAGE_STRING, MAXIMUM_BATCH);
+    }
+
+END_TEST_SUITE(iothubtransporthttp_perftests)
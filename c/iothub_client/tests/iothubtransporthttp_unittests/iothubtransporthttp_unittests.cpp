@@ -31,6 +31,9 @@
 #include "azure_c_shared_utility/base64.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "deviceregistry.h"
 
 #define IOTHUB_ACK "iothub-ack"
 #define IOTHUB_ACK_NONE "none"
@@ -67,6 +70,7 @@ namespace BASEIMPLEMENTATION
 #include "strings.c"
 #include "buffer.c"
 #include "vector.c"
+#include "../../src/deviceregistry.c"
 };
 
 class RefCountObject
@@ -112,6 +116,8 @@ static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 #define TEST_PROPERTY_A_VALUE "value_of_a"
 
 #define TEST_HTTPAPIEX_HANDLE (HTTPAPIEX_HANDLE)0x343
+#define TEST_LOCK_HANDLE (LOCK_HANDLE)0x344
+#define TEST_THREAD_HANDLE (THREAD_HANDLE)0x345
 
 static const bool thisIsTrue = true;
 static const bool thisIsFalse = false;
@@ -239,6 +245,8 @@ static IOTHUBTRANSPORT_CONFIG TEST_CONFIG_NULL_IOTHUB_SUFFIX =
 #define TEST_IOTHUB_MESSAGE_HANDLE_10 ((IOTHUB_MESSAGE_HANDLE)0x01da)
 #define TEST_IOTHUB_MESSAGE_HANDLE_11 ((IOTHUB_MESSAGE_HANDLE)0x01db)
 #define TEST_IOTHUB_MESSAGE_HANDLE_12 ((IOTHUB_MESSAGE_HANDLE)0x01dc)
+#define TEST_IOTHUB_MESSAGE_HANDLE_13 ((IOTHUB_MESSAGE_HANDLE)0x01dd)
+#define TEST_IOTHUB_MESSAGE_HANDLE_14 ((IOTHUB_MESSAGE_HANDLE)0x01de)
 
 static IOTHUB_MESSAGE_LIST message1 =  /*this is the oldest message, always the first to be processed, send etc*/
 {
@@ -328,12 +336,30 @@ static IOTHUB_MESSAGE_LIST message12 = /*this is message of 255*1024 bytes - 384
 	{ NULL, NULL }                                  /*DLIST_ENTRY entry;                                          */
 };
 
+static IOTHUB_MESSAGE_LIST message13 = /*this has properties with characters that need escaping in JSON*/
+{
+	TEST_IOTHUB_MESSAGE_HANDLE_13,                  /*IOTHUB_MESSAGE_HANDLE messageHandle;                        */
+	NULL,                                           /*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;     */
+	NULL,                                           /*void* context;                                              */
+	{ NULL, NULL }                                  /*DLIST_ENTRY entry;                                          */
+};
+
+static IOTHUB_MESSAGE_LIST message14 = /*this is a string message with multibyte UTF-8 characters in its body and in its properties*/
+{
+	TEST_IOTHUB_MESSAGE_HANDLE_14,                  /*IOTHUB_MESSAGE_HANDLE messageHandle;                        */
+	NULL,                                           /*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;     */
+	NULL,                                           /*void* context;                                              */
+	{ NULL, NULL }                                  /*DLIST_ENTRY entry;                                          */
+};
+
 #define TEST_MAP_EMPTY (MAP_HANDLE) 0xe0
 #define TEST_MAP_1_PROPERTY (MAP_HANDLE) 0xe1
 #define TEST_MAP_2_PROPERTY (MAP_HANDLE) 0xe2
 #define TEST_MAP_3_PROPERTY (MAP_HANDLE) 0xe3
 #define TEST_MAP_1_PROPERTY_A_B (MAP_HANDLE) 0xe4
 #define TEST_MAP_1_PROPERTY_AA_B (MAP_HANDLE) 0xe5
+#define TEST_MAP_ESCAPED_PROPERTIES (MAP_HANDLE) 0xe6
+#define TEST_MAP_UTF8_PROPERTIES (MAP_HANDLE) 0xe7
 
 #define TEST_RED_KEY "redkey"
 #define TEST_RED_KEY_STRING TEST_RED_KEY
@@ -368,9 +394,33 @@ static const char* TEST_VALUES1_A_B[] = { "b" };
 static const char* TEST_KEYS1_AA_B[] = { "aa" };
 static const char* TEST_VALUES1_AA_B[] = { "b" };
 
+/*quotes, backslashes, slashes and control characters*/
+static const char* TEST_KEYS_ESCAPED[] = { "q\"k", "back\\slash", "tab\tkey" };
+static const char* TEST_VALUES_ESCAPED[] = { "say \"hi\"", "C:\\dir/file", "line1\nline2\x01\x1F" };
+#define TEST_ESCAPED_PROPERTIES_JSON ",\"properties\":{" \
+    "\"iothub-app-q\\\"k\":\"say \\\"hi\\\"\"," \
+    "\"iothub-app-back\\\\slash\":\"C:\\\\dir\\/file\"," \
+    "\"iothub-app-tab\\u0009key\":\"line1\\u000Aline2\\u0001\\u001F\"}"
+
+/*2, 3 and 4 byte UTF-8 sequences are not escaped*/
+static const char* TEST_KEYS_UTF8[] = { "temp\xC3\xA9rature", "unit" };
+static const char* TEST_VALUES_UTF8[] = { "21\xC2\xB0", "\xE2\x84\x83 \xF0\x9F\x8C\xA1" };
+#define TEST_UTF8_PROPERTIES_JSON ",\"properties\":{" \
+    "\"iothub-app-temp\xC3\xA9rature\":\"21\xC2\xB0\"," \
+    "\"iothub-app-unit\":\"\xE2\x84\x83 \xF0\x9F\x8C\xA1\"}"
+
 static size_t currentmalloc_call;
 static size_t whenShallmalloc_fail;
 
+extern "C" const size_t IoTHubTransportHttp_StopWorkersOffset;
+
+/*the last worker thread created, so that a test can run it*/
+static THREAD_START_FUNC savedWorkerFunc;
+static void* savedWorkerArg;
+/*when not NULL, the workers of this transport are told to stop after workerSleepsBeforeStop calls to ThreadAPI_Sleep*/
+static TRANSPORT_LL_HANDLE workerStopTransport;
+static size_t workerSleepsBeforeStop;
+
 /*different STRING constructors*/
 static size_t currentSTRING_new_call;
 static size_t whenShallSTRING_new_fail;
@@ -428,6 +478,15 @@ static size_t whenShallVECTOR_push_back_fail;
 static size_t currentVECTOR_find_if_call;
 static size_t whenShallVECTOR_find_if_fail;
 
+static size_t currentDeviceRegistry_Create_call;
+static size_t whenShallDeviceRegistry_Create_fail;
+
+static size_t currentDeviceRegistry_Add_call;
+static size_t whenShallDeviceRegistry_Add_fail;
+
+static size_t currentMap_GetInternals_call;
+static size_t whenShallMap_GetInternals_fail;
+
 
 #define MAXIMUM_MESSAGE_SIZE (255*1024-1)
 #define PAYLOAD_OVERHEAD (384)
@@ -468,6 +527,9 @@ static unsigned char* bigBufferOverflow; /*this is a buffer that contains just e
 static unsigned char* bigBufferFit; /*this is a buffer that contains just enough characters to NOT go over the limit of 256K as a single message*/
 
 static const char* string10 = "thisgoestoJ\\s//on\"ToBeEn\r\n\bcoded";
+#define TEST_STRING10_PAYLOAD "[{\"body\":\"thisgoestoJ\\\\s\\/\\/on\\\"ToBeEn\\u000D\\u000A\\u0008coded\",\"base64Encoded\":false}]"
+static const char* string14 = "h\xC3\xA9llo w\xC3\xB6rld \xE2\x82\xAC\xF0\x9F\x98\x80\"";
+#define TEST_STRING14_ITEM "{\"body\":\"h\xC3\xA9llo w\xC3\xB6rld \xE2\x82\xAC\xF0\x9F\x98\x80\\\"\",\"base64Encoded\":false" TEST_UTF8_PROPERTIES_JSON "}"
 
 const unsigned int httpStatus200 = 200;
 const unsigned int httpStatus201 = 201;
@@ -485,6 +547,8 @@ static bool HTTPHeaders_GetHeaderCount_writes_to_its_outputs = true;
 /*value returned by time() function*/
 /*for the purpose of this implementation, time_t represents the number of seconds since 1970, 1st jan, 0:0:0*/
 #define TEST_GET_TIME_VALUE 384739233
+#define TEST_TICK_COUNTER_HANDLE (TICK_COUNTER_HANDLE)0x346
+static uint64_t currentTickMs;
 #define TEST_DEFAULT_GETMINIMUMPOLLINGTIME 1500
 
 
@@ -800,6 +864,12 @@ public:
 			*size = buffer11_size;
 			break;
 		}
+		case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_13) : /*this is a message with properties that need escaping*/
+		{
+			*buffer = buffer1;
+			*size = buffer1_size;
+			break;
+		}
 		default:
 		{
 			/*not expected really*/
@@ -826,6 +896,7 @@ public:
 	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_9) :
 	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
 	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_12) :
+	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_13) :
 	{
 		result2 = NULL;
 		break;
@@ -835,6 +906,11 @@ public:
 		result2 = string10;
 		break;
 	}
+	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_14) :
+	{
+		result2 = string14;
+		break;
+	}
 	default:
 	{
 		/*not expected really*/
@@ -907,6 +983,16 @@ public:
 		result2 = TEST_MAP_1_PROPERTY_AA_B;
 		break;
 	}
+	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_13) :
+	{
+		result2 = TEST_MAP_ESCAPED_PROPERTIES;
+		break;
+	}
+	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_14) :
+	{
+		result2 = TEST_MAP_UTF8_PROPERTIES;
+		break;
+	}
 	default:
 	{
 		/*not expected really*/
@@ -942,15 +1028,22 @@ public:
 	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_9) :
 	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
 	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_12) :
+	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_13) :
 	{
 		result2 = IOTHUBMESSAGE_BYTEARRAY;
 		break;
 	}
 	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_10) :
+	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_14) :
 	{
 		result2 = IOTHUBMESSAGE_STRING;
 		break;
 	}
+	default:
+	{
+		result2 = IOTHUBMESSAGE_UNKNOWN;
+		break;
+	}
 	}
 	MOCK_METHOD_END(IOTHUBMESSAGE_CONTENT_TYPE, result2)
 
@@ -963,6 +1056,9 @@ public:
 		MOCK_STATIC_METHOD_3(, void, IoTHubClient_LL_SendComplete, IOTHUB_CLIENT_LL_HANDLE, handle, PDLIST_ENTRY, completed, IOTHUB_BATCHSTATE_RESULT, result2)
 		MOCK_VOID_METHOD_END()
 
+		MOCK_STATIC_METHOD_4(, void, IoTHubClient_LL_SendStarted, IOTHUB_CLIENT_LL_HANDLE, handle, IOTHUB_MESSAGE_LIST*, first, size_t, count, size_t, size)
+		MOCK_VOID_METHOD_END()
+
 		/*buffer*/
 		/* BUFFER Mocks */
 		MOCK_STATIC_METHOD_0(, BUFFER_HANDLE, BUFFER_new)
@@ -1056,12 +1152,27 @@ public:
 			*count = 1;
 			break;
 		}
+		case((uintptr_t)TEST_MAP_ESCAPED_PROPERTIES) :
+		{
+			*keys = (const char*const*)TEST_KEYS_ESCAPED;
+			*values = (const char*const*)TEST_VALUES_ESCAPED;
+			*count = sizeof(TEST_KEYS_ESCAPED) / sizeof(TEST_KEYS_ESCAPED[0]);
+			break;
+		}
+		case((uintptr_t)TEST_MAP_UTF8_PROPERTIES) :
+		{
+			*keys = (const char*const*)TEST_KEYS_UTF8;
+			*values = (const char*const*)TEST_VALUES_UTF8;
+			*count = sizeof(TEST_KEYS_UTF8) / sizeof(TEST_KEYS_UTF8[0]);
+			break;
+		}
 		default:
 		{
 			ASSERT_FAIL("unexpected value");
 		}
 		}
-	MOCK_METHOD_END(MAP_RESULT, MAP_OK);
+	currentMap_GetInternals_call++;
+	MOCK_METHOD_END(MAP_RESULT, (((whenShallMap_GetInternals_fail > 0) && (currentMap_GetInternals_call == whenShallMap_GetInternals_fail)) ? MAP_ERROR : MAP_OK));
 
 	MOCK_STATIC_METHOD_3(, MAP_RESULT, Map_AddOrUpdate, MAP_HANDLE, handle, const char*, key, const char*, value)
 		MOCK_METHOD_END(MAP_RESULT, MAP_OK)
@@ -1140,11 +1251,15 @@ public:
 	last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = BASEIMPLEMENTATION::BUFFER_clone(requestContent);
 	MOCK_METHOD_END(HTTPAPIEX_RESULT, HTTPAPIEX_OK)
 
-		MOCK_STATIC_METHOD_1(, time_t, get_time, time_t*, currentTime)
-		MOCK_METHOD_END(time_t, TEST_GET_TIME_VALUE)
+		MOCK_STATIC_METHOD_0(, TICK_COUNTER_HANDLE, tickcounter_create)
+		MOCK_METHOD_END(TICK_COUNTER_HANDLE, TEST_TICK_COUNTER_HANDLE)
 
-		MOCK_STATIC_METHOD_2(, double, get_difftime, time_t, stopTime, time_t, startTime)
-		MOCK_METHOD_END(double, stopTime - startTime)
+		MOCK_STATIC_METHOD_1(, void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter)
+		MOCK_VOID_METHOD_END()
+
+		MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms)
+		*current_ms = currentTickMs;
+	MOCK_METHOD_END(int, 0)
 
 		// vector.h
 		MOCK_STATIC_METHOD_1(, VECTOR_HANDLE, VECTOR_create, size_t, elementSize)
@@ -1213,6 +1328,81 @@ public:
 		size_t result2 = BASEIMPLEMENTATION::VECTOR_size(vector);
 	MOCK_METHOD_END(size_t, result2)
 
+		// deviceregistry.h
+		MOCK_STATIC_METHOD_0(, DEVICE_REGISTRY_HANDLE, DeviceRegistry_Create)
+		DEVICE_REGISTRY_HANDLE result2;
+	++currentDeviceRegistry_Create_call;
+	if ((whenShallDeviceRegistry_Create_fail > 0) &&
+		(currentDeviceRegistry_Create_call == whenShallDeviceRegistry_Create_fail))
+	{
+		result2 = NULL;
+	}
+	else
+	{
+		result2 = BASEIMPLEMENTATION::DeviceRegistry_Create();
+	}
+	MOCK_METHOD_END(DEVICE_REGISTRY_HANDLE, result2)
+
+		MOCK_STATIC_METHOD_1(, void, DeviceRegistry_Destroy, DEVICE_REGISTRY_HANDLE, registry)
+		BASEIMPLEMENTATION::DeviceRegistry_Destroy(registry);
+	MOCK_VOID_METHOD_END()
+
+		MOCK_STATIC_METHOD_3(, int, DeviceRegistry_Add, DEVICE_REGISTRY_HANDLE, registry, const void*, device, const char*, deviceId)
+		int result2;
+	++currentDeviceRegistry_Add_call;
+	if ((whenShallDeviceRegistry_Add_fail > 0) &&
+		(currentDeviceRegistry_Add_call == whenShallDeviceRegistry_Add_fail))
+	{
+		result2 = __LINE__;
+	}
+	else
+	{
+		result2 = BASEIMPLEMENTATION::DeviceRegistry_Add(registry, device, deviceId);
+	}
+	MOCK_METHOD_END(int, result2)
+
+		MOCK_STATIC_METHOD_2(, void, DeviceRegistry_Remove, DEVICE_REGISTRY_HANDLE, registry, const void*, device)
+		BASEIMPLEMENTATION::DeviceRegistry_Remove(registry, device);
+	MOCK_VOID_METHOD_END()
+
+		MOCK_STATIC_METHOD_2(, bool, DeviceRegistry_Contains, DEVICE_REGISTRY_HANDLE, registry, const void*, device)
+		bool result2 = BASEIMPLEMENTATION::DeviceRegistry_Contains(registry, device);
+	MOCK_METHOD_END(bool, result2)
+
+		MOCK_STATIC_METHOD_2(, const void*, DeviceRegistry_FindById, DEVICE_REGISTRY_HANDLE, registry, const char*, deviceId)
+		const void* result2 = BASEIMPLEMENTATION::DeviceRegistry_FindById(registry, deviceId);
+	MOCK_METHOD_END(const void*, result2)
+
+		/* ThreadAPI mocks, the worker threads are never started, a test can run the last one created */
+		MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+		*threadHandle = TEST_THREAD_HANDLE;
+		savedWorkerFunc = func;
+		savedWorkerArg = arg;
+	MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+		MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+	MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+		MOCK_STATIC_METHOD_1(, void, ThreadAPI_Sleep, unsigned int, milliseconds)
+		if ((workerStopTransport != NULL) && (--workerSleepsBeforeStop == 0))
+		{
+			*(bool*)(((char*)workerStopTransport) + IoTHubTransportHttp_StopWorkersOffset) = true; /*what stopping the workers does under workLock*/
+		}
+	MOCK_VOID_METHOD_END()
+
+		/* Lock mocks */
+		MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+	MOCK_METHOD_END(LOCK_HANDLE, TEST_LOCK_HANDLE)
+
+		MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, handle)
+	MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+		MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, handle)
+	MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+		MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, handle)
+	MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, DList_InitializeListHead, PDLIST_ENTRY, listHead);
@@ -1274,6 +1464,7 @@ DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportHttpMocks, , MAP_RESULT, Map_GetInt
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , IOTHUBMESSAGE_DISPOSITION_RESULT, IoTHubClient_LL_MessageCallback, IOTHUB_CLIENT_LL_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, message)
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , void, IoTHubClient_LL_SendComplete, IOTHUB_CLIENT_LL_HANDLE, handle, PDLIST_ENTRY, completed, IOTHUB_BATCHSTATE_RESULT, result2)
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportHttpMocks, , void, IoTHubClient_LL_SendStarted, IOTHUB_CLIENT_LL_HANDLE, handle, IOTHUB_MESSAGE_LIST*, first, size_t, count, size_t, size)
 
 
 DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportHttpMocks, , BUFFER_HANDLE, BUFFER_new);
@@ -1296,8 +1487,9 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, HTTPAPIEX_SAS_De
 DECLARE_GLOBAL_MOCK_METHOD_9(CIoTHubTransportHttpMocks, , HTTPAPIEX_RESULT, HTTPAPIEX_SAS_ExecuteRequest2, HTTPAPIEX_SAS_HANDLE, sasHandle, HTTPAPIEX_HANDLE, handle, HTTPAPI_REQUEST_TYPE, requestType, const char*, relativePath, HTTP_HEADERS_HANDLE, requestHttpHeadersHandle, BUFFER_HANDLE, requestContent, unsigned int*, statusCode, HTTP_HEADERS_HANDLE, responseHttpHeadersHandle, BUFFER_HANDLE, responseContent);
 DECLARE_GLOBAL_MOCK_METHOD_8(CIoTHubTransportHttpMocks, , HTTPAPIEX_RESULT, HTTPAPIEX_ExecuteRequest2, HTTPAPIEX_HANDLE, handle, HTTPAPI_REQUEST_TYPE, requestType, const char*, relativePath, HTTP_HEADERS_HANDLE, requestHttpHeadersHandle, BUFFER_HANDLE, requestContent, unsigned int*, statusCode, HTTP_HEADERS_HANDLE, responseHttpHeadersHandle, BUFFER_HANDLE, responseContent);
 
-DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , time_t, get_time, time_t*, currentTime);
-DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , double, get_difftime, time_t, stopTime, time_t, startTime);
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportHttpMocks, , TICK_COUNTER_HANDLE, tickcounter_create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms);
 
 //vector
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , VECTOR_HANDLE, VECTOR_create, size_t, elementSize);
@@ -1310,6 +1502,22 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void*, VECTOR_back, VE
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , void*, VECTOR_find_if, VECTOR_HANDLE, vector, PREDICATE_FUNCTION, pred, const void*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , size_t, VECTOR_size, VECTOR_HANDLE, vector);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportHttpMocks, , DEVICE_REGISTRY_HANDLE, DeviceRegistry_Create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, DeviceRegistry_Destroy, DEVICE_REGISTRY_HANDLE, registry);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , int, DeviceRegistry_Add, DEVICE_REGISTRY_HANDLE, registry, const void*, device, const char*, deviceId);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , void, DeviceRegistry_Remove, DEVICE_REGISTRY_HANDLE, registry, const void*, device);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , bool, DeviceRegistry_Contains, DEVICE_REGISTRY_HANDLE, registry, const void*, device);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , const void*, DeviceRegistry_FindById, DEVICE_REGISTRY_HANDLE, registry, const char*, deviceId);
+
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, ThreadAPI_Sleep, unsigned int, milliseconds);
+
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportHttpMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, handle);
+
 extern "C" HTTPAPIEX_RESULT HTTPAPIEX_SAS_ExecuteRequest(HTTPAPIEX_SAS_HANDLE sasHandle, HTTPAPIEX_HANDLE handle, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath, HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode, HTTP_HEADERS_HANDLE responseHttpHeadersHandle, BUFFER_HANDLE responseContent)
 {
 	*statusCode = 204;
@@ -1369,25 +1577,40 @@ static void setupCreateHappyPathPerDeviceList(CIoTHubTransportHttpMocks &mocks,
 
 	STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Create());
 	if (deallocateCreated == true)
 	{
+		STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Destroy(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
 		STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
 	}
 }
 
+static void setupCreateHappyPathTickCounter(CIoTHubTransportHttpMocks &mocks, bool deallocateCreated)
+{
+	(void)mocks;
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+	if (deallocateCreated == true)
+	{
+		STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_TICK_COUNTER_HANDLE));
+	}
+}
+
 static void setupCreateHappyPath(CIoTHubTransportHttpMocks &mocks, bool deallocateCreated)
 {
 	setupCreateHappyPathAlloc(mocks, deallocateCreated);
 	setupCreateHappyPathHostname(mocks, deallocateCreated);
 	setupCreateHappyPathApiExHandle(mocks, deallocateCreated);
 	setupCreateHappyPathPerDeviceList(mocks, deallocateCreated);
+	setupCreateHappyPathTickCounter(mocks, deallocateCreated);
 }
 
 static void setupRegisterHappyPathNotFoundInList(CIoTHubTransportHttpMocks &mocks, bool deallocateCreated)
 {
 	(void)mocks;
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_DEVICE_ID))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_FindById(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreAllArguments();
 }
 
@@ -1585,13 +1808,26 @@ static void setupRegisterHappyPatheventConfirmations(CIoTHubTransportHttpMocks &
 {
 	(void)mocks;
 	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
 }
 
 static void setupRegisterHappyPathDeviceListAdd(CIoTHubTransportHttpMocks &mocks, bool deallocateCreated)
 {
 	(void)mocks;
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Add(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
 	STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
 		.IgnoreArgument(1).IgnoreArgument(2);
+	if (deallocateCreated == true)
+	{
+		STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreAllArguments();
+	}
+	else
+	{
+		STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+	}
 }
 
 
@@ -1657,6 +1893,35 @@ static void setupUnregisterOneDevice(CIoTHubTransportHttpMocks &mocks)
 
 }
 
+static void setupStartOneWorker(CIoTHubTransportHttpMocks &mocks)
+{
+	(void)mocks;
+
+	STRICT_EXPECTED_CALL(mocks, Lock_Init());
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+}
+
+static void setupStopOneWorker(CIoTHubTransportHttpMocks &mocks)
+{
+	(void)mocks;
+
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Destroy(TEST_HTTPAPIEX_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+}
+
 static void setupDoWorkLoopOnceForOneDevice(CIoTHubTransportHttpMocks &mocks)
 {
 	(void)mocks;
@@ -1675,6 +1940,51 @@ static void setupDoWorkLoopForNextDevice(CIoTHubTransportHttpMocks &mocks, size_
 		.IgnoreArgument(1);
 }
 
+/*makePayload fetches every message it batches twice: once to measure it, once to write it*/
+static void setupGetBatchItem(CIoTHubTransportHttpMocks &mocks, IOTHUB_MESSAGE_HANDLE messageHandle, MAP_HANDLE properties)
+{
+	(void)mocks;
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(messageHandle));
+	if ((messageHandle == TEST_IOTHUB_MESSAGE_HANDLE_10) || (messageHandle == TEST_IOTHUB_MESSAGE_HANDLE_14)) /*the IOTHUBMESSAGE_STRING messages*/
+	{
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(messageHandle));
+	}
+	else
+	{
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(2)
+			.IgnoreArgument(3);
+	}
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(messageHandle));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(properties, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+}
+
+static void setupPayloadBuffer(CIoTHubTransportHttpMocks &mocks)
+{
+	(void)mocks;
+
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+}
+
+/*the payload is sized exactly, so its length is checked too*/
+static void assertLastPayload(const char* expected)
+{
+	ASSERT_IS_NOT_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+	ASSERT_ARE_EQUAL(int, (int)strlen(expected), (int)BASEIMPLEMENTATION::BUFFER_length(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest));
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), expected, strlen(expected)));
+}
+
 //
 //static void setupInitHappyPathUpThroughHostName(CIoTHubTransportHttpMocks &mocks, bool deallocateCreated)
 //{
@@ -1782,6 +2092,11 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 	currentmalloc_call = 0;
 	whenShallmalloc_fail = 0;
 
+	savedWorkerFunc = NULL;
+	savedWorkerArg = NULL;
+	workerStopTransport = NULL;
+	workerSleepsBeforeStop = 0;
+
 	currentSTRING_new_call = 0;
 	whenShallSTRING_new_fail = 0;
 
@@ -1839,7 +2154,18 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 	currentVECTOR_find_if_call = 0;
 	whenShallVECTOR_find_if_fail = 0;
 
+	currentDeviceRegistry_Create_call = 0;
+	whenShallDeviceRegistry_Create_fail = 0;
+
+	currentDeviceRegistry_Add_call = 0;
+	whenShallDeviceRegistry_Add_fail = 0;
+
+	currentMap_GetInternals_call = 0;
+	whenShallMap_GetInternals_fail = 0;
+
 	last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
+
+	currentTickMs = TEST_GET_TIME_VALUE;
 }
 
 
@@ -1979,7 +2305,57 @@ TEST_FUNCTION(IoTHubTransportHttp_Create_fails_when_perDeviceList_fails)
 	setupCreateHappyPathHostname(mocks, true);
 	setupCreateHappyPathApiExHandle(mocks, true);
 	whenShallVECTOR_create_fail = 1;
-	setupCreateHappyPathPerDeviceList(mocks, false);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	auto result = IoTHubTransportHttp_Create(&TEST_CONFIG);
+
+	///assert
+	ASSERT_IS_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_183: [ IoTHubTransportHttp_Create shall call DeviceRegistry_Create to create the index of the registered devices. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_184: [ If DeviceRegistry_Create fails, then IoTHubTransportHttp_Create shall fail and return NULL. ]
+TEST_FUNCTION(IoTHubTransportHttp_Create_fails_when_DeviceRegistry_Create_fails)
+{
+	CIoTHubTransportHttpMocks mocks;
+
+	setupCreateHappyPathAlloc(mocks, true);
+	setupCreateHappyPathHostname(mocks, true);
+	setupCreateHappyPathApiExHandle(mocks, true);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	whenShallDeviceRegistry_Create_fail = 1;
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Create());
+	STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	auto result = IoTHubTransportHttp_Create(&TEST_CONFIG);
+
+	///assert
+	ASSERT_IS_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_162: [ IoTHubTransportHttp_Create shall create a tick counter by calling tickcounter_create. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_163: [ If tickcounter_create fails, then IoTHubTransportHttp_Create shall fail and return NULL. ]
+TEST_FUNCTION(IoTHubTransportHttp_Create_fails_when_tickcounter_create_fails)
+{
+	CIoTHubTransportHttpMocks mocks;
+
+	setupCreateHappyPathAlloc(mocks, true);
+	setupCreateHappyPathHostname(mocks, true);
+	setupCreateHappyPathApiExHandle(mocks, true);
+	setupCreateHappyPathPerDeviceList(mocks, true);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_create())
+		.SetReturn((TICK_COUNTER_HANDLE)NULL);
 
 	///act
 	auto result = IoTHubTransportHttp_Create(&TEST_CONFIG);
@@ -2133,8 +2509,11 @@ TEST_FUNCTION(IoTHubTransportHttp_Destroy_succeeds_NoRegistered_devices)
 		.IgnoreArgument(1);                                             //HTTPAPIEX_HANDLE httpApiExHandle;
 	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);                                             //DEVICE_REGISTRY_HANDLE deviceRegistry;
 	STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);                                             //VECTOR_HANDLE perDeviceList;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_TICK_COUNTER_HANDLE)); //TICK_COUNTER_HANDLE tickCounter;
 
 	STRICT_EXPECTED_CALL(mocks, gballoc_free(handle));
 
@@ -2167,8 +2546,11 @@ TEST_FUNCTION(IoTHubTransportHttp_Destroy_succeeds_One_Registered_device)
 	STRICT_EXPECTED_CALL(mocks, gballoc_free(devHandle));
 
 
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);                                             //DEVICE_REGISTRY_HANDLE deviceRegistry;
 	STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);                                             //VECTOR_HANDLE perDeviceList;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_TICK_COUNTER_HANDLE)); //TICK_COUNTER_HANDLE tickCounter;
 
 	STRICT_EXPECTED_CALL(mocks, gballoc_free(handle));
 
@@ -2283,11 +2665,6 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_2nd_device_HappyPath_success_fun_time
 
 	mocks.ResetAllCalls();
 
-	// find in vector..
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	// actual register
 	setupRegisterHappyPath(mocks, false);
 
 	///act 
@@ -2306,7 +2683,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_2nd_device_HappyPath_success_fun_time
 
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_137: [ IoTHubTransportHttp_Register shall search the devices list for any device matching name deviceId. If deviceId is found it shall return NULL. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_137: [ IoTHubTransportHttp_Register shall look up deviceId in the device registry of the transport. If deviceId is found it shall return NULL. ]
 TEST_FUNCTION(IoTHubTransportHttp_Register_sameDevice_twice_returns_null)
 {
 	///arrange
@@ -2318,13 +2695,8 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_sameDevice_twice_returns_null)
 
 	mocks.ResetAllCalls();
 
-	// find in vector.. 2 and 1a
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_FindById(IGNORED_PTR_ARG, TEST_DEVICE_ID))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_DEVICE_ID))
-		.IgnoreAllArguments();
 
 	///act 
 
@@ -2340,6 +2712,43 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_sameDevice_twice_returns_null)
 
 }
 
+//Tests_SRS_TRANSPORTMULTITHTTP_17_181: [ IoTHubTransportHttp_Register shall call DeviceRegistry_Add to index the new device by its handle and by deviceId. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_182: [ If DeviceRegistry_Add fails then IoTHubTransportHttp_Register shall fail and return NULL. ]
+TEST_FUNCTION(IoTHubTransportHttp_Register_DeviceRegistry_Add_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	bool deallocateCreated = true;
+	setupRegisterHappyPathNotFoundInList(mocks, deallocateCreated);
+	setupRegisterHappyPathAllocHandle(mocks, deallocateCreated);
+	setupRegisterHappyPathcreate_deviceId(mocks, deallocateCreated);
+	setupRegisterHappyPathcreate_deviceKey(mocks, deallocateCreated);
+	setupRegisterHappyPatheventHTTPrelativePath(mocks, deallocateCreated);
+	setupRegisterHappyPathmessageHTTPrelativePath(mocks, deallocateCreated);
+	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
+	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathsasObject(mocks, deallocateCreated);
+	whenShallDeviceRegistry_Add_fail = 1;
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Add(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_DEVICE_ID))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	///assert
+
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
 //Tests_SRS_TRANSPORTMULTITHTTP_17_042: [ If the VECTOR_push_back fails then IoTHubTransportHttp_Register shall fail and return NULL. ]
 TEST_FUNCTION(IoTHubTransportHttp_Register_vector_pushback_fails)
 {
@@ -3752,7 +4161,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_deviceHandle_not_allocated)
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_137: [ IoTHubTransportHttp_Register shall search the devices list for any device matching name deviceId. If deviceId is found it shall return NULL. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_137: [ IoTHubTransportHttp_Register shall look up deviceId in the device registry of the transport. If deviceId is found it shall return NULL. ]
 TEST_FUNCTION(IoTHubTransportHttp_Register_deviceFoundInList_fails)
 {
 	///arrange
@@ -3760,9 +4169,9 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_deviceFoundInList_fails)
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_DEVICE_ID))
-		.IgnoreAllArguments()
-		.SetReturn((void_ptr)0x1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_FindById(IGNORED_PTR_ARG, TEST_DEVICE_ID))
+		.IgnoreArgument(1)
+		.SetReturn((const void*)0x1);
 
 	///act
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
@@ -3920,9 +4329,9 @@ TEST_FUNCTION(IoTHubTransportHttp_Unregister_null_does_nothing)
 	IoTHubTransportHttp_Unregister(NULL);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_045: [IoTHubTransportHttp_Unregister shall locate deviceHandle in the transport device list by calling VECTOR_find_if.]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_045: [IoTHubTransportHttp_Unregister shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains.]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_047 : [IoTHubTransportHttp_Unregister shall free all the resources used in the device structure.]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_048 : [IoTHubTransportHttp_Unregister shall call VECTOR_erase to remove device from devices list.]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_048 : [IoTHubTransportHttp_Unregister shall call DeviceRegistry_Remove and shall remove the device from the devices list by moving the last device of the list in its place.]
 TEST_FUNCTION(IoTHubTransportHttp_Unregister_superHappyFunPath)
 {
 	///arrange
@@ -3933,10 +4342,13 @@ TEST_FUNCTION(IoTHubTransportHttp_Unregister_superHappyFunPath)
 	mocks.ResetAllCalls();
 
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1);
 	setupUnregisterOneDevice(mocks);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
@@ -3955,9 +4367,9 @@ TEST_FUNCTION(IoTHubTransportHttp_Unregister_superHappyFunPath)
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_045: [IoTHubTransportHttp_Unregister shall locate deviceHandle in the transport device list by calling VECTOR_find_if.]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_045: [IoTHubTransportHttp_Unregister shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains.]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_047 : [IoTHubTransportHttp_Unregister shall free all the resources used in the device structure.]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_048 : [IoTHubTransportHttp_Unregister shall call VECTOR_erase to remove device from devices list.]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_048 : [IoTHubTransportHttp_Unregister shall call DeviceRegistry_Remove and shall remove the device from the devices list by moving the last device of the list in its place.]
 TEST_FUNCTION(IoTHubTransportHttp_Unregister_2nd_device_superHappyFunPath)
 {
 	///arrange
@@ -3969,10 +4381,13 @@ TEST_FUNCTION(IoTHubTransportHttp_Unregister_2nd_device_superHappyFunPath)
 	mocks.ResetAllCalls();
 
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle1))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle1))
+		.IgnoreArgument(1);
 	setupUnregisterOneDevice(mocks);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, devHandle1))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
@@ -3991,21 +4406,78 @@ TEST_FUNCTION(IoTHubTransportHttp_Unregister_2nd_device_superHappyFunPath)
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_046 : [If the device structure is not found, then this function shall fail and do nothing.]
-TEST_FUNCTION(IoTHubTransportHttp_Unregister_DeviceNotFound_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_048 : [IoTHubTransportHttp_Unregister shall call DeviceRegistry_Remove and shall remove the device from the devices list by moving the last device of the list in its place.]
+TEST_FUNCTION(IoTHubTransportHttp_Unregister_1st_of_2_devices_moves_the_last_device)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	auto devHandle1 = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	auto devHandle2 = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
 
 	mocks.ResetAllCalls();
 
-
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle1))
+		.IgnoreArgument(1);
+	setupUnregisterOneDevice(mocks);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, devHandle1))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
 		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetFailReturn((void_ptr)NULL);
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(devHandle1));
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);                                             //STRING_HANDLE deviceSasToken;
+
+	///act
+	IoTHubTransportHttp_Unregister(devHandle1);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(int, 0, IoTHubTransportHttp_Subscribe(devHandle2));
+	mocks.ResetAllCalls();
+
+	/*the device that was moved is found at its new place*/
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle2))
+		.IgnoreArgument(1);
+	setupUnregisterOneDevice(mocks);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Remove(IGNORED_PTR_ARG, devHandle2))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(devHandle2));
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);                                             //STRING_HANDLE deviceSasToken;
+
+	IoTHubTransportHttp_Unregister(devHandle2);
+
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_046 : [If the device structure is not found, then this function shall fail and do nothing.]
+TEST_FUNCTION(IoTHubTransportHttp_Unregister_DeviceNotFound_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	mocks.ResetAllCalls();
+
+
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1)
+		.SetReturn(false);
 
 
 	///act
@@ -4032,7 +4504,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Subscribe_with_NULL_parameter_fails)
 }
 
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_104: [ IoTHubTransportHttp_Subscribe shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_104: [ IoTHubTransportHttp_Subscribe shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_106: [ Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork should execute HTTP requests. 
 TEST_FUNCTION(IoTHubTransportHttp_Subscribe_with_non_NULL_parameter_succeeds)
 {
@@ -4043,9 +4515,8 @@ TEST_FUNCTION(IoTHubTransportHttp_Subscribe_with_non_NULL_parameter_succeeds)
 
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1);
 
 	///act
 	auto result = IoTHubTransportHttp_Subscribe(devHandle);
@@ -4058,7 +4529,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Subscribe_with_non_NULL_parameter_succeeds)
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_104: [ IoTHubTransportHttp_Subscribe shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_104: [ IoTHubTransportHttp_Subscribe shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_106: [ Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork should execute HTTP requests. 
 TEST_FUNCTION(IoTHubTransportHttp_Subscribe_2devices_succeeds)
 {
@@ -4070,12 +4541,10 @@ TEST_FUNCTION(IoTHubTransportHttp_Subscribe_2devices_succeeds)
 
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle1))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle2))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle1))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle2))
+		.IgnoreArgument(1);
 
 	///act
 	auto result1 = IoTHubTransportHttp_Subscribe(devHandle1);
@@ -4100,10 +4569,9 @@ TEST_FUNCTION(IoTHubTransportHttp_Subscribe_with_list_find_fails)
 
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle))
 		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetReturn((void_ptr)NULL);
+		.SetReturn(false);
 
 	///act
 	auto result = IoTHubTransportHttp_Subscribe(devHandle);
@@ -4130,7 +4598,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Unsubscribe_with_NULL_parameter_succeeds) /*do
 
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_108: [IoTHubTransportHttp_Unsubscribe shall locate deviceHandle in the transport device list by calling VECTOR_find_if.]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_108: [IoTHubTransportHttp_Unsubscribe shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains.]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_110 : [Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork shall not execute HTTP requests.]
 TEST_FUNCTION(IoTHubTransportHttp_Unsubscribe_with_non_NULL_parameter_succeeds)
 {
@@ -4141,9 +4609,8 @@ TEST_FUNCTION(IoTHubTransportHttp_Unsubscribe_with_non_NULL_parameter_succeeds)
 
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1);
 
 	///act
 	IoTHubTransportHttp_Unsubscribe(devHandle);
@@ -4155,7 +4622,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Unsubscribe_with_non_NULL_parameter_succeeds)
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_108: [IoTHubTransportHttp_Unsubscribe shall locate deviceHandle in the transport device list by calling VECTOR_find_if.]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_108: [IoTHubTransportHttp_Unsubscribe shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains.]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_110 : [Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork should not execute HTTP requests.]
 TEST_FUNCTION(IoTHubTransportHttp_Unsubscribe_with_2devices_succeeds)
 {
@@ -4167,12 +4634,10 @@ TEST_FUNCTION(IoTHubTransportHttp_Unsubscribe_with_2devices_succeeds)
 
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle2))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle2))
+		.IgnoreArgument(1);
 
 	///act
 	IoTHubTransportHttp_Unsubscribe(devHandle);
@@ -4195,10 +4660,9 @@ TEST_FUNCTION(IoTHubTransportHttp_Unsubscribe_with_device_not_found_does_nothing
 
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle))
 		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetFailReturn((void_ptr)NULL);
+		.SetReturn(false);
 
 	///act
 	IoTHubTransportHttp_Unsubscribe(devHandle);
@@ -4409,7 +4873,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -4565,7 +5030,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_2device_with_2nd_empty_waiti
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend2)); /* DoWork DoEvent for device 1*/
 
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -4694,51 +5160,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_2devices_2nd_has_1_event_item_as_string
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	setupGetBatchItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
 	/*building the list of messages to be notified if HTTP is fine*/
 	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
@@ -4746,25 +5173,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_2devices_2nd_has_1_event_item_as_string
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
@@ -4793,6 +5205,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_2devices_2nd_has_1_event_item_as_string
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	assertLastPayload(TEST_STRING10_PAYLOAD);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
@@ -4823,7 +5236,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_2devices_2subscriptions_happy_path_succ
 
 																	 // Device 1
 	{
-		STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
 		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
@@ -4926,7 +5340,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_2devices_2subscriptions_happy_path_succ
 
 	//device 2
 	{
-		STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2);
 		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
@@ -5054,8 +5469,9 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL))
-		.SetReturn((time_t)(-1));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.SetReturn(1);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -5183,8 +5599,9 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 		STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-		STRICT_EXPECTED_CALL(mocks, get_time(NULL))
-			.SetReturn((time_t)(-1));
+		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+			.IgnoreArgument(2)
+			.SetReturn(1);
 		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
@@ -5319,7 +5736,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -5445,9 +5863,43 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL))
-		.SetReturn(TEST_GET_TIME_VALUE + TEST_DEFAULT_GETMINIMUMPOLLINGTIME); /*right on the verge of the time*/
-	STRICT_EXPECTED_CALL(mocks, get_difftime(TEST_GET_TIME_VALUE + TEST_DEFAULT_GETMINIMUMPOLLINGTIME, TEST_GET_TIME_VALUE));
+	currentTickMs = TEST_GET_TIME_VALUE + TEST_DEFAULT_GETMINIMUMPOLLINGTIME * 1000; /*right on the verge of the time*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_165: [ Every consecutive GET that returns no message shall double the polling interval of the device, up to MaximumPollingTime. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_after_an_empty_GET_with_MaximumPollingTime_backs_off_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	unsigned int maximumPollingTime = 4 * TEST_DEFAULT_GETMINIMUMPOLLINGTIME;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_SetOption(handle, "MaximumPollingTime", &maximumPollingTime);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE); /*the GET returns 204, the polling interval doubles*/
+	mocks.ResetAllCalls();
+
+	/*everything below is for the second time _DoWork this is called*/
+
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+
+	currentTickMs = TEST_GET_TIME_VALUE + 2 * TEST_DEFAULT_GETMINIMUMPOLLINGTIME * 1000; /*after MinimumPollingTime, on the verge of the doubled interval*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -5479,9 +5931,9 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL))
-		.SetReturn(TEST_GET_TIME_VALUE + TEST_DEFAULT_GETMINIMUMPOLLINGTIME + 1); /*right on the verge of the time*/
-	STRICT_EXPECTED_CALL(mocks, get_difftime(TEST_GET_TIME_VALUE + TEST_DEFAULT_GETMINIMUMPOLLINGTIME + 1, TEST_GET_TIME_VALUE));
+	currentTickMs = TEST_GET_TIME_VALUE + TEST_DEFAULT_GETMINIMUMPOLLINGTIME * 1000 + 1; /*right on the verge of the time*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
@@ -5606,7 +6058,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -5728,7 +6181,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -5851,7 +6305,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -5955,7 +6410,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -6056,7 +6512,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -6152,7 +6609,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -6245,7 +6703,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -6336,7 +6795,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -6422,7 +6882,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -6530,7 +6991,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -6653,7 +7115,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -6776,7 +7239,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -6899,7 +7363,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7003,7 +7468,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7105,7 +7571,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7200,7 +7667,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7293,7 +7761,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7384,7 +7853,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7470,7 +7940,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7554,7 +8025,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7667,7 +8139,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7726,7 +8199,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7785,7 +8259,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7844,7 +8319,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7903,7 +8379,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -7962,7 +8439,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -8021,7 +8499,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -8076,7 +8555,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -8131,7 +8611,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -8164,7 +8645,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
 	whenShallHTTPHeaders_Alloc_fail = currentHTTPHeaders_Alloc_call + 1;
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 
 													  ///act
@@ -8195,6 +8677,7 @@ TEST_FUNCTION(HTTP_Protocol_succeeds)
 	ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Unsubscribe, (void*)IoTHubTransportHttp_Unsubscribe);
 	ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_DoWork, (void*)IoTHubTransportHttp_DoWork);
 	ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_GetSendStatus, (void*)IoTHubTransportHttp_GetSendStatus);
+	ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_SendMessageDisposition, (void*)IoTHubTransportHttp_SendMessageDisposition);
 	ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_SetOption, (void*)IoTHubTransportHttp_SetOption);
 
 	///cleanup
@@ -8207,6 +8690,7 @@ TEST_FUNCTION(HTTP_Protocol_succeeds)
 //Tests_SRS_TRANSPORTMULTITHTTP_17_054: [ Request HTTP headers shall have the value of "Content-Type" created or updated to "application/vnd.microsoft.iothub.json" by a call to HTTPHeaders_ReplaceHeaderNameValuePair. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_053: [ If option SetBatching is true then _DoWork shall send batched event message as specced below. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_186: [ If HTTPAPIEX_SAS_ExecuteRequest does not fail for a batch, IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendStarted passing the first batched message, the number of batched messages and the size of the payload, before looking at the http status code. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
 TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_happy_path_succeeds)
 {
@@ -8225,55 +8709,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_happy_path_succeeds)
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
 	/*building the list of messages to be notified if HTTP is fine*/
 	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
@@ -8281,25 +8722,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_happy_path_succeeds)
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, &message1, 1, sizeof("[{\"body\":\"MQ==\"}]") - 1));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
@@ -8328,6 +8754,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_happy_path_succeeds)
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	assertLastPayload("[{\"body\":\"MQ==\"}]");
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
@@ -8352,55 +8779,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_ht
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
 	/*building the list of messages to be notified if HTTP is fine*/
 	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
@@ -8408,25 +8792,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_ht
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
@@ -8461,6 +8830,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_ht
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_186: [ If HTTPAPIEX_SAS_ExecuteRequest does not fail for a batch, IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendStarted passing the first batched message, the number of batched messages and the size of the payload, before looking at the http status code. ]
 TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HTTPAPIEX_SAS_ExecuteRequest2_fails)
 {
 	///arrange
@@ -8478,55 +8848,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HT
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
 	/*building the list of messages to be notified if HTTP is fine*/
 	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
@@ -8534,22 +8861,6 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HT
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
@@ -8587,8 +8898,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HT
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BUFFER_build_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_146: [ If BUFFER_new or BUFFER_pre_build fails then no item shall be removed from waitingToSend and IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_leaves_it_in_waitingToSend_when_BUFFER_pre_build_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -8605,98 +8916,32 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(__LINE__);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		whenShallBUFFER_build_fail = 1;
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.SetReturn(__LINE__);
-	}
-
-	STRICT_EXPECTED_CALL(mocks, DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
-
 	ENABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(void_ptr, &(message1.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BUFFER_new_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_146: [ If BUFFER_new or BUFFER_pre_build fails then no item shall be removed from waitingToSend and IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_leaves_it_in_waitingToSend_when_BUFFER_new_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -8713,71 +8958,11 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
-
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-		.IgnoreArgument(1);
-
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		whenShallBUFFER_new_fail = 1;
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	}
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-	STRICT_EXPECTED_CALL(mocks, DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new())
+		.SetReturn((BUFFER_HANDLE)NULL);
 
 	ENABLE_BATCHING();
 
@@ -8785,6 +8970,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(void_ptr, &(message1.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
@@ -8792,7 +8978,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_with_STRING_fails_it_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_GetByteArray_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -8809,50 +8995,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		whenShallSTRING_concat_with_STRING_fail = 7;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+	/*measuring the payload*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.SetReturn(IOTHUB_MESSAGE_ERROR);
 
 	ENABLE_BATCHING();
 
@@ -8866,8 +9014,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_055: [ If updating Content-Type fails for any reason, then _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_HTTP_headers_fails_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -8882,46 +9030,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		whenShallSTRING_concat_fail = currentSTRING_concat_call + 2;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+		.IgnoreArgument(1)
+		.SetReturn(HTTP_HEADERS_ERROR);
 
 	ENABLE_BATCHING();
 
@@ -8935,12 +9045,14 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it_fails_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_065: [ If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_FAILED. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_061: [ The message size shall be limited to 255KB - 1 byte. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_062: [ The message size is computed from the length of the payload + 384. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_bigger_than_256K_path_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message4.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -8953,37 +9065,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message4.messageHandle, TEST_MAP_EMPTY);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	/*building the list of messages to be notified because this is 100% fail (>256K)*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message4.entry)))
 		.IgnoreArgument(1);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-
-		whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -8997,12 +9089,13 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_with_STRING_it_fails_2)
+/*this is a test that wants to see that "almost" 255KB message still fits*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_062: [ The message size is computed from the length of the payload + 384. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message5.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -9015,35 +9108,46 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message5.messageHandle, TEST_MAP_EMPTY);
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	setupGetBatchItem(mocks, message5.messageHandle, TEST_MAP_EMPTY);
 
-		whenShallSTRING_concat_with_STRING_fail = 6;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-		/*end of the first batched payload*/
-	}
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message5.entry)))
+		.IgnoreArgument(1);
 
-	ENABLE_BATCHING();
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+	/*once the event has been succesfull...*/
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
+
+	ENABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -9055,12 +9159,13 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_Base64_Encode_Bytes_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
 	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message2.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -9073,25 +9178,50 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_Base64_Encode_By
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+	setupGetBatchItem(mocks, message2.messageHandle, TEST_MAP_EMPTY);
+
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+	setupGetBatchItem(mocks, message2.messageHandle, TEST_MAP_EMPTY);
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message2.entry)))
 		.IgnoreArgument(1);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-		whenShallBase64_Encode_Bytes_fail = 1;
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		/*end of the first batched payload*/
-	}
+	/*once the event has been succesfull...*/
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -9099,23 +9229,24 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_Base64_Encode_By
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	assertLastPayload("[{\"body\":\"MQ==\"},{\"body\":\"MjI=\"}]");
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_GetByteArray_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_1)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
 	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message2.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
-
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
@@ -9123,24 +9254,49 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_Ge
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.SetReturn(IOTHUB_MESSAGE_ERROR);
+
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
 		.IgnoreArgument(1);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.SetReturn(IOTHUB_MESSAGE_ERROR);
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-		/*end of the first batched payload*/
-	}
+	/*once the event has been succesfull...*/
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -9148,23 +9304,24 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_Ge
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	assertLastPayload("[{\"body\":\"MQ==\"}]");
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct_fails_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_2)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
 	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message2.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
-
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
@@ -9172,18 +9329,54 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
+
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
 		.IgnoreArgument(1);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		whenShallSTRING_construct_fail = currentSTRING_construct_call + 2;
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		/*end of the first batched payload*/
-	}
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+	/*once the event has been succesfull...*/
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -9191,23 +9384,24 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	assertLastPayload("[{\"body\":\"MQ==\"}]");
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_the_second_one_does_not_fit_256K_makes_1_batch_of_the_first_item_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
 	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message5.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
-
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
@@ -9215,9 +9409,45 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	whenShallSTRING_construct_fail = currentSTRING_construct_call + 1;
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+	setupGetBatchItem(mocks, message5.messageHandle, TEST_MAP_EMPTY);
+
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+		.IgnoreArgument(1);
+
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+	/*once the event has been succesfull...*/
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -9225,220 +9455,206 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	assertLastPayload("[{\"body\":\"MQ==\"}]");
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_055: [ If updating Content-Type fails for any reason, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_HTTP_headers_fails_it_fails)
+
+/*** IoTHubTransportHttp_GetSendStatus ***/
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidHandleArgument_fail)
 {
-	///arrange
+	// arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
+	IOTHUB_CLIENT_STATUS status;
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(NULL, &status);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1)
-		.SetReturn(HTTP_HEADERS_ERROR);
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
 
-	ENABLE_BATCHING();
+	mocks.AssertActualAndExpectedCalls();
 
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	// cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidStatusArgument_fail)
+{
+	// arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	mocks.ResetAllCalls();
+
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, NULL);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
 
-	///assert
 	mocks.AssertActualAndExpectedCalls();
 
-	///cleanup
+	// cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_065: [ If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_FAILED. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_061: [ The message size shall be limited to 255KB - 1 byte. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_062: [ The message size is computed from the length of the payload + 384. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_bigger_than_256K_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_112: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there are currently no event items to be sent or being sent. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_empty_waitingToSend_and_empty_eventConfirmations_success)
 {
-	///arrange
+	// arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message4.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	IOTHUB_CLIENT_STATUS status;
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_IDLE);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message4.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message4.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(bigBufferOverflow, TEST_BIG_BUFFER_1_OVERFLOW_SIZE));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	// cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_113: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the device registry of the transport by calling DeviceRegistry_Contains. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_waitingToSend_not_empty_success)
+{
+	// arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message4.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
+	IOTHUB_MESSAGE_LIST newEntry;
+	newEntry.messageHandle = &newEntry;
+	DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
 
-	{
-		/*adding the first payload to the "big" payload*/
-		/*building the list of messages to be notified because this is 100% fail (>256K)*/
-		STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message4.entry)))
-			.IgnoreArgument(1);
-	}
+	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
-		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	ENABLE_BATCHING();
+	IOTHUB_CLIENT_STATUS status;
 
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_BUSY);
 
-	///assert
 	mocks.AssertActualAndExpectedCalls();
 
-	///cleanup
+	// cleanup
 	IoTHubTransportHttp_Destroy(handle);
+	IoTHubMessage_Destroy(eventMessageHandle);
 }
 
-/*this is a test that wants to see that "almost" 255KB message still fits*/
-//Tests_SRS_TRANSPORTMULTITHTTP_17_062: [ The message size is computed from the length of the payload + 384. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_139: [ If the device structure is not found, then this function shall fail and return with IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_deviceData_is_not_found_fails)
 {
-	///arrange
+	// arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message5.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	mocks.ResetAllCalls();
+	IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
+	IOTHUB_MESSAGE_LIST newEntry;
+	newEntry.messageHandle = &newEntry;
+	DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
+	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Contains(IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1)
+		.SetReturn(false);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	IOTHUB_CLIENT_STATUS status;
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message5.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message5.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(bigBufferFit, TEST_BIG_BUFFER_1_FIT_SIZE));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	// cleanup
+	IoTHubTransportHttp_Destroy(handle);
+	IoTHubMessage_Destroy(eventMessageHandle);
+}
 
-		EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+void setupIrrelevantMocksForProperties(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_HANDLE messageHandle) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
+{
+	(void)(*mocks);
+	STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+		.IgnoreArgument(1);
 
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message5.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
+	MAP_HANDLE properties;
+	PDLIST_ENTRY entry;
+	switch ((uintptr_t)messageHandle)
+	{
+	case((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
+	{
+		properties = TEST_MAP_1_PROPERTY_A_B;
+		entry = &(message11.entry);
+		break;
 	}
-
+	default:
 	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+		properties = TEST_MAP_1_PROPERTY;
+		entry = &(message6.entry);
+		break;
+	}
 	}
 
+	/*measuring the payload*/
+	setupGetBatchItem(*mocks, messageHandle, properties);
+
+	/*writing the payload*/
+	setupPayloadBuffer(*mocks);
+	setupGetBatchItem(*mocks, messageHandle, properties);
+
 	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message5.entry)))
+	STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, entry))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+	STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+	EXPECTED_CALL((*mocks), IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
 		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
@@ -9457,8 +9673,25 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_
 
 	/*once the event has been succesfull...*/
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+	STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
 		.IgnoreArgument(2);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_059: [ It shall inspect the "waitingToSend" DLIST passed in config structure. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_properties_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	mocks.ResetAllCalls();
+
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	setupIrrelevantMocksForProperties(&mocks, message6.messageHandle);
 
 	ENABLE_BATCHING();
 
@@ -9472,13 +9705,15 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_063: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_at_maximum_message_size_succeeds)
 {
+	/*this test shall use a message that has a payload of MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - PROPERTY_OVERHEAD - 2*/
+	/*it will also have a property of "a":"b", therefore reaching the MAXIMUM_MESSAGE_SIZE*/
+	/*the next test will increase either the propertyname or value by 1 character as the message is expected to fail*/
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
-	DList_InsertTailList(&(waitingToSend), &(message2.entry));
+	DList_InsertTailList(&(waitingToSend), &(message11.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -9486,151 +9721,70 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succee
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+	setupIrrelevantMocksForProperties(&mocks, message11.messageHandle);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	ENABLE_BATCHING();
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-		.ExpectedAtLeastTimes(2);
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_063: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_past_maximum_message_size_fails)
+{
+	/*this test shall use a message that has a payload of MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - PROPERTY_OVERHEAD - 2*/
+	/*it will also have a property of "aa":"b", therefore reaching 1 byte past the MAXIMUM_MESSAGE_SIZE*/
+	/*this is done in a very e2e manner*/
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks>mocks;
+	DList_InsertTailList(&(waitingToSend), &(message12.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	ENABLE_BATCHING();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
 
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+	mocks.ResetAllCalls();
 
-	/*this is second batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer2, buffer2_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+		.IgnoreArgument(2);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-	{
-		/*adding the second payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-	{
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
-
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message2.entry)))
-		.IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_fails_when_Map_GetInternals_fails)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
-
-	/*once the event has been succesfull...*/
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
 
 	ENABLE_BATCHING();
 
@@ -9638,139 +9792,46 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succee
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
 	mocks.AssertActualAndExpectedCalls();
 
+
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_1)
+void setupIrrelevantMocksForProperties2(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_HANDLE h1, IOTHUB_MESSAGE_HANDLE h2) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
 {
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
-	DList_InsertTailList(&(waitingToSend), &(message2.entry));
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	(void)(*mocks);
+	STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-		.ExpectedAtLeastTimes(2);
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
-
-	/*this is second batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer2, buffer2_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		whenShallSTRING_concat_fail = currentSTRING_concat_call + 4;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the second batched payload*/
-	}
+	/*measuring the payload*/
+	setupGetBatchItem(*mocks, h1, TEST_MAP_1_PROPERTY);
+	setupGetBatchItem(*mocks, h2, TEST_MAP_2_PROPERTY);
 
-	{
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*writing the payload*/
+	setupPayloadBuffer(*mocks);
+	setupGetBatchItem(*mocks, h1, TEST_MAP_1_PROPERTY);
+	setupGetBatchItem(*mocks, h2, TEST_MAP_2_PROPERTY);
 
 	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+	STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message7.entry)))
 		.IgnoreArgument(1);
-
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
 
 	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+	STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+	EXPECTED_CALL((*mocks), IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
 		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
@@ -9789,8 +9850,25 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_item
 
 	/*once the event has been succesfull...*/
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+	STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
 		.IgnoreArgument(2);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_with_properties_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	DList_InsertTailList(&(waitingToSend), &(message7.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	mocks.ResetAllCalls();
+
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	setupIrrelevantMocksForProperties2(&mocks, message6.messageHandle, message7.messageHandle);
 
 	ENABLE_BATCHING();
 
@@ -9804,323 +9882,179 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_item
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_2)
+
+#define TEST_2_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}},{\"body\":\"MTIzNDU2Nw==\",\"properties\":{" TEST_BLUE_KEY_STRING_WITH_IOTHUBAPP ":" TEST_BLUE_VALUE_STRING "," TEST_YELLOW_KEY_STRING_WITH_IOTHUBAPP ":" TEST_YELLOW_VALUE_STRING "}}]"
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
-	DList_InsertTailList(&(waitingToSend), &(message2.entry));
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	DList_InsertTailList(&(waitingToSend), &(message7.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	ENABLE_BATCHING();
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-		.ExpectedAtLeastTimes(2);
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	///assert
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_2_ITEM_STRING, sizeof(TEST_2_ITEM_STRING) - 1));
+	mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+#define TEST_1_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}}]"
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);;
-		/*end of the first batched payload*/
-	}
+/*message6 and message7 are batched with 4 calls to Map_GetInternals: measuring message6, measuring message7, writing message6, writing message7*/
+#define THRESHOLD1 4 /*failing any call after THRESHOLD1 still produces the payload of both items*/
+#define THRESHOLD2 2 /*failing the measurement of message7 produces a payload of only message6*/
 
+//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_THRESHOLD1_succeeds)
+{
+	for (size_t i = THRESHOLD1 + 1; i > THRESHOLD1; i--)
 	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+		///arrange
+		currentMap_GetInternals_call = 0;
+		whenShallMap_GetInternals_fail = 0;
+		BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
+		CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
+		DList_InsertTailList(&(waitingToSend), &(message6.entry));
+		DList_InsertTailList(&(waitingToSend), &(message7.entry));
+		auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+		auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	/*this is second batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+		mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer2, buffer2_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+		setupDoWorkLoopOnceForOneDevice(mocks);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the second batched payload*/
-	}
+		whenShallMap_GetInternals_fail = i;
 
-	{
-		/*adding the second payload to the "big" payload*/
-		whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 4;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+		ENABLE_BATCHING();
 
-	{
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
-
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-		.IgnoreArgument(1);
+		///act
+		IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+		///assert
+		assertLastPayload(TEST_2_ITEM_STRING);
+		mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+		///cleanup
+		IoTHubTransportHttp_Destroy(handle);
+		if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
+		{
+			BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+			last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
+		}
 	}
-
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
-
-	/*once the event has been succesfull...*/
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
-
-	ENABLE_BATCHING();
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-	///assert
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
 }
 
+//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_the_second_one_does_not_fit_256K_makes_1_batch_of_the_first_item_succeeds)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_only_1_when_properties_for_second_fail)
 {
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
-	DList_InsertTailList(&(waitingToSend), &(message5.entry));
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	for (size_t i = THRESHOLD2; i > THRESHOLD2 - 1; i--)
+	{
+		///arrange
+		currentMap_GetInternals_call = 0;
+		whenShallMap_GetInternals_fail = 0;
+		BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
+		CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
+		DList_InsertTailList(&(waitingToSend), &(message6.entry));
+		DList_InsertTailList(&(waitingToSend), &(message7.entry));
+		auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+		auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+		mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-		.ExpectedAtLeastTimes(2);
+		setupDoWorkLoopOnceForOneDevice(mocks);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+		whenShallMap_GetInternals_fail = i;
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+		ENABLE_BATCHING();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+		///act
+		IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+		///assert
+		assertLastPayload(TEST_1_ITEM_STRING);
+		ASSERT_ARE_EQUAL(void_ptr, &(message7.entry), waitingToSend.Flink);
+		mocks.AssertActualAndExpectedCalls();
 
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+		///cleanup
+		IoTHubTransportHttp_Destroy(handle);
+		if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
+		{
+			BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+			last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
+		}
 	}
+}
 
-	/*this is second batched payload*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_nothing)
+{
+	/*failing the measurement of message6 leaves nothing to batch, failing the writing of either message drops the whole payload*/
+	const size_t failingCalls[] = { 1, THRESHOLD2 + 1, THRESHOLD1 };
+	for (size_t i = 0; i < sizeof(failingCalls) / sizeof(failingCalls[0]); i++)
 	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message5.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message5.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(bigBufferFit, TEST_BIG_BUFFER_1_FIT_SIZE));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+		///arrange
+		currentMap_GetInternals_call = 0;
+		whenShallMap_GetInternals_fail = 0;
+		BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
+		CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
+		DList_InsertTailList(&(waitingToSend), &(message6.entry));
+		DList_InsertTailList(&(waitingToSend), &(message7.entry));
+		auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+		auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+		mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message5.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+		whenShallMap_GetInternals_fail = failingCalls[i];
 
-	{
-		/*adding the second payload to the "big" payload*/
-	}
+		ENABLE_BATCHING();
 
-	{
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+		///act
+		IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-		.IgnoreArgument(1);
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+		///assert
+		ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+		ASSERT_ARE_EQUAL(void_ptr, &(message6.entry), waitingToSend.Flink);
+		ASSERT_ARE_EQUAL(void_ptr, &(message7.entry), waitingToSend.Flink->Flink);
+		mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+		///cleanup
+		IoTHubTransportHttp_Destroy(handle);
+		if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
+		{
+			BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+			last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
+		}
 	}
+}
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+//Tests_SRS_TRANSPORTMULTITHTTP_17_147: [ Property names and values shall be escaped the same way as the body of a message of type IOTHUBMESSAGE_STRING. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_escapes_quotes_backslashes_slashes_and_control_characters_in_properties)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	DList_InsertTailList(&(waitingToSend), &(message13.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	/*once the event has been succesfull...*/
+	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
 	ENABLE_BATCHING();
 
@@ -10128,297 +10062,200 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_the_second_one_does_
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	assertLastPayload("[{\"body\":\"MQ==\"" TEST_ESCAPED_PROPERTIES_JSON "}]");
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-
-/*** IoTHubTransportHttp_GetSendStatus ***/
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidHandleArgument_fail)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_147: [ Property names and values shall be escaped the same way as the body of a message of type IOTHUBMESSAGE_STRING. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_passes_multibyte_UTF8_body_and_properties_through)
 {
-	// arrange
-	CIoTHubTransportHttpMocks mocks;
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	DList_InsertTailList(&(waitingToSend), &(message14.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
 
-	IOTHUB_CLIENT_STATUS status;
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(NULL, &status);
+	ENABLE_BATCHING();
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	///assert
+	assertLastPayload("[" TEST_STRING14_ITEM "]");
 	mocks.AssertActualAndExpectedCalls();
 
-	// cleanup
+	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidStatusArgument_fail)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_144: [ IoTHubTransportHttp_DoWork shall compute the exact size of the payload and decide which items are batched before allocating any memory for it. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_147: [ Property names and values shall be escaped the same way as the body of a message of type IOTHUBMESSAGE_STRING. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_escaped_and_UTF8_event_items_sizes_the_payload_exactly)
 {
-	// arrange
-	CIoTHubTransportHttpMocks mocks;
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	DList_InsertTailList(&(waitingToSend), &(message13.entry));
+	DList_InsertTailList(&(waitingToSend), &(message14.entry));
+	DList_InsertTailList(&(waitingToSend), &(message10.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, NULL);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_pre_build(IGNORED_PTR_ARG, sizeof("[{\"body\":\"MQ==\"" TEST_ESCAPED_PROPERTIES_JSON "}," TEST_STRING14_ITEM ",{\"body\":\"thisgoestoJ\\\\s\\/\\/on\\\"ToBeEn\\u000D\\u000A\\u0008coded\",\"base64Encoded\":false}]") - 1))
+		.IgnoreArgument(1);
+
+	ENABLE_BATCHING();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	///assert
+	assertLastPayload("[{\"body\":\"MQ==\"" TEST_ESCAPED_PROPERTIES_JSON "}," TEST_STRING14_ITEM ",{\"body\":\"thisgoestoJ\\\\s\\/\\/on\\\"ToBeEn\\u000D\\u000A\\u0008coded\",\"base64Encoded\":false}]");
 	mocks.AssertActualAndExpectedCalls();
 
-	// cleanup
+	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_112: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there are currently no event items to be sent or being sent. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_empty_waitingToSend_and_empty_eventConfirmations_success)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_GetContentType_is_unknown_it_fails)
 {
-	// arrange
+	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	IOTHUB_CLIENT_STATUS status;
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+		.IgnoreArgument(1);
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
+	/*measuring the payload*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle))
+		.SetReturn(IOTHUBMESSAGE_UNKNOWN);
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_IDLE);
+	ENABLE_BATCHING();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	///assert
+	ASSERT_ARE_EQUAL(void_ptr, &(message1.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
-	// cleanup
+	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_113: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_waitingToSend_not_empty_success)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_GetByteArray_fails_while_writing_it_fails)
 {
-	// arrange
+	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
-	IOTHUB_MESSAGE_LIST newEntry;
-	newEntry.messageHandle = &newEntry;
-	DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
-
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	IOTHUB_CLIENT_STATUS status;
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+		.IgnoreArgument(1);
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_BUSY);
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.SetReturn(IOTHUB_MESSAGE_ERROR);
+
+	ENABLE_BATCHING();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	///assert
+	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+	ASSERT_ARE_EQUAL(void_ptr, &(message1.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
-	// cleanup
+	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
-	IoTHubMessage_Destroy(eventMessageHandle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_139: [ If the device structure is not found, then this function shall fail and return with IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_deviceData_is_not_found_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_Map_GetInternals_fails_while_writing_it_fails)
 {
-	// arrange
+	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
-	IOTHUB_MESSAGE_LIST newEntry;
-	newEntry.messageHandle = &newEntry;
-	DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
-
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetFailReturn((void_ptr)NULL);
-
-	IOTHUB_CLIENT_STATUS status;
-
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
-
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
-
-	mocks.AssertActualAndExpectedCalls();
-
-	// cleanup
-	IoTHubTransportHttp_Destroy(handle);
-	IoTHubMessage_Destroy(eventMessageHandle);
-}
-
-void setupIrrelevantMocksForProperties(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_HANDLE messageHandle) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
-{
-	(void)(*mocks);
-	STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL((*mocks), STRING_construct("["));
-	STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetContentType(messageHandle));
-		STRICT_EXPECTED_CALL((*mocks), STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-
-		switch ((uintptr_t)messageHandle)
-		{
-		case((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
-		{
-			STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer11, buffer11_size));
-			break;
-		}
-		default:
-		{
-			STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer6, buffer6_size));
-			break;
-		}
-		}
-
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	switch ((uintptr_t)messageHandle)
-	{
-	case((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
-	{
-		STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message11.entry)))
-			.IgnoreArgument(1);
-		break;
-	}
-
-	default:
-	{
-		STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
-			.IgnoreArgument(1);
-		break;
-	}
-	}
-
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message6.messageHandle, TEST_MAP_1_PROPERTY);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_new());
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message6.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message6.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message6.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
+	ENABLE_BATCHING();
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	/*once the event has been succesfull...*/
+	///assert
+	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+	ASSERT_ARE_EQUAL(void_ptr, &(message6.entry), waitingToSend.Flink);
+	mocks.AssertActualAndExpectedCalls();
 
-	STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_059: [ It shall inspect the "waitingToSend" DLIST passed in config structure. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_properties_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_146: [ If BUFFER_new or BUFFER_pre_build fails then no item shall be removed from waitingToSend and IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_with_properties_when_BUFFER_new_fails_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -10430,32 +10267,16 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_properties_succ
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	setupIrrelevantMocksForProperties(&mocks, message6.messageHandle);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message6.messageHandle));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message6.messageHandle, TEST_MAP_1_PROPERTY);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES1[0]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1[0]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new())
+		.SetReturn((BUFFER_HANDLE)NULL);
 
 	ENABLE_BATCHING();
 
@@ -10463,21 +10284,20 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_properties_succ
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(void_ptr, &(message6.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_063: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_at_maximum_message_size_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_146: [ If BUFFER_new or BUFFER_pre_build fails then no item shall be removed from waitingToSend and IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_144: [ IoTHubTransportHttp_DoWork shall compute the exact size of the payload and decide which items are batched before allocating any memory for it. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_with_properties_when_BUFFER_pre_build_fails_it_fails)
 {
-	/*this test shall use a message that has a payload of MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - PROPERTY_OVERHEAD - 2*/
-	/*it will also have a property of "a":"b", therefore reaching the MAXIMUM_MESSAGE_SIZE*/
-	/*the next test will increase either the propertyname or value by 1 character as the message is expected to fail*/
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message11.entry));
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -10485,31 +10305,19 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_at
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	setupIrrelevantMocksForProperties(&mocks, message11.messageHandle);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message11.messageHandle));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY_A_B, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message6.messageHandle, TEST_MAP_1_PROPERTY);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES1_A_B[0]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1_A_B[0]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(TEST_1_ITEM_STRING) - 1))
+		.IgnoreArgument(1)
+		.SetReturn(__LINE__);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
 	ENABLE_BATCHING();
@@ -10518,296 +10326,283 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_at
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(void_ptr, &(message6.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_063: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_past_maximum_message_size_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_that_could_not_be_written_is_sent_at_the_next_DoWork)
 {
-	/*this test shall use a message that has a payload of MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - PROPERTY_OVERHEAD - 2*/
-	/*it will also have a property of "aa":"b", therefore reaching 1 byte past the MAXIMUM_MESSAGE_SIZE*/
-	/*this is done in a very e2e manner*/
 	///arrange
-	CNiceCallComparer<CIoTHubTransportHttpMocks>mocks;
-	DList_InsertTailList(&(waitingToSend), &(message12.entry));
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	ENABLE_BATCHING();
-
-
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
-		.IgnoreArgument(2);
+	whenShallMap_GetInternals_fail = 2; /*the first call measures the message, the second one writes it*/
+
+	ENABLE_BATCHING();
+
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+	ASSERT_ARE_EQUAL(void_ptr, &(message1.entry), waitingToSend.Flink);
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	assertLastPayload("[{\"body\":\"MQ==\"}]");
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_fails_when_Map_GetInternals_fails)
+
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_114: [ If handle parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_handle_fails)
 {
 	///arrange
-	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	mocks.ResetAllCalls();
+	///act
+	auto result = IoTHubTransportHttp_SetOption(NULL, "someOption", "someValue");
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4)
-		.SetReturn(MAP_ERROR);
+	///cleanup
+}
 
-	ENABLE_BATCHING();
+//Tests_SRS_TRANSPORTMULTITHTTP_17_115: [ If option parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_optionName_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportHttp_SetOption(handle, NULL, "someValue");
 
 	///assert
-	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_116: [ If value parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_value_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", NULL);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-void setupIrrelevantMocksForProperties2(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_HANDLE h1, IOTHUB_MESSAGE_HANDLE h2) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_succeeds_when_HTTPAPIEX_succeeds)
 {
-	(void)(*mocks);
-	STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL((*mocks), STRING_construct("["));
-	STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetContentType(h1));
-		STRICT_EXPECTED_CALL((*mocks), STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetByteArray(message6.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer6, buffer6_size));
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_INVALID_ARG)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
+		.SetReturn(HTTPAPIEX_INVALID_ARG);
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
 
-	/*this is second batched payload*/
-	{
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetContentType(h2));
-		STRICT_EXPECTED_CALL((*mocks), STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetByteArray(message7.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer7, buffer7_size));
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_ERROR)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
+		.SetReturn(HTTPAPIEX_ERROR);
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
 
-	{
-		/*adding the second payload to the "big" payload*/
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_any_other_error)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message7.entry)))
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
+		.SetReturn(HTTPAPIEX_RECOVERYFAILED);
+
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_new());
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
+//Tests_SRS_TRANSPORTMULTITHTTP_17_171: [ If the value of "PollingJitter" is greater than 100 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_PollingJitter_greater_than_100_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	unsigned int pollingJitter = 101;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "PollingJitter", &pollingJitter);
 
-	/*once the event has been succesfull...*/
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
 
-	STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_with_properties_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_174: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ASYNC_ACK then _DoWork shall keep the message and a copy of its ETag until IoTHubTransportHttp_SendMessageDisposition is called for it. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_ASYNC_ACK_keeps_the_message_and_does_not_complete_it)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
-	DList_InsertTailList(&(waitingToSend), &(message7.entry));
+	unsigned int statusCode200 = 200;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	setupIrrelevantMocksForProperties2(&mocks, message6.messageHandle, message7.messageHandle);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message6.messageHandle));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-		.ExpectedAtLeastTimes(2);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{")) /*opening of the properties*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES1[0]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1[0]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))/*closing of the properties*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message7.messageHandle));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_2_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_GET,
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,
+		IGNORED_PTR_ARG,
+		NULL,
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG
+		))
+		.IgnoreArgument(1)
 		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{")) /*opening of the properties*/
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES2[0]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS2[0]))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"iothub-app-"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES2[1]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS2[1]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(IOTHUBMESSAGE_ASYNC_ACK);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))/*closing of the properties*/
+	/*the message and its ETag are kept, no completion is sent and the message is not destroyed*/
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
 		.IgnoreArgument(1);
-
-	ENABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(TEST_ETAG_VALUE)));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -10819,200 +10614,275 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_with_properties_succ
 	IoTHubTransportHttp_Destroy(handle);
 }
 
+//Tests_SRS_TRANSPORTMULTITHTTP_17_176: [ If handle or message is NULL or disposition is not one of IOTHUBMESSAGE_ACCEPTED, IOTHUBMESSAGE_REJECTED or IOTHUBMESSAGE_ABANDONED then IoTHubTransportHttp_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SendMessageDisposition_with_NULL_handle_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
 
-#define TEST_2_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}},{\"body\":\"MTIzNDU2Nw==\",\"properties\":{" TEST_BLUE_KEY_STRING_WITH_IOTHUBAPP ":" TEST_BLUE_VALUE_STRING "," TEST_YELLOW_KEY_STRING_WITH_IOTHUBAPP ":" TEST_YELLOW_VALUE_STRING "}}]"
-#define TEST_1_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}}]"
+	///act
+	auto result = IoTHubTransportHttp_SendMessageDisposition(NULL, (IOTHUB_MESSAGE_HANDLE)0x42, IOTHUBMESSAGE_ACCEPTED);
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items)
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_176: [ If handle or message is NULL or disposition is not one of IOTHUBMESSAGE_ACCEPTED, IOTHUBMESSAGE_REJECTED or IOTHUBMESSAGE_ABANDONED then IoTHubTransportHttp_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SendMessageDisposition_with_NULL_message_fails)
 {
 	///arrange
-	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
-	DList_InsertTailList(&(waitingToSend), &(message7.entry));
+	CIoTHubTransportHttpMocks mocks;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubTransportHttp_SendMessageDisposition(devHandle, NULL, IOTHUBMESSAGE_ACCEPTED);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
+//Tests_SRS_TRANSPORTMULTITHTTP_17_176: [ If handle or message is NULL or disposition is not one of IOTHUBMESSAGE_ACCEPTED, IOTHUBMESSAGE_REJECTED or IOTHUBMESSAGE_ABANDONED then IoTHubTransportHttp_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SendMessageDisposition_with_ASYNC_ACK_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
+	///act
+	auto result = IoTHubTransportHttp_SendMessageDisposition(devHandle, (IOTHUB_MESSAGE_HANDLE)0x42, IOTHUBMESSAGE_ASYNC_ACK);
 
-	ENABLE_BATCHING();
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_177: [ If message is not waiting for its disposition then IoTHubTransportHttp_SendMessageDisposition shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SendMessageDisposition_for_a_message_that_is_not_pending_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	mocks.ResetAllCalls();
 
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportHttp_SendMessageDisposition(devHandle, (IOTHUB_MESSAGE_HANDLE)0x42, IOTHUBMESSAGE_ACCEPTED);
 
 	///assert
-	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_2_ITEM_STRING, sizeof(TEST_2_ITEM_STRING) - 1));
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-#define THRESHOLD1 32 /*between THRESHOLD1 and THRESHOLD2 of STRING_concat fails there still is produced a payload, consisting of only REDKEY, REDVALUE*/
-#define THRESHOLD2 17
-#define THRESHOLD3 7 /*below 7, STRING_concat would fail not in producing properties*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_172: [ If handle or statistics is NULL then IoTHubTransportHttp_GetPollStatistics shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetPollStatistics_with_NULL_handle_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	HTTP_POLL_STATISTICS statistics;
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_THRESHOLD1_succeeds)
+	///act
+	auto result = IoTHubTransportHttp_GetPollStatistics(NULL, &statistics);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_173: [ IoTHubTransportHttp_GetPollStatistics shall add up the GET requests and the GET requests that returned a message of all the registered devices and return IOTHUB_CLIENT_OK. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetPollStatistics_counts_an_empty_GET)
 {
-	for (size_t i = THRESHOLD1 + 1; i > THRESHOLD1; i--)
-	{
-		///arrange
-		currentSTRING_concat_call = 0;
-		whenShallSTRING_concat_fail = 0;
-		BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
-		CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-		DList_InsertTailList(&(waitingToSend), &(message6.entry));
-		DList_InsertTailList(&(waitingToSend), &(message7.entry));
-		auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-		auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	HTTP_POLL_STATISTICS statistics;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE); /*the GET returns 204*/
+	mocks.ResetAllCalls();
 
-		mocks.ResetAllCalls();
+	///act
+	auto result = IoTHubTransportHttp_GetPollStatistics(handle, &statistics);
 
-		setupDoWorkLoopOnceForOneDevice(mocks);
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 1, statistics.polls);
+	ASSERT_ARE_EQUAL(size_t, 0, statistics.hits);
 
-		whenShallSTRING_concat_fail = i;
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		ENABLE_BATCHING();
+//Tests_SRS_TRANSPORTMULTITHTTP_17_155: [ If the value of "HttpConnections" is 0 or greater than 32 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnections_with_0_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	size_t connections = 0;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-		///act
-		IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "HttpConnections", &connections);
 
-		///assert
-		ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_2_ITEM_STRING, sizeof(TEST_2_ITEM_STRING) - 1));
-		mocks.AssertActualAndExpectedCalls();
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
 
-		///cleanup
-		IoTHubTransportHttp_Destroy(handle);
-		if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
-		{
-			BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-			last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
-		}
-	}
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_only_1_when_properties_for_second_fail)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_155: [ If the value of "HttpConnections" is 0 or greater than 32 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnections_with_33_fails)
 {
-	for (size_t i = THRESHOLD1; i > THRESHOLD2; i--)
-	{
-		///arrange
-		currentSTRING_concat_call = 0;
-		whenShallSTRING_concat_fail = 0;
-		BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
-		CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-		DList_InsertTailList(&(waitingToSend), &(message6.entry));
-		DList_InsertTailList(&(waitingToSend), &(message7.entry));
-		auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-		auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	size_t connections = 33;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-		mocks.ResetAllCalls();
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "HttpConnections", &connections);
 
-		setupDoWorkLoopOnceForOneDevice(mocks);
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
 
-		whenShallSTRING_concat_fail = i;
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		ENABLE_BATCHING();
+//Tests_SRS_TRANSPORTMULTITHTTP_17_154: ["HttpConnections"]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_157: [ IoTHubTransportHttp_SetOption shall stop the existing workers and start "HttpConnections" - 1 workers, each one having its own HTTPAPIEX handle. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnections_with_2_starts_1_worker)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	size_t connections = 2;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-		///act
-		IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	setupStartOneWorker(mocks);
 
-		///assert
-		ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_1_ITEM_STRING, sizeof(TEST_1_ITEM_STRING) - 1));
-		mocks.AssertActualAndExpectedCalls();
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "HttpConnections", &connections);
 
-		///cleanup
-		IoTHubTransportHttp_Destroy(handle);
-		if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
-		{
-			BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-			last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
-		}
-	}
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_nothing)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_158: [ If starting the workers fails then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR and _DoWork shall serve the devices sequentially. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnections_fails_when_ThreadAPI_Create_fails)
 {
-	for (size_t i = THRESHOLD2; i > THRESHOLD3; i--)
-	{
-		///arrange
-		currentSTRING_concat_call = 0;
-		whenShallSTRING_concat_fail = 0;
-		BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
-		CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-		DList_InsertTailList(&(waitingToSend), &(message6.entry));
-		DList_InsertTailList(&(waitingToSend), &(message7.entry));
-		auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-		mocks.ResetAllCalls();
-
-		whenShallSTRING_concat_fail = i;
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	size_t connections = 2;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-		ENABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, Lock_Init());
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.SetReturn(THREADAPI_ERROR);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Destroy(TEST_HTTPAPIEX_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
 
-		///act
-		IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "HttpConnections", &connections);
 
-		///assert
-		ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-		mocks.AssertActualAndExpectedCalls();
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
 
-		///cleanup
-		IoTHubTransportHttp_Destroy(handle);
-		if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
-		{
-			BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-			last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
-		}
-	}
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_114: [ If handle parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_handle_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_156: [ If an option has already been passed down to HTTPAPIEX and "HttpConnections" is greater than 1 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnections_after_HTTPAPIEX_option_fails)
 {
 	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	size_t connections = 2;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+	mocks.ResetAllCalls();
 
 	///act
-	auto result = IoTHubTransportHttp_SetOption(NULL, "someOption", "someValue");
+	auto result = IoTHubTransportHttp_SetOption(handle, "HttpConnections", &connections);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_115: [ If option parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_optionName_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_161: [ An option passed down to HTTPAPIEX shall also be passed down to the HTTPAPIEX handle of every worker. If any of these calls fails then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_passes_HTTPAPIEX_option_to_every_worker)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	size_t connections = 2;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_SetOption(handle, "HttpConnections", &connections);
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
+		.ExpectedTimesExactly(2);
+
 	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, NULL, "someValue");
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_116: [ If value parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_value_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_160: [ If the value of "EventRequestsPerDevice" is 0 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_EventRequestsPerDevice_with_0_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	size_t eventRequests = 0;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	mocks.ResetAllCalls();
 
 	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", NULL);
+	auto result = IoTHubTransportHttp_SetOption(handle, "EventRequestsPerDevice", &eventRequests);
 
 	///assert
 	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
@@ -11022,19 +10892,17 @@ TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_value_fails)
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_succeeds_when_HTTPAPIEX_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_187: [ "AsyncMessageDisposition" - HTTP completes every message with its own request, so IoTHubTransportHttp_SetOption shall accept the option and return IOTHUB_CLIENT_OK. Value is a pointer to a bool. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_AsyncMessageDisposition_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	bool asyncMessageDisposition = true;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
-
 	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+	auto result = IoTHubTransportHttp_SetOption(handle, "AsyncMessageDisposition", &asyncMessageDisposition);
 
 	///assert
 	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
@@ -11044,69 +10912,127 @@ TEST_FUNCTION(IoTHubTransportHttp_SetOption_succeeds_when_HTTPAPIEX_succeeds)
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_INVALID_ARG)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_149: [ IoTHubTransportHttp_Destroy shall stop and join all the worker threads and destroy their HTTPAPIEX handles. ]
+TEST_FUNCTION(IoTHubTransportHttp_Destroy_stops_the_workers)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	size_t connections = 2;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_SetOption(handle, "HttpConnections", &connections);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
-		.SetReturn(HTTPAPIEX_INVALID_ARG);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	setupStopOneWorker(mocks);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);                                             //STRING_HANDLE hostName;
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Destroy(TEST_HTTPAPIEX_HANDLE)); //HTTPAPIEX_HANDLE httpApiExHandle;
+	STRICT_EXPECTED_CALL(mocks, DeviceRegistry_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);                                             //DEVICE_REGISTRY_HANDLE deviceRegistry;
+	STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);                                             //VECTOR_HANDLE perDeviceList;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_TICK_COUNTER_HANDLE)); //TICK_COUNTER_HANDLE tickCounter;
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(handle));
 
 	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+	IoTHubTransportHttp_Destroy(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_151: [ When "HttpConnections" is greater than 1, _DoWork shall let the workers and the calling thread claim the devices of the transport device list one at a time, so that every device is served by exactly one connection per _DoWork. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_153: [ _DoWork shall return only after all the devices of the transport device list have been served. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_HttpConnections_serves_every_device_once)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	size_t connections = 2;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_SetOption(handle, "HttpConnections", &connections);
+	(void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	(void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+	mocks.ResetAllCalls();
+
+	/*starting the pass, claiming device 0, claiming device 1, last claim finds the pass complete*/
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+		.ExpectedTimesExactly(6);
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+		.ExpectedTimesExactly(6);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend2));
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_ERROR)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_188: [ A connection that finds no device to claim shall sleep before looking again, starting at 1 ms and doubling up to 16 ms, and shall start again at 1 ms once it claimed a device. ]
+TEST_FUNCTION(IoTHubTransportHttp_worker_without_a_device_to_claim_backs_off_up_to_16_ms)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	size_t connections = 2;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_SetOption(handle, "HttpConnections", &connections);
 	mocks.ResetAllCalls();
+	workerStopTransport = handle;
+	workerSleepsBeforeStop = 6;
 
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
-		.SetReturn(HTTPAPIEX_ERROR);
+	/*6 looks for a device that find none, the 7th finds the workers stopped*/
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+		.ExpectedTimesExactly(7);
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+		.ExpectedTimesExactly(7);
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(2));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(4));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(8));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(16))
+		.ExpectedTimesExactly(2);
 
 	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+	int result = savedWorkerFunc(savedWorkerArg);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	ASSERT_ARE_EQUAL(int, 0, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_any_other_error)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_150: [ For every device, _DoWork shall send events at most "EventRequestsPerDevice" times, stopping as soon as waitingToSend is empty or did not change, and then shall fetch messages once. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_EventRequestsPerDevice_stops_when_waitingToSend_is_empty)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	size_t eventRequests = 3;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_SetOption(handle, "EventRequestsPerDevice", &eventRequests);
+	(void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
-		.SetReturn(HTTPAPIEX_RECOVERYFAILED);
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
 	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
@@ -11129,7 +11055,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -11253,7 +11180,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -11394,7 +11322,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -11549,7 +11478,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -11700,7 +11630,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -11847,7 +11778,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -11988,7 +11920,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -12125,7 +12058,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -12241,6 +12175,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 //Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCCESS. The item shall be removed from waitingToSend. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_185: [ If executing the request does not fail, IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendStarted passing the message, 1 and the size of the message content, before looking at the http status code. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
 TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_unbatched_happy_path_succeeds)
 {
@@ -12287,6 +12222,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_unbatch
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, &message1, 1, buffer1_size));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
@@ -12381,6 +12317,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
@@ -12482,6 +12419,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_unbatched_happy_path_at_th
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
@@ -12657,6 +12595,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
@@ -12758,6 +12697,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
@@ -12792,6 +12732,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_185: [ If executing the request does not fail, IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendStarted passing the message, 1 and the size of the message content, before looking at the http status code. ]
 TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_HTTPAPIEXSAS_fails)
 {
 	///arrange
@@ -13409,51 +13350,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_happy_path_
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	setupGetBatchItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
 	/*building the list of messages to be notified if HTTP is fine*/
 	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
@@ -13461,25 +13363,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_happy_path_
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
@@ -13508,6 +13395,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_happy_path_
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	assertLastPayload(TEST_STRING10_PAYLOAD);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
@@ -13515,7 +13403,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_happy_path_
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_string_concat_fails_it_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_GetInternals_fails_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -13532,39 +13420,15 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_string
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		whenShallSTRING_concat_fail = currentSTRING_concat_call + 2;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	/*measuring the payload*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
 
 	ENABLE_BATCHING();
 
@@ -13579,7 +13443,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_string
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_GetInternals_fails_it_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHubMessage_GetString_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -13596,37 +13460,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_Ge
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4)
-			.SetReturn(MAP_ERROR);
-		/*end of the first batched payload*/
-	}
+	/*measuring the payload*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle))
+		.SetReturn((const char*)NULL);
 
 	ENABLE_BATCHING();
 
@@ -13640,8 +13477,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_Ge
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_concat_fails_it_fails_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_146: [ If BUFFER_new or BUFFER_pre_build fails then no item shall be removed from waitingToSend and IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_BUFFER_new_fails_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -13658,32 +13495,11 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-		whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new())
+		.SetReturn((BUFFER_HANDLE)NULL);
 
 	ENABLE_BATCHING();
 
@@ -13691,14 +13507,16 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(void_ptr, &(message10.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_concat_with_STRING_fails_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_146: [ If BUFFER_new or BUFFER_pre_build fails then no item shall be removed from waitingToSend and IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_144: [ IoTHubTransportHttp_DoWork shall compute the exact size of the payload and decide which items are batched before allocating any memory for it. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_BUFFER_pre_build_fails_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -13715,29 +13533,15 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-		whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-		/*end of the first batched payload*/
-	}
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_pre_build(IGNORED_PTR_ARG, sizeof(TEST_STRING10_PAYLOAD) - 1))
+		.IgnoreArgument(1)
+		.SetReturn(__LINE__);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
 	ENABLE_BATCHING();
 
@@ -13745,14 +13549,15 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(void_ptr, &(message10.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_new_JSON_fails_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHubMessage_GetString_fails_while_writing_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -13769,24 +13574,14 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		whenShallSTRING_new_JSON_fail = currentSTRING_new_JSON_call + 1;
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-		/*end of the first batched payload*/
-	}
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle))
+		.SetReturn((const char*)NULL);
 
 	ENABLE_BATCHING();
 
@@ -13794,14 +13589,16 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+	ASSERT_ARE_EQUAL(void_ptr, &(message10.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHubMessage_GetString_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_GetInternals_fails_while_writing_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -13818,22 +13615,19 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHub
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle))
-			.SetReturn((const char*)NULL);
+	/*measuring the payload*/
+	setupGetBatchItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-		/*end of the first batched payload*/
-	}
+	/*writing the payload*/
+	setupPayloadBuffer(mocks);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
 
 	ENABLE_BATCHING();
 
@@ -13841,18 +13635,22 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHub
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+	ASSERT_ARE_EQUAL(void_ptr, &(message10.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
+//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_construct_it_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_as_string_and_bytearray_makes_1_batch_succeeds)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
 	DList_InsertTailList(&(waitingToSend), &(message10.entry));
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -13860,31 +13658,13 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		whenShallSTRING_construct_fail = currentSTRING_construct_call + 2;
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-
-		/*end of the first batched payload*/
-	}
-
 	ENABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	assertLastPayload("[{\"body\":\"thisgoestoJ\\\\s\\/\\/on\\\"ToBeEn\\u000D\\u000A\\u0008coded\",\"base64Encoded\":false},{\"body\":\"MQ==\"}]");
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
@@ -13908,7 +13688,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_SUCCEED)
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -14067,7 +13848,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_FAILED)
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -14262,6 +14044,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetMessageId_succeeds)
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
@@ -14364,6 +14147,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetCorrelationId_succeeds)
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
+	EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_NUM_ARG));
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
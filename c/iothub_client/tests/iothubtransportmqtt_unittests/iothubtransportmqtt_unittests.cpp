@@ -23,6 +23,7 @@
 
 #include "iothubtransportmqtt.h"
 #include "iothub_client_private.h"
+#include "nodepool.h"
 
 #include "azure_c_shared_utility/xio.h"
 #include "azure_c_shared_utility/tlsio.h"
@@ -57,12 +58,15 @@ static const char* TEST_EMPTY_STRING = "";
 static const char* TEST_SAS_TOKEN = "Test_SAS_Token_value";
 static const char* LOG_TRACE_OPTION = "logtrace";
 static const char* KEEP_ALIVE_OPTION = "keepalive";
+static const char* MAX_INFLIGHT_OPTION = "maxinflight";
+static const char* ASYNC_MESSAGE_DISPOSITION_OPTION = "AsyncMessageDisposition";
 const char* PROPERTY_SEPARATOR = "&";
 
+static const char* TEST_DEVICE_ID_2 = "thisIsAnotherDeviceID";
 static const IOTHUB_DEVICE_CONFIG TEST_DEVICE_1 = { TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL };
 
 static const IOTHUB_CLIENT_LL_HANDLE TEST_IOTHUB_CLIENT_LL_HANDLE = (IOTHUB_CLIENT_LL_HANDLE)0x4343;
-static const TRANSPORT_LL_HANDLE TEST_TRANSPORT_HANDLE = (TRANSPORT_LL_HANDLE)0x4444;
+static const IOTHUB_CLIENT_LL_HANDLE TEST_IOTHUB_CLIENT_LL_HANDLE_2 = (IOTHUB_CLIENT_LL_HANDLE)0x4345;
 static const MQTT_CLIENT_HANDLE TEST_MQTT_CLIENT_HANDLE = (MQTT_CLIENT_HANDLE)0x1122;
 static const PDLIST_ENTRY TEST_PDLIST_ENTRY = (PDLIST_ENTRY)0x1123;
 static const MQTT_MESSAGE_HANDLE TEST_MQTT_MESSAGE_HANDLE = (MQTT_MESSAGE_HANDLE)0x1124;
@@ -79,6 +83,7 @@ static IOTHUB_MESSAGE_HANDLE TEST_IOTHUB_MSG_BYTEARRAY = (IOTHUB_MESSAGE_HANDLE)
 static IOTHUB_MESSAGE_HANDLE TEST_IOTHUB_MSG_STRING = (IOTHUB_MESSAGE_HANDLE)0x01d2;
 
 static const TICK_COUNTER_HANDLE TEST_COUNTER_HANDLE = (TICK_COUNTER_HANDLE)0x12;
+static const NODEPOOL_HANDLE TEST_NODEPOOL_HANDLE = (NODEPOOL_HANDLE)0x13;
 static const MAP_HANDLE TEST_MESSAGE_PROP_MAP = (MAP_HANDLE)0x1212;
 
 static char appMessageString[] = "App Message String";
@@ -141,6 +146,7 @@ static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 
 static size_t currentmalloc_call;
 static size_t whenShallmalloc_fail;
+static size_t g_nodePoolNodeSize;
 
 static size_t currentSTRING_construct_call;
 static size_t whenShallSTRING_construct_fail;
@@ -267,6 +273,9 @@ public:
 		MOCK_STATIC_METHOD_3(, void, IoTHubClient_LL_SendComplete, IOTHUB_CLIENT_LL_HANDLE, handle, PDLIST_ENTRY, completed, IOTHUB_BATCHSTATE_RESULT, result2)
 		MOCK_VOID_METHOD_END()
 
+		MOCK_STATIC_METHOD_4(, void, IoTHubClient_LL_SendStarted, IOTHUB_CLIENT_LL_HANDLE, handle, IOTHUB_MESSAGE_LIST*, first, size_t, count, size_t, size)
+		MOCK_VOID_METHOD_END()
+
 		/* IoTHubMessage mocks */
 		MOCK_STATIC_METHOD_1(, IOTHUBMESSAGE_CONTENT_TYPE, IoTHubMessage_GetContentType, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
 		IOTHUBMESSAGE_CONTENT_TYPE result2;
@@ -456,6 +465,23 @@ public:
 		*current_ms = g_current_ms;
 	MOCK_METHOD_END(int, 0);
 
+	MOCK_STATIC_METHOD_2(, NODEPOOL_HANDLE, NodePool_Create, size_t, nodeSize, size_t, growth)
+		g_nodePoolNodeSize = nodeSize;
+	MOCK_METHOD_END(NODEPOOL_HANDLE, TEST_NODEPOOL_HANDLE);
+
+	MOCK_STATIC_METHOD_1(, void, NodePool_Destroy, NODEPOOL_HANDLE, pool)
+	MOCK_VOID_METHOD_END();
+
+	MOCK_STATIC_METHOD_2(, int, NodePool_Reserve, NODEPOOL_HANDLE, pool, size_t, count)
+	MOCK_METHOD_END(int, 0);
+
+	MOCK_STATIC_METHOD_1(, void*, NodePool_Alloc, NODEPOOL_HANDLE, pool)
+	MOCK_METHOD_END(void*, BASEIMPLEMENTATION::gballoc_malloc(g_nodePoolNodeSize));
+
+	MOCK_STATIC_METHOD_1(, void, NodePool_Free, void*, node)
+		BASEIMPLEMENTATION::gballoc_free(node);
+	MOCK_VOID_METHOD_END();
+
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportMqttMocks, , const IO_INTERFACE_DESCRIPTION*, tlsio_schannel_get_interface_description);
@@ -525,6 +551,7 @@ DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportMqttMocks, , STRING_HANDLE, SASToke
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportMqttMocks, , IOTHUBMESSAGE_DISPOSITION_RESULT, IoTHubClient_LL_MessageCallback, IOTHUB_CLIENT_LL_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportMqttMocks, , void, IoTHubClient_LL_SendComplete, IOTHUB_CLIENT_LL_HANDLE, handle, PDLIST_ENTRY, completed, IOTHUB_BATCHSTATE_RESULT, result2);
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportMqttMocks, , void, IoTHubClient_LL_SendStarted, IOTHUB_CLIENT_LL_HANDLE, handle, IOTHUB_MESSAGE_LIST*, first, size_t, count, size_t, size);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportMqttMocks, , time_t, get_time, time_t*, currentTime);
 
@@ -533,6 +560,12 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportMqttMocks, , int, tickcounter_reset
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportMqttMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportMqttMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms);
 
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportMqttMocks, , NODEPOOL_HANDLE, NodePool_Create, size_t, nodeSize, size_t, growth);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportMqttMocks, , void, NodePool_Destroy, NODEPOOL_HANDLE, pool);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportMqttMocks, , int, NodePool_Reserve, NODEPOOL_HANDLE, pool, size_t, count);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportMqttMocks, , void*, NodePool_Alloc, NODEPOOL_HANDLE, pool);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportMqttMocks, , void, NodePool_Free, void*, node);
+
 BEGIN_TEST_SUITE(iothubtransportmqtt)
 
 static void SetupMocksForInitConnection(CIoTHubTransportMqttMocks& mocks)
@@ -571,6 +604,7 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 
 	currentmalloc_call=0;
 	whenShallmalloc_fail = 0;
+	g_nodePoolNodeSize = 0;
 
 	currentSTRING_construct_call = 0;;
 	whenShallSTRING_construct_fail = 0;
@@ -625,6 +659,12 @@ static void SetupIothubTransportConfigWithKeyAndSasToken(IOTHUBTRANSPORT_CONFIG*
 	config->upperConfig = &g_iothubClientConfig;
 }
 
+static IOTHUB_DEVICE_HANDLE RegisterConfiguredDevice(TRANSPORT_LL_HANDLE handle, const IOTHUBTRANSPORT_CONFIG* config)
+{
+	IOTHUB_DEVICE_CONFIG deviceConfig = { config->upperConfig->deviceId, config->upperConfig->deviceKey, config->upperConfig->deviceSasToken };
+	return IoTHubTransportMqtt_Register(handle, &deviceConfig, TEST_IOTHUB_CLIENT_LL_HANDLE, config->waitingToSend);
+}
+
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_001: [If parameter config is NULL then IoTHubTransportMqtt_Create shall return NULL.] */
 TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_parameter_Succeed)
 {
@@ -640,7 +680,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_parameter_Succeed)
 	///cleanup
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_002: [If the parameter config's variables upperConfig or waitingToSend are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_002: [If the parameter config's variable upperConfig is NULL then IoTHubTransportMqtt_Create shall return NULL.] */
 TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_config_parameter_fails)
 {
 	///arrange
@@ -657,8 +697,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_config_parameter_fails)
 	///cleanup
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_002: [If the parameter config's variables upperConfig or waitingToSend are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_waitingToSend_fails)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_053: [IoTHubTransportMqtt_Create shall ignore the device fields of the upperConfig and the waitingToSend list; devices are added with IoTHubTransportMqtt_Register.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_waitingToSend_succeeds)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
@@ -670,47 +710,46 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_waitingToSend_fails)
 	auto result = IoTHubTransportMqtt_Create(&config);
 
 	// assert
-	ASSERT_IS_NULL(result);
-}
-
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_009: [If any error is encountered then IoTHubTransportMqtt_Create shall return NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_protocol_fails)
-{
-	// arrange
-	CIoTHubTransportMqttMocks mocks;
-	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
-	g_iothubClientConfig.protocol = NULL;
-
-	// act
-	auto result = IoTHubTransportMqtt_Create(&config);
+	ASSERT_IS_NOT_NULL(result);
 
-	// assert
-	ASSERT_IS_NULL(result);
+	// clean up
+	IoTHubTransportMqtt_Destroy(result);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, deviceKey, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_device_id_fails)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_053: [IoTHubTransportMqtt_Create shall ignore the device fields of the upperConfig and the waitingToSend list; devices are added with IoTHubTransportMqtt_Register.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_device_id_and_key_succeeds)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, NULL, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	SetupIothubTransportConfig(&config, NULL, NULL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_HOST_NAME));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(IGNORED_NUM_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments();
+	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
 
 	// act
 	auto result = IoTHubTransportMqtt_Create(&config);
 
 	// assert
-	ASSERT_IS_NULL(result);
+	ASSERT_IS_NOT_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
+
+	// clean up
+	IoTHubTransportMqtt_Destroy(result);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, deviceKey, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_device_key_fails)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_protocol_fails)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, NULL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	g_iothubClientConfig.protocol = NULL;
 
 	// act
 	auto result = IoTHubTransportMqtt_Create(&config);
@@ -719,7 +758,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_device_key_fails)
 	ASSERT_IS_NULL(result);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, deviceKey, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
 TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_iothub_name_fails)
 {
 	// arrange
@@ -734,7 +773,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_iothub_name_fails)
 	ASSERT_IS_NULL(result);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, deviceKey, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
 TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_iothub_suffix_fails)
 {
 	// arrange
@@ -749,13 +788,13 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_iothub_suffix_fails)
 	ASSERT_IS_NULL(result);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_006: [If the upperConfig's variables deviceId is an empty strings or length is greater then 128 then IoTHubTransportMqtt_Create shall return NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_with_very_long_device_id_fails)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_005: [If the upperConfig's variable iotHubName is an empty string then IoTHubTransportMqtt_Create shall return NULL.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Create_with_empty_iothub_name_fails)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, TEST_VERY_LONG_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_EMPTY_STRING, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	// act
 	auto result = IoTHubTransportMqtt_Create(&config);
@@ -772,30 +811,13 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_protocol_gateway_hostname_Suc
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, NULL);
 
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_MESSAGE_TOPIC));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
 	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_HOST_NAME));
-
-	EXPECTED_CALL(mocks, mqtt_client_init(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(IGNORED_NUM_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments();
 	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
 
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-
 	// act
 	auto result = IoTHubTransportMqtt_Create(&config);
 
@@ -807,8 +829,9 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_with_NULL_protocol_gateway_hostname_Suc
 	IoTHubTransportMqtt_Destroy(result);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_010: [IoTHubTransportMqtt_Create shall allocate memory to save its internal state where all topics, hostname, device_id, device_key, sasTokenSr and client handle shall be saved.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_010: [IoTHubTransportMqtt_Create shall allocate memory to save its internal state where the hostname and the list of registered devices shall be saved.] */
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_011: [On Success IoTHubTransportMqtt_Create shall return a non-NULL value.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_049: [IoTHubTransportMqtt_Create shall create a pool for the records of the messages waiting for PUBACK by calling NodePool_Create.] */
 TEST_FUNCTION(IoTHubTransportMqtt_Create_validConfig_Succeed)
 {
 	// arrange
@@ -817,30 +840,12 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_validConfig_Succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, NULL);
 
 	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_MESSAGE_TOPIC));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
 	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_HOST_NAME));
-
-	EXPECTED_CALL(mocks, mqtt_client_init(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(IGNORED_NUM_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments();
 	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG)).IgnoreArgument(1);
-
 	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
 
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-
 	// act
 	auto result = IoTHubTransportMqtt_Create(&config);
 
@@ -860,31 +865,10 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_hostAddress_fails)
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, NULL);
 
-	whenShallSTRING_construct_fail = 6;
+	whenShallSTRING_construct_fail = 1;
 
 	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_MESSAGE_TOPIC));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
 	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_HOST_NAME));
-
-	EXPECTED_CALL(mocks, mqtt_client_init(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
 	EXPECTED_CALL(mocks, gballoc_free(NULL));
 
 	// act
@@ -897,323 +881,193 @@ TEST_FUNCTION(IoTHubTransportMqtt_Create_hostAddress_fails)
 	// clean up
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, deviceKey, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_with_empty_device_id_fails)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_009: [If any error is encountered then IoTHubTransportMqtt_Create shall return NULL.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Create_validConfig_state_Allocation_fails_fail)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, TEST_EMPTY_STRING, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	whenShallmalloc_fail = 1;
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 
 	// act
 	auto result = IoTHubTransportMqtt_Create(&config);
 
 	// assert
 	ASSERT_IS_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, deviceKey, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_with_empty_device_key_fails)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_049: [IoTHubTransportMqtt_Create shall create a pool for the records of the messages waiting for PUBACK by calling NodePool_Create.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_050: [If NodePool_Create fails then IoTHubTransportMqtt_Create shall fail and return NULL.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Create_validConfig_NodePool_Create_fails_fail)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_EMPTY_STRING, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_HOST_NAME));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Create(IGNORED_NUM_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments()
+		.SetReturn((NODEPOOL_HANDLE)NULL);
+	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_free(NULL));
 
 	// act
 	auto result = IoTHubTransportMqtt_Create(&config);
 
 	// assert
 	ASSERT_IS_NULL(result);
+	mocks.AssertActualAndExpectedCalls();
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_03_003: [If both deviceKey & deviceSasToken fields are NOT NULL then IoTHubTransportMqtt_Create shall return NULL.]*/
-TEST_FUNCTION(IoTHubTransportMqtt_Create_with_both_deviceKey_and_deviceSasToken_defined_fails)
-{
-    // arrange
-    CIoTHubTransportMqttMocks mocks;
-    IOTHUBTRANSPORT_CONFIG config = { 0 };
-
-    SetupIothubTransportConfigWithKeyAndSasToken(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_DEVICE_SAS, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
-
-    // act
-    auto result = IoTHubTransportMqtt_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(result);
-}
-
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_003: [If the upperConfig's variables deviceId, deviceKey, iotHubName, protocol, or iotHubSuffix are NULL then IoTHubTransportMqtt_Create shall return NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_with_empty_iothub_name_fails)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_012: [IoTHubTransportMqtt_Destroy shall do nothing if parameter handle is NULL.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Destroy_parameter_NULL_succeed)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
-	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_EMPTY_STRING, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	// act
-	auto result = IoTHubTransportMqtt_Create(&config);
+	IoTHubTransportMqtt_Destroy(NULL);
 
 	// assert
-	ASSERT_IS_NULL(result);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_011: [On Success IoTHubTransportMqtt_Create shall return a non-NULL value.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_validConfig_String_construct_fails_fail)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_013: [If the parameter subscribe is true then IoTHubTransportMqtt_Destroy shall call IoTHubTransportMqtt_Unsubscribe.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_054: [IoTHubTransportMqtt_Destroy shall unregister the devices that are still registered.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Destroy_Unsubscribe_succeeds)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
-	whenShallSTRING_construct_fail = 5;
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	auto device = RegisterConfiguredDevice(handle, &config);
+	(void)IoTHubTransportMqtt_Subscribe(device);
+	CONNECT_ACK connack = { true, CONNECTION_ACCEPTED };
+	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_CONNACK, &connack, g_callbackCtx);
+	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(mocks, STRING_c_str(NULL));
 
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_MESSAGE_TOPIC));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).ExpectedTimesExactly(3);
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
 
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
 
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_disconnect(TEST_MQTT_CLIENT_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_deinit(TEST_MQTT_CLIENT_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_unsubscribe(TEST_MQTT_CLIENT_HANDLE, IGNORED_NUM_ARG, IGNORED_PTR_ARG, 1))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
 	EXPECTED_CALL(mocks, gballoc_free(NULL));
 	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
+	STRICT_EXPECTED_CALL(mocks, xio_destroy(TEST_XIO_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(TEST_NODEPOOL_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_COUNTER_HANDLE));
 
 	// act
-	auto result = IoTHubTransportMqtt_Create(&config);
+	IoTHubTransportMqtt_Destroy(handle);
 
 	// assert
-	ASSERT_IS_NULL(result);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_011: [On Success IoTHubTransportMqtt_Create shall return a non-NULL value.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_validConfig_string_contruct_for_message_fails_fail)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_014: [IoTHubTransportMqtt_Destroy shall free all the resources currently in use.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Destroy_One_Message_Ack_succeeds)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
+
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
-	whenShallSTRING_construct_fail = 4;
-
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+	SUBSCRIBE_ACK suback;
+	suback.packetId = 1234;
+	suback.qosCount = 1;
+	suback.qosReturn = QosValue;
 
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
+	DList_InsertTailList(config.waitingToSend, &(message1.entry));
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
+	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).ExpectedTimesExactly(4);
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
 
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_disconnect(TEST_MQTT_CLIENT_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_deinit(TEST_MQTT_CLIENT_HANDLE));
+	EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG));
 	EXPECTED_CALL(mocks, gballoc_free(NULL));
 	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
+	STRICT_EXPECTED_CALL(mocks, xio_destroy(TEST_XIO_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(TEST_NODEPOOL_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_COUNTER_HANDLE));
 
 	// act
-	auto result = IoTHubTransportMqtt_Create(&config);
+	IoTHubTransportMqtt_Destroy(handle);
 
 	// assert
-	ASSERT_IS_NULL(result);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_011: [On Success IoTHubTransportMqtt_Create shall return a non-NULL value.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_validConfig_string_construct_sasTokenSr_fails_fail)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_014: [IoTHubTransportMqtt_Destroy shall free all the resources currently in use.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Destroy_succeeds)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
-	whenShallSTRING_construct_fail = 3;
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
+	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).ExpectedTimesExactly(3);
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
 
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
+	EXPECTED_CALL(mocks, STRING_delete(NULL));
 
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-
-	// act
-	auto result = IoTHubTransportMqtt_Create(&config);
-
-	// assert
-	ASSERT_IS_NULL(result);
-}
-
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_011: [On Success IoTHubTransportMqtt_Create shall return a non-NULL value.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_validConfig_state_Allocation_fails_fail)
-{
-	// arrange
-	CIoTHubTransportMqttMocks mocks;
-	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
-
-	whenShallmalloc_fail = 1;
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-
-	// act
-	auto result = IoTHubTransportMqtt_Create(&config);
-
-	// assert
-	ASSERT_IS_NULL(result);
-}
-
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_011: [On Success IoTHubTransportMqtt_Create shall return a non-NULL value.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Create_validConfig_mqtt_client_init_Create_fails_fail)
-{
-	// arrange
-	CIoTHubTransportMqttMocks mocks;
-	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
-
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_MESSAGE_TOPIC));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
-	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
-
-	EXPECTED_CALL(mocks, mqtt_client_init(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn((MQTT_CLIENT_HANDLE)NULL);
-
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-
-	// act
-	auto result = IoTHubTransportMqtt_Create(&config);
-
-	// assert
-	ASSERT_IS_NULL(result);
-}
-
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_012: [IoTHubTransportMqtt_Destroy shall do nothing if parameter handle is NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Destroy_parameter_NULL_succeed)
-{
-	// arrange
-	CIoTHubTransportMqttMocks mocks;
-
-	// act
-	IoTHubTransportMqtt_Destroy(NULL);
-
-	// assert
-}
-
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_013: [If the parameter subscribe is true then IoTHubTransportMqtt_Destroy shall call IoTHubTransportMqtt_Unsubscribe.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Destroy_Unsubscribe_succeeds)
-{
-	// arrange
-	CIoTHubTransportMqttMocks mocks;
-	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
-
-	auto handle = IoTHubTransportMqtt_Create(&config);
-	(void)IoTHubTransportMqtt_Subscribe(handle);
-	CONNECT_ACK connack = { true, CONNECTION_ACCEPTED };
-	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_CONNACK, &connack, g_callbackCtx);
-	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-	mocks.ResetAllCalls();
-
-	EXPECTED_CALL(mocks, STRING_c_str(NULL));
-
-	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-
-	STRICT_EXPECTED_CALL(mocks, mqtt_client_disconnect(TEST_MQTT_CLIENT_HANDLE));
-	STRICT_EXPECTED_CALL(mocks, mqtt_client_deinit(TEST_MQTT_CLIENT_HANDLE));
-	STRICT_EXPECTED_CALL(mocks, mqtt_client_unsubscribe(TEST_MQTT_CLIENT_HANDLE, IGNORED_NUM_ARG, IGNORED_PTR_ARG, 1))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	STRICT_EXPECTED_CALL(mocks, xio_destroy(TEST_XIO_HANDLE));
-	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_COUNTER_HANDLE));
-
-	// act
-	IoTHubTransportMqtt_Destroy(handle);
-
-	// assert
-}
-
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_014: [IoTHubTransportMqtt_Destroy shall free all the resources currently in use.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Destroy_One_Message_Ack_succeeds)
-{
-	// arrange
-	CIoTHubTransportMqttMocks mocks;
-
-	IOTHUBTRANSPORT_CONFIG config = { 0 };
-	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
-
-	QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
-	SUBSCRIBE_ACK suback;
-	suback.packetId = 1234;
-	suback.qosCount = 1;
-	suback.qosReturn = QosValue;
-
-	DList_InsertTailList(config.waitingToSend, &(message1.entry));
-	auto handle = IoTHubTransportMqtt_Create(&config);
-	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
-	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-	mocks.ResetAllCalls();
-
-	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
-	EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-
-	STRICT_EXPECTED_CALL(mocks, mqtt_client_disconnect(TEST_MQTT_CLIENT_HANDLE));
-	STRICT_EXPECTED_CALL(mocks, mqtt_client_deinit(TEST_MQTT_CLIENT_HANDLE));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
-	STRICT_EXPECTED_CALL(mocks, xio_destroy(TEST_XIO_HANDLE));
-	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_COUNTER_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_deinit(TEST_MQTT_CLIENT_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_disconnect(TEST_MQTT_CLIENT_HANDLE));
+	EXPECTED_CALL(mocks, xio_destroy(NULL));
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(TEST_NODEPOOL_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_COUNTER_HANDLE));
 
 	// act
 	IoTHubTransportMqtt_Destroy(handle);
@@ -1222,7 +1076,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Destroy_One_Message_Ack_succeeds)
 }
 
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_014: [IoTHubTransportMqtt_Destroy shall free all the resources currently in use.] */
-TEST_FUNCTION(IoTHubTransportMqtt_Destroy_succeeds)
+TEST_FUNCTION(IoTHubTransportMqtt_Destroy_without_devices_succeeds)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
@@ -1233,25 +1087,16 @@ TEST_FUNCTION(IoTHubTransportMqtt_Destroy_succeeds)
 	mocks.ResetAllCalls();
 
 	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
 	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-	EXPECTED_CALL(mocks, STRING_delete(NULL));
-
-	STRICT_EXPECTED_CALL(mocks, mqtt_client_deinit(TEST_MQTT_CLIENT_HANDLE));
-	STRICT_EXPECTED_CALL(mocks, mqtt_client_disconnect(TEST_MQTT_CLIENT_HANDLE));
-	EXPECTED_CALL(mocks, xio_destroy(NULL));
 	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, NodePool_Destroy(TEST_NODEPOOL_HANDLE));
 	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_COUNTER_HANDLE));
 
 	// act
 	IoTHubTransportMqtt_Destroy(handle);
 
 	// assert
+	mocks.AssertActualAndExpectedCalls();
 }
 
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_015: [If parameter handle is NULL than IoTHubTransportMqtt_Subscribe shall return a non-zero value.] */
@@ -1276,7 +1121,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_Subscribe_mqtt_client_subscribe_return_error_f
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
-	auto result = IoTHubTransportMqtt_Subscribe(handle);
+	auto device = RegisterConfiguredDevice(handle, &config);
+	auto result = IoTHubTransportMqtt_Subscribe(device);
 	CONNECT_ACK connack = { true, CONNECTION_ACCEPTED };
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_CONNACK, &connack, g_callbackCtx);
 
@@ -1314,6 +1160,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Subscribe_Succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	TRANSPORT_LL_HANDLE handle = IoTHubTransportMqtt_Create(&config);
+	auto device = RegisterConfiguredDevice(handle, &config);
 
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_CONNACK, &connack, g_callbackCtx);
 	mocks.ResetAllCalls();
@@ -1329,7 +1176,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Subscribe_Succeed)
 	SetupMocksForInitConnection(mocks);
 
 	// act
-	int result = IoTHubTransportMqtt_Subscribe(handle);
+	int result = IoTHubTransportMqtt_Subscribe(device);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	ASSERT_ARE_EQUAL(int, result, 0);
@@ -1351,6 +1198,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Subscribe_set_subscribe_type_Succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	TRANSPORT_LL_HANDLE handle = IoTHubTransportMqtt_Create(&config);
+	auto device = RegisterConfiguredDevice(handle, &config);
 
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_CONNACK, &connack, g_callbackCtx);
 	mocks.ResetAllCalls();
@@ -1366,7 +1214,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Subscribe_set_subscribe_type_Succeed)
 	SetupMocksForInitConnection(mocks);
 
 	// act
-	int result = IoTHubTransportMqtt_Subscribe(handle);
+	int result = IoTHubTransportMqtt_Subscribe(device);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	ASSERT_ARE_EQUAL(int, result, 0);
@@ -1393,6 +1241,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Subscribe_set_subscribe_after_publish_Succeed)
 	suback.qosReturn = QosValue;
 
 	TRANSPORT_LL_HANDLE handle = IoTHubTransportMqtt_Create(&config);
+	auto device = RegisterConfiguredDevice(handle, &config);
 
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -1410,7 +1259,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Subscribe_set_subscribe_after_publish_Succeed)
 
 	// act
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-	int result = IoTHubTransportMqtt_Subscribe(handle);
+	int result = IoTHubTransportMqtt_Subscribe(device);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	ASSERT_ARE_EQUAL(int, result, 0);
@@ -1443,7 +1292,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_Unsubscribe_Succeeds)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
-	IoTHubTransportMqtt_Subscribe(handle);
+	auto device = RegisterConfiguredDevice(handle, &config);
+	IoTHubTransportMqtt_Subscribe(device);
 
 	CONNECT_ACK connack = { true, CONNECTION_ACCEPTED };
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_CONNACK, &connack, g_callbackCtx);
@@ -1458,7 +1308,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Unsubscribe_Succeeds)
 	EXPECTED_CALL(mocks, STRING_c_str(NULL)).SetReturn(TEST_MQTT_MESSAGE_TOPIC);
 
 	// act
-	IoTHubTransportMqtt_Unsubscribe(handle);
+	IoTHubTransportMqtt_Unsubscribe(device);
 
 	// assert
 	mocks.AssertActualAndExpectedCalls();
@@ -1467,7 +1317,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Unsubscribe_Succeeds)
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_032: [IoTHubTransportMqtt_SetOption shall pass down the option to xio_setoption if the option parameter is not a known option string for the MQTT transport.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_032: [IoTHubTransportMqtt_SetOption shall pass down the option to xio_setoption of every registered device if the option parameter is not a known option string for the MQTT transport.] */
 TEST_FUNCTION(IoTHubTransportMqtt_Setoption_invokes_xio_setoption_when_option_not_consumed_by_mqtt_transport)
 {
 	// arrange
@@ -1480,9 +1330,11 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_invokes_xio_setoption_when_option_no
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	bool traceOn = true;
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
 	EXPECTED_CALL(mocks, STRING_c_str(NULL));
 	EXPECTED_CALL(mocks, platform_get_default_tlsio());
 	EXPECTED_CALL(mocks, xio_create(NULL, NULL, NULL));
@@ -1501,7 +1353,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_invokes_xio_setoption_when_option_no
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_032: [IoTHubTransportMqtt_SetOption shall pass down the option to xio_setoption if the option parameter is not a known option string for the MQTT transport.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_032: [IoTHubTransportMqtt_SetOption shall pass down the option to xio_setoption of every registered device if the option parameter is not a known option string for the MQTT transport.] */
 TEST_FUNCTION(IoTHubTransportMqtt_Setoption_xio_create_fail)
 {
 	// arrange
@@ -1514,9 +1366,11 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_xio_create_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	bool traceOn = true;
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
 	EXPECTED_CALL(mocks, STRING_c_str(NULL));
 	EXPECTED_CALL(mocks, platform_get_default_tlsio());
 	EXPECTED_CALL(mocks, xio_create(NULL, NULL, NULL)).SetReturn((XIO_HANDLE)NULL);
@@ -1546,10 +1400,12 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_fails_when_xio_setoption_fails)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	bool traceOn = true;
 
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
 	EXPECTED_CALL(mocks, STRING_c_str(NULL));
 	EXPECTED_CALL(mocks, platform_get_default_tlsio());
 	EXPECTED_CALL(mocks, xio_create(NULL, NULL, NULL));
@@ -1579,6 +1435,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_option_NULL_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	bool traceOn = true;
@@ -1604,6 +1461,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_value_NULL_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	// act
@@ -1627,6 +1485,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	STRICT_EXPECTED_CALL(mocks, mqtt_client_set_trace(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreArgument(2).IgnoreArgument(3);
@@ -1654,6 +1513,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_keepAlive_succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	int keepAlive = 10;
@@ -1670,7 +1530,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_keepAlive_succeed)
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_038: [If the client is connected when the keepalive is set then IoTHubTransportMqtt_SetOption shall disconnect and reconnect with the specified keepalive value.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_038: [Every device that is connected when the keepalive is set shall be disconnected by IoTHubTransportMqtt_SetOption and reconnect with the specified keepalive value.] */
 TEST_FUNCTION(IoTHubTransportMqtt_Setoption_keepAlive_previous_connection_succeed)
 {
 	// arrange
@@ -1679,6 +1539,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_keepAlive_previous_connection_succee
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
@@ -1713,6 +1574,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_keepAlive_same_value_succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 
 	int keepAlive = 30;
 	auto result = IoTHubTransportMqtt_SetOption(handle, KEEP_ALIVE_OPTION, &keepAlive);
@@ -1734,44 +1596,93 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_keepAlive_same_value_succeed)
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_026: [IoTHubTransportMqtt_DoWork shall do nothing if parameter handle and/or iotHubClientHandle is NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_DoWork_parameter_handle_NULL_fail)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_026: [IoTHubTransportMqtt_DoWork shall do nothing if parameter handle is NULL.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_046: [If the option parameter is set to "maxinflight" then the value shall be a size_t_ptr and the value will determine the maximum number of messages of each device waiting for PUBACK.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_051: [When "maxinflight" is set IoTHubTransportMqtt_SetOption shall call NodePool_Reserve so that a full window of messages does not allocate from the heap.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_maxInflight_succeed)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
+	mocks.ResetAllCalls();
+
+	size_t maxInflight = 16;
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Reserve(TEST_NODEPOOL_HANDLE, 16));
 
 	// act
-	IoTHubTransportMqtt_DoWork(NULL, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportMqtt_SetOption(handle, MAX_INFLIGHT_OPTION, &maxInflight);
+
 	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+	mocks.AssertActualAndExpectedCalls();
 
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_026: [IoTHubTransportMqtt_DoWork shall do nothing if parameter handle and/or iotHubClientHandle is NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_DoWork_parameter_iothubClient_NULL_fail)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_052: [If NodePool_Reserve fails then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_maxInflight_NodePool_Reserve_fails_fail)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
+	mocks.ResetAllCalls();
+
+	size_t maxInflight = 16;
+
+	STRICT_EXPECTED_CALL(mocks, NodePool_Reserve(TEST_NODEPOOL_HANDLE, 16))
+		.SetReturn(__LINE__);
 
 	// act
-	IoTHubTransportMqtt_DoWork(TEST_TRANSPORT_HANDLE, NULL);
+	auto result = IoTHubTransportMqtt_SetOption(handle, MAX_INFLIGHT_OPTION, &maxInflight);
+
 	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
 
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_026: [IoTHubTransportMqtt_DoWork shall do nothing if parameter handle and/or iotHubClientHandle is NULL.] */
-TEST_FUNCTION(IoTHubTransportMqtt_DoWork_all_parameters_NULL_fail)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_048: [If the "maxinflight" value is 0 or greater than 256 then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_maxInflight_0_fail)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
+	mocks.ResetAllCalls();
+
+	size_t maxInflight = 0;
 
 	// act
-	IoTHubTransportMqtt_DoWork(NULL, NULL);
+	auto result = IoTHubTransportMqtt_SetOption(handle, MAX_INFLIGHT_OPTION, &maxInflight);
+
 	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+	mocks.AssertActualAndExpectedCalls();
 
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
-TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqtt_client_connect_fail)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_048: [If the "maxinflight" value is 0 or greater than 256 then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_maxInflight_too_large_fail)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
@@ -1779,35 +1690,25 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqtt_client_connect_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
-	//STRICT_EXPECTED_CALL(mocks, mqtt_client_dowork(TEST_MQTT_CLIENT_HANDLE));
-	STRICT_EXPECTED_CALL(mocks, get_time(IGNORED_PTR_ARG));
-	STRICT_EXPECTED_CALL(mocks, STRING_new());
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)).ExpectedTimesExactly(5);
-	STRICT_EXPECTED_CALL(mocks, platform_get_default_tlsio());
-
-	EXPECTED_CALL(mocks, mqtt_client_connect(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
-	EXPECTED_CALL(mocks, SASToken_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-
-	EXPECTED_CALL(mocks, xio_create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
-	EXPECTED_CALL(mocks, xio_destroy(IGNORED_PTR_ARG));
+	size_t maxInflight = 257;
 
 	// act
-	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportMqtt_SetOption(handle, MAX_INFLIGHT_OPTION, &maxInflight);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 
-	//assert
 	mocks.AssertActualAndExpectedCalls();
 
 	//cleanup
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
-TEST_FUNCTION(IoTHubTransportMqtt_DoWork_no_messages_succeed)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_138: [If the option parameter is set to "AsyncMessageDisposition" then the value shall be a bool_ptr. IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_ERROR when it is true, since MQTT completes a message when it is delivered, and IOTHUB_CLIENT_OK when it is false.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_AsyncMessageDisposition_true_fail)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
@@ -1815,44 +1716,185 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_no_messages_succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).ExpectedAtLeastTimes(3).IgnoreArgument(2);
-
-	STRICT_EXPECTED_CALL(mocks, mqtt_client_dowork(TEST_MQTT_CLIENT_HANDLE));
-	SetupMocksForInitConnection(mocks);
+	bool asyncMessageDisposition = true;
 
 	// act
-	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportMqtt_SetOption(handle, ASYNC_MESSAGE_DISPOSITION_OPTION, &asyncMessageDisposition);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
 
-	//assert
 	mocks.AssertActualAndExpectedCalls();
 
 	//cleanup
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
-TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_succeeds)
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_138: [If the option parameter is set to "AsyncMessageDisposition" then the value shall be a bool_ptr. IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_ERROR when it is true, since MQTT completes a message when it is delivered, and IOTHUB_CLIENT_OK when it is false.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_AsyncMessageDisposition_false_succeed)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
-	QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
-	SUBSCRIBE_ACK suback;
-	suback.packetId = 1234;
-	suback.qosCount = 1;
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
+	mocks.ResetAllCalls();
+
+	bool asyncMessageDisposition = false;
+
+	// act
+	auto result = IoTHubTransportMqtt_SetOption(handle, ASYNC_MESSAGE_DISPOSITION_OPTION, &asyncMessageDisposition);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_parameter_handle_NULL_fail)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+
+	// act
+	IoTHubTransportMqtt_DoWork(NULL, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	// assert
+
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_055: [IoTHubTransportMqtt_DoWork shall ignore the iotHubClientHandle parameter; each device uses the client handle it was registered with.] */
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_parameter_iothubClient_NULL_succeed)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).ExpectedAtLeastTimes(3).IgnoreArgument(2);
+
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_dowork(TEST_MQTT_CLIENT_HANDLE));
+	SetupMocksForInitConnection(mocks);
+
+	// act
+	IoTHubTransportMqtt_DoWork(handle, NULL);
+
+	//assert
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_026: [IoTHubTransportMqtt_DoWork shall do nothing if parameter handle is NULL.] */
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_all_parameters_NULL_fail)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+
+	// act
+	IoTHubTransportMqtt_DoWork(NULL, NULL);
+	// assert
+
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqtt_client_connect_fail)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
+	mocks.ResetAllCalls();
+
+	//STRICT_EXPECTED_CALL(mocks, mqtt_client_dowork(TEST_MQTT_CLIENT_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, get_time(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_new());
+	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)).ExpectedTimesExactly(5);
+	STRICT_EXPECTED_CALL(mocks, platform_get_default_tlsio());
+
+	EXPECTED_CALL(mocks, mqtt_client_connect(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(__LINE__);
+	EXPECTED_CALL(mocks, SASToken_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+
+	EXPECTED_CALL(mocks, xio_create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
+	EXPECTED_CALL(mocks, xio_destroy(IGNORED_PTR_ARG));
+
+	// act
+	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	//assert
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_no_messages_succeed)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).ExpectedAtLeastTimes(3).IgnoreArgument(2);
+
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_dowork(TEST_MQTT_CLIENT_HANDLE));
+	SetupMocksForInitConnection(mocks);
+
+	// act
+	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	//assert
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_succeeds)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+	SUBSCRIBE_ACK suback;
+	suback.packetId = 1234;
+	suback.qosCount = 1;
 	suback.qosReturn = QosValue;
 
 	DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_BYTEARRAY));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MSG_BYTEARRAY, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
@@ -1862,6 +1904,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_succeeds)
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, mqtt_client_publish(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG))
 		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, &message1, 1, appMsgSize));
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
@@ -1915,12 +1958,14 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_succe
 
 	DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
 
 	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-		.ExpectedTimesExactly(2);
+		.ExpectedTimesExactly(1);
+	EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG));
 	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_BYTEARRAY));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MSG_BYTEARRAY, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -1930,6 +1975,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_succe
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, mqtt_client_publish(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG))
 		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, &message1, 1, appMsgSize));
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
@@ -1989,12 +2035,14 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_2_properties_suc
 
 	DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
 
 	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-		.ExpectedTimesExactly(3);
+		.ExpectedTimesExactly(2);
+	EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG));
 	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 		.ExpectedTimesExactly(2);
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_BYTEARRAY));
@@ -2005,6 +2053,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_2_properties_suc
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, mqtt_client_publish(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG))
 		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, &message1, 1, appMsgSize));
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
@@ -2062,12 +2111,15 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_STRIN
 
 	DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)).ExpectedTimesExactly(2);
-	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_BYTEARRAY));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MSG_BYTEARRAY, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
@@ -2118,6 +2170,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_no_subscribe_succeeds)
 
 	//DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_CONNACK, &connack, g_callbackCtx);
@@ -2140,6 +2193,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_no_subscribe_succeeds)
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_029: [IoTHubTransportMqtt_DoWork shall create a MQTT_MESSAGE_HANDLE and pass this to a call to mqtt_client_publish.] */
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_030: [IoTHubTransportMqtt_DoWork shall call mqtt_client_dowork everytime it is called if it is connected.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_066: [Every time a message is published, first time or resent, IoTHubTransportMqtt_DoWork shall call IoTHubClient_LL_SendStarted with the message, a count of 1 and the size of its payload.] */
 TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_STRING_type_succeeds)
 {
 	// arrange
@@ -2155,11 +2209,12 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_STRING_type_succeeds)
 
 	DList_InsertTailList(config.waitingToSend, &(message2.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_STRING));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MSG_STRING));
 	STRICT_EXPECTED_CALL(mocks, mqttmessage_create(IGNORED_NUM_ARG, IGNORED_PTR_ARG, DELIVER_AT_LEAST_ONCE, (const uint8_t*)appMessageString, strlen(appMessageString) ))
@@ -2167,6 +2222,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_STRING_type_succeeds)
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, mqtt_client_publish(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG))
 		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, &message2, 1, strlen(appMessageString)));
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
@@ -2210,6 +2266,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_no_resend_message_succeeds)
 
 	DList_InsertTailList(config.waitingToSend, &(message2.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -2231,6 +2288,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_no_resend_message_succeeds)
 }
 
 /* Test_SRS_IOTHUB_MQTT_TRANSPORT_07_033: [IoTHubTransportMqtt_DoWork shall iterate through the Waiting Acknowledge messages looking for any message that has been waiting longer than 2 min.]*/
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_043: [A resent message shall be moved to the end of the Waiting for Ack list.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_066: [Every time a message is published, first time or resent, IoTHubTransportMqtt_DoWork shall call IoTHubClient_LL_SendStarted with the message, a count of 1 and the size of its payload.] */
 TEST_FUNCTION(IoTHubTransportMqtt_DoWork_resend_message_succeeds)
 {
 	// arrange
@@ -2246,6 +2305,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_resend_message_succeeds)
 
 	DList_InsertTailList(config.waitingToSend, &(message2.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -2260,6 +2320,9 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_resend_message_succeeds)
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(mocks, mqtt_client_publish(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG))
 		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendStarted(TEST_IOTHUB_CLIENT_LL_HANDLE, &message2, 1, strlen(appMessageString)));
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mocks, mqtt_client_dowork(TEST_MQTT_CLIENT_HANDLE));
 	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
@@ -2301,6 +2364,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_resend_max_recount_reached_message_succ
 
 	DList_InsertTailList(config.waitingToSend, &(message2.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	for (size_t index = 0; index < 3; index++)
 	{
@@ -2320,7 +2384,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_resend_max_recount_reached_message_succ
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
 		.ExpectedAtLeastTimes(2);
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
+	EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG));
 
 	// act
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -2348,6 +2412,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_GetString_fails)
 
 	DList_InsertTailList(config.waitingToSend, &(message2.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
@@ -2383,6 +2448,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_GetByteArray_Error_fail)
 
 	DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
@@ -2406,6 +2472,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_GetByteArray_Error_fail)
 }
 
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_030: [IoTHubTransportMqtt_DoWork shall call mqtt_client_dowork everytime it is called if it is connected.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_066: [Every time a message is published, first time or resent, IoTHubTransportMqtt_DoWork shall call IoTHubClient_LL_SendStarted with the message, a count of 1 and the size of its payload.] */
 TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqtt_client_publish_fails)
 {
 	// arrange
@@ -2421,6 +2488,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqtt_client_publish_fails)
 
 	DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
@@ -2444,8 +2512,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqtt_client_publish_fails)
 	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
 		.IgnoreArgument(2);
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
+	EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mocks, mqttmessage_destroy(TEST_MQTT_MESSAGE_HANDLE));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MSG_BYTEARRAY));
 	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
@@ -2480,6 +2548,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqttmessage_create_fails)
 
 	DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
@@ -2500,8 +2569,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqttmessage_create_fails)
 	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
 		.IgnoreArgument(2);
-	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-	EXPECTED_CALL(mocks, gballoc_free(NULL));
+	EXPECTED_CALL(mocks, NodePool_Alloc(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, NodePool_Free(IGNORED_PTR_ARG));
 	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
 	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MSG_BYTEARRAY));
 	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
@@ -2529,6 +2598,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_connectFailCount_exceed_succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	//STRICT_EXPECTED_CALL(mocks, mqtt_client_dowork(TEST_MQTT_CLIENT_HANDLE)).ExpectedAtLeastTimes(iterationCount-1);
@@ -2571,6 +2641,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_GetSendStatus_InvalidHandleArgument_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	IOTHUB_CLIENT_STATUS status;
@@ -2596,10 +2667,11 @@ TEST_FUNCTION(IoTHubTransportMqtt_GetSendStatus_InvalidStatusArgument_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	auto device = RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportMqtt_GetSendStatus(handle, NULL);
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportMqtt_GetSendStatus(device, NULL);
 
 	// assert
 	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
@@ -2619,6 +2691,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_GetSendStatus_empty_waitingToSend_and_empty_wa
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	auto device = RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(config.waitingToSend) );
@@ -2627,7 +2700,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_GetSendStatus_empty_waitingToSend_and_empty_wa
 	IOTHUB_CLIENT_STATUS status;
 
 	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportMqtt_GetSendStatus(handle, &status);
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportMqtt_GetSendStatus(device, &status);
 
 	// assert
 	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
@@ -2648,6 +2721,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_GetSendStatus_waitingToSend_not_empty_success)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	auto device = RegisterConfiguredDevice(handle, &config);
 
 	IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG);
 	IOTHUB_MESSAGE_LIST newEntry;
@@ -2661,7 +2735,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_GetSendStatus_waitingToSend_not_empty_success)
 	IOTHUB_CLIENT_STATUS status;
 
 	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportMqtt_GetSendStatus(handle, &status);
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportMqtt_GetSendStatus(device, &status);
 
 	// assert
 	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
@@ -2674,6 +2748,50 @@ TEST_FUNCTION(IoTHubTransportMqtt_GetSendStatus_waitingToSend_not_empty_success)
 	IoTHubMessage_Destroy(eventMessageHandle);
 }
 
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_045: [IoTHubTransportMqtt_DoWork shall not publish a message while the number of messages waiting for PUBACK is equal to the "maxinflight" option.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_047: [IoTHubTransportMqtt_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_FULL if there are event items to be sent and the in flight window is full.] */
+TEST_FUNCTION(IoTHubTransportMqtt_GetSendStatus_inflight_window_full_success)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+	SUBSCRIBE_ACK suback;
+	suback.packetId = 1234;
+	suback.qosCount = 1;
+	suback.qosReturn = QosValue;
+
+	DList_InsertTailList(config.waitingToSend, &(message1.entry));
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	auto device = RegisterConfiguredDevice(handle, &config);
+	size_t maxInflight = 1;
+	(void)IoTHubTransportMqtt_SetOption(handle, MAX_INFLIGHT_OPTION, &maxInflight);
+	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	DList_InsertTailList(config.waitingToSend, &(message2.entry));
+	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(config.waitingToSend));
+
+	IOTHUB_CLIENT_STATUS status;
+
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportMqtt_GetSendStatus(device, &status);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_FULL);
+
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_022: [This function shall return a pointer to a structure of type TRANSPORT_PROVIDER having the following values for its fields: IoTHubTransport_Create = IoTHubTransportMqtt_Create
 IoTHubTransport_Destroy = IoTHubTransportMqtt_Destroy
 IoTHubTransport_Subscribe = IoTHubTransportMqtt_Subscribe
@@ -2696,6 +2814,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Protocol_succeeds)
 	ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_Unsubscribe, (void*)IoTHubTransportMqtt_Unsubscribe);
 	ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_DoWork, (void*)IoTHubTransportMqtt_DoWork);
 	ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_GetSendStatus, (void*)IoTHubTransportMqtt_GetSendStatus);
+	ASSERT_ARE_EQUAL(void_ptr, (void*)((TRANSPORT_PROVIDER*)result)->IoTHubTransport_SendMessageDisposition, (void*)IoTHubTransportMqtt_SendMessageDisposition);
 
 	///cleanup
 }
@@ -2708,6 +2827,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_delivered_NULL_context_do_Nothing)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 
 	mocks.ResetAllCalls();
 
@@ -2733,6 +2853,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_DISCONNECT_succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	// act
@@ -2757,6 +2878,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_CONN_ACK_NOT_CONNECTED_
 	connack.returnCode = CONN_REFUSED_BAD_USERNAME_PASSWORD;
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	STRICT_EXPECTED_CALL(mocks, mqtt_client_disconnect(TEST_MQTT_CLIENT_HANDLE))
@@ -2780,6 +2902,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_CONNACK_NULL_msgInfo_fa
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	mocks.ResetAllCalls();
 
 	// act
@@ -2810,6 +2933,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_PUBLISH_ACK_succeed)
 
 	DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -2823,7 +2947,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_PUBLISH_ACK_succeed)
 		.IgnoreAllArguments();
 	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
 		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, gballoc_free(NULL))
+	STRICT_EXPECTED_CALL(mocks, NodePool_Free(NULL))
 		.IgnoreArgument(1);
 
 	// act
@@ -2836,6 +2960,41 @@ TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_PUBLISH_ACK_succeed)
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_040: [On PUBACK or PUBCOMP the message shall be looked up in the in flight table by its packet id, without walking the Waiting for Ack list.] */
+TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_PUBLISH_ACK_unknown_packetId_does_nothing)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	PUBLISH_ACK puback;
+	puback.packetId = 1 + 256;
+
+	QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+	SUBSCRIBE_ACK suback;
+	suback.packetId = 1234;
+	suback.qosCount = 1;
+	suback.qosReturn = QosValue;
+
+	DList_InsertTailList(config.waitingToSend, &(message1.entry));
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
+	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	mocks.ResetAllCalls();
+
+	// act
+	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_PUBLISH_ACK, &puback, g_callbackCtx);
+
+	//assert
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
 TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_message_NULL_fail)
 {
 	// arrange
@@ -2844,6 +3003,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_message_NULL_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 
 	mocks.ResetAllCalls();
 
@@ -2866,6 +3026,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_context_NULL_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 
 	mocks.ResetAllCalls();
 
@@ -2888,6 +3049,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_Message_context_NULL_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 
 	mocks.ResetAllCalls();
 
@@ -2910,6 +3072,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
 
@@ -2950,6 +3113,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_with_Properties_succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_tokenizerIndex = 1;
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
@@ -3004,6 +3168,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_with_Properties_Map_AddorUpdate_fa
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_tokenizerIndex = 1;
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
@@ -3056,6 +3221,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_STRING_construct_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_tokenizerIndex = 1;
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
@@ -3089,6 +3255,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_IoTHubMessage_Properties_fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_tokenizerIndex = 1;
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
@@ -3124,6 +3291,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_with_System_Properties_succeed)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_tokenizerIndex = 1;
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	mocks.ResetAllCalls();
@@ -3176,6 +3344,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_CreateIotHubMessage_Fail)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 
 	mocks.ResetAllCalls();
 
@@ -3209,6 +3378,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_messagecallback_ABANDONED_fail)
 
 	DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -3259,6 +3429,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_messagecallback_REJECTED_fail)
 
 	DList_InsertTailList(config.waitingToSend, &(message1.entry));
 	auto handle = IoTHubTransportMqtt_Create(&config);
+	auto device = RegisterConfiguredDevice(handle, &config);
 	g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 	IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -3294,8 +3465,10 @@ TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_messagecallback_REJECTED_fail)
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_004: [ IoTHubTransportMqtt_Register shall return the TRANSPORT_LL_HANDLE as the IOTHUB_DEVICE_HANDLE. ]
-TEST_FUNCTION(IoTHubTransportMqtt_Register_succeeds_returns_transport)
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_059: [ IoTHubTransportMqtt_Register shall allocate the state of the device where its topics, device_id, device_key, sasTokenSr, username and its own MQTT client handle shall be saved.]
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_063: [ IoTHubTransportMqtt_Register shall add the device to the devices served by IoTHubTransportMqtt_DoWork.]
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_004: [ IoTHubTransportMqtt_Register shall return the state of the device as the IOTHUB_DEVICE_HANDLE. ]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_succeeds_returns_device)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
@@ -3305,23 +3478,33 @@ TEST_FUNCTION(IoTHubTransportMqtt_Register_succeeds_returns_transport)
 	auto handle = IoTHubTransportMqtt_Create(&config);
 	mocks.ResetAllCalls();
 
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)).ExpectedTimesExactly(5);
 	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_MESSAGE_TOPIC));
+	EXPECTED_CALL(mocks, mqtt_client_init(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).ExpectedTimesExactly(4);
 
 	// act
 	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
 
 	// assert
 	ASSERT_IS_NOT_NULL(devHandle);
-	ASSERT_ARE_EQUAL(void_ptr, handle, devHandle);
+	ASSERT_ARE_NOT_EQUAL(void_ptr, handle, devHandle);
 	mocks.AssertActualAndExpectedCalls();
 
 	//cleanup
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_004: [ IoTHubTransportMqtt_Register shall return the TRANSPORT_LL_HANDLE as the IOTHUB_DEVICE_HANDLE. ]
-TEST_FUNCTION(IoTHubTransportMqtt_Register_twice_fails_second_time)
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_060: [ If any of the device resources cannot be created then IoTHubTransportMqtt_Register shall fail and return NULL.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_state_allocation_fails_returns_null)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
@@ -3329,41 +3512,45 @@ TEST_FUNCTION(IoTHubTransportMqtt_Register_twice_fails_second_time)
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
-	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
-
 	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	currentmalloc_call = 0;
+	whenShallmalloc_fail = 1;
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 
 	// act
-	auto devHandle2 = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
 
 	// assert
-	ASSERT_IS_NULL(devHandle2);
+	ASSERT_IS_NULL(devHandle);
 	mocks.AssertActualAndExpectedCalls();
 
 	//cleanup
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_003: [ IoTHubTransportMqtt_Register shall return NULL if deviceId or deviceKey do not match the deviceId and deviceKey passed in during IoTHubTransportMqtt_Create.]
-TEST_FUNCTION(IoTHubTransportMqtt_Register_deviceKey_mismatch_returns_null)
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_060: [ If any of the device resources cannot be created then IoTHubTransportMqtt_Register shall fail and return NULL.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_device_id_construct_fails_returns_null)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
-	IOTHUB_DEVICE_CONFIG deviceConfig = { TEST_DEVICE_ID, "not the right device key", NULL };
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
 	mocks.ResetAllCalls();
 
+	currentSTRING_construct_call = 0;
+	whenShallSTRING_construct_fail = 1;
+
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
+	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)).ExpectedTimesExactly(6);
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
 	// act
-	auto devHandle = IoTHubTransportMqtt_Register(handle, &deviceConfig, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
 
 	// assert
 	ASSERT_IS_NULL(devHandle);
@@ -3373,22 +3560,30 @@ TEST_FUNCTION(IoTHubTransportMqtt_Register_deviceKey_mismatch_returns_null)
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_003: [ IoTHubTransportMqtt_Register shall return NULL if deviceId or deviceKey do not match the deviceId and deviceKey passed in during IoTHubTransportMqtt_Create.]
-TEST_FUNCTION(IoTHubTransportMqtt_Register_deviceid_mismatch_returns_null)
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_060: [ If any of the device resources cannot be created then IoTHubTransportMqtt_Register shall fail and return NULL.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_sasTokenSr_construct_fails_returns_null)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
 	IOTHUBTRANSPORT_CONFIG config = { 0 };
 	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
-	IOTHUB_DEVICE_CONFIG deviceConfig = { "not a good id after all", TEST_DEVICE_KEY, NULL };
 
 	auto handle = IoTHubTransportMqtt_Create(&config);
 	mocks.ResetAllCalls();
 
+	currentSTRING_construct_call = 0;
+	whenShallSTRING_construct_fail = 3;
+
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)).ExpectedTimesExactly(2);
 	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
+	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)).ExpectedTimesExactly(6);
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
 
 	// act
-	auto devHandle = IoTHubTransportMqtt_Register(handle, &deviceConfig, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
 
 	// assert
 	ASSERT_IS_NULL(devHandle);
@@ -3398,8 +3593,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_Register_deviceid_mismatch_returns_null)
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_002: [ IoTHubTransportMqtt_Register shall return NULL if device or waitingToSend are NULL.]
-TEST_FUNCTION(IoTHubTransportMqtt_Register_wts_null_returns_null)
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_060: [ If any of the device resources cannot be created then IoTHubTransportMqtt_Register shall fail and return NULL.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_message_topic_construct_fails_returns_null)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
@@ -3409,7 +3604,235 @@ TEST_FUNCTION(IoTHubTransportMqtt_Register_wts_null_returns_null)
 	auto handle = IoTHubTransportMqtt_Create(&config);
 	mocks.ResetAllCalls();
 
-	// act
+	currentSTRING_construct_call = 0;
+	whenShallSTRING_construct_fail = 5;
+
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)).ExpectedTimesExactly(4);
+	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_MESSAGE_TOPIC));
+	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)).ExpectedTimesExactly(6);
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).ExpectedTimesExactly(4);
+
+	// act
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_060: [ If any of the device resources cannot be created then IoTHubTransportMqtt_Register shall fail and return NULL.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_mqtt_client_init_fails_returns_null)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	mocks.ResetAllCalls();
+
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)).ExpectedTimesExactly(4);
+	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_MESSAGE_TOPIC));
+	EXPECTED_CALL(mocks, mqtt_client_init(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn((MQTT_CLIENT_HANDLE)NULL);
+	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)).ExpectedTimesExactly(6);
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).ExpectedTimesExactly(4);
+
+	// act
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_060: [ If any of the device resources cannot be created then IoTHubTransportMqtt_Register shall fail and return NULL.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_username_construct_fails_returns_null)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	mocks.ResetAllCalls();
+
+	currentSTRING_construct_call = 0;
+	whenShallSTRING_construct_fail = 6;
+
+	EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)).ExpectedTimesExactly(5);
+	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_SAS_TOKEN));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_MESSAGE_TOPIC));
+	EXPECTED_CALL(mocks, mqtt_client_init(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_deinit(TEST_MQTT_CLIENT_HANDLE));
+	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)).ExpectedTimesExactly(6);
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).ExpectedTimesExactly(5);
+
+	// act
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_003: [ IoTHubTransportMqtt_Register shall return NULL if a device with the same deviceId is already registered with the transport.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_twice_fails_second_time)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+
+	mocks.ResetAllCalls();
+
+	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+
+	// act
+	auto devHandle2 = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+
+	// assert
+	ASSERT_IS_NOT_NULL(devHandle);
+	ASSERT_IS_NULL(devHandle2);
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_063: [ IoTHubTransportMqtt_Register shall add the device to the devices served by IoTHubTransportMqtt_DoWork.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_second_device_succeeds)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	IOTHUB_DEVICE_CONFIG deviceConfig = { TEST_DEVICE_ID_2, TEST_DEVICE_KEY, NULL };
+	DLIST_ENTRY waitingToSend2;
+	DList_InitializeListHead(&waitingToSend2);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+
+	// act
+	auto devHandle2 = IoTHubTransportMqtt_Register(handle, &deviceConfig, TEST_IOTHUB_CLIENT_LL_HANDLE_2, &waitingToSend2);
+
+	// assert
+	ASSERT_IS_NOT_NULL(devHandle);
+	ASSERT_IS_NOT_NULL(devHandle2);
+	ASSERT_ARE_NOT_EQUAL(void_ptr, devHandle, devHandle2);
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_057: [ IoTHubTransportMqtt_Register shall return NULL if deviceId is an empty string or its length is greater than 128.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_very_long_device_id_returns_null)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	IOTHUB_DEVICE_CONFIG deviceConfig = { TEST_VERY_LONG_DEVICE_ID, TEST_DEVICE_KEY, NULL };
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	mocks.ResetAllCalls();
+
+	// act
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &deviceConfig, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_057: [ IoTHubTransportMqtt_Register shall return NULL if deviceId is an empty string or its length is greater than 128.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_empty_device_id_returns_null)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	IOTHUB_DEVICE_CONFIG deviceConfig = { TEST_EMPTY_STRING, TEST_DEVICE_KEY, NULL };
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	mocks.ResetAllCalls();
+
+	// act
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &deviceConfig, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_058: [ IoTHubTransportMqtt_Register shall return NULL if deviceKey or deviceSasToken is an empty string.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_empty_device_key_returns_null)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	IOTHUB_DEVICE_CONFIG deviceConfig = { TEST_DEVICE_ID, TEST_EMPTY_STRING, NULL };
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	mocks.ResetAllCalls();
+
+	// act
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &deviceConfig, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+
+	// assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_002: [ IoTHubTransportMqtt_Register shall return NULL if device or waitingToSend are NULL.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_wts_null_returns_null)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	mocks.ResetAllCalls();
+
+	// act
 	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, NULL);
 
 	// assert
@@ -3512,7 +3935,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_Register_deviceKey_and_deviceSasToken_both_pro
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-// SRS_IOTHUB_MQTT_TRANSPORT_17_004: [IoTHubTransportMqtt_Register shall return the TRANSPORT_LL_HANDLE as the IOTHUB_DEVICE_HANDLE.]
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_004: [ IoTHubTransportMqtt_Register shall return the state of the device as the IOTHUB_DEVICE_HANDLE. ]
 TEST_FUNCTION(IoTHubTransportMqtt_Register_deviceKey_null_and_deviceSas_valid_succeeds)
 {
     // arrange
@@ -3524,7 +3947,17 @@ TEST_FUNCTION(IoTHubTransportMqtt_Register_deviceKey_null_and_deviceSas_valid_su
     auto handle = IoTHubTransportMqtt_Create(&config);
     mocks.ResetAllCalls();
 
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)).ExpectedTimesExactly(4);
     EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_ID));
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_SAS));
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_MESSAGE_TOPIC));
+    EXPECTED_CALL(mocks, mqtt_client_init(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG)).IgnoreArgument(1);
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).ExpectedTimesExactly(3);
 
     // act
     auto devHandle = IoTHubTransportMqtt_Register(handle, &deviceConfig, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
@@ -3559,7 +3992,20 @@ TEST_FUNCTION(IoTHubTransportMqtt_Register_transport_null_returns_null)
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_005: [ IoTHubTransportMqtt_Unregister shall return. ]
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_005: [ IoTHubTransportMqtt_Unregister shall do nothing if deviceHandle is NULL. ]
+TEST_FUNCTION(IoTHubTransportMqtt_Unregister_NULL_does_nothing)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+
+	// act
+	IoTHubTransportMqtt_Unregister(NULL);
+
+	// assert
+	mocks.AssertActualAndExpectedCalls();
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_064: [ IoTHubTransportMqtt_Unregister shall disconnect the device, fail its messages waiting for PUBACK, remove it from the transport and free its resources. ]
 TEST_FUNCTION(IoTHubTransportMqtt_Unregister_succeeds)
 {
 	// arrange
@@ -3572,6 +4018,13 @@ TEST_FUNCTION(IoTHubTransportMqtt_Unregister_succeeds)
 
 	mocks.ResetAllCalls();
 
+	EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_disconnect(TEST_MQTT_CLIENT_HANDLE));
+	EXPECTED_CALL(mocks, xio_destroy(NULL));
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_deinit(TEST_MQTT_CLIENT_HANDLE));
+	EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)).ExpectedTimesExactly(6);
+	EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
 	// act
 	IoTHubTransportMqtt_Unregister(devHandle);
@@ -3583,8 +4036,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_Unregister_succeeds)
 	IoTHubTransportMqtt_Destroy(handle);
 }
 
-// Tests_SRS_IOTHUB_MQTT_TRANSPORT_17_004: [ IoTHubTransportMqtt_Register shall return the TRANSPORT_LL_HANDLE as the IOTHUB_DEVICE_HANDLE. ]
-TEST_FUNCTION(IoTHubTransportMqtt_Register_Unregister_Register_returns_handle)
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_064: [ IoTHubTransportMqtt_Unregister shall disconnect the device, fail its messages waiting for PUBACK, remove it from the transport and free its resources. ]
+TEST_FUNCTION(IoTHubTransportMqtt_Unregister_Register_Register_returns_handle)
 {
 	// arrange
 	CIoTHubTransportMqttMocks mocks;
@@ -3595,17 +4048,94 @@ TEST_FUNCTION(IoTHubTransportMqtt_Register_Unregister_Register_returns_handle)
 	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
 	IoTHubTransportMqtt_Unregister(devHandle);
 
+	// act
+	auto devHandle2 = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+
+	// assert
+	ASSERT_IS_NOT_NULL(devHandle2);
+	ASSERT_ARE_NOT_EQUAL(void_ptr, handle, devHandle2);
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_056: [ IoTHubTransportMqtt_DoWork shall connect, publish and call mqtt_client_dowork for every registered device, starting with the device that follows the one the previous call started with.]
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_serves_every_registered_device)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+	IOTHUB_DEVICE_CONFIG deviceConfig = { TEST_DEVICE_ID_2, TEST_DEVICE_KEY, NULL };
+	DLIST_ENTRY waitingToSend2;
+	DList_InitializeListHead(&waitingToSend2);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	(void)IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+	(void)IoTHubTransportMqtt_Register(handle, &deviceConfig, TEST_IOTHUB_CLIENT_LL_HANDLE_2, &waitingToSend2);
 	mocks.ResetAllCalls();
 
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).ExpectedAtLeastTimes(6).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_dowork(TEST_MQTT_CLIENT_HANDLE)).ExpectedTimesExactly(2);
+	SetupMocksForInitConnection(mocks);
+	SetupMocksForInitConnection(mocks);
 
 	// act
-	auto devHandle2 = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
+	IoTHubTransportMqtt_DoWork(handle, NULL);
+
+	//assert
+	mocks.AssertActualAndExpectedCalls();
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_061: [ The "logtrace" option shall apply to the MQTT client of every registered device and of the devices registered later.]
+TEST_FUNCTION(IoTHubTransportMqtt_Register_after_logtrace_sets_trace)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	bool traceOn = true;
+	(void)IoTHubTransportMqtt_SetOption(handle, LOG_TRACE_OPTION, &traceOn);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, mqtt_client_set_trace(TEST_MQTT_CLIENT_HANDLE, true, true));
+
+	// act
+	auto devHandle = IoTHubTransportMqtt_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, config.waitingToSend);
 
 	// assert
-	ASSERT_IS_NOT_NULL(devHandle2);
-	ASSERT_ARE_EQUAL(void_ptr, handle, devHandle2);
+	ASSERT_IS_NOT_NULL(devHandle);
+
+	//cleanup
+	IoTHubTransportMqtt_Destroy(handle);
+}
+
+// Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_062: [ If no device is registered IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_ERROR for an option that is not a known option string for the MQTT transport.]
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_xio_option_without_devices_fails)
+{
+	// arrange
+	CIoTHubTransportMqttMocks mocks;
+	IOTHUBTRANSPORT_CONFIG config = { 0 };
+	SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+	const char* SOME_OPTION = "AnOption";
+	const void* SOME_VALUE = (void*)42;
+
+	auto handle = IoTHubTransportMqtt_Create(&config);
+	mocks.ResetAllCalls();
+
+	EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+
+	// act
+	auto result = IoTHubTransportMqtt_SetOption(handle, SOME_OPTION, SOME_VALUE);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	//cleanup
@@ -0,0 +1,114 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <cstdio>
+#include <cstring>
+
+#include "testrunnerswitcher.h"
+
+#include "messagestore.h"
+
+#include "azure_c_shared_utility/tickcounter.h"
+
+#define PERF_STORE_PATH "messagestore_perftests_store"
+#define RECORD_COUNT 20000
+#define RECORD_SIZE 256 /*about the size of a serialized telemetry event*/
+#define SEGMENT_SIZE (1024 * 1024)
+#define MAX_PERF_SEGMENTS 64
+
+static void removeStoreFiles(void)
+{
+    char name[sizeof(PERF_STORE_PATH) + 16];
+    unsigned long i;
+    for (i = 0; i < MAX_PERF_SEGMENTS; i++)
+    {
+        (void)sprintf(name, "%s.%lu", PERF_STORE_PATH, i);
+        (void)remove(name);
+    }
+    (void)remove(PERF_STORE_PATH ".head");
+}
+
+static double recordsPerSecond(size_t count, uint64_t elapsedMs)
+{
+    return (elapsedMs == 0) ? (double)count * 1000 : (double)count * 1000 / elapsedMs;
+}
+
+BEGIN_TEST_SUITE(messagestore_perftests)
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        removeStoreFiles();
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        removeStoreFiles();
+    }
+
+    /*appends RECORD_COUNT records the way IoTHubClient_LL does during an outage, then replays them from a new store the way
+    IoTHubClient_LL does once it is restarted and connected again, confirming every record*/
+    TEST_FUNCTION(MessageStore_append_and_replay_throughput)
+    {
+        // arrange
+        TICK_COUNTER_HANDLE tickCounter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tickCounter);
+        unsigned char record[RECORD_SIZE];
+        MESSAGESTORE_HANDLE store = MessageStore_Create(PERF_STORE_PATH, SEGMENT_SIZE);
+        ASSERT_IS_NOT_NULL(store);
+        MESSAGESTORE_RECORD readRecord;
+        uint64_t start;
+        uint64_t appended;
+        uint64_t replayed;
+        size_t failedAppends = 0;
+        size_t replayedInOrder = 0;
+        size_t i;
+        (void)memset(record, 'x', sizeof(record));
+
+        // act
+        (void)tickcounter_get_current_ms(tickCounter, &start);
+        for (i = 0; i < RECORD_COUNT; i++)
+        {
+            (void)memcpy(record, &i, sizeof(i));
+            if (MessageStore_Append(store, record, sizeof(record)) != 0)
+            {
+                failedAppends++;
+            }
+        }
+        MessageStore_Destroy(store);
+        (void)tickcounter_get_current_ms(tickCounter, &appended);
+
+        store = MessageStore_Create(PERF_STORE_PATH, SEGMENT_SIZE);
+        ASSERT_IS_NOT_NULL(store);
+        while (MessageStore_ReadNext(store, &readRecord) == 0)
+        {
+            if ((readRecord.size == sizeof(record)) && (memcmp(readRecord.data, &replayedInOrder, sizeof(replayedInOrder)) == 0))
+            {
+                replayedInOrder++;
+            }
+            MessageStore_Confirm(store, readRecord.segment);
+        }
+        MessageStore_Destroy(store);
+        (void)tickcounter_get_current_ms(tickCounter, &replayed);
+
+        (void)printf("%d records of %d bytes, segments of %d bytes: append %.0f records/s, replay %.0f records/s\r\n",
+            RECORD_COUNT, RECORD_SIZE, SEGMENT_SIZE,
+            recordsPerSecond(RECORD_COUNT, appended - start),
+            recordsPerSecond(replayedInOrder, replayed - appended));
+
+        // assert
+        ASSERT_ARE_EQUAL(size_t, 0, failedAppends);
+        ASSERT_ARE_EQUAL(size_t, RECORD_COUNT, replayedInOrder);
+        store = MessageStore_Create(PERF_STORE_PATH, SEGMENT_SIZE);
+        ASSERT_IS_NOT_NULL(store);
+        ASSERT_IS_TRUE(MessageStore_IsEmpty(store));
+
+        // cleanup
+        MessageStore_Destroy(store);
+        tickcounter_destroy(tickCounter);
+    }
+
+END_TEST_SUITE(messagestore_perftests)
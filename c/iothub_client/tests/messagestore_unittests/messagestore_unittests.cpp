@@ -0,0 +1,505 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <cstdio>
+#include <cstring>
+
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "messagestore.h"
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+/*the tests work on real files in the current directory*/
+#define TEST_STORE_PATH "messagestore_unittests_store"
+#define TEST_SEGMENT_SIZE 1024
+#define MAX_TEST_SEGMENTS 64
+
+static const char* segmentName(unsigned long number)
+{
+    static char name[sizeof(TEST_STORE_PATH) + 16];
+    (void)sprintf(name, "%s.%lu", TEST_STORE_PATH, number);
+    return name;
+}
+
+static bool fileExists(const char* name)
+{
+    FILE* file = fopen(name, "rb");
+    if (file != NULL)
+    {
+        (void)fclose(file);
+    }
+    return file != NULL;
+}
+
+static long fileSize(const char* name)
+{
+    long result;
+    FILE* file = fopen(name, "rb");
+    if (file == NULL)
+    {
+        result = -1;
+    }
+    else
+    {
+        result = ((fseek(file, 0, SEEK_END) == 0) ? ftell(file) : -1);
+        (void)fclose(file);
+    }
+    return result;
+}
+
+static void removeStoreFiles(void)
+{
+    unsigned long i;
+    for (i = 0; i < MAX_TEST_SEGMENTS; i++)
+    {
+        (void)remove(segmentName(i));
+    }
+    (void)remove(TEST_STORE_PATH ".head");
+}
+
+static void appendText(MESSAGESTORE_HANDLE store, const char* text)
+{
+    ASSERT_ARE_EQUAL(int, 0, MessageStore_Append(store, (const unsigned char*)text, strlen(text)));
+}
+
+static void assertReadText(MESSAGESTORE_HANDLE store, const char* text, bool appendedByThisStore, MESSAGESTORE_SEGMENT_HANDLE* segment)
+{
+    MESSAGESTORE_RECORD record;
+    ASSERT_ARE_EQUAL(int, 0, MessageStore_ReadNext(store, &record));
+    ASSERT_ARE_EQUAL(size_t, strlen(text), record.size);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(text, record.data, record.size));
+    ASSERT_ARE_EQUAL(int, (int)appendedByThisStore, (int)record.appendedByThisStore);
+    ASSERT_IS_NOT_NULL(record.segment);
+    if (segment != NULL)
+    {
+        *segment = record.segment;
+    }
+}
+
+BEGIN_TEST_SUITE(messagestore_unittests)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+        removeStoreFiles();
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        removeStoreFiles();
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_001: [ If path is NULL or segmentSize is 0 then MessageStore_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(MessageStore_Create_with_NULL_path_fails)
+    {
+        ///act
+        MESSAGESTORE_HANDLE store = MessageStore_Create(NULL, TEST_SEGMENT_SIZE);
+
+        ///assert
+        ASSERT_IS_NULL(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_001: [ If path is NULL or segmentSize is 0 then MessageStore_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(MessageStore_Create_with_0_segmentSize_fails)
+    {
+        ///act
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, 0);
+
+        ///assert
+        ASSERT_IS_NULL(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_005: [ Otherwise MessageStore_Create shall succeed and return a non-NULL handle. ]*/
+    /*Tests_SRS_MESSAGESTORE_02_015: [ If every record has been read then MessageStore_ReadNext shall return a non-zero value. ]*/
+    TEST_FUNCTION(MessageStore_Create_on_a_new_path_makes_an_empty_store)
+    {
+        ///arrange
+        MESSAGESTORE_RECORD record;
+
+        ///act
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(store);
+        ASSERT_IS_TRUE(MessageStore_IsEmpty(store));
+        ASSERT_ARE_NOT_EQUAL(int, 0, MessageStore_ReadNext(store, &record));
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_006: [ If store is NULL then MessageStore_Destroy shall do nothing. ]*/
+    TEST_FUNCTION(MessageStore_Destroy_with_NULL_store_does_nothing)
+    {
+        ///act
+        MessageStore_Destroy(NULL);
+
+        ///assert - no crash
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_008: [ If store is NULL, or data is NULL while size is not 0, then MessageStore_Append shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MessageStore_Append_with_NULL_store_fails)
+    {
+        ///act
+        int result = MessageStore_Append(NULL, (const unsigned char*)"a", 1);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_008: [ If store is NULL, or data is NULL while size is not 0, then MessageStore_Append shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MessageStore_Append_with_NULL_data_and_non_zero_size_fails)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+
+        ///act
+        int result = MessageStore_Append(store, NULL, 1);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_IS_TRUE(MessageStore_IsEmpty(store));
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_012: [ MessageStore_Append shall write size, 4 bytes little endian, followed by the size bytes of data at the end of the newest segment. ]*/
+    /*Tests_SRS_MESSAGESTORE_02_013: [ Otherwise MessageStore_Append shall succeed and return 0. ]*/
+    /*Tests_SRS_MESSAGESTORE_02_017: [ Otherwise MessageStore_ReadNext shall fill record with the oldest record that was not read yet and return 0. record->data shall be valid until the next call to MessageStore_ReadNext. ]*/
+    /*Tests_SRS_MESSAGESTORE_02_018: [ record->appendedByThisStore shall be false for the records found in the files by MessageStore_Create and true for the records appended by MessageStore_Append. ]*/
+    /*Tests_SRS_MESSAGESTORE_02_020: [ Otherwise MessageStore_IsEmpty shall return true if every record has been read and false otherwise. ]*/
+    TEST_FUNCTION(MessageStore_ReadNext_returns_the_appended_records_in_order)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+        MESSAGESTORE_RECORD record;
+        appendText(store, "first");
+        ASSERT_ARE_EQUAL(int, 0, MessageStore_Append(store, NULL, 0));
+        appendText(store, "third");
+
+        ///act and assert
+        ASSERT_IS_FALSE(MessageStore_IsEmpty(store));
+        assertReadText(store, "first", true, NULL);
+        assertReadText(store, "", true, NULL);
+        assertReadText(store, "third", true, NULL);
+        ASSERT_IS_TRUE(MessageStore_IsEmpty(store));
+        ASSERT_ARE_NOT_EQUAL(int, 0, MessageStore_ReadNext(store, &record));
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_017: [ Otherwise MessageStore_ReadNext shall fill record with the oldest record that was not read yet and return 0. record->data shall be valid until the next call to MessageStore_ReadNext. ]*/
+    TEST_FUNCTION(MessageStore_ReadNext_returns_records_appended_between_reads)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+        appendText(store, "1");
+        assertReadText(store, "1", true, NULL);
+
+        ///act
+        appendText(store, "2");
+
+        ///assert
+        ASSERT_IS_FALSE(MessageStore_IsEmpty(store));
+        assertReadText(store, "2", true, NULL);
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_025: [ Once "syncInterval" records have been appended since the last sync, MessageStore_Append shall flush the newest segment and wait for the operating system to write it to the disk (fsync, or _commit on Windows). ]*/
+    /*Tests_SRS_MESSAGESTORE_02_027: [ Otherwise MessageStore_SetSyncInterval shall set after how many appended records the newest segment is synced to the disk, 0 leaving it to the operating system, and return 0. The default is 1, every record. ]*/
+    TEST_FUNCTION(MessageStore_Append_writes_the_record_to_the_segment_file_before_returning)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+
+        ///act
+        appendText(store, "abc");
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 4 + 3, (int)fileSize(segmentName(0)));
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_025: [ Once "syncInterval" records have been appended since the last sync, MessageStore_Append shall flush the newest segment and wait for the operating system to write it to the disk (fsync, or _commit on Windows). ]*/
+    /*Tests_SRS_MESSAGESTORE_02_027: [ Otherwise MessageStore_SetSyncInterval shall set after how many appended records the newest segment is synced to the disk, 0 leaving it to the operating system, and return 0. The default is 1, every record. ]*/
+    TEST_FUNCTION(MessageStore_Append_with_a_syncInterval_of_2_writes_the_records_to_the_segment_file_every_2_records)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+        ASSERT_ARE_EQUAL(int, 0, MessageStore_SetSyncInterval(store, 2));
+
+        ///act
+        appendText(store, "1");
+        appendText(store, "2");
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 2 * (4 + 1), (int)fileSize(segmentName(0)));
+        assertReadText(store, "1", true, NULL);
+        assertReadText(store, "2", true, NULL);
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_026: [ If store is NULL then MessageStore_SetSyncInterval shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MessageStore_SetSyncInterval_with_NULL_store_fails)
+    {
+        ///act
+        int result = MessageStore_SetSyncInterval(NULL, 1);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_014: [ If store or record is NULL then MessageStore_ReadNext shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MessageStore_ReadNext_with_NULL_store_fails)
+    {
+        ///arrange
+        MESSAGESTORE_RECORD record;
+
+        ///act
+        int result = MessageStore_ReadNext(NULL, &record);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_014: [ If store or record is NULL then MessageStore_ReadNext shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MessageStore_ReadNext_with_NULL_record_fails)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+        appendText(store, "1");
+
+        ///act
+        int result = MessageStore_ReadNext(store, NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_IS_FALSE(MessageStore_IsEmpty(store));
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_019: [ If store is NULL then MessageStore_IsEmpty shall return true. ]*/
+    TEST_FUNCTION(MessageStore_IsEmpty_with_NULL_store_returns_true)
+    {
+        ///act
+        bool result = MessageStore_IsEmpty(NULL);
+
+        ///assert
+        ASSERT_IS_TRUE(result);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_021: [ If store or segment is NULL then MessageStore_Confirm shall do nothing. ]*/
+    TEST_FUNCTION(MessageStore_Confirm_with_NULL_arguments_does_nothing)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+        MESSAGESTORE_SEGMENT_HANDLE segment;
+        appendText(store, "1");
+        assertReadText(store, "1", true, &segment);
+
+        ///act
+        MessageStore_Confirm(NULL, segment);
+        MessageStore_Confirm(store, NULL);
+
+        ///assert - no crash
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_010: [ If appending the record would make a segment that already has records bigger than segmentSize then MessageStore_Append shall start a new segment. ]*/
+    TEST_FUNCTION(MessageStore_Append_starts_a_new_segment_when_the_newest_one_is_full)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, 10);
+
+        ///act
+        appendText(store, "0123"); /*8 bytes in segment 0*/
+        appendText(store, "4567"); /*would make 16 bytes, goes to segment 1*/
+        appendText(store, "0123456789ABCDEF"); /*bigger than a segment, goes alone in segment 2*/
+
+        ///assert
+        ASSERT_IS_TRUE(fileExists(segmentName(0)));
+        ASSERT_IS_TRUE(fileExists(segmentName(1)));
+        ASSERT_IS_TRUE(fileExists(segmentName(2)));
+        assertReadText(store, "0123", true, NULL);
+        assertReadText(store, "4567", true, NULL);
+        assertReadText(store, "0123456789ABCDEF", true, NULL);
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_022: [ MessageStore_Confirm shall count one more confirmed record in segment. ]*/
+    /*Tests_SRS_MESSAGESTORE_02_023: [ MessageStore_Confirm shall then delete, oldest first, every segment but the newest whose records have all been read and confirmed, saving the number of the oldest remaining segment in "path.head" before deleting a segment. ]*/
+    TEST_FUNCTION(MessageStore_Confirm_deletes_the_segments_whose_records_are_all_confirmed)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, 10);
+        MESSAGESTORE_SEGMENT_HANDLE segment0;
+        MESSAGESTORE_SEGMENT_HANDLE segment1;
+        MESSAGESTORE_SEGMENT_HANDLE segment2;
+        appendText(store, "0123");
+        appendText(store, "4567");
+        appendText(store, "89AB");
+        assertReadText(store, "0123", true, &segment0);
+        assertReadText(store, "4567", true, &segment1);
+        assertReadText(store, "89AB", true, &segment2);
+
+        ///act
+        MessageStore_Confirm(store, segment1);
+
+        ///assert - segment 0 is not confirmed yet, nothing can be deleted
+        ASSERT_IS_TRUE(fileExists(segmentName(0)));
+        ASSERT_IS_TRUE(fileExists(segmentName(1)));
+
+        ///act
+        MessageStore_Confirm(store, segment0);
+        MessageStore_Confirm(store, segment2);
+
+        ///assert - the newest segment is kept for the next records
+        ASSERT_IS_FALSE(fileExists(segmentName(0)));
+        ASSERT_IS_FALSE(fileExists(segmentName(1)));
+        ASSERT_IS_TRUE(fileExists(segmentName(2)));
+        ASSERT_IS_TRUE(fileExists(TEST_STORE_PATH ".head"));
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_003: [ MessageStore_Create shall find the segments of an existing store, starting from the segment number saved in "path.head" (0 if there is no such file) up to the first missing segment, and shall make their complete records available to MessageStore_ReadNext. ]*/
+    /*Tests_SRS_MESSAGESTORE_02_007: [ MessageStore_Destroy shall close the files of the store and free all the resources used by store. The records that were not confirmed shall stay in the files. ]*/
+    /*Tests_SRS_MESSAGESTORE_02_018: [ record->appendedByThisStore shall be false for the records found in the files by MessageStore_Create and true for the records appended by MessageStore_Append. ]*/
+    TEST_FUNCTION(MessageStore_Create_reads_the_records_left_by_a_previous_store)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, 10);
+        MESSAGESTORE_SEGMENT_HANDLE segment;
+        appendText(store, "0123");
+        appendText(store, "4567");
+        appendText(store, "89AB");
+        assertReadText(store, "0123", true, &segment);
+        MessageStore_Confirm(store, segment);
+        MessageStore_Destroy(store);
+
+        ///act
+        store = MessageStore_Create(TEST_STORE_PATH, 10);
+        appendText(store, "CDEF");
+
+        ///assert
+        ASSERT_IS_NOT_NULL(store);
+        assertReadText(store, "4567", false, NULL);
+        assertReadText(store, "89AB", false, NULL);
+        assertReadText(store, "CDEF", true, NULL);
+        ASSERT_IS_TRUE(MessageStore_IsEmpty(store));
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_003: [ MessageStore_Create shall find the segments of an existing store, starting from the segment number saved in "path.head" (0 if there is no such file) up to the first missing segment, and shall make their complete records available to MessageStore_ReadNext. ]*/
+    TEST_FUNCTION(MessageStore_Create_reads_again_the_records_that_were_read_but_not_confirmed)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+        appendText(store, "1");
+        assertReadText(store, "1", true, NULL);
+        MessageStore_Destroy(store);
+
+        ///act
+        store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+
+        ///assert
+        ASSERT_IS_FALSE(MessageStore_IsEmpty(store));
+        assertReadText(store, "1", false, NULL);
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_024: [ If every record of the store has been read and confirmed, MessageStore_Destroy shall delete the newest segment too. ]*/
+    TEST_FUNCTION(MessageStore_Destroy_deletes_every_segment_when_all_records_are_confirmed)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+        MESSAGESTORE_SEGMENT_HANDLE segment;
+        appendText(store, "1");
+        assertReadText(store, "1", true, &segment);
+        MessageStore_Confirm(store, segment);
+
+        ///act
+        MessageStore_Destroy(store);
+
+        ///assert
+        ASSERT_IS_FALSE(fileExists(segmentName(0)));
+        store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+        ASSERT_IS_TRUE(MessageStore_IsEmpty(store));
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+    /*Tests_SRS_MESSAGESTORE_02_004: [ MessageStore_Create shall append the new records to a new segment, so that records cut short by the end of a previous process are never followed by new records. ]*/
+    TEST_FUNCTION(MessageStore_Create_ignores_a_record_cut_short)
+    {
+        ///arrange
+        MESSAGESTORE_HANDLE store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+        const unsigned char cutShort[] = { 100, 0, 0, 0, 'a', 'b' }; /*announces 100 bytes, has 2*/
+        FILE* segment;
+        appendText(store, "complete");
+        MessageStore_Destroy(store);
+        segment = fopen(segmentName(0), "ab");
+        ASSERT_IS_NOT_NULL(segment);
+        ASSERT_ARE_EQUAL(size_t, sizeof(cutShort), fwrite(cutShort, 1, sizeof(cutShort), segment));
+        (void)fclose(segment);
+
+        ///act
+        store = MessageStore_Create(TEST_STORE_PATH, TEST_SEGMENT_SIZE);
+        appendText(store, "new");
+
+        ///assert
+        assertReadText(store, "complete", false, NULL);
+        assertReadText(store, "new", true, NULL);
+        ASSERT_IS_TRUE(MessageStore_IsEmpty(store));
+
+        ///cleanup
+        MessageStore_Destroy(store);
+    }
+
+END_TEST_SUITE(messagestore_unittests)
@@ -0,0 +1,274 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#include <cstddef>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "mpscqueue.h"
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+typedef struct TEST_ITEM_TAG
+{
+    int value;
+    MPSC_QUEUE_ENTRY entry;
+} TEST_ITEM;
+
+#define TEST_ITEM_FROM_ENTRY(e) ((TEST_ITEM*)((char*)(e) - offsetof(TEST_ITEM, entry)))
+
+BEGIN_TEST_SUITE(mpscqueue_unittests)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_001: [ If queue is NULL then MpscQueue_Initialize shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MpscQueue_Initialize_with_NULL_queue_fails)
+    {
+        ///act
+        int result = MpscQueue_Initialize(NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_002: [ Otherwise MpscQueue_Initialize shall make queue empty and return 0. ]*/
+    /*Tests_SRS_MPSCQUEUE_02_009: [ Otherwise MpscQueue_IsEmpty shall return true if queue has no entries and false otherwise. ]*/
+    TEST_FUNCTION(MpscQueue_Initialize_makes_the_queue_empty)
+    {
+        ///arrange
+        MPSC_QUEUE queue;
+        queue.head = (MPSC_QUEUE_ENTRY*)0x42;
+
+        ///act
+        int result = MpscQueue_Initialize(&queue);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_IS_TRUE(MpscQueue_IsEmpty(&queue));
+        ASSERT_IS_NULL(MpscQueue_PopAll(&queue));
+
+        ///cleanup
+        MpscQueue_Deinitialize(&queue);
+    }
+
+    /* MpscQueue_Deinitialize */
+
+    /*Tests_SRS_MPSCQUEUE_02_011: [ If queue is NULL then MpscQueue_Deinitialize shall do nothing. ]*/
+    TEST_FUNCTION(MpscQueue_Deinitialize_with_NULL_queue_does_nothing)
+    {
+        ///act
+        MpscQueue_Deinitialize(NULL);
+
+        ///assert - no crash
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_003: [ If queue or entry is NULL then MpscQueue_Push shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MpscQueue_Push_with_NULL_queue_fails)
+    {
+        ///arrange
+        TEST_ITEM item;
+        item.entry.next = (MPSC_QUEUE_ENTRY*)0x42;
+
+        ///act
+        int result = MpscQueue_Push(NULL, &item.entry);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(void_ptr, (void*)0x42, item.entry.next);
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_003: [ If queue or entry is NULL then MpscQueue_Push shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(MpscQueue_Push_with_NULL_entry_fails)
+    {
+        ///arrange
+        MPSC_QUEUE queue;
+        MpscQueue_Initialize(&queue);
+
+        ///act
+        int result = MpscQueue_Push(&queue, NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        ASSERT_IS_TRUE(MpscQueue_IsEmpty(&queue));
+
+        ///cleanup
+        MpscQueue_Deinitialize(&queue);
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_004: [ MpscQueue_Push shall append entry to queue without taking any lock, retrying with the latest head of the queue until its compare-and-swap succeeds, and return 0. ]*/
+    /*Tests_SRS_MPSCQUEUE_02_009: [ Otherwise MpscQueue_IsEmpty shall return true if queue has no entries and false otherwise. ]*/
+    TEST_FUNCTION(MpscQueue_Push_makes_the_queue_not_empty)
+    {
+        ///arrange
+        MPSC_QUEUE queue;
+        TEST_ITEM item;
+        MpscQueue_Initialize(&queue);
+
+        ///act
+        int result = MpscQueue_Push(&queue, &item.entry);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_IS_FALSE(MpscQueue_IsEmpty(&queue));
+
+        ///cleanup
+        MpscQueue_Deinitialize(&queue);
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_005: [ If queue is NULL then MpscQueue_PopAll shall return NULL. ]*/
+    TEST_FUNCTION(MpscQueue_PopAll_with_NULL_queue_returns_NULL)
+    {
+        ///act
+        MPSC_QUEUE_ENTRY* result = MpscQueue_PopAll(NULL);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_007: [ MpscQueue_PopAll shall return the entries it took linked through their next field in the order they were pushed, the last one having a NULL next, or NULL if queue was empty. ]*/
+    TEST_FUNCTION(MpscQueue_PopAll_on_an_empty_queue_returns_NULL)
+    {
+        ///arrange
+        MPSC_QUEUE queue;
+        MpscQueue_Initialize(&queue);
+
+        ///act
+        MPSC_QUEUE_ENTRY* result = MpscQueue_PopAll(&queue);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+        ASSERT_IS_TRUE(MpscQueue_IsEmpty(&queue));
+
+        ///cleanup
+        MpscQueue_Deinitialize(&queue);
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_006: [ MpscQueue_PopAll shall atomically take all the entries out of queue, leaving it empty. ]*/
+    /*Tests_SRS_MPSCQUEUE_02_007: [ MpscQueue_PopAll shall return the entries it took linked through their next field in the order they were pushed, the last one having a NULL next, or NULL if queue was empty. ]*/
+    TEST_FUNCTION(MpscQueue_PopAll_with_1_entry_returns_it)
+    {
+        ///arrange
+        MPSC_QUEUE queue;
+        TEST_ITEM item;
+        item.value = 1;
+        MpscQueue_Initialize(&queue);
+        MpscQueue_Push(&queue, &item.entry);
+
+        ///act
+        MPSC_QUEUE_ENTRY* result = MpscQueue_PopAll(&queue);
+
+        ///assert
+        ASSERT_ARE_EQUAL(void_ptr, &item.entry, result);
+        ASSERT_IS_NULL(result->next);
+        ASSERT_ARE_EQUAL(int, 1, TEST_ITEM_FROM_ENTRY(result)->value);
+        ASSERT_IS_TRUE(MpscQueue_IsEmpty(&queue));
+
+        ///cleanup
+        MpscQueue_Deinitialize(&queue);
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_006: [ MpscQueue_PopAll shall atomically take all the entries out of queue, leaving it empty. ]*/
+    /*Tests_SRS_MPSCQUEUE_02_007: [ MpscQueue_PopAll shall return the entries it took linked through their next field in the order they were pushed, the last one having a NULL next, or NULL if queue was empty. ]*/
+    TEST_FUNCTION(MpscQueue_PopAll_returns_the_entries_in_the_order_they_were_pushed)
+    {
+        ///arrange
+        MPSC_QUEUE queue;
+        TEST_ITEM items[10];
+        int i;
+        MpscQueue_Initialize(&queue);
+        for (i = 0; i < 10; i++)
+        {
+            items[i].value = i;
+            MpscQueue_Push(&queue, &items[i].entry);
+        }
+
+        ///act
+        MPSC_QUEUE_ENTRY* result = MpscQueue_PopAll(&queue);
+
+        ///assert
+        for (i = 0; i < 10; i++)
+        {
+            ASSERT_IS_NOT_NULL(result);
+            ASSERT_ARE_EQUAL(int, i, TEST_ITEM_FROM_ENTRY(result)->value);
+            result = result->next;
+        }
+        ASSERT_IS_NULL(result);
+        ASSERT_IS_TRUE(MpscQueue_IsEmpty(&queue));
+
+        ///cleanup
+        MpscQueue_Deinitialize(&queue);
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_007: [ MpscQueue_PopAll shall return the entries it took linked through their next field in the order they were pushed, the last one having a NULL next, or NULL if queue was empty. ]*/
+    TEST_FUNCTION(MpscQueue_PopAll_only_returns_the_entries_pushed_since_the_previous_PopAll)
+    {
+        ///arrange
+        MPSC_QUEUE queue;
+        TEST_ITEM items[4];
+        int i;
+        MpscQueue_Initialize(&queue);
+        for (i = 0; i < 4; i++)
+        {
+            items[i].value = i;
+        }
+        MpscQueue_Push(&queue, &items[0].entry);
+        MpscQueue_Push(&queue, &items[1].entry);
+        (void)MpscQueue_PopAll(&queue);
+        MpscQueue_Push(&queue, &items[2].entry);
+        MpscQueue_Push(&queue, &items[3].entry);
+
+        ///act
+        MPSC_QUEUE_ENTRY* result = MpscQueue_PopAll(&queue);
+
+        ///assert
+        ASSERT_ARE_EQUAL(void_ptr, &items[2].entry, result);
+        ASSERT_ARE_EQUAL(void_ptr, &items[3].entry, result->next);
+        ASSERT_IS_NULL(result->next->next);
+
+        ///cleanup
+        MpscQueue_Deinitialize(&queue);
+    }
+
+    /*Tests_SRS_MPSCQUEUE_02_008: [ If queue is NULL then MpscQueue_IsEmpty shall return true. ]*/
+    TEST_FUNCTION(MpscQueue_IsEmpty_with_NULL_queue_returns_true)
+    {
+        ///act
+        bool result = MpscQueue_IsEmpty(NULL);
+
+        ///assert
+        ASSERT_IS_TRUE(result);
+    }
+
+END_TEST_SUITE(mpscqueue_unittests)
@@ -0,0 +1,641 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "micromockcharstararenullterminatedstrings.h"
+#include "nodepool.h"
+#include "azure_c_shared_utility/lock.h"
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+
+#define GBALLOC_H
+
+extern "C" int gballoc_init(void);
+extern "C" void gballoc_deinit(void);
+extern "C" void* gballoc_malloc(size_t size);
+extern "C" void* gballoc_calloc(size_t nmemb, size_t size);
+extern "C" void* gballoc_realloc(void* ptr, size_t size);
+extern "C" void gballoc_free(void* ptr);
+
+namespace BASEIMPLEMENTATION
+{
+    /*if malloc is defined as gballoc_malloc at this moment, there'd be serious trouble*/
+#define Lock(x) (LOCK_OK + gballocState - gballocState) /*compiler warning about constant in if condition*/
+#define Unlock(x) (LOCK_OK + gballocState - gballocState)
+#define Lock_Init() (LOCK_HANDLE)0x42
+#define Lock_Deinit(x) (LOCK_OK + gballocState - gballocState)
+#include "gballoc.c"
+#undef Lock
+#undef Unlock
+#undef Lock_Init
+#undef Lock_Deinit
+};
+
+#define TEST_NODE_SIZE 24
+
+static size_t currentmalloc_call;
+static size_t whenShallmalloc_fail;
+
+TYPED_MOCK_CLASS(CNodePoolMocks, CGlobalMock)
+{
+public:
+
+    MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
+        void* result2;
+        currentmalloc_call++;
+        if ((whenShallmalloc_fail > 0) && (currentmalloc_call == whenShallmalloc_fail))
+        {
+            result2 = NULL;
+        }
+        else
+        {
+            result2 = BASEIMPLEMENTATION::gballoc_malloc(size);
+        }
+    MOCK_METHOD_END(void*, result2);
+
+    MOCK_STATIC_METHOD_1(, void, gballoc_free, void*, ptr)
+        BASEIMPLEMENTATION::gballoc_free(ptr);
+    MOCK_VOID_METHOD_END()
+};
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CNodePoolMocks, , void*, gballoc_malloc, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CNodePoolMocks, , void, gballoc_free, void*, ptr);
+
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(nodepool_unittests)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+
+        currentmalloc_call = 0;
+        whenShallmalloc_fail = 0;
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    /*Tests_SRS_NODEPOOL_02_001: [ If nodeSize is 0 then NodePool_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(NodePool_Create_with_0_nodeSize_fails)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+
+        ///act
+        NODEPOOL_HANDLE pool = NodePool_Create(0, 4);
+
+        ///assert
+        ASSERT_IS_NULL(pool);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_NODEPOOL_02_002: [ NodePool_Create shall allocate memory for the pool and shall not allocate any slab. ]*/
+    /*Tests_SRS_NODEPOOL_02_004: [ Otherwise NodePool_Create shall succeed and return a non-NULL handle. ]*/
+    TEST_FUNCTION(NodePool_Create_succeeds)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(pool);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(int, 0, NodePool_GetStats(pool, &stats));
+        ASSERT_ARE_EQUAL(size_t, 0, stats.capacity);
+        ASSERT_ARE_EQUAL(size_t, 0, stats.inUse);
+
+        ///cleanup
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_003: [ If allocating memory fails then NodePool_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(NodePool_Create_fails_when_malloc_fails)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+
+        whenShallmalloc_fail = currentmalloc_call + 1;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+
+        ///assert
+        ASSERT_IS_NULL(pool);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_NODEPOOL_02_005: [ If pool is NULL then NodePool_Destroy shall do nothing. ]*/
+    TEST_FUNCTION(NodePool_Destroy_with_NULL_does_nothing)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+
+        ///act
+        NodePool_Destroy(NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_NODEPOOL_02_006: [ NodePool_Destroy shall free all the slabs of the pool and the pool itself. ]*/
+    TEST_FUNCTION(NodePool_Destroy_frees_all_the_slabs)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 1);
+        NodePool_Free(NodePool_Alloc(pool));
+        (void)NodePool_Reserve(pool, 3);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(pool));
+
+        ///act
+        NodePool_Destroy(pool);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_NODEPOOL_02_007: [ If pool is NULL then NodePool_Reserve shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(NodePool_Reserve_with_NULL_pool_fails)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+
+        ///act
+        int result = NodePool_Reserve(NULL, 3);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_NODEPOOL_02_009: [ Otherwise NodePool_Reserve shall allocate one slab for the missing nodes. ]*/
+    TEST_FUNCTION(NodePool_Reserve_allocates_one_slab)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        int result = NodePool_Reserve(pool, 10);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 10, stats.capacity);
+
+        ///cleanup
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_008: [ If the pool already owns count nodes or more then NodePool_Reserve shall succeed and return 0. ]*/
+    TEST_FUNCTION(NodePool_Reserve_does_not_allocate_when_the_pool_is_big_enough)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+        (void)NodePool_Reserve(pool, 10);
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = NodePool_Reserve(pool, 7);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 10, stats.capacity);
+
+        ///cleanup
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_009: [ Otherwise NodePool_Reserve shall allocate one slab for the missing nodes. ]*/
+    TEST_FUNCTION(NodePool_Reserve_only_allocates_the_missing_nodes)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+        (void)NodePool_Reserve(pool, 3);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        int result = NodePool_Reserve(pool, 8);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 8, stats.capacity);
+
+        ///cleanup
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_010: [ If allocating the slab fails then NodePool_Reserve shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(NodePool_Reserve_fails_when_malloc_fails)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+        mocks.ResetAllCalls();
+
+        whenShallmalloc_fail = currentmalloc_call + 1;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        int result = NodePool_Reserve(pool, 10);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 0, stats.capacity);
+
+        ///cleanup
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_011: [ If pool is NULL then NodePool_SetGrowth shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(NodePool_SetGrowth_with_NULL_pool_fails)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+
+        ///act
+        int result = NodePool_SetGrowth(NULL, 3);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_NODEPOOL_02_012: [ Otherwise NodePool_SetGrowth shall use growth as the number of nodes of every slab allocated afterwards and return 0. ]*/
+    TEST_FUNCTION(NodePool_SetGrowth_changes_the_size_of_the_next_slab)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = NodePool_SetGrowth(pool, 7);
+        void* node = NodePool_Alloc(pool);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 7, stats.capacity);
+
+        ///cleanup
+        NodePool_Free(node);
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_013: [ If pool is NULL then NodePool_Alloc shall return NULL. ]*/
+    TEST_FUNCTION(NodePool_Alloc_with_NULL_pool_returns_NULL)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+
+        ///act
+        void* node = NodePool_Alloc(NULL);
+
+        ///assert
+        ASSERT_IS_NULL(node);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_NODEPOOL_02_015: [ Otherwise NodePool_Alloc shall count a miss and allocate a new slab of growth nodes. ]*/
+    /*Tests_SRS_NODEPOOL_02_018: [ NodePool_Alloc shall keep track of the number of nodes in use and of the highest such number. ]*/
+    TEST_FUNCTION(NodePool_Alloc_from_an_empty_pool_allocates_a_slab)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        void* node = NodePool_Alloc(pool);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(node);
+        mocks.AssertActualAndExpectedCalls();
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 0, stats.hits);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.misses);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.inUse);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.highWaterMark);
+        ASSERT_ARE_EQUAL(size_t, 4, stats.capacity);
+
+        ///cleanup
+        NodePool_Free(node);
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_014: [ If the pool has a free node then NodePool_Alloc shall hand it out and count a hit. ]*/
+    TEST_FUNCTION(NodePool_Alloc_from_a_reserved_pool_does_not_allocate)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+        (void)NodePool_Reserve(pool, 2);
+        mocks.ResetAllCalls();
+
+        ///act
+        void* node1 = NodePool_Alloc(pool);
+        void* node2 = NodePool_Alloc(pool);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(node1);
+        ASSERT_IS_NOT_NULL(node2);
+        ASSERT_ARE_NOT_EQUAL(void_ptr, node1, node2);
+        mocks.AssertActualAndExpectedCalls();
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 2, stats.hits);
+        ASSERT_ARE_EQUAL(size_t, 0, stats.misses);
+
+        ///cleanup
+        NodePool_Free(node1);
+        NodePool_Free(node2);
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_014: [ If the pool has a free node then NodePool_Alloc shall hand it out and count a hit. ]*/
+    /*Tests_SRS_NODEPOOL_02_020: [ NodePool_Free shall put a node that belongs to a slab back in the free list of its pool. ]*/
+    TEST_FUNCTION(NodePool_Alloc_reuses_a_freed_node)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 1);
+        void* node = NodePool_Alloc(pool);
+        mocks.ResetAllCalls();
+
+        ///act
+        NodePool_Free(node);
+        void* node2 = NodePool_Alloc(pool);
+
+        ///assert
+        ASSERT_ARE_EQUAL(void_ptr, node, node2);
+        mocks.AssertActualAndExpectedCalls();
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.hits);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.misses);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.highWaterMark);
+
+        ///cleanup
+        NodePool_Free(node2);
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_018: [ NodePool_Alloc shall keep track of the number of nodes in use and of the highest such number. ]*/
+    TEST_FUNCTION(NodePool_Alloc_keeps_the_high_water_mark)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 2);
+        void* node1 = NodePool_Alloc(pool);
+        void* node2 = NodePool_Alloc(pool);
+        void* node3 = NodePool_Alloc(pool);
+        NodePool_Free(node2);
+        NodePool_Free(node3);
+
+        ///act
+        (void)NodePool_GetStats(pool, &stats);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 1, stats.inUse);
+        ASSERT_ARE_EQUAL(size_t, 3, stats.highWaterMark);
+        ASSERT_ARE_EQUAL(size_t, 4, stats.capacity);
+        ASSERT_ARE_EQUAL(size_t, 2, stats.misses);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.hits);
+
+        ///cleanup
+        NodePool_Free(node1);
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_016: [ If growth is 0 or the slab cannot be allocated then NodePool_Alloc shall allocate a single node from the heap. ]*/
+    /*Tests_SRS_NODEPOOL_02_021: [ NodePool_Free shall free a node that was allocated from the heap. ]*/
+    TEST_FUNCTION(NodePool_Alloc_with_0_growth_allocates_from_the_heap)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 0);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        void* node = NodePool_Alloc(pool);
+        ASSERT_IS_NOT_NULL(node);
+        NodePool_Free(node);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 0, stats.capacity);
+        ASSERT_ARE_EQUAL(size_t, 0, stats.inUse);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.misses);
+
+        ///cleanup
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_016: [ If growth is 0 or the slab cannot be allocated then NodePool_Alloc shall allocate a single node from the heap. ]*/
+    TEST_FUNCTION(NodePool_Alloc_falls_back_to_the_heap_when_the_slab_cannot_be_allocated)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 1000);
+        mocks.ResetAllCalls();
+
+        whenShallmalloc_fail = currentmalloc_call + 1;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        void* node = NodePool_Alloc(pool);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(node);
+        mocks.AssertActualAndExpectedCalls();
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 0, stats.capacity);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.inUse);
+
+        ///cleanup
+        NodePool_Free(node);
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_017: [ If no memory can be allocated then NodePool_Alloc shall return NULL. ]*/
+    TEST_FUNCTION(NodePool_Alloc_fails_when_no_memory_is_available)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 0);
+        mocks.ResetAllCalls();
+
+        whenShallmalloc_fail = currentmalloc_call + 1;
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        void* node = NodePool_Alloc(pool);
+
+        ///assert
+        ASSERT_IS_NULL(node);
+        mocks.AssertActualAndExpectedCalls();
+        (void)NodePool_GetStats(pool, &stats);
+        ASSERT_ARE_EQUAL(size_t, 0, stats.inUse);
+
+        ///cleanup
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_019: [ If node is NULL then NodePool_Free shall do nothing. ]*/
+    TEST_FUNCTION(NodePool_Free_with_NULL_does_nothing)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+
+        ///act
+        NodePool_Free(NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_NODEPOOL_02_022: [ If pool or stats is NULL then NodePool_GetStats shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(NodePool_GetStats_with_NULL_pool_fails)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+
+        ///act
+        int result = NodePool_GetStats(NULL, &stats);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_NODEPOOL_02_022: [ If pool or stats is NULL then NodePool_GetStats shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(NodePool_GetStats_with_NULL_stats_fails)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = NodePool_GetStats(pool, NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        NodePool_Destroy(pool);
+    }
+
+    /*Tests_SRS_NODEPOOL_02_023: [ Otherwise NodePool_GetStats shall copy the usage counters of the pool in stats and return 0. ]*/
+    TEST_FUNCTION(NodePool_GetStats_succeeds)
+    {
+        ///arrange
+        CNodePoolMocks mocks;
+        NODEPOOL_STATS stats;
+        NODEPOOL_HANDLE pool = NodePool_Create(TEST_NODE_SIZE, 4);
+        void* node = NodePool_Alloc(pool);
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = NodePool_GetStats(pool, &stats);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, stats.hits);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.misses);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.inUse);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.highWaterMark);
+        ASSERT_ARE_EQUAL(size_t, 4, stats.capacity);
+
+        ///cleanup
+        NodePool_Free(node);
+        NodePool_Destroy(pool);
+    }
+
+END_TEST_SUITE(nodepool_unittests)
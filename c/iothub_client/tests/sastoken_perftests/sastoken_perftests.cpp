@@ -0,0 +1,109 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <cstdio>
+#include <cstring>
+
+#include "testrunnerswitcher.h"
+
+#include "azure_c_shared_utility/sastoken.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#define REQUEST_COUNT 20000
+#define TOKEN_LIFETIME_S 3600
+#define TOKEN_REFRESH_S (TOKEN_LIFETIME_S / 2) /*the default refresh time of the AMQP transport*/
+#define TEST_DEVICE_KEY "dGhpcyBpcyBub3QgYSByZWFsIGRldmljZSBrZXksIGp1c3QgMzIgYnl0ZXM="
+#define TEST_SCOPE "myhub.azure-devices.net/devices/mydevice"
+
+static double requestsPerSecond(size_t count, uint64_t elapsedMs)
+{
+    return (elapsedMs == 0) ? (double)count * 1000 : (double)count * 1000 / elapsedMs;
+}
+
+BEGIN_TEST_SUITE(sastoken_perftests)
+
+    /*authorizes REQUEST_COUNT requests twice: once signing a new SAS token for every request, the way HTTPAPIEX_SAS
+    does for every HTTP request, and once reusing a token that is signed again only every TOKEN_REFRESH_S seconds, the
+    way the AMQP transport puts tokens on the CBS. The difference is what signing costs the thread that moves telemetry.*/
+    TEST_FUNCTION(SASToken_Create_on_every_request_versus_cached_token)
+    {
+        // arrange
+        TICK_COUNTER_HANDLE tickCounter = tickcounter_create();
+        ASSERT_IS_NOT_NULL(tickCounter);
+        STRING_HANDLE key = STRING_construct(TEST_DEVICE_KEY);
+        STRING_HANDLE scope = STRING_construct(TEST_SCOPE);
+        STRING_HANDLE keyName = STRING_new();
+        ASSERT_IS_NOT_NULL(key);
+        ASSERT_IS_NOT_NULL(scope);
+        ASSERT_IS_NOT_NULL(keyName);
+        STRING_HANDLE cachedToken = NULL;
+        time_t cachedTokenCreateTime = 0;
+        size_t failedTokens = 0;
+        size_t tokensCreated = 0;
+        size_t authorizedBytes = 0;
+        uint64_t start;
+        uint64_t hotPathEnd;
+        uint64_t cachedEnd;
+        size_t i;
+
+        // act
+        (void)tickcounter_get_current_ms(tickCounter, &start);
+        for (i = 0; i < REQUEST_COUNT; i++)
+        {
+            STRING_HANDLE token = SASToken_Create(key, scope, keyName, (size_t)get_time(NULL) + TOKEN_LIFETIME_S);
+            if (token == NULL)
+            {
+                failedTokens++;
+            }
+            else
+            {
+                authorizedBytes += strlen(STRING_c_str(token));
+                STRING_delete(token);
+            }
+        }
+        (void)tickcounter_get_current_ms(tickCounter, &hotPathEnd);
+
+        for (i = 0; i < REQUEST_COUNT; i++)
+        {
+            time_t now = get_time(NULL);
+            if ((cachedToken == NULL) || (get_difftime(now, cachedTokenCreateTime) >= TOKEN_REFRESH_S))
+            {
+                STRING_delete(cachedToken);
+                cachedToken = SASToken_Create(key, scope, keyName, (size_t)now + TOKEN_LIFETIME_S);
+                cachedTokenCreateTime = now;
+                tokensCreated++;
+            }
+            if (cachedToken == NULL)
+            {
+                failedTokens++;
+            }
+            else
+            {
+                authorizedBytes += strlen(STRING_c_str(cachedToken));
+            }
+        }
+        (void)tickcounter_get_current_ms(tickCounter, &cachedEnd);
+
+        (void)printf("%d requests, a new SAS token per request: %.0f requests/s\r\n", REQUEST_COUNT, requestsPerSecond(REQUEST_COUNT, hotPathEnd - start));
+        (void)printf("%d requests, a cached SAS token (%lu signed): %.0f requests/s\r\n", REQUEST_COUNT, (unsigned long)tokensCreated, requestsPerSecond(REQUEST_COUNT, cachedEnd - hotPathEnd));
+
+        // assert
+        ASSERT_ARE_EQUAL(size_t, 0, failedTokens);
+        ASSERT_IS_TRUE(authorizedBytes > 0);
+        ASSERT_IS_TRUE(tokensCreated < REQUEST_COUNT);
+
+        // cleanup
+        STRING_delete(cachedToken);
+        STRING_delete(keyName);
+        STRING_delete(scope);
+        STRING_delete(key);
+        tickcounter_destroy(tickCounter);
+    }
+
+END_TEST_SUITE(sastoken_perftests)
@@ -67,7 +67,15 @@ public final class DeviceClient
                 IotHubEventCallback callback,
                 Pointer object)
     {
-        return Iothub_client_wrapperLibrary.INSTANCE.IoTHubClient_SendEventAsync(handle.getPointer(), message.getMessageHandle(), callback, object);
+        int result = Iothub_client_wrapperLibrary.INSTANCE.IoTHubClient_SendEventAsync_Move(handle.getPointer(), message.getMessageHandle(), callback, object);
+        
+        if (result == IOTHUB_CLIENT_RESULT.IOTHUB_CLIENT_OK)
+        {
+            // the client now owns the native message, it must not be destroyed from here anymore
+            message.releaseMessageHandle();
+        }
+        
+        return result;
     }
     
     public int setMessageCallback(IotHubMessageCallback messageCallback, Pointer userContextCallback)
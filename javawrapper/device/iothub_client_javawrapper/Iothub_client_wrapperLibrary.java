@@ -61,6 +61,10 @@ public interface Iothub_client_wrapperLibrary extends Library{
      * Original signature : IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE, IOTHUB_MESSAGE_HANDLE, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, void*)
      */
     public int IoTHubClient_SendEventAsync(Pointer iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IotHubEventCallback eventConfirmationCallback, Pointer userContextCallback);
+    /*
+     * Original signature : IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync_Move(IOTHUB_CLIENT_HANDLE, IOTHUB_MESSAGE_HANDLE, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, void*)
+     */
+    public int IoTHubClient_SendEventAsync_Move(Pointer iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IotHubEventCallback eventConfirmationCallback, Pointer userContextCallback);
     /*
      * Original signature : IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE, IOTHUB_CLIENT_STATUS*)
      */
@@ -106,7 +106,7 @@ public class Message
     
     public void destroy()
     {
-    	if (messageHandle.getPointer().getInt(0) != 0)
+    	if ((messageHandle != null) && (messageHandle.getPointer().getInt(0) != 0))
     	{
     		Iothub_client_wrapperLibrary.INSTANCE.IoTHubMessage_Destroy(messageHandle);
     		messageHandle.getPointer().setInt(0, 0);
@@ -118,6 +118,11 @@ public class Message
         return Message.messageHandle;
     }
     
+    void releaseMessageHandle()
+    {
+        messageHandle = null;
+    }
+    
     public void setMessageHandle(IOTHUB_MESSAGE_HANDLE _messageHandle)
     {
         messageHandle = _messageHandle;
@@ -759,7 +759,7 @@ typedef struct
 {
     boost::python::object messageCallback;
     boost::python::object userContext;
-    IoTHubMessage *eventMessage;
+    boost::python::object eventMessage;
 } SendContext;
 
 extern "C"
@@ -770,13 +770,10 @@ SendConfirmationCallback(
     )
 {
     SendContext *sendContext = (SendContext *)sendContextCallback;
-    IoTHubMessage *eventMessage = sendContext->eventMessage;
-    boost::python::object userContext = sendContext->userContext;
-    boost::python::object messageCallback = sendContext->messageCallback;
     {
         ScopedGILAcquire acquire;
         try {
-            messageCallback(eventMessage, result, userContext);
+            sendContext->messageCallback(sendContext->eventMessage, result, sendContext->userContext);
         }
         catch (const boost::python::error_already_set)
         {
@@ -784,9 +781,9 @@ SendConfirmationCallback(
             // There is nothing we can do about it here.
             PyErr_Print();
         }
+        // the context holds python references, release them with the GIL held
+        delete sendContext;
     }
-    delete sendContext;
-    delete eventMessage;
 }
 
 typedef struct
@@ -958,28 +955,44 @@ public:
     }
 
     void SendEventAsync(
-        IoTHubMessage &eventMessage,
+        boost::python::object& eventMessage,
         boost::python::object& messageCallback,
         boost::python::object& userContext
         )
     {
+        boost::python::extract<IoTHubMessage&> message(eventMessage);
+        if (!message.check())
+        {
+            PyErr_SetString(PyExc_TypeError, "send_event_async expected type IoTHubMessage");
+            boost::python::throw_error_already_set();
+            return;
+        }
         if (!PyCallable_Check(messageCallback.ptr()))
         {
             PyErr_SetString(PyExc_TypeError, "send_event_async expected type callable");
             boost::python::throw_error_already_set();
             return;
         }
+        // the client takes ownership of this single copy, the callback gets back the caller's own message object
+        IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_Clone(message().Handle());
+        if (eventMessageHandle == NULL)
+        {
+            throw IoTHubMessageError(__func__, IOTHUB_MESSAGE_ERROR);
+        }
         IOTHUB_CLIENT_RESULT result;
         SendContext *sendContext = new SendContext();
         sendContext->messageCallback = messageCallback;
         sendContext->userContext = userContext;
-        sendContext->eventMessage = eventMessage.Clone();
+        sendContext->eventMessage = eventMessage;
         {
             ScopedGILRelease release;
-            result = IoTHubClient_SendEventAsync(iotHubClientHandle, eventMessage.Handle(), SendConfirmationCallback, sendContext);
+            result = IoTHubClient_SendEventAsync_Move(iotHubClientHandle, eventMessageHandle, SendConfirmationCallback, sendContext);
         }
         if (result != IOTHUB_CLIENT_OK)
         {
+            // ownership was not transferred
+            IoTHubMessage_Destroy(eventMessageHandle);
+            delete sendContext;
             throw IoTHubClientError(__func__, result);
         }
     }
@@ -1190,6 +1203,7 @@ BOOST_PYTHON_MODULE(IMPORT_NAME)
     enum_<IOTHUB_CLIENT_STATUS>("IoTHubClientStatus")
         .value("IDLE", IOTHUB_CLIENT_SEND_STATUS_IDLE)
         .value("BUSY", IOTHUB_CLIENT_SEND_STATUS_BUSY)
+        .value("FULL", IOTHUB_CLIENT_SEND_STATUS_FULL)
         ;
 
     enum_<IOTHUB_CLIENT_CONFIRMATION_RESULT>("IoTHubClientConfirmationResult")